@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <chrono>
@@ -16,6 +17,7 @@
 #include <pybind11/stl_bind.h>
 #pragma GCC diagnostic pop
 
+#include "broker/arrow.hh"
 #include "broker/backend.hh"
 #include "broker/backend_options.hh"
 #include "broker/configuration.hh"
@@ -40,6 +42,8 @@
 
 #include <memory>
 
+#include "data.h"
+
 namespace py = pybind11;
 
 extern void init_zeek(py::module& m);
@@ -51,6 +55,54 @@ PYBIND11_MAKE_OPAQUE(broker::set)
 PYBIND11_MAKE_OPAQUE(broker::table)
 PYBIND11_MAKE_OPAQUE(broker::vector)
 
+namespace {
+
+using data_subscriber_base
+  = broker::subscriber_base<broker::subscriber::value_type>;
+
+// Waits up to `secs` for the first message. Afterwards, takes what is
+// available without blocking. Requires the caller to release the GIL.
+std::vector<broker::data_message>
+poll_batch(data_subscriber_base& ep, size_t max_items, double secs) {
+  std::vector<broker::data_message> res;
+  auto n = std::min(ep.available(), max_items);
+  if (n == 0 && max_items > 0 && secs > 0) {
+    if (auto x = ep.get(broker::to_duration(secs)))
+      res.emplace_back(std::move(*x));
+    n = std::min(ep.available(), max_items - res.size());
+  }
+  if (n > 0) {
+    res.reserve(res.size() + n);
+    for (auto& x : ep.get(n))
+      res.emplace_back(std::move(x));
+  }
+  return res;
+}
+
+// Owns the structs of an exported record batch until pyarrow imports them.
+struct arrow_export {
+  ArrowArray array;
+  ArrowSchema schema;
+
+  arrow_export() {
+    array.release = nullptr;
+    schema.release = nullptr;
+  }
+
+  arrow_export(const arrow_export&) = delete;
+
+  arrow_export& operator=(const arrow_export&) = delete;
+
+  ~arrow_export() {
+    if (array.release != nullptr)
+      array.release(&array);
+    if (schema.release != nullptr)
+      schema.release(&schema);
+  }
+};
+
+} // namespace
+
 PYBIND11_MODULE(_broker, m) {
   m.doc() = "Broker python bindings";
   py::module mb = m.def_submodule("zeek", "Zeek-specific bindings");
@@ -123,9 +175,11 @@ PYBIND11_MODULE(_broker, m) {
     .def("send_rate", &broker::publisher::send_rate)
     .def("fd", &broker::publisher::fd)
     .def("drop_all_on_destruction", &broker::publisher::drop_all_on_destruction)
-    .def("publish", (void (broker::publisher::*)(broker::data d)) &broker::publisher::publish)
+    .def("publish", (void (broker::publisher::*)(broker::data d)) &broker::publisher::publish,
+         py::call_guard<py::gil_scoped_release>())
     .def("publish_batch",
-       [](broker::publisher& p, std::vector<broker::data> xs) { p.publish(xs); });
+       [](broker::publisher& p, std::vector<broker::data> xs) { p.publish(xs); },
+       py::call_guard<py::gil_scoped_release>());
 
   using subscriber_base = broker::subscriber_base<broker::subscriber::value_type>;
   using topic_data_pair = std::pair<broker::topic, broker::data>;
@@ -144,7 +198,7 @@ PYBIND11_MODULE(_broker, m) {
          [](subscriber_base& ep) -> topic_data_pair {
        auto res = ep.get();
        return std::make_pair(broker::get_topic(res), broker::get_data(res));
-      })
+      }, py::call_guard<py::gil_scoped_release>())
 
     .def("get",
          [](subscriber_base& ep, double secs) -> broker::optional<topic_data_pair> {
@@ -155,7 +209,7 @@ PYBIND11_MODULE(_broker, m) {
           rval = caf::optional<topic_data_pair>(std::move(p));
         }
         return rval;
-	  })
+	  }, py::call_guard<py::gil_scoped_release>())
 
     .def("get",
          [](subscriber_base& ep, size_t num) -> std::vector<topic_data_pair> {
@@ -165,7 +219,7 @@ PYBIND11_MODULE(_broker, m) {
        for ( auto& e : res )
          rval.emplace_back(std::make_pair(broker::get_topic(e), broker::get_data(e)));
        return rval;
-      })
+      }, py::call_guard<py::gil_scoped_release>())
 
     .def("get",
          [](subscriber_base& ep, size_t num, double secs) -> std::vector<topic_data_pair> {
@@ -175,15 +229,67 @@ PYBIND11_MODULE(_broker, m) {
        for ( auto& e : res )
          rval.emplace_back(std::make_pair(broker::get_topic(e), broker::get_data(e)));
        return rval;
-	  })
+	  }, py::call_guard<py::gil_scoped_release>())
 
     .def("poll", &subscriber_base::poll)
+
+    .def("poll_into",
+         [](subscriber_base& ep, py::list& out, size_t max_items, double secs,
+            bool numeric_vectors) -> size_t {
+       std::vector<broker::data_message> res;
+       {
+         py::gil_scoped_release release;
+         res = poll_batch(ep, max_items, secs);
+       }
+       data_converter convert{numeric_vectors};
+       for (auto& x : res)
+         out.append(py::make_tuple(broker::get_topic(x).string(),
+                                   convert(broker::get_data(x))));
+       return res.size();
+      },
+      py::arg("out"), py::arg("max_items"), py::arg("secs") = 0.0,
+      py::arg("numeric_vectors") = false)
+
+    .def("poll_arrow",
+         [](subscriber_base& ep, size_t max_items, double secs,
+            const py::list& row_path, const py::list& names) {
+       std::vector<broker::count> path;
+       for (auto& x : row_path)
+         path.emplace_back(x.cast<broker::count>());
+       std::vector<std::string> column_names;
+       for (auto& x : names)
+         column_names.emplace_back(x.cast<std::string>());
+       auto result = std::make_unique<arrow_export>();
+       broker::error err;
+       {
+         py::gil_scoped_release release;
+         auto res = poll_batch(ep, max_items, secs);
+         err = broker::export_arrow(res, path, column_names, &result->array,
+                                    &result->schema);
+       }
+       if (err)
+         throw py::value_error(to_string(err));
+       return result;
+      },
+      py::arg("max_items"), py::arg("secs") = 0.0,
+      py::arg("row_path") = py::list(), py::arg("names") = py::list())
+
     .def("available", &subscriber_base::available)
     .def("fd", &subscriber_base::fd);
 
+  py::class_<arrow_export>(m, "ArrowExport")
+    .def("array_address",
+         [](arrow_export& x) {
+           return reinterpret_cast<uintptr_t>(&x.array);
+         })
+    .def("schema_address", [](arrow_export& x) {
+      return reinterpret_cast<uintptr_t>(&x.schema);
+    });
+
   py::class_<broker::subscriber, subscriber_base>(m, "Subscriber")
     .def("add_topic", &broker::subscriber::add_topic)
-    .def("remove_topic", &broker::subscriber::remove_topic);
+    .def("remove_topic", &broker::subscriber::remove_topic)
+    .def("update_topics", &broker::subscriber::update_topics);
 
   py::bind_vector<std::vector<broker::status_subscriber::value_type>>(m, "VectorStatusSubscriberValueType");
 
@@ -201,16 +307,17 @@ PYBIND11_MODULE(_broker, m) {
 
   py::class_<broker::status_subscriber> status_subscriber(m, "StatusSubscriber");
   status_subscriber
-    .def("get", (broker::status_subscriber::value_type (broker::status_subscriber::*)()) &broker::status_subscriber::get)
+    .def("get", (broker::status_subscriber::value_type (broker::status_subscriber::*)()) &broker::status_subscriber::get,
+         py::call_guard<py::gil_scoped_release>())
     .def("get",
          [](broker::status_subscriber& ep, double secs) -> broker::optional<broker::status_subscriber::value_type> {
-	   return ep.get(broker::to_duration(secs)); })
+	   return ep.get(broker::to_duration(secs)); }, py::call_guard<py::gil_scoped_release>())
     .def("get",
          [](broker::status_subscriber& ep, size_t num) -> std::vector<broker::status_subscriber::value_type> {
-	   return ep.get(num); })
+	   return ep.get(num); }, py::call_guard<py::gil_scoped_release>())
     .def("get",
          [](broker::status_subscriber& ep, size_t num, double secs) -> std::vector<broker::status_subscriber::value_type> {
-	   return ep.get(num, broker::to_duration(secs)); })
+	   return ep.get(num, broker::to_duration(secs)); }, py::call_guard<py::gil_scoped_release>())
     .def("poll",
          [](broker::status_subscriber& ep) -> std::vector<broker::status_subscriber::value_type> {
 	   return ep.poll(); })
@@ -235,6 +342,7 @@ PYBIND11_MODULE(_broker, m) {
     .def_readwrite("ttl", &broker::broker_options::ttl)
     .def_readwrite("forward", &broker::broker_options::forward)
     .def_readwrite("ignore_broker_conf", &broker::broker_options::ignore_broker_conf)
+    .def_readwrite("fast_start", &broker::broker_options::fast_start)
     .def_readwrite("use_real_time", &broker::broker_options::use_real_time);
 
   // We need a configuration class here that's separate from
@@ -278,21 +386,22 @@ PYBIND11_MODULE(_broker, m) {
         }))
     .def("__repr__", [](const broker::endpoint& e) { return to_string(e.node_id()); })
     .def("node_id", [](const broker::endpoint& e) { return to_string(e.node_id()); })
-    .def("listen", &broker::endpoint::listen, py::arg("address"), py::arg("port") = 0)
+    .def("listen", &broker::endpoint::listen, py::arg("address"), py::arg("port") = 0,
+         py::call_guard<py::gil_scoped_release>())
     .def("peer",
          [](broker::endpoint& ep, std::string& addr, uint16_t port, double retry) -> bool {
 	 return ep.peer(addr, port, std::chrono::seconds((int)retry));},
-         py::arg("addr"), py::arg("port"), py::arg("retry") = 10.0
-         )
+         py::arg("addr"), py::arg("port"), py::arg("retry") = 10.0,
+         py::call_guard<py::gil_scoped_release>())
     .def("peer_nosync",
          [](broker::endpoint& ep, std::string& addr, uint16_t port, double retry) {
 	 ep.peer_nosync(addr, port, std::chrono::seconds((int)retry));},
          py::arg("addr"), py::arg("port"), py::arg("retry") = 10.0
          )
-    .def("unpeer", &broker::endpoint::unpeer)
+    .def("unpeer", &broker::endpoint::unpeer, py::call_guard<py::gil_scoped_release>())
     .def("unpeer_nosync", &broker::endpoint::unpeer_nosync)
-    .def("peers", &broker::endpoint::peers)
-    .def("peer_subscriptions", &broker::endpoint::peer_subscriptions)
+    .def("peers", &broker::endpoint::peers, py::call_guard<py::gil_scoped_release>())
+    .def("peer_subscriptions", &broker::endpoint::peer_subscriptions, py::call_guard<py::gil_scoped_release>())
     .def("forward", &broker::endpoint::forward)
     .def("publish", (void (broker::endpoint::*)(broker::topic t, broker::data d)) &broker::endpoint::publish)
     .def("publish", (void (broker::endpoint::*)(const broker::endpoint_info& dst, broker::topic t, broker::data d)) &broker::endpoint::publish)
@@ -307,16 +416,16 @@ PYBIND11_MODULE(_broker, m) {
     .def("make_publisher", &broker::endpoint::make_publisher)
     .def("make_subscriber", &broker::endpoint::make_subscriber, py::arg("topics"), py::arg("max_qsize") = 20)
     .def("make_status_subscriber", &broker::endpoint::make_status_subscriber, py::arg("receive_statuses") = false)
-    .def("shutdown", &broker::endpoint::shutdown)
+    .def("shutdown", &broker::endpoint::shutdown, py::call_guard<py::gil_scoped_release>())
     .def("attach_master",
          [](broker::endpoint& ep, const std::string& name, broker::backend type,
             const broker::backend_options& opts) -> broker::expected<broker::store> {
 	        return ep.attach_master(name, type, opts);
-	    })
+	    }, py::call_guard<py::gil_scoped_release>())
     .def("attach_clone",
          [](broker::endpoint& ep, const std::string& name) -> broker::expected<broker::store> {
 	        return ep.attach_clone(name);
-	    })
+	    }, py::call_guard<py::gil_scoped_release>())
    ;
 }
 
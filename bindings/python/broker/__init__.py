@@ -97,6 +97,7 @@ Table = _broker.Table
 Timespan = _broker.Timespan
 Timestamp = _broker.Timestamp
 Vector = _broker.Vector
+NumericVector = _broker.NumericVector
 
 def _make_topic(t):
     return (Topic(t) if not isinstance(t, Topic) else t)
@@ -145,6 +146,33 @@ class Subscriber:
         msgs = self._subscriber.poll()
         return [(d[0].string(), Data.to_py(d[1])) for d in msgs]
 
+    def poll_into(self, out, max_items=1024, timeout=0.0, numeric_vectors=False):
+        """Appends up to max_items (topic, value) pairs to the list out.
+
+        Waits up to timeout seconds for the first message and converts all
+        messages of the batch in a single call. With numeric_vectors, vectors
+        of only integers, counts, or reals become NumericVector objects that
+        support the buffer protocol (e.g., for numpy.asarray or memoryview).
+        Returns the number of appended pairs.
+        """
+        return self._subscriber.poll_into(out, max_items, timeout, numeric_vectors)
+
+    def poll_arrow(self, max_items=1024, timeout=0.0, row_path=(), names=None):
+        """Returns up to max_items messages as a pyarrow.RecordBatch.
+
+        Each message contributes the vector at row_path as one row, e.g.,
+        () for vectors or (2, 1) for the arguments of Zeek events. The
+        batch shares its buffers with Broker instead of converting each
+        value to a Python object. Columns use the given names or f0, f1, ...
+        Waits up to timeout seconds for the first message. Raises ValueError
+        if rows differ in length or type.
+        """
+        import pyarrow
+        x = self._subscriber.poll_arrow(max_items, timeout, list(row_path),
+                                        list(names or []))
+        return pyarrow.RecordBatch._import_from_c(x.array_address(),
+                                                  x.schema_address())
+
     def available(self):
         return self._subscriber.available()
 
@@ -157,6 +185,16 @@ class Subscriber:
     def remove_topic(self, topic, block=False):
         return self._subscriber.remove_topic(_make_topic(topic), block)
 
+    def update_topics(self, add=(), remove=(), block=False):
+        """Adds and removes many topics with a single filter update."""
+        return self._subscriber.update_topics(_make_topics(add),
+                                              _make_topics(remove), block)
+
+    def __aiter__(self):
+        """Supports "async for msg in subscriber" (see broker.aio)."""
+        from . import aio
+        return aio.SubscriberIterator(self)
+
 class StatusSubscriber(_broker.Subscriber):
     def __init__(self, internal_subscriber):
         self._subscriber = internal_subscriber
@@ -175,6 +213,11 @@ class StatusSubscriber(_broker.Subscriber):
     def fd(self):
         return self._subscriber.fd()
 
+    def __aiter__(self):
+        """Supports "async for x in subscriber" (see broker.aio)."""
+        from . import aio
+        return aio.SubscriberIterator(self)
+
     def _to_result(self, x):
         if isinstance(x, _broker.VectorStatusSubscriberValueType):
             return [self._to_error_or_status(xi) for xi in x]
@@ -259,6 +302,33 @@ class Store:
 
         return Data.to_py(keys.get()) if keys.is_valid() else None
 
+    # The asynchronous queries return asyncio futures that resolve to the
+    # same values as their blocking counterparts (see broker.aio).
+
+    def exists_async(self, key, loop=None):
+        from . import aio
+        key = Data.from_py(key)
+        return aio.query(lambda f: self._store.exists_async(key, f),
+                         Data.to_py, loop)
+
+    def get_async(self, key, loop=None):
+        from . import aio
+        key = Data.from_py(key)
+        return aio.query(lambda f: self._store.get_async(key, f),
+                         Data.to_py, loop)
+
+    def get_index_from_value_async(self, key, index, loop=None):
+        from . import aio
+        key = Data.from_py(key)
+        index = Data.from_py(index)
+        return aio.query(
+            lambda f: self._store.get_index_from_value_async(key, index, f),
+            Data.to_py, loop)
+
+    def keys_async(self, loop=None):
+        from . import aio
+        return aio.query(lambda f: self._store.keys_async(f), Data.to_py, loop)
+
     def put(self, key, value, expiry=None):
         key = Data.from_py(key)
         value = Data.from_py(value)
@@ -0,0 +1,80 @@
+"""asyncio integration for subscribers and stores (Python 3.5+).
+
+Subscribers become asynchronous iterators that suspend on the file
+descriptor of the subscriber, and store queries complete asyncio futures
+from the helper actor of the store. Nothing in this module polls.
+"""
+
+import asyncio
+import collections
+
+def _set_result(fut, value):
+    # The awaiting task may have given up on the future in the meantime.
+    if not fut.done():
+        fut.set_result(value)
+
+def _readable(fd, loop):
+    """Returns a future that completes once fd becomes readable."""
+    fut = loop.create_future()
+
+    def on_readable():
+        loop.remove_reader(fd)
+        _set_result(fut, None)
+
+    loop.add_reader(fd, on_readable)
+    fut.add_done_callback(lambda _: loop.remove_reader(fd))
+    return fut
+
+class SubscriberIterator:
+    """Yields the messages of a subscriber, waiting for new ones on the event
+    loop. Drains the subscriber in batches, but only after handing out all
+    messages of the previous batch. Hence, slow consumers still apply
+    backpressure to the publishers.
+    """
+    def __init__(self, subscriber, loop=None):
+        self._subscriber = subscriber
+        self._loop = loop
+        self._buf = collections.deque()
+
+    def __aiter__(self):
+        return self
+
+    async def __anext__(self):
+        # Without an explicit loop, wait on the loop that runs this task.
+        loop = self._loop or asyncio.get_event_loop()
+        while not self._buf:
+            self._buf.extend(self._subscriber.poll())
+            if not self._buf:
+                await _readable(self._subscriber.fd(), loop)
+        return self._buf.popleft()
+
+def watch(subscriber, callback, loop=None):
+    """Calls callback with each new batch of subscriber from the event loop.
+    Returns a function that stops watching the subscriber.
+    """
+    loop = loop or asyncio.get_event_loop()
+    fd = subscriber.fd()
+
+    def on_readable():
+        batch = subscriber.poll()
+        if batch:
+            callback(batch)
+
+    loop.add_reader(fd, on_readable)
+    return lambda: loop.remove_reader(fd)
+
+def query(issue, convert, loop=None):
+    """Returns a future for the result of an asynchronous store query. Calls
+    issue with the completion handler for the query. The handler runs in the
+    helper actor of the store and passes the converted result (None for
+    errors) to the event loop.
+    """
+    loop = loop or asyncio.get_event_loop()
+    fut = loop.create_future()
+
+    def done(x):
+        value = convert(x.get()) if x.is_valid() else None
+        loop.call_soon_threadsafe(_set_result, fut, value)
+
+    issue(done)
+    return fut
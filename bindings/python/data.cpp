@@ -1,13 +1,17 @@
 
 #include <cstdint>
+#include <cstring>
+#include <string>
 #include <utility>
 #include <array>
+#include <vector>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wpedantic"
 #include <pybind11/pybind11.h>
 #pragma GCC diagnostic pop
 
+#include "data.h"
 #include "set_bind.h"
 
 #include "broker/data.hh"
@@ -18,6 +22,148 @@
 namespace py = pybind11;
 using namespace pybind11::literals;
 
+namespace {
+
+// A homogeneous numeric vector in contiguous memory, exposed to Python via the
+// buffer protocol.
+struct numeric_vector {
+  std::vector<char> bytes;
+  std::string format;
+  size_t item_size;
+  size_t size;
+};
+
+template <class T>
+numeric_vector make_numeric_vector(const broker::vector& xs) {
+  numeric_vector result;
+  result.bytes.resize(xs.size() * sizeof(T));
+  result.format = py::format_descriptor<T>::format();
+  result.item_size = sizeof(T);
+  result.size = xs.size();
+  auto ptr = result.bytes.data();
+  for (auto& x : xs) {
+    memcpy(ptr, &caf::get<T>(x), sizeof(T));
+    ptr += sizeof(T);
+  }
+  return result;
+}
+
+} // namespace <anonymous>
+
+data_converter::data_converter(bool numeric_vectors)
+  : numeric_vectors_(numeric_vectors) {
+  // nop
+}
+
+py::object data_converter::operator()(const broker::data& x) {
+  switch (x.get_type()) {
+    case broker::data::type::none:
+      return py::none();
+    case broker::data::type::boolean:
+      return py::bool_(caf::get<broker::boolean>(x));
+    case broker::data::type::count:
+      return py::cast(count_type{caf::get<broker::count>(x)});
+    case broker::data::type::integer:
+      return py::int_(caf::get<broker::integer>(x));
+    case broker::data::type::real:
+      return py::float_(caf::get<broker::real>(x));
+    case broker::data::type::string: {
+      auto& str = caf::get<std::string>(x);
+      auto ptr = PyUnicode_DecodeUTF8(str.data(),
+                                      static_cast<Py_ssize_t>(str.size()),
+                                      nullptr);
+      if (ptr != nullptr)
+        return py::reinterpret_steal<py::object>(ptr);
+      // Same as Data.to_py: fall back to bytes for non-UTF-8 strings.
+      PyErr_Clear();
+      return py::bytes(str);
+    }
+    case broker::data::type::address:
+      return to_address(caf::get<broker::address>(x));
+    case broker::data::type::subnet: {
+      auto& sn = caf::get<broker::subnet>(x);
+      auto net = to_address(sn.network());
+      auto cls = ipaddress_.attr(sn.network().is_v4() ? "IPv4Network"
+                                                      : "IPv6Network");
+      return cls(net).attr("supernet")("new_prefix"_a = sn.length());
+    }
+    case broker::data::type::port:
+      return py::cast(caf::get<broker::port>(x));
+    case broker::data::type::timestamp: {
+      if (!datetime_)
+        datetime_ = py::module::import("datetime");
+      if (!utc_)
+        utc_ = py::module::import("broker").attr("utc");
+      double secs;
+      broker::convert(caf::get<broker::timestamp>(x), secs);
+      return datetime_.attr("datetime").attr("fromtimestamp")(secs, utc_);
+    }
+    case broker::data::type::timespan: {
+      if (!datetime_)
+        datetime_ = py::module::import("datetime");
+      double secs;
+      broker::convert(caf::get<broker::timespan>(x), secs);
+      return datetime_.attr("timedelta")("seconds"_a = secs);
+    }
+    case broker::data::type::enum_value:
+      return py::cast(caf::get<broker::enum_value>(x));
+    case broker::data::type::set: {
+      py::set result;
+      for (auto& y : caf::get<broker::set>(x))
+        result.add((*this)(y));
+      return std::move(result);
+    }
+    case broker::data::type::table: {
+      py::dict result;
+      for (auto& kvp : caf::get<broker::table>(x))
+        result[(*this)(kvp.first)] = (*this)(kvp.second);
+      return std::move(result);
+    }
+    case broker::data::type::vector: {
+      auto& xs = caf::get<broker::vector>(x);
+      if (numeric_vectors_ && !xs.empty()) {
+        auto result = to_numeric_vector(xs);
+        if (result)
+          return result;
+      }
+      py::tuple result(xs.size());
+      for (size_t i = 0; i < xs.size(); ++i)
+        result[i] = (*this)(xs[i]);
+      return std::move(result);
+    }
+    default:
+      throw py::type_error("unsupported data type: "
+                           + std::to_string(static_cast<int>(x.get_type())));
+  }
+}
+
+py::object data_converter::to_address(const broker::address& x) {
+  if (!ipaddress_)
+    ipaddress_ = py::module::import("ipaddress");
+  auto& bytes = x.bytes();
+  auto first = reinterpret_cast<const char*>(bytes.data());
+  if (x.is_v4())
+    return ipaddress_.attr("IPv4Address")(py::bytes(first + 12, 4));
+  return ipaddress_.attr("IPv6Address")(py::bytes(first, bytes.size()));
+}
+
+py::object data_converter::to_numeric_vector(const broker::vector& xs) {
+  auto type = xs.front().get_type();
+  for (auto& x : xs)
+    if (x.get_type() != type)
+      return py::object{};
+  switch (type) {
+    case broker::data::type::integer:
+      return py::cast(make_numeric_vector<broker::integer>(xs));
+    case broker::data::type::count:
+      return py::cast(make_numeric_vector<broker::count>(xs));
+    case broker::data::type::real:
+      return py::cast(make_numeric_vector<broker::real>(xs));
+    default:
+      return py::object{};
+  }
+}
+
 void init_data(py::module& m) {
 
   py::class_<broker::address> address_type{m, "Address"};
@@ -53,19 +199,6 @@ void init_data(py::module& m) {
     .value("Host", broker::address::byte_order::host)
     .value("Network", broker::address::byte_order::network);
 
-  // A thin wrapper around the 'count' type, because Python has no notion of
-  // unsigned integers.
-  struct count_type {
-    count_type(broker::count c) : value{c} {}
-    bool operator==(const count_type& other) const { return value == other.value; }
-    bool operator!=(const count_type& other) const { return value != other.value; }
-    bool operator<(const count_type& other) const { return value < other.value; }
-    bool operator<=(const count_type& other) const { return value <= other.value; }
-    bool operator>(const count_type& other) const { return value > other.value; }
-    bool operator>=(const count_type& other) const { return value >= other.value; }
-    broker::count value;
-  };
-
   py::class_<count_type>(m, "Count")
     .def(py::init<py::int_>())
     .def_readwrite("value", &count_type::value)
@@ -170,6 +303,13 @@ void init_data(py::module& m) {
 
   py::bind_vector<broker::vector>(m, "Vector");
 
+  py::class_<numeric_vector>(m, "NumericVector", py::buffer_protocol())
+    .def_buffer([](numeric_vector& v) -> py::buffer_info {
+        return py::buffer_info(v.bytes.data(), v.item_size, v.format, 1,
+                               {v.size}, {v.item_size});
+        })
+    .def("__len__", [](const numeric_vector& v) { return v.size; });
+
   py::class_<broker::data> data_type{m, "Data"};
   data_type
     .def(py::init<>())
@@ -216,6 +356,9 @@ void init_data(py::module& m) {
 	})
     .def("as_vector", [](const broker::data& d) { return caf::get<broker::vector>(d); })
     .def("get_type", &broker::data::get_type)
+    .def("to_py", [](const broker::data& d, bool numeric_vectors) {
+        return data_converter{numeric_vectors}(d);
+        }, "numeric_vectors"_a = false)
     .def("__str__", [](const broker::data& d) { return broker::to_string(d); })
     .def(py::self < py::self)
     .def(py::self <= py::self)
@@ -240,6 +383,7 @@ void init_data(py::module& m) {
     .value("Table", broker::data::type::table)
     .value("Timespan", broker::data::type::timespan)
     .value("Timestamp", broker::data::type::timestamp)
-    .value("Vector", broker::data::type::vector);
+    .value("Vector", broker::data::type::vector)
+    .value("PackedData", broker::data::type::packed_data);
 }
 
@@ -0,0 +1,45 @@
+#pragma once
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#include <pybind11/pybind11.h>
+#pragma GCC diagnostic pop
+
+#include "broker/data.hh"
+
+// A thin wrapper around the 'count' type, because Python has no notion of
+// unsigned integers.
+struct count_type {
+  count_type(broker::count c) : value{c} {}
+  bool operator==(const count_type& other) const { return value == other.value; }
+  bool operator!=(const count_type& other) const { return value != other.value; }
+  bool operator<(const count_type& other) const { return value < other.value; }
+  bool operator<=(const count_type& other) const { return value <= other.value; }
+  bool operator>(const count_type& other) const { return value > other.value; }
+  bool operator>=(const count_type& other) const { return value >= other.value; }
+  broker::count value;
+};
+
+// Converts Broker data directly into the Python objects that `Data.to_py`
+// returns, without wrapping each value into a `Data` object first. Looks up
+// the Python modules for addresses and times only once, so callers should use
+// a single converter for an entire batch.
+class data_converter {
+public:
+  // Setting `numeric_vectors` converts non-empty vectors that contain only
+  // integers, only counts, or only reals into a `NumericVector`, which
+  // implements the buffer protocol, instead of into a tuple.
+  explicit data_converter(bool numeric_vectors = false);
+
+  pybind11::object operator()(const broker::data& x);
+
+private:
+  pybind11::object to_address(const broker::address& x);
+
+  pybind11::object to_numeric_vector(const broker::vector& xs);
+
+  bool numeric_vectors_;
+  pybind11::object ipaddress_;
+  pybind11::object datetime_;
+  pybind11::object utc_;
+};
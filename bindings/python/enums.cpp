@@ -67,5 +67,6 @@ void init_enums(py::module& m) {
     .value("Memory", broker::memory)
     .value("SQLite", broker::sqlite)
     .value("RocksDB", broker::rocksdb)
+    .value("LMDB", broker::lmdb)
     .export_values();
 }
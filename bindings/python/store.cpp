@@ -4,6 +4,7 @@
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wpedantic"
+#include <pybind11/functional.h>
 #include <pybind11/pybind11.h>
 #pragma GCC diagnostic pop
 
@@ -37,10 +38,33 @@ void init_store(py::module& m) {
   py::class_<broker::store> store(m, "Store");
   store
     .def("name", &broker::store::name)
-    .def("exists", (broker::expected<broker::data> (broker::store::*)(broker::data d) const) &broker::store::exists)
-    .def("get", (broker::expected<broker::data> (broker::store::*)(broker::data d) const) &broker::store::get)
-    .def("get_index_from_value", (broker::expected<broker::data> (broker::store::*)(broker::data d, broker::data index) const) &broker::store::get_index_from_value)
-    .def("keys", &broker::store::keys)
+    .def("exists", (broker::expected<broker::data> (broker::store::*)(broker::data d) const) &broker::store::exists,
+         py::call_guard<py::gil_scoped_release>())
+    .def("get", (broker::expected<broker::data> (broker::store::*)(broker::data d) const) &broker::store::get,
+         py::call_guard<py::gil_scoped_release>())
+    .def("get_index_from_value", (broker::expected<broker::data> (broker::store::*)(broker::data d, broker::data index) const) &broker::store::get_index_from_value,
+         py::call_guard<py::gil_scoped_release>())
+    .def("keys", &broker::store::keys, py::call_guard<py::gil_scoped_release>())
+    // The callbacks run in the helper actor of the store. Pybind11 acquires
+    // the GIL before calling into Python.
+    .def("exists_async",
+         [](broker::store& st, broker::data key, broker::store::callback f) {
+           st.exists_async(std::move(key), std::move(f));
+         })
+    .def("get_async",
+         [](broker::store& st, broker::data key, broker::store::callback f) {
+           st.get_async(std::move(key), std::move(f));
+         })
+    .def("get_index_from_value_async",
+         [](broker::store& st, broker::data key, broker::data index,
+            broker::store::callback f) {
+           st.get_index_from_value_async(std::move(key), std::move(index),
+                                         std::move(f));
+         })
+    .def("keys_async",
+         [](broker::store& st, broker::store::callback f) {
+           st.keys_async(std::move(f));
+         })
     .def("put", &broker::store::put)
     .def("put_unique", &broker::store::put_unique)
     .def("erase", &broker::store::erase)
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "broker/data.hh"
+#include "broker/error.hh"
+#include "broker/message.hh"
+
+// The structs of the Arrow C data interface, as specified at
+// https://arrow.apache.org/docs/format/CDataInterface.html. Arrow libraries
+// for C++, Python, R, etc. import these structs without copying the buffers,
+// which spares Broker a dependency on Arrow.
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C" {
+
+struct ArrowSchema {
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+  void (*release)(struct ArrowSchema*);
+  void* private_data;
+};
+
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+  void (*release)(struct ArrowArray*);
+  void* private_data;
+};
+
+} // extern "C"
+
+#endif // ARROW_C_DATA_INTERFACE
+
+namespace broker {
+
+/// Converts a batch of homogeneous messages into a record batch, i.e., a
+/// struct array with one child array per column. Each message contributes
+/// one row: the vector at `row_path` in its content (see `get_field`), e.g.,
+/// `{}` for messages that are vectors themselves or `{2, 1}` for the
+/// arguments of Zeek events. The first row with a value for a column
+/// determines its type:
+/// - `boolean`, `count`, `integer`, and `real` map to the Arrow types
+///   `bool`, `uint64`, `int64`, and `double`
+/// - `timestamp` and `timespan` map to nanosecond `timestamp` and `duration`
+/// - all other values map to `utf8` in the notation of `to_string`
+/// - `nil` becomes a null value, and columns without any value have the
+///   Arrow type `null`
+/// Columns use the names in `names` or `f<i>` for the `i`-th column if
+/// `names` has no entry for it.
+/// @returns `ec::type_clash` if a message has no vector at `row_path`, if
+///          rows differ in length, or if a value does not match the type of
+///          its column. Leaves `array` and `schema` untouched on error.
+/// @post on success, `array` and `schema` own the batch until the caller
+///       (or an Arrow library importing them) calls their `release`.
+error export_arrow(const std::vector<data_message>& xs,
+                   const std::vector<count>& row_path,
+                   const std::vector<std::string>& names, ArrowArray* array,
+                   ArrowSchema* schema);
+
+} // namespace broker
@@ -35,17 +35,26 @@ using update = caf::update_atom;
 /// --- generic communication --------------------------------------------------
 
 using ack = caf::atom_constant<caf::atom("ack")>;
+using busy = caf::atom_constant<caf::atom("busy")>;
+using codec = caf::atom_constant<caf::atom("codec")>;
+using compress = caf::atom_constant<caf::atom("compress")>;
 using default_ = caf::atom_constant<caf::atom("default")>;
+using events = caf::atom_constant<caf::atom("events")>;
 using init = caf::atom_constant<caf::atom("init")>;
 using name = caf::atom_constant<caf::atom("name")>;
 using network = caf::atom_constant<caf::atom("network")>;
+using pack = caf::atom_constant<caf::atom("pack")>;
 using peer = caf::atom_constant<caf::atom("peer")>;
+using probe = caf::atom_constant<caf::atom("probe")>;
 using read = caf::atom_constant<caf::atom("read")>;
+using recording = caf::atom_constant<caf::atom("recording")>;
 using retry = caf::atom_constant<caf::atom("retry")>;
 using run = caf::atom_constant<caf::atom("run")>;
 using shutdown = caf::atom_constant<caf::atom("shutdown")>;
 using status = caf::atom_constant<caf::atom("status")>;
+using summary = caf::atom_constant<caf::atom("summary")>;
 using unpeer = caf::atom_constant<caf::atom("unpeer")>;
+using unreliable = caf::atom_constant<caf::atom("unreliable")>;
 using write = caf::atom_constant<caf::atom("write")>;
 
 /// --- communication with workers ---------------------------------------------
@@ -60,6 +69,7 @@ using clone = caf::atom_constant<caf::atom("clone")>;
 using decrement = caf::atom_constant<caf::atom("decrement")>;
 using erase = caf::atom_constant<caf::atom("erase")>;
 using expire = caf::atom_constant<caf::atom("expire")>;
+using flush = caf::atom_constant<caf::atom("flush")>;
 using exists = caf::atom_constant<caf::atom("exists")>;
 using increment = caf::atom_constant<caf::atom("increment")>;
 using keys = caf::atom_constant<caf::atom("keys")>;
@@ -68,6 +78,7 @@ using store = caf::atom_constant<caf::atom("store")>;
 using subtract = caf::atom_constant<caf::atom("subtract")>;
 using local = caf::atom_constant<caf::atom("local")>;
 using resolve = caf::atom_constant<caf::atom("resolve")>;
+using scan = caf::atom_constant<caf::atom("scan")>;
 using stale_check = caf::atom_constant<caf::atom("stale")>;
 using mutable_check = caf::atom_constant<caf::atom("mutable")>;
 using sync_point = caf::atom_constant<caf::atom("sync_point")>;
@@ -77,6 +88,11 @@ using sync_point = caf::atom_constant<caf::atom("sync_point")>;
 using no_events = caf::atom_constant<caf::atom("noEvents")>;
 using subscriptions = caf::atom_constant<caf::atom("subs")>;
 using snapshot = caf::atom_constant<caf::atom("snapshot")>;
+using standby = caf::atom_constant<caf::atom("standby")>;
+using stale = caf::atom_constant<caf::atom("stale")>;
+using metrics = caf::atom_constant<caf::atom("metrics")>;
+using stats = caf::atom_constant<caf::atom("stats")>;
+using worker = caf::atom_constant<caf::atom("worker")>;
 
 } // namespace atom
 } // namespace broker
@@ -7,6 +7,7 @@ enum backend {
   memory,   ///< An in-memory backend based on a simple hash table.
   sqlite,   ///< A SQLite3 backend.
   rocksdb,  ///< A RocksDB backend.
+  lmdb,     ///< An LMDB backend.
 };
 
 } // namespace broker
@@ -1,11 +1,15 @@
 #pragma once
 
 #include "broker/address.hh"
+#include "broker/arrow.hh"
 #include "broker/atoms.hh"
+#include "broker/change_subscriber.hh"
 #include "broker/config.hh"
+#include "broker/consumer_group.hh"
 #include "broker/convert.hh"
 #include "broker/data.hh"
 #include "broker/endpoint.hh"
+#include "broker/shared_system.hh"
 #include "broker/status_subscriber.hh"
 #include "broker/port.hh"
 #include "broker/publisher.hh"
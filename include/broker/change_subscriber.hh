@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+
+#include <caf/actor.hpp>
+#include <caf/meta/type_name.hpp>
+
+#include "broker/data.hh"
+#include "broker/fwd.hh"
+#include "broker/subscriber_base.hh"
+
+namespace broker {
+
+/// A modification of a data store as seen by its master.
+struct store_change {
+  enum class kind : uint8_t {
+    /// Inserts or updates `key`. Also reports the result of increments,
+    /// appends, and other modifications of existing values.
+    put,
+    /// Removes `key` on request of a user.
+    erase,
+    /// Removes `key` after it expired.
+    expire,
+    /// Removes all keys. Leaves `key` empty.
+    clear,
+  };
+
+  kind type = kind::put;
+
+  data key;
+
+  /// The new value for `put` events, empty otherwise.
+  data value;
+};
+
+/// @relates store_change
+const char* to_string(store_change::kind x);
+
+/// @relates store_change
+template <class Inspector>
+typename Inspector::result_type inspect(Inspector& f, store_change& x) {
+  return f(caf::meta::type_name("store_change"), x.type, x.key, x.value);
+}
+
+/// Provides blocking access to the changes of a data store without keeping a
+/// copy of its content. Each subscriber receives the changes of all keys that
+/// start with its prefix and `clear` events.
+class change_subscriber : public subscriber_base<store_change> {
+public:
+  // --- friend declarations ---------------------------------------------------
+
+  friend class store;
+
+  // --- member types ----------------------------------------------------------
+
+  using super = subscriber_base<store_change>;
+
+  // --- constructors and destructors ------------------------------------------
+
+  change_subscriber(change_subscriber&&) = default;
+
+  change_subscriber& operator=(change_subscriber&&) = default;
+
+  ~change_subscriber();
+
+  // --- properties ------------------------------------------------------------
+
+  const caf::actor& worker() const {
+    return worker_;
+  }
+
+  const std::string& prefix() const {
+    return prefix_;
+  }
+
+private:
+  // -- force users to use `store::subscribe_changes` --------------------------
+  change_subscriber(const caf::actor& frontend, std::string prefix);
+
+  caf::actor worker_;
+
+  std::string prefix_;
+};
+
+} // namespace broker
@@ -24,6 +24,12 @@ struct broker_options {
   /// Whether to ignore the `broker.conf` file.
   bool ignore_broker_conf = false;
 
+  /// Whether to start quickly at the cost of throughput, e.g., for tools that
+  /// publish a few messages or run a single store query. Implies
+  /// `ignore_broker_conf` and defaults to two scheduler threads without
+  /// separate BASP workers.
+  bool fast_start = false;
+
   broker_options() = default;
 
   broker_options(const broker_options&) = default;
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <caf/meta/type_name.hpp>
+#include <caf/string_view.hpp>
+
+namespace broker {
+
+/// Selects how a consumer group distributes messages among its members.
+enum class group_policy : uint8_t {
+  /// Hands each message to the next member in turn.
+  round_robin,
+  /// Hands all messages on the same topic to the same member for as long as
+  /// the group does not change, which preserves the order per topic.
+  key_hash,
+};
+
+/// @relates group_policy
+const char* to_string(group_policy x);
+
+/// @relates group_policy
+bool convert(caf::string_view x, group_policy& y);
+
+/// Names a group of subscribers that share the messages on their topics. The
+/// core delivers each message to only one member of the group among the
+/// members with a matching filter. Groups are local to an endpoint, i.e.,
+/// subscribers with the same group name on different endpoints form separate
+/// groups. All members of a group must agree on the policy; the first member
+/// decides.
+struct consumer_group {
+  std::string name;
+
+  group_policy policy = group_policy::round_robin;
+
+  bool empty() const noexcept {
+    return name.empty();
+  }
+};
+
+/// @relates consumer_group
+inline bool operator==(const consumer_group& x, const consumer_group& y) {
+  return x.name == y.name && x.policy == y.policy;
+}
+
+/// @relates consumer_group
+template <class Inspector>
+typename Inspector::result_type inspect(Inspector& f, consumer_group& x) {
+  return f(caf::meta::type_name("consumer_group"), x.name, x.policy);
+}
+
+} // namespace broker
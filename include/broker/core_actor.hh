@@ -1,6 +1,5 @@
 #pragma once
 
-#include <fstream>
 #include <map>
 #include <unordered_map>
 #include <unordered_set>
@@ -15,16 +14,23 @@
 #include "broker/endpoint.hh"
 #include "broker/endpoint_info.hh"
 #include "broker/error.hh"
+#include "broker/event_filter.hh"
 #include "broker/filter_type.hh"
 #include "broker/logger.hh"
 #include "broker/network_info.hh"
 #include "broker/optional.hh"
 #include "broker/peer_info.hh"
 #include "broker/status.hh"
+#include "broker/time.hh"
 
+#include "broker/detail/backoff.hh"
 #include "broker/detail/core_policy.hh"
+#include "broker/detail/event_batcher.hh"
+#include "broker/detail/link_estimator.hh"
+#include "broker/detail/memory_accounting.hh"
 #include "broker/detail/network_cache.hh"
 #include "broker/detail/radix_tree.hh"
+#include "broker/detail/shared_subscriber_queue.hh"
 
 namespace broker {
 
@@ -38,6 +44,8 @@ struct core_state {
   struct pending_peer_state {
     caf::stream_slot slot;
     caf::response_promise rp;
+    /// Number of failed attempts for connecting to this peer so far.
+    size_t attempts;
   };
 
   using pending_peers_map = std::unordered_map<caf::actor, pending_peer_state>;
@@ -52,16 +60,62 @@ struct core_state {
 
   /// Establishes all invariants.
   void init(filter_type initial_filter, broker_options opts,
-            endpoint::clock* ep_clock);
+            endpoint::clock* ep_clock, detail::memory_accounting_ptr mem);
 
   // --- filter management -----------------------------------------------------
 
-  /// Sends the current filter to all peers.
+  /// Sends all topics added since the last update to all peers. Peers that
+  /// accept incremental updates only receive the new topics, all others
+  /// receive the full filter. Also sends `events` to all peers if it changed.
   void update_filter_on_peers();
 
-  /// Adds `xs` to our filter and update all peers on changes.
+  /// Adds `xs` to our filter and schedules an update of all peers on changes.
   void add_to_filter(filter_type xs);
 
+  /// Adds `xs` to our filter for subscribers that only handle the Zeek events
+  /// in `event_names` (or all messages if `event_names` is empty) and
+  /// schedules an update of all peers on changes.
+  void add_to_filter(filter_type xs,
+                     const std::vector<std::string>& event_names);
+
+  /// Sends pending changes to `filter` and `events` to our peers after
+  /// collecting further changes for `filter_update_delay`.
+  void schedule_filter_update();
+
+  /// Terminates the core once it sent all buffered messages to peers or
+  /// `shutdown_deadline` passed. Otherwise, checks again later.
+  void continue_shutdown();
+
+  /// Writes all messages that remain unsent to peers to the spill file (if
+  /// configured) or drops them.
+  /// @returns the number of unsent messages.
+  size_t spill_unsent();
+
+  /// Tells `hdl` which Zeek events we handle on our topics.
+  void announce_events(const caf::actor& hdl);
+
+  /// Tells `hdl` that we accept incremental filter updates.
+  void offer_filter_deltas(const caf::actor& hdl);
+
+  /// Returns the filter for peering handshakes. Once our filter reached
+  /// `filter_summary_threshold` topics, the handshake only carries a wildcard
+  /// and `offer_filter_summary` sends the actual subscriptions.
+  filter_type handshake_filter();
+
+  /// Sends a summary of our filter to `hdl` if `handshake_filter` sent only a
+  /// wildcard.
+  void offer_filter_summary(const caf::actor& hdl);
+
+  // --- store management ------------------------------------------------------
+
+  /// Opens a stream to the store actor `hdl` and forwards all messages for
+  /// `filter` to it.
+  caf::error attach_store(const caf::actor& hdl, filter_type filter);
+
+  /// Sends `result` to all clones waiting for the master of `name`.
+  void finish_master_lookup(const std::string& name,
+                            const caf::message& result);
+
   // --- convenience functions for querying state ------------------------------
 
   /// Returns whether `x` is either a pending peer or a connected peer.
@@ -76,16 +130,32 @@ struct core_state {
 
   // --- convenience functions for sending errors and events -------------------
 
+  /// Passes `msg` to local status subscribers, either right away or with the
+  /// next batch of `status_batcher`.
+  void emit_event(data_message msg);
+
+  /// Passes all events of the current batch to local status subscribers.
+  void flush_events();
+
+  /// Delivers `msg` to all local subscribers right away. Writes directly to
+  /// the queues of matching status subscribers.
+  void push_event(data_message msg);
+
   template <ec ErrorCode>
   void emit_error(caf::actor hdl, const char* msg) {
+    // Checking before resolving the address keeps floods of events for the
+    // same peer away from the network cache.
+    auto key = detail::event_batcher::make_key(
+      true, static_cast<uint8_t>(ErrorCode), hdl.address());
+    if (!status_batcher.admit(key))
+      return;
     auto emit = [=](network_info x) {
       BROKER_INFO("error" << ErrorCode << x);
       // TODO: consider creating the data directly rather than going through the
       //       error object and converting it.
       auto err
         = make_error(ErrorCode, endpoint_info{hdl.node(), std::move(x)}, msg);
-      governor->policy().local_push(
-        make_data_message(topics::errors, get_as<data>(err)));
+      emit_event(make_data_message(topics::errors, get_as<data>(err)));
     };
     if (self->node() != hdl.node())
       cache.fetch(hdl,
@@ -106,11 +176,14 @@ struct core_state {
     if (x)
       emit_error<ErrorCode>(std::move(*x), msg);
     else {
+      auto key = detail::event_batcher::make_key(
+        true, static_cast<uint8_t>(ErrorCode), inf);
+      if (!status_batcher.admit(key))
+        return;
       BROKER_INFO("error" << ErrorCode << inf);
       auto err
         = make_error(ErrorCode, endpoint_info{node_id(), std::move(inf)}, msg);
-      governor->policy().local_push(
-        make_data_message(topics::errors, get_as<data>(err)));
+      emit_event(make_data_message(topics::errors, get_as<data>(err)));
     }
   }
 
@@ -118,14 +191,17 @@ struct core_state {
   void emit_status(caf::actor hdl, const char* msg) {
     static_assert(StatusCode != sc::peer_added,
                   "Use emit_peer_added_status instead");
+    auto key = detail::event_batcher::make_key(
+      false, static_cast<uint8_t>(StatusCode), hdl.address());
+    if (!status_batcher.admit(key))
+      return;
     auto emit = [=](network_info x) {
       BROKER_INFO("status" << StatusCode << x);
       // TODO: consider creating the data directly rather than going through the
       //       status object and converting it.
       auto stat = status::make<StatusCode>(
         endpoint_info{hdl.node(), std::move(x)}, msg);
-      governor->policy().local_push(
-        make_data_message(topics::statuses, get_as<data>(stat)));
+      emit_event(make_data_message(topics::statuses, get_as<data>(stat)));
     };
     if (self->node() != hdl.node())
       cache.fetch(hdl,
@@ -137,6 +213,32 @@ struct core_state {
 
   void emit_peer_added_status(caf::actor hdl, const char* msg);
 
+  /// Tells `hdl` which compression algorithms we accept for batches.
+  void offer_compression(const caf::actor& hdl);
+
+  /// Tells `hdl` that we accept batches that share headers between messages.
+  void offer_packing(const caf::actor& hdl);
+
+  /// Tells `hdl` which encodings of ::data we accept in packed batches.
+  void offer_codec(const caf::actor& hdl);
+
+  // --- session resumption ----------------------------------------------------
+
+  /// Issues a token to `hdl` that allows it to resume the peering after a
+  /// disconnect within `resume_window`.
+  void offer_session(const caf::actor& hdl);
+
+  /// Ends the session of the peer `hdl`. Keeps `peer_filter` for resuming
+  /// the session later if `resumable` is `true`.
+  void suspend_session(const caf::actor& hdl, const filter_type& peer_filter,
+                       bool resumable);
+
+  /// Returns the filter of the suspended session of `hdl` if the session is
+  /// still valid, `token` matches, and `peer_digest` equals the digest of the
+  /// filter. Drops the session in any case, since tokens are single-use.
+  optional<filter_type> resume_session(const caf::actor& hdl, uint64_t token,
+                                       uint64_t peer_digest);
+
   template <sc StatusCode>
   void emit_status(caf::strong_actor_ptr hdl, const char* msg) {
     emit_status<StatusCode>(caf::actor_cast<caf::actor>(std::move(hdl)), msg);
@@ -144,6 +246,30 @@ struct core_state {
 
   void sync_with_status_subscribers(caf::actor new_peer);
 
+  // --- metrics ---------------------------------------------------------------
+
+  /// Returns a table with the current queue depth and credit per peer, the
+  /// number of copied local messages, the memory usage per subsystem, plus
+  /// the traffic statistics per topic (if enabled).
+  data metrics_snapshot();
+
+  /// Returns the summary of this endpoint for cluster-wide aggregation.
+  table metrics_summary();
+
+  /// Sends the summaries of this endpoint and all endpoints below it to the
+  /// peer configured as `broker.metrics.export-to`.
+  void export_metrics();
+
+  /// Sends a probe to each peer and updates the link estimates on response.
+  void probe_links();
+
+  /// Returns a table with the backpressure state of the core: its mailbox
+  /// size, queue depth, credit and unacknowledged batches per peer, buffered
+  /// batches of blocked peers, the number of local workers and stores, the
+  /// number of duplicates from peers and of copied local messages, and the
+  /// memory usage per subsystem.
+  table stats_snapshot();
+
   // --- member variables ------------------------------------------------------
 
   /// A copy of the current Broker configuration options.
@@ -155,9 +281,43 @@ struct core_state {
   /// Stores all clone actors created by this core.
   std::unordered_multimap<std::string, caf::actor> clones;
 
-  /// Requested topics on this core.
+  /// Stores all masters in standby mode created by this core. A standby moves
+  /// to `masters` after taking over from its primary.
+  std::unordered_map<std::string, caf::actor> standbys;
+
+  /// Stores clones waiting for a `master_resolver` by store name.
+  std::unordered_map<std::string, std::vector<caf::actor>>
+    pending_master_lookups;
+
+  /// Requested topics on this core in normalized form.
   filter_type filter;
 
+  /// Topics in `filter` that our peers do not know about yet.
+  filter_type filter_delta;
+
+  /// Time span for collecting changes to `filter` before updating peers.
+  timespan filter_update_delay;
+
+  /// Set to `true` while waiting for sending `filter_delta` to our peers.
+  bool filter_update_scheduled;
+
+  /// Minimum number of topics in `filter` for sending summaries instead of
+  /// the filter to new peers. 0 disables summaries.
+  size_t filter_summary_threshold;
+
+  /// Set to `true` once `filter` reached `filter_summary_threshold`. Never
+  /// changes back, because peers that received a wildcard must receive a
+  /// summary afterwards.
+  bool summarize_filter;
+
+  /// Names of the Zeek events that local subscribers handle per topic in
+  /// `filter`. Topics without an entry have at least one subscriber for all
+  /// messages.
+  event_filter events;
+
+  /// Set to `true` while our peers do not know the current `events` yet.
+  bool events_changed;
+
   /// Multiplexes local streams and streams for peers.
   governor_ptr governor;
 
@@ -174,30 +334,100 @@ struct core_state {
   /// Associates network addresses to remote actor handles and vice versa.
   detail::network_cache cache;
 
+  /// Computes the delays between reconnect attempts.
+  detail::backoff reconnect_backoff;
+
+  /// Remote peers that started a handshake with us (step #1) but did not
+  /// complete it yet (step #3).
+  std::unordered_set<caf::actor> inbound_handshakes;
+
+  /// Maximum size of `inbound_handshakes` before rejecting new peers.
+  size_t max_pending_handshakes;
+
+  /// State of a lost peer for resuming its session.
+  struct suspended_session {
+    uint64_t token;
+    filter_type filter;
+    timestamp expires;
+  };
+
+  /// Time span for lost peers to resume their session. 0 disables sessions.
+  timespan resume_window;
+
+  /// Tokens that we issued to connected peers.
+  std::unordered_map<caf::actor, uint64_t> session_tokens;
+
+  /// Sessions of lost peers that may resume within `resume_window`.
+  std::unordered_map<caf::actor_addr, suspended_session> suspended_sessions;
+
+  /// Tokens that peers issued to us. Presenting a token on reconnect allows
+  /// us to skip sending our filter.
+  std::unordered_map<caf::actor_addr, uint64_t> resume_tokens;
+
+  /// Number of masters (and clones) per data store. Each shard owns the keys
+  /// that hash to its index. A value of 1 disables sharding.
+  size_t store_shards;
+
   /// Name shown in logs for all instances of this actor.
   static const char* name;
 
   /// Set to `true` after receiving a shutdown message from the endpoint.
   bool shutting_down;
 
+  /// Point in time for giving up on sending buffered messages to peers after
+  /// receiving a shutdown message with a timeout.
+  timestamp shutdown_deadline;
+
+  /// Receives the number of unsent messages after a shutdown with a timeout.
+  caf::response_promise shutdown_promise;
+
   /// Required when spawning data stores.
   endpoint::clock* clock;
 
+  /// Approximates the memory usage of this endpoint per subsystem. Shared
+  /// with the endpoint, its subscribers and all data stores.
+  detail::memory_accounting_ptr memory;
+
+  /// RTT, jitter, and throughput estimates per peer, updated by link probes.
+  std::unordered_map<caf::actor, detail::link_estimator> links;
+
+  /// Metric summaries exported to this endpoint by its peers.
+  detail::metrics_aggregator cluster_metrics;
+
   /// Keeps track of all actors that subscribed to status updates.
   std::unordered_set<caf::actor> status_subscribers;
 
+  /// Queues of status subscribers with their filters. The core writes status
+  /// and error events straight into these queues instead of sending them
+  /// through the stream to the workers. Hence, congested data subscribers
+  /// never delay events such as a lost peer.
+  std::vector<std::pair<filter_type, detail::shared_subscriber_queue_ptr<>>>
+    status_queues;
+
   /// Keeps track of all actors that currently wait for handshakes to complete.
   std::unordered_map<caf::actor, size_t> peers_awaiting_status_sync;
 
-  /// Handle for recording all subscribed topics (if enabled).
-  std::ofstream topics_file;
+  /// Collects status and error events for emitting them at a bounded rate.
+  detail::event_batcher status_batcher;
+
+  /// Records all subscribed topics (if enabled). Runs detached to keep file
+  /// I/O off the core.
+  caf::actor topics_writer;
 
-  /// Handle for recording all peers (if enabled).
-  std::ofstream peers_file;
+  /// Records all peers (if enabled). Runs detached to keep file I/O off the
+  /// core.
+  caf::actor peers_writer;
 };
 
 caf::behavior core_actor(caf::stateful_actor<core_state>* self,
                          filter_type initial_filter, broker_options opts,
                          endpoint::clock* clock);
 
+/// Like `core_actor`, but shares the memory accounting with the endpoint
+/// instead of creating its own.
+caf::behavior accounted_core_actor(caf::stateful_actor<core_state>* self,
+                                   filter_type initial_filter,
+                                   broker_options opts, endpoint::clock* clock,
+                                   detail::memory_accounting_ptr memory);
+
 } // namespace broker
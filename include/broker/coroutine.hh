@@ -0,0 +1,181 @@
+#pragma once
+
+// Awaitables for C++20 coroutines. Broker itself builds as C++17, hence this
+// header only provides its content to applications that compile with
+// coroutine support. It defines `BROKER_HAS_COROUTINES` in this case.
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#define BROKER_HAS_COROUTINES
+
+#include <coroutine>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "broker/data.hh"
+#include "broker/error.hh"
+#include "broker/expected.hh"
+#include "broker/publisher.hh"
+#include "broker/store.hh"
+#include "broker/subscriber_base.hh"
+
+namespace broker {
+
+/// Calls a function once a file descriptor becomes readable. Connects the
+/// awaitables for subscribers and publishers to the event loop of the
+/// application, e.g., `epoll` or an Asio `posix::stream_descriptor`, by
+/// resuming the coroutine from that event loop.
+using fd_waiter = std::function<void(int fd, std::function<void()> f)>;
+
+/// Resumes a coroutine after a store query completed, e.g., by posting it to
+/// an executor. An empty resumer resumes the coroutine right away in the
+/// helper actor of the store, which requires the coroutine to neither block
+/// nor run for long until its next suspension point.
+using resumer = std::function<void(std::coroutine_handle<>)>;
+
+namespace detail {
+
+template <class ValueType>
+class next_batch_awaiter {
+public:
+  next_batch_awaiter(subscriber_base<ValueType>& sub, fd_waiter wait)
+    : sub_(sub), wait_(std::move(wait)) {
+    // nop
+  }
+
+  bool await_ready() {
+    buf_ = sub_.poll();
+    return !buf_.empty();
+  }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    wait_(sub_.fd(), [h] { h.resume(); });
+  }
+
+  std::vector<ValueType> await_resume() {
+    if (buf_.empty())
+      buf_ = sub_.poll();
+    return std::move(buf_);
+  }
+
+private:
+  subscriber_base<ValueType>& sub_;
+  fd_waiter wait_;
+  std::vector<ValueType> buf_;
+};
+
+class ready_awaiter {
+public:
+  ready_awaiter(publisher& pub, fd_waiter wait)
+    : pub_(pub), wait_(std::move(wait)) {
+    // nop
+  }
+
+  bool await_ready() const {
+    return pub_.free_capacity() > 0;
+  }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    wait_(static_cast<int>(pub_.fd()), [h] { h.resume(); });
+  }
+
+  void await_resume() const noexcept {
+    // nop
+  }
+
+private:
+  publisher& pub_;
+  fd_waiter wait_;
+};
+
+class query_awaiter {
+public:
+  /// Issues the query with the given completion handler.
+  using request_fn = std::function<void(store::callback)>;
+
+  query_awaiter(request_fn f, resumer res)
+    : f_(std::move(f)), res_(std::move(res)) {
+    // nop
+  }
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    f_([this, h](expected<data> x) {
+      result_ = std::move(x);
+      if (res_)
+        res_(h);
+      else
+        h.resume();
+    });
+  }
+
+  expected<data> await_resume() {
+    return std::move(result_);
+  }
+
+private:
+  request_fn f_;
+  resumer res_;
+  expected<data> result_ = make_error(ec::unspecified);
+};
+
+} // namespace detail
+
+/// Returns the next non-empty batch of `sub` when awaited. Completes right
+/// away if `sub` has buffered values, otherwise suspends until `wait` calls
+/// back for the file descriptor of `sub`.
+template <class ValueType>
+auto next_batch(subscriber_base<ValueType>& sub, fd_waiter wait) {
+  return detail::next_batch_awaiter<ValueType>{sub, std::move(wait)};
+}
+
+/// Completes when `pub` accepts items without blocking, i.e., when
+/// `try_publish` succeeds.
+inline auto ready(publisher& pub, fd_waiter wait) {
+  return detail::ready_awaiter{pub, std::move(wait)};
+}
+
+/// Returns the result of `get_async` when awaited.
+inline auto async_get(const store& st, data key, resumer res = {}) {
+  return detail::query_awaiter{
+    [&st, key{std::move(key)}](store::callback f) mutable {
+      st.get_async(std::move(key), std::move(f));
+    },
+    std::move(res)};
+}
+
+/// Returns the result of `exists_async` when awaited.
+inline auto async_exists(const store& st, data key, resumer res = {}) {
+  return detail::query_awaiter{
+    [&st, key{std::move(key)}](store::callback f) mutable {
+      st.exists_async(std::move(key), std::move(f));
+    },
+    std::move(res)};
+}
+
+/// Returns the result of `get_index_from_value_async` when awaited.
+inline auto async_get_index_from_value(const store& st, data key, data index,
+                                       resumer res = {}) {
+  return detail::query_awaiter{
+    [&st, key{std::move(key)}, index{std::move(index)}](
+      store::callback f) mutable {
+      st.get_index_from_value_async(std::move(key), std::move(index),
+                                    std::move(f));
+    },
+    std::move(res)};
+}
+
+/// Returns the result of `keys_async` when awaited.
+inline auto async_keys(const store& st, resumer res = {}) {
+  return detail::query_awaiter{
+    [&st](store::callback f) { st.keys_async(std::move(f)); },
+    std::move(res)};
+}
+
+} // namespace broker
+
+#endif // defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
@@ -4,6 +4,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -19,6 +20,7 @@
 #include "broker/fwd.hh"
 #include "broker/none.hh"
 #include "broker/optional.hh"
+#include "broker/packed_data.hh"
 #include "broker/port.hh"
 #include "broker/subnet.hh"
 #include "broker/time.hh"
@@ -63,7 +65,8 @@ using data_variant = caf::variant<
   enum_value,
   set,
   table,
-  vector
+  vector,
+  packed_data
 >;
 
 /// A variant class that may store the data associated with one of several
@@ -87,7 +90,9 @@ public:
     table,
     timespan,
     timestamp,
-    vector
+    vector,
+    // Comes last to keep the numeric values of all other tags stable.
+    packed_data
   };
 
 	template <class T>
@@ -115,7 +120,8 @@ public:
                     || std::is_same<T, port>::value
                     || std::is_same<T, broker::set>::value
                     || std::is_same<T, table>::value
-                    || std::is_same<T, vector>::value,
+                    || std::is_same<T, vector>::value
+                    || std::is_same<T, packed_data>::value,
                   T,
                   std::false_type
                 >
@@ -196,6 +202,7 @@ DATA_TAG_ORACLE(enum_value);
 DATA_TAG_ORACLE(set);
 DATA_TAG_ORACLE(table);
 DATA_TAG_ORACLE(vector);
+DATA_TAG_ORACLE(packed_data);
 
 #undef DATA_TAG_ORACLE
 
@@ -224,28 +231,55 @@ inline std::string to_string(const broker::data& d) {
   return s;
 }
 
+namespace detail {
+
+/// Compares two data instances by their type tags first and only inspects
+/// the values if the tags match. Visits each (nested) value exactly once.
+/// @returns a negative number if `x < y`, 0 if neither `x < y` nor `y < x`,
+///          and a positive number otherwise.
+int compare(const data& x, const data& y);
+
+/// Checks whether `x` and `y` store the same type and equal values.
+bool equals(const data& x, const data& y);
+
+/// Adds the type tag and the value of `x` (recursively) to `st`.
+void hash_append(hash_state& st, const data& x);
+
+/// @copydoc hash_append
+void hash_append(stable_hash_state& st, const data& x);
+
+/// Returns a hash of `x` that is the same on all platforms and never changes
+/// between versions: the FNV-1a hash over the index of the type in
+/// ::data_variant and the value, where integers, sizes, and the bits of reals
+/// are eight bytes in little-endian order. Any placement of keys that
+/// outlives the process (e.g., partitions on disk or shards across endpoints)
+/// must use this function rather than `std::hash<data>`.
+uint64_t stable_hash(const data& x);
+
+} // namespace detail
+
 inline bool operator<(const data& x, const data& y) {
-  return x.get_data() < y.get_data();
+  return detail::compare(x, y) < 0;
 }
 
 inline bool operator<=(const data& x, const data& y) {
-  return x.get_data() <= y.get_data();
+  return detail::compare(x, y) <= 0;
 }
 
 inline bool operator>(const data& x, const data& y) {
-  return x.get_data() > y.get_data();
+  return detail::compare(x, y) > 0;
 }
 
 inline bool operator>=(const data& x, const data& y) {
-  return x.get_data() >= y.get_data();
+  return detail::compare(x, y) >= 0;
 }
 
 inline bool operator==(const data& x, const data& y) {
-  return x.get_data() == y.get_data();
+  return detail::equals(x, y);
 }
 
 inline bool operator!=(const data& x, const data& y) {
-  return x.get_data() != y.get_data();
+  return !detail::equals(x, y);
 }
 
 // --- compatibility/wrapper functionality (may be removed later) --------------
@@ -279,6 +313,20 @@ inline const T& get(const data& d) {
   throw bad_variant_access{};
 }
 
+/// Returns a view on the string stored in `d` without copying it.
+/// @throws bad_variant_access if `d` does not hold a string.
+inline std::string_view get_string_view(const data& d) {
+  return get<std::string>(d);
+}
+
+/// Returns a view on the string stored in `d` or `none` if `d` does not hold
+/// a string.
+inline optional<std::string_view> get_if_string_view(const data& d) {
+  if (auto str = caf::get_if<std::string>(&d))
+    return std::string_view{*str};
+  return caf::none;
+}
+
 template <class Visitor>
 typename detail::remove_reference_t<Visitor>::result_type
 inline visit(Visitor&& visitor, data d) {
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <memory>
+
+#include "broker/data.hh"
+#include "broker/message.hh"
+#include "broker/topic.hh"
+
+namespace broker {
+
+/// A read-only view on the content of a ::data_message that defers decoding
+/// of packed payloads (see `pack`) until the first access. A view shares the
+/// underlying message, i.e., creating and copying views never copies the
+/// payload.
+class data_view {
+public:
+  // -- constructors, destructors, and assignment operators --------------------
+
+  explicit data_view(data_message msg);
+
+  data_view(const data_view&) = default;
+
+  data_view(data_view&&) = default;
+
+  data_view& operator=(const data_view&) = default;
+
+  data_view& operator=(data_view&&) = default;
+
+  // -- properties -------------------------------------------------------------
+
+  /// Returns the topic of the viewed message.
+  const topic& get_topic() const {
+    return caf::get<0>(msg_);
+  }
+
+  /// Returns whether the viewed message carries a packed payload.
+  bool packed() const;
+
+  /// Returns whether accessing the payload requires no further decoding.
+  bool decoded() const {
+    return decoded_ != nullptr || !packed();
+  }
+
+  /// Returns the payload, decoding it first if necessary.
+  /// @returns a pointer to the payload or `nullptr` if the message carries an
+  ///          invalid packed payload.
+  const data* get() const;
+
+  /// Returns the viewed message.
+  const data_message& message() const noexcept {
+    return msg_;
+  }
+
+private:
+  data_message msg_;
+
+  /// Stores the decoded payload for packed messages. Copies of a view share
+  /// the decoded payload if the original decoded it before copying.
+  mutable std::shared_ptr<data> decoded_;
+};
+
+/// @relates data_view
+inline data_view make_data_view(data_message msg) {
+  return data_view{std::move(msg)};
+}
+
+} // namespace broker
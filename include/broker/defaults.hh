@@ -1,7 +1,12 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 #include "caf/string_view.hpp"
 
+#include "broker/time.hh"
+
 // This header contains hard-coded default values for various Broker options.
 
 namespace broker {
@@ -11,5 +16,360 @@ extern const caf::string_view recording_directory;
 
 extern const size_t output_generator_file_cap;
 
+/// Maximum number of messages waiting for the recorder thread.
+extern const size_t recording_queue_size;
+
+/// Either "block" or "drop". Configures whether the core waits for the
+/// recorder thread or discards messages when the recording queue is full.
+extern const caf::string_view recording_overflow;
+
+/// Maximum size of a recording segment in bytes before Broker starts a new
+/// segment. 0 disables size-based rotation.
+extern const size_t recording_segment_size;
+
+/// Maximum time span covered by a recording segment before Broker starts a
+/// new segment. 0 disables time-based rotation.
+extern const timespan recording_segment_duration;
+
+/// Maximum number of recording segments on disk. Broker deletes the oldest
+/// segment when exceeding this limit. 0 keeps all segments.
+extern const size_t recording_max_segments;
+
+/// Records every n-th published message on topics without a sample rule.
+/// 1 records all messages and 0 records none.
+extern const size_t recording_sample_rate;
+
+/// Factor for growing the delay between reconnect attempts to a peer.
+extern const double reconnect_backoff_factor;
+
+/// Upper bound for the delay between reconnect attempts.
+extern const timespan reconnect_max_delay;
+
+/// Fraction of the delay between reconnect attempts that Broker randomizes.
+extern const double reconnect_jitter;
+
+/// Time span for a lost peer to resume its session via token, i.e., without
+/// sending its filter again. 0 disables session resumption.
+extern const timespan peer_resume_window;
+
+/// Maximum number of peering handshakes from remote nodes in progress at the
+/// same time. 0 disables the limit.
+extern const size_t max_pending_handshakes;
+
+/// Time span for collecting subscriptions before sending them to peers. 0
+/// still collects all subscriptions the core processes back-to-back.
+extern const timespan filter_update_delay;
+
+/// Minimum number of topics in the filter of a core for sending a summary
+/// instead of the full filter to new peers. 0 disables summaries.
+extern const size_t filter_summary_threshold;
+
+/// Time span for collecting status and error events before passing them to
+/// status subscribers as one batch. 0 passes each event right away.
+extern const timespan status_interval;
+
+/// Maximum number of status and error events per batch. 0 disables the
+/// limit.
+extern const size_t status_batch_size;
+
+/// Interval for forwarding coalesced messages to peers once their rate limit
+/// permits.
+extern const timespan rate_limit_flush_interval;
+
+/// Configures whether Broker sends control messages and store commands to
+/// peers ahead of other data.
+extern const bool peer_priorities;
+
+/// Number of helper actors for resolving host names of peers. 0 lets the
+/// middleman resolve host names while connecting.
+extern const size_t resolver_pool_size;
+
+/// Time span for caching resolved host names.
+extern const timespan resolver_cache_ttl;
+
+/// Maximum number of (estimated) bytes Broker keeps in memory for a blocked
+/// peer before spilling further batches to a temporary file.
+extern const size_t blocked_peer_buffer_size;
+
+/// Maximum number of buffered batches Broker handles at once when replaying
+/// a previously blocked peer.
+extern const size_t blocked_peer_replay_batches;
+
+/// Number of actors that decompress large batches from peers outside of the
+/// core actor. Zero decodes all batches in the core.
+extern const size_t decode_workers;
+
+/// Minimum uncompressed size of a batch in bytes before the core hands it to
+/// a decode worker.
+extern const size_t decode_offload_size;
+
+/// CPU for pinning the core actor to. Negative values disable pinning.
+extern const int core_cpu;
+
+/// NUMA node for binding all threads of the endpoint to. Negative values
+/// disable binding.
+extern const int numa_node;
+
+/// Configures whether Broker lets the kernel encrypt TLS records of peerings.
+extern const bool ktls;
+
+/// Number of messages from `endpoint::publish` that the endpoint collects
+/// before sending them to the core as one batch. Values below 2 disable
+/// batching.
+extern const size_t publish_batch_size;
+
+/// Maximum time that a message from `endpoint::publish` waits for more
+/// messages of its batch.
+extern const timespan publish_batch_delay;
+
+/// Compression algorithm for batches to peers that support it. Either
+/// "none", "lz4", or "zstd".
+extern const caf::string_view peer_compression;
+
+/// Minimum (estimated) number of bytes in a batch before Broker compresses
+/// it.
+extern const size_t peer_compression_min_size;
+
+/// Configures whether Broker sends batches that share headers between
+/// messages to peers that support them.
+extern const bool peer_packing;
+
+/// Configures whether Broker encodes data in packed batches with its compact
+/// encoding for peers that support it.
+extern const bool peer_compact_data;
+
+namespace publisher {
+
+/// Number of items a publisher can buffer before `publish` blocks.
+extern const size_t queue_size;
+
+/// Approximate payload size in bytes a publisher can buffer before `publish`
+/// blocks. 0 disables the limit.
+extern const size_t queue_bytes;
+
+/// Number of seconds for averaging the send rate of a publisher.
+extern const size_t rate_window;
+
+/// Upper bound for the time messages of a publisher wait in partial batches.
+/// 0 leaves batching to the stream parameters of CAF.
+extern const timespan latency_target;
+
+/// Maximum number of Zeek events a publisher packs into a single batch
+/// message. 0 disables batching.
+extern const size_t zeek_batch_size;
+
+/// Upper bound for the time Zeek events wait in partial batches.
+extern const timespan zeek_batch_latency;
+
+} // namespace publisher
+
+namespace subscriber {
+
+/// Configures whether subscribers replace Zeek batch messages with the
+/// messages they contain.
+extern const bool unpack_zeek_batches;
+
+/// Approximate payload size in bytes a subscriber buffers before it stops
+/// granting credit. 0 disables the limit.
+extern const size_t queue_bytes;
+
+/// Time span a message may wait in a subscriber queue before the subscriber
+/// discards it. 0 disables the limit.
+extern const timespan max_age;
+
+} // namespace subscriber
+
+namespace slow_peer {
+
+/// Time span a path to a peer may run out of credit before the core isolates
+/// the peer. 0 disables isolating slow peers.
+extern const timespan timeout;
+
+/// Treatment of messages for isolated peers. Either "buffer", "drop", or
+/// "sample/<n>".
+extern const caf::string_view policy;
+
+/// Maximum number of messages that an isolated peer may fall behind.
+extern const size_t buffer_size;
+
+} // namespace slow_peer
+
+namespace shutdown {
+
+/// Maximum time span for sending buffered messages to peers when shutting
+/// down an endpoint. 0 terminates the core immediately.
+extern const timespan timeout;
+
+/// Path of a file in the generator format for messages that the core could
+/// not send to peers before the timeout. Empty for dropping these messages.
+extern const caf::string_view spill_file;
+
+/// Interval for checking whether the core sent all buffered messages.
+extern const timespan check_interval;
+
+} // namespace shutdown
+
+namespace memory {
+
+/// Maximum bytes in the queues of all local subscribers. 0 disables the limit.
+extern const size_t subscriber_queues;
+
+/// Maximum bytes that the core buffers in memory for blocked peers. 0 disables
+/// the limit.
+extern const size_t blocked_peers;
+
+/// Maximum bytes in all master stores with a memory backend. 0 disables the
+/// limit.
+extern const size_t master_stores;
+
+/// Maximum bytes that clones buffer for local writes and remote updates. 0
+/// disables the limit.
+extern const size_t clone_buffers;
+
+} // namespace memory
+
+namespace metrics {
+
+/// Interval for publishing metrics to topics::metrics. 0 disables
+/// publishing.
+extern const timespan interval;
+
+/// Port for serving metrics in the Prometheus text format. 0 disables the
+/// server.
+extern const uint16_t port;
+
+/// Interval for probing the links to all peers. 0 disables probing.
+extern const timespan probe_interval;
+
+/// Address of the peer that receives metric summaries at each metrics
+/// interval, in the format `host:port`. Empty disables exporting.
+extern const caf::string_view export_to;
+
+/// Whether to combine imported summaries with the local summary before
+/// exporting them.
+extern const bool merge_summaries;
+
+/// Time after which imported summaries expire unless refreshed.
+extern const timespan summary_ttl;
+
+} // namespace metrics
+
+namespace store {
+
+/// Maximum number of key-value pairs per message when transferring a
+/// snapshot from a master to a clone.
+extern const size_t snapshot_chunk_size;
+
+/// Algorithm for compressing snapshot chunks to clones that support it.
+/// Either "none", "lz4", or "zstd".
+extern const caf::string_view snapshot_compression;
+
+/// Directory for recording the commands and queries of each master, or an
+/// empty string to disable workload recordings.
+extern const caf::string_view workload_directory;
+
+/// Time span for keeping a snapshot in memory on the master after reading it
+/// from the backend. All clones requesting a snapshot within this window
+/// share the same copy, as long as no modification took place.
+extern const timespan snapshot_cache_window;
+
+/// Number of commands a master keeps for resynchronizing clones after
+/// transient disconnects.
+extern const size_t replay_log_size;
+
+/// Granularity of expiration timers on the master. The master groups all keys
+/// that expire within the same interval into one bucket and expires them
+/// together, i.e., keys expire up to this amount of time late.
+extern const timespan expiry_resolution;
+
+/// Time span for collapsing successive updates to the same key on the master
+/// before sending them to clones. 0 disables coalescing.
+extern const timespan coalesce_window;
+
+/// Number of masters (and clones) per data store. 1 disables sharding. All
+/// endpoints of a cluster must use the same value.
+extern const size_t shards;
+
+/// Whether masters with a persistent backend (SQLite, RocksDB, or LMDB) run
+/// in their own thread instead of blocking a worker of the scheduler during
+/// disk I/O.
+extern const bool detach_persistent_masters;
+
+/// Whether masters with a memory backend publish a snapshot after each batch
+/// of modifications for serving local reads without a message round trip.
+extern const bool read_snapshots;
+
+/// Whether masters start serving requests before loading the expiration
+/// times of all keys from their backend.
+extern const bool deferred_expiries;
+
+/// Time span of upcoming expirations a master loads from its backend at once.
+/// The master loads the next window once half of the current one passed. 0
+/// loads all expirations at startup.
+extern const timespan expiry_window;
+
+/// Maximum number of expiration times a master with deferred expiries
+/// processes at once before handling other messages.
+extern const size_t expiry_load_chunk_size;
+
+/// Maximum time a data store may take for answering a request for its
+/// statistics before `endpoint::stats` leaves it out.
+extern const timespan stats_timeout;
+
+/// Maximum number of commands a clone buffers while its master is unavailable
+/// or while waiting for a snapshot, per buffer. 0 disables the limit.
+extern const size_t clone_buffer_size;
+
+/// Either "drop-oldest" or "spill". Configures whether clones discard their
+/// oldest buffered commands or write further commands to disk once a buffer
+/// is full.
+extern const caf::string_view clone_buffer_overflow;
+
+/// Lets endpoints forward updates from masters to clones on other peers,
+/// which allows a master to reach many clones over a few relays.
+extern const bool relay_clone_updates;
+
+/// Directory for persisting the content of clones across restarts. An empty
+/// string disables the cache.
+extern const caf::string_view clone_cache;
+
+/// Either "sqlite" or "rocksdb".
+extern const caf::string_view clone_cache_backend;
+
+/// Configures how often clones write modifications to their cache.
+extern const timespan clone_cache_interval;
+
+/// Lets clones with a cache ask for a copy of the files of their master
+/// instead of a snapshot if both use the same backend type.
+extern const bool clone_checkpoint_transfer;
+
+/// Lets clones answer queries from their previous content until a new
+/// snapshot has arrived completely.
+extern const bool clone_serve_stale;
+
+/// Lets clones expire keys on their own instead of waiting for erase commands
+/// from the master. Masters and clones of a store must agree on this setting.
+extern const bool clone_local_expiry;
+
+/// Maximum number of bytes per message when transferring the files of a
+/// backend checkpoint from a master to a clone.
+extern const size_t checkpoint_chunk_size;
+
+/// Number of bits per key in the Bloom filter that lets masters answer
+/// lookups for missing keys without querying their backend. 0 disables the
+/// filter.
+extern const size_t key_filter_bits_per_key;
+
+/// Number of threads per master that answer queries from read-only handles
+/// to the backend while the master applies modifications. Only applies to
+/// backends that support concurrent readers. 0 disables readers.
+extern const size_t read_workers;
+
+/// Interval at which a standby master tries to find its primary until it
+/// has one.
+extern const timespan standby_resolve_interval;
+
+} // namespace store
+
 } // namespace defaults
 } // namespace broker
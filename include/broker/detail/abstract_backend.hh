@@ -5,7 +5,14 @@
 #include "broker/optional.hh"
 #include "broker/snapshot.hh"
 
+#include <algorithm>
 #include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace broker {
 namespace detail {
@@ -13,6 +20,54 @@ namespace detail {
 using expirable = std::pair<broker::data, timestamp>;
 using expirables = std::deque<expirable>;
 
+/// Checks whether `key` is a string that starts with `prefix`.
+inline bool has_prefix(const data& key, const std::string& prefix) {
+  auto str = get_if<std::string>(key);
+  return str != nullptr && str->compare(0, prefix.size(), prefix) == 0;
+}
+
+/// A batch of key-value pairs that `abstract_backend::scan` visits.
+using scan_batch = std::vector<std::pair<data, data>>;
+
+/// Receives the batches of `abstract_backend::scan`. The callback may move
+/// entries out of the batch. Returning `false` stops the scan.
+using scan_callback = std::function<bool(scan_batch&)>;
+
+/// Groups the entries of a scan into batches for a `scan_callback`.
+class scan_batcher {
+public:
+  scan_batcher(size_t batch_size, const scan_callback& f)
+    : batch_size_(std::max(batch_size, size_t{1})), f_(f) {
+    buf_.reserve(batch_size_);
+  }
+
+  /// Passes the current batch to the callback if it is full.
+  /// @returns `false` if the callback stopped the scan.
+  bool flush_if_full() {
+    if (buf_.size() < batch_size_)
+      return true;
+    auto result = f_(buf_);
+    buf_.clear();
+    return result;
+  }
+
+  void push(data key, data value) {
+    buf_.emplace_back(std::move(key), std::move(value));
+  }
+
+  /// Passes the remaining entries to the callback.
+  void finish() {
+    if (!buf_.empty())
+      f_(buf_);
+    buf_.clear();
+  }
+
+private:
+  size_t batch_size_;
+  const scan_callback& f_;
+  scan_batch buf_;
+};
+
 /// Abstract base class for a key-value storage backend.
 class abstract_backend {
 public:
@@ -30,6 +85,15 @@ public:
   virtual expected<void> put(const data& key, data value,
                              optional<timestamp> expiry = {}) = 0;
 
+  /// Inserts or updates multiple key-value pairs. The default implementation
+  /// calls `put` for each entry. Backends with transaction support override
+  /// this function to apply all modifications at once.
+  /// @param entries The key-value pairs to update/insert.
+  /// @param expiry An optional expiration time for all entries.
+  /// @returns `nil` on success.
+  virtual expected<void> put_many(const std::unordered_map<data, data>& entries,
+                                  optional<timestamp> expiry = {});
+
   /// Adds one value to another value.
   /// @param key The key associated with the existing value to add to.
   /// @param value The value to add on top of the existing value at *key*.
@@ -54,6 +118,12 @@ public:
   /// exist.
   virtual expected<void> erase(const data& key) = 0;
 
+  /// Removes multiple keys and their associated values from the store. The
+  /// default implementation calls `erase` for each key.
+  /// @param keys The keys to remove.
+  /// @returns `nil` if all keys were removed successfully or did not exist.
+  virtual expected<void> erase_many(const std::vector<data>& keys);
+
   /// Empties out the store.
   /// @returns `nil` if the store was successfully emptied out.
   virtual expected<void> clear() = 0;
@@ -69,6 +139,23 @@ public:
   virtual expected<bool> expire(const data& key,
                                 timestamp current_time) = 0;
 
+  /// Removes all keys in `keys` that have an expiration in the past. The
+  /// default implementation calls `expire` for each key and ignores keys that
+  /// no longer exist. Backends with transaction support override this
+  /// function to apply all expirations at once.
+  /// @param keys The keys to expire.
+  /// @param current_time The time used to compare whether to actual
+  /// expire the given keys.
+  /// @returns The keys that were expired (and deleted).
+  virtual expected<std::vector<data>>
+  expire_many(const std::vector<data>& keys, timestamp current_time);
+
+  /// Commits all pending modifications. Backends that group multiple
+  /// modifications into a single transaction rely on the master to call this
+  /// function periodically (see `flush_interval`).
+  /// @returns `nil` on success.
+  virtual expected<void> flush();
+
   // --- inspectors -----------------------------------------------------------
 
   /// Retrieves the value associated with a given key.
@@ -82,6 +169,36 @@ public:
   /// @returns The *aspect* of the value at *key*.
   virtual expected<data> get(const data& key, const data& value) const;
 
+  /// Retrieves the values associated with multiple keys. The default
+  /// implementation calls `get` for each key.
+  /// @param keys The keys to use.
+  /// @returns A table with an entry for each key that exists in the store.
+  virtual expected<data> get_many(const std::vector<data>& keys) const;
+
+  /// Retrieves all entries with a string key that starts with `prefix`. The
+  /// default implementation filters a full snapshot of the store.
+  /// @param prefix The key prefix to match.
+  /// @param limit The maximum number of entries to return, or 0 for no limit.
+  /// @returns A table with the matching entries. If there are more than
+  ///          *limit* matches, it is unspecified which ones get returned.
+  virtual expected<data> scan(const std::string& prefix, size_t limit) const;
+
+  /// Visits all entries in batches of at most `batch_size` entries without
+  /// loading the whole store into memory. The order of the entries depends on
+  /// the backend. The default implementation sorts a full snapshot of the
+  /// store by key.
+  /// @param start The key to start at as returned by a previous scan, or `nil`
+  ///              to start at the first entry.
+  /// @param batch_size The maximum number of entries per batch.
+  /// @param f The callback for each batch. It must not modify the backend.
+  /// @returns The key for resuming the scan if *f* stopped it, or `nil` after
+  ///          visiting all entries. Resuming a scan after modifying the store
+  ///          may skip or repeat entries. Backends without an order on their
+  ///          keys fail with `ec::no_such_key` if *start* no longer exists.
+  virtual expected<optional<data>> scan(const optional<data>& start,
+                                        size_t batch_size,
+                                        const scan_callback& f) const;
+
   /// Checks if a key exists.
   /// @param key The key to check.
   /// @returns `true` if the *key* exists and `false` if it doesn't.
@@ -102,6 +219,36 @@ public:
 
   /// @returns the set of all keys that have expiry times.
   virtual expected<expirables> expiries() const = 0;
+
+  /// @returns all keys with an expiry time in the interval `(from, until]`.
+  /// @note The default implementation filters the result of `expiries`.
+  ///       Backends with an index on expiry times should override it.
+  virtual expected<expirables> expiries_between(timestamp from,
+                                                timestamp until) const;
+
+  /// @returns the maximum time between a modification and the next call to
+  ///          `flush`, or 0 if the backend commits each modification
+  ///          immediately.
+  virtual timespan flush_interval() const;
+
+  /// @returns the estimated number of bytes of all entries in memory, or 0 if
+  ///          the backend keeps its entries outside of the process.
+  virtual size_t memory_usage() const;
+
+  /// Opens an additional read-only handle to the same storage that may
+  /// answer queries in another thread while this backend applies
+  /// modifications. Readers only see committed modifications.
+  /// @returns the new handle or `nullptr` if the backend does not support
+  ///          concurrent readers, which is the default.
+  virtual std::unique_ptr<abstract_backend> make_reader() const;
+
+  /// Writes a consistent copy of all committed and pending modifications to
+  /// `path`, which must not exist yet. Opening a backend of the same type
+  /// with the option `path` set to `path` restores the copy.
+  /// @returns the names of all files in the copy.
+  /// @note The default implementation fails with `ec::backend_failure`.
+  virtual expected<std::vector<std::string>>
+  checkpoint(const std::string& path);
 };
 
 } // namespace detail
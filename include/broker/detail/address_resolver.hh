@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+#include <caf/actor.hpp>
+#include <caf/behavior.hpp>
+#include <caf/event_based_actor.hpp>
+#include <caf/fwd.hpp>
+
+namespace broker {
+namespace detail {
+
+/// Translates host names into numeric addresses. Runs blocking queries to the
+/// system resolver and thus should run in a detached actor.
+///
+/// Message interface:
+/// - `(atom::resolve, std::string host) -> std::string`
+caf::behavior address_resolver(caf::event_based_actor* self);
+
+/// Spawns `size` detached address resolvers behind a round-robin actor pool.
+/// The number of resolvers bounds the number of concurrent queries.
+caf::actor make_address_resolver_pool(caf::actor_system& sys,
+                                      caf::execution_unit* ctx, size_t size);
+
+} // namespace detail
+} // namespace broker
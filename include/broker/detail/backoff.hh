@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <random>
+
+#include "broker/time.hh"
+
+namespace broker {
+namespace detail {
+
+/// Computes delays for reconnect attempts. Each failed attempt multiplies the
+/// delay by `factor` up to `max_delay`. A `jitter` of `j` picks the actual
+/// delay uniformly from `[(1 - j) * d, d]` to keep peers that lost their
+/// connection at the same time from reconnecting at the same time.
+class backoff {
+public:
+  backoff();
+
+  backoff(double factor, timespan max_delay, double jitter);
+
+  /// Returns the delay before retry number `attempt` (starting at 0) for a
+  /// peer with the initial delay `base`. Never grows the delay beyond
+  /// `max(base, max_delay)`.
+  timespan delay(timespan base, size_t attempt);
+
+  double factor() const noexcept {
+    return factor_;
+  }
+
+  timespan max_delay() const noexcept {
+    return max_delay_;
+  }
+
+  double jitter() const noexcept {
+    return jitter_;
+  }
+
+private:
+  double factor_;
+  timespan max_delay_;
+  double jitter_;
+  std::minstd_rand rng_;
+};
+
+} // namespace detail
+} // namespace broker
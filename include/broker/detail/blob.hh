@@ -5,10 +5,18 @@
 
 #include <caf/binary_deserializer.hpp>
 #include <caf/binary_serializer.hpp>
+#include <caf/error.hpp>
+
+#include "broker/data.hh"
+#include "broker/detail/data_codec.hh"
+#include "broker/error.hh"
 
 namespace broker {
 namespace detail {
 
+/// Serializes all arguments with the binary serializer. Persistent stores
+/// keep this format for keys and values, since their databases outlive
+/// Broker versions.
 template <class T, class... Ts>
 auto to_blob(T&& x, Ts&&... xs) {
   typename caf::binary_serializer::container_type buf;
@@ -31,5 +39,25 @@ T from_blob(const Container& buf) {
   return from_blob<T>(buf.data(), buf.size());
 }
 
+/// Encodes `x` with ::data_codec, which results in smaller blobs than
+/// `to_blob` for most values.
+inline data_codec::buffer to_compact_blob(const data& x) {
+  data_codec::buffer buf;
+  data_codec::encode(x, buf);
+  return buf;
+}
+
+/// Decodes a blob from `to_compact_blob` into `x`. Fails unless the blob
+/// contains exactly one value.
+inline caf::error from_compact_blob(const void* buf, size_t size, data& x) {
+  auto first = reinterpret_cast<const char*>(buf);
+  auto last = first + size;
+  if (auto err = data_codec::decode(first, last, x))
+    return err;
+  if (first != last)
+    return make_error(ec::invalid_data, "trailing bytes after data");
+  return caf::none;
+}
+
 } // namespace detail
 } // namespace broker
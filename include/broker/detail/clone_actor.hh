@@ -1,6 +1,12 @@
 #pragma once
 
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <caf/actor.hpp>
@@ -9,7 +15,12 @@
 #include <caf/behavior.hpp>
 
 #include "broker/data.hh"
+#include "broker/detail/clone_cache.hh"
+#include "broker/detail/command_buffer.hh"
+#include "broker/detail/memory_accounting.hh"
 #include "broker/internal_command.hh"
+#include "broker/optional.hh"
+#include "broker/snapshot.hh"
 #include "broker/topic.hh"
 #include "broker/endpoint.hh"
 
@@ -26,7 +37,8 @@ public:
 
   /// Initializes the object.
   void init(caf::event_based_actor* ptr, std::string&& nm,
-            caf::actor&& parent, endpoint::clock* ep_clock);
+            caf::actor&& parent, endpoint::clock* ep_clock,
+            memory_accounting_ptr mem);
 
   /// Sends `x` to the master.
   void forward(internal_command&& x);
@@ -61,8 +73,129 @@ public:
 
   void operator()(clear_command&);
 
+  void operator()(put_many_command&);
+
+  void operator()(erase_many_command&);
+
+  void operator()(compare_and_swap_command&);
+
+  void operator()(add_and_get_command&);
+
+  /// Applies a command from the master unless we have seen it before.
+  void apply_remote(internal_command& cmd);
+
+  /// Applies one chunk of a snapshot transfer from the master.
+  void apply_snapshot_chunk(snapshot& chunk, uint64_t seq, bool last);
+
+  /// Writes one chunk of a checkpoint transfer from the master to the
+  /// staging area next to the cache and replaces the cache with the
+  /// checkpoint after the last chunk.
+  void apply_checkpoint_chunk(const std::string& file,
+                              const std::string& bytes, uint64_t seq,
+                              bool last);
+
+  /// Applies the missing commands after resynchronizing with the master.
+  void apply_deltas(std::vector<internal_command>& deltas);
+
+  /// Applies all updates that arrived while waiting for the snapshot.
+  /// Resynchronizes with the master if we had to drop updates.
+  void apply_pending_updates();
+
+  /// Stores `cmd` until the snapshot arrives.
+  void buffer_remote_update(internal_command&& cmd);
+
+  /// Applies `cmd` locally and stores it until we have a master.
+  void buffer_mutation(internal_command&& cmd);
+
+  /// Sends all buffered local writes to the master.
+  void flush_mutation_buffer();
+
+  /// Empties `mutation_buffer`.
+  void clear_mutation_buffer();
+
+  /// Empties `pending_remote_updates`.
+  void clear_pending_updates();
+
+  /// Checks whether `last_seq` allows us to request only the missing commands
+  /// from `new_master` instead of a full snapshot.
+  bool can_request_deltas(const caf::actor& new_master) const;
+
+  /// Requests all commands after `last_seq` from the master or a new snapshot
+  /// if we have no sequence number.
+  void request_resync();
+
+  /// Updates the expiration times of all keys that `cmd` touches if the clone
+  /// expires keys on its own.
+  void track_expiries(const internal_command::variant_type& cmd);
+
+  /// Sets the expiration time of `key` or clears it if `deadline` is none.
+  void set_deadline(const data& key, optional<timestamp> deadline);
+
+  /// Replaces all expiration times with `staged_deadlines` after receiving a
+  /// snapshot or checkpoint.
+  void adopt_staged_deadlines();
+
+  /// Erases all keys that expired until now, i.e., at least all keys in the
+  /// bucket for `deadline`.
+  void expire(timestamp deadline);
+
+  /// Marks the content as outdated until the clone is in sync again.
+  void begin_resync();
+
+  /// Returns for how long the content has been outdated or 0 if the clone is
+  /// in sync with its master.
+  timespan staleness() const;
+
+  /// Requests a checkpoint of the backend files from the master if enabled
+  /// and a full snapshot otherwise.
+  void request_snapshot();
+
+  /// Marks `key` as modified for the cache.
+  void modified(const data& key) {
+    if (cache)
+      cache->modified(key);
+  }
+
+  /// Marks the entire store as replaced for the cache.
+  void replaced() {
+    if (cache)
+      cache->replaced();
+  }
+
+  /// Writes all modifications since the last checkpoint to the cache.
+  void checkpoint();
+
+  /// Applies a local modification optimistically, i.e., before the master
+  /// confirms it. Gives users read-your-writes semantics on the clone.
+  void apply_local(const internal_command& cmd);
+
+  /// Drops optimistic modifications for all keys that `cmd` touches once the
+  /// master broadcasts the corresponding update.
+  void reconcile(const internal_command& cmd);
+
+  /// Marks `key` as locally modified with `value`, whereas `nullptr` denotes
+  /// a local erase.
+  void set_local(const data& key, const data* value);
+
+  /// Decrements the number of pending local writes for `key`.
+  void confirm_local(const data& key);
+
+  /// Reverts `apply_local` for a command that never reaches the master.
+  void discard_local(const internal_command& cmd);
+
+  /// Returns the value for `key`, taking pending local modifications into
+  /// account, or `nullptr` if no such key exists.
+  const data* lookup(const data& key) const;
+
   data keys() const;
 
+  /// Returns a table with an entry for each key in `xs` that exists.
+  data get_many(const vector& xs) const;
+
+  /// Returns up to `limit` entries with a string key that starts with
+  /// `prefix`, or all matching entries if `limit` is 0.
+  data scan(const std::string& prefix, size_t limit) const;
+
   caf::event_based_actor* self;
 
   std::string name;
@@ -75,20 +208,107 @@ public:
 
   std::unordered_map<data, data> store;
 
+  /// A local modification that the master did not confirm yet.
+  struct local_write {
+    /// The new value or `none` if the key was erased.
+    optional<data> value;
+
+    /// Number of local writes to this key without confirmation.
+    size_t pending;
+  };
+
+  /// Overlays `store` with local modifications that wait for confirmation
+  /// by the master, indexed by key.
+  std::unordered_map<data, local_write> local_writes;
+
   bool is_stale;
 
   double stale_time;
 
   double unmutable_time;
 
-  std::vector<internal_command> mutation_buffer;
+  /// Local writes while the master is unavailable.
+  command_buffer mutation_buffer;
+
+  /// Updates from the master while waiting for a snapshot.
+  command_buffer pending_remote_updates;
+
+  /// Number of local writes dropped from `mutation_buffer` since the last
+  /// flush.
+  size_t dropped_mutations;
 
-  std::vector<internal_command> pending_remote_updates;
+  /// Number of updates dropped from `pending_remote_updates` while waiting
+  /// for the current snapshot.
+  size_t dropped_updates;
 
   bool awaiting_snapshot;
 
   bool awaiting_snapshot_sync;
 
+  /// Stores whether we have received at least one chunk of the current
+  /// snapshot transfer.
+  bool receiving_snapshot;
+
+  /// Stores whether we keep answering queries from the previous content
+  /// while receiving a snapshot instead of from a partial snapshot.
+  bool serve_stale;
+
+  /// Collects the chunks of the current snapshot transfer if `serve_stale`.
+  snapshot staged_snapshot;
+
+  /// Time when the clone lost its sync with the master. Only valid while
+  /// awaiting a snapshot.
+  timestamp resync_start;
+
+  /// Sequence number of the last command from the master. Allows us to
+  /// resynchronize after transient disconnects by requesting only the missing
+  /// commands.
+  uint64_t last_seq;
+
+  /// Stores whether the clone expires keys on its own instead of waiting for
+  /// erase commands from the master.
+  bool local_expiry;
+
+  /// Maps keys to their expiration time if `local_expiry`.
+  std::unordered_map<data, timestamp> deadlines;
+
+  /// Maps deadlines to the keys that may expire at that time. Works like
+  /// `master_state::expiry_buckets`, i.e., entries may be outdated.
+  std::map<timestamp, std::vector<data>> expiry_buckets;
+
+  /// Expiration times that the master sent ahead of a snapshot or checkpoint.
+  table staged_deadlines;
+
+  /// Stores whether `deadlines` covers all keys in `store`. Content from the
+  /// cache lacks expiration times.
+  bool deadlines_known;
+
+  /// Persists `store` across restarts if enabled.
+  std::unique_ptr<clone_cache> cache;
+
+  /// Stores whether we ask the master for a checkpoint of its backend files
+  /// instead of a snapshot. Requires `cache`.
+  bool checkpoint_transfer;
+
+  /// The file of the current checkpoint transfer that receives the next
+  /// chunk.
+  std::ofstream checkpoint_file;
+
+  /// Path of `checkpoint_file` or an empty string if no transfer is active.
+  std::string checkpoint_file_name;
+
+  /// Stores whether we failed to write a chunk of the current checkpoint
+  /// transfer and only wait for its end.
+  bool checkpoint_failed;
+
+  /// Change subscribers on this endpoint with their prefix. The clone
+  /// registers them at each master it connects to.
+  std::vector<std::pair<std::string, caf::actor>> change_feeds;
+
+  /// Number of commands from the core that other stores on this endpoint
+  /// still referenced, forcing us to copy them before applying.
+  size_t unshares;
+
   endpoint::clock* clock;
 };
 
@@ -96,7 +316,8 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
                           caf::actor core, std::string name,
                           double resync_interval, double stale_interval,
                           double mutation_buffer_interval,
-                          endpoint::clock* ep_clock);
+                          endpoint::clock* ep_clock,
+                          memory_accounting_ptr memory);
 
 } // namespace detail
 } // namespace broker
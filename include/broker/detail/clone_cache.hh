@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <caf/error.hpp>
+#include <caf/fwd.hpp>
+#include <caf/string_view.hpp>
+
+#include "broker/backend.hh"
+#include "broker/data.hh"
+#include "broker/detail/abstract_backend.hh"
+
+namespace broker {
+namespace detail {
+
+/// Persists the content of a clone together with the sequence number of the
+/// last command from its master. Allows a restarting clone to serve reads
+/// from its local copy right away and to request only the commands it missed
+/// instead of a full snapshot.
+///
+/// The cache writes lazily: the clone marks modified keys and periodically
+/// calls `checkpoint`, which writes all modified entries together with the
+/// sequence number in a single `put_many`. Since erasing keys takes a
+/// separate write, checkpoints with erasures first invalidate the stored
+/// sequence number. Hence, a crash during a checkpoint never leaves a
+/// sequence number that does not match the persisted content.
+class clone_cache {
+public:
+  using content_type = std::unordered_map<data, data>;
+
+  explicit clone_cache(std::unique_ptr<abstract_backend> backend,
+                       backend type = backend::sqlite, std::string path = {});
+
+  clone_cache(const clone_cache&) = delete;
+
+  clone_cache& operator=(const clone_cache&) = delete;
+
+  /// Reads the persisted content into `content` and returns the sequence
+  /// number of the last persisted command. Returns 0 and leaves `content`
+  /// empty if the cache holds no consistent state.
+  uint64_t load(content_type& content);
+
+  /// Marks `key` as modified since the last checkpoint.
+  void modified(const data& key) {
+    if (!rewrite_)
+      dirty_.emplace(key);
+  }
+
+  /// Marks the entire content as replaced since the last checkpoint.
+  void replaced() {
+    rewrite_ = true;
+    dirty_.clear();
+  }
+
+  /// Checks whether the content or the sequence number changed since the
+  /// last checkpoint.
+  bool dirty(uint64_t seq) const noexcept {
+    return rewrite_ || !dirty_.empty() || seq != seq_;
+  }
+
+  /// Writes all modifications since the last checkpoint.
+  caf::error checkpoint(const content_type& content, uint64_t seq);
+
+  /// Returns the number of checkpoints so far.
+  size_t checkpoints() const noexcept {
+    return checkpoints_;
+  }
+
+  /// Returns the type of the backend.
+  backend type() const noexcept {
+    return type_;
+  }
+
+  /// Returns the location of the backend files or an empty string if
+  /// unknown.
+  const std::string& path() const noexcept {
+    return path_;
+  }
+
+  /// Replaces the backend files with the checkpoint of a master at `files`,
+  /// reads its content into `content`, and marks the content as reflecting
+  /// all commands up to `seq`.
+  /// @pre `!path().empty()`
+  caf::error adopt(const std::string& files, content_type& content,
+                   uint64_t seq);
+
+  /// Returns the key that stores the sequence number in the backend.
+  static const data& seq_key();
+
+private:
+  std::unique_ptr<abstract_backend> backend_;
+  backend type_;
+  std::string path_;
+  std::unordered_set<data> dirty_;
+  bool rewrite_ = false;
+  uint64_t seq_ = 0;
+  size_t checkpoints_ = 0;
+};
+
+/// Opens the cache for the clone `name` if `broker.store.clone-cache` names a
+/// directory. Returns `nullptr` if the cache is disabled or unavailable.
+/// @relates clone_cache
+std::unique_ptr<clone_cache> make_clone_cache(const caf::actor_system_config& cfg,
+                                              const std::string& name);
+
+/// @relates clone_cache
+bool convert(caf::string_view x, backend& y);
+
+} // namespace detail
+} // namespace broker
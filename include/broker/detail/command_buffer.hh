@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include <caf/binary_serializer.hpp>
+#include <caf/error.hpp>
+#include <caf/fwd.hpp>
+#include <caf/string_view.hpp>
+
+#include "broker/data.hh"
+#include "broker/detail/memory_accounting.hh"
+#include "broker/internal_command.hh"
+
+namespace broker {
+namespace detail {
+
+/// Buffers commands of a clone, e.g., local writes while the master is
+/// unavailable. Coalesces successive `put` and `erase` commands for the same
+/// key by discarding the older command and bounds the number of buffered
+/// commands. Always returns the remaining commands in insertion order.
+class command_buffer {
+public:
+  // --- member types ----------------------------------------------------------
+
+  /// Configures what happens once the buffer reaches its capacity or the
+  /// memory limit for clone buffers.
+  enum class overflow_policy {
+    /// Discard the oldest command to make room for the new one.
+    drop_oldest,
+    /// Write further commands to a temporary file.
+    spill,
+  };
+
+  /// Denotes why the buffer discarded a command.
+  enum class discard_reason {
+    /// A newer command for the same key replaced the command.
+    coalesced,
+    /// The buffer overflowed.
+    dropped,
+  };
+
+  /// Receives all commands that the buffer discards.
+  using discard_handler = std::function<void(const internal_command&,
+                                             discard_reason)>;
+
+  // --- construction and destruction ------------------------------------------
+
+  command_buffer();
+
+  command_buffer(const command_buffer&) = delete;
+
+  command_buffer& operator=(const command_buffer&) = delete;
+
+  /// Deletes the temporary file, if any.
+  ~command_buffer();
+
+  /// Sets the capacity (0 for no limit), the overflow policy, and the memory
+  /// accounting for this buffer.
+  /// @pre `empty()`
+  void init(caf::actor_system& sys, size_t capacity, overflow_policy policy,
+            memory_accounting_ptr memory);
+
+  /// Sets a callback for discarded commands.
+  void on_discard(discard_handler f) {
+    on_discard_ = std::move(f);
+  }
+
+  // --- buffer access ---------------------------------------------------------
+
+  /// Appends `cmd` to the buffer or merges it with a previous command for the
+  /// same key.
+  caf::error push(internal_command cmd);
+
+  /// Passes all buffered commands to `f` in insertion order and clears the
+  /// buffer afterwards.
+  template <class F>
+  caf::error drain(F f) {
+    for (auto& x : mem_)
+      if (x.live)
+        f(x.cmd);
+    auto spilled = spilled_;
+    internal_command cmd;
+    for (size_t i = 0; i < spilled; ++i) {
+      if (auto err = unspill(cmd)) {
+        clear();
+        return err;
+      }
+      f(cmd);
+    }
+    clear();
+    return caf::none;
+  }
+
+  /// Discards all commands.
+  void clear();
+
+  // --- properties ------------------------------------------------------------
+
+  bool empty() const noexcept {
+    return live_ == 0 && spilled_ == 0;
+  }
+
+  /// Returns the number of commands in memory and in the temporary file.
+  size_t size() const noexcept {
+    return live_ + spilled_;
+  }
+
+  /// Returns the estimated payload bytes of all commands in memory.
+  size_t memory_usage() const noexcept {
+    return memory_.bytes();
+  }
+
+  /// Returns the number of commands in the temporary file.
+  size_t spilled() const noexcept {
+    return spilled_;
+  }
+
+  /// Returns how many commands the buffer merged with newer commands.
+  size_t coalesced() const noexcept {
+    return coalesced_;
+  }
+
+  /// Returns how many commands the buffer dropped on overflow.
+  size_t dropped() const noexcept {
+    return dropped_;
+  }
+
+private:
+  struct entry {
+    internal_command cmd;
+    size_t size;
+    /// Set to `false` after coalescing the command with a newer one.
+    bool live;
+  };
+
+  /// Checks whether the buffer must make room before adding another command.
+  bool full() const noexcept;
+
+  /// Discards a buffered command for the same key if `cmd` replaces it.
+  void coalesce(const internal_command& cmd);
+
+  /// Updates `index_` for appending `cmd` at `pos`. Drops all keys of `cmd`
+  /// that `cmd` does not replace entirely, because `cmd` must stay ordered
+  /// after previous commands for these keys.
+  void index(const internal_command& cmd, size_t pos);
+
+  /// Discards the oldest command in memory.
+  void drop_oldest();
+
+  /// Removes discarded entries from `mem_` and rebuilds `index_`.
+  void compact();
+
+  caf::error spill(internal_command& cmd);
+
+  caf::error unspill(internal_command& cmd);
+
+  void discard(const internal_command& cmd, discard_reason reason) {
+    if (on_discard_)
+      on_discard_(cmd, reason);
+  }
+
+  caf::actor_system* sys_ = nullptr;
+  size_t capacity_ = 0;
+  overflow_policy policy_ = overflow_policy::drop_oldest;
+  discard_handler on_discard_;
+
+  /// Commands in memory, including discarded entries until the next call to
+  /// `compact`. Only holds the oldest commands while spilling.
+  std::deque<entry> mem_;
+
+  /// Number of live entries in `mem_`.
+  size_t live_ = 0;
+
+  /// Number of commands removed from the front of `mem_` so far. Allows
+  /// `index_` to store stable positions.
+  size_t offset_ = 0;
+
+  /// Maps keys to the position of the last command for this key, as long as
+  /// that command replaces the previous value of the key entirely.
+  std::unordered_map<data, size_t> index_;
+
+  memory_counter memory_;
+  size_t coalesced_ = 0;
+  size_t dropped_ = 0;
+
+  std::string file_name_;
+  std::fstream file_;
+  size_t spilled_ = 0;
+  std::streamoff read_pos_ = 0;
+  caf::binary_serializer::container_type buf_;
+};
+
+/// @relates command_buffer
+bool convert(caf::string_view x, command_buffer::overflow_policy& y);
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <caf/error.hpp>
+#include <caf/fwd.hpp>
+#include <caf/meta/type_name.hpp>
+#include <caf/string_view.hpp>
+
+#include "broker/message.hh"
+#include "broker/snapshot.hh"
+
+namespace broker {
+namespace detail {
+
+/// Algorithms for compressing batches to peers and snapshot chunks to clones.
+enum class compression : uint8_t {
+  none,
+  lz4,
+  zstd,
+};
+
+/// @relates compression
+const char* to_string(compression x);
+
+/// @relates compression
+bool convert(caf::string_view x, compression& y);
+
+/// Returns whether this build of Broker supports `x`.
+bool supported(compression x);
+
+/// Returns the names of all algorithms this build of Broker supports.
+std::vector<std::string> supported_compressions();
+
+/// A batch of node messages or snapshot entries in binary serialization,
+/// compressed as a whole.
+struct compressed_batch {
+  compression algorithm = compression::none;
+
+  /// Size of the serialized batch before compression.
+  uint32_t size = 0;
+
+  /// Compressed bytes.
+  std::vector<char> bytes;
+};
+
+/// @relates compressed_batch
+template <class Inspector>
+typename Inspector::result_type inspect(Inspector& f, compressed_batch& x) {
+  return f(caf::meta::type_name("compressed_batch"), x.algorithm, x.size,
+           x.bytes);
+}
+
+/// Serializes and compresses `xs` into `result`.
+caf::error compress(caf::actor_system& sys, compression algorithm,
+                    std::vector<node_message>& xs, compressed_batch& result);
+
+/// Decompresses and deserializes `x` into `result`.
+caf::error decompress(caf::actor_system& sys, const compressed_batch& x,
+                      std::vector<node_message>& result);
+
+/// Serializes and compresses the snapshot chunk `xs` into `result`.
+caf::error compress(caf::actor_system& sys, compression algorithm,
+                    snapshot& xs, compressed_batch& result);
+
+/// Decompresses and deserializes `x` into the snapshot chunk `result`.
+caf::error decompress(caf::actor_system& sys, const compressed_batch& x,
+                      snapshot& result);
+
+} // namespace detail
+} // namespace broker
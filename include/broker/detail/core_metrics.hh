@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include "broker/data.hh"
+#include "broker/fwd.hh"
+#include "broker/message.hh"
+#include "broker/time.hh"
+
+namespace broker {
+namespace detail {
+
+/// Approximates the number of bytes for serializing `x`.
+size_t estimated_size(const data& x);
+
+/// Counts observed values in buckets with power-of-two bounds. Bucket `i`
+/// counts all values in `(2^(i-1), 2^i]`, bucket 0 counts values up to 1 and
+/// the last bucket counts all values above `2^(num_buckets - 2)`.
+class histogram {
+public:
+  static constexpr size_t num_buckets = 16;
+
+  void observe(uint64_t x) noexcept;
+
+  /// Adds all observations of `other` to this histogram.
+  void merge(const histogram& other) noexcept;
+
+  /// Adds all observations of a histogram in the format of `to_data`.
+  /// Returns `false` if `x` has a different format.
+  bool merge(const data& x);
+
+  /// Returns the inclusive upper bound of bucket `index`.
+  /// @pre `index < num_buckets - 1`
+  static uint64_t upper_bound(size_t index) noexcept {
+    return uint64_t{1} << index;
+  }
+
+  const std::array<count, num_buckets>& buckets() const noexcept {
+    return buckets_;
+  }
+
+  count samples() const noexcept {
+    return samples_;
+  }
+
+  count sum() const noexcept {
+    return sum_;
+  }
+
+  /// Converts the histogram to a table with the keys `buckets` (vector of
+  /// counts per bucket), `samples`, and `sum`.
+  data to_data() const;
+
+private:
+  std::array<count, num_buckets> buckets_ = {};
+  count samples_ = 0;
+  count sum_ = 0;
+};
+
+/// Collects statistics about the traffic that passes through a core actor.
+class core_metrics {
+public:
+  struct topic_stats {
+    /// Number of data and command messages.
+    count messages = 0;
+
+    /// Estimated payload size of all data messages.
+    count bytes = 0;
+  };
+
+  using topic_map = std::unordered_map<std::string, topic_stats>;
+
+  void record(const data_message& x);
+
+  void record(const command_message& x);
+
+  void record(const node_message::value_type& x);
+
+  /// Records the size of a batch from a peer.
+  void record_batch(size_t size) noexcept {
+    batch_sizes_.observe(size);
+  }
+
+  const topic_map& topics() const noexcept {
+    return topics_;
+  }
+
+  /// Converts the statistics per topic to a table that maps each topic to its
+  /// number of `messages` and `bytes`.
+  table topics_to_data() const;
+
+  const histogram& batch_sizes() const noexcept {
+    return batch_sizes_;
+  }
+
+private:
+  topic_map topics_;
+  histogram batch_sizes_;
+};
+
+/// Combines the metric summaries of multiple endpoints, e.g., of all endpoints
+/// below a manager in the peering tree. A summary is a table with the number
+/// of `endpoints` it covers, the statistics per topic in `topics`, and the
+/// histograms `batch-sizes` and `peer-rtts`.
+class metrics_aggregator {
+public:
+  /// Stores all summaries in `xs`, which maps endpoint names to summaries,
+  /// replacing previous summaries of the same endpoints.
+  void merge(const table& xs, timestamp received);
+
+  /// Drops all summaries received before `cutoff`.
+  void expire(timestamp cutoff);
+
+  /// Combines all summaries into one.
+  table total() const;
+
+  /// Returns all summaries by endpoint name.
+  table to_data() const;
+
+  bool empty() const noexcept {
+    return summaries_.empty();
+  }
+
+private:
+  struct entry {
+    table summary;
+    timestamp received;
+  };
+
+  std::map<std::string, entry> summaries_;
+};
+
+/// Renders a metrics snapshot of a core actor in the Prometheus text
+/// exposition format.
+std::string to_prometheus(const data& snapshot);
+
+} // namespace detail
+} // namespace broker
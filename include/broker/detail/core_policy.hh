@@ -1,5 +1,7 @@
 #pragma once
 
+#include <map>
+#include <memory>
 #include <vector>
 #include <utility>
 #include <unordered_set>
@@ -13,16 +15,30 @@
 #include <caf/fused_downstream_manager.hpp>
 #include <caf/fwd.hpp>
 #include <caf/message.hpp>
+#include <caf/outbound_path.hpp>
 #include <caf/stream_slot.hpp>
 
+#include "broker/consumer_group.hh"
 #include "broker/data.hh"
 #include "broker/detail/assert.hh"
-#include "broker/detail/generator_file_writer.hh"
+#include "broker/detail/compression.hh"
+#include "broker/detail/core_metrics.hh"
+#include "broker/detail/duplicate_filter.hh"
+#include "broker/detail/generator_file_recorder.hh"
+#include "broker/detail/peer_buffer.hh"
+#include "broker/detail/peer_manager.hh"
+#include "broker/detail/rate_limiter.hh"
+#include "broker/detail/record_sampler.hh"
+#include "broker/detail/slot_filter.hh"
+#include "broker/detail/subscription_index.hh"
+#include "broker/detail/worker_groups.hh"
+#include "broker/event_filter.hh"
 #include "broker/filter_type.hh"
 #include "broker/internal_command.hh"
 #include "broker/logger.hh"
 #include "broker/message.hh"
 #include "broker/peer_filter.hh"
+#include "broker/predicate.hh"
 #include "broker/topic.hh"
 
 namespace broker {
@@ -51,8 +67,8 @@ public:
     using batch = std::vector<element>;
 
     /// Type of the downstream_manager that broadcasts data to local actors.
-    using manager = caf::broadcast_downstream_manager<element, filter_type,
-                                                      prefix_matcher>;
+    using manager = caf::broadcast_downstream_manager<element, slot_filter,
+                                                      slot_filter_matcher>;
   };
 
   /// Streaming-related types for workers.
@@ -68,9 +84,8 @@ public:
 
     using batch = std::vector<element>;
 
-    /// Type of the downstream_manager that broadcasts data to local actors.
-    using manager = caf::broadcast_downstream_manager<element, peer_filter,
-                                                      peer_filter_matcher>;
+    /// Type of the downstream_manager that broadcasts data to peers.
+    using manager = peer_manager;
   };
 
   /// Maps actor handles to path IDs.
@@ -110,6 +125,11 @@ public:
   void after_handle_batch(caf::stream_slot slot,
                           const caf::strong_actor_ptr& hdl);
 
+  /// Dispatches a message that `peer` sent outside of its stream, because its
+  /// topic belongs to the unreliable delivery class.
+  void receive_unreliable(const caf::strong_actor_ptr& peer,
+                          node_message msg);
+
   void ack_open_success(caf::stream_slot slot,
                         const caf::actor_addr& rebind_from,
                         caf::strong_actor_ptr rebind_to);
@@ -154,9 +174,14 @@ public:
   /// Block peer messages from being handled.  They are buffered until unblocked.
   void block_peer(caf::actor peer);
 
-  /// Unblock peer messages and flush any buffered messages immediately.
+  /// Unblock peer messages and starts replaying any buffered messages.
   void unblock_peer(caf::actor peer);
 
+  /// Handles up to `blocked_peer_replay_batches_` buffered batches of an
+  /// unblocked peer and schedules the next step if the buffer still has
+  /// batches. New batches from the peer go to the buffer until it is empty.
+  void replay_blocked(const caf::actor& peer);
+
   /// Starts the handshake process for a new peering (step #1 in core_actor.cc).
   /// @returns `false` if the peer is already connected, `true` otherwise.
   /// @param peer_hdl Handle to the peering (remote) core actor.
@@ -184,6 +209,12 @@ public:
     auto slot = add(send_own_filter_token, peer_hdl);
     // Make sure the peer receives the correct traffic.
     out().assign<peer_trait::manager>(slot);
+    peers().selector().index = &peer_index_;
+    peers().selector().peer_nodes = &peer_nodes_;
+    ++peer_nodes_[peer_hdl.node()];
+    normalize(peer_filter);
+    relay_clone_topics(peer_filter);
+    peer_index_.update(peer_hdl.address(), peer_filter);
     peers().set_filter(slot,
                        std::make_pair(peer_hdl.address(),
                                       std::move(peer_filter)));
@@ -212,6 +243,46 @@ public:
   /// Updates the filter of an existing peer.
   bool update_peer(const caf::actor& hdl, filter_type filter);
 
+  /// Adds all clone topics in `peer_filter` to our own filter if we relay
+  /// clone updates. Makes peers closer to the master send these updates to us
+  /// for forwarding them to the peer.
+  void relay_clone_topics(const filter_type& peer_filter);
+
+  /// Adds `xs` to the filter of an existing peer.
+  bool add_to_peer_filter(const caf::actor& hdl, filter_type xs);
+
+  /// Restricts Zeek events to an existing peer according to `f`.
+  bool update_peer_events(const caf::actor& hdl, event_filter f);
+
+  /// Replaces the filter of an existing peer with `summary`. Keeps the
+  /// topics in `exact` as filter for looking up stores of the peer.
+  bool update_peer_summary(const caf::actor& hdl, topic_summary summary,
+                           filter_type exact);
+
+  /// Sends only new topics instead of our full filter to `hdl`.
+  void enable_filter_deltas(const caf::actor& hdl);
+
+  /// Queries whether `hdl` accepts incremental filter updates.
+  bool accepts_filter_deltas(const caf::actor& hdl) const;
+
+  /// Returns the number of messages from peers that the core dropped, because
+  /// it received them over another path before.
+  size_t num_duplicates() const noexcept {
+    return duplicates_.rejected();
+  }
+
+  /// Returns the number of messages that the core copied before delivering
+  /// them locally, because other actors still held a reference to them.
+  size_t num_unshares() const noexcept {
+    return unshares_;
+  }
+
+  /// Returns the number of messages that arrived from `hdl` on its stream.
+  uint64_t num_received_from(const caf::actor& hdl) const {
+    auto i = received_.find(hdl);
+    return i != received_.end() ? i->second : 0;
+  }
+
   // -- management of worker and storage streams -------------------------------
 
   /// Adds the sender of the current message as worker by starting an output
@@ -220,17 +291,42 @@ public:
   caf::outbound_stream_slot<worker_trait::element>
   add_worker(filter_type filter);
 
+  /// Adds the sender of the current message as worker that only receives
+  /// messages satisfying `pred`.
+  /// @pre `current_sender() != nullptr`
+  caf::outbound_stream_slot<worker_trait::element>
+  add_worker(filter_type filter, predicate pred);
+
+  /// Adds the sender of the current message as member of `group` that only
+  /// receives messages satisfying `pred`.
+  /// @pre `current_sender() != nullptr`
+  caf::outbound_stream_slot<worker_trait::element>
+  add_worker(filter_type filter, predicate pred, const consumer_group& group);
+
+  /// Returns the predicate of the worker at `slot` or `nullptr` if the worker
+  /// did not register one.
+  const predicate* worker_predicate(caf::stream_slot slot) const;
+
   /// Adds the sender of the current message as store by starting an output
   /// stream to it.
   /// @pre `current_sender() != nullptr`
   caf::outbound_stream_slot<store_trait::element>
   add_store(filter_type filter);
 
+  /// Sets or replaces the filter of the worker at `slot`.
+  void set_worker_filter(caf::stream_slot slot, filter_type filter);
+
+  /// Sets or replaces the filter of the store at `slot`.
+  void set_store_filter(caf::stream_slot slot, filter_type filter);
+
   // -- selectively pushing data into the streams ------------------------------
 
   /// Pushes data to workers without forwarding it to peers.
   void local_push(data_message x);
 
+  /// Pushes a batch of data to workers without forwarding it to peers.
+  void local_push(std::vector<data_message> xs);
+
   /// Pushes data to stores without forwarding it to peers.
   void local_push(command_message x);
 
@@ -240,9 +336,17 @@ public:
   /// Pushes data to peers and workers.
   void push(data_message msg);
 
+  /// Pushes a batch of data to peers and workers.
+  void push(std::vector<data_message> xs);
+
   /// Pushes data to peers and stores.
   void push(command_message msg);
 
+  /// Sends data to the subscribers at node `receiver` only. Routes the
+  /// message over the peer streams, i.e., through other nodes if `receiver`
+  /// is no direct peer.
+  void unicast(const caf::node_id& receiver, data_message msg);
+
   // -- properties -------------------------------------------------------------
 
   /// Returns the fused downstream_manager of the parent.
@@ -286,6 +390,53 @@ public:
   /// Returns all known peers.
   std::vector<caf::actor> get_peer_handles();
 
+  /// Applies `f` to each peer with an outbound path, passing the peer handle,
+  /// the number of buffered messages, the open credit of the path, and the
+  /// number of batches that the peer did not acknowledge yet.
+  template <class F>
+  void for_each_peer_path(F f) {
+    for (auto& kvp : peer_to_opath_) {
+      auto path = out().path(kvp.second);
+      if (path != nullptr)
+        f(kvp.first, peers().buffered(kvp.second), path->open_credit,
+          path->next_batch_id - path->next_ack_id);
+      else
+        f(kvp.first, peers().buffered(kvp.second), 0, int64_t{0});
+    }
+  }
+
+  /// Applies `f` to each blocked peer and to each peer that still replays
+  /// buffered batches, passing the peer handle and its buffer (`nullptr` if
+  /// nothing arrived while blocked).
+  template <class F>
+  void for_each_blocked_peer(F f) const {
+    for (auto& hdl : blocked_peers) {
+      auto i = blocked_msgs.find(hdl);
+      f(hdl, i != blocked_msgs.end() ? i->second.get() : nullptr);
+    }
+    for (auto& kvp : blocked_msgs)
+      if (blocked_peers.count(kvp.first) == 0)
+        f(kvp.first, kvp.second.get());
+  }
+
+  /// Replaces the sampler that selects which published messages to record.
+  void set_record_sampler(record_sampler x) {
+    sampler_ = std::move(x);
+  }
+
+  /// Returns the traffic statistics or `nullptr` if metrics are disabled.
+  const core_metrics* metrics() const noexcept {
+    return metrics_.get();
+  }
+
+  /// Returns the rate limits for peers or `nullptr` if not configured.
+  const rate_limiter* rate_limits() const noexcept {
+    return limiter_.get();
+  }
+
+  /// Forwards coalesced messages to peers once their rate limit permits.
+  void flush_rate_limits();
+
   /// Finds the first peer handle that satisfies the predicate.
   template <class Predicate>
   caf::actor find_output_peer_hdl(Predicate pred) {
@@ -309,8 +460,10 @@ private:
   bool try_record(const T& x) {
     BROKER_ASSERT(recorder_ != nullptr);
     BROKER_ASSERT(remaining_records_ > 0);
-    if (auto err = recorder_->write(x)) {
-      BROKER_WARNING("unable to write to generator file:" << err);
+    if (!sampler_.select(get_topic(x)))
+      return true;
+    if (!recorder_->push(x)) {
+      BROKER_WARNING("recorder failed, stop recording");
       recorder_ = nullptr;
       remaining_records_ = 0;
       return false;
@@ -330,31 +483,16 @@ private:
   bool try_handle(caf::message& msg, const char* debug_msg) {
     CAF_IGNORE_UNUSED(debug_msg);
     if (msg.match_elements<T>()) {
-      using iterator_type = typename T::iterator;
-      auto ttl0 = initial_ttl();
-      auto push_unrecorded = [&](iterator_type first, iterator_type last) {
-        for (auto i = first; i != last; ++i)
-          peers().push(make_node_message(std::move(*i), ttl0));
-      };
-      auto push_recorded = [&](iterator_type first, iterator_type last) {
-        for (auto i = first; i != last; ++i) {
-          if (!try_record(*i))
-            return i;
-          peers().push(make_node_message(std::move(*i), ttl0));
-        }
-        return last;
-      };
       BROKER_DEBUG(debug_msg);
       auto& xs = msg.get_mutable_as<T>(0);
-      if (recorder_ == nullptr) {
-        push_unrecorded(xs.begin(), xs.end());
-      } else {
-        auto n = std::min(remaining_records_, xs.size());
-        auto first = xs.begin();
-        auto last = xs.end();
-        auto i = push_recorded(first, first + n);
-        if (i != last)
-          push_unrecorded(i, last);
+      if (metrics_ != nullptr)
+        for (auto& x : xs)
+          metrics_->record(x);
+      // try_record resets recorder_ once reaching the cap or on errors.
+      for (auto& x : xs) {
+        if (recorder_ != nullptr)
+          try_record(x);
+        forward_to_peers(originate(std::move(x)));
       }
       return true;
     }
@@ -364,6 +502,43 @@ private:
   /// Returns the initial TTL value when publishing data.
   ttl initial_ttl() const;
 
+  /// Wraps a message that this node publishes, assigning the initial TTL and
+  /// the next sequence number of this node.
+  node_message originate(node_message::value_type content);
+
+  /// Pushes `msg` to the peers unless exceeding its rate limit.
+  void forward_to_peers(node_message msg);
+
+  /// Sends `msg` to the peers outside of their streams if its topic belongs
+  /// to the unreliable delivery class and pushes it to the streams otherwise.
+  void push_to_peers(node_message msg);
+
+  /// Sends `msg` to all matching peers as individual messages, bypassing the
+  /// credit of the streams. Drops `msg` for peers with messages waiting for
+  /// credit.
+  void send_unreliable(const node_message& msg);
+
+  /// Buffers a batch from a blocked peer or handles it right away.
+  void receive_peer_batch(const caf::strong_actor_ptr& peer,
+                          peer_trait::batch& batch);
+
+  /// Dispatches a batch from a peer to local subscribers and other peers.
+  void handle_peer_batch(peer_trait::batch& batch);
+
+  /// Decodes `x` in place or hands it to a decode worker if `x` is large.
+  void receive_compressed_batch(const caf::strong_actor_ptr& peer,
+                                compressed_batch& x);
+
+  /// Queues `batch` behind the batches of `peer` that are still decoding.
+  /// @returns `false` if `peer` has no pending batches.
+  bool enqueue_behind_decoders(const caf::actor& peer,
+                               peer_trait::batch& batch);
+
+  /// Stores the batch `id` of `peer` after decoding it and handles all
+  /// batches of the peer that are ready in the order of their arrival.
+  void decoded_batch(const caf::actor& peer, uint64_t id,
+                     peer_trait::batch batch);
+
   /// Adds entries to `peer_to_ipath_` and `ipath_to_peer_`.
   void add_ipath(caf::stream_slot slot, const caf::actor& peer_hdl);
 
@@ -404,14 +579,105 @@ private:
   /// Peers that are currently blocked (messages buffered until unblocked).
   std::unordered_set<caf::actor> blocked_peers;
 
+  /// Peers that accept incremental filter updates.
+  std::unordered_set<caf::actor> delta_peers_;
+
+  /// Counts the peers per node for routing messages to a single receiver.
+  std::unordered_map<caf::node_id, size_t> peer_nodes_;
+
+  /// Event filters that peers announced for their topics.
+  std::unordered_map<caf::actor_addr, event_filter> peer_events_;
+
+  /// Summaries that peers with large filters sent instead of their filter.
+  std::unordered_map<caf::actor_addr, topic_summary> peer_summaries_;
+
   /// Messages that are currently buffered.
-  std::unordered_map<caf::actor, std::vector<caf::message>> blocked_msgs;
+  std::unordered_map<caf::actor, std::unique_ptr<peer_buffer>> blocked_msgs;
+
+  /// Maximum number of (estimated) bytes per peer buffer before spilling
+  /// batches to disk.
+  size_t blocked_peer_buffer_size_;
+
+  /// Maximum number of buffered batches per replay step.
+  size_t blocked_peer_replay_batches_;
+
+  /// Forwards updates from masters to the clones of other peers if `true`.
+  bool relay_clone_updates_;
+
+  /// Compiled view on the filters of all outbound peer paths.
+  subscription_index<caf::actor_addr> peer_index_;
+
+  /// Compiled view on the filters of all worker paths.
+  subscription_index<caf::stream_slot> worker_index_;
 
-  /// Helper for recording meta data of published messages.
-  detail::generator_file_writer_ptr recorder_;
+  /// Predicates of all workers that registered one.
+  std::unordered_map<caf::stream_slot, predicate> worker_predicates_;
+
+  /// Consumer groups of all workers that joined one.
+  worker_groups worker_groups_;
+
+  /// Compiled view on the filters of all store paths.
+  subscription_index<caf::stream_slot> store_index_;
+
+  /// Helper for recording meta data of published messages. Writes to disk
+  /// in a background thread.
+  detail::generator_file_recorder_ptr recorder_;
 
   /// Counts down when using a `recorder_` to cap maximum file entries.
   size_t remaining_records_;
+
+  /// Selects which published messages `recorder_` captures.
+  record_sampler sampler_;
+
+  /// Collects traffic statistics if enabled.
+  std::unique_ptr<core_metrics> metrics_;
+
+  /// Limits the rate of messages to peers per topic prefix if configured.
+  std::unique_ptr<rate_limiter> limiter_;
+
+  /// Topic prefixes for messages that bypass the streams to peers.
+  filter_type unreliable_topics_;
+
+  /// Identifies this node in the `origin` field of node messages.
+  uint64_t origin_;
+
+  /// Sequence number for the next message that this node publishes.
+  uint32_t next_seq_;
+
+  /// Drops messages from peers that arrived over another path already.
+  duplicate_filter duplicates_;
+
+  /// Number of local messages that we had to copy before handing them to our
+  /// workers or stores.
+  size_t unshares_;
+
+  /// Number of messages that arrived from each peer on its stream.
+  std::unordered_map<caf::actor, uint64_t> received_;
+
+  /// Batches of a peer that went through the decode workers. Restores the
+  /// order of arrival, since workers may finish out of order.
+  struct decode_queue {
+    /// ID for the next batch from the peer.
+    uint64_t next_id = 0;
+
+    /// ID of the next batch to handle.
+    uint64_t next_ready = 0;
+
+    /// Decoded batches that wait for their predecessors.
+    std::map<uint64_t, peer_trait::batch> ready;
+  };
+
+  /// Actors that decompress large batches from peers in parallel.
+  std::vector<caf::actor> decoders_;
+
+  /// Index of the decoder for the next batch.
+  size_t next_decoder_ = 0;
+
+  /// Minimum uncompressed size of batches for the decoders.
+  size_t decode_offload_size_;
+
+  /// Pending batches per peer while decoders work on them.
+  std::unordered_map<caf::actor, decode_queue> decode_queues_;
 };
 
 } // namespace detail
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include <caf/binary_serializer.hpp>
+#include <caf/error.hpp>
+
+#include "broker/data.hh"
+
+namespace broker {
+namespace detail {
+
+/// A compact binary encoding for `data`. Each value starts with a single
+/// byte that stores the type in its lower four bits. The upper four bits
+/// inline small values: booleans, counts and (zigzag-encoded) integers below
+/// 15 as well as the length of short strings and containers. Larger numbers
+/// and lengths follow as LEB128 varints, addresses use 4 bytes for IPv4 and
+/// 16 bytes for IPv6.
+///
+/// Peers agree on the encoding after the handshake by exchanging `id`, so any
+/// incompatible change to the encoding requires a new ID. Broker uses the
+/// encoding for packed batches to peers, spill files, recorded meta data, and
+/// ::packed_data values.
+class data_codec {
+public:
+  using buffer = caf::binary_serializer::container_type;
+
+  /// Identifies this version of the encoding when negotiating it with peers.
+  static constexpr const char* id = "compact-1";
+
+  /// Appends `x` to `buf`.
+  static void encode(const data& x, buffer& buf);
+
+  /// Decodes a value from `[first, last)` into `x`. On success, `first`
+  /// points to the first byte after the encoded value.
+  static caf::error decode(const char*& first, const char* last, data& x);
+
+  /// Appends `x` as LEB128 varint to `buf`.
+  static void write_varint(uint64_t x, buffer& buf);
+
+  /// Reads a LEB128 varint from `[first, last)`.
+  static bool read_varint(const char*& first, const char* last, uint64_t& x);
+};
+
+} // namespace detail
+} // namespace broker
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <random>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <caf/error.hpp>
 #include <caf/fwd.hpp>
@@ -25,8 +28,40 @@ public:
     }
   };
 
+  /// Configures how the generator fills values. The default profile fills
+  /// strings with a placeholder character and all other values with random
+  /// content.
+  struct profile {
+    /// Probability for reusing a previously generated string or command key
+    /// of the same size or type instead of generating a new one.
+    double reuse = 0;
+
+    /// Skew of the Zipf distribution for picking reused values, i.e., higher
+    /// values concentrate reuse on fewer values. Picks uniformly if 0.
+    double zipf_skew = 1.0;
+
+    /// Maximum number of values per dictionary.
+    size_t dictionary_size = 1024;
+
+    /// Composes new strings from these words. Strings still have the recorded
+    /// size, i.e., the generator truncates the last word if necessary.
+    std::vector<std::string> words;
+
+    /// Picks addresses and subnets from these ranges. Fills addresses with
+    /// random bytes if empty.
+    std::vector<subnet> address_ranges;
+
+    /// Returns whether this profile differs from the default profile.
+    bool enabled() const noexcept {
+      return reuse > 0 || !words.empty() || !address_ranges.empty();
+    }
+  };
+
   data_generator(caf::binary_deserializer& meta_data_source, unsigned seed = 0);
 
+  data_generator(caf::binary_deserializer& meta_data_source, profile prof,
+                 unsigned seed = 0);
+
   caf::error operator()(data& x);
 
   caf::error operator()(internal_command& x);
@@ -57,6 +92,8 @@ public:
 
   caf::error generate(enum_value& x);
 
+  caf::error generate(packed_data& x);
+
   void shuffle(none&);
 
   void shuffle(boolean& x);
@@ -70,6 +107,8 @@ public:
 
   void shuffle(enum_value& x);
 
+  void shuffle(packed_data& x);
+
   void shuffle(port& x);
 
   void shuffle(address& x);
@@ -88,15 +127,59 @@ public:
 
   void shuffle(table& xs);
 
+  const profile& get_profile() const noexcept {
+    return profile_;
+  }
+
+  /// Configures whether the meta data stores sizes as varints (the default)
+  /// or as fixed-size integers (generator files prior to version 4).
+  void varint_sizes(bool value) noexcept {
+    varint_sizes_ = value;
+  }
+
 private:
   char next_char();
 
   uint8_t next_byte();
 
+  /// Returns whether to pick the next value from a dictionary.
+  bool next_reuse();
+
+  /// Picks an index in `[0, n)` from the Zipf distribution of the profile.
+  size_t next_index(size_t n);
+
+  /// Generates a command key and optionally replaces it with a previously
+  /// generated key of the same type.
+  caf::error generate_key(data& x);
+
+  /// Fills `x` with words from the profile.
+  void compose(std::string& x);
+
+  /// Reads the size of a string or container from the meta data.
+  caf::error read_size(uint32_t& x);
+
+  /// Replaces `x` with an entry of `dict` or adds `x` to `dict`.
+  template <class T>
+  void reuse(std::vector<T>& dict, T& x) {
+    if (!dict.empty() && next_reuse())
+      x = dict[next_index(dict.size())];
+    else if (dict.size() < profile_.dictionary_size)
+      dict.emplace_back(x);
+  }
+
   caf::binary_deserializer& source_;
+  bool varint_sizes_ = true;
+  profile profile_;
   std::minstd_rand engine_;
   std::uniform_int_distribution<int16_t> char_generator_;
   std::uniform_int_distribution<uint16_t> byte_generator_;
+  std::uniform_real_distribution<double> real_generator_;
+  /// Cumulative weights of the Zipf distribution for all dictionary indexes.
+  std::vector<double> zipf_cdf_;
+  /// Previously generated strings by size.
+  std::unordered_map<size_t, std::vector<std::string>> strings_;
+  /// Previously generated command keys by type.
+  std::unordered_map<size_t, std::vector<data>> keys_;
 };
 
 } // namespace detail
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+namespace broker {
+namespace detail {
+
+/// Detects copies of messages that reach a node over more than one path.
+/// Keeps a sliding window of the most recent sequence numbers per origin.
+/// Messages older than the window count as new, since the filter can no
+/// longer tell whether it saw them before.
+class duplicate_filter {
+public:
+  /// Number of sequence numbers per origin in the sliding window.
+  static constexpr size_t window_size = 4096;
+
+  /// Maximum number of origins before the filter starts over.
+  static constexpr size_t max_origins = 1024;
+
+  /// Returns `false` if the filter has seen message `seq` from `origin`
+  /// before, otherwise records the message and returns `true`. Accepts all
+  /// messages with origin 0.
+  bool accept(uint64_t origin, uint32_t seq);
+
+  /// Returns the number of messages rejected so far.
+  size_t rejected() const noexcept {
+    return rejected_;
+  }
+
+private:
+  struct window {
+    /// Highest sequence number that the filter has seen so far.
+    uint32_t top;
+
+    /// Bit `i` is set if the filter has seen sequence number `top - i`.
+    std::bitset<window_size> seen;
+  };
+
+  std::unordered_map<uint64_t, window> windows_;
+
+  size_t rejected_ = 0;
+};
+
+} // namespace detail
+} // namespace broker
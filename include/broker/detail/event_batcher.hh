@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include <caf/actor_addr.hpp>
+
+#include "broker/data.hh"
+#include "broker/message.hh"
+#include "broker/network_info.hh"
+#include "broker/time.hh"
+
+namespace broker {
+namespace detail {
+
+/// Collects status and error events of the core for emitting them in batches
+/// at a bounded rate. Drops events that repeat an event for the same peer
+/// within the current batch and events that exceed the batch size.
+class event_batcher {
+public:
+  /// Identifies an event by its kind (errors have the most significant bit
+  /// set), the code, and either the handle or the network address of a peer.
+  using key_type = std::tuple<uint16_t, caf::actor_addr, network_info>;
+
+  /// Creates a batcher that passes all events through if `interval` is 0.
+  explicit event_batcher(timespan interval = timespan{0},
+                         size_t max_batch_size = 0);
+
+  /// Returns whether the batcher collects events.
+  bool enabled() const noexcept {
+    return interval_.count() > 0;
+  }
+
+  timespan interval() const noexcept {
+    return interval_;
+  }
+
+  /// Returns `false` if the current batch already contains an event for `key`
+  /// or has no room left. Always returns `true` if the batcher is disabled.
+  bool admit(const key_type& key);
+
+  /// Adds `msg` to the current batch.
+  /// @returns `true` if the caller must schedule a flush.
+  bool push(data_message msg);
+
+  /// Returns the current batch and starts a new one.
+  std::vector<data_message> flush();
+
+  /// Returns the number of pending events.
+  size_t size() const noexcept {
+    return buf_.size();
+  }
+
+  /// Returns the number of events that repeated a pending event.
+  size_t suppressed() const noexcept {
+    return suppressed_;
+  }
+
+  /// Returns the number of events that exceeded the batch size.
+  size_t dropped() const noexcept {
+    return dropped_;
+  }
+
+  /// Creates a key for status or error `code` regarding the peer `hdl`.
+  static key_type make_key(bool is_error, uint8_t code,
+                           const caf::actor_addr& hdl) {
+    return key_type{kind(is_error, code), hdl, network_info{}};
+  }
+
+  /// Creates a key for status or error `code` regarding the peer at `addr`.
+  static key_type make_key(bool is_error, uint8_t code,
+                           const network_info& addr) {
+    return key_type{kind(is_error, code), caf::actor_addr{}, addr};
+  }
+
+private:
+  static uint16_t kind(bool is_error, uint8_t code) noexcept {
+    return static_cast<uint16_t>((is_error ? 0x100 : 0) | code);
+  }
+
+  timespan interval_;
+  size_t max_batch_size_;
+  std::set<key_type> keys_;
+  std::vector<data_message> buf_;
+  bool flush_scheduled_ = false;
+  size_t suppressed_ = 0;
+  size_t dropped_ = 0;
+};
+
+} // namespace detail
+} // namespace broker
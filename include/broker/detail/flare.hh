@@ -14,16 +14,19 @@ namespace broker::detail {
 /// signal availability of a resource across threads, both access to that
 /// resource and the use of the fire/extinguish functions must be performed in
 /// a thread-safe manner in order for that to work correctly.
+///
+/// On Linux, the flare uses a single `eventfd` in semaphore mode instead of a
+/// pipe. In this case, the "ready" state corresponds to a non-zero counter.
 class flare {
 public:
   using timeout_type = clock::time_point;
 
   using native_socket = caf::io::network::native_socket;
 
-  /// Constructs a flare by opening a UNIX pipe.
+  /// Constructs a flare by opening a UNIX pipe or an `eventfd`.
   flare();
 
-  /// Destructs the flare, closing the UNIX pipe's file descriptors.
+  /// Destructs the flare, closing its file descriptors.
   ~flare();
 
   flare(const flare&) = delete;
@@ -72,6 +75,8 @@ public:
 private:
   bool await_one_impl(int ms_timeout);
 
+  /// Stores the read handle at index 0 and the write handle at index 1. Both
+  /// handles are identical when using an `eventfd`.
   native_socket fds_[2];
 };
 
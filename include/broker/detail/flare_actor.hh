@@ -30,7 +30,11 @@ namespace detail {
 
 class flare_actor : public caf::blocking_actor {
 public:
-  flare_actor(caf::actor_config& sys);
+  /// Creates a flare actor that fires its flare once per message if
+  /// `fire_per_burst` is `false`. Otherwise, the flare only fires when a
+  /// message arrives at an empty mailbox and stays lit until the mailbox runs
+  /// empty again, i.e., the descriptor becomes ready once per burst.
+  flare_actor(caf::actor_config& sys, bool fire_per_burst = false);
 
   void launch(caf::execution_unit*, bool, bool) override;
 
@@ -46,13 +50,25 @@ public:
 
   const char* name() const override;
 
+  /// Extinguishes the flare for one consumed message. In burst mode,
+  /// extinguishes the flare only if the mailbox ran empty.
   void extinguish_one();
 
+  /// Extinguishes the flare if the mailbox ran empty. Allows consumers in
+  /// burst mode to process any number of messages before resetting the flare
+  /// with a single call.
+  void extinguish_if_empty();
+
   auto descriptor() const noexcept {
     return flare_.fd();
   }
 
 private:
+  bool mailbox_empty();
+
+  void extinguish_if_empty_impl();
+
+  bool fire_per_burst_;
   flare flare_;
   int flare_count_;
   std::mutex flare_mtx_;
@@ -1,14 +1,18 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <memory>
+#include <vector>
 
 #include <caf/binary_deserializer.hpp>
 
 #include "broker/config.hh"
 #include "broker/detail/data_generator.hh"
+#include "broker/detail/topic_table.hh"
 #include "broker/fwd.hh"
+#include "broker/time.hh"
 #include "broker/topic.hh"
 
 namespace broker::detail {
@@ -27,8 +31,27 @@ public:
 
   using mapped_pointer = void*;
 
+  /// Describes a block in a file of version 2 or later.
+  struct block_info {
+    /// Position of the first entry in the file.
+    size_t offset;
+
+    /// Size of all entries in bytes.
+    size_t size;
+
+    /// Number of data and command messages in the block.
+    size_t entries;
+
+    /// Time of the first entry.
+    timestamp first;
+
+    /// Time of the last entry.
+    timestamp last;
+  };
+
   generator_file_reader(file_handle fd, mapper_handle mapper,
-                        mapped_pointer addr, size_t file_size);
+                        mapped_pointer addr, size_t file_size,
+                        uint8_t version, data_generator::profile prof = {});
 
   generator_file_reader(generator_file_reader&&) = delete;
 
@@ -47,12 +70,39 @@ public:
 
   caf::error read(value_type& x);
 
+  /// Reads the next message into `x` and stores the time it was recorded in
+  /// `t`. Files prior to version 3 have no per-message timestamps. For those,
+  /// `t` is the time of the first entry in the current block (version 2) or
+  /// the epoch (version 1).
+  caf::error read(value_type& x, timestamp& t);
+
+  /// Appends up to `n` messages to `xs`, stopping early at the end of the
+  /// file. Returns `ec::end_of_file` only if `at_end()` holds before reading.
+  caf::error read(std::vector<value_type>& xs, size_t n);
+
   caf::error skip();
 
   caf::error skip_to_end();
 
+  /// Positions the reader at the first entry of the block at `index`. Blocks
+  /// are self-contained, i.e., multiple readers may process disjoint ranges of
+  /// blocks of the same file in parallel.
+  /// @pre `version() >= 2`
+  caf::error seek(size_t index);
+
+  /// Returns the format version of the file.
+  uint8_t version() const noexcept {
+    return version_;
+  }
+
+  /// Returns the index of all blocks in the file. Always empty for version 1.
+  const std::vector<block_info>& blocks() const noexcept {
+    return blocks_;
+  }
+
+  /// Returns all topics in order of first appearance.
   const std::vector<topic>& topics() const noexcept {
-    return topic_table_;
+    return topics_.topics();
   }
 
   size_t entries() const noexcept {
@@ -68,13 +118,33 @@ public:
   }
 
 private:
+  /// Builds `blocks_` and computes `content_size_`.
+  void index_blocks();
+
+  /// Lets `source_` point to the first entry of the block at `index`.
+  void enter_block(size_t index);
+
+  /// Position of `source_` in the file.
+  size_t offset() const noexcept {
+    return content_size_ - source_.remaining();
+  }
+
   file_handle fd_;
   mapper_handle mapper_;
   mapped_pointer addr_;
   size_t file_size_;
+  uint8_t version_;
+  size_t content_size_;
   caf::binary_deserializer source_;
   data_generator generator_;
-  std::vector<topic> topic_table_;
+  /// Maps the topic IDs of the current block to IDs in `topics_`.
+  std::vector<topic_table::id_type> topic_table_;
+  /// Interns all topics of the file, i.e., blocks that repeat a topic share
+  /// the same instance.
+  topic_table topics_;
+  std::vector<block_info> blocks_;
+  size_t next_block_ = 0;
+  size_t block_end_ = 0;
   size_t data_entries_ = 0;
   size_t command_entries_ = 0;
   bool sealed_ = false;
@@ -84,4 +154,10 @@ using generator_file_reader_ptr = std::unique_ptr<generator_file_reader>;
 
 generator_file_reader_ptr make_generator_file_reader(const std::string& fname);
 
+/// Opens the generator file `fname` for generating content according to
+/// `prof` instead of the default profile.
+generator_file_reader_ptr
+make_generator_file_reader(const std::string& fname,
+                           data_generator::profile prof);
+
 } // namespace broker::detail
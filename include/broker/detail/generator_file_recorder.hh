@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <caf/string_view.hpp>
+
+#include "broker/detail/generator_file_writer.hh"
+#include "broker/detail/spsc_ring.hh"
+#include "broker/fwd.hh"
+#include "broker/message.hh"
+#include "broker/time.hh"
+
+namespace broker {
+namespace detail {
+
+/// Moves serialization and file I/O for recording published messages off the
+/// caller's thread. Messages travel through a lock-free ring buffer to a
+/// dedicated writer thread. The producer only touches the mutex for waking up
+/// the writer thread after it went to sleep on an empty ring.
+///
+/// Optionally, the recorder rotates through multiple files by size or time
+/// and deletes old files to retain only the most recent traffic.
+///
+/// Only a single thread (or actor) may call `push`.
+class generator_file_recorder {
+public:
+  // --- member types ----------------------------------------------------------
+
+  /// Configures what `push` does when the writer cannot keep up.
+  enum class overflow_policy {
+    /// Discard messages while the buffer is full.
+    drop,
+    /// Wait until the writer thread has made room in the buffer.
+    block,
+  };
+
+  struct entry {
+    generator_file_writer::data_or_command_message content;
+    timestamp time;
+  };
+
+  /// Configures rotation of the recording into multiple files (segments).
+  struct segment_options {
+    /// Path of all segment files without index and file extension.
+    std::string prefix;
+
+    /// Starts a new segment when the current one reaches this size in bytes.
+    /// A value of 0 disables size-based rotation.
+    size_t max_size = 0;
+
+    /// Starts a new segment when the current one spans this much time. A
+    /// value of 0 disables time-based rotation.
+    timespan max_duration{0};
+
+    /// Deletes the oldest segment when exceeding this number of segments.
+    /// A value of 0 keeps all segments.
+    size_t max_segments = 0;
+
+    /// Returns whether any rotation criterion is set.
+    bool enabled() const noexcept {
+      return max_size > 0 || max_duration.count() > 0;
+    }
+  };
+
+  // --- construction and destruction ------------------------------------------
+
+  /// @pre `writer != nullptr`
+  /// @pre `!segments.enabled()
+  ///       || writer->file_name() == segment_file_name(segments.prefix, 1)`
+  generator_file_recorder(generator_file_writer_ptr writer, size_t capacity,
+                          overflow_policy policy,
+                          segment_options segments = {});
+
+  generator_file_recorder(const generator_file_recorder&) = delete;
+
+  generator_file_recorder& operator=(const generator_file_recorder&) = delete;
+
+  /// Writes all pending messages and stops the writer thread.
+  ~generator_file_recorder();
+
+  // --- recording -------------------------------------------------------------
+
+  /// Hands `x` to the writer thread, stamped with the current time.
+  /// @returns `false` if the writer failed and no longer accepts messages.
+  bool push(const data_message& x);
+
+  /// Hands `x` to the writer thread, stamped with the current time.
+  /// @returns `false` if the writer failed and no longer accepts messages.
+  bool push(const command_message& x);
+
+  /// Hands `x` to the writer thread, stamped with `t`.
+  /// @returns `false` if the writer failed and no longer accepts messages.
+  bool push(const data_message& x, timestamp t);
+
+  /// Hands `x` to the writer thread, stamped with `t`.
+  /// @returns `false` if the writer failed and no longer accepts messages.
+  bool push(const command_message& x, timestamp t);
+
+  // --- properties ------------------------------------------------------------
+
+  /// Returns the number of messages discarded due to a full buffer.
+  size_t dropped() const noexcept {
+    return dropped_;
+  }
+
+  /// Returns whether the writer thread stopped after an error.
+  bool failed() const noexcept {
+    return failed_;
+  }
+
+private:
+  bool enqueue(entry x);
+
+  void run();
+
+  /// Returns whether `x` belongs to a new segment. Always `false` when
+  /// rotation is disabled.
+  bool rotation_due(const entry& x) const;
+
+  /// Opens the next segment and deletes old segments if necessary.
+  caf::error rotate();
+
+  generator_file_writer_ptr writer_;
+  overflow_policy policy_;
+  segment_options segments_;
+  size_t segment_index_ = 1;
+  size_t segment_entries_ = 0;
+  timestamp segment_start_;
+  std::deque<std::string> segment_files_;
+  spsc_ring<entry> ring_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::atomic<bool> sleeping_;
+  std::atomic<bool> done_;
+  std::atomic<bool> failed_;
+  std::atomic<size_t> dropped_;
+  std::thread thread_;
+};
+
+using generator_file_recorder_ptr = std::unique_ptr<generator_file_recorder>;
+
+/// Parses `x` as overflow policy. Returns `true` on success.
+bool convert(caf::string_view x, generator_file_recorder::overflow_policy& y);
+
+/// Returns the file name for segment `index`, e.g., `messages-0001.dat` for
+/// prefix `messages` and index 1.
+std::string segment_file_name(const std::string& prefix, size_t index);
+
+/// Opens `fname` for recording. Returns `nullptr` if opening the file failed.
+generator_file_recorder_ptr
+make_generator_file_recorder(const std::string& fname, size_t capacity,
+                             generator_file_recorder::overflow_policy policy);
+
+/// Opens the first segment for recording with rotation. Returns `nullptr` if
+/// opening the file failed.
+/// @pre `segments.enabled()`
+generator_file_recorder_ptr make_generator_file_recorder(
+  generator_file_recorder::segment_options segments, size_t capacity,
+  generator_file_recorder::overflow_policy policy);
+
+} // namespace detail
+} // namespace broker
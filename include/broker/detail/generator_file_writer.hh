@@ -12,19 +12,36 @@
 #include <caf/variant.hpp>
 
 #include "broker/fwd.hh"
+#include "broker/time.hh"
+#include "broker/detail/topic_table.hh"
 
 namespace broker {
 namespace detail {
 
+/// Records messages to a generator file. Since version 2, the file consists
+/// of self-contained blocks. Each block starts with a fixed-size header that
+/// stores the size of the block, the number of entries, and the time of the
+/// first and last entry. Each block also starts with an empty topic table.
+/// Hence, readers can index a file by jumping from block header to block
+/// header and start reading at any block. Since version 3, each data and
+/// command message also stores the time it was written (usually: the time the
+/// core received it), which allows readers to reproduce the original timing.
+/// Since version 4, the meta data stores sizes of strings and containers as
+/// LEB128 varints (see ::data_codec) instead of 32-bit integers.
 class generator_file_writer {
 public:
   struct format {
     static constexpr uint32_t magic = 0x2EECC0DE;
 
-    static constexpr uint8_t version = 1;
+    static constexpr uint8_t version = 4;
 
     static constexpr size_t header_size = sizeof(magic) + sizeof(version);
 
+    /// Payload size and number of entries (both `uint32_t`) plus time of the
+    /// first and last entry (both `int64_t` nanoseconds since the epoch).
+    static constexpr size_t block_header_size = 2 * sizeof(uint32_t)
+                                                + 2 * sizeof(int64_t);
+
     enum class entry_type : uint8_t {
       new_topic,
       data_message,
@@ -46,6 +63,8 @@ public:
 
   ~generator_file_writer();
 
+  /// Opens `file_name` for writing. Flushes and closes the previous file
+  /// first, if any.
   caf::error open(std::string file_name);
 
   caf::error write(const data_message& x);
@@ -54,6 +73,16 @@ public:
 
   caf::error write(const data_or_command_message& x);
 
+  /// Writes `x` with timestamp `t` instead of the current time.
+  caf::error write(const data_message& x, timestamp t);
+
+  /// Writes `x` with timestamp `t` instead of the current time.
+  caf::error write(const command_message& x, timestamp t);
+
+  /// Writes `x` with timestamp `t` instead of the current time.
+  caf::error write(const data_or_command_message& x, timestamp t);
+
+  /// Writes all buffered entries as a single block.
   caf::error flush();
 
   size_t flush_threshold() const noexcept {
@@ -64,6 +93,17 @@ public:
     flush_threshold_ = x;
   }
 
+  /// Returns the number of bytes in the current file, including buffered
+  /// entries that have not been flushed yet.
+  size_t file_size() const noexcept {
+    return bytes_written_ + (buf_.empty() ? 0 : format::block_header_size)
+           + buf_.size();
+  }
+
+  const std::string& file_name() const noexcept {
+    return file_name_;
+  }
+
   bool operator!() const;
 
   explicit operator bool() const;
@@ -71,12 +111,20 @@ public:
 private:
   caf::error topic_id(const topic& x, uint16_t& id);
 
+  /// Updates the block statistics after adding an entry to the buffer and
+  /// flushes the buffer if it reached the threshold.
+  caf::error finish_entry(timestamp t);
+
   caf::binary_serializer::container_type buf_;
   caf::binary_serializer sink_;
   std::ofstream f_;
   size_t flush_threshold_;
-  std::vector<topic> topic_table_;
+  topic_table topic_table_;
   std::string file_name_;
+  size_t bytes_written_ = 0;
+  uint32_t block_entries_ = 0;
+  timestamp block_first_;
+  timestamp block_last_;
 };
 
 using generator_file_writer_ptr = std::unique_ptr<generator_file_writer>;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <functional>
 
 namespace broker {
@@ -25,6 +27,84 @@ inline void hash_range(size_t& seed, It first, It last) {
     hash_combine(seed, *first);
 }
 
+/// Accumulates a 64-bit hash over a sequence of words and byte ranges. Mixes
+/// each input with a single multiply-xorshift step, which is considerably
+/// cheaper than combining the results of `std::hash` for every element.
+class hash_state {
+public:
+  static constexpr uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+
+  void add(uint64_t x) noexcept {
+    state_ = (state_ ^ x) * multiplier;
+    state_ ^= state_ >> 32;
+  }
+
+  void add_bytes(const void* ptr, size_t size) noexcept {
+    auto bytes = static_cast<const char*>(ptr);
+    add(size);
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t)) {
+      uint64_t word;
+      std::memcpy(&word, bytes, sizeof(word));
+      add(word);
+      bytes += sizeof(word);
+    }
+    if (size > 0) {
+      uint64_t word = 0;
+      std::memcpy(&word, bytes, size);
+      add(word);
+    }
+  }
+
+  size_t result() const noexcept {
+    // Final avalanche step (from MurmurHash3's fmix64).
+    auto x = state_;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    return static_cast<size_t>(x);
+  }
+
+private:
+  uint64_t state_ = 0;
+};
+
+/// Computes the 64-bit FNV-1a hash over a sequence of words and byte ranges.
+/// Feeds each word as eight bytes in little-endian order, i.e., the result
+/// only depends on the input values and is the same on all platforms. Unlike
+/// `hash_state`, this algorithm must never change, since callers may persist
+/// its results.
+class stable_hash_state {
+public:
+  static constexpr uint64_t offset_basis = 0xcbf29ce484222325ull;
+
+  static constexpr uint64_t prime = 0x100000001b3ull;
+
+  void add(uint64_t x) noexcept {
+    for (size_t i = 0; i < sizeof(x); ++i) {
+      add_byte(static_cast<uint8_t>(x));
+      x >>= 8;
+    }
+  }
+
+  void add_bytes(const void* ptr, size_t size) noexcept {
+    auto bytes = static_cast<const uint8_t*>(ptr);
+    add(size);
+    for (size_t i = 0; i < size; ++i)
+      add_byte(bytes[i]);
+  }
+
+  uint64_t result() const noexcept {
+    return state_;
+  }
+
+private:
+  void add_byte(uint8_t x) noexcept {
+    state_ = (state_ ^ x) * prime;
+  }
+
+  uint64_t state_ = offset_basis;
+};
+
 // Allows hashing of composite types.
 template <class Container>
 struct container_hasher {
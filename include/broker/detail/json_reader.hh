@@ -0,0 +1,32 @@
+#pragma once
+
+#include <caf/error.hpp>
+
+#include "broker/data.hh"
+
+namespace broker {
+namespace detail {
+
+/// Parses JSON into data. The mapping from JSON to data is:
+/// - `null` becomes `none` and `true`/`false` become `boolean`
+/// - numbers without fraction and exponent become `count` or, if negative,
+///   `integer`; all other numbers become `real`
+/// - strings become strings (with `\u` escapes converted to UTF-8)
+/// - arrays become vectors and objects become tables with string keys
+class json_reader {
+public:
+  /// Maximum nesting depth of arrays and objects.
+  static constexpr size_t max_depth = 256;
+
+  /// Parses the next JSON value from `[first, last)` into `x`, skipping any
+  /// whitespace before the value. On success, `first` points to the first
+  /// character after the value. Since the reader cannot tell whether a number
+  /// at the very end of the input is complete, callers must terminate the
+  /// input with a whitespace character after the last value.
+  /// @returns `ec::end_of_file` if the input ends before a complete value or
+  ///          `ec::invalid_data` if the input is not valid JSON.
+  static caf::error read(const char*& first, const char* last, data& x);
+};
+
+} // namespace detail
+} // namespace broker
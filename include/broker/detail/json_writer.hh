@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+
+#include "broker/data.hh"
+#include "broker/topic.hh"
+
+namespace broker {
+namespace detail {
+
+/// Renders data as JSON by appending to a caller-provided buffer. Callers can
+/// reuse the same buffer (and writer) for many messages to avoid heap
+/// allocations once the buffer has reached a sufficient capacity.
+///
+/// The mapping from data to JSON is:
+/// - `none` becomes `null` and `boolean` becomes `true` or `false`
+/// - `count`, `integer` and `real` become numbers, except for non-finite
+///   `real` values, which become `null`
+/// - `timestamp` becomes seconds since the epoch and `timespan` becomes
+///   seconds, both as numbers with nanosecond precision
+/// - `string`, `address`, `subnet`, `port` and `enum_value` become strings
+/// - `set` and `vector` become arrays
+/// - `table` becomes an array of `[key, value]` arrays, since keys need not be
+///   strings
+class json_writer {
+public:
+  /// Appends `x` to `buf`.
+  void append(std::string& buf, const data& x);
+
+  /// Appends `{"topic":<t>,"data":<x>}` and a newline to `buf`, i.e., one line
+  /// of NDJSON.
+  void append_line(std::string& buf, const topic& t, const data& x);
+
+  /// Appends `str` as quoted and escaped JSON string to `buf`.
+  static void append_string(std::string& buf, const std::string& str);
+
+private:
+  // Receives the string representation of addresses and subnets.
+  std::string scratch_;
+};
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "broker/data.hh"
+
+namespace broker {
+namespace detail {
+
+/// A Bloom filter over the keys of a data store. Answers whether a store may
+/// contain a key, i.e., a negative answer is definitive while a positive
+/// answer requires a lookup in the backend. The filter cannot remove keys.
+/// Hence, erased keys remain in the filter until the next `reset`.
+class key_filter {
+public:
+  /// Creates a filter for up to `capacity` keys with `bits_per_key` bits per
+  /// key. Ten bits per key result in a false positive rate of about 1%.
+  key_filter(size_t capacity, size_t bits_per_key);
+
+  /// Adds `key` to the filter.
+  void add(const data& key);
+
+  /// Returns `false` if the filter never saw `key`.
+  bool may_contain(const data& key) const;
+
+  /// Removes all keys and resizes the filter for up to `capacity` keys.
+  void reset(size_t capacity);
+
+  /// Returns the number of keys added since the last reset.
+  size_t size() const noexcept {
+    return size_;
+  }
+
+  /// Returns the number of keys the filter has room for at its configured
+  /// false positive rate.
+  size_t capacity() const noexcept {
+    return capacity_;
+  }
+
+  /// Returns whether the filter exceeds its capacity.
+  bool saturated() const noexcept {
+    return size_ > capacity_;
+  }
+
+private:
+  size_t bits_per_key_;
+  size_t capacity_;
+  size_t size_ = 0;
+  size_t num_hashes_;
+  std::vector<uint64_t> bits_;
+};
+
+} // namespace detail
+} // namespace broker
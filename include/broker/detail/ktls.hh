@@ -0,0 +1,15 @@
+#pragma once
+
+namespace broker {
+namespace detail {
+
+/// Lets OpenSSL hand record encryption of all TLS connections that the
+/// process establishes from now on to the kernel (kTLS). Replaces the
+/// `system_default` section of the OpenSSL configuration. Returns `false` if
+/// the platform or OpenSSL (before 3.0 or built without kTLS) lacks support.
+/// Connections still use user-space encryption if the kernel lacks the `tls`
+/// module or the negotiated cipher.
+bool enable_ktls();
+
+} // namespace detail
+} // namespace broker
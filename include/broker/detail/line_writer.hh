@@ -0,0 +1,26 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+
+#include <caf/behavior.hpp>
+#include <caf/fwd.hpp>
+
+namespace broker {
+namespace detail {
+
+struct line_writer_state {
+  std::ofstream out;
+
+  static const char* name;
+};
+
+/// Appends lines to `file_name`. The actor receives `std::vector<std::string>`
+/// messages and writes one line per element, flushing after each message.
+/// When spawned detached, senders never block on file I/O. The actor quits
+/// on `atom::shutdown` or if it cannot open or write to the file.
+caf::behavior line_writer(caf::stateful_actor<line_writer_state>* self,
+                          const std::string& file_name);
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "broker/time.hh"
+
+namespace broker {
+namespace detail {
+
+/// Estimates round-trip time, jitter, and throughput of the link to a peer
+/// from periodic probes. Smoothes RTT and jitter the same way as TCP
+/// (RFC 6298) and RTP (RFC 3550).
+class link_estimator {
+public:
+  /// Records a probe that returned after `rtt` at time `t`, reporting that
+  /// the peer received `received` messages from us in total.
+  void record(timespan rtt, uint64_t received, timestamp t);
+
+  /// Returns the RTT of the last probe.
+  timespan rtt() const noexcept {
+    return rtt_;
+  }
+
+  /// Returns the smoothed RTT.
+  timespan srtt() const noexcept {
+    return srtt_;
+  }
+
+  /// Returns the smoothed difference between the RTT of consecutive probes.
+  timespan jitter() const noexcept {
+    return jitter_;
+  }
+
+  /// Returns the messages per second that the peer received between the last
+  /// two probes.
+  double throughput() const noexcept {
+    return throughput_;
+  }
+
+  /// Returns the number of recorded probes.
+  size_t samples() const noexcept {
+    return samples_;
+  }
+
+private:
+  timespan rtt_{0};
+  timespan srtt_{0};
+  timespan jitter_{0};
+  double throughput_ = 0;
+  uint64_t received_ = 0;
+  timestamp last_;
+  size_t samples_ = 0;
+};
+
+} // namespace detail
+} // namespace broker
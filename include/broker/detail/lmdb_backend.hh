@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+
+#include "broker/backend_options.hh"
+
+#include "broker/detail/abstract_backend.hh"
+
+namespace broker {
+namespace detail {
+
+/// An LMDB storage backend. Reads decode values directly from the
+/// memory-mapped database and each modification commits in a single
+/// transaction.
+class lmdb_backend : public abstract_backend {
+public:
+  /// Constructs an LMDB backend.
+  /// @param opts The options to create/open a database.
+  ///
+  /// Required:
+  ///   - `path`: a `std::string` representing the directory of the database
+  ///             on the filesystem.
+  ///
+  /// Optional:
+  ///   - `map-size`: a `count` for the maximum size of the database in bytes.
+  ///                 (default = 1 GiB)
+  ///   - `no-sync`: a `boolean` that disables flushing to disk after each
+  ///                commit, trading durability on system crashes for write
+  ///                throughput. (default = false)
+  lmdb_backend(backend_options opts = backend_options{});
+
+  ~lmdb_backend();
+
+  expected<void> put(const data& key, data value,
+                     optional<timestamp> expiry) override;
+
+  expected<void> put_many(const std::unordered_map<data, data>& entries,
+                          optional<timestamp> expiry) override;
+
+  expected<void> add(const data& key, const data& value,
+                     data::type init_type,
+                     optional<timestamp> expiry) override;
+
+  expected<void> subtract(const data& key, const data& value,
+                          optional<timestamp> expiry) override;
+
+  expected<void> erase(const data& key) override;
+
+  expected<void> erase_many(const std::vector<data>& keys) override;
+
+  expected<void> clear() override;
+
+  expected<bool> expire(const data& key, timestamp current_time) override;
+
+  expected<std::vector<data>> expire_many(const std::vector<data>& keys,
+                                          timestamp current_time) override;
+
+  expected<data> get(const data& key) const override;
+
+  expected<data> get_many(const std::vector<data>& keys) const override;
+
+  expected<data> scan(const std::string& prefix, size_t limit) const override;
+
+  expected<optional<data>> scan(const optional<data>& start, size_t batch_size,
+                                const scan_callback& f) const override;
+
+  expected<bool> exists(const data& key) const override;
+
+  expected<uint64_t> size() const override;
+
+  expected<data> keys() const override;
+
+  expected<broker::snapshot> snapshot() const override;
+
+  expected<expirables> expiries() const override;
+
+private:
+  bool open_db();
+
+  struct impl;
+  std::unique_ptr<impl> impl_;
+};
+
+} // namespace detail
+} // namespace broker
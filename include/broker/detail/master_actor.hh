@@ -1,23 +1,39 @@
 #pragma once
 
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include <caf/actor.hpp>
 #include <caf/behavior.hpp>
 #include <caf/stateful_actor.hpp>
 #include <caf/event_based_actor.hpp>
 
+#include "broker/backend.hh"
+#include "broker/backend_options.hh"
+#include "broker/change_subscriber.hh"
 #include "broker/data.hh"
+#include "broker/detail/abstract_backend.hh"
+#include "broker/detail/compression.hh"
+#include "broker/detail/generator_file_recorder.hh"
+#include "broker/detail/key_filter.hh"
+#include "broker/detail/memory_accounting.hh"
+#include "broker/detail/shared_snapshot.hh"
+#include "broker/detail/store_workload.hh"
 #include "broker/fwd.hh"
 #include "broker/internal_command.hh"
+#include "broker/snapshot.hh"
 #include "broker/topic.hh"
 #include "broker/endpoint.hh"
 
 namespace broker {
 namespace detail {
 
-class abstract_backend;
-
 class master_state {
 public:
   /// Allows us to apply this state as a visitor to internal commands.
@@ -29,22 +45,191 @@ public:
   /// Creates an uninitialized object.
   master_state();
 
+  /// Removes the files of unfinished checkpoint transfers.
+  ~master_state();
+
   /// Initializes the object.
   void init(caf::event_based_actor* ptr, std::string&& nm,
-            backend_pointer&& bp, caf::actor&& parent, endpoint::clock* clock);
+            backend_pointer&& bp, caf::actor&& parent, endpoint::clock* clock,
+            memory_accounting_ptr mem);
+
+  /// Reads the expiration times of all keys from the backend. Schedules all
+  /// of them immediately unless `deferred` is set, in which case the master
+  /// schedules them in chunks via `load_pending_expiries`.
+  void load_expiries(bool deferred);
+
+  /// Reads the expiration times for the next expiry window from the backend
+  /// and schedules loading the window after that. Reads all expiration times
+  /// if the window is 0.
+  expected<expirables> read_expiries();
+
+  /// Schedules all expirations in the next expiry window.
+  void load_expiry_window();
+
+  /// Schedules up to `defaults::store::expiry_load_chunk_size` entries of
+  /// `pending_expiries` and sends a message to itself for the next chunk.
+  void load_pending_expiries();
 
   /// Sends `x` to all clones.
   void broadcast(internal_command&& x);
 
+  /// Assigns the next sequence number to `cmd`, stores it in the replay log
+  /// and sends it to all clones. Sends all coalesced commands first.
   template <class T>
   void broadcast_cmd_to_clones(T cmd) {
-    if (!clones.empty())
-      broadcast(internal_command{std::move(cmd)});
+    flush_coalesced();
+    sequence(internal_command{std::move(cmd)});
   }
 
+  /// Holds back `cmd` for the coalescing window if enabled, replacing any
+  /// previous command for the same key. Never holds back writes of clones.
+  void broadcast_cmd_to_clones(put_command cmd);
+
+  /// Holds back `cmd` for the coalescing window if enabled, merging it with
+  /// a previous command for the same key if possible.
+  void broadcast_cmd_to_clones(add_command cmd);
+
+  /// Sends all commands held back for coalescing to the clones.
+  void flush_coalesced();
+
+  /// Assigns the next sequence number to `x`, stores it in the replay log
+  /// and sends it to all clones.
+  void sequence(internal_command&& x);
+
+  /// Resynchronizes `clone` by sending it all commands after `last_seq` or by
+  /// falling back to a full snapshot if the replay log no longer contains all
+  /// missing commands.
+  void resync(const caf::actor& clone, uint64_t last_seq);
+
+  /// Sends a snapshot to `clone` and adds `clone` to the list of clones.
+  /// @param monitored The actor we monitor for detecting when the clone
+  ///                  disappears.
+  void start_snapshot(const caf::actor& monitored, const caf::actor& clone);
+
+  /// Sends a checkpoint of the backend files to `clone` if the cache of the
+  /// clone uses the backend type `type_name`, otherwise falls back to a
+  /// regular snapshot.
+  void start_checkpoint_transfer(const caf::actor& clone,
+                                 const std::string& type_name);
+
+  /// Schedules `key` for expiration after `expiry`.
   void remind(timespan expiry, const data& key);
 
-  void expire(data& key);
+  /// Schedules `key` for expiration at `expiry`. Adds `key` to the bucket of
+  /// all keys expiring in the same `defaults::store::expiry_resolution`
+  /// interval and starts a timer if the bucket did not exist yet.
+  void remind(timestamp expiry, data key);
+
+  /// Expires all keys in buckets that are due, i.e., at least all keys in the
+  /// bucket for `deadline`.
+  void expire(timestamp deadline);
+
+  /// Sends the expiration times of all keys to `clone` ahead of a snapshot
+  /// or checkpoint. Clones with local expiry as well as standby masters keep
+  /// the expiration times of the transferred keys.
+  void send_expiries(const caf::actor& clone);
+
+  /// Returns the current content of the backend, reusing the cached snapshot
+  /// if possible.
+  std::shared_ptr<const snapshot> make_snapshot();
+
+  /// Publishes a new read snapshot before processing the next message, unless
+  /// read snapshots are disabled or the master already scheduled an update.
+  void schedule_publish();
+
+  /// Replaces the read snapshot with the current content of the backend.
+  void publish();
+
+  /// Sends the next chunk of the snapshot for `clone` or drops the transfer
+  /// state after sending the last chunk.
+  void send_snapshot_chunk(const caf::actor& clone);
+
+  /// Sends the next chunk of the checkpoint transfer to `clone`.
+  void send_checkpoint_chunk(const caf::actor& clone);
+
+  /// Compresses the remaining chunks of the snapshot transfer to `clone` if
+  /// `offer` contains `snapshot_compression`.
+  void negotiate_compression(const caf::actor& clone,
+                             const std::vector<std::string>& offer);
+
+  /// Makes sure that the master calls `flush` on its backend within the
+  /// flush interval of the backend.
+  void schedule_flush();
+
+  /// Commits pending modifications of the backend.
+  void flush();
+
+  /// Fills the key filter with all keys of the backend, leaving room for twice
+  /// as many keys. Disables the filter if the master cannot read the keys.
+  void rebuild_key_filter();
+
+  /// Adds `key` to the key filter, if any. Rebuilds the filter once it runs
+  /// out of capacity, which also drops erased keys.
+  void key_added(const data& key);
+
+  /// Returns `false` if the key filter rules out that the backend contains
+  /// `key`.
+  bool may_contain(const data& key);
+
+  /// Returns the reader for the next query, alternating between all readers.
+  const caf::actor& next_reader() {
+    return readers[next_reader_index++ % readers.size()];
+  }
+
+  /// Returns whether any change feed selects `key`.
+  bool watched(const data& key) const;
+
+  /// Sends each change feed the subset of `changes` it selects. Callers
+  /// should check `change_feeds.empty()` first to avoid building `changes`
+  /// needlessly.
+  void notify(const std::vector<store_change>& changes);
+
+  /// Notifies the change feeds about a single change.
+  void notify(store_change::kind type, const data& key,
+              const data& value = data{});
+
+  /// Notifies the change feeds about the same change to each of `keys`.
+  void notify_all(store_change::kind type, const std::vector<data>& keys);
+
+  /// Notifies the change feeds about the new value of `key`, which the master
+  /// reads from the backend only if a feed selects `key`.
+  void notify_put(const data& key);
+
+  /// Passes the change in memory usage of the backend to `memory`.
+  void update_memory_usage();
+
+  /// Checks whether the master must drop `cmd` because master stores reached
+  /// their memory limit. Only rejects commands that may grow the store.
+  bool reject(const internal_command::variant_type& cmd);
+
+  /// Asks the core for the primary master while in standby mode and retries
+  /// periodically until finding one.
+  void resolve_primary();
+
+  /// Requests a snapshot from the primary for the standby backend.
+  void request_standby_snapshot();
+
+  /// Replaces the content of the backend with a snapshot chunk from the
+  /// primary while in standby mode.
+  void apply_standby_chunk(snapshot& chunk, uint64_t snapshot_seq, bool last);
+
+  /// Applies a command that the primary broadcasted to its clones, assigning
+  /// it the same sequence number. Buffers commands until the standby has
+  /// received a snapshot.
+  void replicate(internal_command& cmd);
+
+  /// Leaves standby mode and registers the master at the core.
+  void promote();
+
+  /// Opens the workload recording if `broker.store.workload-directory`
+  /// points to a directory.
+  void open_workload_recording();
+
+  /// Adds `cmd` to the workload recording, if any.
+  void record(const internal_command::variant_type& cmd);
+
+  /// Adds a query to the workload recording, if any.
+  void record(store_query query, const data& x);
 
   void command(internal_command& cmd);
 
@@ -70,6 +255,14 @@ public:
 
   void operator()(clear_command&);
 
+  void operator()(put_many_command&);
+
+  void operator()(erase_many_command&);
+
+  void operator()(compare_and_swap_command&);
+
+  void operator()(add_and_get_command&);
+
   caf::event_based_actor* self;
 
   std::string id;
@@ -84,13 +277,187 @@ public:
 
   endpoint::clock* clock;
 
+  /// Keeps track of a snapshot that is currently on its way to a clone.
+  struct snapshot_transfer {
+    std::shared_ptr<const snapshot> content;
+    snapshot::const_iterator position;
+    uint64_t seq;
+    compression algorithm = compression::none;
+    /// The actor whose termination cancels this transfer.
+    caf::actor_addr monitored;
+  };
+
+  /// Stores snapshots that are currently on their way to clones. The master
+  /// sends each snapshot in bounded chunks and only sends the next chunk after
+  /// the clone acknowledged the previous one.
+  std::unordered_map<caf::actor, snapshot_transfer> snapshot_transfers;
+
+  /// Keeps track of a checkpoint whose files are on their way to a clone.
+  struct checkpoint_transfer {
+    /// Temporary directory that holds the checkpoint.
+    std::string dir;
+    /// Location of the checkpoint. File names in chunks are relative to it.
+    std::string root;
+    std::vector<std::string> files;
+    size_t file_index;
+    uint64_t offset;
+    uint64_t seq;
+    /// The actor whose termination cancels this transfer.
+    caf::actor_addr monitored;
+  };
+
+  /// Stores checkpoints that are currently on their way to clones. Uses the
+  /// same flow control as snapshot transfers.
+  std::unordered_map<caf::actor, checkpoint_transfer> checkpoint_transfers;
+
+  /// Type of `backend`.
+  backend backend_type = backend::memory;
+
+  /// Algorithm for compressing snapshot chunks to clones that support it.
+  compression snapshot_compression = compression::none;
+
+  /// Caches the last snapshot until the next modification or until the
+  /// cache window expires. Allows the master to serve bursts of clones with a
+  /// single read from the backend.
+  std::shared_ptr<const snapshot> cached_snapshot;
+
+  /// Sequence number of the last command reflected in `cached_snapshot`.
+  uint64_t cached_snapshot_seq = 0;
+
+  /// Sequence number of the last broadcasted command. Starts at a random
+  /// multiple of 2^32.
+  uint64_t seq = 0;
+
+  /// Stores the last `defaults::store::replay_log_size` commands.
+  std::deque<internal_command> replay_log;
+
+  /// Maps deadlines to the keys that may expire at that time. Keys may appear
+  /// more than once or after being overridden, since the backend checks the
+  /// actual expiry of each key.
+  std::map<timestamp, std::vector<data>> expiry_buckets;
+
+  /// Stores whether the master already scheduled a call to `flush`.
+  bool flush_scheduled = false;
+
+  /// Time span for collapsing successive updates to the same key before
+  /// sending them to clones. Disabled if 0.
+  timespan coalesce_window;
+
+  /// Commands for clones held back during the coalescing window.
+  std::vector<internal_command> coalesced;
+
+  /// Maps keys to their position in `coalesced`.
+  std::unordered_map<data, size_t> coalesced_index;
+
+  /// Stores whether the master currently processes a command it received
+  /// via the store topic rather than from its frontend.
+  bool from_clone = false;
+
+  /// Allows frontends to read from the latest snapshot without sending a
+  /// message to the master. Disabled if `nullptr`.
+  shared_snapshot_ptr read_snapshot;
+
+  /// Stores whether the master already scheduled a call to `publish`.
+  bool publish_scheduled = false;
+
+  /// Expiration times from the backend that the master did not schedule yet.
+  /// Only used when deferring expiries.
+  expirables pending_expiries;
+
+  /// Time span of upcoming expirations to load from the backend at once.
+  /// Disabled if 0.
+  timespan expiry_window;
+
+  /// All expirations up to this point in time are scheduled.
+  timestamp expiries_loaded_until = timestamp::min();
+
+  /// Stores whether clones expire keys on their own. The master then no
+  /// longer broadcasts erase commands for expired keys.
+  bool clone_local_expiry = false;
+
+  /// Number of commands from the core that other stores on this endpoint
+  /// still referenced, forcing us to copy them before applying.
+  size_t unshares = 0;
+
+  /// Tracks the memory usage of the backend.
+  memory_counter memory;
+
+  /// Number of commands dropped because of the memory limit.
+  size_t rejected = 0;
+
+  /// Answers lookups for missing keys without querying the backend. Disabled
+  /// if `nullptr`.
+  std::unique_ptr<key_filter> known_keys;
+
+  /// Number of lookups that the key filter answered.
+  size_t key_filter_hits = 0;
+
+  /// Answer queries in their own threads with separate read-only handles to
+  /// the backend. The master answers queries itself if empty.
+  std::vector<caf::actor> readers;
+
+  /// Selects the reader for the next query.
+  size_t next_reader_index = 0;
+
+  /// Records all commands and queries for replaying them later. Disabled if
+  /// `nullptr`.
+  generator_file_recorder_ptr workload;
+
+  /// Receives all changes of keys that start with `prefix`.
+  struct change_feed {
+    caf::actor worker;
+    std::string prefix;
+
+    /// Returns whether the feed includes changes of `key`. Feeds include
+    /// `clear` events regardless of their prefix.
+    bool selects(const data& key) const;
+  };
+
+  /// Workers of change subscribers, see `store::subscribe_changes`.
+  std::vector<change_feed> change_feeds;
+
+  /// Stores whether this master mirrors a primary master as a hot standby.
+  /// A standby applies the commands that the primary broadcasts to its
+  /// clones and takes over once the primary goes down.
+  bool standby = false;
+
+  /// The master that this standby mirrors, if known.
+  caf::actor primary;
+
+  /// Stores whether the standby backend reflects a snapshot of `primary`.
+  bool standby_synced = false;
+
+  /// Stores whether we have received at least one chunk of the snapshot.
+  bool receiving_standby_snapshot = false;
+
+  /// Commands from `primary` that arrived while waiting for the snapshot.
+  std::vector<internal_command> standby_buffer;
+
+  /// Expiration times that `primary` sent ahead of its snapshot.
+  table standby_expiries;
+
   static const char* name;
 };
 
+/// Spawns a master in standby mode, see `master_state::standby`.
+caf::behavior standby_master_actor(caf::stateful_actor<master_state>* self,
+                                   caf::actor core, std::string id,
+                                   backend backend_type, backend_options opts,
+                                   endpoint::clock* clock,
+                                   memory_accounting_ptr memory);
+
+/// Answers queries from a read-only `backend` on behalf of a master.
+caf::behavior master_reader(caf::event_based_actor* self,
+                            std::shared_ptr<const abstract_backend> backend);
+
+/// Spawns a master that opens its backend of type `backend_type` with `opts`
+/// when starting. Hence, the core never blocks on opening a backend and
+/// detached masters open their backends in parallel.
 caf::behavior master_actor(caf::stateful_actor<master_state>* self,
                            caf::actor core, std::string id,
-                           master_state::backend_pointer backend,
-                           endpoint::clock* clock);
+                           backend backend_type, backend_options opts,
+                           endpoint::clock* clock,
+                           memory_accounting_ptr memory);
 
 } // namespace detail
 } // namespace broker
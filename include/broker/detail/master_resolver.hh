@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include <vector>
 
 #include <caf/actor.hpp>
@@ -12,12 +13,16 @@ namespace detail {
 
 struct master_resolver_state {
   size_t remaining_responses;
+  std::string name;
   caf::actor who_asked;
 };
 
 using master_resolver_actor = caf::stateful_actor<master_resolver_state>;
 
-/// Queries each peer in `peers`.
+/// Queries each peer in `peers` for the master of a store and responds to
+/// `who_asked` with `(master, resolve, name, actor)` on the first hit or with
+/// `(master, resolve, name, error)` if no peer knows the master within
+/// `timeout::frontend`.
 caf::behavior master_resolver(master_resolver_actor* self);
 
 } // namespace detail
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+#include <caf/fwd.hpp>
+#include <caf/intrusive_ptr.hpp>
+#include <caf/ref_counted.hpp>
+
+#include "broker/data.hh"
+#include "broker/internal_command.hh"
+
+namespace broker {
+namespace detail {
+
+/// Approximates the number of bytes that an endpoint keeps in its buffers,
+/// broken down by subsystem. All actors and subscribers of an endpoint share
+/// one instance and update it concurrently. Byte counts use the same estimates
+/// as the core metrics (see `estimated_size`) and thus only cover payloads.
+class memory_accounting : public caf::ref_counted {
+public:
+  enum subsystem : size_t {
+    /// Messages waiting in the queues of local subscribers.
+    subscriber_queues,
+    /// Batches from blocked peers that the core keeps in memory.
+    blocked_peers,
+    /// Content of master stores with a memory backend.
+    master_stores,
+    /// Local writes and remote updates that clones buffer.
+    clone_buffers,
+  };
+
+  static constexpr size_t num_subsystems = 4;
+
+  /// Creates an instance without limits.
+  memory_accounting();
+
+  /// Creates an instance with the limits in `broker.memory`.
+  explicit memory_accounting(const caf::actor_system_config& cfg);
+
+  void add(subsystem s, size_t bytes) noexcept {
+    usage_[s].fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  void remove(subsystem s, size_t bytes) noexcept {
+    usage_[s].fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  size_t usage(subsystem s) const noexcept {
+    return usage_[s].load(std::memory_order_relaxed);
+  }
+
+  /// Returns the limit for `s` or 0 if `s` may grow without bounds.
+  size_t limit(subsystem s) const noexcept {
+    return limits_[s];
+  }
+
+  void limit(subsystem s, size_t bytes) noexcept {
+    limits_[s] = bytes;
+  }
+
+  /// Checks whether `s` has reached its limit.
+  bool exhausted(subsystem s) const noexcept {
+    return limits_[s] > 0 && usage(s) >= limits_[s];
+  }
+
+  /// Returns the name of `s` in configuration keys and metrics.
+  static const char* name(subsystem s) noexcept;
+
+  /// Converts the usage to a table that maps the name of each subsystem to a
+  /// table with the keys `bytes` and `limit`.
+  data to_data() const;
+
+private:
+  std::array<std::atomic<size_t>, num_subsystems> usage_;
+  std::array<size_t, num_subsystems> limits_;
+};
+
+/// @relates memory_accounting
+using memory_accounting_ptr = caf::intrusive_ptr<memory_accounting>;
+
+/// Approximates the number of bytes for the payload of `x`.
+size_t estimated_size(const internal_command& x);
+
+/// Tracks the bytes of a single container in a ::memory_accounting. Keeps the
+/// local sum in order to return it to the accounting when going out of scope.
+class memory_counter {
+public:
+  memory_counter() = default;
+
+  memory_counter(memory_accounting_ptr ptr, memory_accounting::subsystem s)
+    : ptr_(std::move(ptr)), subsystem_(s) {
+    // nop
+  }
+
+  memory_counter(const memory_counter&) = delete;
+
+  memory_counter& operator=(const memory_counter&) = delete;
+
+  ~memory_counter() {
+    reset();
+  }
+
+  /// Starts tracking bytes for `s` in `ptr`, returning all previously tracked
+  /// bytes to the old accounting.
+  void attach(memory_accounting_ptr ptr, memory_accounting::subsystem s) {
+    reset();
+    ptr_ = std::move(ptr);
+    subsystem_ = s;
+  }
+
+  void add(size_t bytes) noexcept {
+    if (ptr_) {
+      bytes_ += bytes;
+      ptr_->add(subsystem_, bytes);
+    }
+  }
+
+  void remove(size_t bytes) noexcept {
+    if (ptr_) {
+      bytes_ -= bytes;
+      ptr_->remove(subsystem_, bytes);
+    }
+  }
+
+  /// Returns all bytes to the accounting.
+  void reset() noexcept {
+    if (ptr_ && bytes_ > 0) {
+      ptr_->remove(subsystem_, bytes_);
+      bytes_ = 0;
+    }
+  }
+
+  bool exhausted() const noexcept {
+    return ptr_ && ptr_->exhausted(subsystem_);
+  }
+
+  size_t bytes() const noexcept {
+    return bytes_;
+  }
+
+private:
+  memory_accounting_ptr ptr_;
+  memory_accounting::subsystem subsystem_ = memory_accounting::master_stores;
+  size_t bytes_ = 0;
+};
+
+} // namespace detail
+} // namespace broker
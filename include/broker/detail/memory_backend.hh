@@ -1,19 +1,34 @@
 #pragma once
 
+#include <memory>
+#include <string>
 #include <unordered_map>
 
 #include "broker/backend_options.hh"
 
 #include "broker/detail/abstract_backend.hh"
+#include "broker/detail/memory_journal.hh"
+#include "broker/detail/radix_tree.hh"
 
 namespace broker {
 namespace detail {
 
-/// An in-memory key-value storage backend.
+/// An in-memory key-value storage backend. Keeps all entries in a hash table,
+/// i.e., point lookups only compare keys with equal hash values. Ordered views
+/// (`keys`) are computed on demand. Optionally indexes string keys in a radix
+/// tree for answering prefix scans without visiting unrelated entries.
+/// Optionally persists its content in a journal for restoring it on restart.
 class memory_backend : public abstract_backend {
 public:
   /// Constructs a memory backend.
-  /// @param opts The options controlling the backend behavior.
+  /// @param opts The options controlling the backend behavior. The option
+  ///             `capacity` pre-allocates buckets for the given number of
+  ///             entries to avoid rehashing while the store grows. Setting
+  ///             the option `prefix-index` to `true` enables the radix tree.
+  ///             Setting the option `checkpoint` to a file name enables the
+  ///             journal. The backend then hands its log to the operating
+  ///             system every `checkpoint-ms` milliseconds (default: 1000)
+  ///             and writes a new snapshot whenever the log outgrows it.
   memory_backend(backend_options opts = backend_options{});
 
   expected<void> put(const data& key, data value,
@@ -35,6 +50,11 @@ public:
 
   expected<data> get(const data& key, const data& value) const override;
 
+  expected<data> scan(const std::string& prefix, size_t limit) const override;
+
+  expected<optional<data>> scan(const optional<data>& start, size_t batch_size,
+                                const scan_callback& f) const override;
+
   expected<bool> exists(const data& key) const override;
 
   expected<uint64_t> size() const override;
@@ -45,10 +65,56 @@ public:
 
   expected<expirables> expiries() const override;
 
+  size_t memory_usage() const override;
+
+  expected<void> flush() override;
+
+  timespan flush_interval() const override;
+
 private:
+  using store_type
+    = std::unordered_map<data, std::pair<data, optional<timestamp>>>;
+
+  /// Maps string keys to their entry in the store. Rehashing an unordered map
+  /// leaves pointers to its elements valid.
+  using index_type = radix_tree<store_type::value_type*>;
+
+  /// Adds `entry` to the index if enabled.
+  void add_to_index(store_type::value_type& entry);
+
+  /// Removes `key` from the index if enabled.
+  void remove_from_index(const data& key);
+
+  /// Restores the content from the journal at `path` and starts logging.
+  void open_journal(const std::string& path);
+
+  /// Applies a command from the journal.
+  void replay(memory_journal::command& cmd);
+
+  /// Appends `cmd` to the journal if enabled.
+  void log(memory_journal::command cmd);
+
+  /// Writes all entries to a new snapshot.
+  caf::error write_snapshot();
+
   backend_options options_;
-  std::unordered_map<data, std::pair<data, optional<timestamp>>> store_;
-  std::unordered_map<data, timestamp> expirations_;
+  store_type store_;
+  std::unique_ptr<index_type> index_;
+
+  /// Counts string keys with embedded null characters. The radix tree treats
+  /// the null character as terminator, so scans fall back to visiting all
+  /// entries as long as the store contains such keys.
+  size_t unindexed_ = 0;
+
+  /// Estimated size of all keys and values in `store_`.
+  size_t bytes_ = 0;
+
+  std::unique_ptr<memory_journal> journal_;
+
+  timespan checkpoint_interval_;
+
+  /// Forces a new snapshot on the next flush after failing to write the log.
+  bool journal_failed_ = false;
 };
 
 } // namespace detail
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+
+#include <caf/binary_serializer.hpp>
+#include <caf/error.hpp>
+
+#include "broker/data.hh"
+#include "broker/expected.hh"
+#include "broker/internal_command.hh"
+#include "broker/optional.hh"
+#include "broker/time.hh"
+
+namespace broker {
+namespace detail {
+
+/// Persists the content of a memory backend in two files: a snapshot of all
+/// entries at `path` and an append-only log of all modifications since the
+/// snapshot at `path + ".log"`. Both files consist of a header with a
+/// generation number followed by size-prefixed records of serialized
+/// commands. Writing a snapshot goes to a temporary file that replaces the
+/// previous snapshot atomically and bumps the generation before truncating
+/// the log. Hence, loading never replays a log on top of a snapshot that
+/// already contains its commands.
+class memory_journal {
+public:
+  using command = internal_command::variant_type;
+
+  using entry_callback
+    = std::function<void(data& key, data& value, optional<timestamp> expiry)>;
+
+  using command_callback = std::function<void(command& cmd)>;
+
+  static constexpr uint32_t magic = 0x2EECC0DF;
+
+  static constexpr uint8_t version = 1;
+
+  explicit memory_journal(std::string path);
+
+  memory_journal(const memory_journal&) = delete;
+
+  memory_journal& operator=(const memory_journal&) = delete;
+
+  ~memory_journal();
+
+  /// Calls `on_entry` for each entry of the snapshot and then `on_command`
+  /// for each command in the log of the same generation. Stops at the first
+  /// incomplete record, i.e., drops a partially written tail of the log.
+  /// @returns the number of replayed commands.
+  expected<size_t> load(const entry_callback& on_entry,
+                        const command_callback& on_command);
+
+  /// Starts an empty log for the current generation.
+  caf::error reset_log();
+
+  /// Appends `cmd` to the log. Buffers the record until the next `flush`.
+  caf::error append(const command& cmd);
+
+  /// Hands all buffered records to the operating system.
+  caf::error flush();
+
+  /// Starts writing a new snapshot.
+  caf::error begin_snapshot();
+
+  /// Adds an entry to the new snapshot.
+  /// @pre `begin_snapshot()` succeeded
+  caf::error add_to_snapshot(const data& key, const data& value,
+                             optional<timestamp> expiry);
+
+  /// Replaces the previous snapshot with the new one and starts an empty log.
+  /// @pre `begin_snapshot()` succeeded
+  caf::error commit_snapshot();
+
+  /// Returns the number of bytes in the log.
+  size_t log_size() const noexcept {
+    return log_size_;
+  }
+
+  /// Returns the number of bytes in the snapshot.
+  size_t snapshot_size() const noexcept {
+    return snapshot_size_;
+  }
+
+  uint64_t generation() const noexcept {
+    return generation_;
+  }
+
+  const std::string& path() const noexcept {
+    return path_;
+  }
+
+  /// Converts an absolute expiry time into the representation in commands,
+  /// i.e., the time since the epoch.
+  static optional<timespan> encode_expiry(optional<timestamp> x) {
+    if (x)
+      return x->time_since_epoch();
+    return nil;
+  }
+
+  /// Restores an absolute expiry time from its representation in commands.
+  static optional<timestamp> decode_expiry(optional<timespan> x) {
+    if (x)
+      return timestamp{*x};
+    return nil;
+  }
+
+private:
+  /// Opens `file_name` and writes the header for generation `gen`.
+  caf::error open(std::ofstream& out, const std::string& file_name,
+                  uint64_t gen);
+
+  /// Serializes `cmd` as size-prefixed record to `out`.
+  caf::error write(std::ofstream& out, const std::string& file_name,
+                   const command& cmd, size_t& bytes);
+
+  std::string path_;
+  uint64_t generation_ = 0;
+  std::ofstream log_;
+  size_t log_size_ = 0;
+  std::ofstream snapshot_;
+  size_t snapshot_size_ = 0;
+  size_t pending_size_ = 0;
+  caf::binary_serializer::container_type buf_;
+};
+
+} // namespace detail
+} // namespace broker
@@ -37,6 +37,14 @@ public:
 
   caf::error operator()(const clear_command& x);
 
+  caf::error operator()(const put_many_command& x);
+
+  caf::error operator()(const erase_many_command& x);
+
+  caf::error operator()(const compare_and_swap_command& x);
+
+  caf::error operator()(const add_and_get_command& x);
+
 private:
   caf::error apply_tag(uint8_t tag);
 
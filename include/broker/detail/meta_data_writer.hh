@@ -14,6 +14,7 @@ namespace broker {
 namespace detail {
 
 /// Writes meta information (type and size) of Broker ::data to a serializer.
+/// Sizes use the LEB128 varints of ::data_codec.
 class meta_data_writer {
 public:
   meta_data_writer(caf::binary_serializer& sink);
@@ -39,6 +40,11 @@ public:
     return apply(x.name.size());
   }
 
+  caf::error operator()(const packed_data& x) {
+    BROKER_TRY(apply(data_tag<packed_data>()));
+    return apply(x.bytes.size());
+  }
+
   caf::error operator()(const set& xs) {
     BROKER_TRY(apply(data_tag<set>()));
     return apply_container(xs);
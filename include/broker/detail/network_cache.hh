@@ -13,8 +13,10 @@
 #include <caf/optional.hpp>
 #include <caf/result.hpp>
 
+#include "broker/atoms.hh"
 #include "broker/logger.hh"
 #include "broker/network_info.hh"
+#include "broker/time.hh"
 
 namespace broker {
 namespace detail {
@@ -29,6 +31,14 @@ public:
 
   void set_use_ssl(bool use_ssl_) { use_ssl = use_ssl_; }
 
+  /// Resolves host names via `resolver` (see ::address_resolver) before
+  /// connecting to them and caches numeric addresses for `ttl`. Keeps
+  /// blocking DNS queries out of the middleman.
+  void set_resolver(caf::actor resolver, timespan ttl) {
+    resolver_ = std::move(resolver);
+    resolver_ttl_ = ttl;
+  }
+
   /// Either returns an actor handle immediately if the entry is cached or
   /// queries the middleman actor and responds later via response promise.
   caf::result<caf::actor> fetch(const network_info& x);
@@ -41,26 +51,20 @@ public:
       f(*y);
       return;
     }
-    BROKER_INFO("initiating connection to"
-                << (x.address + ":" + std::to_string(x.port))
-                << (use_ssl ? "(SSL)" : "(no SSL)"));
-    auto hdl = (use_ssl ? self->home_system().openssl_manager().actor_handle()
-                        : self->home_system().middleman().actor_handle());
-    self->request(hdl, infinite,
-                  connect_atom::value, x.address, x.port)
+    if (!resolver_) {
+      connect(x, x.address, std::move(f), std::move(g));
+      return;
+    }
+    if (auto addr = find_address(x.address)) {
+      connect(x, std::move(*addr), std::move(f), std::move(g));
+      return;
+    }
+    self->request(resolver_, infinite, atom::resolve::value, x.address)
     .then(
-      [=](const node_id&, strong_actor_ptr& res,
-          std::set<std::string>& ifs) mutable {
-        if (!ifs.empty())
-          g(sec::unexpected_actor_messaging_interface);
-        else if (res == nullptr)
-          g(sec::no_actor_published_at_port);
-        else {
-          auto hdl = actor_cast<actor>(std::move(res));
-          hdls_.emplace(x, hdl);
-          addrs_.emplace(hdl, x);
-          f(std::move(hdl));
-        }
+      [=](std::string& addr) mutable {
+        BROKER_DEBUG("resolved" << x.address << "to" << addr);
+        resolved_[x.address] = resolved_address{addr, now() + resolver_ttl_};
+        connect(x, std::move(addr), std::move(f), std::move(g));
       },
       [=](error& err) mutable {
         g(std::move(err));
@@ -111,6 +115,48 @@ public:
   void remove(const network_info& x);
 
 private:
+  struct resolved_address {
+    std::string address;
+    timestamp expires;
+  };
+
+  /// Returns the cached numeric address for `host` unless expired.
+  caf::optional<std::string> find_address(const std::string& host);
+
+  /// Connects to `x` using the (possibly numeric) address `addr`.
+  template <class OnResult, class OnError>
+  void connect(const network_info& x, std::string addr, OnResult f,
+               OnError g) {
+    using namespace caf;
+    BROKER_INFO("initiating connection to"
+                << (x.address + ":" + std::to_string(x.port))
+                << (use_ssl ? "(SSL)" : "(no SSL)"));
+    auto hdl = (use_ssl ? self->home_system().openssl_manager().actor_handle()
+                        : self->home_system().middleman().actor_handle());
+    self->request(hdl, infinite,
+                  connect_atom::value, std::move(addr), x.port)
+    .then(
+      [=](const node_id&, strong_actor_ptr& res,
+          std::set<std::string>& ifs) mutable {
+        if (!ifs.empty())
+          g(sec::unexpected_actor_messaging_interface);
+        else if (res == nullptr)
+          g(sec::no_actor_published_at_port);
+        else {
+          auto hdl = actor_cast<actor>(std::move(res));
+          hdls_.emplace(x, hdl);
+          addrs_.emplace(hdl, x);
+          f(std::move(hdl));
+        }
+      },
+      [=](error& err) mutable {
+        // The host may have moved, so resolve it again on the next attempt.
+        resolved_.erase(x.address);
+        g(std::move(err));
+      }
+    );
+  }
+
   // Parent.
   caf::event_based_actor* self;
   bool use_ssl = true;
@@ -120,6 +166,15 @@ private:
 
   // Maps network addresses to remote actor handles.
   std::unordered_map<network_info, caf::actor> hdls_;
+
+  // Pool of address resolvers (optional).
+  caf::actor resolver_;
+
+  // Lifetime of entries in resolved_.
+  timespan resolver_ttl_;
+
+  // Maps host names to numeric addresses.
+  std::unordered_map<std::string, resolved_address> resolved_;
 };
 
 } // namespace detail
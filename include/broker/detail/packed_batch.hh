@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <caf/error.hpp>
+#include <caf/fwd.hpp>
+#include <caf/meta/type_name.hpp>
+
+#include "broker/message.hh"
+
+namespace broker {
+namespace detail {
+
+/// A batch of node messages in binary serialization that shares headers
+/// between messages. Each run of consecutive messages with the same kind,
+/// TTL, origin, receiver, and topic (and with consecutive sequence numbers)
+/// starts with a single header, followed by the payloads of all messages in
+/// the run.
+struct packed_batch {
+  /// Number of messages in the batch.
+  uint32_t size = 0;
+
+  /// Whether data payloads use the encoding of ::data_codec instead of the
+  /// binary serialization. Only set for peers that accepted the encoding.
+  bool compact = false;
+
+  /// Serialized runs.
+  std::vector<char> bytes;
+};
+
+/// @relates packed_batch
+template <class Inspector>
+typename Inspector::result_type inspect(Inspector& f, packed_batch& x) {
+  return f(caf::meta::type_name("packed_batch"), x.size, x.compact, x.bytes);
+}
+
+/// Serializes `xs` into `result`. Encodes data payloads with ::data_codec if
+/// `compact` is set.
+caf::error pack(caf::actor_system& sys, const std::vector<node_message>& xs,
+                packed_batch& result, bool compact = false);
+
+/// Deserializes `x` into `result`.
+caf::error unpack(caf::actor_system& sys, const packed_batch& x,
+                  std::vector<node_message>& result);
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "broker/detail/abstract_backend.hh"
+
+namespace broker {
+namespace detail {
+
+/// Spreads the keys of a store over several backends by their hash. Each
+/// partition has a thread of its own for operations on many keys, i.e.,
+/// `put_many`, `erase_many`, `expire_many`, and `flush` as well as queries
+/// that visit all entries. Operations on a single key run in the calling
+/// thread on the partition of the key.
+class partitioned_backend : public abstract_backend {
+public:
+  using backend_pointer = std::unique_ptr<abstract_backend>;
+
+  /// Constructs a backend from at least one partition. Keys go to the
+  /// partition at `shard_of(key, partitions.size())`.
+  explicit partitioned_backend(std::vector<backend_pointer> partitions);
+
+  ~partitioned_backend();
+
+  expected<void> put(const data& key, data value,
+                     optional<timestamp> expiry) override;
+
+  expected<void> put_many(const std::unordered_map<data, data>& entries,
+                          optional<timestamp> expiry) override;
+
+  expected<void> add(const data& key, const data& value, data::type init_type,
+                     optional<timestamp> expiry) override;
+
+  expected<void> subtract(const data& key, const data& value,
+                          optional<timestamp> expiry) override;
+
+  expected<void> erase(const data& key) override;
+
+  expected<void> erase_many(const std::vector<data>& keys) override;
+
+  expected<void> clear() override;
+
+  expected<bool> expire(const data& key, timestamp current_time) override;
+
+  expected<std::vector<data>> expire_many(const std::vector<data>& keys,
+                                          timestamp current_time) override;
+
+  expected<void> flush() override;
+
+  timespan flush_interval() const override;
+
+  expected<data> get(const data& key) const override;
+
+  expected<data> get(const data& key, const data& aspect) const override;
+
+  expected<data> get_many(const std::vector<data>& keys) const override;
+
+  expected<data> scan(const std::string& prefix, size_t limit) const override;
+
+  expected<bool> exists(const data& key) const override;
+
+  expected<uint64_t> size() const override;
+
+  expected<data> keys() const override;
+
+  expected<broker::snapshot> snapshot() const override;
+
+  expected<expirables> expiries() const override;
+
+  expected<expirables> expiries_between(timestamp from,
+                                        timestamp until) const override;
+
+  size_t memory_usage() const override;
+
+private:
+  class thread_pool;
+
+  abstract_backend& partition_of(const data& key) const;
+
+  /// Calls `f(i)` for each partition `i` in parallel and returns the first
+  /// error.
+  error for_each_partition(const std::function<error(size_t)>& f) const;
+
+  std::vector<backend_pointer> partitions_;
+
+  std::unique_ptr<thread_pool> pool_;
+};
+
+} // namespace detail
+} // namespace broker
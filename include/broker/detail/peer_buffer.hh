@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <caf/binary_serializer.hpp>
+#include <caf/error.hpp>
+#include <caf/expected.hpp>
+#include <caf/fwd.hpp>
+
+#include "broker/detail/memory_accounting.hh"
+#include "broker/message.hh"
+
+namespace broker {
+namespace detail {
+
+/// Buffers batches from a blocked peer. Keeps batches in memory up to a limit
+/// of (estimated) bytes and spills all further batches to a temporary file.
+/// Always returns batches in insertion order. Also spills once all blocked
+/// peers together reach the limit of the (optional) memory accounting.
+class peer_buffer {
+public:
+  // --- member types ----------------------------------------------------------
+
+  using batch_type = std::vector<node_message>;
+
+  // --- construction and destruction ------------------------------------------
+
+  peer_buffer(caf::actor_system& sys, size_t memory_limit,
+              memory_accounting_ptr memory = nullptr);
+
+  peer_buffer(const peer_buffer&) = delete;
+
+  peer_buffer& operator=(const peer_buffer&) = delete;
+
+  /// Deletes the temporary file, if any.
+  ~peer_buffer();
+
+  // --- buffer access ---------------------------------------------------------
+
+  /// Appends `xs` to the buffer.
+  caf::error push(batch_type xs);
+
+  /// Removes the oldest batch from the buffer.
+  /// @pre `!empty()`
+  caf::expected<batch_type> pop();
+
+  // --- properties ------------------------------------------------------------
+
+  bool empty() const noexcept {
+    return mem_.empty() && spilled_ == 0;
+  }
+
+  /// Returns the estimated number of bytes of all batches in memory.
+  size_t memory_usage() const noexcept {
+    return memory_usage_;
+  }
+
+  /// Returns the number of batches in the temporary file.
+  size_t spilled() const noexcept {
+    return spilled_;
+  }
+
+  /// Returns the number of batches in memory and in the temporary file.
+  size_t size() const noexcept {
+    return mem_.size() + spilled_;
+  }
+
+private:
+  struct entry {
+    batch_type batch;
+    size_t size;
+  };
+
+  caf::error spill(batch_type& xs);
+
+  caf::expected<batch_type> unspill();
+
+  caf::actor_system& sys_;
+  size_t memory_limit_;
+  size_t memory_usage_ = 0;
+  memory_counter accounting_;
+  std::deque<entry> mem_;
+  std::string file_name_;
+  std::fstream file_;
+  size_t spilled_ = 0;
+  std::streamoff read_pos_ = 0;
+  caf::binary_serializer::container_type buf_;
+};
+
+/// Returns an estimate for the number of bytes of `x` when serialized.
+size_t estimated_size(const peer_buffer::batch_type& xs);
+
+} // namespace detail
+} // namespace broker
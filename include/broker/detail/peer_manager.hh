@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <caf/actor_addr.hpp>
+#include <caf/broadcast_downstream_manager.hpp>
+#include <caf/fwd.hpp>
+
+#include "broker/detail/compression.hh"
+#include "broker/message.hh"
+#include "broker/peer_filter.hh"
+#include "broker/time.hh"
+
+namespace broker {
+namespace detail {
+
+/// Priority classes for messages to peers, ordered from highest to lowest.
+enum class priority_class : uint8_t {
+  /// Data on reserved topics, i.e., Broker-internal control messages.
+  control,
+  /// Commands for data stores.
+  store,
+  /// All other data.
+  bulk,
+};
+
+/// Returns the priority class of `x`.
+priority_class priority_of(const node_message& x);
+
+/// Sorts `xs` by priority class while keeping the order of messages within
+/// each class.
+template <class Container>
+void prioritize(Container& xs);
+
+/// Configures how the peer manager treats peers that keep falling behind.
+struct overload_policy {
+  enum class mode : uint8_t {
+    /// Keeps messages for the peer in a separate buffer.
+    buffer,
+    /// Keeps only every `sample_rate`-th message for the peer.
+    sample,
+    /// Drops all messages for the peer.
+    drop,
+  };
+
+  /// Time span a path to a peer may run out of credit before isolating the
+  /// peer. 0 disables isolating peers.
+  timespan timeout{0};
+
+  mode what = mode::buffer;
+
+  size_t sample_rate = 1;
+
+  /// Maximum number of messages in the separate buffer of an isolated peer.
+  size_t buffer_size = 0;
+};
+
+/// @relates overload_policy
+bool convert(const std::string& str, overload_policy::mode& x,
+             size_t& sample_rate);
+
+/// Congestion state of the path to a single peer.
+struct overload_state {
+  /// Start of the current congestion.
+  timestamp congested_since;
+
+  /// Whether the peer manager applies the overload policy to the path.
+  bool isolated = false;
+
+  /// Number of messages in the buffer of the path after the last emit.
+  size_t held = 0;
+
+  /// Counts messages for sampling.
+  size_t excess = 0;
+
+  /// Counts messages that the path never received.
+  size_t dropped = 0;
+
+  /// Messages that wait for the path to catch up.
+  std::deque<node_message> pending;
+};
+
+/// Keeps at most `keep` messages in `buf`, the buffer of an isolated path.
+/// Messages that arrived since the last emit and do not fit into `buf` go
+/// through `cfg`, except for store commands that always wait aside. Refills
+/// `buf` from pending messages afterwards.
+template <class Container>
+void throttle(const overload_policy& cfg, overload_state& st, Container& buf,
+              size_t keep);
+
+/// Broadcasts messages to peers. Unless disabled via `broker.peer-priorities`,
+/// moves messages of higher priority classes ahead of lower ones in the
+/// buffer of each path before emitting batches. Hence, store commands and
+/// control messages consume the credit of a path first and never wait behind
+/// bulk data.
+///
+/// When configured via `broker.peer-compression`, compresses each batch to
+/// peers that announced support for the algorithm as a whole, as long as the
+/// batch has at least `broker.peer-compression-min-size` (estimated) bytes.
+/// Unless disabled via `broker.peer-packing`, sends all other batches to
+/// peers that announced support for it as a ::packed_batch. Unless disabled
+/// via `broker.peer-compact-data`, packed batches encode data payloads with
+/// ::data_codec for peers that announced support for the same version.
+///
+/// When configured via `broker.slow-peer.timeout`, isolates peers whose path
+/// runs out of credit for longer than the timeout. Instead of letting their
+/// buffers grow (and thus stalling all publishers via backpressure), the
+/// manager keeps only one batch in the buffer of an isolated path and
+/// applies `broker.slow-peer.policy` to further messages until the peer
+/// catches up.
+class peer_manager
+  : public caf::broadcast_downstream_manager<node_message, peer_filter,
+                                             peer_filter_matcher> {
+public:
+  using super = caf::broadcast_downstream_manager<node_message, peer_filter,
+                                                  peer_filter_matcher>;
+
+  explicit peer_manager(caf::stream_manager* parent);
+
+  void emit_batches() override;
+
+  void force_emit_batches() override;
+
+  bool prioritized() const noexcept {
+    return prioritized_;
+  }
+
+  // --- shutdown --------------------------------------------------------------
+
+  /// Returns the number of messages that wait for credit on any path. Counts
+  /// a message once per path.
+  size_t unsent();
+
+  /// Removes all messages that wait for credit and returns them. Returns
+  /// messages with an ID only once, even if they wait on several paths.
+  std::vector<node_message> take_unsent();
+
+  // --- compression -----------------------------------------------------------
+
+  /// Enables compression of batches to `hdl` if `offer` contains the
+  /// configured algorithm.
+  void negotiate_compression(const caf::actor& hdl,
+                             const std::vector<std::string>& offer);
+
+  /// Sends uncompressed batches to `hdl` again.
+  void disable_compression(const caf::actor& hdl);
+
+  /// Returns the algorithm for batches to `hdl`.
+  compression compression_for(const caf::actor& hdl) const;
+
+  // --- header sharing --------------------------------------------------------
+
+  /// Sends packed batches to `hdl` unless disabled in the configuration.
+  void enable_packing(const caf::actor& hdl);
+
+  /// Sends regular batches to `hdl` again.
+  void disable_packing(const caf::actor& hdl);
+
+  /// Returns whether batches to `hdl` share headers between messages.
+  bool packs_for(const caf::actor& hdl) const;
+
+  // --- compact data encoding -------------------------------------------------
+
+  /// Encodes data in packed batches to `hdl` with ::data_codec if `offer`
+  /// contains its ID, unless disabled in the configuration.
+  void negotiate_codec(const caf::actor& hdl,
+                       const std::vector<std::string>& offer);
+
+  /// Uses the binary serialization for data to `hdl` again.
+  void disable_codec(const caf::actor& hdl);
+
+  /// Returns whether packed batches to `hdl` encode data with ::data_codec.
+  bool encodes_for(const caf::actor& hdl) const;
+
+private:
+  void prioritize_paths();
+
+  /// Detects congested paths and applies the overload policy to isolated
+  /// paths.
+  void throttle_slow_peers();
+
+  /// Remembers the buffer size of each isolated path after emitting batches.
+  void update_held();
+
+  /// Emits all batches on paths to peers with compression or packing,
+  /// bypassing the batching of the base class.
+  void emit_encoded_batches(bool force_underfull);
+
+  void emit_encoded(caf::outbound_path* ptr, compression algorithm,
+                    bool packed, bool compact, std::vector<node_message> xs);
+
+  bool prioritized_;
+
+  /// Configured algorithm for compressing batches.
+  compression compression_;
+
+  /// Minimum (estimated) size of a batch for compressing it.
+  size_t compression_min_size_;
+
+  /// Peers that accept compressed batches.
+  std::unordered_map<caf::actor_addr, compression> compressed_peers_;
+
+  /// Configures whether we send packed batches to peers that support them.
+  bool packing_;
+
+  /// Peers that accept packed batches.
+  std::unordered_set<caf::actor_addr> packed_peers_;
+
+  /// Configures whether we encode data in packed batches with ::data_codec
+  /// for peers that support it.
+  bool compact_data_;
+
+  /// Peers that accept data encoded with ::data_codec.
+  std::unordered_set<caf::actor_addr> coded_peers_;
+
+  /// Configures isolating slow peers.
+  overload_policy overload_;
+
+  /// Congestion state of all congested or isolated paths.
+  std::unordered_map<caf::stream_slot, overload_state> slow_peers_;
+};
+
+} // namespace detail
+} // namespace broker
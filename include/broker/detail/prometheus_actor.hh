@@ -0,0 +1,16 @@
+#pragma once
+
+#include <caf/actor.hpp>
+#include <caf/behavior.hpp>
+#include <caf/io/broker.hpp>
+
+namespace broker {
+namespace detail {
+
+/// Serves the metrics of `core` in the Prometheus text exposition format. The
+/// actor answers each incoming connection with a single HTTP response that
+/// contains the current snapshot and then closes the connection.
+caf::behavior prometheus_actor(caf::io::broker* self, caf::actor core);
+
+} // namespace detail
+} // namespace broker
@@ -40,13 +40,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <algorithm>
 #include <deque>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
 #include <initializer_list>
 
 #include "broker/config.hh"
-
-#ifdef BROKER_USE_SSE2
-#include <emmintrin.h>
-#endif
+#include "broker/detail/simd.hh"
 
 #include <caf/serializer.hpp>
 #include <caf/deserializer.hpp>
@@ -54,6 +54,85 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace broker {
 namespace detail {
 
+/**
+ * Recycles memory for objects of type T. Allocates memory in chunks of
+ * growing size and keeps released blocks in an intrusive free list. Releases
+ * memory to the system only on destruction or when calling reset().
+ */
+template <typename T>
+class node_pool {
+public:
+  node_pool() = default;
+
+  node_pool(const node_pool&) = delete;
+
+  node_pool& operator=(const node_pool&) = delete;
+
+  /**
+   * Construct an object of type T in a recycled block if available.
+   */
+  template <typename... Ts>
+  T* make(Ts&&... xs) {
+    if (!free_list)
+      grow();
+    auto b = free_list;
+    free_list = b->next;
+    return new (&b->storage) T(std::forward<Ts>(xs)...);
+  }
+
+  /**
+   * Destroy an object that make() returned and recycle its block.
+   */
+  void destroy(T* ptr) {
+    ptr->~T();
+    release(reinterpret_cast<block*>(ptr));
+  }
+
+  /**
+   * Release all memory to the system.
+   * @pre all objects of the pool have been destroyed.
+   */
+  void reset() {
+    chunks.clear();
+    free_list = nullptr;
+    next_chunk_size = 1;
+  }
+
+  friend void swap(node_pool& a, node_pool& b) {
+    using std::swap;
+    swap(a.chunks, b.chunks);
+    swap(a.free_list, b.free_list);
+    swap(a.next_chunk_size, b.next_chunk_size);
+  }
+
+private:
+  union block {
+    block* next;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  // Caps chunks at roughly one page, but always fits at least one block.
+  static constexpr size_t max_chunk_size
+    = std::max(size_t{1}, size_t{4096} / sizeof(block));
+
+  void release(block* b) {
+    b->next = free_list;
+    free_list = b;
+  }
+
+  void grow() {
+    auto n = next_chunk_size;
+    chunks.emplace_back(new block[n]);
+    for (size_t i = 0; i < n; ++i)
+      release(&chunks.back()[i]);
+    next_chunk_size = std::min(2 * n, max_chunk_size);
+  }
+
+  std::vector<std::unique_ptr<block[]>> chunks;
+  block* free_list = nullptr;
+  size_t next_chunk_size = 1;
+};
+
 /**
  * A radix tree data structure that facilitates O(k) operations,
  * including finding elements that match a given prefix.  Keys
@@ -181,6 +260,7 @@ public:
     recursive_clear(root);
     root = nullptr;
     num_entries = 0;
+    alloc.reset();
   }
 
   /**
@@ -229,7 +309,7 @@ public:
     if (!l)
       return 0;
     --num_entries;
-    delete l;
+    alloc.leaves.destroy(l);
     return 1;
   }
 
@@ -261,9 +341,12 @@ public:
     using std::swap;
     swap(a.root, b.root);
     swap(a.num_entries, b.num_entries);
+    swap(a.alloc, b.alloc);
   }
 
 private:
+  struct node_allocator;
+
   /**
    * Included as part of all internal nodes.
    */
@@ -304,8 +387,9 @@ private:
     node4(const node& other) : n(node::tag::node4, other) {
     }
 
-    void add_child(node** ref, unsigned char c, node* child);
-    void rem_child(node** ref, node** child);
+    void add_child(node_allocator& alloc, node** ref, unsigned char c,
+                   node* child);
+    void rem_child(node_allocator& alloc, node** ref, node** child);
   };
 
   /**
@@ -320,8 +404,9 @@ private:
     node16(const node& other) : n(node::tag::node16, other) {
     }
 
-    void add_child(node** ref, unsigned char c, node* child);
-    void rem_child(node** ref, node** child);
+    void add_child(node_allocator& alloc, node** ref, unsigned char c,
+                   node* child);
+    void rem_child(node_allocator& alloc, node** ref, node** child);
   };
 
   /**
@@ -337,8 +422,9 @@ private:
     node48(const node& other) : n(node::tag::node48, other) {
     }
 
-    void add_child(node** ref, unsigned char c, node* child);
-    void rem_child(node** ref, unsigned char c);
+    void add_child(node_allocator& alloc, node** ref, unsigned char c,
+                   node* child);
+    void rem_child(node_allocator& alloc, node** ref, unsigned char c);
   };
 
   /**
@@ -352,8 +438,9 @@ private:
     node256(const node& other) : n(node::tag::node256, other) {
     }
 
-    void add_child(node** ref, unsigned char c, node* child);
-    void rem_child(node** ref, unsigned char c);
+    void add_child(node_allocator& alloc, node** ref, unsigned char c,
+                   node* child);
+    void rem_child(node_allocator& alloc, node** ref, unsigned char c);
   };
 
   /**
@@ -371,6 +458,35 @@ private:
     }
   };
 
+  /**
+   * Owns the memory of all nodes and leaves in the tree. Nodes that grow or
+   * shrink into a different node type return their memory to the pool of
+   * their type for reuse by the next transition.
+   */
+  struct node_allocator {
+    node_pool<node4> node4s;
+    node_pool<node16> node16s;
+    node_pool<node48> node48s;
+    node_pool<node256> node256s;
+    node_pool<leaf> leaves;
+
+    void reset() {
+      node4s.reset();
+      node16s.reset();
+      node48s.reset();
+      node256s.reset();
+      leaves.reset();
+    }
+
+    friend void swap(node_allocator& a, node_allocator& b) {
+      swap(a.node4s, b.node4s);
+      swap(a.node16s, b.node16s);
+      swap(a.node48s, b.node48s);
+      swap(a.node256s, b.node256s);
+      swap(a.leaves, b.leaves);
+    }
+  };
+
   static leaf* minimum(node* n);
 
   static std::pair<node**, uint16_t> find_child(node* n, unsigned char c);
@@ -381,17 +497,17 @@ private:
   // Returns calculated index at which a prefix mismatches.
   static size_t prefix_mismatch(node* n, const key_type& key, int depth);
 
-  static void add_child(node* n, node** ref, unsigned char c, node* child);
+  void add_child(node* n, node** ref, unsigned char c, node* child);
 
-  static void rem_child(node* n, node** ref, unsigned char c, node** child);
+  void rem_child(node* n, node** ref, unsigned char c, node** child);
 
   std::pair<iterator, bool> recursive_insert(node* n, node** self,
                                              value_type kv, size_t depth);
 
-  static leaf* recursive_erase(node* n, node** self, const key_type& key,
-                               size_t depth);
+  leaf* recursive_erase(node* n, node** self, const key_type& key,
+                        size_t depth);
 
-  static void recursive_clear(node* n);
+  void recursive_clear(node* n);
 
   void recursive_add_leaves(node* n, std::deque<iterator>& leaves) const;
 
@@ -399,6 +515,7 @@ private:
 
   size_type num_entries;
   node* root;
+  node_allocator alloc;
 };
 
 inline const unsigned char* as_key_data(const std::string& key) {
@@ -656,31 +773,17 @@ radix_tree<T, N>::find_child(node* n, unsigned char c) {
     } break;
     case node::tag::node16: {
       auto p = reinterpret_cast<node16*>(n);
-#ifdef BROKER_USE_SSE2
-      // Compare the key to all 16 stored keys
-      __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(c),
-                                   _mm_loadu_si128((__m128i*)p->keys.data()));
-
-      // Use a mask to ignore children that don't exist
-      int mask = (1 << n->num_children) - 1;
-      int bitfield = _mm_movemask_epi8(cmp) & mask;
-
-      if (bitfield) {
-        auto i = __builtin_ctz(bitfield);
+      auto i = find_byte16(p->keys.data(), n->num_children, c);
+      if (i < n->num_children)
         return {&p->children[i], i};
-      }
-#else
-      for (int i = 0; i < n->num_children; ++i)
-        if (p->keys[i] == c)
-          return {&p->children[i], i};
-#endif
     } break;
     case node::tag::node48: {
       auto p = reinterpret_cast<node48*>(n);
       int i = p->keys[c];
 
+      // Iterators resume at the next key, not at the next child slot.
       if (i)
-        return {&p->children[i - 1], i};
+        return {&p->children[i - 1], c};
     } break;
     case node::tag::node256: {
       auto p = reinterpret_cast<node256*>(n);
@@ -743,13 +846,13 @@ void radix_tree<T, N>::add_child(node* n, node** ref, unsigned char c,
                                  node* child) {
   switch (n->type) {
     case node::tag::node4:
-      return reinterpret_cast<node4*>(n)->add_child(ref, c, child);
+      return reinterpret_cast<node4*>(n)->add_child(alloc, ref, c, child);
     case node::tag::node16:
-      return reinterpret_cast<node16*>(n)->add_child(ref, c, child);
+      return reinterpret_cast<node16*>(n)->add_child(alloc, ref, c, child);
     case node::tag::node48:
-      return reinterpret_cast<node48*>(n)->add_child(ref, c, child);
+      return reinterpret_cast<node48*>(n)->add_child(alloc, ref, c, child);
     case node::tag::node256:
-      return reinterpret_cast<node256*>(n)->add_child(ref, c, child);
+      return reinterpret_cast<node256*>(n)->add_child(alloc, ref, c, child);
     default:
       abort();
   }
@@ -760,13 +863,13 @@ void radix_tree<T, N>::rem_child(node* n, node** ref, unsigned char c,
                                  node** child) {
   switch (n->type) {
     case node::tag::node4:
-      return reinterpret_cast<node4*>(n)->rem_child(ref, child);
+      return reinterpret_cast<node4*>(n)->rem_child(alloc, ref, child);
     case node::tag::node16:
-      return reinterpret_cast<node16*>(n)->rem_child(ref, child);
+      return reinterpret_cast<node16*>(n)->rem_child(alloc, ref, child);
     case node::tag::node48:
-      return reinterpret_cast<node48*>(n)->rem_child(ref, c);
+      return reinterpret_cast<node48*>(n)->rem_child(alloc, ref, c);
     case node::tag::node256:
-      return reinterpret_cast<node256*>(n)->rem_child(ref, c);
+      return reinterpret_cast<node256*>(n)->rem_child(alloc, ref, c);
     default:
       abort();
   }
@@ -777,7 +880,7 @@ std::pair<typename radix_tree<T, N>::iterator, bool>
 radix_tree<T, N>::recursive_insert(node* n, node** ref, value_type kv,
                                    size_t depth) {
   if (!n) {
-    *ref = reinterpret_cast<node*>(new leaf(std::move(kv)));
+    *ref = reinterpret_cast<node*>(alloc.leaves.make(std::move(kv)));
     return {{root, *ref}, true};
   }
 
@@ -790,17 +893,17 @@ radix_tree<T, N>::recursive_insert(node* n, node** ref, value_type kv,
     }
 
     // New value, need a new internal node.
-    auto nn = new node4;
-    auto l2 = new leaf(std::move(kv));
+    auto nn = alloc.node4s.make();
+    auto l2 = alloc.leaves.make(std::move(kv));
     auto longest_prefix = longest_common_prefix(l->key(), l2->key(), depth);
     auto m = std::min(N, static_cast<size_t>(longest_prefix));
     nn->n.partial_len = longest_prefix;
     std::copy(l2->key().begin() + depth, l2->key().begin() + depth + m,
               nn->n.partial.begin());
     *ref = reinterpret_cast<node*>(nn);
-    nn->add_child(ref, l->key()[depth + longest_prefix],
+    nn->add_child(alloc, ref, l->key()[depth + longest_prefix],
                   reinterpret_cast<node*>(l));
-    nn->add_child(ref, l2->key()[depth + longest_prefix],
+    nn->add_child(alloc, ref, l2->key()[depth + longest_prefix],
                   reinterpret_cast<node*>(l2));
     return {{root, reinterpret_cast<node*>(l2)}, true};
   }
@@ -812,7 +915,7 @@ radix_tree<T, N>::recursive_insert(node* n, node** ref, value_type kv,
       depth += n->partial_len;
     else {
       // Need to split the node.
-      auto nn = new node4;
+      auto nn = alloc.node4s.make();
       *ref = reinterpret_cast<node*>(nn);
       nn->n.partial_len = prefix_diff;
       std::copy(n->partial.begin(),
@@ -821,7 +924,7 @@ radix_tree<T, N>::recursive_insert(node* n, node** ref, value_type kv,
 
       // Adjust prefix of the old node.
       if (n->partial_len <= N) {
-        nn->add_child(ref, n->partial[prefix_diff], n);
+        nn->add_child(alloc, ref, n->partial[prefix_diff], n);
         n->partial_len -= prefix_diff + 1;
         auto m = std::min(N, static_cast<size_t>(n->partial_len));
         std::copy(n->partial.begin() + prefix_diff + 1,
@@ -829,7 +932,7 @@ radix_tree<T, N>::recursive_insert(node* n, node** ref, value_type kv,
       } else {
         n->partial_len -= prefix_diff + 1;
         leaf* l = minimum(n);
-        nn->add_child(ref, l->key()[depth + prefix_diff], n);
+        nn->add_child(alloc, ref, l->key()[depth + prefix_diff], n);
         auto m = std::min(N, static_cast<size_t>(n->partial_len));
         std::copy(l->key().begin() + depth + prefix_diff + 1,
                   l->key().begin() + depth + prefix_diff + 1 + m,
@@ -837,8 +940,8 @@ radix_tree<T, N>::recursive_insert(node* n, node** ref, value_type kv,
       }
 
       unsigned char c = kv.first[depth + prefix_diff];
-      auto nl = reinterpret_cast<node*>(new leaf(std::move(kv)));
-      nn->add_child(ref, c, nl);
+      auto nl = reinterpret_cast<node*>(alloc.leaves.make(std::move(kv)));
+      nn->add_child(alloc, ref, c, nl);
       return {{root, nl}, true};
     }
   }
@@ -849,7 +952,7 @@ radix_tree<T, N>::recursive_insert(node* n, node** ref, value_type kv,
     return recursive_insert(*child, child, std::move(kv), depth + 1);
 
   unsigned char c = kv.first[depth];
-  auto nl = reinterpret_cast<node*>(new leaf(std::move(kv)));
+  auto nl = reinterpret_cast<node*>(alloc.leaves.make(std::move(kv)));
   add_child(n, ref, c, nl);
   return {{root, nl}, true};
 }
@@ -905,27 +1008,27 @@ void radix_tree<T, N>::recursive_clear(node* n) {
 
   switch (n->type) {
     case node::tag::leaf:
-      delete reinterpret_cast<leaf*>(n);
+      alloc.leaves.destroy(reinterpret_cast<leaf*>(n));
       return;
     case node::tag::node4: {
       auto p = reinterpret_cast<node4*>(n);
       for (int i = 0; i < n->num_children; ++i)
         recursive_clear(p->children[i]);
-      delete p;
+      alloc.node4s.destroy(p);
     }
       return;
     case node::tag::node16: {
       auto p = reinterpret_cast<node16*>(n);
       for (int i = 0; i < n->num_children; ++i)
         recursive_clear(p->children[i]);
-      delete p;
+      alloc.node16s.destroy(p);
     }
       return;
     case node::tag::node48: {
       auto p = reinterpret_cast<node48*>(n);
       for (int i = 0; i < n->num_children; ++i)
         recursive_clear(p->children[i]);
-      delete p;
+      alloc.node48s.destroy(p);
     }
       return;
     case node::tag::node256: {
@@ -933,7 +1036,7 @@ void radix_tree<T, N>::recursive_clear(node* n) {
       for (int i = 0; i < 256; ++i)
         if (p->children[i])
           recursive_clear(p->children[i]);
-      delete p;
+      alloc.node256s.destroy(p);
     }
       return;
     default:
@@ -1022,8 +1125,8 @@ radix_tree<T, N>::add_prefix_leaf(node* n, std::deque<iterator>& leaves) const {
 }
 
 template <typename T, std::size_t N>
-void radix_tree<T, N>::node4::add_child(node** ref, unsigned char c,
-                                        node* child) {
+void radix_tree<T, N>::node4::add_child(node_allocator& alloc, node** ref,
+                                        unsigned char c, node* child) {
   if (n.num_children < 4) {
     int idx;
     for (idx = 0; idx < n.num_children; ++idx)
@@ -1043,45 +1146,20 @@ void radix_tree<T, N>::node4::add_child(node** ref, unsigned char c,
     return;
   }
 
-  auto nn = new node16(n);
+  auto nn = alloc.node16s.make(n);
   std::copy(children.begin(), children.begin() + n.num_children,
             nn->children.begin());
   std::copy(keys.begin(), keys.begin() + n.num_children, nn->keys.begin());
   *ref = reinterpret_cast<node*>(nn);
-  delete this;
-  nn->add_child(ref, c, child);
+  alloc.node4s.destroy(this);
+  nn->add_child(alloc, ref, c, child);
 }
 
 template <typename T, std::size_t N>
-void radix_tree<T, N>::node16::add_child(node** ref, unsigned char c,
-                                         node* child) {
+void radix_tree<T, N>::node16::add_child(node_allocator& alloc, node** ref,
+                                         unsigned char c, node* child) {
   if (n.num_children < 16) {
-#ifdef BROKER_USE_SSE2
-    // Compare the key to all 16 stored keys
-    __m128i cmp = _mm_cmplt_epi8(_mm_set1_epi8(c),
-                                 _mm_loadu_si128((__m128i*)keys.data()));
-
-    // Use a mask to ignore children that don't exist
-    unsigned mask = (1 << n.num_children) - 1;
-    unsigned bitfield = _mm_movemask_epi8(cmp) & mask;
-
-    // Check if less than any
-    unsigned idx = n.num_children;
-
-    if (bitfield) {
-      idx = __builtin_ctz(bitfield);
-      // Shift right.
-      std::copy_backward(keys.begin() + idx, keys.begin() + n.num_children,
-                         keys.begin() + n.num_children + 1);
-      std::copy_backward(children.begin() + idx,
-                         children.begin() + n.num_children,
-                         children.begin() + n.num_children + 1);
-    }
-#else
-    int idx;
-    for (idx = 0; idx < n.num_children; ++idx)
-      if (c < keys[idx])
-        break;
+    auto idx = upper_bound16(keys.data(), n.num_children, c);
 
     // Shift right.
     std::copy_backward(keys.begin() + idx, keys.begin() + n.num_children,
@@ -1089,7 +1167,6 @@ void radix_tree<T, N>::node16::add_child(node** ref, unsigned char c,
     std::copy_backward(children.begin() + idx,
                        children.begin() + n.num_children,
                        children.begin() + n.num_children + 1);
-#endif
 
     keys[idx] = c;
     children[idx] = child;
@@ -1097,7 +1174,7 @@ void radix_tree<T, N>::node16::add_child(node** ref, unsigned char c,
     return;
   }
 
-  auto nn = new node48(n);
+  auto nn = alloc.node48s.make(n);
   std::copy(children.begin(), children.begin() + n.num_children,
             nn->children.begin());
 
@@ -1105,13 +1182,13 @@ void radix_tree<T, N>::node16::add_child(node** ref, unsigned char c,
     nn->keys[keys[i]] = i + 1;
 
   *ref = reinterpret_cast<node*>(nn);
-  delete this;
-  nn->add_child(ref, c, child);
+  alloc.node16s.destroy(this);
+  nn->add_child(alloc, ref, c, child);
 }
 
 template <typename T, std::size_t N>
-void radix_tree<T, N>::node48::add_child(node** ref, unsigned char c,
-                                         node* child) {
+void radix_tree<T, N>::node48::add_child(node_allocator& alloc, node** ref,
+                                         unsigned char c, node* child) {
   if (n.num_children < 48) {
     int pos = 0;
     while (children[pos])
@@ -1122,26 +1199,27 @@ void radix_tree<T, N>::node48::add_child(node** ref, unsigned char c,
     return;
   }
 
-  auto nn = new node256(n);
+  auto nn = alloc.node256s.make(n);
 
   for (int i = 0; i < 256; ++i)
     if (keys[i])
       nn->children[i] = children[keys[i] - 1];
 
   *ref = reinterpret_cast<node*>(nn);
-  delete this;
-  nn->add_child(ref, c, child);
+  alloc.node48s.destroy(this);
+  nn->add_child(alloc, ref, c, child);
 }
 
 template <typename T, std::size_t N>
-void radix_tree<T, N>::node256::add_child(node**, unsigned char c,
-                                          node* child) {
+void radix_tree<T, N>::node256::add_child(node_allocator&, node**,
+                                          unsigned char c, node* child) {
   ++n.num_children;
   children[c] = child;
 }
 
 template <typename T, std::size_t N>
-void radix_tree<T, N>::node4::rem_child(node** ref, node** child) {
+void radix_tree<T, N>::node4::rem_child(node_allocator& alloc, node** ref,
+                                        node** child) {
   int pos = child - children.data();
   std::copy(keys.begin() + pos + 1, keys.begin() + n.num_children,
             keys.begin() + pos);
@@ -1178,11 +1256,12 @@ void radix_tree<T, N>::node4::rem_child(node** ref, node** child) {
   }
 
   *ref = last;
-  delete this;
+  alloc.node4s.destroy(this);
 }
 
 template <typename T, std::size_t N>
-void radix_tree<T, N>::node16::rem_child(node** ref, node** child) {
+void radix_tree<T, N>::node16::rem_child(node_allocator& alloc, node** ref,
+                                         node** child) {
   int pos = child - children.data();
   std::copy(keys.begin() + pos + 1, keys.begin() + n.num_children,
             keys.begin() + pos);
@@ -1193,15 +1272,16 @@ void radix_tree<T, N>::node16::rem_child(node** ref, node** child) {
   if (n.num_children != 3)
     return;
 
-  auto nn = new node4(n);
+  auto nn = alloc.node4s.make(n);
   *ref = reinterpret_cast<node*>(nn);
   std::copy(keys.begin(), keys.begin() + 4, nn->keys.begin());
   std::copy(children.begin(), children.begin() + 4, nn->children.begin());
-  delete this;
+  alloc.node16s.destroy(this);
 }
 
 template <typename T, std::size_t N>
-void radix_tree<T, N>::node48::rem_child(node** ref, unsigned char c) {
+void radix_tree<T, N>::node48::rem_child(node_allocator& alloc, node** ref,
+                                         unsigned char c) {
   int pos = keys[c];
   keys[c] = 0;
   children[pos - 1] = nullptr;
@@ -1210,7 +1290,7 @@ void radix_tree<T, N>::node48::rem_child(node** ref, unsigned char c) {
   if (n.num_children != 12)
     return;
 
-  auto nn = new node16(n);
+  auto nn = alloc.node16s.make(n);
   *ref = reinterpret_cast<node*>(nn);
   int child = 0;
 
@@ -1224,11 +1304,12 @@ void radix_tree<T, N>::node48::rem_child(node** ref, unsigned char c) {
     }
   }
 
-  delete this;
+  alloc.node48s.destroy(this);
 }
 
 template <typename T, std::size_t N>
-void radix_tree<T, N>::node256::rem_child(node** ref, unsigned char c) {
+void radix_tree<T, N>::node256::rem_child(node_allocator& alloc, node** ref,
+                                          unsigned char c) {
   children[c] = nullptr;
   --n.num_children;
 
@@ -1236,7 +1317,7 @@ void radix_tree<T, N>::node256::rem_child(node** ref, unsigned char c) {
   if (n.num_children != 37)
     return;
 
-  auto nn = new node48(n);
+  auto nn = alloc.node48s.make(n);
   *ref = reinterpret_cast<node*>(nn);
   int pos = 0;
 
@@ -1247,7 +1328,7 @@ void radix_tree<T, N>::node256::rem_child(node** ref, unsigned char c) {
       ++pos;
     }
 
-  delete this;
+  alloc.node256s.destroy(this);
 }
 
 template <typename T, std::size_t N>
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "broker/fwd.hh"
+#include "broker/message.hh"
+#include "broker/time.hh"
+#include "broker/topic.hh"
+
+namespace broker {
+namespace detail {
+
+/// Enforces token-bucket limits on messages per topic prefix. Each rule
+/// refills its bucket with `rate` tokens per second up to `burst` tokens and
+/// each message takes one token. Once a bucket runs empty, the policy of the
+/// rule decides what happens to further messages.
+class rate_limiter {
+public:
+  // --- member types ----------------------------------------------------------
+
+  enum class policy : uint8_t {
+    /// Drops all messages that exceed the limit.
+    drop,
+    /// Lets every `sample_rate`-th message that exceeds the limit pass.
+    sample,
+    /// Keeps only the latest message per topic that exceeds the limit and
+    /// releases it when the bucket has a token again.
+    coalesce,
+  };
+
+  struct rule {
+    topic prefix;
+    double rate = 0;
+    double burst = 0;
+    policy mode = policy::drop;
+    size_t sample_rate = 0;
+  };
+
+  struct rule_state {
+    rule config;
+    double tokens;
+    timestamp last_refill;
+    /// Counts messages in excess of the limit that have been dropped
+    /// (including messages replaced while coalescing).
+    count dropped = 0;
+    /// Counts messages in excess of the limit for sampling.
+    size_t excess = 0;
+    /// Messages held back for coalescing.
+    std::map<topic, node_message> pending;
+  };
+
+  // --- construction ----------------------------------------------------------
+
+  explicit rate_limiter(std::vector<rule> rules);
+
+  // --- rate limiting ---------------------------------------------------------
+
+  /// Returns whether `x` may pass at time `t`. Passes previously held back
+  /// messages that may pass now to `f` first. May move `x` into the pending
+  /// messages of a rule when returning `false`. Commands and messages on
+  /// internal topics always pass, since losing them would make data stores
+  /// diverge.
+  template <class F>
+  bool admit(node_message& x, timestamp t, F f) {
+    if (is_command_message(x) || get_topic(x).is_internal())
+      return true;
+    auto st = find(get_topic(x));
+    if (st == nullptr)
+      return true;
+    refill(*st, t);
+    release(*st, f);
+    if (st->tokens >= 1 && st->pending.empty()) {
+      st->tokens -= 1;
+      return true;
+    }
+    switch (st->config.mode) {
+      case policy::sample:
+        if (++st->excess >= st->config.sample_rate) {
+          st->excess = 0;
+          return true;
+        }
+        ++st->dropped;
+        return false;
+      case policy::coalesce:
+        hold(*st, x);
+        return false;
+      default:
+        ++st->dropped;
+        return false;
+    }
+  }
+
+  /// Passes all held back messages that may pass at time `t` to `f`.
+  template <class F>
+  void flush(timestamp t, F f) {
+    for (auto& st : rules_) {
+      if (!st.pending.empty()) {
+        refill(st, t);
+        release(st, f);
+      }
+    }
+  }
+
+  // --- properties ------------------------------------------------------------
+
+  const std::vector<rule_state>& rules() const noexcept {
+    return rules_;
+  }
+
+  /// Returns whether at least one rule coalesces messages.
+  bool coalesces() const noexcept;
+
+private:
+  /// Returns the most specific rule for `t` or `nullptr` if no rule applies.
+  /// Prefixes only match entire components of `t`.
+  rule_state* find(const topic& t);
+
+  void refill(rule_state& st, timestamp t);
+
+  void hold(rule_state& st, node_message& x);
+
+  template <class F>
+  void release(rule_state& st, F& f) {
+    while (st.tokens >= 1 && !st.pending.empty()) {
+      st.tokens -= 1;
+      auto i = st.pending.begin();
+      auto msg = std::move(i->second);
+      st.pending.erase(i);
+      f(std::move(msg));
+    }
+  }
+
+  std::vector<rule_state> rules_;
+};
+
+/// Parses a rule in the format `<prefix>:<rate>[:<burst>[:<policy>]]`, where
+/// `<policy>` is either `drop`, `coalesce`, or `sample/<n>`. The burst size
+/// defaults to the rate and the policy defaults to `drop`.
+/// @relates rate_limiter
+bool convert(const std::string& str, rate_limiter::rule& x);
+
+} // namespace detail
+} // namespace broker
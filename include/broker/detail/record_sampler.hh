@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "broker/topic.hh"
+
+namespace broker {
+namespace detail {
+
+/// Decides which published messages a recorder captures. By default, the
+/// sampler selects every `rate`-th message. Rules override the rate for all
+/// topics with a given prefix, whereas the most specific rule wins. A rate of
+/// 1 selects all messages and a rate of 0 selects none.
+class record_sampler {
+public:
+  // --- member types ----------------------------------------------------------
+
+  struct rule {
+    topic prefix;
+    size_t rate = 1;
+  };
+
+  // --- construction ----------------------------------------------------------
+
+  record_sampler() = default;
+
+  record_sampler(size_t rate, std::vector<rule> rules);
+
+  // --- sampling --------------------------------------------------------------
+
+  /// Returns whether to record the next message on topic `t`.
+  bool select(const topic& t) {
+    if (rules_.empty())
+      return sample(rate_, seen_);
+    return select_slow(t);
+  }
+
+  // --- properties ------------------------------------------------------------
+
+  size_t rate() const noexcept {
+    return rate_;
+  }
+
+  /// Returns whether the sampler selects every message.
+  bool selects_all() const noexcept {
+    return rate_ == 1 && rules_.empty();
+  }
+
+private:
+  struct rule_state {
+    rule config;
+    size_t seen = 0;
+  };
+
+  static bool sample(size_t rate, size_t& seen) {
+    if (rate == 0)
+      return false;
+    if (++seen < rate)
+      return false;
+    seen = 0;
+    return true;
+  }
+
+  bool select_slow(const topic& t);
+
+  size_t rate_ = 1;
+  size_t seen_ = 0;
+  std::vector<rule_state> rules_;
+};
+
+/// Parses a rule in the format `<prefix>:<rate>`.
+/// @relates record_sampler
+bool convert(const std::string& str, record_sampler::rule& x);
+
+/// Creates a sampler from a default rate and a list of rules in the format of
+/// `convert`, ignoring invalid rules.
+/// @relates record_sampler
+record_sampler make_record_sampler(size_t rate,
+                                   const std::vector<std::string>& rules);
+
+} // namespace detail
+} // namespace broker
@@ -31,6 +31,9 @@ public:
   expected<void> put(const data& key, data value,
                      optional<timestamp> expiry) override;
 
+  expected<void> put_many(const std::unordered_map<data, data>& entries,
+                          optional<timestamp> expiry) override;
+
   expected<void> add(const data& key, const data& value,
                      data::type init_type,
                      optional<timestamp> expiry) override;
@@ -40,12 +43,23 @@ public:
 
   expected<void> erase(const data& key) override;
 
+  expected<void> erase_many(const std::vector<data>& keys) override;
+
   expected<void> clear() override;
 
   expected<bool> expire(const data& key, timestamp current_time) override;
 
   expected<data> get(const data& key) const override;
 
+  expected<data> get(const data& key, const data& aspect) const override;
+
+  expected<data> get_many(const std::vector<data>& keys) const override;
+
+  expected<data> scan(const std::string& prefix, size_t limit) const override;
+
+  expected<optional<data>> scan(const optional<data>& start, size_t batch_size,
+                                const scan_callback& f) const override;
+
   expected<bool> exists(const data& key) const override;
 
   expected<uint64_t> size() const override;
@@ -56,6 +70,11 @@ public:
 
   expected<expirables> expiries() const override;
 
+  /// Creates a RocksDB checkpoint, which hard-links the immutable SST files
+  /// if `path` resides on the same file system.
+  expected<std::vector<std::string>>
+  checkpoint(const std::string& path) override;
+
 private:
   bool open_db();
 
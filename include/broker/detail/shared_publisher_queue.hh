@@ -1,11 +1,20 @@
 #pragma once
 
+#include <algorithm>
+#include <deque>
+#include <iterator>
+#include <vector>
+
 #include <caf/intrusive_ptr.hpp>
 #include <caf/make_counted.hpp>
+#include <caf/variant.hpp>
 
+#include "broker/data.hh"
 #include "broker/detail/assert.hh"
+#include "broker/detail/core_metrics.hh"
 #include "broker/detail/shared_queue.hh"
 #include "broker/message.hh"
+#include "broker/topic.hh"
 
 namespace broker {
 namespace detail {
@@ -15,12 +24,17 @@ namespace detail {
 /// the flare remains active. The worker consumes items, while the user
 /// produces them.
 ///
+/// The queue stores batches from the user as a whole and only creates the
+/// individual messages when the worker consumes them. Hence, publishing a
+/// batch costs a constant number of queue operations regardless of its size.
+///
 /// The protocol on the flare is as follows:
 /// - the flare starts active
-/// - the flare is active as long as xs_ has below 20 items
-/// - consume() fires the flare when it removes items from xs_ and less than 20
-///   items remain
-/// - produce() extinguishes the flare it adds items to xs_, exceeding 20
+/// - the flare is active as long as the queue has below `capacity` items and,
+///   with a byte limit, below `max_bytes` of payload
+/// - consume() fires the flare when it removes items and the queue drops
+///   below both limits
+/// - produce() extinguishes the flare when it adds items, reaching a limit
 template <class ValueType = data_message>
 class shared_publisher_queue : public shared_queue<ValueType> {
 public:
@@ -30,11 +44,24 @@ public:
 
   using guard_type = typename super::guard_type;
 
-  shared_publisher_queue(size_t buffer_size) : capacity_(buffer_size) {
+  shared_publisher_queue(size_t buffer_size, size_t max_bytes = 0)
+    : capacity_(buffer_size), max_bytes_(max_bytes) {
     // The flare is active as long as publishers can write.
     this->fx_.fire();
   }
 
+  size_t buffer_size() const {
+    guard_type guard{this->mtx_};
+    return size_;
+  }
+
+  /// Returns the approximate payload size of all items in the queue if the
+  /// queue has a byte limit, 0 otherwise.
+  size_t buffered_bytes() const {
+    guard_type guard{this->mtx_};
+    return bytes_;
+  }
+
   // Called to pull items out of the queue. Signals demand to the user if less
   // than `num` items can be published from the buffer. When calling consume
   // again after an unsuccessful run, `num` must not be smaller than on the
@@ -43,24 +70,39 @@ public:
   template <class F>
   size_t consume(size_t num, F fun) {
     guard_type guard{this->mtx_};
-    auto& xs = this->xs_;
-    if (xs.empty()) {
+    if (size_ == 0) {
       this->pending_ = static_cast<long>(num);
       return false;
     }
-    auto n = std::min(num, xs.size());
-    auto b = xs.begin();
-    auto e = b + static_cast<ptrdiff_t>(n);
-    for (auto i = b; i != e; ++i)
-      fun(std::move(*i));
-    auto old_size = xs.size();
-    xs.erase(b, e);
-    auto new_size = xs.size();
-    // Extinguish the flare if we reach the capacity or fire it if we drop
-    // below the capacity again.
-    if (new_size >= capacity_ && old_size < capacity_)
-      this->fx_.extinguish();
-    else if (new_size < capacity_ && old_size >= capacity_)
+    auto n = std::min(num, size_);
+    auto was_full = full();
+    for (size_t i = 0; i < n;) {
+      auto& seg = segments_.front();
+      if (auto x = caf::get_if<value_type>(&seg)) {
+        release(*x);
+        fun(std::move(*x));
+        ++i;
+        segments_.pop_front();
+      } else if (auto xs = caf::get_if<data_batch>(&seg)) {
+        for (; i < n && xs->pos < xs->items.size(); ++i) {
+          release(xs->items[xs->pos]);
+          fun(value_type{xs->t, std::move(xs->items[xs->pos++])});
+        }
+        if (xs->pos == xs->items.size())
+          segments_.pop_front();
+      } else {
+        auto& ys = caf::get<message_batch>(seg);
+        for (; i < n && ys.pos < ys.items.size(); ++i) {
+          release(ys.items[ys.pos]);
+          fun(std::move(ys.items[ys.pos++]));
+        }
+        if (ys.pos == ys.items.size())
+          segments_.pop_front();
+      }
+    }
+    size_ -= n;
+    // Fire the flare if we drop below the limits again.
+    if (was_full && !full())
       this->fx_.fire();
     if (num - n > 0)
       this->pending_ = static_cast<long>(num - n);
@@ -71,42 +113,184 @@ public:
   /// go beyond the capacity of the queue.
   template <class Iterator>
   bool produce(const topic& t, Iterator first, Iterator last) {
-    guard_type guard{this->mtx_};
-    auto& xs = this->xs_;
-    if (xs.size() >= capacity_)
-      await_consumer(guard);
-    auto xs_old_size = xs.size();
-    BROKER_ASSERT(xs_old_size < capacity_);
-    for (; first != last; ++first)
-      xs.emplace_back(t, std::move(*first));
-    if (xs.size() >= capacity_) {
-      // Extinguish the flare to cause the *next* produce to block.
-      this->fx_.extinguish();
-    }
-    return xs_old_size == 0;
+    return produce(t, std::vector<data>{std::make_move_iterator(first),
+                                        std::make_move_iterator(last)});
+  }
+
+  /// Adds all items of `xs` with the shared topic `t` as a single batch.
+  /// Returns true if the caller must wake up the consumer. This function can
+  /// go beyond the capacity of the queue.
+  bool produce(const topic& t, std::vector<data>&& xs) {
+    if (xs.empty())
+      return false;
+    auto n = xs.size();
+    auto bytes = payload_size(xs);
+    return append(data_batch{t, std::move(xs), 0}, n, bytes);
   }
 
   // Returns true if the caller must wake up the consumer.
   bool produce(const topic& t, data&& y) {
+    return produce(value_type{t, std::move(y)});
+  }
+
+  /// Adds messages with individual topics. Returns true if the caller must
+  /// wake up the consumer. This function can go beyond the capacity of the
+  /// queue.
+  template <class Iterator>
+  bool produce(Iterator first, Iterator last) {
+    return produce(std::vector<value_type>{std::make_move_iterator(first),
+                                           std::make_move_iterator(last)});
+  }
+
+  /// Adds all messages in `xs` as a single batch. Returns true if the caller
+  /// must wake up the consumer. This function can go beyond the capacity of
+  /// the queue.
+  bool produce(std::vector<value_type>&& xs) {
+    if (xs.empty())
+      return false;
+    auto n = xs.size();
+    auto bytes = payload_size(xs);
+    return append(message_batch{std::move(xs), 0}, n, bytes);
+  }
+
+  // Returns true if the caller must wake up the consumer.
+  bool produce(value_type&& y) {
+    auto bytes = max_bytes_ > 0 ? item_size(y) : 0;
+    return append(std::move(y), 1, bytes);
+  }
+
+  /// Adds as many items from `[first, last)` as fit into the queue without
+  /// blocking. Sets `wakeup` to true if the caller must wake up the consumer.
+  /// Returns an iterator to the first item that did not fit.
+  template <class Iterator>
+  Iterator try_produce(const topic& t, Iterator first, Iterator last,
+                       bool& wakeup) {
     guard_type guard{this->mtx_};
-    auto& xs = this->xs_;
-    if (xs.size() >= capacity_)
-      await_consumer(guard);
-    auto xs_old_size = xs.size();
-    BROKER_ASSERT(xs_old_size < capacity_);
-    xs.emplace_back(t, std::move(y));
-    if (xs.size() >= capacity_) {
-      // Extinguish the flare to cause the *next* produce to block.
-      this->fx_.extinguish();
+    wakeup = false;
+    if (full() || first == last)
+      return first;
+    wakeup = size_ == 0;
+    auto n = std::min(static_cast<size_t>(std::distance(first, last)),
+                      capacity_ - size_);
+    if (max_bytes_ > 0) {
+      // Takes at least one item, even if it exceeds the limit on its own.
+      size_t taken = 0;
+      for (auto j = first; taken < n && bytes_ < max_bytes_; ++j, ++taken)
+        bytes_ += item_size(*j);
+      n = taken;
     }
-    return xs_old_size == 0;
+    auto i = std::next(first, static_cast<ptrdiff_t>(n));
+    if (n == 1)
+      segments_.emplace_back(value_type{t, std::move(*first)});
+    else
+      segments_.emplace_back(data_batch{t,
+                                        std::vector<data>{
+                                          std::make_move_iterator(first),
+                                          std::make_move_iterator(i)},
+                                        0});
+    size_ += n;
+    if (full())
+      this->fx_.extinguish();
+    return i;
   }
 
   size_t capacity() const {
     return capacity_;
   }
 
+  /// Returns the byte limit of the queue or 0 if the queue has none.
+  size_t max_bytes() const {
+    return max_bytes_;
+  }
+
+  /// Returns whether the caller must send a wakeup message to the consumer.
+  /// Returns `false` while a previous wakeup is still pending, which allows
+  /// producers to coalesce wakeups for bursts of `produce` calls.
+  bool request_wakeup() {
+    return !wakeup_pending_.exchange(true, std::memory_order_acq_rel);
+  }
+
+  /// Signals that the consumer received a wakeup message. Must get called
+  /// before consuming items to make sure no wakeup gets lost.
+  void wakeup_received() {
+    wakeup_pending_.store(false, std::memory_order_release);
+  }
+
 private:
+  /// Data items that share a single topic. The worker already consumed all
+  /// items before `pos`.
+  struct data_batch {
+    topic t;
+    std::vector<data> items;
+    size_t pos;
+  };
+
+  /// Messages with individual topics. The worker already consumed all items
+  /// before `pos`.
+  struct message_batch {
+    std::vector<value_type> items;
+    size_t pos;
+  };
+
+  using segment = caf::variant<value_type, data_batch, message_batch>;
+
+  static size_t item_size(const data& x) {
+    return estimated_size(x);
+  }
+
+  static size_t item_size(const data_message& x) {
+    return estimated_size(get_data(x));
+  }
+
+  template <class T>
+  static size_t item_size(const T&) {
+    return 0;
+  }
+
+  /// Returns the payload size of all items in `xs` if the queue has a byte
+  /// limit. Runs before locking the queue.
+  template <class T>
+  size_t payload_size(const std::vector<T>& xs) const {
+    size_t result = 0;
+    if (max_bytes_ > 0)
+      for (auto& x : xs)
+        result += item_size(x);
+    return result;
+  }
+
+  /// Removes the payload size of an item that leaves the queue.
+  /// @pre `mtx_` is locked
+  template <class T>
+  void release(const T& x) {
+    if (max_bytes_ > 0)
+      bytes_ -= std::min(bytes_, item_size(x));
+  }
+
+  /// Checks whether the queue reached one of its limits.
+  /// @pre `mtx_` is locked
+  bool full() const {
+    return size_ >= capacity_ || (max_bytes_ > 0 && bytes_ >= max_bytes_);
+  }
+
+  /// Adds `x` with `n` items and `bytes` of payload to the queue. Returns true
+  /// if the caller must wake up the consumer.
+  template <class T>
+  bool append(T&& x, size_t n, size_t bytes) {
+    guard_type guard{this->mtx_};
+    if (full())
+      await_consumer(guard);
+    auto old_size = size_;
+    BROKER_ASSERT(!full());
+    segments_.emplace_back(std::forward<T>(x));
+    size_ += n;
+    bytes_ += bytes;
+    if (full()) {
+      // Extinguish the flare to cause the *next* produce to block.
+      this->fx_.extinguish();
+    }
+    return old_size == 0;
+  }
+
   void await_consumer(guard_type& guard) {
     // Block the caller until the consumer catched up.
     guard.unlock();
@@ -114,14 +298,25 @@ private:
     guard.lock();
   }
 
-  /// @pre xs.size() < capacity_
-  ptrdiff_t free_space() {
-    return static_cast<ptrdiff_t>(capacity_ - this->xs.size());
-  }
+  // Configures the amound of items for the queue.
+  const size_t capacity_;
 
+  // Configures the approximate payload size for the queue. 0 disables the
+  // limit.
+  const size_t max_bytes_;
 
-  // Configures the amound of items for xs_.
-  const size_t capacity_;
+  // Approximate payload size of all items in `segments_` if `max_bytes_` is
+  // set.
+  size_t bytes_ = 0;
+
+  // Buffers single messages and batches in the order of their arrival.
+  std::deque<segment> segments_;
+
+  // Number of items in `segments_`.
+  size_t size_ = 0;
+
+  // Signals whether a wakeup message is on its way to the consumer.
+  std::atomic<bool> wakeup_pending_{false};
 };
 
 template <class ValueType = data_message>
@@ -130,8 +325,9 @@ using shared_publisher_queue_ptr
 
 template <class ValueType = data_message>
 shared_publisher_queue_ptr<ValueType>
-make_shared_publisher_queue(size_t buffer_size) {
-  return caf::make_counted<shared_publisher_queue<ValueType>>(buffer_size);
+make_shared_publisher_queue(size_t buffer_size, size_t max_bytes = 0) {
+  return caf::make_counted<shared_publisher_queue<ValueType>>(buffer_size,
+                                                              max_bytes);
 }
 
 } // namespace detail
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <caf/allowed_unsafe_message_type.hpp>
+
+#include "broker/snapshot.hh"
+
+namespace broker {
+namespace detail {
+
+/// Holds the latest snapshot of a master for reading it from other threads
+/// without going through the master's mailbox. The master replaces the
+/// snapshot after modifications, while readers keep using the snapshot they
+/// loaded, i.e., each load returns a consistent point-in-time view.
+class shared_snapshot {
+public:
+  using pointer = std::shared_ptr<const snapshot>;
+
+  /// Returns the current snapshot or `nullptr` if the master did not publish
+  /// a snapshot yet.
+  pointer load() const {
+    return std::atomic_load(&ptr_);
+  }
+
+  /// Replaces the current snapshot.
+  void store(pointer x) {
+    std::atomic_store(&ptr_, std::move(x));
+  }
+
+private:
+  pointer ptr_;
+};
+
+using shared_snapshot_ptr = std::shared_ptr<shared_snapshot>;
+
+} // namespace detail
+} // namespace broker
+
+CAF_ALLOW_UNSAFE_MESSAGE_TYPE(broker::detail::shared_snapshot_ptr)
@@ -1,11 +1,24 @@
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
+
 #include <caf/intrusive_ptr.hpp>
 #include <caf/make_counted.hpp>
 
+#include "broker/data.hh"
+#include "broker/detail/assert.hh"
+#include "broker/detail/core_metrics.hh"
+#include "broker/detail/memory_accounting.hh"
 #include "broker/detail/shared_queue.hh"
+#include "broker/detail/spsc_ring.hh"
 #include "broker/message.hh"
+#include "broker/time.hh"
 
 namespace broker {
 namespace detail {
@@ -15,11 +28,29 @@ namespace detail {
 /// the flare remains active. The user consumes items, while the worker
 /// produces them.
 ///
+/// Items travel through a lock-free ring buffer. Only when the ring is full,
+/// the worker appends additional items to `chunks_` (guarded by `mtx_`) until
+/// the user drained all overflowing items again. The overflow buffer stores
+/// entire batches from the worker rather than individual items and recycles
+/// the storage of drained batches for subsequent batches.
+///
+/// With a maximum age, the queue records the time of each call to `produce`
+/// together with the total number of items produced so far. Since items leave
+/// the queue in order, these marks tell the consumer the enqueue time of each
+/// item without storing a timestamp per item. In conflating mode, a
+/// replacement also refreshes the age of the pending item, since the item
+/// then holds a new value. `drop_stale` stops at such an item instead of
+/// discarding the latest value for its key.
+///
+/// In conflating mode, the queue keeps only the latest item per key. The
+/// worker then appends to `keyed_` (guarded by `mtx_`) and replaces the
+/// pending item with the same key in place instead of appending another one.
+///
 /// The protocol on the flare is as follows:
 /// - the flare starts inactive
-/// - the flare is active as long as xs_ has more than one item
-/// - produce() fires the flare when it adds items to xs_ and xs_ was empty
-/// - consume() extinguishes the flare when it removes the last item from xs_
+/// - the flare is active as long as the queue has at least one item
+/// - produce() fires the flare when it adds items to an empty queue
+/// - consume() extinguishes the flare when it removes the last item
 template <class ValueType = data_message>
 class shared_subscriber_queue : public shared_queue<ValueType> {
 public:
@@ -29,49 +60,198 @@ public:
 
   using guard_type = typename super::guard_type;
 
-  shared_subscriber_queue() = default;
+  using batch_type = std::vector<value_type>;
+
+  /// Stores the key of an item in its second argument. Returns `false` for
+  /// items without a key.
+  using key_function = std::function<bool(const value_type&, data&)>;
+
+  /// Default capacity of the ring buffer.
+  static constexpr size_t default_ring_capacity = 128;
+
+  /// Maximum number of drained batches the queue keeps for reuse.
+  static constexpr size_t max_recycled_batches = 4;
+
+  explicit shared_subscriber_queue(size_t ring_capacity = default_ring_capacity)
+    : ring_(ring_capacity), size_(0), overflow_size_(0) {
+    // nop
+  }
+
+  ~shared_subscriber_queue() override {
+    if (memory_)
+      memory_->remove(memory_accounting::subscriber_queues,
+                      bytes_.load(std::memory_order_relaxed));
+  }
+
+  size_t buffer_size() const {
+    return size_.load(std::memory_order_acquire);
+  }
+
+  /// Accounts the payload of all items in the queue as subscriber memory of
+  /// `ptr` from now on.
+  /// @pre the queue is still empty and not shared with a producer yet
+  void track_memory(memory_accounting_ptr ptr) {
+    BROKER_ASSERT(size_.load() == 0);
+    memory_ = std::move(ptr);
+  }
+
+  /// Checks whether all subscriber queues together reached their limit.
+  bool memory_exhausted() const noexcept {
+    return memory_ && memory_->exhausted(memory_accounting::subscriber_queues);
+  }
+
+  /// Limits the approximate payload size of all items in the queue to `n`
+  /// bytes. 0 disables the limit.
+  /// @pre the queue is still empty and not shared with a producer yet
+  void max_bytes(size_t n) {
+    BROKER_ASSERT(size_.load() == 0);
+    max_bytes_ = n;
+  }
+
+  /// Returns the byte limit of the queue or 0 if the queue has none.
+  size_t max_bytes() const noexcept {
+    return max_bytes_;
+  }
+
+  /// Returns the approximate payload size of all items in the queue if the
+  /// queue tracks memory or has a byte limit, 0 otherwise.
+  size_t buffered_bytes() const noexcept {
+    return bytes_.load(std::memory_order_relaxed);
+  }
+
+  /// Checks whether the queue reached its byte limit.
+  bool bytes_exhausted() const noexcept {
+    return max_bytes_ > 0 && buffered_bytes() >= max_bytes_;
+  }
+
+  /// Discards items that stay in the queue for longer than `x` from now on.
+  /// Items produced before setting a maximum age never expire. 0 disables the
+  /// limit.
+  void max_age(timespan x) {
+    guard_type guard{this->mtx_};
+    if (x.count() > 0 && max_age_.load(std::memory_order_relaxed).count() == 0)
+      aged_from_ = produced_total_.load(std::memory_order_relaxed);
+    max_age_.store(x, std::memory_order_relaxed);
+  }
+
+  /// Returns the maximum age of items or 0 if the queue has no limit.
+  timespan max_age() const noexcept {
+    return max_age_.load(std::memory_order_relaxed);
+  }
+
+  /// Returns the number of items the queue discarded for exceeding the
+  /// maximum age.
+  size_t stale() const noexcept {
+    return stale_.load(std::memory_order_relaxed);
+  }
+
+  /// Discards all items at the front of the queue that exceed the maximum age.
+  /// Stops at the first conflated item that a recent replacement refreshed.
+  /// Must be called from the consumer. Stores the number of items before
+  /// discarding any in `size_before_drop` unless it is `nullptr`.
+  /// @returns the number of discarded items.
+  size_t drop_stale(size_t* size_before_drop = nullptr) {
+    auto max_age = max_age_.load(std::memory_order_relaxed);
+    if (max_age.count() == 0)
+      return 0;
+    auto available = size_.load(std::memory_order_acquire);
+    if (size_before_drop)
+      *size_before_drop = available;
+    if (available == 0)
+      return 0;
+    auto last = consumed_total_ + available;
+    auto stale_end = consumed_total_;
+    timestamp stale_time;
+    auto cutoff = broker::now() - max_age;
+    {
+      guard_type guard{this->mtx_};
+      // Items leave in order, so nothing expires before the consumer reached
+      // the first item produced with a maximum age.
+      if (consumed_total_ < aged_from_)
+        return 0;
+      while (!marks_.empty()) {
+        auto& front = marks_.front();
+        if (front.end > consumed_total_) {
+          if (front.time >= cutoff)
+            break;
+          // Keep the mark if the consumer cannot see all of its items yet.
+          stale_time = front.time;
+          if (front.end > last) {
+            stale_end = last;
+            break;
+          }
+          stale_end = front.end;
+        }
+        marks_.pop_front();
+      }
+    }
+    auto n = static_cast<size_t>(stale_end - consumed_total_);
+    auto discard = [](value_type&&) {};
+    size_t i = 0;
+    for (; i < n && !refreshed_front(cutoff); ++i)
+      pop(discard);
+    if (i < n) {
+      // Restore the age of the items behind the refreshed item.
+      guard_type guard{this->mtx_};
+      if (marks_.empty() || marks_.front().end != stale_end)
+        marks_.emplace_front(mark{stale_end, stale_time});
+    }
+    n = i;
+    if (n == 0)
+      return 0;
+    consumed(n);
+    stale_.fetch_add(n, std::memory_order_relaxed);
+    return n;
+  }
+
+  /// Keeps only the latest pending item for each key that `f` extracts from
+  /// now on. Items without a key never get replaced. Conflating applies only
+  /// to items that arrive after calling this function and cannot be turned
+  /// off again.
+  void conflate(key_function f) {
+    BROKER_ASSERT(f != nullptr);
+    guard_type guard{this->mtx_};
+    key_fn_ = std::move(f);
+    conflating_.store(true, std::memory_order_release);
+  }
+
+  /// Checks whether the queue keeps only the latest item per key.
+  bool conflating() const noexcept {
+    return conflating_.load(std::memory_order_acquire);
+  }
+
+  /// Returns the number of items that replaced a pending item with the same
+  /// key.
+  size_t conflated() const noexcept {
+    return conflated_.load(std::memory_order_relaxed);
+  }
 
   // Called to pull up to `num` items out of the queue. Returns the number of
   // consumed elements.
   template <class F>
   size_t consume(size_t num, size_t* size_before_consume, F fun) {
-    guard_type guard{this->mtx_};
-    if (this->xs_.empty())
+    auto available = size_.load(std::memory_order_acquire);
+    if (available == 0)
       return 0;
     if (size_before_consume)
-      *size_before_consume = this->xs_.size();
-    auto n = std::min(num, this->xs_.size());
-    if (n == this->xs_.size()) {
-      for (auto& x : this->xs_)
-        fun(std::move(x));
-      this->xs_.clear();
-      this->fx_.extinguish_one();
-    } else {
-      auto b = this->xs_.begin();
-      auto e = b + static_cast<ptrdiff_t>(n);
-      for (auto i = b; i != e; ++i)
-        fun(std::move(*i));
-      this->xs_.erase(b, e);
-    }
+      *size_before_consume = available;
+    auto n = std::min(num, available);
+    for (size_t i = 0; i < n; ++i)
+      pop(fun);
+    consumed(n);
     return n;
   }
 
   std::vector<value_type> consume_all() {
-    guard_type guard{this->mtx_};
-
     std::vector<value_type> rval;
-
-    if (this->xs_.empty())
+    auto n = size_.load(std::memory_order_acquire);
+    if (n == 0)
       return rval;
-
-    rval.reserve(this->xs_.size());
-
-    for (auto& x : this->xs_)
-      rval.emplace_back(std::move(x));
-
-    this->xs_.clear();
-    this->fx_.extinguish_one();
-
+    rval.reserve(n);
+    auto f = [&](value_type&& x) { rval.emplace_back(std::move(x)); };
+    for (size_t i = 0; i < n; ++i)
+      pop(f);
+    consumed(n);
     return rval;
   }
 
@@ -80,19 +260,338 @@ public:
   void produce(size_t num, Iter i, Iter e) {
     CAF_IGNORE_UNUSED(num);
     CAF_ASSERT(num == std::distance(i, e));
-    guard_type guard{this->mtx_};
-    if (this->xs_.empty())
-      this->fx_.fire();
-    this->xs_.insert(this->xs_.end(), i, e);
+    size_t n = 0;
+    for (; i != e; ++i)
+      if (push(*i))
+        ++n;
+    produced(n);
   }
 
   // Inserts `x` into the queue.
   void produce(ValueType x) {
+    if (push(std::move(x)))
+      produced(1);
+  }
+
+  // Inserts all items of `xs` into the queue. Moves items into the ring as
+  // long as it has room and hands the remainder over as a whole.
+  void produce(batch_type&& xs) {
+    auto n = xs.size();
+    if (n == 0)
+      return;
+    if (tracks_bytes()) {
+      size_t bytes = 0;
+      for (auto& x : xs)
+        bytes += item_size(x);
+      bytes_.fetch_add(bytes, std::memory_order_relaxed);
+      if (memory_)
+        memory_->add(memory_accounting::subscriber_queues, bytes);
+    }
+    if (conflating()) {
+      size_t added = 0;
+      guard_type guard{this->mtx_};
+      for (auto& x : xs)
+        if (insert_keyed(std::move(x)))
+          ++added;
+      recycle(xs);
+      guard.unlock();
+      produced(added);
+      return;
+    }
+    size_t i = 0;
+    if (overflow_size_.load(std::memory_order_acquire) == 0)
+      while (i < n && ring_.try_push(std::move(xs[i])))
+        ++i;
+    {
+      guard_type guard{this->mtx_};
+      if (i < n) {
+        chunks_.emplace_back(chunk{std::move(xs), i});
+        overflow_size_.fetch_add(n - i, std::memory_order_release);
+      } else {
+        recycle(xs);
+      }
+    }
+    produced(n);
+  }
+
+  /// Lets `xs` reuse the storage of a previously drained batch if possible.
+  /// @pre `xs.empty()`
+  void reuse_batch(batch_type& xs) {
+    BROKER_ASSERT(xs.empty());
+    guard_type guard{this->mtx_};
+    if (!pool_.empty() && pool_.back().capacity() > xs.capacity()) {
+      xs.swap(pool_.back());
+      pool_.pop_back();
+    }
+  }
+
+private:
+  static size_t item_size(const data_message& x) {
+    return estimated_size(get_data(x));
+  }
+
+  template <class T>
+  static size_t item_size(const T&) {
+    return 0;
+  }
+
+  /// Checks whether the queue needs the payload size of its items. Each item
+  /// gets estimated once when entering and once when leaving the queue.
+  bool tracks_bytes() const noexcept {
+    return memory_ || max_bytes_ > 0;
+  }
+
+  /// Adds the payload size of `x` to `bytes_` and the memory accounting.
+  void account(const value_type& x) {
+    if (tracks_bytes()) {
+      auto n = item_size(x);
+      bytes_.fetch_add(n, std::memory_order_relaxed);
+      if (memory_)
+        memory_->add(memory_accounting::subscriber_queues, n);
+    }
+  }
+
+  /// Subtracts the payload size of `x` from `bytes_` and the memory
+  /// accounting.
+  void unaccount(const value_type& x) {
+    auto n = item_size(x);
+    bytes_.fetch_sub(n, std::memory_order_relaxed);
+    if (memory_)
+      memory_->remove(memory_accounting::subscriber_queues, n);
+  }
+
+  /// Adds `x` to the ring or to the overflow buffer, or replaces the pending
+  /// item with the same key in conflating mode.
+  /// @returns `false` if `x` replaced a pending item, `true` otherwise.
+  bool push(value_type x) {
+    account(x);
+    if (conflating()) {
+      guard_type guard{this->mtx_};
+      return insert_keyed(std::move(x));
+    }
+    if (overflow_size_.load(std::memory_order_acquire) == 0
+        && ring_.try_push(std::move(x)))
+      return true;
+    push_overflow(std::move(x));
+    return true;
+  }
+
+  /// Replaces the pending item with the same key as `x` or appends `x` to
+  /// `keyed_`. Expects the caller to have accounted `x` already.
+  /// @returns `false` if `x` replaced a pending item, `true` otherwise.
+  /// @pre `mtx_` is locked
+  bool insert_keyed(value_type&& x) {
+    keyed_item item{data{}, false, std::move(x), timestamp{}};
+    if (max_age_.load(std::memory_order_relaxed).count() > 0)
+      item.time = broker::now();
+    item.has_key = key_fn_(item.value, item.key);
+    if (item.has_key) {
+      auto i = slots_.find(item.key);
+      if (i != slots_.end()) {
+        auto& pending = keyed_[i->second - keyed_offset_];
+        if (tracks_bytes())
+          unaccount(pending.value);
+        pending.value = std::move(item.value);
+        pending.time = item.time;
+        conflated_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      slots_.emplace(item.key, keyed_offset_ + keyed_.size());
+    }
+    keyed_.emplace_back(std::move(item));
+    return true;
+  }
+
+  /// Checks whether the next item of the consumer is a conflated item that
+  /// entered or got replaced after `cutoff`. Items in the ring or in the
+  /// overflow buffer always come before items in `keyed_`.
+  bool refreshed_front(timestamp cutoff) {
+    if (!conflating() || !ring_.empty())
+      return false;
     guard_type guard{this->mtx_};
-    if (this->xs_.empty())
+    return chunks_.empty() && !keyed_.empty() && keyed_.front().time >= cutoff;
+  }
+
+  /// Adds `x` to the overflow buffer.
+  void push_overflow(value_type x) {
+    guard_type guard{this->mtx_};
+    if (chunks_.empty()) {
+      chunk tmp{batch_type{}, 0};
+      if (!pool_.empty()) {
+        tmp.xs.swap(pool_.back());
+        pool_.pop_back();
+      }
+      chunks_.emplace_back(std::move(tmp));
+    }
+    chunks_.back().xs.emplace_back(std::move(x));
+    overflow_size_.fetch_add(1, std::memory_order_release);
+  }
+
+  /// Keeps the storage of `xs` for later batches.
+  /// @pre `mtx_` is locked
+  void recycle(batch_type& xs) {
+    if (pool_.size() < max_recycled_batches && xs.capacity() > 0) {
+      xs.clear();
+      pool_.emplace_back(std::move(xs));
+    }
+  }
+
+  /// Removes the oldest item and passes it to `f`. Items in the ring are
+  /// always older than items in the overflow buffer, because `push` only
+  /// writes to the ring while no overflow exists. Likewise, items in `keyed_`
+  /// are always the youngest, because producers no longer write to the ring
+  /// or to the overflow buffer after switching to conflating mode.
+  /// @pre at least one item was announced via `produced`
+  template <class F>
+  void pop(F& f) {
+    if (tracks_bytes()) {
+      auto g = [&](value_type&& x) {
+        unaccount(x);
+        f(std::move(x));
+      };
+      do_pop(g);
+    } else {
+      do_pop(f);
+    }
+  }
+
+  template <class F>
+  void do_pop(F& f) {
+    if (ring_.try_pop(f))
+      return;
+    guard_type guard{this->mtx_};
+    if (chunks_.empty()) {
+      BROKER_ASSERT(!keyed_.empty());
+      auto& front = keyed_.front();
+      if (front.has_key) {
+        auto i = slots_.find(front.key);
+        if (i != slots_.end() && i->second == keyed_offset_)
+          slots_.erase(i);
+      }
+      f(std::move(front.value));
+      keyed_.pop_front();
+      ++keyed_offset_;
+      return;
+    }
+    auto& front = chunks_.front();
+    BROKER_ASSERT(front.pos < front.xs.size());
+    f(std::move(front.xs[front.pos++]));
+    if (front.pos == front.xs.size()) {
+      recycle(front.xs);
+      chunks_.pop_front();
+    }
+    overflow_size_.fetch_sub(1, std::memory_order_release);
+  }
+
+  /// Announces `n` new items to the consumer.
+  void produced(size_t n) {
+    if (n == 0)
+      return;
+    auto total = produced_total_.fetch_add(n, std::memory_order_relaxed) + n;
+    if (max_age_.load(std::memory_order_relaxed).count() > 0) {
+      guard_type guard{this->mtx_};
+      marks_.emplace_back(mark{total, broker::now()});
+    }
+    if (size_.fetch_add(n, std::memory_order_acq_rel) == 0)
       this->fx_.fire();
-    this->xs_.emplace_back(std::move(x));
   }
+
+  /// Removes `n` announced items.
+  void consumed(size_t n) {
+    consumed_total_ += n;
+    if (size_.fetch_sub(n, std::memory_order_acq_rel) == n) {
+      // The producer may still be on its way to firing the flare after making
+      // the queue non-empty. Wait for it, otherwise the flare would remain
+      // active after we return.
+      while (!this->fx_.extinguish_one())
+        std::this_thread::yield();
+    }
+  }
+
+  /// A batch in the overflow buffer. The consumer already read all items
+  /// before `pos`.
+  struct chunk {
+    batch_type xs;
+    size_t pos;
+  };
+
+  /// Marks the time at which the total number of produced items reached
+  /// `end`.
+  struct mark {
+    uint64_t end;
+    timestamp time;
+  };
+
+  /// An item in conflating mode.
+  struct keyed_item {
+    data key;
+    bool has_key;
+    value_type value;
+    /// Time of the last insertion or replacement while a maximum age is set.
+    timestamp time;
+  };
+
+  /// Lock-free transport for items.
+  spsc_ring<value_type> ring_;
+
+  /// Buffers items that did not fit into the ring.
+  std::deque<chunk> chunks_;
+
+  /// Storage of drained batches for reuse.
+  std::vector<batch_type> pool_;
+
+  /// Number of items the consumer may read.
+  std::atomic<size_t> size_;
+
+  /// Number of unread items in `chunks_`.
+  std::atomic<size_t> overflow_size_;
+
+  /// Receives the payload size of all items in the queue (optional).
+  memory_accounting_ptr memory_;
+
+  /// Upper bound for `bytes_` before the queue counts as full (optional).
+  size_t max_bytes_ = 0;
+
+  /// Payload size of all items in the queue if `tracks_bytes()`.
+  std::atomic<size_t> bytes_{0};
+
+  /// Maximum time span items may stay in the queue (optional).
+  std::atomic<timespan> max_age_{timespan{0}};
+
+  /// Enqueue times of produced items while a maximum age is set.
+  std::deque<mark> marks_;
+
+  /// Number of items ever produced.
+  std::atomic<uint64_t> produced_total_{0};
+
+  /// Value of `produced_total_` when setting the maximum age. Items before
+  /// this position never expire. Guarded by `mtx_`.
+  uint64_t aged_from_ = 0;
+
+  /// Number of items ever consumed or discarded. Only used by the consumer.
+  uint64_t consumed_total_ = 0;
+
+  /// Number of items discarded for exceeding the maximum age.
+  std::atomic<size_t> stale_{0};
+
+  /// Signals that producers append to `keyed_`.
+  std::atomic<bool> conflating_{false};
+
+  /// Extracts the key of items in conflating mode.
+  key_function key_fn_;
+
+  /// Pending items in conflating mode.
+  std::deque<keyed_item> keyed_;
+
+  /// Maps keys to the position of their item, counting from the first item
+  /// that ever entered `keyed_`.
+  std::unordered_map<data, uint64_t> slots_;
+
+  /// Position of the first item in `keyed_`.
+  uint64_t keyed_offset_ = 0;
+
+  /// Number of items that replaced a pending item with the same key.
+  std::atomic<size_t> conflated_{0};
 };
 
 template <class ValueType = data_message>
@@ -100,8 +599,10 @@ using shared_subscriber_queue_ptr
   = caf::intrusive_ptr<shared_subscriber_queue<ValueType>>;
 
 template <class ValueType = data_message>
-shared_subscriber_queue_ptr<ValueType> make_shared_subscriber_queue() {
-  return caf::make_counted<shared_subscriber_queue<ValueType>>();
+shared_subscriber_queue_ptr<ValueType> make_shared_subscriber_queue(
+  size_t ring_capacity
+  = shared_subscriber_queue<ValueType>::default_ring_capacity) {
+  return caf::make_counted<shared_subscriber_queue<ValueType>>(ring_capacity);
 }
 
 } // namespace detail
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#include "broker/config.hh"
+
+#ifdef BROKER_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace broker {
+namespace detail {
+
+/// Returns whether the first `n` bytes of `x` and `y` are equal. Compares 16
+/// bytes at a time if SSE2 is available. Unlike `memcmp`, this function only
+/// tests for equality and gets inlined at the call site.
+inline bool equal_bytes(const char* x, const char* y, size_t n) noexcept {
+#ifdef BROKER_USE_SSE2
+  for (; n >= 16; n -= 16, x += 16, y += 16) {
+    auto xs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x));
+    auto ys = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(xs, ys)) != 0xFFFF)
+      return false;
+  }
+  for (; n > 0; --n)
+    if (*x++ != *y++)
+      return false;
+  return true;
+#else
+  return std::memcmp(x, y, n) == 0;
+#endif
+}
+
+/// Returns a pointer to the first occurrence of `c` in `[first, last)` or
+/// `last` if `c` does not occur in the range. Scans 16 bytes at a time if
+/// SSE2 is available.
+inline const char* find_byte(const char* first, const char* last,
+                             char c) noexcept {
+#ifdef BROKER_USE_SSE2
+  auto needle = _mm_set1_epi8(c);
+  for (; last - first >= 16; first += 16) {
+    auto xs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+    if (auto mask = _mm_movemask_epi8(_mm_cmpeq_epi8(xs, needle)))
+      return first + __builtin_ctz(static_cast<unsigned>(mask));
+  }
+  for (; first != last; ++first)
+    if (*first == c)
+      return first;
+  return last;
+#else
+  auto result = std::memchr(first, c, static_cast<size_t>(last - first));
+  return result != nullptr ? static_cast<const char*>(result) : last;
+#endif
+}
+
+/// Returns a pointer to the first quote, backslash, or control character in
+/// `[first, last)` or `last` if there is none, i.e., finds the end of a run
+/// of characters that need no escaping in a JSON string. Scans 16 bytes at a
+/// time if SSE2 is available.
+inline const char* find_json_special(const char* first,
+                                     const char* last) noexcept {
+#ifdef BROKER_USE_SSE2
+  auto quote = _mm_set1_epi8('"');
+  auto backslash = _mm_set1_epi8('\\');
+  // Flipping the sign bit maps control characters (below 0x20) to the
+  // smallest signed bytes.
+  auto bias = _mm_set1_epi8(static_cast<char>(0x80));
+  auto limit = _mm_set1_epi8(static_cast<char>(0x20 ^ 0x80));
+  for (; last - first >= 16; first += 16) {
+    auto xs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+    auto hits = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(xs, quote), _mm_cmpeq_epi8(xs, backslash)),
+      _mm_cmplt_epi8(_mm_xor_si128(xs, bias), limit));
+    if (auto mask = _mm_movemask_epi8(hits))
+      return first + __builtin_ctz(static_cast<unsigned>(mask));
+  }
+#endif
+  for (; first != last; ++first) {
+    auto c = static_cast<unsigned char>(*first);
+    if (c == '"' || c == '\\' || c < 0x20)
+      return first;
+  }
+  return last;
+}
+
+/// Returns the position of `c` in the first `n` bytes of the 16-byte array
+/// `keys` or `n` if `c` does not occur in them. Compares all 16 bytes with a
+/// single instruction if SSE2 is available.
+/// @pre `n <= 16`
+inline int find_byte16(const unsigned char* keys, int n,
+                       unsigned char c) noexcept {
+#ifdef BROKER_USE_SSE2
+  auto xs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+  auto cmp = _mm_cmpeq_epi8(xs, _mm_set1_epi8(static_cast<char>(c)));
+  auto mask = static_cast<unsigned>(_mm_movemask_epi8(cmp)) & ((1u << n) - 1);
+  return mask != 0 ? __builtin_ctz(mask) : n;
+#else
+  int i = 0;
+  while (i < n && keys[i] != c)
+    ++i;
+  return i;
+#endif
+}
+
+/// Returns the position of the first of the first `n` bytes of the sorted
+/// 16-byte array `keys` that is greater than `c` or `n` if there is no such
+/// byte. Compares all 16 bytes with a single instruction if SSE2 is
+/// available.
+/// @pre `n <= 16`
+inline int upper_bound16(const unsigned char* keys, int n,
+                         unsigned char c) noexcept {
+#ifdef BROKER_USE_SSE2
+  // SSE2 only compares signed bytes. Flipping the sign bit of both operands
+  // maps the unsigned order onto the signed order.
+  auto bias = _mm_set1_epi8(static_cast<char>(0x80));
+  auto xs = _mm_xor_si128(
+    _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys)), bias);
+  auto cs = _mm_xor_si128(_mm_set1_epi8(static_cast<char>(c)), bias);
+  auto cmp = _mm_cmplt_epi8(cs, xs);
+  auto mask = static_cast<unsigned>(_mm_movemask_epi8(cmp)) & ((1u << n) - 1);
+  return mask != 0 ? __builtin_ctz(mask) : n;
+#else
+  int i = 0;
+  while (i < n && keys[i] <= c)
+    ++i;
+  return i;
+#endif
+}
+
+} // namespace detail
+} // namespace broker
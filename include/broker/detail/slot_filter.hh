@@ -0,0 +1,69 @@
+#pragma once
+
+#include <unordered_map>
+#include <utility>
+
+#include <caf/stream_slot.hpp>
+
+#include "broker/filter_type.hh"
+#include "broker/message.hh"
+#include "broker/predicate.hh"
+#include "broker/detail/prefix_matcher.hh"
+#include "broker/detail/subscription_index.hh"
+#include "broker/detail/worker_groups.hh"
+
+namespace broker {
+namespace detail {
+
+/// Filter for a local (worker or store) path, tagged with its stream slot.
+using slot_filter = std::pair<caf::stream_slot, filter_type>;
+
+/// Matches messages against the filter of a local path.
+struct slot_filter_matcher {
+  /// Optional index over the filters of all paths. When set, the matcher
+  /// queries the index instead of scanning `f.second` linearly.
+  subscription_index<caf::stream_slot>* index = nullptr;
+
+  /// Optional predicates of local subscribers. Paths without an entry accept
+  /// all messages that match their filter.
+  const std::unordered_map<caf::stream_slot, predicate>* predicates = nullptr;
+
+  /// Optional consumer groups of local subscribers. A message for a group
+  /// only passes for one of its members.
+  worker_groups* groups = nullptr;
+
+  bool matches_topic(const slot_filter& f, const topic& x) const {
+    if (index != nullptr)
+      return index->matches(f.first, x);
+    prefix_matcher g;
+    return g(f.second, x);
+  }
+
+  template <class T>
+  bool operator()(const slot_filter& f, const T& x) const {
+    return matches_topic(f, get_topic(x));
+  }
+
+  bool matches_data(caf::stream_slot slot, const data_message& x) const {
+    if (predicates == nullptr)
+      return true;
+    auto i = predicates->find(slot);
+    return i == predicates->end() || matches(i->second, get_data(x));
+  }
+
+  bool operator()(const slot_filter& f, const data_message& x) const {
+    if (!matches_topic(f, get_topic(x)) || !matches_data(f.first, x))
+      return false;
+    if (groups == nullptr || groups->empty())
+      return true;
+    // Other members only know their filters through the index.
+    return groups->selects(f.first, x, [&](caf::stream_slot member) {
+      return (member == f.first || index == nullptr
+              || index->matches(member, get_topic(x)))
+             && matches_data(member, x);
+    });
+  }
+};
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace broker {
+namespace detail {
+
+/// A bounded, lock-free ring buffer for exactly one producer thread and
+/// exactly one consumer thread.
+template <class T>
+class spsc_ring {
+public:
+  // -- member types -----------------------------------------------------------
+
+  using value_type = T;
+
+  // -- constants --------------------------------------------------------------
+
+  /// Size of a cache line for separating producer and consumer state.
+  static constexpr size_t cache_line_size = 64;
+
+  // -- constructors, destructors, and assignment operators --------------------
+
+  /// Constructs a ring that holds at least `min_capacity` elements. Rounds the
+  /// capacity up to the next power of two.
+  explicit spsc_ring(size_t min_capacity) {
+    size_t capacity = 2;
+    while (capacity < min_capacity)
+      capacity <<= 1;
+    mask_ = capacity - 1;
+    slots_.reset(new storage[capacity]);
+  }
+
+  ~spsc_ring() {
+    auto head = head_.load(std::memory_order_relaxed);
+    auto tail = tail_.load(std::memory_order_relaxed);
+    for (; head != tail; ++head)
+      slot(head)->~value_type();
+  }
+
+  spsc_ring(const spsc_ring&) = delete;
+
+  spsc_ring& operator=(const spsc_ring&) = delete;
+
+  // -- producer interface -----------------------------------------------------
+
+  /// Appends `x` to the ring unless the ring is full.
+  /// @returns `true` if `x` was added, `false` otherwise.
+  bool try_push(value_type&& x) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ > mask_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ > mask_)
+        return false;
+    }
+    new (slot(tail)) value_type(std::move(x));
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // -- consumer interface -----------------------------------------------------
+
+  /// Removes the oldest element from the ring and passes it to `f`.
+  /// @returns `true` if an element was removed, `false` if the ring is empty.
+  template <class F>
+  bool try_pop(F& f) {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_)
+        return false;
+    }
+    auto ptr = slot(head);
+    f(std::move(*ptr));
+    ptr->~value_type();
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // -- properties -------------------------------------------------------------
+
+  /// Returns the maximum number of elements in the ring.
+  size_t capacity() const noexcept {
+    return mask_ + 1;
+  }
+
+  /// Returns the number of elements in the ring. The result is only a
+  /// snapshot when called while the other side modifies the ring.
+  size_t size() const noexcept {
+    return tail_.load(std::memory_order_acquire)
+           - head_.load(std::memory_order_acquire);
+  }
+
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+private:
+  using storage = typename std::aligned_storage<sizeof(value_type),
+                                                alignof(value_type)>::type;
+
+  value_type* slot(size_t pos) noexcept {
+    return reinterpret_cast<value_type*>(&slots_[pos & mask_]);
+  }
+
+  /// Stores the elements.
+  std::unique_ptr<storage[]> slots_;
+
+  /// Bitmask for mapping positions to slots.
+  size_t mask_;
+
+  /// Position of the next element to read. Written by the consumer only.
+  alignas(cache_line_size) std::atomic<size_t> head_{0};
+
+  /// Cached value of `tail_` on the consumer side.
+  size_t tail_cache_ = 0;
+
+  /// Position of the next element to write. Written by the producer only.
+  alignas(cache_line_size) std::atomic<size_t> tail_{0};
+
+  /// Cached value of `head_` on the producer side.
+  size_t head_cache_ = 0;
+};
+
+} // namespace detail
+} // namespace broker
@@ -15,6 +15,19 @@ public:
   /// Required parameters:
   ///   - `path`: a `std::string` representing the location of the database on
   ///             the filesystem.
+  /// Optional parameters:
+  ///   - `batch_size`: a `count` that enables group commit if greater than 1.
+  ///                   The backend then commits modifications in
+  ///                   transactions of up to `batch_size` writes.
+  ///   - `batch_ms`: a `count` denoting how many milliseconds a modification
+  ///                 may remain uncommitted with group commit enabled.
+  ///                 (default = 10)
+  ///   - `journal_mode`: a `std::string` for the SQLite journal mode, e.g.,
+  ///                     `"wal"`.
+  ///   - `synchronous`: a `std::string` for the SQLite synchronous flag,
+  ///                    e.g., `"normal"`.
+  ///   - `read_only`: a `bool` that opens an existing database without
+  ///                  modifying it, e.g., for concurrent readers.
   sqlite_backend(backend_options opts = backend_options{});
 
   ~sqlite_backend();
@@ -22,6 +35,9 @@ public:
   expected<void> put(const data& key, data value,
                      optional<timestamp> expiry) override;
 
+  expected<void> put_many(const std::unordered_map<data, data>& entries,
+                          optional<timestamp> expiry) override;
+
   expected<void> add(const data& key, const data& value, data::type init_type,
                      optional<timestamp> expiry) override;
 
@@ -30,12 +46,28 @@ public:
 
   expected<void> erase(const data& key) override;
 
+  expected<void> erase_many(const std::vector<data>& keys) override;
+
   expected<void> clear() override;
 
   expected<bool> expire(const data& key, timestamp current_time) override;
 
+  expected<std::vector<data>> expire_many(const std::vector<data>& keys,
+                                          timestamp current_time) override;
+
+  expected<void> flush() override;
+
+  timespan flush_interval() const override;
+
   expected<data> get(const data& key) const override;
 
+  expected<data> get(const data& key, const data& aspect) const override;
+
+  expected<data> scan(const std::string& prefix, size_t limit) const override;
+
+  expected<optional<data>> scan(const optional<data>& start, size_t batch_size,
+                                const scan_callback& f) const override;
+
   expected<bool> exists(const data& key) const override;
 
   expected<uint64_t> size() const override;
@@ -46,6 +78,17 @@ public:
 
   expected<expirables> expiries() const override;
 
+  expected<expirables> expiries_between(timestamp from,
+                                        timestamp until) const override;
+
+  /// Opens a read-only connection if the database uses the write-ahead log,
+  /// since only then readers never block the writer.
+  std::unique_ptr<abstract_backend> make_reader() const override;
+
+  /// Copies the database via the SQLite backup API.
+  expected<std::vector<std::string>>
+  checkpoint(const std::string& path) override;
+
 private:
   struct impl;
   std::unique_ptr<impl> impl_;
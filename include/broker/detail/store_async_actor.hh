@@ -0,0 +1,92 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+
+#include <caf/actor.hpp>
+#include <caf/actor_clock.hpp>
+#include <caf/allowed_unsafe_message_type.hpp>
+#include <caf/behavior.hpp>
+#include <caf/event_based_actor.hpp>
+#include <caf/stateful_actor.hpp>
+
+#include "broker/data.hh"
+#include "broker/expected.hh"
+#include "broker/fwd.hh"
+
+namespace broker {
+namespace detail {
+
+/// State of the long-lived helper actor that performs asynchronous queries on
+/// behalf of a ::store. The helper multiplexes all outstanding queries of a
+/// store over the request ID based protocol of master and clone actors, i.e.,
+/// any number of queries may be in flight at the same time without spawning
+/// an actor or blocking a thread per query. A single timer covers all pending
+/// queries: it always fires at the deadline of the oldest query.
+struct store_async_state {
+  // --- member types ----------------------------------------------------------
+
+  using callback = std::function<void(expected<data>)>;
+
+  using time_point = caf::actor_clock::time_point;
+
+  // --- construction ----------------------------------------------------------
+
+  store_async_state(caf::event_based_actor* ptr);
+
+  /// Establishes all invariants.
+  void init(caf::actor frontend_hdl);
+
+  // --- request management ----------------------------------------------------
+
+  /// Sends `xs..., id` to the frontend for a fresh `id` and stores `f` until
+  /// the response for `id` arrives.
+  template <class... Ts>
+  void request(callback f, Ts&&... xs);
+
+  /// Completes the request `id` with `x`. Ignores unknown IDs.
+  void deliver(request_id id, expected<data> x);
+
+  /// Completes all pending requests with `reason`.
+  void fail_all(const caf::error& reason);
+
+  /// Fails all requests that passed their deadline and schedules the next
+  /// tick if requests remain.
+  void tick();
+
+  // --- member variables ------------------------------------------------------
+
+  /// Points to the owning actor.
+  caf::event_based_actor* self;
+
+  /// Handle to the master or clone.
+  caf::actor frontend;
+
+  /// Last used request ID.
+  request_id id = 0;
+
+  /// Callbacks for all requests that wait for a response.
+  std::unordered_map<request_id, callback> pending;
+
+  /// Deadlines of all requests in the order of their creation. May contain
+  /// requests that already received a response.
+  std::deque<std::pair<time_point, request_id>> deadlines;
+
+  /// Whether a tick message is on its way.
+  bool tick_scheduled = false;
+
+  /// Name shown in logs for all instances of this actor.
+  static const char* name;
+};
+
+using store_async_actor_type = caf::stateful_actor<store_async_state>;
+
+caf::behavior store_async_actor(store_async_actor_type* self,
+                                caf::actor frontend);
+
+} // namespace detail
+} // namespace broker
+
+CAF_ALLOW_UNSAFE_MESSAGE_TYPE(broker::detail::store_async_state::callback)
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <caf/actor.hpp>
+#include <caf/behavior.hpp>
+#include <caf/event_based_actor.hpp>
+
+#include "broker/data.hh"
+
+namespace broker {
+namespace detail {
+
+/// Returns the name of shard `index` of the store `name`. Each shard is a
+/// regular master (or clone) with its own update topic.
+std::string shard_name(const std::string& name, size_t index);
+
+/// Returns the index of the shard responsible for `key`. Relies on
+/// `stable_hash`, since all endpoints of a cluster as well as partitions on
+/// disk must agree on the placement of each key.
+size_t shard_of(const data& key, size_t num_shards);
+
+/// Acts as the frontend of a sharded store. Routes commands and lookups to
+/// the shard responsible for their key and merges the results of queries
+/// that span all shards (keys, scan, get_many). Accepts the same messages as
+/// masters and clones.
+caf::behavior store_router(caf::event_based_actor* self, std::string name,
+                           std::vector<caf::actor> shards);
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <caf/string_view.hpp>
+
+#include "broker/topic.hh"
+
+namespace broker {
+namespace detail {
+
+/// Queries in store workload recordings. A workload recording is a generator
+/// file with all commands a master received as command messages on the topic
+/// of the store and all queries as data messages on the topic
+/// `<store>/<query>`. The data of a query message is its key (`get`,
+/// `exists`), a vector with the key and the aspect (`get_index`), a vector
+/// of keys (`get_many`), the prefix (`scan`), or `nil` (`keys`). Like all
+/// generator files, recordings only capture the shape of keys and values.
+enum class store_query : uint8_t {
+  get,
+  get_index,
+  exists,
+  keys,
+  get_many,
+  scan,
+};
+
+/// @relates store_query
+const char* to_string(store_query x);
+
+/// @relates store_query
+bool convert(caf::string_view x, store_query& y);
+
+/// Returns the topic for recording `x` on store `name`.
+topic workload_topic(const std::string& name, store_query x);
+
+/// Extracts the query from a topic that `workload_topic` created.
+/// @returns `true` on success, `false` if `x` is not a query topic.
+bool convert(const topic& x, store_query& y);
+
+/// Returns the file name for recording the workload of store `name` in `dir`.
+/// Replaces separators in `name` to keep all recordings in `dir`.
+std::string workload_file_name(const std::string& dir,
+                               const std::string& name);
+
+} // namespace detail
+} // namespace broker
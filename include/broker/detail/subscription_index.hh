@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "broker/filter_type.hh"
+#include "broker/topic.hh"
+
+#include "broker/detail/radix_tree.hh"
+
+namespace broker {
+namespace detail {
+
+/// A compiled view on the filters of many subscribers. The index maps each
+/// subscribed topic prefix to the keys of all subscribers with that prefix in
+/// their filter, allowing us to answer "which subscribers receive topic `t`"
+/// with a single walk over the radix tree instead of comparing `t` to each
+/// prefix of each subscriber.
+/// @tparam Key Identifies a subscriber. Must be hashable and less-than
+///             comparable.
+template <class Key>
+class subscription_index {
+public:
+  // -- member types -----------------------------------------------------------
+
+  using key_type = Key;
+
+  /// A sorted list of subscriber keys without duplicates.
+  using key_list = std::vector<key_type>;
+
+  // -- constants --------------------------------------------------------------
+
+  /// Maximum number of memoized lookup results before we flush the cache.
+  static constexpr size_t max_cached_results = 1024;
+
+  // -- modifiers --------------------------------------------------------------
+
+  /// Replaces the filter of `key` with `filter`.
+  void update(const key_type& key, const filter_type& filter) {
+    erase(key);
+    auto& entry = filters_[key];
+    for (auto& prefix : filter) {
+      auto& str = prefix.string();
+      if (str.empty())
+        insert_sorted(wildcards_, key);
+      else
+        insert_sorted(tree_[str], key);
+    }
+    entry = filter;
+    cache_.clear();
+  }
+
+  /// Removes `key` and all of its subscriptions from the index.
+  void erase(const key_type& key) {
+    auto i = filters_.find(key);
+    if (i == filters_.end())
+      return;
+    for (auto& prefix : i->second) {
+      auto& str = prefix.string();
+      if (str.empty()) {
+        erase_sorted(wildcards_, key);
+        continue;
+      }
+      auto j = tree_.find(str);
+      if (j == tree_.end())
+        continue;
+      erase_sorted(j->second, key);
+      if (j->second.empty())
+        tree_.erase(str);
+    }
+    filters_.erase(i);
+    cache_.clear();
+  }
+
+  /// Removes all entries from the index.
+  void clear() {
+    tree_.clear();
+    filters_.clear();
+    wildcards_.clear();
+    cache_.clear();
+  }
+
+  // -- lookup -----------------------------------------------------------------
+
+  /// Returns all keys with at least one prefix in their filter that matches
+  /// `t`. Memoizes the result, i.e., subsequent lookups for the same topic
+  /// only cost a single hash lookup until the next modification.
+  const key_list& match(const topic& t) {
+    auto& str = t.string();
+    auto i = cache_.find(str);
+    if (i != cache_.end())
+      return i->second;
+    if (cache_.size() >= max_cached_results)
+      cache_.clear();
+    key_list result = wildcards_;
+    if (!str.empty() && !tree_.empty())
+      for (auto& entry : tree_.prefix_of(str))
+        for (auto& key : entry->second)
+          insert_sorted(result, key);
+    return cache_.emplace(str, std::move(result)).first->second;
+  }
+
+  /// Queries whether `key` subscribed to a prefix of `t`.
+  bool matches(const key_type& key, const topic& t) {
+    auto& xs = match(t);
+    return std::binary_search(xs.begin(), xs.end(), key);
+  }
+
+  // -- properties -------------------------------------------------------------
+
+  /// Returns the filter of `key` or `nullptr` if `key` is unknown.
+  const filter_type* filter(const key_type& key) const {
+    auto i = filters_.find(key);
+    return i != filters_.end() ? &i->second : nullptr;
+  }
+
+  /// Returns the number of subscribers in the index.
+  size_t size() const noexcept {
+    return filters_.size();
+  }
+
+  /// Returns whether the index contains no subscribers.
+  bool empty() const noexcept {
+    return filters_.empty();
+  }
+
+private:
+  static void insert_sorted(key_list& xs, const key_type& x) {
+    auto i = std::lower_bound(xs.begin(), xs.end(), x);
+    if (i == xs.end() || *i != x)
+      xs.insert(i, x);
+  }
+
+  static void erase_sorted(key_list& xs, const key_type& x) {
+    auto i = std::lower_bound(xs.begin(), xs.end(), x);
+    if (i != xs.end() && *i == x)
+      xs.erase(i);
+  }
+
+  /// Maps topic prefixes to subscribers.
+  radix_tree<key_list> tree_;
+
+  /// Subscribers with an empty prefix, i.e., subscribers to all topics.
+  key_list wildcards_;
+
+  /// Stores the current filter of each subscriber.
+  std::unordered_map<key_type, filter_type> filters_;
+
+  /// Memoizes results of `match`.
+  std::unordered_map<std::string, key_list> cache_;
+};
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+
+#include "broker/data.hh"
+
+namespace broker {
+namespace detail {
+
+/// Renders data in the text format of `to_string` by appending to a
+/// caller-provided buffer. Unlike nesting `to_string` calls, the writer
+/// creates no intermediate strings per element. Callers can reuse the same
+/// buffer (and writer) for many values to avoid heap allocations once the
+/// buffer has reached a sufficient capacity.
+class text_writer {
+public:
+  /// Appends `x` to `buf`.
+  void append(std::string& buf, const data& x);
+
+  /// Appends `xs` to `buf`, enclosed in parentheses.
+  void append(std::string& buf, const vector& xs);
+
+  /// Appends `xs` to `buf`, enclosed in braces.
+  void append(std::string& buf, const set& xs);
+
+  /// Appends `xs` to `buf` as `key -> value` pairs, enclosed in braces.
+  void append(std::string& buf, const table& xs);
+
+private:
+  // Receives the string representation of addresses and subnets.
+  std::string scratch_;
+};
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+#include <caf/fwd.hpp>
+#include <caf/thread_hook.hpp>
+
+namespace broker {
+namespace detail {
+
+/// Pins the calling thread to `cpu`. Returns `false` if the platform does not
+/// support pinning or the OS rejected the request.
+bool pin_current_thread(int cpu);
+
+/// Pins the calling thread to the set `cpus`. Returns `false` if the platform
+/// does not support pinning or the OS rejected the request.
+bool pin_current_thread(const std::vector<int>& cpus);
+
+/// Returns the CPUs of NUMA node `node` or an empty list if the platform has
+/// no such node or does not support NUMA.
+std::vector<int> numa_node_cpus(int node);
+
+/// Lets the kernel allocate memory for the calling thread on NUMA node `node`
+/// whenever possible. Returns `false` if the platform does not support NUMA or
+/// the OS rejected the request.
+bool prefer_numa_node(int node);
+
+/// Binds all threads of CAF (scheduler workers, the multiplexer of the
+/// middleman, and detached actors) to the NUMA node in `broker.numa-node`.
+/// Does nothing if the option is negative.
+class numa_hook : public caf::thread_hook {
+public:
+  void init(caf::actor_system& sys) override;
+
+  void thread_started() override;
+
+  void thread_terminates() override;
+
+private:
+  int node_ = -1;
+  std::vector<int> cpus_;
+};
+
+} // namespace detail
+} // namespace broker
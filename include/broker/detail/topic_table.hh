@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "broker/topic.hh"
+
+namespace broker {
+namespace detail {
+
+/// Interns topics by assigning a compact integer ID to each distinct topic.
+/// IDs are dense and assigned in order of first appearance, i.e., the first
+/// topic receives ID 0, the second topic receives ID 1, and so on.
+class topic_table {
+public:
+  // -- member types -----------------------------------------------------------
+
+  using id_type = uint32_t;
+
+  // -- constants --------------------------------------------------------------
+
+  /// Denotes an unknown topic.
+  static constexpr id_type invalid_id = std::numeric_limits<id_type>::max();
+
+  // -- modifiers --------------------------------------------------------------
+
+  /// Returns the ID for `x`, assigning a new ID if `x` is not in the table.
+  /// @param added Receives whether `x` was new to the table (optional).
+  id_type intern(const topic& x, bool* added = nullptr);
+
+  /// Removes all topics from the table.
+  void clear();
+
+  // -- lookup -----------------------------------------------------------------
+
+  /// Returns the ID for `x` or `invalid_id` if `x` is not in the table.
+  id_type find(const topic& x) const;
+
+  /// Returns the topic for `id`.
+  /// @pre `id < size()`
+  const topic& operator[](id_type id) const {
+    return topics_[id];
+  }
+
+  /// Returns whether `id` denotes a topic in the table.
+  bool contains(id_type id) const noexcept {
+    return id < topics_.size();
+  }
+
+  // -- properties -------------------------------------------------------------
+
+  /// Returns all topics, ordered by their ID.
+  const std::vector<topic>& topics() const noexcept {
+    return topics_;
+  }
+
+  size_t size() const noexcept {
+    return topics_.size();
+  }
+
+  bool empty() const noexcept {
+    return topics_.empty();
+  }
+
+private:
+  std::vector<topic> topics_;
+  std::unordered_map<std::string, id_type> ids_;
+};
+
+} // namespace detail
+} // namespace broker
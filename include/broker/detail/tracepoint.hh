@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "broker/config.hh"
+
+namespace broker {
+namespace detail {
+
+/// Identifies a static tracepoint on the hot path.
+enum class tracepoint : uint32_t {
+  /// A core received a batch from a peer. Arguments: batch size.
+  batch_received,
+  /// A core matched a batch from a peer against local subscribers. Arguments:
+  /// number of messages for local workers or stores, batch size.
+  batch_matched,
+  /// A core forwarded messages of a batch to other peers. Arguments: number
+  /// of forwarded messages, batch size.
+  batch_forwarded,
+  /// A subscriber received a batch for its queue. Arguments: batch size.
+  batch_delivered,
+  /// A store applied a command. Arguments: index of the command type in
+  /// `internal_command::variant_type`, 0 for masters and 1 for clones.
+  store_command_applied,
+};
+
+/// @relates tracepoint
+const char* to_string(tracepoint x);
+
+/// A fixed-size binary record of passing a tracepoint.
+struct trace_event {
+  /// Nanoseconds since the epoch of the steady clock.
+  uint64_t timestamp;
+  tracepoint id;
+  uint64_t arg0;
+  uint64_t arg1;
+};
+
+/// Capacity of the trace buffer. Once full, new events overwrite the oldest.
+constexpr size_t trace_buffer_size = 16384;
+
+/// Appends an event to the process-wide trace buffer. Safe to call from any
+/// number of threads. Prefer the `BROKER_TRACEPOINT` macro, which compiles to
+/// nothing unless building with tracepoints.
+void trace(tracepoint id, uint64_t arg0, uint64_t arg1) noexcept;
+
+/// Returns all completely written events in the trace buffer, oldest first.
+/// Skips events that concurrent writers modify while reading.
+std::vector<trace_event> trace_events();
+
+/// Drops all events from the trace buffer.
+/// @warning not safe to call while other threads append events.
+void clear_trace_events() noexcept;
+
+} // namespace detail
+} // namespace broker
+
+#ifdef BROKER_HAVE_TRACEPOINTS
+
+#ifdef BROKER_HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+// Also emits a USDT probe for attaching tools such as bpftrace, perf or
+// SystemTap to a running process.
+#define BROKER_TRACEPOINT(name, arg0, arg1)                                    \
+  do {                                                                         \
+    auto broker_tp_arg0 = static_cast<uint64_t>(arg0);                         \
+    auto broker_tp_arg1 = static_cast<uint64_t>(arg1);                         \
+    DTRACE_PROBE2(broker, name, broker_tp_arg0, broker_tp_arg1);               \
+    ::broker::detail::trace(::broker::detail::tracepoint::name,                \
+                            broker_tp_arg0, broker_tp_arg1);                   \
+  } while (false)
+
+#else // BROKER_HAVE_SYS_SDT_H
+
+#define BROKER_TRACEPOINT(name, arg0, arg1)                                    \
+  ::broker::detail::trace(::broker::detail::tracepoint::name,                  \
+                          static_cast<uint64_t>(arg0),                         \
+                          static_cast<uint64_t>(arg1))
+
+#endif // BROKER_HAVE_SYS_SDT_H
+
+#else // BROKER_HAVE_TRACEPOINTS
+
+// Does not evaluate its arguments but still counts as using them to avoid
+// warnings for variables that only exist for tracing.
+#define BROKER_TRACEPOINT(name, arg0, arg1)                                    \
+  static_cast<void>(sizeof(arg0) + sizeof(arg1))
+
+#endif // BROKER_HAVE_TRACEPOINTS
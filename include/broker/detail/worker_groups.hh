@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <caf/stream_slot.hpp>
+
+#include "broker/consumer_group.hh"
+#include "broker/message.hh"
+
+namespace broker {
+namespace detail {
+
+/// Tracks the consumer groups of local workers and picks one member per
+/// group for each message.
+///
+/// The downstream manager evaluates its selector once per path and message.
+/// Hence, the selection for a message must be the same for all members of
+/// its group. Round-robin groups remember their choices by the address of
+/// the shared message content until the next `reset`, which the core calls
+/// before pushing new messages into the workers.
+class worker_groups {
+public:
+  /// Adds `slot` to `group`.
+  void add(caf::stream_slot slot, const consumer_group& group);
+
+  /// Removes `slot` from its group, if any.
+  void erase(caf::stream_slot slot);
+
+  /// Drops the choices for delivered messages.
+  void reset();
+
+  bool empty() const noexcept {
+    return slots_.empty();
+  }
+
+  /// Checks whether `slot` receives `x`. Always returns `true` for slots
+  /// outside of any group. The predicate `eligible` tells whether another
+  /// member of the group accepts `x`.
+  template <class Predicate>
+  bool selects(caf::stream_slot slot, const data_message& x,
+               Predicate eligible) {
+    auto i = slots_.find(slot);
+    if (i == slots_.end())
+      return true;
+    auto& grp = groups_[i->second];
+    if (grp.members.size() < 2)
+      return true;
+    if (grp.policy == group_policy::round_robin) {
+      // All copies of a message share the same topic object.
+      auto key = static_cast<const void*>(&get_topic(x));
+      auto j = grp.choices.find(key);
+      if (j != grp.choices.end() && grp.has_member(j->second))
+        return j->second == slot;
+      auto choice = grp.next_eligible(eligible, slot);
+      grp.choices[key] = choice;
+      return choice == slot;
+    }
+    return grp.hashed_eligible(eligible, get_topic(x), slot) == slot;
+  }
+
+private:
+  struct group {
+    group_policy policy = group_policy::round_robin;
+
+    /// Stream slots of all members in the order they joined.
+    std::vector<caf::stream_slot> members;
+
+    /// Position for the next round-robin choice.
+    size_t next = 0;
+
+    /// Round-robin choices since the last reset.
+    std::unordered_map<const void*, caf::stream_slot> choices;
+
+    bool has_member(caf::stream_slot slot) const;
+
+    template <class Predicate>
+    caf::stream_slot next_eligible(Predicate& eligible,
+                                   caf::stream_slot fallback) {
+      for (size_t n = 0; n < members.size(); ++n) {
+        auto pos = (next + n) % members.size();
+        if (eligible(members[pos])) {
+          next = pos + 1;
+          return members[pos];
+        }
+      }
+      return fallback;
+    }
+
+    template <class Predicate>
+    caf::stream_slot hashed_eligible(Predicate& eligible, const topic& t,
+                                     caf::stream_slot fallback) {
+      std::vector<caf::stream_slot> xs;
+      for (auto member : members)
+        if (eligible(member))
+          xs.emplace_back(member);
+      if (xs.empty())
+        return fallback;
+      return xs[std::hash<std::string>{}(t.string()) % xs.size()];
+    }
+  };
+
+  /// Maps each member to the name of its group.
+  std::unordered_map<caf::stream_slot, std::string> slots_;
+
+  std::unordered_map<std::string, group> groups_;
+};
+
+} // namespace detail
+} // namespace broker
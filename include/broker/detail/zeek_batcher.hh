@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "broker/data.hh"
+#include "broker/message.hh"
+#include "broker/topic.hh"
+
+namespace broker {
+namespace detail {
+
+/// Packs Zeek events for the same topic into `zeek::Batch` messages.
+class zeek_batcher {
+public:
+  /// Creates a batcher that packs up to `max_size` events into a single
+  /// message. A `max_size` of 0 or 1 disables batching.
+  explicit zeek_batcher(size_t max_size = 0) : max_size_(max_size) {
+    // nop
+  }
+
+  /// Returns whether no event waits in a partial batch.
+  bool empty() const noexcept {
+    return batches_.empty();
+  }
+
+  /// Adds `x` to the partial batch for its topic if `x` is a Zeek event and
+  /// calls `f` with the batch once it is full. Calls `f` with any other
+  /// message right away, after flushing the partial batch for its topic to
+  /// preserve the ordering.
+  template <class F>
+  void add(data_message&& x, F&& f) {
+    if (max_size_ <= 1) {
+      f(std::move(x));
+      return;
+    }
+    auto i = find(get_topic(x));
+    if (!is_event(get_data(x))) {
+      if (i != batches_.end())
+        flush(i, f);
+      f(std::move(x));
+      return;
+    }
+    if (i == batches_.end()) {
+      batches_.emplace_back(get_topic(x), vector{});
+      i = std::prev(batches_.end());
+      i->second.reserve(max_size_);
+    }
+    i->second.emplace_back(move_data(x));
+    if (i->second.size() >= max_size_)
+      flush(i, f);
+  }
+
+  /// Calls `f` with all partial batches.
+  template <class F>
+  void flush(F&& f) {
+    for (auto& x : batches_)
+      f(make_batch(x));
+    batches_.clear();
+  }
+
+private:
+  using batch_list = std::vector<std::pair<topic, vector>>;
+
+  template <class F>
+  void flush(batch_list::iterator i, F& f) {
+    f(make_batch(*i));
+    batches_.erase(i);
+  }
+
+  batch_list::iterator find(const topic& t);
+
+  static bool is_event(const data& x);
+
+  /// Moves the events of `x` into a single message. Sends a single event
+  /// as-is.
+  static data_message make_batch(batch_list::value_type& x);
+
+  size_t max_size_;
+
+  /// Partial batches per topic. Publishers usually have very few topics.
+  batch_list batches_;
+};
+
+/// Replaces each `zeek::Batch` in `xs` with the messages it contains.
+void unbatch_zeek_messages(std::vector<data_message>& xs);
+
+} // namespace detail
+} // namespace broker
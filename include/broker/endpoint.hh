@@ -20,6 +20,8 @@
 #include "broker/backend.hh"
 #include "broker/backend_options.hh"
 #include "broker/configuration.hh"
+#include "broker/consumer_group.hh"
+#include "broker/data.hh"
 #include "broker/endpoint_info.hh"
 #include "broker/expected.hh"
 #include "broker/frontend.hh"
@@ -27,12 +29,18 @@
 #include "broker/message.hh"
 #include "broker/network_info.hh"
 #include "broker/peer_info.hh"
+#include "broker/predicate.hh"
+#include "broker/shared_system.hh"
 #include "broker/status.hh"
 #include "broker/status_subscriber.hh"
 #include "broker/store.hh"
 #include "broker/time.hh"
 #include "broker/topic.hh"
 
+#include "broker/detail/memory_accounting.hh"
+#include "broker/detail/shared_publisher_queue.hh"
+#include "broker/detail/shared_subscriber_queue.hh"
+
 namespace broker {
 
 /// The main publish/subscribe abstraction. Endpoints can *peer* which each
@@ -40,6 +48,11 @@ namespace broker {
 /// all peers with matching subscriptions receive the message.
 class endpoint {
 public:
+  // --- friends ---------------------------------------------------------------
+
+  friend class publisher;
+  friend class subscriber;
+
   // --- member types ----------------------------------------------------------
 
   using stream_type = caf::stream<data_message>;
@@ -56,9 +69,17 @@ public:
 
     using lock_type = std::unique_lock<mutex_type>;
 
-    using pending_msg_type = std::pair<caf::actor, caf::message>;
+    /// A message that waits for its timeout.
+    struct pending_msg_type {
+      timestamp due;
+      /// Preserves the order of messages with the same timeout.
+      uint64_t seq;
+      caf::actor dest;
+      caf::message msg;
+    };
 
-    using pending_msgs_map_type = std::multimap<timestamp, pending_msg_type>;
+    /// Binary min-heap of pending messages, ordered by `(due, seq)`.
+    using pending_msgs_heap_type = std::vector<pending_msg_type>;
 
     // --- construction and destruction ----------------------------------------
 
@@ -88,11 +109,14 @@ public:
     /// Nanoseconds since start of the epoch.
     std::atomic<timespan> time_since_epoch_;
 
-    /// Guards pending_.
+    /// Guards pending_ and next_seq_.
     mutex_type mtx_;
 
     /// Stores pending messages until they time out.
-    pending_msgs_map_type pending_;
+    pending_msgs_heap_type pending_;
+
+    /// Sequence number for the next pending message.
+    uint64_t next_seq_;
 
     /// Stores number of items in pending_.  We track it separately as
     /// a micro-optimization -- checking pending_.size() would require
@@ -105,6 +129,13 @@ public:
 
   endpoint(configuration config = {});
 
+  /// Creates an endpoint on a shared actor system instead of spawning
+  /// scheduler threads and an I/O multiplexer of its own.
+  /// @param config Provides the `broker_options` and the endpoint-level
+  ///               settings, e.g., `broker.publish-batch-size`.
+  /// @param sys Hosts the core and all other actors of the endpoint.
+  endpoint(configuration config, shared_system_ptr sys);
+
   endpoint(endpoint&&) = delete;
   endpoint(const endpoint&) = delete;
   endpoint& operator=(endpoint&&) = delete;
@@ -115,12 +146,23 @@ public:
 
   /// Shuts down all background activity and blocks until all local subscribers
   /// and publishers have terminated. *Must* be the very last function call on
-  /// this object before destroying it.
-  /// @warning *Destroys* the underlying actor system. Calling *any* member
-  ///          function afterwards except `shutdown` and the destructor is
-  ///          undefined behavior.
+  /// this object before destroying it. Uses `broker.shutdown.timeout` as
+  /// deadline for sending buffered messages to peers.
+  /// @warning *Destroys* the underlying actor system unless the endpoint runs
+  ///          on a shared system. Calling *any* member function afterwards
+  ///          except `shutdown` and the destructor is undefined behavior.
   void shutdown();
 
+  /// Shuts down all background activity like `shutdown()`, but lets the core
+  /// send buffered messages to peers for up to `timeout` first. Afterwards,
+  /// the core writes all remaining messages to `broker.shutdown.spill-file`
+  /// or drops them.
+  /// @returns the number of messages the core did not send to peers.
+  /// @warning *Destroys* the underlying actor system unless the endpoint runs
+  ///          on a shared system. Calling *any* member function afterwards
+  ///          except `shutdown` and the destructor is undefined behavior.
+  size_t shutdown(timespan timeout);
+
   /// @returns a unique node id for this endpoint.
   caf::node_id node_id() const;
 
@@ -180,6 +222,22 @@ public:
   /// Retrieves a list of topics that peers have subscribed to on this endpoint.
   std::vector<topic> peer_subscriptions() const;
 
+  // --- introspection ---------------------------------------------------------
+
+  /// Collects the current backpressure state of this endpoint for debugging
+  /// stalls. Queries the core and all data stores with high priority, i.e.,
+  /// without waiting for their regular mailbox to drain. The result is a
+  /// `table` with the following entries:
+  /// - `core`: mailbox size of the core actor plus queue depth, credit and
+  ///   unacknowledged batches per peer (`peers`), the buffered batches of
+  ///   blocked peers (`blocked-peers`) and the number of messages from peers
+  ///   dropped as duplicates (`duplicates`) plus the number of local messages
+  ///   that the core had to copy before delivering them (`unshares`).
+  /// - `data-stores`: the mailbox size and state of each master and clone.
+  /// - `subscribers`: buffered items and the topics of each subscriber.
+  /// - `publishers`: buffered items, capacity and demand of each publisher.
+  data stats() const;
+
   // --- publishing ------------------------------------------------------------
 
   /// Publishes a message.
@@ -187,7 +245,9 @@ public:
   /// @param d The message data.
   void publish(topic t, data d);
 
-  /// Publishes a message to a specific peer endpoint only.
+  /// Publishes a message to the subscribers of a specific endpoint only. The
+  /// message travels over the regular peer streams and reaches endpoints that
+  /// are no direct peers as long as the nodes in between forward messages.
   /// @param dst The destination endpoint.
   /// @param t The topic of the message.
   /// @param d The message data.
@@ -206,6 +266,10 @@ public:
 
   publisher make_publisher(topic ts);
 
+  /// Creates a publisher for `ts` that buffers up to `queue_size` items,
+  /// overriding `broker.publisher.queue-size`.
+  publisher make_publisher(topic ts, size_t queue_size);
+
   /// Starts a background worker from the given set of functions that publishes
   /// a series of messages. The worker will run in the background, but `init`
   /// is guaranteed to be called before the function returns.
@@ -253,11 +317,36 @@ public:
   // Forward remote events for given topics even if no local subscriber.
   void forward(std::vector<topic> ts);
 
+  // --- recording -------------------------------------------------------------
+
+  /// Changes which published messages the endpoint records while running
+  /// with a recording directory. The endpoint records every `rate`-th message
+  /// (1 records all, 0 none). Each rule in `rules` has the format
+  /// `<prefix>:<rate>` and overrides the rate for topics with that prefix.
+  /// Replaces the settings `broker.recording-sample-rate` and
+  /// `broker.recording-sample-rules`.
+  void sample_recording(size_t rate, std::vector<std::string> rules = {});
+
   // --- subscribing data ------------------------------------------------------
 
   /// Returns a subscriber connected to this endpoint for the topics `ts`.
   subscriber make_subscriber(std::vector<topic> ts, size_t max_qsize = 20u);
 
+  /// Returns a subscriber connected to this endpoint for the topics `ts` that
+  /// only receives messages satisfying `pred`. The core evaluates `pred`
+  /// before delivering a message, i.e., rejected messages never enter the
+  /// queue of the subscriber.
+  subscriber make_subscriber(std::vector<topic> ts, predicate pred,
+                             size_t max_qsize = 20u);
+
+  /// Returns a subscriber connected to this endpoint for the topics `ts` that
+  /// shares the messages on its topics with the other subscribers of `group`
+  /// on this endpoint. The core delivers each message to a single member of
+  /// the group, as selected by the policy of the group. An empty `pred`
+  /// accepts all messages.
+  subscriber make_subscriber(std::vector<topic> ts, consumer_group group,
+                             predicate pred = {}, size_t max_qsize = 20u);
+
   /// Starts a background worker from the given set of function that consumes
   /// incoming messages. The worker will run in the background, but `init` is
   /// guaranteed to be called before the function returns.
@@ -309,6 +398,16 @@ public:
   expected<store> attach_master(std::string name, backend type,
                                 backend_options opts=backend_options());
 
+  /// Attaches and/or creates a *standby* for the master of an existing data
+  /// store. The standby mirrors the master in its own backend and takes over
+  /// once the master goes down.
+  /// @param name The name of the master.
+  /// @param type The type of backend to use.
+  /// @param opts The options controlling backend construction.
+  /// @returns A handle to the frontend representing the standby or an error if
+  ///          this endpoint runs the master itself.
+  expected<store> attach_standby(std::string name, backend type,
+                                 backend_options opts=backend_options());
 
   /// Attaches and/or creates a *clone* data store to an existing master.
   /// @param name The name of the clone.
@@ -373,7 +472,7 @@ public:
   }
 
   caf::actor_system& system() {
-    return system_;
+    return *system_;
   }
 
   const caf::actor& core() const {
@@ -390,15 +489,81 @@ protected:
 private:
   caf::actor make_actor(actor_init_fun f);
 
+  /// Makes the queue of a subscriber visible to `stats`.
+  void register_queue(filter_type filter,
+                      detail::shared_subscriber_queue_ptr<> queue);
+
+  /// Makes the queue of a publisher visible to `stats`.
+  void register_queue(topic t, detail::shared_publisher_queue_ptr<> queue);
+
+  /// Replaces the filter of a registered subscriber queue.
+  void update_queue(const detail::shared_subscriber_queue_ptr<>& queue,
+                    filter_type filter);
+
+  /// Sends `x` to the core, either right away or as part of the next batch.
+  void publish_to_core(data_message x);
+
+  /// Sends all messages in `publish_buf_` to the core.
+  void flush_publish_buffer();
+
+  /// Sends all messages in `publish_buf_` to the core.
+  /// @pre `publish_mtx_` is locked
+  void flush_publish_buffer_locked();
+
   configuration config_;
+
+  /// Keeps a shared actor system alive while the endpoint runs on it.
+  shared_system_ptr shared_system_;
+
+  /// Hosts all actors of the endpoint unless it runs on a shared system.
   union {
-    mutable caf::actor_system system_;
+    mutable caf::actor_system own_system_;
   };
+
+  /// Points to either `own_system_` or the shared system.
+  caf::actor_system* system_;
+
   caf::actor core_;
   bool await_stores_on_shutdown_;
   std::vector<caf::actor> children_;
   bool destroyed_;
   clock* clock_;
+
+  /// Approximates the memory usage of this endpoint. Shared with the core and
+  /// all subscribers.
+  detail::memory_accounting_ptr memory_;
+
+  /// Guards `subscriber_queues_` and `publisher_queues_`.
+  mutable std::mutex queues_mtx_;
+
+  /// Number of messages per batch from `publish` to the core. Values below 2
+  /// disable batching.
+  size_t publish_batch_size_;
+
+  /// Maximum time that messages wait in `publish_buf_`.
+  timespan publish_batch_delay_;
+
+  /// Guards `publish_buf_`. Flushing sends the batch while holding the lock,
+  /// which keeps batches in order.
+  std::mutex publish_mtx_;
+
+  /// Collects messages from `publish` for the core.
+  std::vector<data_message> publish_buf_;
+
+  /// Flushes `publish_buf_` after `publish_batch_delay_`.
+  caf::actor publish_flusher_;
+
+  /// Queues of all subscribers for `stats`. Holding
+  /// the only reference to a queue marks a destroyed subscriber, which `stats`
+  /// then drops.
+  mutable std::vector<std::pair<filter_type,
+                                detail::shared_subscriber_queue_ptr<>>>
+    subscriber_queues_;
+
+  /// Queues of all publishers for `stats`, pruned just like
+  /// `subscriber_queues_`.
+  mutable std::vector<std::pair<topic, detail::shared_publisher_queue_ptr<>>>
+    publisher_queues_;
 };
 
 } // namespace broker
@@ -3,6 +3,7 @@
 #include <functional>
 #include <ostream>
 #include <string>
+#include <string_view>
 
 #include "broker/detail/operators.hh"
 
@@ -19,6 +20,11 @@ struct enum_value : detail::totally_ordered<enum_value> {
     // nop
   }
 
+  /// Returns a view on the name without copying it.
+  std::string_view name_view() const noexcept {
+    return name;
+  }
+
   std::string name;
 };
 
@@ -32,6 +38,27 @@ inline bool operator<(const enum_value& lhs, const enum_value& rhs) {
   return lhs.name < rhs.name;
 }
 
+/// Compares the name of `lhs` to `rhs` without constructing an enum_value.
+/// @relates enum_value
+inline bool operator==(const enum_value& lhs, std::string_view rhs) {
+  return lhs.name == rhs;
+}
+
+/// @relates enum_value
+inline bool operator==(std::string_view lhs, const enum_value& rhs) {
+  return rhs == lhs;
+}
+
+/// @relates enum_value
+inline bool operator!=(const enum_value& lhs, std::string_view rhs) {
+  return !(lhs == rhs);
+}
+
+/// @relates enum_value
+inline bool operator!=(std::string_view lhs, const enum_value& rhs) {
+  return !(rhs == lhs);
+}
+
 /// @relates enum_value
 template <class Inspector>
 typename Inspector::result_type inspect(Inspector& f, enum_value& e) {
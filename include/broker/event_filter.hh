@@ -0,0 +1,37 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "broker/data.hh"
+#include "broker/filter_type.hh"
+#include "broker/topic.hh"
+
+namespace broker {
+
+/// Restricts topics of a filter to the names of the Zeek events that the
+/// subscribers on these topics handle. Each key is a topic of the filter and
+/// maps to a sorted list of event names. Topics without an entry receive all
+/// messages. Cores announce this map to their peers, which then only send
+/// matching events instead of every message on the topic.
+using event_filter = std::map<topic, std::vector<std::string>>;
+
+/// Checks whether `x` on topic `t` passes `f`. Messages on topics without an
+/// entry always pass, as do packed payloads (see `pack`). Otherwise, `x` must
+/// be a Zeek event or a batch containing an event with one of the listed
+/// names.
+bool accepts(const event_filter& f, const topic& t, const data& x);
+
+/// Updates `f` for adding subscribers to the topics `xs` before merging them
+/// into the filter `g`.
+/// Subscribers only handle the events in `names` or all messages if `names` is
+/// empty. Keeps an entry for a topic of `g` only as long as all subscribers it
+/// covers restrict their events.
+/// @pre `g`, `xs` and `names` are normalized
+/// @returns whether `f` changed
+bool add_subscribers(event_filter& f, const filter_type& g,
+                     const filter_type& xs,
+                     const std::vector<std::string>& names);
+
+} // namespace broker
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 
 #include "broker/topic.hh"
@@ -8,4 +9,20 @@ namespace broker {
 
 using filter_type = std::vector<topic>;
 
+/// Brings `f` into its canonical form: sorts all topics, removes duplicates
+/// and drops each topic that a shorter topic in `f` is a prefix of. A topic
+/// matches the result if and only if it matches the original filter. Topics
+/// of data store masters always remain in the filter, because cores check
+/// for them explicitly to detect existing masters.
+void normalize(filter_type& f);
+
+/// Computes a hash of `f` that is stable across processes. Peers compare
+/// digests to find out whether they agree on a filter.
+/// @pre `f` is normalized
+uint64_t digest(const filter_type& f);
+
+/// Checks whether any topic in `f` is a prefix of `x`.
+/// @pre `f` is normalized
+bool covers(const filter_type& f, const topic& x);
+
 } // namespace broker
@@ -21,8 +21,10 @@ struct endpoint_info;
 struct network_info;
 struct peer_info;
 
+class change_subscriber;
 class publisher;
 class subscriber;
+class subscriber_channel;
 class topic;
 
 class data;
@@ -32,10 +34,14 @@ class store;
 
 class internal_command;
 
+struct add_and_get_command;
 struct add_command;
 struct clear_command;
+struct compare_and_swap_command;
 struct erase_command;
+struct erase_many_command;
 struct put_command;
+struct put_many_command;
 struct put_unique_command;
 struct set_command;
 struct snapshot_command;
@@ -73,6 +79,7 @@ namespace detail {
 
 class flare_actor;
 class mailbox;
+class shared_snapshot;
 
 } // namespace detail
 
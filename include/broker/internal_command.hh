@@ -2,6 +2,7 @@
 
 #include <utility>
 #include <unordered_map>
+#include <vector>
 
 #include <caf/actor.hpp>
 #include <caf/variant.hpp>
@@ -119,6 +120,61 @@ typename Inspector::result_type inspect(Inspector& f, clear_command&) {
   return f(caf::meta::type_name("clear"));
 }
 
+/// Sets multiple values in the key-value store at once.
+struct put_many_command {
+  std::unordered_map<data, data> entries;
+  caf::optional<timespan> expiry;
+};
+
+template <class Inspector>
+typename Inspector::result_type inspect(Inspector& f, put_many_command& x) {
+  return f(caf::meta::type_name("put_many"), x.entries, x.expiry);
+}
+
+/// Removes multiple values from the key-value store at once.
+struct erase_many_command {
+  std::vector<data> keys;
+};
+
+template <class Inspector>
+typename Inspector::result_type inspect(Inspector& f, erase_many_command& x) {
+  return f(caf::meta::type_name("erase_many"), x.keys);
+}
+
+/// Replaces a value in the key-value store if it equals an expected value.
+/// An expected value of `nil` only matches a missing key.
+struct compare_and_swap_command {
+  data key;
+  data expected_value;
+  data value;
+  caf::optional<timespan> expiry;
+  caf::actor who;
+  request_id req_id;
+};
+
+template <class Inspector>
+typename Inspector::result_type
+inspect(Inspector& f, compare_and_swap_command& x) {
+  return f(caf::meta::type_name("compare_and_swap"), x.key, x.expected_value,
+           x.value, x.expiry, x.who, x.req_id);
+}
+
+/// Adds a value to the existing value and responds with the result.
+struct add_and_get_command {
+  data key;
+  data value;
+  data::type init_type;
+  caf::optional<timespan> expiry;
+  caf::actor who;
+  request_id req_id;
+};
+
+template <class Inspector>
+typename Inspector::result_type inspect(Inspector& f, add_and_get_command& x) {
+  return f(caf::meta::type_name("add_and_get"), x.key, x.value, x.init_type,
+           x.expiry, x.who, x.req_id);
+}
+
 class internal_command {
 public:
   enum class type : uint8_t {
@@ -132,15 +188,26 @@ public:
     snapshot_sync_command,
     set_command,
     clear_command,
+    put_many_command,
+    erase_many_command,
+    compare_and_swap_command,
+    add_and_get_command,
   };
 
   using variant_type
     = caf::variant<none, put_command, put_unique_command, erase_command,
                    add_command, subtract_command, snapshot_command,
-                   snapshot_sync_command, set_command, clear_command>;
+                   snapshot_sync_command, set_command, clear_command,
+                   put_many_command, erase_many_command,
+                   compare_and_swap_command, add_and_get_command>;
 
   variant_type content;
 
+  /// Sequence number assigned by the master when broadcasting the command to
+  /// its clones. Allows clones to detect duplicates and to resume from the
+  /// last command they have seen. A value of 0 denotes an unsequenced command.
+  uint64_t seq = 0;
+
   internal_command(variant_type value);
 
   internal_command() = default;
@@ -157,7 +224,7 @@ internal_command make_internal_command(Ts&&... xs) {
 
 template <class Inspector>
 typename Inspector::result_type inspect(Inspector& f, internal_command& x) {
-  return f(caf::meta::type_name("internal_command"), x.content);
+  return f(caf::meta::type_name("internal_command"), x.content, x.seq);
 }
 
 namespace detail {
@@ -184,6 +251,10 @@ INTERNAL_COMMAND_TAG_ORACLE(snapshot_command);
 INTERNAL_COMMAND_TAG_ORACLE(snapshot_sync_command);
 INTERNAL_COMMAND_TAG_ORACLE(set_command);
 INTERNAL_COMMAND_TAG_ORACLE(clear_command);
+INTERNAL_COMMAND_TAG_ORACLE(put_many_command);
+INTERNAL_COMMAND_TAG_ORACLE(erase_many_command);
+INTERNAL_COMMAND_TAG_ORACLE(compare_and_swap_command);
+INTERNAL_COMMAND_TAG_ORACLE(add_and_get_command);
 
 #undef INTERNAL_COMMAND_TAG_ORACLE
 
@@ -1,21 +1,53 @@
 #pragma once
 
+#include <caf/config.hpp>
 #include <caf/logger.hpp>
 
+#include "broker/config.hh"
+
+// CAF only formats the arguments of a log statement if the logger accepts its
+// level at runtime. Configuring Broker with BROKER_MAX_LOG_LEVEL additionally
+// removes all statements above that level at compile time.
+#ifdef BROKER_MAX_LOG_LEVEL
+#define BROKER_LOG_LEVEL_ENABLED(level) (BROKER_MAX_LOG_LEVEL >= level)
+#else
+#define BROKER_LOG_LEVEL_ENABLED(level) 1
+#endif
+
 #define BROKER_LOG(level, ...) CAF_LOG_IMPL("broker", level, __VA_ARGS__)
 
+#if BROKER_LOG_LEVEL_ENABLED(CAF_LOG_LEVEL_TRACE)
 #define BROKER_TRACE(...)                                                      \
   BROKER_LOG(CAF_LOG_LEVEL_TRACE, "ENTRY" << __VA_ARGS__);                     \
   auto CAF_UNIFYN(broker_log_trace_guard_) = ::caf::detail::make_scope_guard(  \
     [=] { BROKER_LOG(CAF_LOG_LEVEL_TRACE, "EXIT"); })
+#else
+#define BROKER_TRACE(...) CAF_VOID_STMT
+#endif
 
+#if BROKER_LOG_LEVEL_ENABLED(CAF_LOG_LEVEL_DEBUG)
 #define BROKER_DEBUG(...) BROKER_LOG(CAF_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define BROKER_DEBUG(...) CAF_VOID_STMT
+#endif
 
+#if BROKER_LOG_LEVEL_ENABLED(CAF_LOG_LEVEL_INFO)
 #define BROKER_INFO(...) BROKER_LOG(CAF_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define BROKER_INFO(...) CAF_VOID_STMT
+#endif
 
+#if BROKER_LOG_LEVEL_ENABLED(CAF_LOG_LEVEL_WARNING)
 #define BROKER_WARNING(...) BROKER_LOG(CAF_LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define BROKER_WARNING(...) CAF_VOID_STMT
+#endif
 
+#if BROKER_LOG_LEVEL_ENABLED(CAF_LOG_LEVEL_ERROR)
 #define BROKER_ERROR(...) BROKER_LOG(CAF_LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define BROKER_ERROR(...) CAF_VOID_STMT
+#endif
 
 #define BROKER_ARG CAF_ARG
 
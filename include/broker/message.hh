@@ -3,6 +3,7 @@
 #include <cstdint>
 
 #include <caf/cow_tuple.hpp>
+#include <caf/node_id.hpp>
 #include <caf/variant.hpp>
 
 #include "broker/data.hh"
@@ -28,6 +29,19 @@ struct node_message {
 
   /// Time-to-life counter.
   uint16_t ttl;
+
+  /// Identifies the node that published the message. Combined with `seq`, it
+  /// allows cores to drop copies that arrive over more than one path. 0 means
+  /// the message carries no ID.
+  uint64_t origin = 0;
+
+  /// Sequence number of the message at its origin.
+  uint32_t seq = 0;
+
+  /// Restricts delivery to subscribers at this node. Peers forward such
+  /// messages regardless of their filter until reaching the receiver.
+  /// Default-constructed for messages to all subscribers.
+  caf::node_id receiver;
 };
 
 /// Returns whether `x` contains a ::node_message.
@@ -53,7 +67,7 @@ inline bool is_command_message(const node_message& x) {
 /// @relates node_message
 template <class Inspector>
 typename Inspector::result_type inspect(Inspector& f, node_message& x) {
-  return f(x.content, x.ttl);
+  return f(x.content, x.ttl, x.origin, x.seq, x.receiver);
 }
 
 /// Generates a broker ::data_message.
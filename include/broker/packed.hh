@@ -0,0 +1,25 @@
+#pragma once
+
+#include "broker/data.hh"
+#include "broker/expected.hh"
+#include "broker/packed_data.hh"
+
+namespace broker {
+
+/// Encodes `x` once into an opaque ::packed_data value. Packed data travels
+/// through the network as a single byte sequence, i.e., relays forward it
+/// without decoding and re-encoding the original ::data tree at each hop. Only
+/// subscribers that call `unpack` on the received value pay for decoding it.
+data pack(const data& x);
+
+/// Returns whether `x` holds a value previously created by `pack`.
+inline bool is_packed(const data& x) {
+  return caf::holds_alternative<packed_data>(x);
+}
+
+/// Decodes a value previously created by `pack`.
+/// @returns the decoded value or `ec::invalid_data` if `x` is not a valid
+///          packed value.
+expected<data> unpack(const data& x);
+
+} // namespace broker
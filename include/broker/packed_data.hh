@@ -0,0 +1,71 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "broker/detail/operators.hh"
+
+namespace broker {
+
+/// Stores a ::data value in the compact encoding of ::detail::data_codec.
+/// Only `pack` creates meaningful values of this type. Since packed data is a
+/// type of its own, user values (e.g., strings) never appear as packed data by
+/// accident.
+struct packed_data : detail::totally_ordered<packed_data> {
+  using buffer_type = std::vector<char>;
+
+  packed_data() = default;
+
+  explicit packed_data(buffer_type bytes) : bytes(std::move(bytes)) {
+    // nop
+  }
+
+  /// Returns a view on the encoded bytes.
+  std::string_view bytes_view() const noexcept {
+    return {bytes.data(), bytes.size()};
+  }
+
+  buffer_type bytes;
+};
+
+/// @relates packed_data
+inline bool operator==(const packed_data& lhs, const packed_data& rhs) {
+  return lhs.bytes == rhs.bytes;
+}
+
+/// @relates packed_data
+inline bool operator<(const packed_data& lhs, const packed_data& rhs) {
+  return lhs.bytes < rhs.bytes;
+}
+
+/// @relates packed_data
+template <class Inspector>
+typename Inspector::result_type inspect(Inspector& f, packed_data& x) {
+  return f(x.bytes);
+}
+
+/// Renders the size of the encoded value only, since rendering the value
+/// itself would require decoding it.
+/// @relates packed_data
+inline bool convert(const packed_data& x, std::string& str) {
+  str = "packed(";
+  str += std::to_string(x.bytes.size());
+  str += " bytes)";
+  return true;
+}
+
+} // namespace broker
+
+namespace std {
+
+template <>
+struct hash<broker::packed_data> {
+  size_t operator()(const broker::packed_data& x) const {
+    return std::hash<std::string_view>{}(x.bytes_view());
+  }
+};
+
+} // namespace std
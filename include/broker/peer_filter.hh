@@ -1,12 +1,19 @@
 #pragma once
 
+#include <cstddef>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include <caf/actor_addr.hpp>
+#include <caf/node_id.hpp>
 
+#include "broker/event_filter.hh"
+#include "broker/message.hh"
 #include "broker/topic.hh"
+#include "broker/topic_summary.hh"
 #include "broker/detail/prefix_matcher.hh"
+#include "broker/detail/subscription_index.hh"
 
 namespace broker {
 
@@ -15,10 +22,63 @@ using peer_filter = std::pair<caf::actor_addr, std::vector<topic>>;
 /// Allows a stream to dynamically filter on the sender of a message.
 struct peer_filter_matcher {
   caf::actor_addr active_sender;
+
+  /// Optional index over the filters of all peers. When set, the matcher
+  /// queries the index instead of scanning `f.second` linearly.
+  detail::subscription_index<caf::actor_addr>* index = nullptr;
+
+  /// Multiset of the nodes of all peers. When set, the matcher sends
+  /// messages for a specific receiver only to that receiver if it is a peer
+  /// and to all peers otherwise.
+  const std::unordered_map<caf::node_id, size_t>* peer_nodes = nullptr;
+
+  /// Event filters of all peers that announced one. When set, the matcher
+  /// only sends Zeek events to a peer if it handles them.
+  const std::unordered_map<caf::actor_addr, event_filter>* events = nullptr;
+
+  /// Summaries of all peers that replaced their filter with one. When set,
+  /// the matcher consults the summary of such peers instead of their filter.
+  const std::unordered_map<caf::actor_addr, topic_summary>* summaries
+    = nullptr;
+
+  bool operator()(const peer_filter& f, const node_message& x) const {
+    if (x.receiver == caf::none)
+      return (*this)(f, x.content);
+    if (f.first == active_sender)
+      return false;
+    if (f.first.node() == x.receiver)
+      return true;
+    return peer_nodes == nullptr || peer_nodes->count(x.receiver) == 0;
+  }
+
+  bool operator()(const peer_filter& f,
+                  const node_message::value_type& x) const {
+    if (f.first == active_sender || !matches_topic(f, get_topic(x)))
+      return false;
+    if (events == nullptr || !is_data_message(x))
+      return true;
+    auto i = events->find(f.first);
+    if (i == events->end())
+      return true;
+    auto& msg = caf::get<data_message>(x);
+    return accepts(i->second, get_topic(msg), get_data(msg));
+  }
+
   template <class T>
   bool operator()(const peer_filter& f, const T& x) const {
+    return f.first != active_sender && matches_topic(f, get_topic(x));
+  }
+
+  bool matches_topic(const peer_filter& f, const topic& x) const {
+    if (summaries != nullptr) {
+      auto i = summaries->find(f.first);
+      if (i != summaries->end())
+        return i->second.covers(x);
+    }
+    if (index != nullptr)
+      return index->matches(f.first, x);
     detail::prefix_matcher g;
-    return f.first != active_sender && g(f.second, x);
+    return g(f.second, x);
   }
 };
 
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "broker/data.hh"
+
+namespace broker {
+
+/// Requires the element at `path` to equal `value`. Each index in `path`
+/// selects an element of a (nested) vector, starting at the message content.
+/// For example, the path `{2, 1, 0}` selects the first argument of a Zeek
+/// event.
+struct field_condition {
+  std::vector<count> path;
+  data value;
+};
+
+/// Returns the element at `path` in `x` or `nullptr` if `x` has no such
+/// element. Uses the same paths as `field_condition`.
+const data* get_field(const data& x, const std::vector<count>& path);
+
+/// @relates field_condition
+bool operator==(const field_condition& x, const field_condition& y);
+
+/// @relates field_condition
+template <class Inspector>
+typename Inspector::result_type inspect(Inspector& f, field_condition& x) {
+  return f(x.path, x.value);
+}
+
+/// A condition on the content of data messages that a subscriber registers at
+/// its core. The core evaluates the predicate before delivering a message to
+/// the subscriber, i.e., messages that fail the predicate never enter the
+/// queue of the subscriber. A default-constructed predicate accepts all
+/// messages.
+struct predicate {
+  /// Accepts only Zeek events with one of these names if not empty. A Zeek
+  /// batch passes if any of its events does.
+  std::vector<std::string> event_names;
+
+  /// Accepts only messages that satisfy all conditions.
+  std::vector<field_condition> fields;
+
+  bool empty() const noexcept {
+    return event_names.empty() && fields.empty();
+  }
+};
+
+/// @relates predicate
+bool operator==(const predicate& x, const predicate& y);
+
+/// @relates predicate
+template <class Inspector>
+typename Inspector::result_type inspect(Inspector& f, predicate& x) {
+  return f(x.event_names, x.fields);
+}
+
+/// Sorts the event names of `x` and removes duplicates.
+/// @relates predicate
+void normalize(predicate& x);
+
+/// Checks whether `x` is a Zeek event with one of the `names` or a Zeek batch
+/// containing such an event.
+/// @pre `names` is sorted
+bool has_event_name(const std::vector<std::string>& names, const data& x);
+
+/// Checks whether `x` satisfies `pred`. Packed payloads (see `pack`) always
+/// pass, because evaluating the predicate would require decoding them.
+/// @pre `pred` is normalized
+/// @relates predicate
+bool matches(const predicate& pred, const data& x);
+
+} // namespace broker
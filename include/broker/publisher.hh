@@ -52,6 +52,10 @@ public:
   /// Returns the capacity of the output queue.
   size_t capacity() const;
 
+  /// Returns the approximate payload size of the output queue in bytes if
+  /// `broker.publisher.queue-bytes` limits it, 0 otherwise.
+  size_t buffered_bytes() const;
+
   /// Returns the free capacity of the output queue, i.e., how many items can
   /// be enqueued before it starts blocking. The free capacity is calculated as
   /// `capacity - buffered`.
@@ -66,7 +70,8 @@ public:
   }
 
   /// Returns a file handle for integrating this publisher into a `select` or
-  /// `poll` loop.
+  /// `poll` loop. The handle is readable while the queue has free capacity,
+  /// i.e., while `try_publish` accepts items.
   auto fd() const {
     return queue_->fd();
   }
@@ -82,13 +87,37 @@ public:
   /// Sends `x` to all subscribers.
   void publish(data x);
 
-  /// Sends `xs` to all subscribers.
+  /// Sends `xs` to all subscribers. Blocks only while the queue is full and
+  /// then hands `xs` to the worker as a whole, i.e., the queue may exceed its
+  /// capacity by up to `xs.size()` items.
   void publish(std::vector<data> xs);
 
+  /// Sends `x` to all subscribers of `t`. Allows a single publisher to
+  /// serve any number of topics through one queue and one stream.
+  void publish(topic t, data x);
+
+  /// Sends each message in `xs` to all subscribers of its topic.
+  void publish(std::vector<data_message> xs);
+
+  /// Sends `x` to all subscribers unless the queue is full. Never blocks.
+  /// @returns `true` if the publisher accepted `x`, `false` otherwise.
+  bool try_publish(data x);
+
+  /// Sends as many items from `xs` to all subscribers as fit into the queue.
+  /// Never blocks.
+  /// @returns the number of accepted items, i.e., the length of the prefix of
+  ///          `xs` that the publisher moved into its queue.
+  size_t try_publish(std::vector<data>& xs);
+
 private:
   // -- force users to use `endpoint::make_publsiher` -------------------------
   publisher(endpoint& ep, topic t);
 
+  publisher(endpoint& ep, topic t, size_t queue_size);
+
+  /// Wakes up the background worker unless a wakeup is already pending.
+  void wakeup();
+
   bool drop_on_destruction_;
   detail::shared_publisher_queue_ptr<> queue_;
   caf::actor worker_;
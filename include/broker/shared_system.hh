@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+
+#include <caf/actor_system.hpp>
+
+#include "broker/configuration.hh"
+
+namespace broker {
+
+/// An actor system that hosts multiple endpoints in one process. Endpoints on
+/// a shared system still run their own core, filters, and stores, but share
+/// the scheduler threads and the I/O multiplexer. Hence, the per-endpoint
+/// overhead grows with traffic rather than with the number of threads.
+///
+/// Actors read their settings (e.g., `broker.store.*`,
+/// `broker.peer-compression`, or `broker.metrics.*`) from the configuration
+/// of the shared system. The configuration of each endpoint only provides its
+/// `broker_options` and the settings of the endpoint itself, e.g.,
+/// `broker.publish-batch-size`.
+/// @note Endpoints on a shared system have the same node ID. Hence, they
+///       cannot attach clones to masters of each other, and recording
+///       (`broker.recording-directory`) requires an endpoint with an actor
+///       system of its own.
+class shared_system {
+public:
+  explicit shared_system(configuration config);
+
+  shared_system(const shared_system&) = delete;
+
+  shared_system& operator=(const shared_system&) = delete;
+
+  caf::actor_system& system() {
+    return system_;
+  }
+
+  const configuration& config() const {
+    return config_;
+  }
+
+private:
+  configuration config_;
+  caf::actor_system system_;
+};
+
+/// @relates shared_system
+using shared_system_ptr = std::shared_ptr<shared_system>;
+
+/// Creates an actor system for passing to multiple endpoints. The system
+/// shuts down after the last endpoint on it did and the last handle is gone.
+/// @relates shared_system
+shared_system_ptr make_shared_system(configuration config = {});
+
+} // namespace broker
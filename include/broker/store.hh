@@ -1,6 +1,10 @@
 #pragma once
 
+#include <functional>
+#include <future>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <caf/actor.hpp>
@@ -12,6 +16,7 @@
 
 #include "broker/api_flags.hh"
 #include "broker/atoms.hh"
+#include "broker/change_subscriber.hh"
 #include "broker/data.hh"
 #include "broker/fwd.hh"
 #include "broker/mailbox.hh"
@@ -34,6 +39,10 @@ public:
 
   using stream_type = caf::stream<command_message>;
 
+  /// Completion handler for asynchronous queries. Runs in the context of the
+  /// store's helper actor and thus must neither block nor throw.
+  using callback = std::function<void(expected<data>)>;
+
   /// A response to a lookup request issued by a ::proxy.
   struct response {
     expected<data> answer;
@@ -69,6 +78,25 @@ public:
     request_id put_unique(data key, data value,
                           optional<timespan> expiry = {});
 
+    /// Replaces a value if it equals an expected value.
+    /// @param key The key of the key-value pair.
+    /// @param expected_value The current value or `nil` for a missing key.
+    /// @param value The new value.
+    /// @param expiry An optional expiration time for *key*.
+    /// @returns A unique identifier for this request to correlate it with a
+    /// response.
+    request_id compare_and_swap(data key, data expected_value, data value,
+                                optional<timespan> expiry = {});
+
+    /// Increments a value by a given amount and retrieves the result.
+    /// @param key The key of the value to increment.
+    /// @param amount The amount to increment the value.
+    /// @param expiry An optional new expiration time for *key*.
+    /// @returns A unique identifier for this request to correlate it with a
+    /// response.
+    request_id increment_and_get(data key, data amount,
+                                 optional<timespan> expiry = {});
+
     /// For containers values, retrieves a specific index from the value. This
     /// is supported for sets, tables, and vectors.
     /// @param key The key of the container value to retrieve from.
@@ -93,6 +121,11 @@ public:
     /// @returns The next N responses in the proxy's mailbox.
     std::vector<response> receive(size_t n);
 
+    /// Consumes all responses that are ready without blocking. Clears `xs`
+    /// before adding responses to allow callers to reuse its memory.
+    /// @returns The number of consumed responses.
+    size_t receive_all(std::vector<response>& xs);
+
   private:
     request_id id_ = 0;
     caf::actor frontend_;
@@ -125,6 +158,28 @@ public:
   expected<data> put_unique(data key, data value,
                             optional<timespan> expiry = {}) const;
 
+  /// Replaces a value if it equals an expected value. The master compares
+  /// and replaces the value in one step, i.e., no other write can happen in
+  /// between.
+  /// @param key The key of the key-value pair.
+  /// @param expected_value The current value or `nil` for a missing key.
+  /// @param value The new value.
+  /// @param expiry An optional expiration time for *key*.
+  /// @returns A true data value if replaced or false if the current value
+  ///          differs from *expected_value*.
+  expected<data> compare_and_swap(data key, data expected_value, data value,
+                                  optional<timespan> expiry = {}) const;
+
+  /// Increments a value by a given amount and retrieves the result in a
+  /// single round trip to the master. This is supported for the same types
+  /// as `increment`.
+  /// @param key The key of the value to increment.
+  /// @param amount The amount to increment the value.
+  /// @param expiry An optional new expiration time for *key*.
+  /// @returns The incremented value.
+  expected<data> increment_and_get(data key, data amount,
+                                   optional<timespan> expiry = {}) const;
+
   /// For containers values, retrieves a specific index from the value. This
   /// is supported for sets, tables, and vectors.
   /// @param key The key of the value to retrieve the index from.
@@ -137,6 +192,70 @@ public:
   /// Retrieves a copy of the store's current keys, returned as a set.
   expected<data> keys() const;
 
+  /// Retrieves multiple values with a single request.
+  /// @param keys The keys of the values to retrieve.
+  /// @returns A table with an entry for each key that exists in the store.
+  expected<data> get_many(vector keys) const;
+
+  /// Retrieves all entries with a string key that starts with *prefix*.
+  /// @param prefix The key prefix to match.
+  /// @param limit The maximum number of entries to return, or 0 for no limit.
+  /// @returns A table with the matching entries. If there are more than
+  ///          *limit* matches, it is unspecified which ones get returned.
+  expected<data> scan(std::string prefix, size_t limit = 0) const;
+
+  /// Retrieves for how long a clone has been resynchronizing with its master.
+  /// Queries during this time reflect an outdated state of the store.
+  /// @returns The time since the clone lost its sync or 0 if the store is up
+  ///          to date. Masters always return 0.
+  expected<timespan> staleness() const;
+
+  /// Subscribes to all modifications of keys that start with *prefix* from
+  /// now on. An empty prefix selects all keys, otherwise only string keys
+  /// match. Clones forward the subscription to their master, i.e., the
+  /// subscriber receives changes from the master in either case.
+  /// @pre the store is initialized
+  change_subscriber subscribe_changes(std::string prefix = {}) const;
+
+  // --- asynchronous inspectors ----------------------------------------------
+
+  /// Checks whether a key exists in the store without blocking the caller.
+  /// @param key The key to check.
+  /// @param f Receives a boolean that's true if the key exists or an error.
+  void exists_async(data key, callback f) const;
+
+  /// Checks whether a key exists in the store without blocking the caller.
+  /// @returns A future for a boolean that's true if the key exists.
+  std::future<expected<data>> exists_async(data key) const;
+
+  /// Retrieves a value without blocking the caller.
+  /// @param key The key of the value to retrieve.
+  /// @param f Receives the value under *key* or an error.
+  void get_async(data key, callback f) const;
+
+  /// Retrieves a value without blocking the caller.
+  /// @returns A future for the value under *key*.
+  std::future<expected<data>> get_async(data key) const;
+
+  /// Retrieves a specific index from a container value without blocking the
+  /// caller. See ::get_index_from_value for the semantics.
+  /// @param f Receives the result or an error.
+  void get_index_from_value_async(data key, data index, callback f) const;
+
+  /// Retrieves a specific index from a container value without blocking the
+  /// caller. See ::get_index_from_value for the semantics.
+  /// @returns A future for the result.
+  std::future<expected<data>> get_index_from_value_async(data key,
+                                                         data index) const;
+
+  /// Retrieves a copy of the store's current keys without blocking the caller.
+  /// @param f Receives the keys as a set or an error.
+  void keys_async(callback f) const;
+
+  /// Retrieves a copy of the store's current keys without blocking the caller.
+  /// @returns A future for the keys as a set.
+  std::future<expected<data>> keys_async() const;
+
   /// Retrieves the frontend.
   inline const caf::actor& frontend() const {
     return frontend_;
@@ -150,10 +269,21 @@ public:
   /// @param expiry An optional expiration time for *key*.
   void put(data key, data value, optional<timespan> expiry = {}) const;
 
+  /// Inserts or updates multiple values at once. Masters apply all entries
+  /// in a single backend transaction and forward a single command to clones.
+  /// @param entries The key-value pairs to insert or update.
+  /// @param expiry An optional expiration time for all keys.
+  void put_many(std::unordered_map<data, data> entries,
+                optional<timespan> expiry = {}) const;
+
   /// Removes the value associated with a given key.
   /// @param key The key to remove from the store.
   void erase(data key) const;
 
+  /// Removes the values associated with multiple keys at once.
+  /// @param keys The keys to remove from the store.
+  void erase_many(std::vector<data> keys) const;
+
   /// Empties out the store.
   void clear() const;
 
@@ -163,25 +293,7 @@ public:
   /// @param value The amount to increment the value.
   /// @param expiry An optional new expiration time for *key*.
   void increment(data key, data amount, optional<timespan> expiry = {}) const {
-    auto init_type = data::type::none;
-
-    switch ( amount.get_type() ) {
-      case data::type::count:
-        init_type = data::type::count;
-        break;
-      case data::type::integer:
-        init_type = data::type::integer;
-        break;
-      case data::type::real:
-        init_type = data::type::real;
-        break;
-      case data::type::timespan:
-        init_type = data::type::timestamp;
-        break;
-      default:
-        break;
-    }
-
+    auto init_type = increment_init_type(amount);
     add(key, amount, init_type, expiry);
   }
 
@@ -245,6 +357,10 @@ public:
 private:
   store(caf::actor actor, std::string name);
 
+  /// Returns the type of data to initialize when incrementing a missing key
+  /// by *amount*.
+  static data::type increment_init_type(const data& amount);
+
   /// Adds a value to another one, with a type-specific meaning of
   /// "add". This is the backend for a number of the modifiers methods.
   /// @param key The key of the key-value pair.
@@ -278,8 +394,20 @@ private:
     return res;
   }
 
+  /// Sends `xs..., f` to the helper actor for asynchronous queries.
+  template <class... Ts>
+  void request_async(callback f, Ts&&... xs) const;
+
+  /// Wraps `request_async` into a future.
+  template <class... Ts>
+  std::future<expected<data>> request_future(Ts&&... xs) const;
+
   caf::actor frontend_;
+  caf::actor async_;
   std::string name_;
+
+  /// Points to the read snapshot of a local master, if enabled.
+  std::shared_ptr<detail::shared_snapshot> snapshot_;
 };
 
 } // namespace broker
@@ -5,9 +5,13 @@
 
 #include <caf/actor.hpp>
 
+#include "broker/consumer_group.hh"
 #include "broker/data.hh"
+#include "broker/data_view.hh"
+#include "broker/filter_type.hh"
 #include "broker/fwd.hh"
 #include "broker/message.hh"
+#include "broker/predicate.hh"
 #include "broker/subscriber_base.hh"
 #include "broker/topic.hh"
 
@@ -15,6 +19,46 @@
 
 namespace broker {
 
+/// Receives the messages of a ::subscriber that match the filter of the
+/// channel. Each channel has its own queue and file handle, but shares the
+/// stream and the worker of its subscriber.
+class subscriber_channel : public subscriber_base<data_message> {
+public:
+  // --- friend declarations ---------------------------------------------------
+
+  friend class subscriber;
+
+  // --- nested types ----------------------------------------------------------
+
+  using super = subscriber_base<data_message>;
+
+  // --- constructors and destructors ------------------------------------------
+
+  subscriber_channel(subscriber_channel&&) = default;
+
+  /// Detaches this channel from its subscriber before taking over `other`.
+  subscriber_channel& operator=(subscriber_channel&& other);
+
+  /// Detaches the channel from its subscriber. Afterwards, the subscriber
+  /// receives all messages that previously went to this channel.
+  ~subscriber_channel();
+
+  // --- properties ------------------------------------------------------------
+
+  const filter_type& filter() const {
+    return filter_;
+  }
+
+protected:
+  void became_not_full() override;
+
+private:
+  subscriber_channel(caf::actor worker, filter_type filter, size_t max_qsize);
+
+  caf::actor worker_;
+  filter_type filter_;
+};
+
 /// Provides blocking access to a stream of data.
 class subscriber : public subscriber_base<data_message> {
 public:
@@ -46,18 +90,81 @@ public:
     return worker_;
   }
 
+  // --- access to values ------------------------------------------------------
+
+  using super::poll;
+
+  /// Appends all currently available messages as views to `buf` without
+  /// blocking. Packed payloads remain encoded until accessed through the view.
+  /// @returns the number of consumed messages.
+  size_t poll(std::vector<data_view>& buf) {
+    return drain([&](data_message&& x) { buf.emplace_back(std::move(x)); });
+  }
+
   // --- topic management ------------------------------------------------------
 
   void add_topic(topic x, bool block = false);
 
   void remove_topic(topic x, bool block = false);
 
+  /// Adds all topics in `add` and then removes all topics in `remove` as a
+  /// single filter update. Hence, the core sends at most one filter update
+  /// to its peers, regardless of the number of topics.
+  /// @param block Waits until the core has applied the new filter.
+  /// @returns whether the filter changed.
+  bool update_topics(filter_type add, filter_type remove, bool block = false);
+
+  // --- demultiplexing --------------------------------------------------------
+
+  /// Creates a channel that receives all messages matching `filter` instead
+  /// of this subscriber. Adds the topics of `filter` to this subscriber. A
+  /// message matching the filters of several channels goes to the oldest of
+  /// them. Messages matching no channel remain in this subscriber.
+  subscriber_channel add_channel(filter_type filter);
+
+  /// Splits the messages that match no channel into `n` partitions by the
+  /// hash of their key, i.e., the element at `key_path` in the content of
+  /// each message (see `field_condition`). All messages with the same key go
+  /// to the same partition in the order of their arrival. Messages without a
+  /// key go to the first partition. Replaces all previous partitions.
+  /// Destroying a partition spreads its keys over the remaining ones.
+  std::vector<subscriber_channel> add_partitions(size_t n,
+                                                 std::vector<count> key_path);
+
+  /// Splits the messages that match no channel into `n` queues for a pool of
+  /// worker threads. Each message goes to the queue with the fewest buffered
+  /// messages, i.e., idle workers receive new messages first. Each worker
+  /// consumes from its own queue and file handle without synchronizing with
+  /// the other workers. Unlike `add_partitions`, messages of the same key may
+  /// go to different workers. Replaces all previous partitions.
+  std::vector<subscriber_channel> add_workers(size_t n);
+
 protected:
   void became_not_full() override;
 
 private:
   // -- force users to use `endpoint::make_status_subscriber` ------------------
-  subscriber(endpoint& ep, std::vector<topic> ts, size_t max_qsize);
+  subscriber(endpoint& ep, std::vector<topic> ts, size_t max_qsize,
+             predicate pred = {}, consumer_group group = {});
+
+  struct direct_delivery_t {};
+
+  static constexpr direct_delivery_t direct_delivery = direct_delivery_t{};
+
+  /// Creates a subscriber that receives messages straight from the core
+  /// rather than through a stream. Reserved for the status and error events
+  /// of a `status_subscriber`.
+  subscriber(endpoint& ep, std::vector<topic> ts, size_t max_qsize,
+             direct_delivery_t);
+
+  /// Sends the current filter to the worker and the endpoint.
+  void send_filter(bool block);
+
+  /// Creates `n` channels for partitioning the messages that match no channel
+  /// and stores their queues in `queues`.
+  std::vector<subscriber_channel>
+  make_partitions(size_t n,
+                  std::vector<detail::shared_subscriber_queue_ptr<>>& queues);
 
   caf::actor worker_;
   std::vector<topic> filter_;
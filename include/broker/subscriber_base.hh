@@ -1,5 +1,6 @@
 #pragma once
 
+#include <limits>
 #include <vector>
 
 #include <caf/actor.hpp>
@@ -12,6 +13,7 @@
 #include "broker/detail/shared_subscriber_queue.hh"
 #include "broker/fwd.hh"
 #include "broker/logger.hh"
+#include "broker/predicate.hh"
 #include "broker/topic.hh"
 
 namespace broker {
@@ -106,15 +108,15 @@ public:
     for (;;) {
       if (!queue_->wait_on_flare_abs(timeout))
         return result;
+      drop_stale();
       size_t prev_size = 0;
+      auto bytes_full = queue_->bytes_exhausted();
       auto remaining = num - result.size();
       auto got = queue_->consume(remaining, &prev_size, [&](value_type&& x) {
         BROKER_DEBUG("received" << x);
         result.emplace_back(std::move(x));
       });
-      if (prev_size >= static_cast<size_t>(max_qsize_)
-          && prev_size - got < static_cast<size_t>(max_qsize_))
-        became_not_full();
+      check_not_full(prev_size, got, bytes_full);
       if (result.size() == num)
         return result;
     }
@@ -137,15 +139,15 @@ public:
     result.reserve(num);
     for (;;) {
       queue_->wait_on_flare();
+      drop_stale();
       size_t prev_size = 0;
+      auto bytes_full = queue_->bytes_exhausted();
       auto remaining = num - result.size();
       auto got = queue_->consume(remaining, &prev_size, [&](value_type&& x) {
         BROKER_DEBUG("received" << x);
         result.emplace_back(std::move(x));
       });
-      if (prev_size >= static_cast<size_t>(max_qsize_)
-          && prev_size - got < static_cast<size_t>(max_qsize_))
-        became_not_full();
+      check_not_full(prev_size, got, bytes_full);
       if (result.size() == num)
         return result;
     }
@@ -153,12 +155,36 @@ public:
 
   /// Returns all currently available values without blocking.
   std::vector<value_type> poll() {
+    drop_stale();
+    auto bytes_full = queue_->bytes_exhausted();
     auto rval = queue_->consume_all();
-    if (rval.size() >= static_cast<size_t>(max_qsize_))
+    if (rval.size() >= static_cast<size_t>(max_qsize_) || bytes_full)
       became_not_full();
     return rval;
   }
 
+  /// Appends all currently available values to `buf` without blocking.
+  /// Allows callers to reuse the same buffer in a loop to avoid heap
+  /// allocations once `buf` has reached a sufficient capacity.
+  /// @returns the number of appended values.
+  size_t poll(std::vector<value_type>& buf) {
+    return drain([&](value_type&& x) { buf.emplace_back(std::move(x)); });
+  }
+
+  /// Passes all currently available values to `f` without blocking, i.e.,
+  /// without storing them in an intermediate buffer.
+  /// @returns the number of consumed values.
+  template <class F>
+  size_t drain(F f) {
+    drop_stale();
+    size_t prev_size = 0;
+    auto bytes_full = queue_->bytes_exhausted();
+    auto got = queue_->consume(std::numeric_limits<size_t>::max(), &prev_size,
+                               std::move(f));
+    check_not_full(prev_size, got, bytes_full);
+    return got;
+  }
+
   // --- accessors -------------------------------------------------------------
 
   /// Returns the amound of values than can be extracted immediately without
@@ -167,6 +193,69 @@ public:
     return queue_->buffer_size();
   }
 
+  /// Returns the approximate payload size of all values that can be extracted
+  /// immediately.
+  size_t available_bytes() const {
+    return queue_->buffered_bytes();
+  }
+
+  /// Returns the maximum time span values may wait in the queue or 0 if
+  /// values never expire.
+  timespan max_age() const {
+    return queue_->max_age();
+  }
+
+  /// Discards values that waited in the queue for longer than `x` instead of
+  /// returning them. Only affects values that arrive after setting the
+  /// maximum age. 0 disables the limit.
+  void max_age(timespan x) {
+    queue_->max_age(x);
+  }
+
+  /// Returns the number of values discarded for exceeding the maximum age.
+  size_t stale() const {
+    return queue_->stale();
+  }
+
+  /// Keeps only the latest pending value per key from now on, where the key
+  /// consists of the elements at `key_paths` in the content of each value
+  /// (see `field_condition`). For example, `{{2, 0}, {2, 1, 0}}` selects the
+  /// name and the first argument of a Zeek event. A new value replaces the
+  /// pending value with the same key at its position in the queue. Values
+  /// lacking any of the elements never get replaced. Cannot be turned off
+  /// again.
+  /// @pre `!key_paths.empty()`
+  void conflate(std::vector<std::vector<count>> key_paths) {
+    BROKER_ASSERT(!key_paths.empty());
+    queue_->conflate([paths{std::move(key_paths)}](const value_type& x,
+                                                   data& key) {
+      auto& content = get_data(x);
+      if (paths.size() == 1) {
+        auto field = get_field(content, paths.front());
+        if (field == nullptr)
+          return false;
+        key = *field;
+        return true;
+      }
+      vector fields;
+      fields.reserve(paths.size());
+      for (auto& path : paths) {
+        auto field = get_field(content, path);
+        if (field == nullptr)
+          return false;
+        fields.emplace_back(*field);
+      }
+      key = std::move(fields);
+      return true;
+    });
+  }
+
+  /// Returns the number of values that replaced a pending value with the
+  /// same key.
+  size_t conflated() const {
+    return queue_->conflated();
+  }
+
   /// Returns a file handle for integrating this publisher into a `select` or
   /// `poll` loop.
   int fd() const {
@@ -181,6 +270,23 @@ protected:
     // nop
   }
 
+  /// Discards values that exceed the maximum age before consuming.
+  void drop_stale() {
+    size_t prev_size = 0;
+    auto bytes_full = queue_->bytes_exhausted();
+    if (auto n = queue_->drop_stale(&prev_size))
+      check_not_full(prev_size, n, bytes_full);
+  }
+
+  /// Calls `became_not_full` if consuming `got` values from a queue with
+  /// `prev_size` values dropped the queue below one of its limits.
+  void check_not_full(size_t prev_size, size_t got, bool bytes_full) {
+    auto limit = static_cast<size_t>(max_qsize_);
+    if ((prev_size >= limit && prev_size - got < limit)
+        || (bytes_full && !queue_->bytes_exhausted()))
+      became_not_full();
+  }
+
   queue_ptr queue_;
   long max_qsize_;
 };
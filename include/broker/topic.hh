@@ -1,11 +1,15 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <string>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#include <caf/error.hpp>
+#include <caf/meta/load_callback.hpp>
+
 #include "broker/detail/operators.hh"
 
 namespace broker {
@@ -55,15 +59,54 @@ public:
   /// Returns whether this topic is a prefix match for `t`.
   bool prefix_of(const topic& t) const;
 
+  /// Returns whether the topic contains `reserved`, i.e., belongs to Broker
+  /// itself.
+  bool is_internal() const noexcept {
+    return (flags_ & internal_flag) != 0;
+  }
+
+  /// Returns whether the topic starts with `reserved`, e.g., for status and
+  /// error messages.
+  bool is_control() const noexcept {
+    return (flags_ & control_flag) != 0;
+  }
+
+  /// Returns whether the topic ends with `topics::master_suffix`.
+  bool is_master_topic() const noexcept {
+    return (flags_ & master_flag) != 0;
+  }
+
+  /// Returns whether the topic ends with `topics::clone_suffix`.
+  bool is_clone_topic() const noexcept {
+    return (flags_ & clone_flag) != 0;
+  }
+
   template <class Inspector>
   friend typename Inspector::result_type inspect(Inspector& f, topic& t) {
-    return f(t.str_);
+    auto load = caf::meta::load_callback([&]() -> caf::error {
+      t.classify();
+      return caf::none;
+    });
+    return f(t.str_, load);
   }
 
 private:
+  enum flag : uint8_t {
+    internal_flag = 0x01,
+    control_flag = 0x02,
+    master_flag = 0x04,
+    clone_flag = 0x08,
+  };
+
   void clean();
 
+  /// Computes the flags once after each change, so that hot code paths
+  /// branch on a bit instead of comparing strings.
+  void classify() noexcept;
+
   std::string str_;
+
+  uint8_t flags_ = 0;
 };
 
 /// @relates topic
@@ -88,6 +131,7 @@ const topic master_suffix = reserved / master;
 const topic clone_suffix = reserved / clone;
 const topic errors = reserved / "data/errors";
 const topic statuses = reserved / "data/statuses";
+const topic metrics = reserved / "data/metrics";
 
 } // namespace topics
 } // namespace broker
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <caf/meta/type_name.hpp>
+
+#include "broker/filter_type.hh"
+#include "broker/topic.hh"
+
+namespace broker {
+
+/// A Bloom filter over the topics of a filter. Summarizes filters with many
+/// fine-grained topics in a fraction of their size. Peers use a summary to
+/// reject messages early: a summary may cover topics that the filter does not
+/// cover, but never rejects a topic that the filter covers. Receivers then
+/// drop false positives by matching exactly against their subscribers.
+class topic_summary {
+public:
+  topic_summary() = default;
+
+  /// Creates a summary of `xs` with a false positive rate of about `fp_rate`
+  /// for up to `capacity` topics (at least `xs.size()`).
+  topic_summary(const filter_type& xs, size_t capacity, double fp_rate = 0.01);
+
+  /// Adds `x` to the summary.
+  void add(const topic& x);
+
+  /// Adds all topics in `xs` to the summary.
+  void add(const filter_type& xs);
+
+  /// Queries whether any topic in the summary may be a prefix of `x`.
+  bool covers(const topic& x) const;
+
+  /// Returns the size of the Bloom filter in bits.
+  size_t num_bits() const noexcept {
+    return bits_.size() * 64;
+  }
+
+  /// Returns whether the summary covers no topic.
+  bool empty() const noexcept {
+    return bits_.empty() || min_length_ > max_length_;
+  }
+
+  template <class Inspector>
+  friend typename Inspector::result_type inspect(Inspector& f,
+                                                 topic_summary& x) {
+    return f(caf::meta::type_name("topic_summary"), x.num_hashes_,
+             x.min_length_, x.max_length_, x.bits_);
+  }
+
+  friend bool operator==(const topic_summary& x, const topic_summary& y) {
+    return x.num_hashes_ == y.num_hashes_ && x.min_length_ == y.min_length_
+           && x.max_length_ == y.max_length_ && x.bits_ == y.bits_;
+  }
+
+private:
+  bool test(uint64_t hash) const;
+
+  void set(uint64_t hash);
+
+  /// Number of bits per topic.
+  uint32_t num_hashes_ = 0;
+
+  /// Length of the shortest topic. Restricts the prefixes that `covers`
+  /// needs to test.
+  uint32_t min_length_ = UINT32_MAX;
+
+  /// Length of the longest topic.
+  uint32_t max_length_ = 0;
+
+  std::vector<uint64_t> bits_;
+};
+
+} // namespace broker
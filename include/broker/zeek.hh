@@ -1,5 +1,13 @@
 #pragma once
 
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
 #include "broker/data.hh"
 
 namespace broker {
@@ -17,7 +25,8 @@ public:
     LogWrite = 3,
     IdentifierUpdate = 4,
     Batch = 5,
-    MAX = Batch,
+    LogBatch = 6,
+    MAX = LogBatch,
   };
 
   Type type() const {
@@ -83,7 +92,18 @@ public:
 
 protected:
   Message(Type type, vector content)
-    : data_(vector{ProtocolVersion, count(type), std::move(content)}) {
+    : data_(make_vector(ProtocolVersion, count(type), std::move(content))) {
+  }
+
+  /// Creates a vector from `xs` by moving each argument into place. Unlike
+  /// brace-initialization, this avoids copying all elements out of an
+  /// `std::initializer_list`, which would deep-copy nested containers.
+  template <class... Ts>
+  static vector make_vector(Ts&&... xs) {
+    vector result;
+    result.reserve(sizeof...(Ts));
+    (result.emplace_back(std::forward<Ts>(xs)), ...);
+    return result;
   }
 
   Message(data msg) : data_(std::move(msg)) {
@@ -96,7 +116,8 @@ protected:
 class Event : public Message {
   public:
   Event(std::string name, vector args)
-    : Message(Message::Type::Event, {std::move(name), std::move(args)}) {}
+    : Message(Message::Type::Event,
+              make_vector(std::move(name), std::move(args))) {}
 
   Event(data msg) : Message(std::move(msg)) {}
 
@@ -108,6 +129,12 @@ class Event : public Message {
     return caf::get<std::string>(caf::get<vector>(as_vector()[2])[0]);
   }
 
+  /// Returns a view on the event name, e.g., for comparing it to string
+  /// literals during dispatching without creating temporary strings.
+  std::string_view name_view() const {
+    return name();
+  }
+
   const vector& args() const {
     return caf::get<vector>(caf::get<vector>(as_vector()[2])[1]);
   }
@@ -144,6 +171,178 @@ class Event : public Message {
   }
 };
 
+/// Builds a Zeek event in place. The builder creates the final message layout
+/// up front and appends the arguments directly to it, i.e., `build` neither
+/// copies nor moves any argument.
+class EventBuilder {
+public:
+  explicit EventBuilder(std::string name, size_t num_args = 0) {
+    vector content;
+    content.reserve(2);
+    content.emplace_back(std::move(name));
+    content.emplace_back(vector{});
+    vector msg;
+    msg.reserve(3);
+    msg.emplace_back(ProtocolVersion);
+    msg.emplace_back(count(Message::Type::Event));
+    msg.emplace_back(std::move(content));
+    msg_ = std::move(msg);
+    // Moving the builder only moves the outermost vector buffer, i.e., the
+    // pointer remains valid.
+    args_ = &caf::get<vector>(caf::get<vector>(caf::get<vector>(msg_)[2])[1]);
+    args_->reserve(num_args);
+  }
+
+  EventBuilder(EventBuilder&&) = default;
+
+  EventBuilder& operator=(EventBuilder&&) = default;
+
+  EventBuilder(const EventBuilder&) = delete;
+
+  EventBuilder& operator=(const EventBuilder&) = delete;
+
+  /// Appends `x` to the arguments of the event.
+  template <class T>
+  EventBuilder& add(T&& x) {
+    args_->emplace_back(std::forward<T>(x));
+    return *this;
+  }
+
+  /// Returns the event. Leaves the builder in an unspecified state.
+  Event build() && {
+    return Event(std::move(msg_));
+  }
+
+private:
+  data msg_;
+  vector* args_;
+};
+
+/// A non-owning view on a Zeek event that checks the message layout only
+/// once. After `valid()` returned `true`, all accessors run in constant time
+/// without further type checks. The view must not outlive its message.
+class EventView {
+public:
+  explicit EventView(const data& msg) noexcept {
+    auto vp = caf::get_if<vector>(&msg);
+
+    if ( ! vp || vp->size() < 3 )
+      return;
+
+    auto cp = caf::get_if<count>(&(*vp)[1]);
+
+    if ( ! cp || *cp != count(Message::Type::Event) )
+      return;
+
+    auto content = caf::get_if<vector>(&(*vp)[2]);
+
+    if ( ! content || content->size() < 2 )
+      return;
+
+    auto name_ptr = caf::get_if<std::string>(&(*content)[0]);
+    auto args_ptr = caf::get_if<vector>(&(*content)[1]);
+
+    if ( ! name_ptr || ! args_ptr )
+      return;
+
+    name_ = name_ptr;
+    args_ = args_ptr;
+  }
+
+  explicit EventView(const Event& ev) noexcept : EventView(ev.as_data()) {
+  }
+
+  bool valid() const noexcept {
+    return args_ != nullptr;
+  }
+
+  /// @pre `valid()`
+  const std::string& name() const noexcept {
+    return *name_;
+  }
+
+  /// @pre `valid()`
+  std::string_view name_view() const noexcept {
+    return *name_;
+  }
+
+  /// @pre `valid()`
+  const vector& args() const noexcept {
+    return *args_;
+  }
+
+private:
+  const std::string* name_ = nullptr;
+  const vector* args_ = nullptr;
+};
+
+/// Describes a Zeek event by its name and the types of its arguments, e.g.,
+/// `TypedEvent<count, address, port>{"conn_state"}`. Checks the layout of a
+/// received event in a single pass and then grants typed access to all
+/// arguments without further type checks or copies. The argument type `data`
+/// accepts any value.
+template <class... Ts>
+class TypedEvent {
+public:
+  /// References to the arguments of a matching event.
+  using values_type = std::tuple<const Ts&...>;
+
+  explicit TypedEvent(std::string name) : name_(std::move(name)) {
+  }
+
+  const std::string& name() const noexcept {
+    return name_;
+  }
+
+  /// Returns references to the arguments of `ev` if its name and arguments
+  /// match this event type. The result must not outlive the event.
+  std::optional<values_type> unpack(const EventView& ev) const noexcept {
+    if ( ! ev.valid() || ev.name_view() != name_
+         || ev.args().size() != sizeof...(Ts) )
+      return std::nullopt;
+
+    return unpack(ev.args(), std::index_sequence_for<Ts...>{});
+  }
+
+  std::optional<values_type> unpack(const data& msg) const noexcept {
+    return unpack(EventView{msg});
+  }
+
+  /// Returns whether `msg` is an event of this type.
+  bool matches(const data& msg) const noexcept {
+    return unpack(msg).has_value();
+  }
+
+  /// Builds an event of this type by moving each argument into place.
+  Event make(Ts... xs) const {
+    EventBuilder builder{name_, sizeof...(Ts)};
+    (builder.add(std::move(xs)), ...);
+    return std::move(builder).build();
+  }
+
+private:
+  template <class T>
+  static const T* get_arg(const data& x) noexcept {
+    if constexpr ( std::is_same<T, data>::value )
+      return &x;
+    else
+      return caf::get_if<T>(&x);
+  }
+
+  template <size_t... Is>
+  static std::optional<values_type> unpack(const vector& args,
+                                           std::index_sequence<Is...>) noexcept {
+    std::tuple<const Ts*...> ptrs{get_arg<Ts>(args[Is])...};
+
+    if ( ((std::get<Is>(ptrs) == nullptr) || ...) )
+      return std::nullopt;
+
+    return values_type{*std::get<Is>(ptrs)...};
+  }
+
+  std::string name_;
+};
+
 /// A batch of other messages.
 class Batch : public Message {
   public:
@@ -180,8 +379,8 @@ public:
   LogCreate(enum_value stream_id, enum_value writer_id, data writer_info,
             data fields_data)
     : Message(Message::Type::LogCreate,
-              {std::move(stream_id), std::move(writer_id),
-               std::move(writer_info), std::move(fields_data)}) {
+              make_vector(std::move(stream_id), std::move(writer_id),
+                          std::move(writer_info), std::move(fields_data))) {
   }
 
   LogCreate(data msg) : Message(std::move(msg)) {
@@ -250,8 +449,8 @@ public:
   LogWrite(enum_value stream_id, enum_value writer_id, data path,
            data serial_data)
     : Message(Message::Type::LogWrite,
-              {std::move(stream_id), std::move(writer_id),
-               std::move(path), std::move(serial_data)}) {
+              make_vector(std::move(stream_id), std::move(writer_id),
+                          std::move(path), std::move(serial_data))) {
   }
 
   LogWrite(data msg) : Message(std::move(msg)) {
@@ -313,11 +512,196 @@ public:
   }
 };
 
+/// A batch of Zeek log writes for the same stream, writer, and path. Stores
+/// the field values per column and sends the header fields only once. Note
+/// that at the moment this should be used only by Zeek itself as the fields
+/// aren't publicly defined.
+class LogBatch : public Message {
+public:
+  /// A non-owning view on a single row of the batch.
+  class Row {
+  public:
+    Row(const vector* columns, size_t index) noexcept
+      : columns_(columns), index_(index) {
+    }
+
+    /// Returns the number of fields in the row.
+    size_t size() const noexcept {
+      return columns_->size();
+    }
+
+    /// Returns the value of `field` in this row.
+    const data& operator[](size_t field) const noexcept {
+      return caf::get<vector>((*columns_)[field])[index_];
+    }
+
+    size_t index() const noexcept {
+      return index_;
+    }
+
+  private:
+    const vector* columns_;
+    size_t index_;
+  };
+
+  /// Iterates the rows of a batch without allocating.
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Row;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Row*;
+    using reference = Row;
+
+    const_iterator(const vector* columns, size_t index) noexcept
+      : columns_(columns), index_(index) {
+    }
+
+    Row operator*() const noexcept {
+      return Row{columns_, index_};
+    }
+
+    const_iterator& operator++() noexcept {
+      ++index_;
+      return *this;
+    }
+
+    const_iterator operator++(int) noexcept {
+      auto result = *this;
+      ++index_;
+      return result;
+    }
+
+    friend bool operator==(const const_iterator& x,
+                           const const_iterator& y) noexcept {
+      return x.index_ == y.index_;
+    }
+
+    friend bool operator!=(const const_iterator& x,
+                           const const_iterator& y) noexcept {
+      return x.index_ != y.index_;
+    }
+
+  private:
+    const vector* columns_;
+    size_t index_;
+  };
+
+  /// Creates an empty batch with `num_fields` columns.
+  LogBatch(enum_value stream_id, enum_value writer_id, data path,
+           size_t num_fields)
+    : LogBatch(std::move(stream_id), std::move(writer_id), std::move(path),
+               vector(num_fields, data{vector{}})) {
+  }
+
+  /// Creates a batch from `columns`, i.e., a vector of vectors with one entry
+  /// per row each.
+  LogBatch(enum_value stream_id, enum_value writer_id, data path,
+           vector columns)
+    : Message(Message::Type::LogBatch,
+              make_vector(std::move(stream_id), std::move(writer_id),
+                          std::move(path), std::move(columns))) {
+  }
+
+  LogBatch(data msg) : Message(std::move(msg)) {
+  }
+
+  const enum_value& stream_id() const {
+    return caf::get<enum_value>(caf::get<vector>(as_vector()[2])[0]);
+  }
+
+  const enum_value& writer_id() const {
+    return caf::get<enum_value>(caf::get<vector>(as_vector()[2])[1]);
+  }
+
+  const data& path() const {
+    return caf::get<vector>(as_vector()[2])[2];
+  }
+
+  const vector& columns() const {
+    return caf::get<vector>(caf::get<vector>(as_vector()[2])[3]);
+  }
+
+  vector& columns() {
+    return caf::get<vector>(caf::get<vector>(as_vector()[2])[3]);
+  }
+
+  size_t num_fields() const {
+    return columns().size();
+  }
+
+  size_t num_rows() const {
+    auto& cols = columns();
+    return cols.empty() ? 0 : caf::get<vector>(cols[0]).size();
+  }
+
+  /// Appends a row by moving each field into its column.
+  /// @pre `row.size() == num_fields()`
+  void add_row(vector row) {
+    auto& cols = columns();
+    for ( size_t i = 0; i < cols.size(); ++i )
+      caf::get<vector>(cols[i]).emplace_back(std::move(row[i]));
+  }
+
+  /// @pre `valid()`
+  const_iterator begin() const {
+    return {&columns(), 0};
+  }
+
+  /// @pre `valid()`
+  const_iterator end() const {
+    return {&columns(), num_rows()};
+  }
+
+  /// Checks the header fields and that all columns have the same length.
+  bool valid() const {
+    if ( as_vector().size() < 3 )
+      return false;
+
+    auto vp = caf::get_if<vector>(&(as_vector()[2]));
+
+    if ( ! vp )
+      return false;
+
+    auto& v = *vp;
+
+    if ( v.size() < 4 )
+      return false;
+
+    if ( ! caf::get_if<enum_value>(&v[0]) )
+      return false;
+
+    if ( ! caf::get_if<enum_value>(&v[1]) )
+      return false;
+
+    auto cols = caf::get_if<vector>(&v[3]);
+
+    if ( ! cols )
+      return false;
+
+    const vector* first = nullptr;
+
+    for ( auto& col : *cols ) {
+      auto cp = caf::get_if<vector>(&col);
+
+      if ( ! cp )
+        return false;
+
+      if ( ! first )
+        first = cp;
+      else if ( cp->size() != first->size() )
+        return false;
+    }
+
+    return true;
+  }
+};
+
 class IdentifierUpdate : public Message {
 public:
   IdentifierUpdate(std::string id_name, data id_value)
-    : Message(Message::Type::IdentifierUpdate, {std::move(id_name),
-    		                                    std::move(id_value)}) {
+    : Message(Message::Type::IdentifierUpdate,
+              make_vector(std::move(id_name), std::move(id_value))) {
   }
 
   IdentifierUpdate(data msg) : Message(std::move(msg)) {
@@ -0,0 +1,319 @@
+#include "broker/arrow.hh"
+
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <utility>
+
+#include <caf/variant.hpp>
+
+#include "broker/convert.hh"
+#include "broker/predicate.hh"
+
+namespace broker {
+
+namespace {
+
+enum class column_kind : uint8_t {
+  null,
+  boolean,
+  count,
+  integer,
+  real,
+  timestamp,
+  timespan,
+  string,
+};
+
+const char* format_of(column_kind x) {
+  switch (x) {
+    case column_kind::boolean:
+      return "b";
+    case column_kind::count:
+      return "L";
+    case column_kind::integer:
+      return "l";
+    case column_kind::real:
+      return "g";
+    case column_kind::timestamp:
+      return "tsn:";
+    case column_kind::timespan:
+      return "tDn";
+    case column_kind::string:
+      return "u";
+    default:
+      return "n";
+  }
+}
+
+struct kind_of_visitor {
+  using result_type = column_kind;
+
+  column_kind operator()(none) const {
+    return column_kind::null;
+  }
+
+  column_kind operator()(boolean) const {
+    return column_kind::boolean;
+  }
+
+  column_kind operator()(count) const {
+    return column_kind::count;
+  }
+
+  column_kind operator()(integer) const {
+    return column_kind::integer;
+  }
+
+  column_kind operator()(real) const {
+    return column_kind::real;
+  }
+
+  column_kind operator()(timestamp) const {
+    return column_kind::timestamp;
+  }
+
+  column_kind operator()(timespan) const {
+    return column_kind::timespan;
+  }
+
+  template <class T>
+  column_kind operator()(const T&) const {
+    return column_kind::string;
+  }
+};
+
+column_kind kind_of(const data& x) {
+  return caf::visit(kind_of_visitor{}, x);
+}
+
+void set_bit(std::vector<uint8_t>& xs, size_t i) {
+  xs[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+}
+
+/// Buffers of a single child array.
+struct column {
+  std::string name;
+
+  column_kind kind = column_kind::null;
+
+  int64_t null_count = 0;
+
+  std::vector<uint8_t> validity;
+
+  /// Bit-packed values of boolean columns.
+  std::vector<uint8_t> bits;
+
+  /// Bit copies of the values of all other fixed-width columns.
+  std::vector<int64_t> words;
+
+  std::vector<int32_t> offsets;
+
+  std::string chars;
+
+  const void* buffers[3] = {nullptr, nullptr, nullptr};
+
+  void init(size_t n) {
+    validity.resize((n + 7) / 8);
+    switch (kind) {
+      case column_kind::null:
+        break;
+      case column_kind::boolean:
+        bits.resize((n + 7) / 8);
+        break;
+      case column_kind::string:
+        offsets.resize(n + 1);
+        break;
+      default:
+        words.resize(n);
+    }
+  }
+
+  ec append(size_t row, const data& x) {
+    if (kind == column_kind::string)
+      offsets[row + 1] = offsets[row];
+    if (caf::holds_alternative<none>(x)) {
+      ++null_count;
+      return ec::none;
+    }
+    if (kind_of(x) != kind)
+      return ec::type_clash;
+    set_bit(validity, row);
+    switch (kind) {
+      case column_kind::boolean:
+        if (caf::get<boolean>(x))
+          set_bit(bits, row);
+        break;
+      case column_kind::count:
+        std::memcpy(&words[row], &caf::get<count>(x), sizeof(int64_t));
+        break;
+      case column_kind::integer:
+        words[row] = caf::get<integer>(x);
+        break;
+      case column_kind::real:
+        std::memcpy(&words[row], &caf::get<real>(x), sizeof(int64_t));
+        break;
+      case column_kind::timestamp:
+        words[row] = caf::get<timestamp>(x).time_since_epoch().count();
+        break;
+      case column_kind::timespan:
+        words[row] = caf::get<timespan>(x).count();
+        break;
+      default: {
+        if (auto str = caf::get_if<std::string>(&x))
+          chars += *str;
+        else
+          chars += to_string(x);
+        if (chars.size() > std::numeric_limits<int32_t>::max())
+          return ec::invalid_data;
+        offsets[row + 1] = static_cast<int32_t>(chars.size());
+      }
+    }
+    return ec::none;
+  }
+
+  /// Points `buffers` to the final buffers.
+  /// @returns the number of buffers.
+  int64_t finish() {
+    buffers[0] = null_count > 0 ? validity.data() : nullptr;
+    switch (kind) {
+      case column_kind::null:
+        return 0;
+      case column_kind::boolean:
+        buffers[1] = bits.data();
+        return 2;
+      case column_kind::string:
+        buffers[1] = offsets.data();
+        buffers[2] = chars.data();
+        return 3;
+      default:
+        buffers[1] = words.data();
+        return 2;
+    }
+  }
+};
+
+/// Owns all buffers and structs of an exported batch. Each exported struct
+/// holds a reference, because consumers may move child arrays out of their
+/// parent and release them independently.
+struct batch {
+  std::vector<column> columns;
+  std::vector<ArrowArray> arrays;
+  std::vector<ArrowArray*> array_ptrs;
+  std::vector<ArrowSchema> schemas;
+  std::vector<ArrowSchema*> schema_ptrs;
+  const void* struct_buffers[1] = {nullptr};
+};
+
+using batch_ptr = std::shared_ptr<batch>;
+
+template <class T>
+void release_impl(T* x) {
+  for (int64_t i = 0; i < x->n_children; ++i) {
+    auto child = x->children[i];
+    if (child->release != nullptr)
+      child->release(child);
+  }
+  delete static_cast<batch_ptr*>(x->private_data);
+  x->release = nullptr;
+}
+
+void release_array(ArrowArray* x) {
+  release_impl(x);
+}
+
+void release_schema(ArrowSchema* x) {
+  release_impl(x);
+}
+
+} // namespace
+
+error export_arrow(const std::vector<data_message>& xs,
+                   const std::vector<count>& row_path,
+                   const std::vector<std::string>& names, ArrowArray* array,
+                   ArrowSchema* schema) {
+  std::vector<const vector*> rows;
+  rows.reserve(xs.size());
+  for (auto& x : xs) {
+    auto row = get_field(get_data(x), row_path);
+    auto vec = row != nullptr ? caf::get_if<vector>(row) : nullptr;
+    if (vec == nullptr)
+      return make_error(ec::type_clash, "no vector at the row path");
+    if (!rows.empty() && vec->size() != rows.front()->size())
+      return make_error(ec::type_clash, "rows differ in length");
+    rows.emplace_back(vec);
+  }
+  auto n = rows.size();
+  auto num_columns = rows.empty() ? size_t{0} : rows.front()->size();
+  auto ptr = std::make_shared<batch>();
+  auto& cols = ptr->columns;
+  cols.resize(num_columns);
+  for (size_t j = 0; j < num_columns; ++j) {
+    auto& col = cols[j];
+    col.name = j < names.size() ? names[j] : "f" + std::to_string(j);
+    for (auto row : rows)
+      if (auto kind = kind_of((*row)[j]); kind != column_kind::null) {
+        col.kind = kind;
+        break;
+      }
+    col.init(n);
+  }
+  for (size_t i = 0; i < n; ++i)
+    for (size_t j = 0; j < num_columns; ++j)
+      if (auto code = cols[j].append(i, (*rows[i])[j]); code != ec::none)
+        return make_error(code, "cannot convert column " + cols[j].name);
+  // Wire up the child arrays and schemas.
+  auto& b = *ptr;
+  b.arrays.resize(num_columns);
+  b.schemas.resize(num_columns);
+  for (size_t j = 0; j < num_columns; ++j) {
+    auto& col = cols[j];
+    auto& arr = b.arrays[j];
+    arr.length = static_cast<int64_t>(n);
+    arr.n_buffers = col.finish();
+    arr.null_count = col.kind == column_kind::null ? arr.length
+                                                   : col.null_count;
+    arr.offset = 0;
+    arr.n_children = 0;
+    arr.buffers = col.buffers;
+    arr.children = nullptr;
+    arr.dictionary = nullptr;
+    arr.release = release_array;
+    arr.private_data = new batch_ptr(ptr);
+    b.array_ptrs.emplace_back(&arr);
+    auto& sch = b.schemas[j];
+    sch.format = format_of(col.kind);
+    sch.name = col.name.c_str();
+    sch.metadata = nullptr;
+    sch.flags = ARROW_FLAG_NULLABLE;
+    sch.n_children = 0;
+    sch.children = nullptr;
+    sch.dictionary = nullptr;
+    sch.release = release_schema;
+    sch.private_data = new batch_ptr(ptr);
+    b.schema_ptrs.emplace_back(&sch);
+  }
+  // Wire up the struct array and its schema.
+  array->length = static_cast<int64_t>(n);
+  array->null_count = 0;
+  array->offset = 0;
+  array->n_buffers = 1;
+  array->n_children = static_cast<int64_t>(num_columns);
+  array->buffers = b.struct_buffers;
+  array->children = b.array_ptrs.data();
+  array->dictionary = nullptr;
+  array->release = release_array;
+  array->private_data = new batch_ptr(ptr);
+  schema->format = "+s";
+  schema->name = "";
+  schema->metadata = nullptr;
+  schema->flags = 0;
+  schema->n_children = static_cast<int64_t>(num_columns);
+  schema->children = b.schema_ptrs.data();
+  schema->dictionary = nullptr;
+  schema->release = release_schema;
+  schema->private_data = new batch_ptr(std::move(ptr));
+  return {};
+}
+
+} // namespace broker
@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <caf/binary_serializer.hpp>
+#include <caf/config_option_adder.hpp>
+#include <caf/error.hpp>
+
+#include "broker/configuration.hh"
+#include "broker/data.hh"
+#include "broker/error.hh"
+#include "broker/internal_command.hh"
+#include "broker/message.hh"
+#include "broker/time.hh"
+#include "broker/topic.hh"
+
+#include "broker/detail/core_metrics.hh"
+#include "broker/detail/generator_file_reader.hh"
+#include "broker/detail/memory_accounting.hh"
+#include "broker/detail/meta_data_writer.hh"
+
+using std::string;
+
+using broker::count;
+using broker::data;
+using broker::timespan;
+using broker::timestamp;
+
+namespace {
+
+// -- I/O utility --------------------------------------------------------------
+
+std::mutex cerr_mtx;
+
+template <class... Ts>
+void println(Ts&&... xs) {
+  std::unique_lock<std::mutex> guard{cerr_mtx};
+  (std::cerr << ... << xs) << std::endl;
+}
+
+// -- program options ----------------------------------------------------------
+
+using string_list = std::vector<string>;
+
+class config : public broker::configuration {
+public:
+  using super = broker::configuration;
+
+  config() : super(skip_init) {
+    opt_group{custom_options_, "global"}
+      .add<string_list>("files,f",
+                        "generator files to analyze, e.g., all segments of "
+                        "a rotated recording")
+      .add<size_t>("threads,t",
+                   "number of worker threads (default: number of cores)")
+      .add<timespan>("batch-gap",
+                     "maximum time between two messages of the same batch "
+                     "(default: 1ms)")
+      .add<size_t>("top",
+                   "number of topics in the report, 0 for all (default: 20)");
+  }
+
+  using super::init;
+};
+
+// -- statistics ---------------------------------------------------------------
+
+constexpr const char* command_names[] = {
+  "none",     "put",           "put_unique", "erase",
+  "add",      "subtract",      "snapshot",   "snapshot_sync",
+  "set",      "clear",         "put_many",   "erase_many",
+  "compare_and_swap", "add_and_get",
+};
+
+struct topic_stats {
+  count messages = 0;
+  count bytes = 0;
+};
+
+// Collects the statistics of one or more ranges of a recording. Since
+// recordings only contain the shape of values, the analysis identifies keys
+// by their meta data (type and size) rather than by their content.
+struct stats {
+  count data_messages = 0;
+  count command_messages = 0;
+  std::unordered_map<string, topic_stats> topics;
+  std::map<string, count> payload_types;
+  std::map<string, count> commands;
+  std::unordered_map<string, std::unordered_set<string>> key_shapes;
+  broker::detail::histogram batch_sizes;
+  bool has_timestamps = false;
+
+  void merge(stats& other) {
+    data_messages += other.data_messages;
+    command_messages += other.command_messages;
+    for (auto& [name, x] : other.topics) {
+      auto& y = topics[name];
+      y.messages += x.messages;
+      y.bytes += x.bytes;
+    }
+    for (auto& [name, n] : other.payload_types)
+      payload_types[name] += n;
+    for (auto& [name, n] : other.commands)
+      commands[name] += n;
+    for (auto& [name, xs] : other.key_shapes)
+      key_shapes[name].merge(xs);
+    batch_sizes.merge(other.batch_sizes);
+    has_timestamps = has_timestamps || other.has_timestamps;
+  }
+};
+
+// Analyzes the messages of a recording in order.
+class analyzer {
+public:
+  analyzer(stats& result, timespan batch_gap)
+    : result_(result), batch_gap_(batch_gap) {
+    // nop
+  }
+
+  ~analyzer() {
+    if (batch_size_ > 0)
+      result_.batch_sizes.observe(batch_size_);
+  }
+
+  void add(const broker::detail::generator_file_reader::value_type& x,
+           timestamp t) {
+    if (result_.has_timestamps) {
+      if (batch_size_ > 0 && t - last_ <= batch_gap_) {
+        ++batch_size_;
+      } else {
+        if (batch_size_ > 0)
+          result_.batch_sizes.observe(batch_size_);
+        batch_size_ = 1;
+      }
+      last_ = t;
+    }
+    if (auto msg = caf::get_if<broker::data_message>(&x))
+      add(*msg);
+    else
+      add(caf::get<broker::command_message>(x));
+  }
+
+private:
+  void add(const broker::data_message& msg) {
+    auto& x = get_data(msg);
+    auto& ts = result_.topics[get_topic(msg).string()];
+    ++ts.messages;
+    ts.bytes += broker::detail::estimated_size(x);
+    ++result_.payload_types[x.get_type_name()];
+    ++result_.data_messages;
+  }
+
+  void add(const broker::command_message& msg) {
+    auto& cmd = get<1>(msg);
+    auto& name = get_topic(msg).string();
+    auto& ts = result_.topics[name];
+    ++ts.messages;
+    ts.bytes += broker::detail::estimated_size(cmd);
+    ++result_.commands[command_names[cmd.content.index()]];
+    ++result_.command_messages;
+    auto& shapes = result_.key_shapes[name];
+    auto add_key = [&](const data& key) {
+      buf_.clear();
+      caf::binary_serializer sink{nullptr, buf_};
+      broker::detail::meta_data_writer writer{sink};
+      if (!writer(key))
+        shapes.emplace(reinterpret_cast<const char*>(buf_.data()),
+                       buf_.size());
+    };
+    auto& content = cmd.content;
+    if (auto x = caf::get_if<broker::put_command>(&content)) {
+      add_key(x->key);
+    } else if (auto x = caf::get_if<broker::put_unique_command>(&content)) {
+      add_key(x->key);
+    } else if (auto x = caf::get_if<broker::erase_command>(&content)) {
+      add_key(x->key);
+    } else if (auto x = caf::get_if<broker::add_command>(&content)) {
+      add_key(x->key);
+    } else if (auto x = caf::get_if<broker::subtract_command>(&content)) {
+      add_key(x->key);
+    } else if (auto x
+               = caf::get_if<broker::compare_and_swap_command>(&content)) {
+      add_key(x->key);
+    } else if (auto x = caf::get_if<broker::add_and_get_command>(&content)) {
+      add_key(x->key);
+    } else if (auto x = caf::get_if<broker::put_many_command>(&content)) {
+      for (auto& kvp : x->entries)
+        add_key(kvp.first);
+    } else if (auto x = caf::get_if<broker::erase_many_command>(&content)) {
+      for (auto& key : x->keys)
+        add_key(key);
+    }
+  }
+
+  stats& result_;
+  timespan batch_gap_;
+  timestamp last_;
+  size_t batch_size_ = 0;
+  caf::binary_serializer::container_type buf_;
+};
+
+// -- work distribution --------------------------------------------------------
+
+// A range of blocks in a file. Files prior to version 2 have no blocks and
+// thus form a single unit.
+struct work_unit {
+  string file_name;
+  size_t first_block;
+  size_t num_blocks;
+};
+
+caf::error collect_units(const string& fname, size_t max_units,
+                         std::vector<work_unit>& units) {
+  auto in = broker::detail::make_generator_file_reader(fname);
+  if (!in)
+    return make_error(broker::ec::cannot_open_file, fname);
+  auto num_blocks = in->blocks().size();
+  if (in->version() < 2 || num_blocks == 0) {
+    units.emplace_back(work_unit{fname, 0, 0});
+    return caf::none;
+  }
+  auto chunk_size = std::max((num_blocks + max_units - 1) / max_units,
+                             size_t{1});
+  for (size_t first = 0; first < num_blocks; first += chunk_size)
+    units.emplace_back(work_unit{fname, first,
+                                 std::min(chunk_size, num_blocks - first)});
+  return caf::none;
+}
+
+caf::error analyze(const work_unit& unit, timespan batch_gap, stats& result) {
+  auto in = broker::detail::make_generator_file_reader(unit.file_name);
+  if (!in)
+    return make_error(broker::ec::cannot_open_file, unit.file_name);
+  result.has_timestamps = in->version() >= 3;
+  analyzer f{result, batch_gap};
+  broker::detail::generator_file_reader::value_type x;
+  timestamp t;
+  if (unit.num_blocks == 0) {
+    while (!in->at_end()) {
+      if (auto err = in->read(x, t))
+        return err == broker::ec::end_of_file ? caf::none : err;
+      f.add(x, t);
+    }
+    return caf::none;
+  }
+  if (auto err = in->seek(unit.first_block))
+    return err;
+  auto& blocks = in->blocks();
+  size_t entries = 0;
+  for (size_t i = 0; i < unit.num_blocks; ++i)
+    entries += blocks[unit.first_block + i].entries;
+  for (size_t i = 0; i < entries; ++i) {
+    if (auto err = in->read(x, t))
+      return err;
+    f.add(x, t);
+  }
+  return caf::none;
+}
+
+// -- report -------------------------------------------------------------------
+
+void print_report(const stats& x, timespan batch_gap, size_t top) {
+  using std::cout;
+  using std::endl;
+  auto total = x.data_messages + x.command_messages;
+  cout << "messages: " << total << " (data: " << x.data_messages
+       << ", commands: " << x.command_messages << ")" << endl;
+  std::vector<std::pair<string, topic_stats>> topics{x.topics.begin(),
+                                                     x.topics.end()};
+  std::sort(topics.begin(), topics.end(), [](auto& lhs, auto& rhs) {
+    return lhs.second.messages > rhs.second.messages;
+  });
+  if (top > 0 && topics.size() > top)
+    topics.resize(top);
+  cout << "\ntopics (" << x.topics.size() << "), by messages:" << endl;
+  for (auto& [name, ts] : topics)
+    cout << "  " << name << ": " << ts.messages << " messages, " << ts.bytes
+         << " bytes" << endl;
+  cout << "\npayload types:" << endl;
+  for (auto& [name, n] : x.payload_types)
+    cout << "  " << name << ": " << n << endl;
+  cout << "\nstore commands:" << endl;
+  for (auto& [name, n] : x.commands)
+    cout << "  " << name << ": " << n << endl;
+  cout << "\ndistinct key shapes (type and size) per store:" << endl;
+  for (auto& [name, shapes] : x.key_shapes)
+    cout << "  " << name << ": " << shapes.size() << endl;
+  if (!x.has_timestamps) {
+    cout << "\nbatch sizes: n/a (recording has no per-message timestamps)"
+         << endl;
+    return;
+  }
+  cout << "\nbatch sizes (gap <= " << broker::to_string(batch_gap) << "):" << endl;
+  using broker::detail::histogram;
+  auto& buckets = x.batch_sizes.buckets();
+  for (size_t i = 0; i < histogram::num_buckets; ++i) {
+    if (buckets[i] == 0)
+      continue;
+    if (i < histogram::num_buckets - 1)
+      cout << "  <= " << histogram::upper_bound(i);
+    else
+      cout << "  > " << histogram::upper_bound(i - 1);
+    cout << ": " << buckets[i] << endl;
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  config cfg;
+  try {
+    cfg.init(argc, argv);
+  } catch (std::exception& ex) {
+    println("*** ", ex.what());
+    return EXIT_FAILURE;
+  }
+  if (cfg.cli_helptext_printed)
+    return EXIT_SUCCESS;
+  auto files = caf::get_or(cfg, "files", string_list{});
+  if (files.empty()) {
+    println("*** --files is mandatory");
+    return EXIT_FAILURE;
+  }
+  auto num_threads = caf::get_or(cfg, "threads",
+                                 size_t{std::thread::hardware_concurrency()});
+  num_threads = std::max(num_threads, size_t{1});
+  auto batch_gap = caf::get_or(cfg, "batch-gap",
+                               timespan{std::chrono::milliseconds(1)});
+  auto top = caf::get_or(cfg, "top", size_t{20});
+  // Split the input into more units than threads to balance the load.
+  std::vector<work_unit> units;
+  for (auto& fname : files) {
+    if (auto err = collect_units(fname, num_threads * 4, units)) {
+      println("*** ", to_string(err));
+      return EXIT_FAILURE;
+    }
+  }
+  std::atomic<size_t> next_unit{0};
+  std::vector<stats> results(std::min(num_threads, units.size()));
+  std::vector<caf::error> errors(results.size());
+  std::vector<std::thread> workers;
+  for (size_t id = 0; id < results.size(); ++id) {
+    workers.emplace_back([&, id] {
+      for (auto i = next_unit++; i < units.size(); i = next_unit++) {
+        stats tmp;
+        if (auto err = analyze(units[i], batch_gap, tmp)) {
+          errors[id] = std::move(err);
+          return;
+        }
+        results[id].merge(tmp);
+      }
+    });
+  }
+  for (auto& worker : workers)
+    worker.join();
+  for (auto& err : errors) {
+    if (err) {
+      println("*** analysis failed: ", to_string(err));
+      return EXIT_FAILURE;
+    }
+  }
+  stats total;
+  for (auto& x : results)
+    total.merge(x);
+  print_report(total, batch_gap, top);
+  return EXIT_SUCCESS;
+}
@@ -1,15 +1,18 @@
 #include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <cerrno>
 #include <cstddef>
 #include <cstdint>
 #include <exception>
+#include <fstream>
 #include <iostream>
 #include <iterator>
 #include <limits>
 #include <mutex>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -149,6 +152,8 @@ using relay_atom = atom_constant<atom("relay")>;
 
 using generate_atom = atom_constant<atom("generate")>;
 
+using stats_atom = atom_constant<atom("stats")>;
+
 using blocking_atom = atom_constant<atom("blocking")>;
 
 using stream_atom = atom_constant<atom("stream")>;
@@ -179,9 +184,26 @@ public:
       .add<bool>("rate,r", "print receive rate ('relay' mode only)")
       .add<string>("name,N", "set node name in verbose output")
       .add<string_list>("topics,t", "topics for sending/receiving messages")
-      .add<atom_value>("mode,m", "'relay', 'generate', 'ping', or 'pong'")
+      .add<atom_value>("mode,m",
+                       "'relay', 'generate', 'ping', 'pong', or 'stats'")
       .add<string>("generator-file,g",
                    "path to a generator file ('generate' mode only)")
+      .add<double>("replay-speed",
+                   "reproduce the recorded timing, scaled by this factor "
+                   "(e.g., 1 or 10), instead of sending as fast as possible "
+                   "('generate' mode only)")
+      .add<double>("generator-reuse",
+                   "probability for reusing a previously generated string or "
+                   "key (default: 0, 'generate' mode only)")
+      .add<double>("generator-zipf-skew",
+                   "skew of the Zipf distribution for picking reused values "
+                   "(default: 1, 'generate' mode only)")
+      .add<string>("generator-words",
+                   "path to a file with one word per line for composing "
+                   "strings ('generate' mode only)")
+      .add<string_list>("generator-address-ranges",
+                        "subnets for generated addresses, e.g., "
+                        "[\"10.0.0.0/8\"] ('generate' mode only)")
       .add<size_t>("payload-size,s",
                    "additional number of bytes for the ping message")
       .add<timespan>("rendezvous-retry",
@@ -189,6 +211,9 @@ public:
                      "message (default: 50ms)")
       .add<size_t>("num-messages,n",
                    "number of pings (default: 100, 'ping' mode only)")
+      .add<timespan>("stats-interval",
+                     "time between two outputs (default: 1s, 'stats' mode "
+                     "only)")
       .add<uri_list>("peers,p",
                      "list of peers we connect to on startup in "
                      "<tcp://$host:$port> notation")
@@ -357,41 +382,147 @@ void generator(caf::event_based_actor* self, caf::actor core,
       [=](generator_ptr& g, caf::downstream<value_type>& out, size_t hint) {
         if (g == nullptr || g->at_end())
           return;
-        for (size_t i = 0; i < hint; ++i) {
-          if (g->at_end()) {
-            *count += i;
-            return;
-          }
-          value_type x;
-          if (auto err = g->read(x)) {
-            err::println("error while parsing ", file_name, ": ",
-                         self->system().render(err));
-            g = nullptr;
-            *count += i;
-            return;
-          }
+        std::vector<value_type> xs;
+        auto err = g->read(xs, hint);
+        *count += xs.size();
+        for (auto& x : xs)
           out.push(std::move(x));
+        if (err) {
+          err::println("error while parsing ", file_name, ": ",
+                       self->system().render(err));
+          g = nullptr;
         }
-        *count += hint;
       },
       [](const generator_ptr& g) { return g == nullptr || g->at_end(); });
   }
 }
 
+/// Publishes all messages from the generator file with the inter-arrival times
+/// of the recording, divided by `speed`. Messages that fall behind schedule go
+/// out immediately, i.e., the replay never slows down to catch up.
+size_t timed_generate(broker::endpoint& ep, const std::string& file_name,
+                      broker::detail::generator_file_reader& reader,
+                      double speed) {
+  using clock_type = std::chrono::steady_clock;
+  using value_type = broker::detail::generator_file_reader::value_type;
+  if (reader.version() < 3)
+    err::println("generator file has no per-message timestamps, "
+                 "replay timing is approximate: ", file_name);
+  auto limit = get_if<size_t>(&ep, "num-messages");
+  size_t count = 0;
+  auto core = ep.core();
+  auto publish = [&](value_type& x) {
+    if (caf::holds_alternative<broker::data_message>(x))
+      anon_send(core, broker::atom::publish::value,
+                std::move(caf::get<broker::data_message>(x)));
+    else
+      anon_send(core, broker::atom::publish::value,
+                std::move(caf::get<broker::command_message>(x)));
+  };
+  for (;;) {
+    // Each pass over the file starts a new schedule.
+    clock_type::time_point start;
+    broker::timestamp origin;
+    bool started = false;
+    while (!reader.at_end()) {
+      if (limit && count == *limit)
+        return count;
+      value_type x;
+      broker::timestamp t;
+      if (auto err = reader.read(x, t)) {
+        err::println("error while parsing ", file_name, ": ",
+                     ep.system().render(err));
+        return count;
+      }
+      if (!started) {
+        start = clock_type::now();
+        origin = t;
+        started = true;
+      } else if (t > origin) {
+        auto offset = std::chrono::duration_cast<timespan>((t - origin)
+                                                           / speed);
+        std::this_thread::sleep_until(start + offset);
+      }
+      publish(x);
+      ++count;
+    }
+    if (!limit || count == *limit || !started)
+      return count;
+    reader.rewind();
+  }
+}
+
+bool parse_subnet(const string& str, broker::subnet& x) {
+  auto slash = str.find('/');
+  if (slash == string::npos || slash + 1 == str.size())
+    return false;
+  broker::address addr;
+  if (!convert(str.substr(0, slash), addr))
+    return false;
+  auto len = str.substr(slash + 1);
+  if (!std::all_of(len.begin(), len.end(), ::isdigit) || len.size() > 3)
+    return false;
+  auto n = std::stoi(len);
+  if (n > (addr.is_v4() ? 32 : 128))
+    return false;
+  x = broker::subnet{addr, static_cast<uint8_t>(n)};
+  return true;
+}
+
+bool make_generator_profile(broker::endpoint& ep,
+                            broker::detail::data_generator::profile& prof) {
+  prof.reuse = get_or(ep, "generator-reuse", prof.reuse);
+  prof.zipf_skew = get_or(ep, "generator-zipf-skew", prof.zipf_skew);
+  if (auto path = get_or(ep, "generator-words", ""); !path.empty()) {
+    std::ifstream in{path};
+    if (!in) {
+      err::println("unable to open words file: ", path);
+      return false;
+    }
+    for (string line; std::getline(in, line);)
+      if (!line.empty())
+        prof.words.emplace_back(std::move(line));
+  }
+  if (auto ranges = get_if<string_list>(&ep, "generator-address-ranges")) {
+    for (auto& str : *ranges) {
+      broker::subnet sn;
+      if (!parse_subnet(str, sn)) {
+        err::println("invalid address range: ", str);
+        return false;
+      }
+      prof.address_ranges.emplace_back(sn);
+    }
+  }
+  return true;
+}
+
 void generate_mode(broker::endpoint& ep, topic_list) {
   auto file_name = get_or(ep, "generator-file", "");
   if (file_name.empty())
     return err::println("got no path to a generator file");
+  broker::detail::data_generator::profile prof;
+  if (!make_generator_profile(ep, prof))
+    return;
   verbose::println("generate messages from: ", file_name);
-  auto generator_ptr = broker::detail::make_generator_file_reader(file_name);
+  if (prof.enabled())
+    verbose::println("generate with ", prof.words.size(), " words, ",
+                     prof.address_ranges.size(), " address ranges, and ",
+                     prof.reuse * 100, "% reuse");
+  auto generator_ptr
+    = broker::detail::make_generator_file_reader(file_name, std::move(prof));
   if (generator_ptr == nullptr)
     return err::println("unable to open generator file: ", file_name);
   auto count = std::make_shared<size_t>(0u);
-  caf::scoped_actor self{ep.system()};
   auto t0 = std::chrono::system_clock::now();
-  auto g = self->spawn(generator, ep.core(), count, file_name,
-                       std::move(generator_ptr));
-  self->wait_for(g);
+  if (auto speed = get_or(ep, "replay-speed", 0.); speed > 0) {
+    verbose::println("replay with recorded timing at ", speed, "x speed");
+    *count = timed_generate(ep, file_name, *generator_ptr, speed);
+  } else {
+    caf::scoped_actor self{ep.system()};
+    auto g = self->spawn(generator, ep.core(), count, file_name,
+                         std::move(generator_ptr));
+    self->wait_for(g);
+  }
   auto t1 = std::chrono::system_clock::now();
   auto delta = t1 - t0;
   using fractional_seconds = std::chrono::duration<double>;
@@ -460,6 +591,25 @@ void pong_mode(broker::endpoint& ep, topic_list topics) {
   }
 }
 
+void stats_mode(broker::endpoint& ep, topic_list topics) {
+  verbose::println("receive messages and print stats periodically");
+  auto interval = get_or(ep, "stats-interval",
+                         timespan{std::chrono::seconds(1)});
+  auto in = ep.make_subscriber(topics);
+  auto timeout = std::chrono::system_clock::now() + interval;
+  for (;;) {
+    if (auto x = in.get(timeout)) {
+      if (is_stop_msg(get_data(*x))) {
+        verbose::println("received stop");
+        return;
+      }
+      continue;
+    }
+    out::println(to_string(ep.stats()));
+    timeout += interval;
+  }
+}
+
 } // namespace
 
 // -- main function ------------------------------------------------------------
@@ -535,6 +685,9 @@ int main(int argc, char** argv) {
     case generate_atom::uint_value():
       f = generate_mode;
       break;
+    case stats_atom::uint_value():
+      f = stats_mode;
+      break;
     default:
       err::println("invalid mode: ", mode);
       return EXIT_FAILURE;
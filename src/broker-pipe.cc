@@ -14,6 +14,9 @@
 #include <thread>
 #include <mutex>
 #include <cassert>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
 #include <iostream>
 
 #pragma GCC diagnostic push
@@ -34,11 +37,15 @@
 #include "broker/convert.hh"
 #include "broker/data.hh"
 #include "broker/endpoint.hh"
+#include "broker/error.hh"
 #include "broker/publisher.hh"
 #include "broker/status.hh"
 #include "broker/subscriber.hh"
 #include "broker/topic.hh"
 
+#include "broker/detail/json_reader.hh"
+#include "broker/detail/json_writer.hh"
+
 #ifndef _MSC_VER
 #include <sys/select.h>
 #endif // _MSC_VER
@@ -59,6 +66,9 @@ using blocking_atom = atom_constant<atom("blocking")>;
 using select_atom = atom_constant<atom("select")>;
 using stream_atom = atom_constant<atom("stream")>;
 
+using text_atom = atom_constant<atom("text")>;
+using json_atom = atom_constant<atom("json")>;
+
 std::mutex cout_mtx;
 
 using guard_type = std::unique_lock<std::mutex>;
@@ -77,6 +87,7 @@ public:
 
   atom_value mode = atom("");
   atom_value impl = atom("blocking");
+  atom_value format = atom("text");
   std::string topic;
   std::vector<std::string> peers;
   uint16_t local_port = 0;
@@ -96,6 +107,10 @@ public:
          "set mode ('publish' or 'subscribe')")
     .add(impl, "impl,i",
          "set mode implementation ('blocking', 'select', or 'stream')")
+    .add(format, "format,f",
+         "set format ('text' or 'json'): 'json' prints one JSON object per "
+         "message in subscribe mode and publishes each JSON value from STDIN "
+         "in publish mode, ignoring --impl")
     .add(message_cap, "message-cap,c",
          "set a maximum for received/sent messages");
   }
@@ -177,6 +192,101 @@ void publish_mode_stream(broker::endpoint& ep, const std::string& topic_str,
   self->wait_for(worker);
 }
 
+void publish_mode_json(broker::endpoint& ep, const std::string& topic_str,
+                       size_t cap) {
+  constexpr size_t chunk_size = 1024 * 1024;
+  constexpr size_t batch_size = 1024;
+  constexpr size_t max_pending_batches = 16;
+  // A background thread parses STDIN into batches while this thread
+  // publishes them.
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<std::vector<data>> batches;
+  bool done = false;
+  auto push = [&](std::vector<data>& batch) {
+    std::unique_lock<std::mutex> guard{mtx};
+    cv.wait(guard, [&] { return batches.size() < max_pending_batches; });
+    batches.emplace_back(std::move(batch));
+    batch.clear();
+    cv.notify_all();
+  };
+  std::thread parser{[&] {
+    std::string buf;
+    size_t pos = 0;
+    size_t total = 0;
+    bool eof = false;
+    std::vector<data> batch;
+    batch.reserve(batch_size);
+    data x;
+    while (total < cap) {
+      const char* first = buf.data() + pos;
+      const char* last = buf.data() + buf.size();
+      auto err = broker::detail::json_reader::read(first, last, x);
+      if (!err) {
+        pos = static_cast<size_t>(first - buf.data());
+        batch.emplace_back(std::move(x));
+        ++total;
+        if (batch.size() == batch_size)
+          push(batch);
+        continue;
+      }
+      if (err != broker::ec::end_of_file) {
+        print_line(std::cerr, "*** invalid JSON input: " + to_string(err));
+        break;
+      }
+      if (eof) {
+        if (buf.find_first_not_of(" \t\r\n", pos) != std::string::npos)
+          print_line(std::cerr, "*** incomplete JSON value at end of input");
+        break;
+      }
+      buf.erase(0, pos);
+      pos = 0;
+      auto old_size = buf.size();
+      buf.resize(old_size + chunk_size);
+      auto n = fread(&buf[old_size], 1, chunk_size, stdin);
+      buf.resize(old_size + n);
+      if (n == 0) {
+        // The reader needs a delimiter after the last value.
+        eof = true;
+        buf += '\n';
+      }
+    }
+    if (!batch.empty())
+      push(batch);
+    std::unique_lock<std::mutex> guard{mtx};
+    done = true;
+    cv.notify_all();
+  }};
+  auto out = ep.make_publisher(topic_str);
+  auto t0 = std::chrono::steady_clock::now();
+  size_t published = 0;
+  for (;;) {
+    std::vector<data> batch;
+    {
+      std::unique_lock<std::mutex> guard{mtx};
+      cv.wait(guard, [&] { return !batches.empty() || done; });
+      if (batches.empty())
+        break;
+      batch = std::move(batches.front());
+      batches.pop_front();
+      cv.notify_all();
+    }
+    auto num = batch.size();
+    out.publish(std::move(batch));
+    published += num;
+    msg_count += num;
+  }
+  parser.join();
+  using fractional_seconds = std::chrono::duration<double>;
+  auto runtime = std::chrono::duration_cast<fractional_seconds>(
+    std::chrono::steady_clock::now() - t0);
+  print_line(std::cerr, "*** published " + std::to_string(published)
+                          + " messages in " + std::to_string(runtime.count())
+                          + "s ("
+                          + std::to_string(published / runtime.count())
+                          + " msgs/s)");
+}
+
 void subscribe_mode_blocking(broker::endpoint& ep, const std::string& topic_str,
                     size_t cap) {
   auto in = ep.make_subscriber({topic_str});
@@ -245,6 +355,44 @@ void subscribe_mode_stream(broker::endpoint& ep, const std::string& topic_str,
   self->wait_for(worker);
 }
 
+void subscribe_mode_json(broker::endpoint& ep, const std::string& topic_str,
+                         size_t cap) {
+  // Writing to stdout in large chunks rather than per message is what allows
+  // this mode to keep up with high message rates.
+  constexpr size_t flush_threshold = 64 * 1024;
+  auto in = ep.make_subscriber({topic_str});
+  broker::detail::json_writer writer;
+  std::string buf;
+  buf.reserve(2 * flush_threshold);
+  std::vector<data_message> msgs;
+  auto flush = [&] {
+    guard_type guard{cout_mtx};
+    fwrite(buf.data(), 1, buf.size(), stdout);
+    fflush(stdout);
+    buf.clear();
+  };
+  size_t i = 0;
+  while (i < cap) {
+    // Block until at least one message arrives, then grab everything else
+    // that is already available.
+    msgs.clear();
+    msgs.emplace_back(in.get());
+    in.poll(msgs);
+    auto num = std::min(cap - i, msgs.size());
+    if (!rate) {
+      for (size_t j = 0; j < num; ++j) {
+        writer.append_line(buf, get_topic(msgs[j]), get_data(msgs[j]));
+        if (buf.size() >= flush_threshold)
+          flush();
+      }
+      if (!buf.empty())
+        flush();
+    }
+    i += num;
+    msg_count += num;
+  }
+}
+
 behavior event_listener(event_based_actor* self) {
   self->join(self->system().groups().get_local("broker/errors"));
   self->join(self->system().groups().get_local("broker/statuses"));
@@ -276,7 +424,6 @@ int main(int argc, char** argv) {
   }
   if (cfg.cli_helptext_printed)
     return EXIT_SUCCESS;
-  cfg.parse(argc, argv);
   broker::endpoint ep{std::move(cfg)};
   auto el = ep.system().spawn(event_listener);
   // Publish endpoint at demanded port.
@@ -336,6 +483,21 @@ int main(int argc, char** argv) {
     {subscribe_atom::value, select_atom::value},
     {subscribe_atom::value, stream_atom::value}
   };
+  if (cfg.format != text_atom::value && cfg.format != json_atom::value) {
+    std::cerr << "*** invalid format: " << to_string(cfg.format) << std::endl;
+    anon_send_exit(el, exit_reason::user_shutdown);
+    return EXIT_FAILURE;
+  }
+  if (cfg.format == json_atom::value) {
+    if (cfg.mode == publish_atom::value)
+      publish_mode_json(ep, cfg.topic, cfg.message_cap);
+    else if (cfg.mode == subscribe_atom::value)
+      subscribe_mode_json(ep, cfg.topic, cfg.message_cap);
+    else
+      dummy_mode(ep, cfg.topic, cfg.message_cap);
+    anon_send_exit(el, exit_reason::user_shutdown);
+    return EXIT_SUCCESS;
+  }
   auto b = std::begin(as);
   auto i = std::find(b, std::end(as), std::make_pair(cfg.mode, cfg.impl));
   auto f = fs[std::distance(b, i)];
@@ -0,0 +1,728 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <caf/atom.hpp>
+#include <caf/config_option_adder.hpp>
+#include <caf/error.hpp>
+
+#include "broker/backend.hh"
+#include "broker/backend_options.hh"
+#include "broker/configuration.hh"
+#include "broker/data.hh"
+#include "broker/error.hh"
+#include "broker/internal_command.hh"
+#include "broker/message.hh"
+#include "broker/optional.hh"
+#include "broker/time.hh"
+#include "broker/topic.hh"
+
+#include "broker/detail/abstract_backend.hh"
+#include "broker/detail/generator_file_reader.hh"
+#include "broker/detail/generator_file_writer.hh"
+#include "broker/detail/json_reader.hh"
+#include "broker/detail/json_writer.hh"
+#include "broker/detail/make_backend.hh"
+#include "broker/detail/store_workload.hh"
+
+using std::string;
+
+using broker::data;
+using broker::timespan;
+using broker::timestamp;
+
+using caf::atom;
+using caf::atom_value;
+
+namespace {
+
+// -- I/O utility --------------------------------------------------------------
+
+std::mutex cerr_mtx;
+
+template <class... Ts>
+void println(Ts&&... xs) {
+  std::unique_lock<std::mutex> guard{cerr_mtx};
+  (std::cerr << ... << xs) << std::endl;
+}
+
+void print_summary(const char* what, size_t num,
+                   std::chrono::steady_clock::time_point t0) {
+  using fractional_seconds = std::chrono::duration<double>;
+  auto runtime = std::chrono::duration_cast<fractional_seconds>(
+    std::chrono::steady_clock::now() - t0);
+  println("*** ", what, " ", num, " entries in ", runtime.count(), "s (",
+          num / runtime.count(), " entries/s)");
+}
+
+// -- program options ----------------------------------------------------------
+
+class config : public broker::configuration {
+public:
+  using super = broker::configuration;
+
+  config() : super(skip_init) {
+    opt_group{custom_options_, "global"}
+      .add<atom_value>("mode,m",
+                       "'export', 'import', or 'replay' (runs a workload "
+                       "recording of a master against the backend)")
+      .add<atom_value>("backend,b",
+                       "'sqlite', 'rocksdb', 'lmdb', or 'memory' (replay "
+                       "only)")
+      .add<string>("path,p", "path to the database of the backend")
+      .add<string>("file,f",
+                   "path to the dump file, or '-' for STDIN/STDOUT ('json' "
+                   "format only)")
+      .add<atom_value>("format",
+                       "'generator' (default) for a lossless dump in the "
+                       "generator file format or 'json' for NDJSON, which "
+                       "stores addresses, ports, etc. as strings")
+      .add<string>("name,n",
+                   "topic for entries in generator files (default: 'store')")
+      .add<size_t>("batch-size",
+                   "number of entries per read or write (default: 10000)")
+      .add<bool>("timed",
+                 "reproduce the timing of the recording when replaying");
+  }
+
+  using super::init;
+};
+
+// -- backend setup ------------------------------------------------------------
+
+std::unique_ptr<broker::detail::abstract_backend>
+open_backend(atom_value type, const string& path) {
+  broker::backend_options opts{{"path", path}};
+  if (type == atom("sqlite"))
+    return broker::detail::make_backend(broker::backend::sqlite,
+                                        std::move(opts));
+  if (type == atom("rocksdb"))
+    return broker::detail::make_backend(broker::backend::rocksdb,
+                                        std::move(opts));
+  if (type == atom("lmdb"))
+    return broker::detail::make_backend(broker::backend::lmdb,
+                                        std::move(opts));
+  if (type == atom("memory"))
+    return broker::detail::make_backend(broker::backend::memory,
+                                        std::move(opts));
+  println("*** invalid backend: ", to_string(type));
+  return nullptr;
+}
+
+// -- export -------------------------------------------------------------------
+
+using expiry_map = std::unordered_map<data, timestamp>;
+
+// Writes entries as put commands for the store `name`, which a master could
+// also replay. Entries without expiry go into one put_many command per batch.
+class generator_sink {
+public:
+  generator_sink(broker::detail::generator_file_writer_ptr out, string name)
+    : out_(std::move(out)), name_(std::move(name)) {
+    // nop
+  }
+
+  caf::error write(broker::detail::scan_batch& xs, const expiry_map& expiries,
+                   timestamp now) {
+    broker::put_many_command cmd;
+    for (auto& [key, value] : xs) {
+      if (auto i = expiries.find(key); i != expiries.end()) {
+        auto remaining = std::max(i->second - now, timespan{0});
+        auto put = broker::make_internal_command<broker::put_command>(
+          std::move(key), std::move(value), remaining);
+        if (auto err = out_->write(make_command_message(name_, put)))
+          return err;
+      } else {
+        cmd.entries.emplace(std::move(key), std::move(value));
+      }
+    }
+    if (cmd.entries.empty())
+      return caf::none;
+    broker::internal_command put_many{std::move(cmd)};
+    return out_->write(make_command_message(name_, std::move(put_many)));
+  }
+
+  caf::error flush() {
+    return out_->flush();
+  }
+
+private:
+  broker::detail::generator_file_writer_ptr out_;
+  broker::topic name_;
+};
+
+// Writes one JSON object with the fields "key", "value", and (optionally)
+// "expiry" per line.
+class json_sink {
+public:
+  explicit json_sink(FILE* out) : out_(out) {
+    // nop
+  }
+
+  ~json_sink() {
+    if (out_ != stdout)
+      fclose(out_);
+  }
+
+  caf::error write(const broker::detail::scan_batch& xs,
+                   const expiry_map& expiries, timestamp) {
+    buf_.clear();
+    for (auto& [key, value] : xs) {
+      buf_ += "{\"key\":";
+      writer_.append(buf_, key);
+      buf_ += ",\"value\":";
+      writer_.append(buf_, value);
+      if (auto i = expiries.find(key); i != expiries.end()) {
+        buf_ += ",\"expiry\":";
+        writer_.append(buf_, i->second);
+      }
+      buf_ += "}\n";
+    }
+    if (fwrite(buf_.data(), 1, buf_.size(), out_) != buf_.size())
+      return make_error(broker::ec::cannot_write_file);
+    return caf::none;
+  }
+
+  caf::error flush() {
+    if (fflush(out_) != 0)
+      return make_error(broker::ec::cannot_write_file);
+    return caf::none;
+  }
+
+private:
+  FILE* out_;
+  broker::detail::json_writer writer_;
+  string buf_;
+};
+
+template <class Sink>
+int export_store(broker::detail::abstract_backend& backend, Sink& sink,
+                 size_t batch_size) {
+  auto t0 = std::chrono::steady_clock::now();
+  auto now = broker::now();
+  expiry_map expiries;
+  if (auto xs = backend.expiries()) {
+    for (auto& [key, ts] : *xs)
+      expiries.emplace(std::move(key), ts);
+  } else {
+    println("*** unable to read expiries: ", to_string(xs.error()));
+    return EXIT_FAILURE;
+  }
+  size_t num = 0;
+  caf::error err;
+  auto res = backend.scan(broker::optional<data>{}, batch_size,
+                          [&](broker::detail::scan_batch& xs) {
+                            num += xs.size();
+                            err = sink.write(xs, expiries, now);
+                            return !err;
+                          });
+  if (!err && !res)
+    err = std::move(res.error());
+  if (!err)
+    err = sink.flush();
+  if (err) {
+    println("*** export failed: ", to_string(err));
+    return EXIT_FAILURE;
+  }
+  print_summary("exported", num, t0);
+  return EXIT_SUCCESS;
+}
+
+// -- import -------------------------------------------------------------------
+
+// A batch of entries for the backend. Entries with an expiry need individual
+// puts, since put_many applies a single expiry to all entries.
+struct import_batch {
+  std::unordered_map<data, data> entries;
+  std::vector<std::tuple<data, data, timestamp>> expiring;
+
+  size_t size() const {
+    return entries.size() + expiring.size();
+  }
+};
+
+// Hands batches from the reader thread to the thread writing to the backend.
+// Bounded to keep a slow backend from piling up the whole input in memory.
+class batch_queue {
+public:
+  static constexpr size_t max_size = 8;
+
+  void push(import_batch&& x) {
+    std::unique_lock<std::mutex> guard{mtx_};
+    cv_.wait(guard, [&] { return xs_.size() < max_size; });
+    xs_.emplace_back(std::move(x));
+    cv_.notify_all();
+  }
+
+  void close() {
+    std::unique_lock<std::mutex> guard{mtx_};
+    closed_ = true;
+    cv_.notify_all();
+  }
+
+  bool pop(import_batch& x) {
+    std::unique_lock<std::mutex> guard{mtx_};
+    cv_.wait(guard, [&] { return !xs_.empty() || closed_; });
+    if (xs_.empty())
+      return false;
+    x = std::move(xs_.front());
+    xs_.pop_front();
+    cv_.notify_all();
+    return true;
+  }
+
+private:
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<import_batch> xs_;
+  bool closed_ = false;
+};
+
+// Reads put and put_many commands from a generator file.
+caf::error read_generator_file(const string& fname, size_t batch_size,
+                               batch_queue& q) {
+  auto in = broker::detail::make_generator_file_reader(fname);
+  if (!in)
+    return make_error(broker::ec::cannot_open_file, fname);
+  auto now = broker::now();
+  import_batch batch;
+  broker::detail::generator_file_reader::value_type x;
+  while (!in->at_end()) {
+    if (auto err = in->read(x))
+      return err;
+    auto msg = caf::get_if<broker::command_message>(&x);
+    if (!msg)
+      continue;
+    auto& cmd = get_command(*msg);
+    if (auto put = caf::get_if<broker::put_command>(&cmd)) {
+      if (put->expiry)
+        batch.expiring.emplace_back(put->key, put->value, now + *put->expiry);
+      else
+        batch.entries.insert_or_assign(put->key, put->value);
+    } else if (auto put_many = caf::get_if<broker::put_many_command>(&cmd)) {
+      for (auto& [key, value] : put_many->entries) {
+        if (put_many->expiry)
+          batch.expiring.emplace_back(key, value, now + *put_many->expiry);
+        else
+          batch.entries.insert_or_assign(key, value);
+      }
+    }
+    if (batch.size() >= batch_size)
+      q.push(std::exchange(batch, import_batch{}));
+  }
+  if (batch.size() > 0)
+    q.push(std::move(batch));
+  return caf::none;
+}
+
+// Reads the output of `json_sink`.
+caf::error read_json_file(const string& fname, size_t batch_size,
+                          batch_queue& q) {
+  constexpr size_t chunk_size = 1024 * 1024;
+  auto in = fname == "-" ? stdin : fopen(fname.c_str(), "rb");
+  if (in == nullptr)
+    return make_error(broker::ec::cannot_open_file, fname);
+  auto guard = std::unique_ptr<FILE, int (*)(FILE*)>{
+    in != stdin ? in : nullptr, fclose};
+  auto field = [](broker::table& xs, const char* name) -> data* {
+    auto i = xs.find(name);
+    return i != xs.end() ? &i->second : nullptr;
+  };
+  import_batch batch;
+  string buf;
+  size_t pos = 0;
+  bool eof = false;
+  data x;
+  for (;;) {
+    const char* first = buf.data() + pos;
+    const char* last = buf.data() + buf.size();
+    if (auto err = broker::detail::json_reader::read(first, last, x)) {
+      if (err != broker::ec::end_of_file)
+        return err;
+      if (eof) {
+        if (buf.find_first_not_of(" \t\r\n", pos) != string::npos)
+          return make_error(broker::ec::invalid_data,
+                            "incomplete JSON value at end of input");
+        break;
+      }
+      buf.erase(0, pos);
+      pos = 0;
+      auto old_size = buf.size();
+      buf.resize(old_size + chunk_size);
+      auto n = fread(&buf[old_size], 1, chunk_size, in);
+      buf.resize(old_size + n);
+      if (n == 0) {
+        // The reader needs a delimiter after the last value.
+        eof = true;
+        buf += '\n';
+      }
+      continue;
+    }
+    pos = static_cast<size_t>(first - buf.data());
+    auto entry = caf::get_if<broker::table>(&x);
+    data* key = entry ? field(*entry, "key") : nullptr;
+    data* value = entry ? field(*entry, "value") : nullptr;
+    if (!key || !value)
+      return make_error(broker::ec::invalid_data,
+                        "expected an object with 'key' and 'value'");
+    if (auto expiry = field(*entry, "expiry")) {
+      auto secs = caf::get_if<broker::real>(expiry);
+      if (!secs)
+        return make_error(broker::ec::invalid_data,
+                          "expected 'expiry' in seconds since the epoch");
+      auto ts = timestamp{std::chrono::duration_cast<timespan>(
+        std::chrono::duration<double>{*secs})};
+      batch.expiring.emplace_back(std::move(*key), std::move(*value), ts);
+    } else {
+      batch.entries.insert_or_assign(std::move(*key), std::move(*value));
+    }
+    if (batch.size() >= batch_size)
+      q.push(std::exchange(batch, import_batch{}));
+  }
+  if (batch.size() > 0)
+    q.push(std::move(batch));
+  return caf::none;
+}
+
+int import_store(broker::detail::abstract_backend& backend, atom_value format,
+                 const string& fname, size_t batch_size) {
+  auto t0 = std::chrono::steady_clock::now();
+  // Parse the input in the background while writing to the backend.
+  batch_queue q;
+  caf::error read_err;
+  std::thread reader{[&] {
+    if (format == atom("json"))
+      read_err = read_json_file(fname, batch_size, q);
+    else
+      read_err = read_generator_file(fname, batch_size, q);
+    q.close();
+  }};
+  size_t num = 0;
+  caf::error write_err;
+  import_batch batch;
+  while (q.pop(batch)) {
+    if (write_err)
+      continue; // Drain the queue to unblock the reader.
+    if (!batch.entries.empty()) {
+      if (auto res = backend.put_many(batch.entries); !res)
+        write_err = std::move(res.error());
+    }
+    for (auto& [key, value, expiry] : batch.expiring) {
+      if (write_err)
+        break;
+      if (auto res = backend.put(key, std::move(value), expiry); !res)
+        write_err = std::move(res.error());
+    }
+    if (!write_err)
+      num += batch.size();
+  }
+  reader.join();
+  if (!write_err) {
+    if (auto res = backend.flush(); !res)
+      write_err = std::move(res.error());
+  }
+  if (read_err || write_err) {
+    println("*** import failed: ", to_string(read_err ? read_err : write_err));
+    return EXIT_FAILURE;
+  }
+  print_summary("imported", num, t0);
+  return EXIT_SUCCESS;
+}
+
+// -- replay -------------------------------------------------------------------
+
+constexpr const char* command_names[] = {
+  "none",     "put",           "put_unique", "erase",
+  "add",      "subtract",      "snapshot",   "snapshot_sync",
+  "set",      "clear",         "put_many",   "erase_many",
+  "compare_and_swap", "add_and_get",
+};
+
+// Statistics for one type of operation.
+struct op_stats {
+  size_t num = 0;
+  size_t failed = 0;
+  timespan runtime{0};
+};
+
+// Applies the commands of a workload recording to a backend the same way a
+// master does, ignoring all side effects for clones.
+struct command_replayer {
+  using result_type = caf::error;
+
+  broker::detail::abstract_backend& backend;
+  timestamp now;
+
+  broker::optional<timestamp> deadline(broker::optional<timespan> expiry) {
+    if (expiry)
+      return now + *expiry;
+    return broker::nil;
+  }
+
+  template <class T>
+  static caf::error lift(broker::expected<T>&& x) {
+    return x ? caf::none : std::move(x.error());
+  }
+
+  caf::error operator()(broker::none) {
+    return caf::none;
+  }
+
+  caf::error operator()(broker::put_command& x) {
+    return lift(backend.put(x.key, std::move(x.value), deadline(x.expiry)));
+  }
+
+  caf::error operator()(broker::put_unique_command& x) {
+    auto exists = backend.exists(x.key);
+    if (!exists)
+      return std::move(exists.error());
+    if (*exists)
+      return caf::none;
+    return lift(backend.put(x.key, std::move(x.value), deadline(x.expiry)));
+  }
+
+  caf::error operator()(broker::erase_command& x) {
+    return lift(backend.erase(x.key));
+  }
+
+  caf::error operator()(broker::add_command& x) {
+    return lift(
+      backend.add(x.key, x.value, x.init_type, deadline(x.expiry)));
+  }
+
+  caf::error operator()(broker::subtract_command& x) {
+    return lift(backend.subtract(x.key, x.value, deadline(x.expiry)));
+  }
+
+  caf::error operator()(broker::snapshot_command&) {
+    return caf::none;
+  }
+
+  caf::error operator()(broker::snapshot_sync_command&) {
+    return caf::none;
+  }
+
+  caf::error operator()(broker::set_command&) {
+    return caf::none;
+  }
+
+  caf::error operator()(broker::clear_command&) {
+    return lift(backend.clear());
+  }
+
+  caf::error operator()(broker::put_many_command& x) {
+    return lift(backend.put_many(x.entries, deadline(x.expiry)));
+  }
+
+  caf::error operator()(broker::erase_many_command& x) {
+    return lift(backend.erase_many(x.keys));
+  }
+
+  caf::error operator()(broker::compare_and_swap_command& x) {
+    auto current = backend.get(x.key);
+    if (!current && current.error() != broker::ec::no_such_key)
+      return std::move(current.error());
+    if ((current ? *current : data{}) != x.expected_value)
+      return caf::none;
+    return lift(backend.put(x.key, std::move(x.value), deadline(x.expiry)));
+  }
+
+  caf::error operator()(broker::add_and_get_command& x) {
+    auto added = backend.add(x.key, x.value, x.init_type, deadline(x.expiry));
+    if (!added)
+      return std::move(added.error());
+    return lift(backend.get(x.key));
+  }
+};
+
+// Runs a query of a workload recording. Missing keys do not count as errors,
+// since recordings only contain the shape of keys.
+caf::error replay_query(broker::detail::abstract_backend& backend,
+                        broker::detail::store_query query, const data& x) {
+  using broker::detail::store_query;
+  auto lift = [](auto&& res) -> caf::error {
+    if (res || res.error() == broker::ec::no_such_key)
+      return caf::none;
+    return std::move(res.error());
+  };
+  switch (query) {
+    case store_query::get:
+      return lift(backend.get(x));
+    case store_query::get_index:
+      if (auto xs = caf::get_if<broker::vector>(&x); xs && xs->size() == 2)
+        return lift(backend.get((*xs)[0], (*xs)[1]));
+      break;
+    case store_query::exists:
+      return lift(backend.exists(x));
+    case store_query::keys:
+      return lift(backend.keys());
+    case store_query::get_many:
+      if (auto xs = caf::get_if<broker::vector>(&x))
+        return lift(backend.get_many(*xs));
+      break;
+    case store_query::scan:
+      if (auto prefix = caf::get_if<string>(&x))
+        return lift(backend.scan(*prefix, 0));
+      break;
+  }
+  return make_error(broker::ec::invalid_data, "malformed query");
+}
+
+// Replays a workload recording of a master. Optionally waits between
+// operations to reproduce the timing of the recording.
+int replay_workload(broker::detail::abstract_backend& backend,
+                    const string& fname, bool timed) {
+  using clock_type = std::chrono::steady_clock;
+  auto in = broker::detail::make_generator_file_reader(fname);
+  if (!in) {
+    println("*** unable to open file: ", fname);
+    return EXIT_FAILURE;
+  }
+  if (timed && in->version() < 3) {
+    println("*** recording has no timestamps, replay without timing");
+    timed = false;
+  }
+  std::map<string, op_stats> stats;
+  auto flush_interval = backend.flush_interval();
+  auto t0 = clock_type::now();
+  auto last_flush = t0;
+  timestamp first;
+  size_t num = 0;
+  broker::detail::generator_file_reader::value_type x;
+  timestamp t;
+  while (!in->at_end()) {
+    if (auto err = in->read(x, t)) {
+      if (err == broker::ec::end_of_file)
+        break;
+      println("*** unable to read recording: ", to_string(err));
+      return EXIT_FAILURE;
+    }
+    if (timed) {
+      if (num == 0)
+        first = t;
+      std::this_thread::sleep_until(t0 + (t - first));
+    }
+    string name;
+    caf::error err;
+    auto start = clock_type::now();
+    if (auto msg = caf::get_if<broker::command_message>(&x)) {
+      auto cmd = move_command(*msg);
+      name = command_names[cmd.index()];
+      command_replayer f{backend, broker::now()};
+      err = caf::visit(f, cmd);
+    } else {
+      auto& msg = caf::get<broker::data_message>(x);
+      auto query = broker::detail::store_query::get;
+      if (!convert(get_topic(msg), query)) {
+        println("*** unexpected topic in recording: ",
+                get_topic(msg).string());
+        return EXIT_FAILURE;
+      }
+      name = to_string(query);
+      err = replay_query(backend, query, get_data(msg));
+    }
+    auto stop = clock_type::now();
+    auto& st = stats[name];
+    ++st.num;
+    st.runtime += stop - start;
+    if (err)
+      ++st.failed;
+    ++num;
+    if (flush_interval.count() > 0 && stop - last_flush >= flush_interval) {
+      if (auto res = backend.flush(); !res) {
+        println("*** flush failed: ", to_string(res.error()));
+        return EXIT_FAILURE;
+      }
+      last_flush = clock_type::now();
+    }
+  }
+  if (auto res = backend.flush(); !res) {
+    println("*** flush failed: ", to_string(res.error()));
+    return EXIT_FAILURE;
+  }
+  print_summary("replayed", num, t0);
+  using fractional_us = std::chrono::duration<double, std::micro>;
+  for (auto& [name, st] : stats) {
+    auto avg = std::chrono::duration_cast<fractional_us>(st.runtime).count()
+               / st.num;
+    println("    ", name, ": ", st.num, " operations, ", st.failed,
+            " failed, ", avg, "us on average");
+  }
+  return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  config cfg;
+  try {
+    cfg.init(argc, argv);
+  } catch (std::exception& ex) {
+    println("*** ", ex.what());
+    return EXIT_FAILURE;
+  }
+  if (cfg.cli_helptext_printed)
+    return EXIT_SUCCESS;
+  auto mode = caf::get_or(cfg, "mode", atom(""));
+  auto format = caf::get_or(cfg, "format", atom("generator"));
+  auto path = caf::get_or(cfg, "path", string{});
+  auto fname = caf::get_or(cfg, "file", string{});
+  auto name = caf::get_or(cfg, "name", string{"store"});
+  auto batch_size = std::max(caf::get_or(cfg, "batch-size", size_t{10000}),
+                             size_t{1});
+  auto backend_type = caf::get_or(cfg, "backend", atom(""));
+  if (fname.empty() || (path.empty() && backend_type != atom("memory"))) {
+    println("*** --path and --file are mandatory");
+    return EXIT_FAILURE;
+  }
+  if (format != atom("generator") && format != atom("json")) {
+    println("*** invalid format: ", to_string(format));
+    return EXIT_FAILURE;
+  }
+  if (format == atom("generator") && fname == "-") {
+    println("*** the generator format requires a file");
+    return EXIT_FAILURE;
+  }
+  auto backend = open_backend(backend_type, path);
+  if (!backend)
+    return EXIT_FAILURE;
+  if (mode == atom("import"))
+    return import_store(*backend, format, fname, batch_size);
+  if (mode == atom("replay"))
+    return replay_workload(*backend, fname, caf::get_or(cfg, "timed", false));
+  if (mode != atom("export")) {
+    println("*** invalid mode: ", to_string(mode));
+    return EXIT_FAILURE;
+  }
+  if (format == atom("json")) {
+    auto out = fname == "-" ? stdout : fopen(fname.c_str(), "wb");
+    if (out == nullptr) {
+      println("*** unable to open file: ", fname);
+      return EXIT_FAILURE;
+    }
+    json_sink sink{out};
+    return export_store(*backend, sink, batch_size);
+  }
+  auto out = broker::detail::make_generator_file_writer(fname);
+  if (!out) {
+    println("*** unable to open file: ", fname);
+    return EXIT_FAILURE;
+  }
+  generator_sink sink{std::move(out), std::move(name)};
+  return export_store(*backend, sink, batch_size);
+}
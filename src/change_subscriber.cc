@@ -0,0 +1,58 @@
+#include "broker/logger.hh" // Must come before any CAF include.
+#include "broker/change_subscriber.hh"
+
+#include <utility>
+#include <vector>
+
+#include <caf/event_based_actor.hpp>
+#include <caf/send.hpp>
+
+#include "broker/atoms.hh"
+
+using namespace caf;
+
+namespace broker {
+
+namespace {
+
+using queue_ptr = detail::shared_subscriber_queue_ptr<store_change>;
+
+/// Moves the changes from the master into the queue of the subscriber.
+behavior change_subscriber_worker(event_based_actor* self, queue_ptr qptr) {
+  return {
+    [=](std::vector<store_change>& xs) {
+      BROKER_DEBUG("received" << xs.size() << "store changes");
+      qptr->produce(std::move(xs));
+    },
+  };
+}
+
+} // namespace
+
+const char* to_string(store_change::kind x) {
+  switch (x) {
+    case store_change::kind::put:
+      return "put";
+    case store_change::kind::erase:
+      return "erase";
+    case store_change::kind::expire:
+      return "expire";
+    case store_change::kind::clear:
+      return "clear";
+    default:
+      return "???";
+  }
+}
+
+change_subscriber::change_subscriber(const actor& frontend, std::string prefix)
+  : super(std::numeric_limits<long>::max()), prefix_(std::move(prefix)) {
+  BROKER_INFO("creating change subscriber for prefix" << prefix_);
+  worker_ = frontend.home_system().spawn(change_subscriber_worker, queue_);
+  anon_send(frontend, atom::subscribe::value, prefix_, worker_);
+}
+
+change_subscriber::~change_subscriber() {
+  anon_send_exit(worker_, exit_reason::user_shutdown);
+}
+
+} // namespace broker
@@ -1,10 +1,12 @@
 #include "broker/configuration.hh"
 
+#include <algorithm>
 #include <ciso646>
 #include <cstdlib>
 #include <cstring>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -14,16 +16,23 @@
 
 #include "broker/address.hh"
 #include "broker/config.hh"
+#include "broker/consumer_group.hh"
 #include "broker/data.hh"
+#include "broker/detail/compression.hh"
+#include "broker/detail/packed_batch.hh"
+#include "broker/detail/thread_affinity.hh"
 #include "broker/endpoint.hh"
+#include "broker/event_filter.hh"
 #include "broker/internal_command.hh"
 #include "broker/port.hh"
+#include "broker/predicate.hh"
 #include "broker/snapshot.hh"
 #include "broker/status.hh"
 #include "broker/store.hh"
 #include "broker/subnet.hh"
 #include "broker/time.hh"
 #include "broker/topic.hh"
+#include "broker/topic_summary.hh"
 #include "broker/version.hh"
 
 #ifdef BROKER_WINDOWS
@@ -78,6 +87,44 @@ optional<caf::atom_value> to_log_level(const char* cstr) {
   throw std::invalid_argument(what);
 }
 
+/// Sets `key` to `value` unless the user configured it explicitly.
+template <class T>
+void set_default(configuration& cfg, caf::string_view key, T value) {
+  if (caf::get_if(&cfg.content, key) == nullptr)
+    cfg.set(key, std::move(value));
+}
+
+/// Applies the tuning profile from `broker.tuning-profile`, if any.
+void apply_tuning_profile(configuration& cfg) {
+  using namespace std::chrono_literals;
+  auto profile = get_or(cfg, "broker.tuning-profile", std::string{});
+  if (profile.empty())
+    return;
+  if (profile == "latency") {
+    // Emit small batches quickly and hand over CPUs between actors often.
+    set_default(cfg, "stream.desired-batch-complexity", timespan{10us});
+    set_default(cfg, "stream.max-batch-delay", timespan{1ms});
+    set_default(cfg, "stream.credit-round-interval", timespan{2ms});
+    set_default(cfg, "scheduler.max-throughput", size_t{100});
+  } else if (profile == "throughput") {
+    // Fill large batches and keep actors running as long as they have work.
+    set_default(cfg, "stream.desired-batch-complexity", timespan{500us});
+    set_default(cfg, "stream.max-batch-delay", timespan{20ms});
+    set_default(cfg, "stream.credit-round-interval", timespan{20ms});
+  } else {
+    throw std::invalid_argument(
+      concat("invalid value for broker.tuning-profile: '", profile,
+             "' (legal values: 'latency', 'throughput')"));
+  }
+}
+
+/// Keeps the actor system small for short-lived processes. Spawning a thread
+/// per core dominates the runtime of tools that only publish a few messages.
+void apply_fast_start(configuration& cfg) {
+  set_default(cfg, "scheduler.max-threads", size_t{2});
+  set_default(cfg, "middleman.workers", size_t{0});
+}
+
 } // namespace
 
 configuration::configuration(skip_init_t) {
@@ -94,12 +141,253 @@ configuration::configuration(skip_init_t) {
     .add<std::string>("recording-directory",
                       "path for storing recorded meta information")
     .add<size_t>("output-generator-file-cap",
-                 "maximum number of entries when recording published messages");
+                 "maximum number of entries when recording published messages")
+    .add<size_t>("recording-queue-size",
+                 "maximum number of messages waiting for the recorder thread")
+    .add<std::string>("recording-overflow",
+                      "'block' (default) or 'drop' messages when the recorder "
+                      "thread falls behind")
+    .add<size_t>("recording-segment-size",
+                 "start a new recording file after this many bytes "
+                 "(messages-0001.dat, messages-0002.dat, ...)")
+    .add<timespan>("recording-segment-duration",
+                   "start a new recording file after this amount of time")
+    .add<size_t>("recording-max-segments",
+                 "delete the oldest recording file when exceeding this "
+                 "number of files")
+    .add<size_t>("recording-sample-rate",
+                 "record only every n-th published message (1 records all "
+                 "messages, 0 none)")
+    .add<std::vector<std::string>>("recording-sample-rules",
+                                   "override the sample rate per topic "
+                                   "prefix, e.g., [\"zeek/logs:100\", "
+                                   "\"zeek/events:1\"]")
+    .add<double>("reconnect-backoff-factor",
+                 "grow the delay between reconnect attempts by this factor")
+    .add<timespan>("reconnect-max-delay",
+                   "upper bound for the delay between reconnect attempts")
+    .add<double>("reconnect-jitter",
+                 "randomize this fraction of the delay between reconnect "
+                 "attempts")
+    .add<timespan>("peer-resume-window",
+                   "time span for a lost peer to resume its session without "
+                   "sending its filter again (0 disables resumption)")
+    .add<std::string>("tuning-profile",
+                      "'latency' or 'throughput' to adjust CAF's stream and "
+                      "scheduler defaults")
+    .add<int>("core-cpu", "run the core actor in its own thread, pinned to "
+                          "this CPU (Linux only, -1 disables pinning)")
+    .add<int>("numa-node", "bind all threads to the CPUs of this NUMA node "
+                           "and prefer its memory (Linux only, -1 disables "
+                           "binding)")
+    .add<bool>("ktls", "let the kernel encrypt TLS records of peerings "
+                       "(Linux with OpenSSL 3.0 or later)")
+    .add<size_t>("publish-batch-size",
+                 "send messages from endpoint::publish to the core in "
+                 "batches of this size (values below 2 disable batching)")
+    .add<timespan>("publish-batch-delay",
+                   "maximum time a message from endpoint::publish waits for "
+                   "the remainder of its batch")
+    .add<size_t>("max-pending-handshakes",
+                 "reject peering requests while this many handshakes are in "
+                 "progress (0 disables the limit)")
+    .add<timespan>("filter-update-delay",
+                   "collect new subscriptions for this time span before "
+                   "sending them to peers")
+    .add<size_t>("filter-summary-threshold",
+                 "send new peers a Bloom filter summary instead of the filter "
+                 "once it has this many topics (0 disables summaries)")
+    .add<timespan>("status-interval",
+                   "collect status and error events for this time span and "
+                   "drop repeated events for the same peer (disabled by "
+                   "default)")
+    .add<size_t>("status-batch-size",
+                 "maximum number of status and error events per interval")
+    .add<std::vector<std::string>>("rate-limits",
+                                   "limit messages to peers per topic prefix, "
+                                   "e.g., [\"zeek/logs:1000:2000:drop\"] "
+                                   "(policies: drop, coalesce, sample/<n>)")
+    .add<std::vector<std::string>>("unreliable-topics",
+                                   "send messages on these topic prefixes to "
+                                   "peers outside of the stream, dropping "
+                                   "them on congested links")
+    .add<timespan>("rate-limit-flush-interval",
+                   "interval for forwarding coalesced messages to peers")
+    .add<bool>("peer-priorities",
+               "send control messages and store commands to peers ahead of "
+               "other data")
+    .add<size_t>("resolver-pool-size",
+                 "number of helper actors for resolving host names of peers "
+                 "(0 resolves in the middleman)")
+    .add<timespan>("resolver-cache-ttl",
+                   "time span for caching resolved host names")
+    .add<size_t>("blocked-peer-buffer-size",
+                 "bytes per blocked peer to keep in memory before spilling "
+                 "batches to disk")
+    .add<size_t>("blocked-peer-replay-batches",
+                 "maximum number of buffered batches per replay step after "
+                 "unblocking a peer")
+    .add<std::string>("peer-compression",
+                      "compress batches to peers that support it with "
+                      "'lz4' or 'zstd' (default: 'none')")
+    .add<size_t>("peer-compression-min-size",
+                 "minimum bytes per batch before compressing it")
+    .add<bool>("peer-packing",
+               "encode runs of messages with the same topic and TTL in "
+               "batches to peers with a single header")
+    .add<bool>("peer-compact-data",
+               "encode data in packed batches to peers that support it with "
+               "varints and short type tags")
+    .add<size_t>("decode-workers",
+                 "number of actors that decompress large batches from peers "
+                 "in parallel (0 decodes in the core)")
+    .add<size_t>("decode-offload-size",
+                 "minimum uncompressed bytes per batch before handing it to "
+                 "a decode worker");
+  opt_group{custom_options_, "broker.slow-peer"}
+    .add<timespan>("timeout",
+                   "isolate peers that run out of credit for longer than this "
+                   "time span (0 disables isolating peers)")
+    .add<std::string>("policy",
+                      "treatment of messages for isolated peers: 'buffer' "
+                      "(default), 'drop', or 'sample/<n>'")
+    .add<size_t>("buffer-size",
+                 "maximum number of messages an isolated peer may fall "
+                 "behind");
+  opt_group{custom_options_, "broker.shutdown"}
+    .add<timespan>("timeout",
+                   "keep sending buffered messages to peers for up to this "
+                   "time span on shutdown (0 terminates immediately)")
+    .add<std::string>("spill-file",
+                      "write messages that remain unsent after the timeout "
+                      "to this file in the generator format instead of "
+                      "dropping them");
+  opt_group{custom_options_, "broker.memory"}
+    .add<size_t>("subscriber-queues",
+                 "maximum bytes in the queues of local subscribers before "
+                 "applying backpressure (0 for no limit)")
+    .add<size_t>("blocked-peers",
+                 "maximum bytes that the core buffers for blocked peers "
+                 "before spilling to disk (0 for no limit)")
+    .add<size_t>("master-stores",
+                 "maximum bytes in master stores with a memory backend "
+                 "before rejecting writes (0 for no limit)")
+    .add<size_t>("clone-buffers",
+                 "maximum bytes that clones buffer before dropping writes "
+                 "(0 for no limit)");
+  opt_group{custom_options_, "broker.metrics"}
+    .add<timespan>("interval",
+                   "publish metrics to the local metrics topic at this "
+                   "interval (disabled by default)")
+    .add<uint16_t>("port",
+                   "serve metrics for Prometheus at this port (disabled by "
+                   "default)")
+    .add<timespan>("probe-interval",
+                   "probe the links to all peers at this interval for "
+                   "estimating RTT, jitter, and throughput (disabled by "
+                   "default)")
+    .add<std::string>("export-to",
+                      "send metric summaries of this endpoint and all "
+                      "endpoints below it to the peer at this host:port "
+                      "at each metrics interval")
+    .add<bool>("merge-summaries",
+               "combine all summaries into one before exporting them "
+               "instead of forwarding a summary per endpoint")
+    .add<timespan>("summary-ttl",
+                   "drop imported summaries that were not refreshed within "
+                   "this time span");
+  opt_group{custom_options_, "broker.store"}
+    .add<timespan>("coalesce-window",
+                   "collapse updates to the same key on masters within this "
+                   "time span before sending them to clones")
+    .add<size_t>("shards", "number of masters per data store, each owning a "
+                           "partition of the keys (must match on all nodes)")
+    .add<bool>("detach-persistent-masters",
+               "run masters with persistent backends in their own thread "
+               "to keep disk I/O off the scheduler")
+    .add<bool>("read-snapshots",
+               "serve local reads from in-memory masters from a snapshot "
+               "instead of querying the master actor")
+    .add<std::string>("snapshot-compression",
+                      "either 'none' (default), 'lz4', or 'zstd' for "
+                      "compressing snapshot transfers to clones")
+    .add<std::string>("workload-directory",
+                      "existing directory for recording all commands and "
+                      "queries of masters (store-<name>.dat)")
+    .add<bool>("deferred-expiries",
+               "let masters serve requests while loading expiration times "
+               "from their backend")
+    .add<timespan>("expiry-window",
+                   "let masters load only expirations within this time span "
+                   "from their backend at once (0 loads all at startup)")
+    .add<size_t>("clone-buffer-size",
+                 "maximum number of commands per clone buffer while the "
+                 "master is unavailable (0 disables the limit)")
+    .add<std::string>("clone-buffer-overflow",
+                      "either 'drop-oldest' or 'spill' (to disk) for full "
+                      "clone buffers")
+    .add<bool>("relay-clone-updates",
+               "forward updates from masters to clones on other peers")
+    .add<std::string>("clone-cache",
+                      "directory for persisting clones across restarts "
+                      "(disabled by default)")
+    .add<std::string>("clone-cache-backend",
+                      "either 'sqlite' (default) or 'rocksdb'")
+    .add<timespan>("clone-cache-interval",
+                   "how often clones write modifications to their cache")
+    .add<bool>("clone-checkpoint-transfer",
+               "let clones with a cache bootstrap from a copy of the backend "
+               "files of their master")
+    .add<bool>("clone-serve-stale",
+               "let clones answer queries from their previous content while "
+               "receiving a snapshot")
+    .add<bool>("clone-local-expiry",
+               "let clones expire keys on their own instead of receiving "
+               "erase commands from the master")
+    .add<size_t>("key-filter-bits-per-key",
+                 "let masters answer lookups for missing keys from a Bloom "
+                 "filter with this many bits per key (0 disables the filter)")
+    .add<size_t>("read-workers",
+                 "number of threads per master that answer queries for "
+                 "SQLite stores in WAL mode (0 disables readers)")
+    .add<timespan>("standby-resolve-interval",
+                   "how often standby masters look for their primary while "
+                   "they have none");
+  opt_group{custom_options_, "broker.publisher"}
+    .add<size_t>("queue-size",
+                 "number of items a publisher buffers before blocking")
+    .add<size_t>("queue-bytes",
+                 "approximate payload size in bytes a publisher buffers "
+                 "before blocking (disabled by default)")
+    .add<size_t>("rate-window",
+                 "number of seconds for averaging the send rate")
+    .add<timespan>("latency-target",
+                   "send partial batches when the queue runs empty or after "
+                   "this time span (disabled by default)")
+    .add<size_t>("zeek-batch-size",
+                 "pack up to this many Zeek events per topic into a single "
+                 "batch message (disabled by default)")
+    .add<timespan>("zeek-batch-latency",
+                   "maximum time span Zeek events wait in partial batches");
+  opt_group{custom_options_, "broker.subscriber"}
+    .add<bool>("unpack-zeek-batches",
+               "deliver the events of Zeek batch messages individually")
+    .add<size_t>("queue-bytes",
+                 "approximate payload size in bytes a subscriber buffers "
+                 "before it stops receiving (disabled by default)")
+    .add<timespan>("max-age",
+                   "time span after which subscribers discard messages "
+                   "they did not consume yet (disabled by default)");
   // Override CAF defaults.
   using caf::atom;
   set("logger.file-name", "broker_[PID]_[TIMESTAMP].log");
   set("logger.file-verbosity", atom("quiet"));
   set("logger.console-format", "[%c/%p] %d %m");
+  // CAF deserializes messages from remote nodes on a pool of BASP workers,
+  // but uses at most four workers by default. Scale the pool with the
+  // available cores to keep the multiplexer from becoming the bottleneck.
+  auto cores = std::thread::hardware_concurrency();
+  set("middleman.workers", static_cast<size_t>(std::max(cores / 2, 1u)));
   // Enable console output (and color it if stdout is a TTY) but set verbosty to
   // quiet. This allows users to only care about the environment variable
   // BROKER_CONSOLE_VERBOSITY.
@@ -134,8 +422,9 @@ void configuration::init(int argc, char** argv) {
   load<caf::io::middleman>();
   if (not options_.disable_ssl)
     load<caf::openssl::manager>();
+  add_thread_hook<detail::numa_hook>();
   // Phase 1: parse broker.conf (overrides hard-coded defaults).
-  if (!options_.ignore_broker_conf) {
+  if (!options_.ignore_broker_conf && !options_.fast_start) {
     if (auto err = parse(0, nullptr, conf_file)) {
       auto what = concat("Error while reading ", conf_file, ": ", render(err));
       throw std::runtime_error(what);
@@ -169,13 +458,17 @@ void configuration::init(int argc, char** argv) {
     set("broker.output-generator-file-cap", static_cast<size_t>(value));
   }
   // Phase 3: parse command line arguments.
-  if (argc == 0 || argv == nullptr)
-    return;
-  std::stringstream dummy;
-  if (auto err = parse(argc, argv, dummy)) {
-    auto what = concat("Error while parsing CLI arguments: ", render(err));
-    throw std::runtime_error(what);
+  if (argc > 0 && argv != nullptr) {
+    std::stringstream dummy;
+    if (auto err = parse(argc, argv, dummy)) {
+      auto what = concat("Error while parsing CLI arguments: ", render(err));
+      throw std::runtime_error(what);
+    }
   }
+  // Phase 4: fill in the defaults of the tuning profile.
+  apply_tuning_profile(*this);
+  if (options_.fast_start)
+    apply_fast_start(*this);
 }
 
 caf::settings configuration::dump_content() const {
@@ -210,12 +503,21 @@ void configuration::add_message_types(caf::actor_system_config& cfg) {
   ADD_MSG_TYPE(broker::optional<broker::timespan>);
   ADD_MSG_TYPE(broker::snapshot);
   ADD_MSG_TYPE(broker::internal_command);
+  ADD_MSG_TYPE(std::vector<broker::internal_command>);
   ADD_MSG_TYPE(broker::command_message);
   ADD_MSG_TYPE(broker::data_message);
   ADD_MSG_TYPE(broker::node_message);
   ADD_MSG_TYPE(broker::node_message::value_type);
   ADD_MSG_TYPE(broker::set_command);
   ADD_MSG_TYPE(broker::store::stream_type::value_type);
+  ADD_MSG_TYPE(broker::detail::compressed_batch);
+  ADD_MSG_TYPE(broker::detail::packed_batch);
+  ADD_MSG_TYPE(broker::predicate);
+  ADD_MSG_TYPE(broker::consumer_group);
+  ADD_MSG_TYPE(broker::event_filter);
+  ADD_MSG_TYPE(broker::topic_summary);
+  ADD_MSG_TYPE(broker::store_change);
+  ADD_MSG_TYPE(std::vector<broker::store_change>);
 }
 
 #undef ADD_MSG_TYPE
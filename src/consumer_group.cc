@@ -0,0 +1,33 @@
+#include "broker/consumer_group.hh"
+
+#include <algorithm>
+#include <iterator>
+
+namespace broker {
+
+namespace {
+
+constexpr const char* policy_names[] = {
+  "round-robin",
+  "key-hash",
+};
+
+} // namespace
+
+const char* to_string(group_policy x) {
+  return policy_names[static_cast<uint8_t>(x)];
+}
+
+bool convert(caf::string_view x, group_policy& y) {
+  auto first = std::begin(policy_names);
+  auto last = std::end(policy_names);
+  auto i = std::find_if(first, last, [&](const char* name) {
+    return x.compare(name) == 0;
+  });
+  if (i == last)
+    return false;
+  y = static_cast<group_policy>(std::distance(first, i));
+  return true;
+}
+
+} // namespace broker
@@ -1,5 +1,9 @@
 #include "broker/core_actor.hh"
 
+#include <algorithm>
+#include <chrono>
+#include <random>
+
 #include <caf/actor.hpp>
 #include <caf/actor_cast.hpp>
 #include <caf/allowed_unsafe_message_type.hpp>
@@ -9,11 +13,13 @@
 #include <caf/event_based_actor.hpp>
 #include <caf/exit_reason.hpp>
 #include <caf/group.hpp>
+#include <caf/io/middleman.hpp>
 #include <caf/make_counted.hpp>
 #include <caf/none.hpp>
 #include <caf/response_promise.hpp>
 #include <caf/result.hpp>
 #include <caf/sec.hpp>
+#include <caf/send.hpp>
 #include <caf/spawn_options.hpp>
 #include <caf/stateful_actor.hpp>
 #include <caf/stream.hpp>
@@ -26,18 +32,28 @@
 #include "broker/backend_options.hh"
 #include "broker/convert.hh"
 #include "broker/defaults.hh"
+#include "broker/detail/address_resolver.hh"
 #include "broker/detail/assert.hh"
 #include "broker/detail/clone_actor.hh"
+#include "broker/detail/compression.hh"
+#include "broker/detail/data_codec.hh"
 #include "broker/detail/filesystem.hh"
-#include "broker/detail/make_backend.hh"
+#include "broker/detail/generator_file_writer.hh"
+#include "broker/detail/line_writer.hh"
 #include "broker/detail/master_actor.hh"
 #include "broker/detail/master_resolver.hh"
+#include "broker/detail/prefix_matcher.hh"
+#include "broker/detail/prometheus_actor.hh"
+#include "broker/detail/shared_snapshot.hh"
+#include "broker/detail/store_router.hh"
+#include "broker/detail/thread_affinity.hh"
 #include "broker/endpoint.hh"
 #include "broker/error.hh"
 #include "broker/logger.hh"
 #include "broker/peer_status.hh"
 #include "broker/status.hh"
 #include "broker/topic.hh"
+#include "broker/topic_summary.hh"
 
 using namespace caf;
 
@@ -45,7 +61,8 @@ namespace broker {
 namespace detail {
 
 result<void> init_peering(caf::stateful_actor<core_state>* self,
-                          actor remote_core, response_promise rp) {
+                          actor remote_core, response_promise rp,
+                          size_t attempts = 0) {
   BROKER_TRACE(BROKER_ARG(remote_core));
   auto& st = self->state;
   // Sanity checking.
@@ -58,12 +75,24 @@ result<void> init_peering(caf::stateful_actor<core_state>* self,
     rp.deliver(caf::unit);
     return rp;
   }
-  if (st.peers_file)
-    st.peers_file << to_string(remote_core.node()) << std::endl;
+  if (st.peers_writer)
+    self->send(st.peers_writer,
+               std::vector<std::string>{to_string(remote_core.node())});
   // Create necessary state and send message to remote core.
   st.pending_peers.emplace(remote_core,
-                           core_state::pending_peer_state{0, rp});
-  self->send(self * remote_core, atom::peer::value, st.filter, self);
+                           core_state::pending_peer_state{0, rp, attempts});
+  // Resuming a previous session spares us from sending our filter again. The
+  // remote core asks for a full handshake if it cannot resume the session.
+  auto i = st.resume_tokens.find(remote_core.address());
+  if (i != st.resume_tokens.end()) {
+    auto token = i->second;
+    st.resume_tokens.erase(i);
+    self->send(self * remote_core, atom::peer::value, atom::resume::value,
+               token, digest(st.filter), self);
+  } else {
+    self->send(self * remote_core, atom::peer::value, st.handshake_filter(),
+               self);
+  }
   self->monitor(remote_core);
   return rp;
 }
@@ -71,24 +100,33 @@ result<void> init_peering(caf::stateful_actor<core_state>* self,
 struct retry_state {
   network_info addr;
   response_promise rp;
+  size_t attempts;
+
+  /// Schedules the next attempt or delivers `err` to the response promise if
+  /// retries are disabled for `addr`.
+  void retry_later(caf::stateful_actor<core_state>* self, error err) {
+    if (addr.retry.count() > 0) {
+      auto base = std::chrono::duration_cast<timespan>(addr.retry);
+      auto delay = self->state.reconnect_backoff.delay(base, attempts++);
+      BROKER_INFO("retrying" << addr << "in" << to_string(delay));
+      self->delayed_send(self, delay, std::move(*this));
+    } else {
+      rp.deliver(std::move(err));
+    }
+  }
 
   void try_once(caf::stateful_actor<core_state>* self) {
     auto cpy = std::move(*this);
     self->state.cache.fetch(
       cpy.addr,
       [self, cpy](actor x) mutable {
-        init_peering(self, std::move(x), std::move(cpy.rp));
+        init_peering(self, std::move(x), std::move(cpy.rp), cpy.attempts);
       },
       [self, cpy](error err) mutable {
         auto desc = "remote endpoint unavailable: " + self->system().render(err);
         BROKER_ERROR(desc);
         self->state.emit_error<ec::peer_unavailable>(cpy.addr, desc.c_str());
-        if (cpy.addr.retry.count() > 0) {
-          BROKER_INFO("retrying" << cpy.addr << "in"
-                                 << to_string(cpy.addr.retry));
-          self->delayed_send(self, cpy.addr.retry, cpy);
-        } else
-          cpy.rp.deliver(sec::cannot_connect_to_node);
+        cpy.retry_later(self, make_error(sec::cannot_connect_to_node));
       });
   }
 };
@@ -97,93 +135,299 @@ struct retry_state {
 } // namespace broker
 
 CAF_ALLOW_UNSAFE_MESSAGE_TYPE(broker::detail::retry_state)
+CAF_ALLOW_UNSAFE_MESSAGE_TYPE(broker::detail::shared_subscriber_queue_ptr<>)
 
 namespace broker {
 
 const char* core_state::name = "core";
 
 core_state::core_state(caf::event_based_actor* ptr)
-  : self(ptr),
+  : filter_update_delay(0),
+    filter_update_scheduled(false),
+    filter_summary_threshold(0),
+    summarize_filter(false),
+    events_changed(false),
+    self(ptr),
     cache(ptr),
+    max_pending_handshakes(0),
+    store_shards(1),
     shutting_down(false),
     clock(nullptr) {
   // nop
 }
 
 void core_state::init(filter_type initial_filter, broker_options opts,
-                      endpoint::clock* ep_clock) {
+                      endpoint::clock* ep_clock,
+                      detail::memory_accounting_ptr mem) {
   options = std::move(opts);
   filter = std::move(initial_filter);
+  normalize(filter);
   cache.set_use_ssl(! options.disable_ssl);
+  auto& cfg = self->config();
+  reconnect_backoff = detail::backoff{
+    get_or(cfg, "broker.reconnect-backoff-factor",
+           defaults::reconnect_backoff_factor),
+    get_or(cfg, "broker.reconnect-max-delay", defaults::reconnect_max_delay),
+    get_or(cfg, "broker.reconnect-jitter", defaults::reconnect_jitter)};
+  max_pending_handshakes = get_or(cfg, "broker.max-pending-handshakes",
+                                  defaults::max_pending_handshakes);
+  resume_window = get_or(cfg, "broker.peer-resume-window",
+                         defaults::peer_resume_window);
+  filter_update_delay = get_or(cfg, "broker.filter-update-delay",
+                               defaults::filter_update_delay);
+  filter_summary_threshold = get_or(cfg, "broker.filter-summary-threshold",
+                                    defaults::filter_summary_threshold);
+  status_batcher = detail::event_batcher{
+    get_or(cfg, "broker.status-interval", defaults::status_interval),
+    get_or(cfg, "broker.status-batch-size", defaults::status_batch_size)};
+  store_shards = std::max(get_or(cfg, "broker.store.shards",
+                                 defaults::store::shards),
+                          size_t{1});
+  if (mem)
+    memory = std::move(mem);
+  else
+    memory = caf::make_counted<detail::memory_accounting>(cfg);
   governor = caf::make_counted<governor_type>(self, this, filter);
   clock = ep_clock;
   auto meta_dir = get_or(self->config(), "broker.recording-directory",
                          defaults::recording_directory);
   if (!meta_dir.empty() && detail::is_directory(meta_dir)) {
-    auto file_name = meta_dir + "/topics.txt";
-    topics_file.open(file_name);
-    if (topics_file.is_open()) {
-      BROKER_DEBUG("opened file for recording:" << file_name);
-      for (const auto& x : filter) {
-        if (!(topics_file << x.string() << '\n')) {
-          BROKER_WARNING("failed to write to topics file");
-          topics_file.close();
-          break;
-        }
-      }
-      topics_file.flush();
-    } else {
-      BROKER_WARNING("cannot open recording file" << file_name);
-    }
-    peers_file.open(meta_dir + "/peers.txt");
-    if (!peers_file.is_open())
-      BROKER_WARNING("cannot open recording file" << file_name);
-    std::ofstream id_file{meta_dir + "/id.txt"};
-    id_file << to_string(self->node()) << '\n';
+    // Writers quit after writing all lines we sent before terminating.
+    auto spawn_writer = [&](const char* file_name) {
+      auto hdl = self->spawn<caf::detached>(detail::line_writer,
+                                            meta_dir + file_name);
+      self->attach_functor(
+        [hdl] { caf::anon_send(hdl, atom::shutdown::value); });
+      return hdl;
+    };
+    topics_writer = spawn_writer("/topics.txt");
+    std::vector<std::string> lines;
+    for (const auto& x : filter)
+      lines.emplace_back(x.string());
+    self->send(topics_writer, std::move(lines));
+    peers_writer = spawn_writer("/peers.txt");
+    self->send(spawn_writer("/id.txt"),
+               std::vector<std::string>{to_string(self->node())});
+  }
+  if (auto n = get_or(cfg, "broker.resolver-pool-size",
+                      defaults::resolver_pool_size);
+      n > 0) {
+    auto pool = detail::make_address_resolver_pool(self->system(),
+                                                   self->context(), n);
+    self->attach_functor([pool] {
+      caf::anon_send_exit(pool, caf::exit_reason::user_shutdown);
+    });
+    cache.set_resolver(std::move(pool),
+                       get_or(cfg, "broker.resolver-cache-ttl",
+                              defaults::resolver_cache_ttl));
+  }
+  if (auto limits = policy().rate_limits(); limits && limits->coalesces())
+    self->delayed_send(self,
+                       get_or(cfg, "broker.rate-limit-flush-interval",
+                              defaults::rate_limit_flush_interval),
+                       atom::tick::value, atom::flush::value);
+  auto interval = get_or(cfg, "broker.metrics.interval",
+                         defaults::metrics::interval);
+  if (interval.count() > 0)
+    self->delayed_send(self, interval, atom::tick::value,
+                       atom::metrics::value);
+  auto probe_interval = get_or(cfg, "broker.metrics.probe-interval",
+                               defaults::metrics::probe_interval);
+  if (probe_interval.count() > 0)
+    self->delayed_send(self, probe_interval, atom::tick::value,
+                       atom::probe::value);
+  if (auto port = get_or(cfg, "broker.metrics.port", defaults::metrics::port);
+      port > 0) {
+    auto& mm = self->system().middleman();
+    auto srv = mm.spawn_server(detail::prometheus_actor, port,
+                               caf::actor_cast<caf::actor>(self));
+    if (srv)
+      BROKER_INFO("serve metrics on port" << port);
+    else
+      BROKER_ERROR("unable to serve metrics on port" << port << ":"
+                   << srv.error());
   }
 }
 
 void core_state::update_filter_on_peers() {
-  BROKER_TRACE("");
-  policy().for_each_peer([&](const actor& hdl) {
-    self->send(hdl, atom::update::value, filter);
-  });
+  BROKER_TRACE(BROKER_ARG(filter_delta) << BROKER_ARG(events));
+  filter_update_scheduled = false;
+  if (!filter_delta.empty()) {
+    policy().for_each_peer([&](const actor& hdl) {
+      if (policy().accepts_filter_deltas(hdl))
+        self->send(hdl, atom::update::value, atom::add::value, filter_delta);
+      else
+        self->send(hdl, atom::update::value, filter);
+    });
+    filter_delta.clear();
+  }
+  // Peers that never received events from us restrict nothing. Hence, we send
+  // the event filter even if it became empty.
+  if (events_changed) {
+    events_changed = false;
+    policy().for_each_peer([&](const actor& hdl) {
+      self->send(hdl, atom::update::value, atom::events::value, events);
+    });
+  }
 }
 
 void core_state::add_to_filter(filter_type xs) {
-  BROKER_TRACE(BROKER_ARG(xs));
+  add_to_filter(std::move(xs), {});
+}
+
+void core_state::add_to_filter(filter_type xs,
+                               const std::vector<std::string>& event_names) {
+  BROKER_TRACE(BROKER_ARG(xs) << BROKER_ARG(event_names));
   // Status and error topics are internal topics.
   auto status_or_error = [](const topic& x) {
-    return x == topics::errors || x == topics::statuses;
+    return x == topics::errors || x == topics::statuses
+           || x == topics::metrics;
   };
   xs.erase(std::remove_if(xs.begin(), xs.end(), status_or_error), xs.end());
   if (xs.empty())
     return;
   // Simply append to topics without de-duplication.
-  if (topics_file.is_open()) {
-    for (const auto& x : xs) {
-      if (!(topics_file << x.string() << '\n')) {
-        BROKER_WARNING("failed to write to topics file");
-        topics_file.close();
-        break;
+  if (topics_writer) {
+    std::vector<std::string> lines;
+    lines.reserve(xs.size());
+    for (const auto& x : xs)
+      lines.emplace_back(x.string());
+    self->send(topics_writer, std::move(lines));
+  }
+  // Only keep topics that our filter does not cover already. Subscribers on
+  // covered topics may still change the events we need to receive.
+  normalize(xs);
+  if (add_subscribers(events, filter, xs, event_names)) {
+    BROKER_DEBUG("Changed event filter to " << events);
+    events_changed = true;
+    schedule_filter_update();
+  }
+  auto known = [&](const topic& x) { return covers(filter, x); };
+  xs.erase(std::remove_if(xs.begin(), xs.end(), known), xs.end());
+  if (xs.empty())
+    return;
+  // Merge the new topics into our filter. This may also drop topics that the
+  // new topics cover.
+  filter.insert(filter.end(), xs.begin(), xs.end());
+  normalize(filter);
+  BROKER_DEBUG("Changed filter to " << filter);
+  filter_delta.insert(filter_delta.end(), std::make_move_iterator(xs.begin()),
+                      std::make_move_iterator(xs.end()));
+  schedule_filter_update();
+}
+
+void core_state::schedule_filter_update() {
+  // Rather than updating our peers right away, we send a message to
+  // ourselves. This collects all subscriptions that are already waiting in
+  // our mailbox into a single update.
+  if (!filter_update_scheduled) {
+    filter_update_scheduled = true;
+    if (filter_update_delay.count() > 0)
+      self->delayed_send(self, filter_update_delay, atom::tick::value,
+                         atom::update::value);
+    else
+      self->send(self, atom::tick::value, atom::update::value);
+  }
+}
+
+void core_state::offer_filter_deltas(const caf::actor& hdl) {
+  self->send(hdl, atom::peer::value, atom::update::value, atom::add::value);
+}
+
+filter_type core_state::handshake_filter() {
+  if (filter_summary_threshold > 0
+      && filter.size() >= filter_summary_threshold)
+    summarize_filter = true;
+  if (!summarize_filter)
+    return filter;
+  // Peers that cannot handle summaries keep sending us everything, which
+  // remains correct since we match exactly against our subscribers.
+  return filter_type{topic{}};
+}
+
+void core_state::offer_filter_summary(const caf::actor& hdl) {
+  if (!summarize_filter)
+    return;
+  // Peers look up stores by their exact topics. Also leave room for topics
+  // that peers add to the summary from our filter deltas.
+  filter_type exact;
+  for (auto& x : filter)
+    if (x.is_internal())
+      exact.emplace_back(x);
+  topic_summary summary{filter, filter.size() * 2};
+  BROKER_DEBUG("send filter summary" << BROKER_ARG(hdl)
+               << BROKER_ARG2("bits", summary.num_bits()));
+  self->send(hdl, atom::update::value, atom::summary::value,
+             std::move(summary), std::move(exact));
+}
+
+void core_state::announce_events(const caf::actor& hdl) {
+  if (!events.empty())
+    self->send(hdl, atom::update::value, atom::events::value, events);
+}
+
+void core_state::continue_shutdown() {
+  auto& peers = policy().peers();
+  peers.force_emit_batches();
+  auto now = broker::now();
+  if (peers.unsent() > 0 && now < shutdown_deadline) {
+    auto delay = std::min(timespan{shutdown_deadline - now},
+                          defaults::shutdown::check_interval);
+    self->delayed_send(self, delay, atom::shutdown::value, atom::tick::value);
+    return;
+  }
+  auto unsent = spill_unsent();
+  shutdown_promise.deliver(static_cast<count>(unsent));
+  self->quit(caf::exit_reason::user_shutdown);
+}
+
+size_t core_state::spill_unsent() {
+  auto xs = policy().peers().take_unsent();
+  if (xs.empty())
+    return 0;
+  auto fname = get_or(self->config(), "broker.shutdown.spill-file",
+                      defaults::shutdown::spill_file);
+  if (!fname.empty()) {
+    if (auto out = detail::make_generator_file_writer(fname)) {
+      auto ok = std::all_of(xs.begin(), xs.end(), [&](const node_message& x) {
+        return !out->write(x.content);
+      });
+      if (ok && !out->flush()) {
+        BROKER_INFO("wrote" << xs.size() << "unsent messages to" << fname);
+        return xs.size();
       }
     }
-    topics_file.flush();
-  }
-  // Get initial size of our filter.
-  auto s0 = filter.size();
-  // Insert new elements then remove duplicates with sort and unique.
-  filter.insert(filter.end(), std::make_move_iterator(xs.begin()),
-                std::make_move_iterator(xs.end()));
-  std::sort(filter.begin(), filter.end());
-  auto e = std::unique(filter.begin(), filter.end());
-  if (e != filter.end())
-    filter.erase(e, filter.end());
-  // Update our peers if we have actually changed our filter.
-  if (s0 != filter.size()) {
-    BROKER_DEBUG("Changed filter to " << filter);
-    update_filter_on_peers();
+    BROKER_WARNING("failed to write unsent messages to" << fname);
   }
+  BROKER_WARNING("dropped" << xs.size() << "unsent messages on shutdown");
+  return xs.size();
+}
+
+void core_state::finish_master_lookup(const std::string& name,
+                                      const caf::message& result) {
+  auto i = pending_master_lookups.find(name);
+  if (i == pending_master_lookups.end())
+    return;
+  BROKER_DEBUG("finished master lookup for" << name << "with"
+                                            << i->second.size() << "clones");
+  for (auto& clone : i->second)
+    self->send(clone, result);
+  pending_master_lookups.erase(i);
+}
+
+caf::error core_state::attach_store(const caf::actor& hdl,
+                                    filter_type filter) {
+  // Initiate stream handshake and add subscriber to the governor.
+  using value_type = store::stream_type::value_type;
+  auto slot = governor->add_unchecked_outbound_path<value_type>(hdl);
+  if (slot == invalid_stream_slot)
+    return caf::sec::cannot_add_downstream;
+  // Subscribe to messages directly targeted at the store.
+  add_to_filter(filter);
+  // Move the slot to the stores downstream manager and set filter.
+  governor->out().assign<detail::core_policy::store_trait::manager>(slot);
+  policy().set_store_filter(slot, std::move(filter));
+  return caf::none;
 }
 
 bool core_state::has_peer(const caf::actor& x) {
@@ -204,6 +448,165 @@ detail::core_policy& core_state::policy() {
   return governor->policy();
 }
 
+void core_state::probe_links() {
+  for (auto i = links.begin(); i != links.end();) {
+    if (policy().has_peer(i->first))
+      ++i;
+    else
+      i = links.erase(i);
+  }
+  auto timeout = get_or(self->config(), "broker.metrics.probe-interval",
+                        defaults::metrics::probe_interval);
+  auto ptr = self;
+  policy().for_each_peer_path(
+    [&](const caf::actor& hdl, size_t, int64_t, int64_t) {
+      auto start = std::chrono::steady_clock::now();
+      self->request(hdl, timeout, atom::probe::value)
+        .then(
+          [ptr, hdl, start](uint64_t received) {
+            auto& st = ptr->state;
+            if (!st.policy().has_peer(hdl))
+              return;
+            auto rtt = std::chrono::duration_cast<timespan>(
+              std::chrono::steady_clock::now() - start);
+            st.links[hdl].record(rtt, received, broker::now());
+          },
+          [hdl](caf::error& err) {
+            // Peers running older versions do not answer probes.
+            BROKER_DEBUG("link probe to" << hdl << "failed:" << err);
+          });
+    });
+}
+
+data core_state::metrics_snapshot() {
+  table peers;
+  policy().for_each_peer_path(
+    [&](const caf::actor& hdl, size_t buffered, int64_t credit, int64_t) {
+      auto inf = cache.find(hdl);
+      auto name = inf ? to_string(*inf) : to_string(hdl.node());
+      table entry{{"queue-depth", count{buffered}},
+                  {"credit", integer{credit}}};
+      if (auto i = links.find(hdl);
+          i != links.end() && i->second.samples() > 0) {
+        entry.emplace("rtt", i->second.rtt());
+        entry.emplace("srtt", i->second.srtt());
+        entry.emplace("jitter", i->second.jitter());
+        entry.emplace("throughput", i->second.throughput());
+      }
+      peers.emplace(std::move(name), std::move(entry));
+    });
+  table result{{"timestamp", broker::now()},
+               {"peers", std::move(peers)},
+               {"unshares", count{policy().num_unshares()}}};
+  if (auto metrics = policy().metrics()) {
+    result.emplace("topics", metrics->topics_to_data());
+    result.emplace("batch-sizes", metrics->batch_sizes().to_data());
+  }
+  if (auto limits = policy().rate_limits()) {
+    table rate_limits;
+    for (auto& x : limits->rules())
+      rate_limits.emplace(x.config.prefix.string(),
+                          table{{"dropped", x.dropped},
+                                {"pending", count{x.pending.size()}}});
+    result.emplace("rate-limits", std::move(rate_limits));
+  }
+  result.emplace("memory", memory->to_data());
+  auto now = broker::now();
+  cluster_metrics.expire(now - get_or(self->config(),
+                                      "broker.metrics.summary-ttl",
+                                      defaults::metrics::summary_ttl));
+  if (!cluster_metrics.empty()) {
+    auto cluster = cluster_metrics;
+    cluster.merge(table{{to_string(self->node()), metrics_summary()}}, now);
+    result.emplace("cluster", cluster.total());
+  }
+  return result;
+}
+
+table core_state::metrics_summary() {
+  table result{{"endpoints", count{1}}};
+  if (auto metrics = policy().metrics()) {
+    result.emplace("topics", metrics->topics_to_data());
+    result.emplace("batch-sizes", metrics->batch_sizes().to_data());
+  }
+  detail::histogram rtts;
+  for (auto& kvp : links) {
+    if (kvp.second.samples() == 0)
+      continue;
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+      kvp.second.srtt());
+    rtts.observe(static_cast<uint64_t>(us.count()));
+  }
+  result.emplace("peer-rtts", rtts.to_data());
+  return result;
+}
+
+void core_state::export_metrics() {
+  auto& cfg = self->config();
+  auto parent_addr = get_or(cfg, "broker.metrics.export-to",
+                            defaults::metrics::export_to);
+  if (parent_addr.empty())
+    return;
+  caf::actor parent;
+  policy().for_each_peer([&](const caf::actor& hdl) {
+    if (auto inf = cache.find(hdl); inf && to_string(*inf) == parent_addr)
+      parent = hdl;
+  });
+  if (!parent) {
+    BROKER_DEBUG("cannot export metrics: no peer at" << parent_addr);
+    return;
+  }
+  auto now = broker::now();
+  cluster_metrics.expire(now - get_or(cfg, "broker.metrics.summary-ttl",
+                                      defaults::metrics::summary_ttl));
+  auto summaries = cluster_metrics.to_data();
+  auto name = to_string(self->node());
+  summaries[name] = metrics_summary();
+  if (get_or(cfg, "broker.metrics.merge-summaries",
+             defaults::metrics::merge_summaries)) {
+    detail::metrics_aggregator merged;
+    merged.merge(summaries, now);
+    summaries = table{{std::move(name), merged.total()}};
+  }
+  self->send(parent, atom::metrics::value, atom::update::value,
+             std::move(summaries));
+}
+
+table core_state::stats_snapshot() {
+  auto peer_name = [&](const caf::actor& hdl) {
+    auto inf = cache.find(hdl);
+    return inf ? to_string(*inf) : to_string(hdl.node());
+  };
+  table peers;
+  policy().for_each_peer_path([&](const caf::actor& hdl, size_t buffered,
+                                  int64_t credit, int64_t pending) {
+    peers.emplace(peer_name(hdl), table{{"queue-depth", count{buffered}},
+                                        {"credit", integer{credit}},
+                                        {"pending-batches", integer{pending}}});
+  });
+  table blocked;
+  policy().for_each_blocked_peer(
+    [&](const caf::actor& hdl, const detail::peer_buffer* buf) {
+      blocked.emplace(peer_name(hdl),
+                      table{{"batches", count{buf ? buf->size() : 0}},
+                            {"bytes", count{buf ? buf->memory_usage() : 0}},
+                            {"spilled", count{buf ? buf->spilled() : 0}}});
+    });
+  return table{{"timestamp", broker::now()},
+               {"mailbox-size", count{self->mailbox().size()}},
+               {"peers", std::move(peers)},
+               {"blocked-peers", std::move(blocked)},
+               {"workers", count{policy().workers().num_paths()}},
+               {"stores", count{policy().stores().num_paths()}},
+               {"duplicates", count{policy().num_duplicates()}},
+               {"unshares", count{policy().num_unshares()}},
+               {"status-events",
+                table{{"pending", count{status_batcher.size()}},
+                      {"suppressed", count{status_batcher.suppressed()}},
+                      {"dropped", count{status_batcher.dropped()}}}},
+               {"memory", memory->to_data()}};
+}
+
 static void sync_peer_status(core_state* st, caf::actor new_peer) {
   auto it = st->peers_awaiting_status_sync.find(new_peer);
 
@@ -244,13 +647,114 @@ void core_state::sync_with_status_subscribers(caf::actor new_peer) {
   }
 }
 
+void core_state::offer_session(const caf::actor& hdl) {
+  if (resume_window.count() <= 0)
+    return;
+  std::random_device rd;
+  auto token = (uint64_t{rd()} << 32) | rd();
+  session_tokens[hdl] = token;
+  self->send(hdl, atom::peer::value, atom::resume::value, token);
+}
+
+void core_state::suspend_session(const caf::actor& hdl,
+                                 const filter_type& peer_filter,
+                                 bool resumable) {
+  auto i = session_tokens.find(hdl);
+  if (i == session_tokens.end())
+    return;
+  auto token = i->second;
+  session_tokens.erase(i);
+  if (!resumable) {
+    resume_tokens.erase(hdl.address());
+    return;
+  }
+  // Drop expired sessions first to keep the map from growing.
+  auto now = broker::now();
+  for (auto j = suspended_sessions.begin(); j != suspended_sessions.end();) {
+    if (j->second.expires <= now)
+      j = suspended_sessions.erase(j);
+    else
+      ++j;
+  }
+  suspended_sessions[hdl.address()] = suspended_session{token, peer_filter,
+                                                        now + resume_window};
+}
+
+optional<filter_type> core_state::resume_session(const caf::actor& hdl,
+                                                 uint64_t token,
+                                                 uint64_t peer_digest) {
+  auto i = suspended_sessions.find(hdl.address());
+  if (i == suspended_sessions.end())
+    return nil;
+  auto session = std::move(i->second);
+  suspended_sessions.erase(i);
+  if (session.token != token || session.expires <= broker::now()
+      || digest(session.filter) != peer_digest)
+    return nil;
+  return std::move(session.filter);
+}
+
+void core_state::offer_compression(const caf::actor& hdl) {
+  auto offer = detail::supported_compressions();
+  if (!offer.empty())
+    self->send(hdl, atom::peer::value, atom::compress::value,
+               std::move(offer));
+}
+
+void core_state::offer_packing(const caf::actor& hdl) {
+  self->send(hdl, atom::peer::value, atom::pack::value);
+}
+
+void core_state::offer_codec(const caf::actor& hdl) {
+  self->send(hdl, atom::peer::value, atom::codec::value,
+             std::vector<std::string>{detail::data_codec::id});
+}
+
+static void push_to_status_queues(core_state* st, const data_message& msg) {
+  auto& xs = st->status_queues;
+  // Holding the only reference marks a destroyed status subscriber.
+  xs.erase(std::remove_if(xs.begin(), xs.end(),
+                          [](auto& x) { return x.second->unique(); }),
+           xs.end());
+  detail::prefix_matcher matches;
+  for (auto& kvp : xs)
+    if (matches(kvp.first, msg))
+      kvp.second->produce(msg);
+}
+
+void core_state::emit_event(data_message msg) {
+  if (!status_batcher.enabled()) {
+    push_event(std::move(msg));
+    return;
+  }
+  if (status_batcher.push(std::move(msg)))
+    self->delayed_send(self, status_batcher.interval(), atom::tick::value,
+                       atom::status::value);
+}
+
+void core_state::flush_events() {
+  auto xs = status_batcher.flush();
+  if (xs.empty())
+    return;
+  for (auto& x : xs)
+    push_to_status_queues(this, x);
+  governor->policy().local_push(std::move(xs));
+}
+
+void core_state::push_event(data_message msg) {
+  push_to_status_queues(this, msg);
+  governor->policy().local_push(std::move(msg));
+}
+
 void core_state::emit_peer_added_status(caf::actor hdl, const char* msg) {
+  // Never batched, because status subscribers must see this event before
+  // the first message from the new peer. Earlier events still go first.
   auto emit = [=](network_info x) {
     BROKER_INFO("status" << sc::peer_added << x);
     auto stat = status::make<sc::peer_added>(
       endpoint_info{hdl.node(), std::move(x)}, msg);
-    governor->policy().local_push(
-      make_data_message(topics::statuses, get_as<data>(stat)));
+    flush_events();
+    push_event(make_data_message(topics::statuses, get_as<data>(stat)));
     sync_with_status_subscribers(hdl);
   };
 
@@ -262,10 +766,69 @@ void core_state::emit_peer_added_status(caf::actor hdl, const char* msg) {
     emit({});
 }
 
+// Returns the Zeek events that the worker at `slot` handles, whereas an empty
+// list stands for all messages.
+static std::vector<std::string> event_names_of(core_state& st,
+                                               caf::stream_slot slot) {
+  if (auto pred = st.policy().worker_predicate(slot))
+    return pred->event_names;
+  return {};
+}
+
+// Checks whether we accept a peering request from `peer_hdl` (step #1).
+static bool admit_peering(caf::stateful_actor<core_state>* self,
+                          const caf::actor& peer_hdl) {
+  auto& st = self->state;
+  // Reject anonymous peering requests.
+  if (peer_hdl == nullptr) {
+    BROKER_DEBUG("Drop anonymous peering request.");
+    return false;
+  }
+  // Drop repeated handshake requests.
+  if (st.has_peer(peer_hdl)) {
+    BROKER_WARNING("Drop peering request from already connected peer.");
+    return false;
+  }
+  // Ask the peer to come back later when at the admission limit.
+  if (st.max_pending_handshakes > 0
+      && st.inbound_handshakes.size() >= st.max_pending_handshakes) {
+    BROKER_INFO("reject peering request: too many pending handshakes"
+                << BROKER_ARG(peer_hdl));
+    self->send(peer_hdl, atom::peer::value, atom::busy::value);
+    return false;
+  }
+  return true;
+}
+
+// Opens the stream to `peer_hdl` (step #1).
+static detail::core_policy::step1_handshake
+start_inbound_peering(caf::stateful_actor<core_state>* self,
+                      const caf::actor& peer_hdl, filter_type peer_ts) {
+  auto& st = self->state;
+  auto result = st.policy().start_peering<true>(peer_hdl, std::move(peer_ts));
+  if (result.value() != invalid_stream_slot)
+    st.inbound_handshakes.emplace(peer_hdl);
+  return result;
+}
+
 caf::behavior core_actor(caf::stateful_actor<core_state>* self,
                          filter_type initial_filter, broker_options options,
                          endpoint::clock* clock) {
-  self->state.init(std::move(initial_filter), std::move(options), clock);
+  return accounted_core_actor(self, std::move(initial_filter),
+                              std::move(options), clock, nullptr);
+}
+
+caf::behavior accounted_core_actor(caf::stateful_actor<core_state>* self,
+                                   filter_type initial_filter,
+                                   broker_options options,
+                                   endpoint::clock* clock,
+                                   detail::memory_accounting_ptr memory) {
+  self->state.init(std::move(initial_filter), std::move(options), clock,
+                   std::move(memory));
+  // Runs in the thread of the core when detached via `broker.core-cpu`.
+  auto cpu = get_or(self->config(), "broker.core-cpu", defaults::core_cpu);
+  if (cpu >= 0 && !detail::pin_current_thread(cpu))
+    BROKER_WARNING("unable to pin the core actor to CPU" << cpu);
   // We monitor remote inbound peerings and local outbound peerings.
   self->set_down_handler(
     [=](const caf::down_msg& down) {
@@ -314,14 +877,36 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
     },
     [=](atom::peer, network_info& addr) -> result<void> {
       auto rp = self->make_response_promise();
-      detail::retry_state rt{std::move(addr), rp};
+      detail::retry_state rt{std::move(addr), rp, 0};
       rt.try_once(self);
       return rp;
     },
     [=](atom::peer, atom::retry, network_info& addr) {
-      detail::retry_state rt{std::move(addr), {}};
+      // Sent by core_policy::peer_lost after the first delay.
+      detail::retry_state rt{std::move(addr), {}, 1};
       rt.try_once(self);
     },
+    [=](atom::peer, atom::busy) {
+      // The remote core rejected our handshake (step #1), because it has too
+      // many handshakes in progress.
+      auto& st = self->state;
+      auto hdl = caf::actor_cast<caf::actor>(self->current_sender());
+      auto i = st.pending_peers.find(hdl);
+      if (i == st.pending_peers.end() || i->second.slot != invalid_stream_slot)
+        return;
+      auto rp = std::move(i->second.rp);
+      auto attempts = i->second.attempts;
+      st.pending_peers.erase(i);
+      self->demonitor(hdl);
+      st.emit_error<ec::peer_unavailable>(hdl, "remote peer is busy");
+      if (auto addr = st.cache.find(hdl)) {
+        detail::retry_state rt{std::move(*addr), std::move(rp), attempts};
+        rt.retry_later(self, make_error(ec::peer_unavailable,
+                                        "remote peer is busy"));
+      } else {
+        rp.deliver(make_error(ec::peer_unavailable, "remote peer is busy"));
+      }
+    },
     [=](detail::retry_state& rt) { rt.try_once(self); },
     // --- 3-way handshake for establishing peering streams between A and B ----
     // --- A (this node) performs steps #1 and #3; B performs #2 and #4 --------
@@ -330,21 +915,47 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
     [=](atom::peer, filter_type& peer_ts,
         caf::actor& peer_hdl) -> detail::core_policy::step1_handshake {
       BROKER_TRACE(BROKER_ARG(peer_ts) << BROKER_ARG(peer_hdl));
-      auto& st = self->state;
-      // Reject anonymous peering requests.
-      if (peer_hdl == nullptr) {
-        BROKER_DEBUG("Drop anonymous peering request.");
+      if (!admit_peering(self, peer_hdl))
         return {};
-      }
-      // Drop repeated handshake requests.
-      if (st.has_peer(peer_hdl)) {
-        BROKER_WARNING("Drop peering request from already connected peer.");
-        return {};
-      }
       BROKER_DEBUG("received handshake step #1" << BROKER_ARG(peer_hdl)
                     << BROKER_ARG(actor{self}));
-      // Start CAF stream.
-      return st.policy().start_peering<true>(peer_hdl, std::move(peer_ts));
+      return start_inbound_peering(self, peer_hdl, std::move(peer_ts));
+    },
+    // Step #1 with a token from a previous session instead of the filter.
+    [=](atom::peer, atom::resume, uint64_t token, uint64_t peer_digest,
+        caf::actor& peer_hdl) -> detail::core_policy::step1_handshake {
+      BROKER_TRACE(BROKER_ARG(token) << BROKER_ARG(peer_hdl));
+      if (!admit_peering(self, peer_hdl))
+        return {};
+      auto& st = self->state;
+      auto peer_ts = st.resume_session(peer_hdl, token, peer_digest);
+      if (!peer_ts) {
+        BROKER_DEBUG("cannot resume session, ask for a full handshake"
+                     << BROKER_ARG(peer_hdl));
+        self->send(peer_hdl, atom::peer::value, atom::resume::value,
+                   atom::retry::value);
+        return {};
+      }
+      BROKER_INFO("resume session with" << peer_hdl);
+      return start_inbound_peering(self, peer_hdl, std::move(*peer_ts));
+    },
+    [=](atom::peer, atom::resume, atom::retry) {
+      // The remote core rejected our token (step #1). Send our filter.
+      auto& st = self->state;
+      auto hdl = caf::actor_cast<caf::actor>(self->current_sender());
+      auto i = st.pending_peers.find(hdl);
+      if (i == st.pending_peers.end() || i->second.slot != invalid_stream_slot)
+        return;
+      self->send(self * hdl, atom::peer::value, st.handshake_filter(), self);
+    },
+    // Sent by peers after the handshake to issue a token for resuming the
+    // session. Older nodes and nodes without a resume window never send it.
+    [=](atom::peer, atom::resume, uint64_t token) {
+      auto& st = self->state;
+      auto hdl = caf::actor_cast<caf::actor>(self->current_sender());
+      if (hdl == nullptr || !st.policy().has_peer(hdl))
+        return;
+      st.resume_tokens[hdl.address()] = token;
     },
     // Step #2: B establishes a stream to A and sends its own filter
     [=](const stream<node_message>& in, filter_type& filter,
@@ -362,6 +973,13 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
         st.policy().block_peer(peer_hdl);
       st.policy().ack_peering(in, peer_hdl);
       st.policy().start_peering<false>(peer_hdl, std::move(filter));
+      st.offer_compression(peer_hdl);
+      st.offer_packing(peer_hdl);
+      st.offer_codec(peer_hdl);
+      st.offer_filter_deltas(peer_hdl);
+      st.offer_filter_summary(peer_hdl);
+      st.offer_session(peer_hdl);
+      st.announce_events(peer_hdl);
       // Emit peer added event.
       st.emit_peer_added_status(peer_hdl, "received handshake from remote core");
       // Send handle to the actor that initiated a peering (if available).
@@ -384,11 +1002,75 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
         BROKER_DEBUG("Drop repeated step #3 handshake.");
         return;
       }
+      st.inbound_handshakes.erase(peer_hdl);
       if ( ! st.status_subscribers.empty() )
         st.policy().block_peer(peer_hdl);
+      st.offer_compression(peer_hdl);
+      st.offer_packing(peer_hdl);
+      st.offer_codec(peer_hdl);
+      st.offer_filter_deltas(peer_hdl);
+      st.offer_filter_summary(peer_hdl);
+      st.offer_session(peer_hdl);
+      st.announce_events(peer_hdl);
       st.emit_peer_added_status(peer_hdl, "handshake successful");
       st.policy().ack_peering(in, peer_hdl);
     },
+    // Sent by peers after the handshake to list the algorithms they can
+    // decompress. Nodes without compression support never send this message.
+    [=](atom::peer, atom::compress, const std::vector<std::string>& offer) {
+      auto& st = self->state;
+      auto hdl = caf::actor_cast<caf::actor>(self->current_sender());
+      if (hdl == nullptr || !st.policy().has_peer(hdl))
+        return;
+      st.policy().peers().negotiate_compression(hdl, offer);
+    },
+    // Sent by peers for messages of the unreliable delivery class, bypassing
+    // the stream.
+    [=](atom::unreliable, node_message& msg) {
+      auto& st = self->state;
+      auto hdl = caf::actor_cast<caf::actor>(self->current_sender());
+      if (hdl == nullptr || !st.policy().has_peer(hdl))
+        return;
+      st.policy().receive_unreliable(self->current_sender(), std::move(msg));
+    },
+    // Sent by peers after the handshake to signal that they accept packed
+    // batches. Older nodes never send this message.
+    [=](atom::peer, atom::pack) {
+      auto& st = self->state;
+      auto hdl = caf::actor_cast<caf::actor>(self->current_sender());
+      if (hdl == nullptr || !st.policy().has_peer(hdl))
+        return;
+      st.policy().peers().enable_packing(hdl);
+    },
+    // Sent by peers after the handshake to list the encodings of ::data they
+    // can decode. Older nodes never send this message.
+    [=](atom::peer, atom::codec, const std::vector<std::string>& offer) {
+      auto& st = self->state;
+      auto hdl = caf::actor_cast<caf::actor>(self->current_sender());
+      if (hdl == nullptr || !st.policy().has_peer(hdl))
+        return;
+      st.policy().peers().negotiate_codec(hdl, offer);
+    },
+    // Sent by peers after the handshake to signal that they apply incremental
+    // filter updates. Older nodes never send this message.
+    [=](atom::peer, atom::update, atom::add) {
+      auto& st = self->state;
+      auto hdl = caf::actor_cast<caf::actor>(self->current_sender());
+      if (hdl == nullptr || !st.policy().has_peer(hdl))
+        return;
+      st.policy().enable_filter_deltas(hdl);
+    },
+    // Sent by peers with large filters after the handshake. Replaces the
+    // wildcard from their handshake with a summary of their filter.
+    [=](atom::update, atom::summary, topic_summary& summary,
+        filter_type& exact) {
+      auto& st = self->state;
+      auto hdl = caf::actor_cast<caf::actor>(self->current_sender());
+      if (hdl == nullptr || !st.policy().has_peer(hdl))
+        return;
+      st.policy().update_peer_summary(hdl, std::move(summary),
+                                      std::move(exact));
+    },
     // --- asynchronous communication to peers ---------------------------------
     [=](atom::update, filter_type f) {
       BROKER_TRACE(BROKER_ARG(f));
@@ -401,6 +1083,30 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
       if (!st.policy().update_peer(p, std::move(f)))
         BROKER_DEBUG("Cannot update filter of unknown peer:" << to_string(p));
     },
+    [=](atom::update, atom::add, filter_type f) {
+      BROKER_TRACE(BROKER_ARG(f));
+      auto& st = self->state;
+      auto p = caf::actor_cast<caf::actor>(self->current_sender());
+      if (p == nullptr) {
+        BROKER_DEBUG("Received anonymous filter update.");
+        return;
+      }
+      if (!st.policy().add_to_peer_filter(p, std::move(f)))
+        BROKER_DEBUG("Cannot update filter of unknown peer:" << to_string(p));
+    },
+    // Sent by peers that have subscribers for specific Zeek events only. Older
+    // nodes never send this message.
+    [=](atom::update, atom::events, event_filter& f) {
+      BROKER_TRACE(BROKER_ARG(f));
+      auto& st = self->state;
+      auto p = caf::actor_cast<caf::actor>(self->current_sender());
+      if (p == nullptr) {
+        BROKER_DEBUG("Received anonymous event filter update.");
+        return;
+      }
+      if (!st.policy().update_peer_events(p, std::move(f)))
+        BROKER_DEBUG("Cannot update events of unknown peer:" << to_string(p));
+    },
     // --- communication to local actors: incoming streams and subscriptions ---
     [=](atom::join, filter_type& filter) {
       BROKER_TRACE(BROKER_ARG(filter));
@@ -410,16 +1116,34 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
         st.add_to_filter(std::move(filter));
       return result;
     },
+    [=](atom::join, filter_type& filter, predicate& pred) {
+      BROKER_TRACE(BROKER_ARG(filter));
+      auto& st = self->state;
+      auto result = st.governor->policy().add_worker(filter, std::move(pred));
+      if (result != invalid_stream_slot)
+        st.add_to_filter(std::move(filter), event_names_of(st, result));
+      return result;
+    },
+    [=](atom::join, filter_type& filter, predicate& pred,
+        consumer_group& group) {
+      BROKER_TRACE(BROKER_ARG(filter) << BROKER_ARG(group));
+      auto& st = self->state;
+      auto result = st.governor->policy().add_worker(filter, std::move(pred),
+                                                     group);
+      if (result != invalid_stream_slot)
+        st.add_to_filter(std::move(filter), event_names_of(st, result));
+      return result;
+    },
     [=](atom::join, atom::update, stream_slot slot, filter_type& filter) {
       auto& st = self->state;
-      st.add_to_filter(filter);
-      st.policy().workers().set_filter(slot, std::move(filter));
+      st.add_to_filter(filter, event_names_of(st, slot));
+      st.policy().set_worker_filter(slot, std::move(filter));
     },
     [=](atom::join, atom::update, stream_slot slot, filter_type& filter,
         caf::actor& who_asked) {
       auto& st = self->state;
-      st.add_to_filter(filter);
-      st.policy().workers().set_filter(slot, std::move(filter));
+      st.add_to_filter(filter, event_names_of(st, slot));
+      st.policy().set_worker_filter(slot, std::move(filter));
       self->send(who_asked, true);
     },
     [=](atom::join, atom::store, filter_type& filter) {
@@ -444,6 +1168,10 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
       BROKER_TRACE(BROKER_ARG(x));
       self->state.policy().push(std::move(x));
     },
+    [=](atom::publish, std::vector<data_message>& xs) {
+      BROKER_TRACE(BROKER_ARG2("num_items", xs.size()));
+      self->state.policy().push(std::move(xs));
+    },
     [=](atom::publish, command_message& x) {
       BROKER_TRACE(BROKER_ARG(x));
       self->state.policy().push(std::move(x));
@@ -451,31 +1179,26 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
     // --- communication to local actors only, i.e., never forward to peers ----
     [=](atom::publish, atom::local, data_message& x) {
       BROKER_TRACE(BROKER_ARG(x));
-      self->state.policy().local_push(std::move(x));
+      self->state.push_event(std::move(x));
     },
     [=](atom::publish, atom::local, command_message& x) {
       BROKER_TRACE(BROKER_ARG(x));
       self->state.policy().local_push(std::move(x));
     },
-    // --- "one-to-one" communication that bypasses streaming entirely ---------
+    // --- "one-to-one" communication over the peer streams --------------------
     [=](atom::publish, endpoint_info& e, data_message& x) {
       BROKER_TRACE(BROKER_ARG(e) << BROKER_ARG(x));
       auto& st = self->state;
-      actor hdl;
+      auto receiver = e.node;
       if (e.network) {
-        auto tmp = st.cache.find(*e.network);
-        if (tmp)
-          hdl = std::move(*tmp);
-      }
-      if (!hdl) {
-        auto predicate = [&](const actor& x) { return x.node() == e.node; };
-        hdl = st.policy().find_output_peer_hdl(std::move(predicate));
-        if (!hdl) {
-          BROKER_ERROR("no node found for endpoint info" << e);
-          return;
-        }
+        if (auto hdl = st.cache.find(*e.network))
+          receiver = hdl->node();
+      }
+      if (receiver == caf::none) {
+        BROKER_ERROR("no node found for endpoint info" << e);
+        return;
       }
-      self->send(hdl, atom::publish::value, atom::local::value, std::move(x));
+      st.policy().unicast(receiver, std::move(x));
     },
     // --- data store management -----------------------------------------------
     [=](atom::store, atom::master, atom::attach, const std::string& name,
@@ -500,29 +1223,119 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
         BROKER_WARNING("remote master with same name exists already");
         return ec::master_exists;
       }
-      BROKER_INFO("instantiating backend");
-      auto ptr = detail::make_backend(backend_type, std::move(opts));
-      BROKER_ASSERT(ptr);
-      BROKER_INFO("spawning new master");
-      auto ms = self->spawn<caf::linked + caf::lazy_init>(
-              detail::master_actor, self, name, std::move(ptr), clock);
-      st.masters.emplace(name, ms);
-      // Initiate stream handshake and add subscriber to the governor.
-      using value_type = store::stream_type::value_type;
-      auto slot = st.governor->add_unchecked_outbound_path<value_type>(ms);
-      if (slot == invalid_stream_slot) {
-        BROKER_ERROR("attaching master failed");
-        return caf::sec::cannot_add_downstream;
-      }
-      // Subscribe to messages directly targeted at the master.
-      filter_type filter{name / topics::master_suffix};
-      st.add_to_filter(filter);
-      // Move the slot to the stores downstream manager and set filter.
-      st.governor->out().assign<detail::core_policy::store_trait::manager>(slot);
-      st.policy().stores().set_filter(slot, std::move(filter));
-      // Done.
+      // Persistent backends block on disk I/O. Give them their own thread to
+      // keep the scheduler responsive.
+      auto detach = backend_type != backend::memory
+                    && get_or(self->config(),
+                              "broker.store.detach-persistent-masters",
+                              defaults::store::detach_persistent_masters);
+      // Copying the content after each write is only cheap enough for
+      // in-memory stores.
+      auto read_snapshots = backend_type == backend::memory
+                            && get_or(self->config(),
+                                      "broker.store.read-snapshots",
+                                      defaults::store::read_snapshots);
+      // Spawns a single master for `shard_name` with its own backend.
+      auto spawn_master = [&](const std::string& shard_name,
+                              backend_options shard_opts)
+        -> caf::expected<caf::actor> {
+        // The master opens its backend itself. Detached masters thus open
+        // their backends in parallel without blocking the core.
+        BROKER_INFO("spawning new master");
+        caf::actor ms;
+        if (detach)
+          ms = self->spawn<caf::linked + caf::detached>(
+                detail::master_actor, self, shard_name, backend_type,
+                std::move(shard_opts), clock, st.memory);
+        else
+          ms = self->spawn<caf::linked + caf::lazy_init>(
+                detail::master_actor, self, shard_name, backend_type,
+                std::move(shard_opts), clock, st.memory);
+        if (read_snapshots)
+          self->send(ms, atom::snapshot::value, atom::publish::value,
+                     std::make_shared<detail::shared_snapshot>());
+        st.masters.emplace(shard_name, ms);
+        if (auto err = st.attach_store(ms, {shard_name
+                                            / topics::master_suffix})) {
+          BROKER_ERROR("attaching master failed");
+          return err;
+        }
+        return ms;
+      };
+      if (st.store_shards == 1)
+        return spawn_master(name, std::move(opts));
+      // Each shard is a regular master with its own backend. Persistent
+      // backends store each shard in a separate file.
+      std::vector<caf::actor> shards;
+      for (size_t k = 0; k < st.store_shards; ++k) {
+        auto shard_opts = opts;
+        if (auto i = shard_opts.find("path"); i != shard_opts.end())
+          if (auto path = caf::get_if<std::string>(&i->second))
+            *path += '.' + std::to_string(k);
+        auto ms = spawn_master(detail::shard_name(name, k),
+                               std::move(shard_opts));
+        if (!ms)
+          return std::move(ms.error());
+        shards.emplace_back(std::move(*ms));
+      }
+      BROKER_INFO("spawning router for" << st.store_shards << "shards");
+      auto router = self->spawn<caf::linked>(detail::store_router, name,
+                                             std::move(shards));
+      st.masters.emplace(name, router);
+      return router;
+    },
+    [=](atom::store, atom::standby, atom::attach, const std::string& name,
+        backend backend_type,
+        backend_options& opts) -> caf::result<caf::actor> {
+      BROKER_TRACE(BROKER_ARG(name)
+                   << BROKER_ARG(backend_type) << BROKER_ARG(opts));
+      BROKER_INFO("attaching standby master:" << name);
+      auto& st = self->state;
+      if (st.masters.count(name) > 0) {
+        BROKER_WARNING("cannot run a standby next to its primary");
+        return ec::master_exists;
+      }
+      if (auto i = st.standbys.find(name); i != st.standbys.end()) {
+        BROKER_INFO("found local standby master");
+        return i->second;
+      }
+      if (st.store_shards != 1) {
+        BROKER_WARNING("standby masters do not support sharded stores");
+        return make_error(ec::unspecified,
+                          "standby masters require broker.store.shards = 1");
+      }
+      auto detach = backend_type != backend::memory
+                    && get_or(self->config(),
+                              "broker.store.detach-persistent-masters",
+                              defaults::store::detach_persistent_masters);
+      caf::actor ms;
+      if (detach)
+        ms = self->spawn<caf::linked + caf::detached>(
+              detail::standby_master_actor, self, name, backend_type,
+              std::move(opts), clock, st.memory);
+      else
+        ms = self->spawn<caf::linked + caf::lazy_init>(
+              detail::standby_master_actor, self, name, backend_type,
+              std::move(opts), clock, st.memory);
+      st.standbys.emplace(name, ms);
+      // The standby replicates the updates for clones and receives writes
+      // once it has taken over.
+      if (auto err = st.attach_store(ms, {name / topics::clone_suffix,
+                                          name / topics::master_suffix})) {
+        BROKER_ERROR("attaching standby master failed");
+        return err;
+      }
       return ms;
     },
+    [=](atom::store, atom::standby, atom::master, const std::string& name) {
+      auto& st = self->state;
+      auto i = st.standbys.find(name);
+      if (i == st.standbys.end())
+        return;
+      BROKER_INFO("standby master for" << name << "took over");
+      st.masters[name] = std::move(i->second);
+      st.standbys.erase(i);
+    },
     [=](atom::store, atom::clone, atom::attach, std::string& name,
         double resync_interval, double stale_interval,
         double mutation_buffer_interval) -> caf::result<caf::actor> {
@@ -542,28 +1355,36 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
       if (!cme.stages.empty())
         return ec::unspecified;
 
-      auto stages = std::move(cme.stages);
-      BROKER_INFO("spawning new clone");
-      auto clone = self->spawn<linked + lazy_init>(
-              detail::clone_actor, self, name, resync_interval, stale_interval,
-              mutation_buffer_interval, clock);
-      auto cptr = actor_cast<strong_actor_ptr>(clone);
-      auto& st = self->state;
-      st.clones.emplace(name, clone);
-      // Subscribe to updates.
-      using value_type = store::stream_type::value_type;
-      auto slot = st.governor->add_unchecked_outbound_path<value_type>(clone);
-      if (slot == invalid_stream_slot) {
-        BROKER_ERROR("attaching master failed");
-        return caf::sec::cannot_add_downstream;
-      }
-      // Subscribe to messages directly targeted at the clone.
-      filter_type filter{name / topics::clone_suffix};
-      st.add_to_filter(filter);
-      // Move the slot to the stores downstream manager and set filter.
-      st.governor->out().assign<detail::core_policy::store_trait::manager>(slot);
-      st.policy().stores().set_filter(slot, std::move(filter));
-      return clone;
+      auto& st = self->state;
+      // Spawns a single clone for `shard_name`.
+      auto spawn_clone = [&](const std::string& shard_name)
+        -> caf::expected<caf::actor> {
+        BROKER_INFO("spawning new clone");
+        auto clone = self->spawn<linked + lazy_init>(
+                detail::clone_actor, self, shard_name, resync_interval,
+                stale_interval, mutation_buffer_interval, clock, st.memory);
+        st.clones.emplace(shard_name, clone);
+        if (auto err = st.attach_store(clone, {shard_name
+                                               / topics::clone_suffix})) {
+          BROKER_ERROR("attaching clone failed");
+          return err;
+        }
+        return clone;
+      };
+      if (st.store_shards == 1)
+        return spawn_clone(name);
+      std::vector<caf::actor> shards;
+      for (size_t k = 0; k < st.store_shards; ++k) {
+        auto clone = spawn_clone(detail::shard_name(name, k));
+        if (!clone)
+          return std::move(clone.error());
+        shards.emplace_back(std::move(*clone));
+      }
+      BROKER_INFO("spawning router for" << st.store_shards << "shards");
+      auto router = self->spawn<linked>(detail::store_router, name,
+                                        std::move(shards));
+      st.clones.emplace(name, router);
+      return router;
       /* FIXME:
       auto spawn_clone = [=](const caf::actor& master) -> caf::actor {
         BROKER_INFO("spawning new clone");
@@ -643,6 +1464,7 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
       if (i != self->state.masters.end()) {
         BROKER_INFO("found local master, using direct link");
         self->send(who_asked, atom::master::value, i->second);
+        return;
       }
 
       auto peers = self->state.policy().get_peer_handles();
@@ -651,11 +1473,32 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
         BROKER_INFO("no peers to ask for the master");
         self->send(who_asked, atom::master::value,
                    make_error(ec::no_such_master, "no peers"));
+        return;
       }
 
+      // Clones retry periodically and several clones may attach to the same
+      // store, so we only run one resolver per store at a time.
+      auto& waiting = self->state.pending_master_lookups[name];
+      if (std::find(waiting.begin(), waiting.end(), who_asked)
+          != waiting.end())
+        return;
+      waiting.emplace_back(std::move(who_asked));
+      if (waiting.size() > 1) {
+        BROKER_DEBUG("join pending master lookup for" << name);
+        return;
+      }
       auto resolv = self->spawn<caf::lazy_init>(detail::master_resolver);
-      self->send(resolv, std::move(peers), std::move(name),
-                 std::move(who_asked));
+      self->send(resolv, std::move(peers), std::move(name), self);
+    },
+    [=](atom::master, atom::resolve, const std::string& name,
+        caf::actor& master) {
+      self->state.finish_master_lookup(
+        name, caf::make_message(atom::master::value, std::move(master)));
+    },
+    [=](atom::master, atom::resolve, const std::string& name,
+        caf::error& err) {
+      self->state.finish_master_lookup(
+        name, caf::make_message(atom::master::value, std::move(err)));
     },
     // --- accessors -----------------------------------------------------------
     [=](atom::get, atom::peer) {
@@ -685,6 +1528,100 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
           add(kvp.first, peer_status::connecting);
       return result;
     },
+    [=](atom::resume, atom::peer, caf::actor& hdl) {
+      self->state.policy().replay_blocked(hdl);
+    },
+    [=](atom::get, atom::metrics) -> data {
+      return self->state.metrics_snapshot();
+    },
+    [=](atom::get, atom::stats) -> caf::result<data> {
+      auto& st = self->state;
+      auto result = std::make_shared<table>(st.stats_snapshot());
+      std::vector<std::pair<std::string, caf::actor>> store_actors;
+      for (auto& kvp : st.masters)
+        store_actors.emplace_back("master", kvp.second);
+      for (auto& kvp : st.standbys)
+        store_actors.emplace_back("standby", kvp.second);
+      for (auto& kvp : st.clones)
+        store_actors.emplace_back("clone", kvp.second);
+      if (store_actors.empty())
+        return data{std::move(*result)};
+      // Ask each store with high priority to skip the regular mailbox, which
+      // may be the reason for asking in the first place.
+      auto rp = self->make_response_promise<data>();
+      auto stores = std::make_shared<vector>();
+      auto pending = std::make_shared<size_t>(store_actors.size());
+      auto deliver_if_done = [=]() mutable {
+        if (--*pending > 0)
+          return;
+        result->emplace("data-stores", std::move(*stores));
+        rp.deliver(data{std::move(*result)});
+      };
+      for (auto& kvp : store_actors) {
+        auto role = std::move(kvp.first);
+        self
+          ->request<caf::message_priority::high>(kvp.second,
+                                                 defaults::store::stats_timeout,
+                                                 atom::get::value,
+                                                 atom::stats::value)
+          .then(
+            [=](table& x) mutable {
+              x.emplace("role", role);
+              stores->emplace_back(std::move(x));
+              deliver_if_done();
+            },
+            [=](caf::error&) mutable { deliver_if_done(); });
+      }
+      return rp;
+    },
+    [=](atom::tick, atom::flush) {
+      auto& st = self->state;
+      st.policy().flush_rate_limits();
+      if (!st.shutting_down)
+        self->delayed_send(self,
+                           get_or(self->config(),
+                                  "broker.rate-limit-flush-interval",
+                                  defaults::rate_limit_flush_interval),
+                           atom::tick::value, atom::flush::value);
+    },
+    [=](atom::tick, atom::update) {
+      self->state.update_filter_on_peers();
+    },
+    [=](atom::tick, atom::status) {
+      self->state.flush_events();
+    },
+    [=](atom::tick, atom::metrics) {
+      auto& st = self->state;
+      st.policy().local_push(make_data_message(topics::metrics,
+                                               st.metrics_snapshot()));
+      st.export_metrics();
+      auto interval = get_or(self->config(), "broker.metrics.interval",
+                             defaults::metrics::interval);
+      if (interval.count() > 0 && !st.shutting_down)
+        self->delayed_send(self, interval, atom::tick::value,
+                           atom::metrics::value);
+    },
+    [=](atom::tick, atom::probe) {
+      auto& st = self->state;
+      st.probe_links();
+      auto interval = get_or(self->config(), "broker.metrics.probe-interval",
+                             defaults::metrics::probe_interval);
+      if (interval.count() > 0 && !st.shutting_down)
+        self->delayed_send(self, interval, atom::tick::value,
+                           atom::probe::value);
+    },
+    [=](atom::recording, atom::update, uint64_t rate,
+        const std::vector<std::string>& rules) {
+      self->state.policy().set_record_sampler(
+        detail::make_record_sampler(static_cast<size_t>(rate), rules));
+    },
+    [=](atom::metrics, atom::update, const table& summaries) {
+      self->state.cluster_metrics.merge(summaries, broker::now());
+    },
+    [=](atom::probe) -> uint64_t {
+      auto hdl = caf::actor_cast<caf::actor>(self->current_sender());
+      return self->state.policy().num_received_from(hdl);
+    },
     [=](atom::get, atom::peer, atom::subscriptions) {
       std::vector<topic> result;
       // Collect filters for all peers.
@@ -748,6 +1685,20 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
       );
       */
     },
+    [=](atom::shutdown, timespan timeout) {
+      // Unlike `shutdown` above, give peers until the deadline to consume
+      // what we have buffered for them.
+      auto& st = self->state;
+      BROKER_DEBUG("Drain peer buffers before terminating"
+                   << BROKER_ARG(timeout));
+      st.policy().peers().selector().active_sender = nullptr;
+      st.shutdown_deadline = broker::now() + timeout;
+      st.shutdown_promise = self->make_response_promise();
+      st.continue_shutdown();
+    },
+    [=](atom::shutdown, atom::tick) {
+      self->state.continue_shutdown();
+    },
     [=](atom::shutdown, atom::store) {
       strong_actor_ptr dummy;
       auto& st = self->state;
@@ -756,6 +1707,12 @@ caf::behavior core_actor(caf::stateful_actor<core_state>* self,
     },
     [=](atom::add, atom::status, caf::actor& ss) {
       self->state.status_subscribers.emplace(std::move(ss));
+    },
+    [=](atom::join, atom::status, filter_type& filter,
+        detail::shared_subscriber_queue_ptr<>& qptr) {
+      BROKER_TRACE(BROKER_ARG(filter));
+      self->state.status_queues.emplace_back(std::move(filter),
+                                             std::move(qptr));
     }};
 }
 
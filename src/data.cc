@@ -1,6 +1,12 @@
 #include "broker/data.hh"
+
+#include <cstring>
+#include <type_traits>
+
 #include "broker/convert.hh"
 
+#include "broker/detail/text_writer.hh"
+
 namespace broker {
 
 struct type_name_getter {
@@ -65,6 +71,10 @@ struct type_name_getter {
   result_type operator()(broker::vector) {
     return "vector";
   }
+
+  result_type operator()(const broker::packed_data&) {
+    return "packed data";
+  }
 };
 
 struct type_getter {
@@ -129,6 +139,10 @@ struct type_getter {
   result_type operator()(broker::vector) {
     return data::type::vector;
   }
+
+  result_type operator()(const broker::packed_data&) {
+    return data::type::packed_data;
+  }
 };
 
 data::type data::get_type() const {
@@ -167,6 +181,8 @@ data data::from_type(data::type t) {
     return broker::timestamp{};
   case data::type::vector:
     return broker::vector{};
+  case data::type::packed_data:
+    return broker::packed_data{};
   default:
     return data{};
   }
@@ -176,93 +192,217 @@ const char* data::get_type_name() const {
   return caf::visit(type_name_getter(), *this);
 }
 
-namespace {
+bool convert(const vector& v, std::string& str) {
+  detail::text_writer{}.append(str, v);
+  return true;
+}
 
-template <class Container>
-void container_convert(Container& c, std::string& str,
-                       const char* left, const char* right,
-                       const char* delim = ", ") {
-  auto first = begin(c);
-  auto last = end(c);
-  str += left;
-  if (first != last) {
-    str += to_string(*first);
-    while (++first != last)
-      str += delim + to_string(*first);
-  }
-  str += right;
+bool convert(const set& s, std::string& str) {
+  detail::text_writer{}.append(str, s);
+  return true;
 }
 
-struct data_converter {
-  using result_type = bool;
+bool convert(const table& t, std::string& str) {
+  detail::text_writer{}.append(str, t);
+  return true;
+}
 
-  template <class T>
-  result_type operator()(const T& x) {
-    return convert(x, str);
-  }
+bool convert(const data& d, std::string& str) {
+  str.clear();
+  detail::text_writer{}.append(str, d);
+  return true;
+}
 
-  result_type operator()(bool b) {
-    str = b ? 'T' : 'F';
-    return true;
-  }
+} // namespace broker
 
-  result_type operator()(const std::string& x) {
-    str = x;
-    return true;
-  }
+namespace broker::detail {
 
-  std::string& str;
-};
+namespace {
 
-} // namespace <anonymous>
+template <class T>
+int compare_values(const T& x, const T& y) {
+  return x < y ? -1 : (y < x ? 1 : 0);
+}
 
-bool convert(const table::value_type& e, std::string& str) {
-  str += to_string(e.first) + " -> " + to_string(e.second);
-  return true;
+int compare_values(const std::string& x, const std::string& y) {
+  return x.compare(y);
 }
 
-bool convert(const vector& v, std::string& str) {
-  container_convert(v, str, "(", ")");
-  return true;
+int compare_values(const data& x, const data& y) {
+  return compare(x, y);
 }
 
-bool convert(const set& s, std::string& str) {
-  container_convert(s, str, "{", "}");
-  return true;
+int compare_values(const table::value_type& x, const table::value_type& y) {
+  if (auto res = compare(x.first, y.first); res != 0)
+    return res;
+  return compare(x.second, y.second);
 }
 
-bool convert(const table& t, std::string& str) {
-  container_convert(t, str, "{", "}");
-  return true;
+// Lexicographical comparison that visits each element only once, whereas
+// std::lexicographical_compare calls operator< up to twice per element.
+template <class Container>
+int compare_ranges(const Container& xs, const Container& ys) {
+  auto i = xs.begin();
+  auto j = ys.begin();
+  for (; i != xs.end() && j != ys.end(); ++i, ++j)
+    if (auto res = compare_values(*i, *j); res != 0)
+      return res;
+  if (i != xs.end())
+    return 1;
+  return j != ys.end() ? -1 : 0;
 }
 
-bool convert(const data& d, std::string& str) {
-  caf::visit(data_converter{str}, d);
-  return true;
+int compare_values(const set& x, const set& y) {
+  return compare_ranges(x, y);
 }
 
-} // namespace broker
+int compare_values(const table& x, const table& y) {
+  return compare_ranges(x, y);
+}
 
-namespace std {
+int compare_values(const vector& x, const vector& y) {
+  return compare_ranges(x, y);
+}
 
-namespace {
+template <class State>
+struct hash_visitor {
+  using result_type = void;
 
-struct hasher {
-  using result_type = size_t;
+  State& st;
 
-  template <class T>
-  result_type operator()(const T& x) const {
-    return std::hash<T>{}(x);
+  void operator()(none) {
+    // nop
+  }
+
+  void operator()(boolean x) {
+    st.add(x ? 1 : 0);
+  }
+
+  void operator()(count x) {
+    st.add(x);
+  }
+
+  void operator()(integer x) {
+    st.add(static_cast<uint64_t>(x));
+  }
+
+  void operator()(real x) {
+    // Makes sure that 0.0 and -0.0 (which compare equal) have the same hash.
+    if (x == 0)
+      x = 0;
+    uint64_t bits;
+    static_assert(sizeof(bits) == sizeof(x));
+    std::memcpy(&bits, &x, sizeof(bits));
+    st.add(bits);
+  }
+
+  void operator()(const std::string& x) {
+    st.add_bytes(x.data(), x.size());
+  }
+
+  void operator()(const address& x) {
+    st.add_bytes(x.bytes().data(), x.bytes().size());
+  }
+
+  void operator()(const subnet& x) {
+    (*this)(x.network());
+    st.add(x.length());
+  }
+
+  void operator()(port x) {
+    st.add((static_cast<uint64_t>(x.type()) << 16) | x.number());
+  }
+
+  void operator()(timestamp x) {
+    st.add(static_cast<uint64_t>(x.time_since_epoch().count()));
+  }
+
+  void operator()(timespan x) {
+    st.add(static_cast<uint64_t>(x.count()));
+  }
+
+  void operator()(const enum_value& x) {
+    (*this)(x.name);
+  }
+
+  void operator()(const set& xs) {
+    st.add(xs.size());
+    for (auto& x : xs)
+      hash_append(st, x);
+  }
+
+  void operator()(const table& xs) {
+    st.add(xs.size());
+    for (auto& [key, val] : xs) {
+      hash_append(st, key);
+      hash_append(st, val);
+    }
+  }
+
+  void operator()(const vector& xs) {
+    st.add(xs.size());
+    for (auto& x : xs)
+      hash_append(st, x);
+  }
+
+  void operator()(const packed_data& x) {
+    st.add_bytes(x.bytes.data(), x.bytes.size());
   }
 };
 
-} // namespace <anonymous>
+} // namespace
+
+int compare(const data& x, const data& y) {
+  auto& xv = x.get_data();
+  auto& yv = y.get_data();
+  if (xv.index() != yv.index())
+    return xv.index() < yv.index() ? -1 : 1;
+  // Both values have the same type, so a single visit suffices.
+  return caf::visit(
+    [&](const auto& lhs) -> int {
+      using value_type = std::decay_t<decltype(lhs)>;
+      return compare_values(lhs, *caf::get_if<value_type>(&yv));
+    },
+    xv);
+}
+
+bool equals(const data& x, const data& y) {
+  auto& xv = x.get_data();
+  auto& yv = y.get_data();
+  if (xv.index() != yv.index())
+    return false;
+  return caf::visit(
+    [&](const auto& lhs) -> bool {
+      using value_type = std::decay_t<decltype(lhs)>;
+      return lhs == *caf::get_if<value_type>(&yv);
+    },
+    xv);
+}
+
+void hash_append(hash_state& st, const data& x) {
+  st.add(x.get_data().index());
+  caf::visit(hash_visitor<hash_state>{st}, x.get_data());
+}
+
+void hash_append(stable_hash_state& st, const data& x) {
+  st.add(x.get_data().index());
+  caf::visit(hash_visitor<stable_hash_state>{st}, x.get_data());
+}
+
+uint64_t stable_hash(const data& x) {
+  stable_hash_state st;
+  hash_append(st, x);
+  return st.result();
+}
+
+} // namespace broker::detail
+
+namespace std {
 
 size_t hash<broker::data>::operator()(const broker::data& v) const {
-  size_t result = 0;
-  broker::detail::hash_combine(result, v.get_data().index());
-  broker::detail::hash_combine(result, caf::visit(hasher{}, v));
-  return result;
+  broker::detail::hash_state st;
+  broker::detail::hash_append(st, v);
+  return st.result();
 }
 
 } // namespace std
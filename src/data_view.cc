@@ -0,0 +1,28 @@
+#include "broker/data_view.hh"
+
+#include "broker/packed.hh"
+
+namespace broker {
+
+data_view::data_view(data_message msg) : msg_(std::move(msg)) {
+  // nop
+}
+
+bool data_view::packed() const {
+  return is_packed(caf::get<1>(msg_));
+}
+
+const data* data_view::get() const {
+  if (decoded_ != nullptr)
+    return decoded_.get();
+  auto& x = caf::get<1>(msg_);
+  if (!is_packed(x))
+    return &x;
+  auto result = unpack(x);
+  if (!result)
+    return nullptr;
+  decoded_ = std::make_shared<data>(std::move(*result));
+  return decoded_.get();
+}
+
+} // namespace broker
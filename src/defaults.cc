@@ -1,5 +1,6 @@
 #include "broker/defaults.hh"
 
+#include <chrono>
 #include <limits>
 
 namespace broker {
@@ -9,5 +10,201 @@ const caf::string_view recording_directory = "";
 
 const size_t output_generator_file_cap = std::numeric_limits<size_t>::max();
 
+const size_t recording_queue_size = 8192;
+
+const caf::string_view recording_overflow = "block";
+
+const size_t recording_segment_size = 0;
+
+const timespan recording_segment_duration = timespan{0};
+
+const size_t recording_max_segments = 0;
+
+const size_t recording_sample_rate = 1;
+
+const double reconnect_backoff_factor = 2.0;
+
+const timespan reconnect_max_delay = std::chrono::seconds{120};
+
+const double reconnect_jitter = 0.25;
+
+const timespan peer_resume_window = timespan{0};
+
+const size_t max_pending_handshakes = 0;
+
+const timespan filter_update_delay = timespan{0};
+
+const size_t filter_summary_threshold = 0;
+
+const timespan status_interval = timespan{0};
+
+const size_t status_batch_size = 1000;
+
+const timespan rate_limit_flush_interval = std::chrono::milliseconds{100};
+
+const bool peer_priorities = true;
+
+const size_t resolver_pool_size = 4;
+
+const timespan resolver_cache_ttl = std::chrono::seconds{60};
+
+const size_t blocked_peer_buffer_size = 32 * 1024 * 1024;
+
+const size_t blocked_peer_replay_batches = 16;
+
+const size_t decode_workers = 0;
+
+const size_t decode_offload_size = 64 * 1024;
+
+const int core_cpu = -1;
+
+const int numa_node = -1;
+
+const bool ktls = false;
+
+const size_t publish_batch_size = 1;
+
+const timespan publish_batch_delay = std::chrono::microseconds{100};
+
+const caf::string_view peer_compression = "none";
+
+const size_t peer_compression_min_size = 1024;
+
+const bool peer_packing = true;
+
+const bool peer_compact_data = true;
+
+namespace publisher {
+
+const size_t queue_size = 30;
+
+const size_t queue_bytes = 0;
+
+const size_t rate_window = 10;
+
+const timespan latency_target = timespan{0};
+
+const size_t zeek_batch_size = 0;
+
+const timespan zeek_batch_latency = std::chrono::milliseconds{5};
+
+} // namespace publisher
+
+namespace subscriber {
+
+const bool unpack_zeek_batches = false;
+
+const size_t queue_bytes = 0;
+
+const timespan max_age = timespan{0};
+
+} // namespace subscriber
+
+namespace slow_peer {
+
+const timespan timeout = timespan{0};
+
+const caf::string_view policy = "buffer";
+
+const size_t buffer_size = 100000;
+
+} // namespace slow_peer
+
+namespace shutdown {
+
+const timespan timeout = timespan{0};
+
+const caf::string_view spill_file = "";
+
+const timespan check_interval = std::chrono::milliseconds{10};
+
+} // namespace shutdown
+
+namespace memory {
+
+const size_t subscriber_queues = 0;
+
+const size_t blocked_peers = 0;
+
+const size_t master_stores = 0;
+
+const size_t clone_buffers = 0;
+
+} // namespace memory
+
+namespace metrics {
+
+const timespan interval = timespan{0};
+
+const uint16_t port = 0;
+
+const timespan probe_interval = timespan{0};
+
+const caf::string_view export_to = "";
+
+const bool merge_summaries = false;
+
+const timespan summary_ttl = std::chrono::seconds{60};
+
+} // namespace metrics
+
+namespace store {
+
+const size_t snapshot_chunk_size = 1024;
+
+const caf::string_view snapshot_compression = "none";
+
+const caf::string_view workload_directory = "";
+
+const timespan snapshot_cache_window = std::chrono::seconds{1};
+
+const size_t replay_log_size = 4096;
+
+const timespan expiry_resolution = std::chrono::milliseconds{100};
+
+const timespan coalesce_window = timespan{0};
+
+const size_t shards = 1;
+
+const bool detach_persistent_masters = true;
+
+const bool read_snapshots = false;
+
+const bool deferred_expiries = false;
+
+const timespan expiry_window = timespan{0};
+
+const size_t expiry_load_chunk_size = 1024;
+
+const timespan stats_timeout = std::chrono::seconds{5};
+
+const size_t clone_buffer_size = 100000;
+
+const caf::string_view clone_buffer_overflow = "drop-oldest";
+
+const bool relay_clone_updates = false;
+
+const caf::string_view clone_cache = "";
+
+const caf::string_view clone_cache_backend = "sqlite";
+
+const timespan clone_cache_interval = std::chrono::seconds{1};
+
+const bool clone_checkpoint_transfer = false;
+
+const bool clone_serve_stale = false;
+
+const bool clone_local_expiry = false;
+
+const size_t checkpoint_chunk_size = 1024 * 1024;
+
+const size_t key_filter_bits_per_key = 0;
+
+const size_t read_workers = 0;
+
+const timespan standby_resolve_interval = std::chrono::seconds{1};
+
+} // namespace store
+
 } // namespace defaults
 } // namespace broker
@@ -1,9 +1,59 @@
 #include "broker/detail/appliers.hh"
 #include "broker/detail/abstract_backend.hh"
 
+#include <algorithm>
+
 namespace broker {
 namespace detail {
 
+expected<void>
+abstract_backend::put_many(const std::unordered_map<data, data>& entries,
+                           optional<timestamp> expiry) {
+  for (auto& kvp : entries) {
+    auto res = put(kvp.first, kvp.second, expiry);
+    if (!res)
+      return res;
+  }
+  return {};
+}
+
+expected<expirables> abstract_backend::expiries_between(timestamp from,
+                                                        timestamp until) const {
+  auto es = expiries();
+  if (!es)
+    return es;
+  expirables result;
+  for (auto& e : *es)
+    if (e.second > from && e.second <= until)
+      result.emplace_back(std::move(e));
+  return result;
+}
+
+expected<void> abstract_backend::erase_many(const std::vector<data>& keys) {
+  for (auto& key : keys) {
+    auto res = erase(key);
+    if (!res)
+      return res;
+  }
+  return {};
+}
+
+expected<std::vector<data>>
+abstract_backend::expire_many(const std::vector<data>& keys,
+                              timestamp current_time) {
+  std::vector<data> result;
+  for (auto& key : keys) {
+    auto res = expire(key, current_time);
+    if (!res) {
+      if (res.error() != ec::no_such_key)
+        return res.error();
+    } else if (*res) {
+      result.emplace_back(key);
+    }
+  }
+  return result;
+}
+
 expected<void> abstract_backend::add(const data& key, const data& value,
                                      data::type init_type,
                                      optional<timestamp> expiry) {
@@ -31,6 +81,27 @@ expected<void> abstract_backend::subtract(const data& key, const data& value,
   return put(key, *v, expiry);
 }
 
+expected<void> abstract_backend::flush() {
+  return {};
+}
+
+timespan abstract_backend::flush_interval() const {
+  return timespan{0};
+}
+
+size_t abstract_backend::memory_usage() const {
+  return 0;
+}
+
+std::unique_ptr<abstract_backend> abstract_backend::make_reader() const {
+  return nullptr;
+}
+
+expected<std::vector<std::string>>
+abstract_backend::checkpoint(const std::string&) {
+  return ec::backend_failure;
+}
+
 expected<data> abstract_backend::get(const data& key, const data& value) const {
   auto k = get(key);
   if (!k)
@@ -38,5 +109,62 @@ expected<data> abstract_backend::get(const data& key, const data& value) const {
   return caf::visit(retriever{value}, *k);
 }
 
+expected<data>
+abstract_backend::get_many(const std::vector<data>& keys) const {
+  table result;
+  for (auto& key : keys) {
+    auto value = get(key);
+    if (value)
+      result.emplace(key, std::move(*value));
+    else if (value.error() != ec::no_such_key)
+      return value;
+  }
+  return {std::move(result)};
+}
+
+expected<data> abstract_backend::scan(const std::string& prefix,
+                                      size_t limit) const {
+  auto ss = snapshot();
+  if (!ss)
+    return ss.error();
+  table result;
+  for (auto& kvp : *ss) {
+    if (!has_prefix(kvp.first, prefix))
+      continue;
+    result.emplace(kvp.first, std::move(kvp.second));
+    if (result.size() == limit)
+      break;
+  }
+  return {std::move(result)};
+}
+
+expected<optional<data>>
+abstract_backend::scan(const optional<data>& start, size_t batch_size,
+                       const scan_callback& f) const {
+  auto ss = snapshot();
+  if (!ss)
+    return ss.error();
+  // Sorting the keys gives us a stable order for resuming the scan.
+  scan_batch xs{std::make_move_iterator(ss->begin()),
+                std::make_move_iterator(ss->end())};
+  ss->clear();
+  std::sort(xs.begin(), xs.end(),
+            [](const auto& x, const auto& y) { return x.first < y.first; });
+  auto i = xs.begin();
+  if (start)
+    i = std::lower_bound(xs.begin(), xs.end(), *start,
+                         [](const auto& x, const data& y) {
+                           return x.first < y;
+                         });
+  scan_batcher batcher{batch_size, f};
+  for (; i != xs.end(); ++i) {
+    if (!batcher.flush_if_full())
+      return optional<data>{std::move(i->first)};
+    batcher.push(std::move(i->first), std::move(i->second));
+  }
+  batcher.finish();
+  return optional<data>{};
+}
+
 } // namespace detail
 } // namespace broker
@@ -0,0 +1,42 @@
+#include "broker/detail/address_resolver.hh"
+
+#include <string>
+
+#include <caf/actor_pool.hpp>
+#include <caf/actor_system.hpp>
+#include <caf/io/network/interfaces.hpp>
+#include <caf/result.hpp>
+#include <caf/sec.hpp>
+
+#include "broker/atoms.hh"
+#include "broker/logger.hh"
+
+namespace broker {
+namespace detail {
+
+caf::behavior address_resolver(caf::event_based_actor* self) {
+  return {
+    [=](atom::resolve, const std::string& host) -> caf::result<std::string> {
+      BROKER_DEBUG("resolve host" << host);
+      auto res = caf::io::network::interfaces::native_address(host);
+      if (!res) {
+        BROKER_INFO("unable to resolve host" << host);
+        return caf::make_error(caf::sec::cannot_connect_to_node,
+                               "unable to resolve host", host);
+      }
+      return std::move(res->first);
+    },
+  };
+}
+
+caf::actor make_address_resolver_pool(caf::actor_system& sys,
+                                      caf::execution_unit* ctx, size_t size) {
+  auto factory = [&sys] {
+    return sys.spawn<caf::detached + caf::hidden>(address_resolver);
+  };
+  return caf::actor_pool::make(ctx, size, factory,
+                               caf::actor_pool::round_robin());
+}
+
+} // namespace detail
+} // namespace broker
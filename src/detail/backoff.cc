@@ -0,0 +1,38 @@
+#include "broker/detail/backoff.hh"
+
+#include <algorithm>
+
+#include "broker/defaults.hh"
+
+namespace broker {
+namespace detail {
+
+backoff::backoff()
+  : backoff(defaults::reconnect_backoff_factor, defaults::reconnect_max_delay,
+            defaults::reconnect_jitter) {
+  // nop
+}
+
+backoff::backoff(double factor, timespan max_delay, double jitter)
+  : factor_(std::max(factor, 1.0)),
+    max_delay_(max_delay),
+    jitter_(std::min(std::max(jitter, 0.0), 1.0)),
+    rng_(std::random_device{}()) {
+  // nop
+}
+
+timespan backoff::delay(timespan base, size_t attempt) {
+  auto limit = static_cast<double>(std::max(base, max_delay_).count());
+  auto result = static_cast<double>(base.count());
+  for (size_t i = 0; i < attempt && result < limit; ++i)
+    result *= factor_;
+  result = std::min(result, limit);
+  if (jitter_ > 0) {
+    std::uniform_real_distribution<double> dist{1.0 - jitter_, 1.0};
+    result *= dist(rng_);
+  }
+  return timespan{static_cast<timespan::rep>(result)};
+}
+
+} // namespace detail
+} // namespace broker
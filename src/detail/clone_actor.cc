@@ -14,13 +14,19 @@
 #include "broker/atoms.hh"
 #include "broker/convert.hh"
 #include "broker/data.hh"
+#include "broker/defaults.hh"
 #include "broker/error.hh"
 #include "broker/store.hh"
 #include "broker/topic.hh"
 
+#include "broker/detail/abstract_backend.hh"
 #include "broker/detail/appliers.hh"
 #include "broker/detail/clone_actor.hh"
+#include "broker/detail/compression.hh"
+#include "broker/detail/filesystem.hh"
+#include "broker/detail/tracepoint.hh"
 
+#include <algorithm>
 #include <chrono>
 
 namespace broker {
@@ -34,13 +40,18 @@ static double now(endpoint::clock* clock)
 
 clone_state::clone_state() : self(nullptr), name(), master_topic(), core(),
   master(), store(), is_stale(), stale_time(), unmutable_time(),
-  mutation_buffer(), pending_remote_updates(), awaiting_snapshot(),
-  awaiting_snapshot_sync(), clock() {
+  mutation_buffer(), pending_remote_updates(), dropped_mutations(),
+  dropped_updates(), awaiting_snapshot(),
+  awaiting_snapshot_sync(), receiving_snapshot(), serve_stale(),
+  staged_snapshot(), resync_start(), last_seq(), local_expiry(),
+  deadlines(), expiry_buckets(), staged_deadlines(), deadlines_known(),
+  cache(), checkpoint_transfer(), checkpoint_failed(), unshares(), clock() {
   // nop
 }
 
 void clone_state::init(caf::event_based_actor* ptr, std::string&& nm,
-                       caf::actor&& parent, endpoint::clock* ep_clock) {
+                       caf::actor&& parent, endpoint::clock* ep_clock,
+                       memory_accounting_ptr mem) {
 
   self = ptr;
   name = std::move(nm);
@@ -53,6 +64,52 @@ void clone_state::init(caf::event_based_actor* ptr, std::string&& nm,
   clock = ep_clock;
   awaiting_snapshot = true;
   awaiting_snapshot_sync = true;
+  receiving_snapshot = false;
+  resync_start = clock->now();
+  last_seq = 0;
+  auto& cfg = self->config();
+  serve_stale = caf::get_or(cfg, "broker.store.clone-serve-stale",
+                            defaults::store::clone_serve_stale);
+  local_expiry = caf::get_or(cfg, "broker.store.clone-local-expiry",
+                             defaults::store::clone_local_expiry);
+  deadlines_known = true;
+  auto capacity = caf::get_or(cfg, "broker.store.clone-buffer-size",
+                              defaults::store::clone_buffer_size);
+  auto policy = command_buffer::overflow_policy::drop_oldest;
+  auto policy_str = caf::get_or(cfg, "broker.store.clone-buffer-overflow",
+                                defaults::store::clone_buffer_overflow);
+  if (!convert(policy_str, policy))
+    BROKER_WARNING("invalid clone-buffer-overflow" << policy_str
+                   << "(expected 'drop-oldest' or 'spill'), use 'drop-oldest'");
+  mutation_buffer.init(self->system(), capacity, policy, mem);
+  mutation_buffer.on_discard(
+    [this](const internal_command& cmd, command_buffer::discard_reason why) {
+      discard_local(cmd);
+      if (why == command_buffer::discard_reason::dropped)
+        ++dropped_mutations;
+    });
+  pending_remote_updates.init(self->system(), capacity, policy,
+                              std::move(mem));
+  pending_remote_updates.on_discard(
+    [this](const internal_command& cmd, command_buffer::discard_reason why) {
+      if (why == command_buffer::discard_reason::coalesced)
+        reconcile(cmd);
+      else
+        ++dropped_updates;
+    });
+  cache = make_clone_cache(cfg, name);
+  if (cache) {
+    last_seq = cache->load(store);
+    if (last_seq > 0) {
+      BROKER_INFO("restored" << store.size() << "entries with sequence number"
+                             << last_seq << "from the cache");
+      is_stale = false;
+      deadlines_known = false;
+    }
+    checkpoint_transfer = caf::get_or(
+      cfg, "broker.store.clone-checkpoint-transfer",
+      defaults::store::clone_checkpoint_transfer);
+  }
 }
 
 void clone_state::forward(internal_command&& x) {
@@ -62,6 +119,7 @@ void clone_state::forward(internal_command&& x) {
 
 void clone_state::command(internal_command::variant_type& cmd) {
   caf::visit(*this, cmd);
+  BROKER_TRACEPOINT(store_command_applied, cmd.index(), 1);
 }
 
 void clone_state::command(internal_command& cmd) {
@@ -73,7 +131,8 @@ void clone_state::operator()(none) {
 }
 
 void clone_state::operator()(put_command& x) {
-  BROKER_INFO("PUT" << x.key << "->" << x.value << "with expiry" << x.expiry);
+  BROKER_DEBUG("PUT" << x.key << "->" << x.value << "with expiry" << x.expiry);
+  modified(x.key);
   auto i = store.find(x.key);
   if (i != store.end())
     i->second = std::move(x.value);
@@ -82,17 +141,20 @@ void clone_state::operator()(put_command& x) {
 }
 
 void clone_state::operator()(put_unique_command& x) {
-  BROKER_INFO("PUT_UNIQUE" << x.key << "->" << x.value << "with expiry" << x.expiry);
+  BROKER_DEBUG("PUT_UNIQUE" << x.key << "->" << x.value << "with expiry" << x.expiry);
+  modified(x.key);
   store.emplace(std::move(x.key), std::move(x.value));
 }
 
 void clone_state::operator()(erase_command& x) {
-  BROKER_INFO("ERASE" << x.key);
+  BROKER_DEBUG("ERASE" << x.key);
+  modified(x.key);
   store.erase(x.key);
 }
 
 void clone_state::operator()(add_command& x) {
-  BROKER_INFO("ADD" << x.key << "->" << x.value);
+  BROKER_DEBUG("ADD" << x.key << "->" << x.value);
+  modified(x.key);
   auto i = store.find(x.key);
   if (i == store.end())
     i = store.emplace(std::move(x.key), data::from_type(x.init_type)).first;
@@ -100,9 +162,10 @@ void clone_state::operator()(add_command& x) {
 }
 
 void clone_state::operator()(subtract_command& x) {
-  BROKER_INFO("SUBTRACT" << x.key << "->" << x.value);
+  BROKER_DEBUG("SUBTRACT" << x.key << "->" << x.value);
   auto i = store.find(x.key);
   if (i != store.end()) {
+    modified(x.key);
     caf::visit(remover{x.value}, i->second);
   } else {
     // can happen if we joined a stream but did not yet receive set_command
@@ -122,18 +185,489 @@ void clone_state::operator()(snapshot_sync_command& x) {
 
 void clone_state::operator()(set_command& x) {
   BROKER_INFO("SET" << x.state);
+  replaced();
   store = std::move(x.state);
 }
 
 void clone_state::operator()(clear_command&) {
   BROKER_INFO("CLEAR");
+  replaced();
   store.clear();
 }
 
+void clone_state::operator()(put_many_command& x) {
+  BROKER_INFO("PUT_MANY" << x.entries.size() << "entries");
+  for (auto& kvp : x.entries) {
+    modified(kvp.first);
+    store[kvp.first] = std::move(kvp.second);
+  }
+}
+
+void clone_state::operator()(erase_many_command& x) {
+  BROKER_INFO("ERASE_MANY" << x.keys.size() << "keys");
+  for (auto& key : x.keys) {
+    modified(key);
+    store.erase(key);
+  }
+}
+
+void clone_state::operator()(compare_and_swap_command&) {
+  BROKER_ERROR("received a compare_and_swap_command in clone actor");
+}
+
+void clone_state::operator()(add_and_get_command&) {
+  BROKER_ERROR("received an add_and_get_command in clone actor");
+}
+
+void clone_state::apply_remote(internal_command& cmd) {
+  if (cmd.seq != 0) {
+    if (cmd.seq <= last_seq) {
+      BROKER_DEBUG("drop duplicate command with sequence number" << cmd.seq);
+      return;
+    }
+    last_seq = cmd.seq;
+  }
+  track_expiries(cmd.content);
+  reconcile(cmd);
+  command(cmd);
+}
+
+void clone_state::apply_snapshot_chunk(snapshot& chunk, uint64_t seq,
+                                       bool last) {
+  BROKER_INFO("SNAPSHOT CHUNK" << chunk.size() << "entries, last:" << last);
+  // Collecting the chunks separately lets queries see the previous content
+  // instead of a partial snapshot.
+  auto& dst = serve_stale ? staged_snapshot : store;
+  if (!receiving_snapshot) {
+    dst.clear();
+    if (!serve_stale)
+      replaced();
+    receiving_snapshot = true;
+  }
+  if (dst.empty())
+    dst = std::move(chunk);
+  else
+    dst.merge(chunk);
+  if (!last) {
+    // Offering our algorithms lets the master compress the remaining chunks.
+    auto hdl = caf::actor_cast<caf::actor>(self->current_sender());
+    auto offer = supported_compressions();
+    if (offer.empty())
+      self->send(hdl, atom::snapshot::value, atom::ack::value);
+    else
+      self->send(hdl, atom::snapshot::value, atom::ack::value,
+                 std::move(offer));
+    return;
+  }
+  if (serve_stale) {
+    store = std::move(staged_snapshot);
+    staged_snapshot = snapshot{};
+    replaced();
+  }
+  adopt_staged_deadlines();
+  receiving_snapshot = false;
+  awaiting_snapshot = false;
+  last_seq = seq;
+  if (!awaiting_snapshot_sync)
+    apply_pending_updates();
+}
+
+void clone_state::apply_checkpoint_chunk(const std::string& file,
+                                         const std::string& bytes,
+                                         uint64_t seq, bool last) {
+  if (!cache || cache->path().empty())
+    return;
+  auto staging = cache->path() + ".transfer";
+  if (checkpoint_file_name.empty()) {
+    BROKER_INFO("receive a checkpoint with sequence number" << seq);
+    remove_all(staging);
+    checkpoint_failed = false;
+  }
+  // Never write outside of the staging area.
+  if (file.find("..") != std::string::npos
+      || (!file.empty() && file.front() == '/')) {
+    BROKER_ERROR("invalid file name in checkpoint:" << file);
+    checkpoint_failed = true;
+  }
+  auto file_name = file.empty() ? staging : staging + '/' + file;
+  if (!checkpoint_failed && file_name != checkpoint_file_name) {
+    checkpoint_file.close();
+    checkpoint_file.clear();
+    if (!file.empty() && !is_directory(staging))
+      mkdirs(staging);
+    checkpoint_file.open(file_name, std::ios::binary | std::ios::trunc);
+  }
+  checkpoint_file_name = std::move(file_name);
+  if (!checkpoint_failed
+      && !checkpoint_file.write(bytes.data(),
+                                static_cast<std::streamsize>(bytes.size()))) {
+    BROKER_ERROR("unable to write checkpoint file" << checkpoint_file_name);
+    checkpoint_failed = true;
+  }
+  if (!last) {
+    self->send(caf::actor_cast<caf::actor>(self->current_sender()),
+               atom::snapshot::value, atom::write::value, atom::ack::value);
+    return;
+  }
+  checkpoint_file.close();
+  checkpoint_file_name.clear();
+  if (checkpoint_failed || !checkpoint_file) {
+    checkpoint_failed = false;
+    remove_all(staging);
+    BROKER_WARNING("clone" << name << "failed to receive a checkpoint,"
+                           << "request a snapshot instead");
+    awaiting_snapshot_sync = true;
+    self->send(core, atom::store::value, atom::master::value,
+               atom::snapshot::value, name, self);
+    return;
+  }
+  if (auto err = cache->adopt(staging, store, seq)) {
+    remove_all(staging);
+    BROKER_WARNING("clone" << name << "failed to load a checkpoint:" << err
+                           << "request a snapshot instead");
+    awaiting_snapshot_sync = true;
+    self->send(core, atom::store::value, atom::master::value,
+               atom::snapshot::value, name, self);
+    return;
+  }
+  BROKER_INFO("restored" << store.size() << "entries from a checkpoint");
+  adopt_staged_deadlines();
+  awaiting_snapshot = false;
+  last_seq = seq;
+  if (!awaiting_snapshot_sync)
+    apply_pending_updates();
+}
+
+void clone_state::apply_deltas(std::vector<internal_command>& deltas) {
+  BROKER_INFO("RESYNC with" << deltas.size() << "missing commands");
+  for (auto& cmd : deltas)
+    apply_remote(cmd);
+  awaiting_snapshot = false;
+  awaiting_snapshot_sync = false;
+  apply_pending_updates();
+}
+
+void clone_state::apply_pending_updates() {
+  if (dropped_updates > 0) {
+    // Applying the remaining updates would leave a gap in the sequence.
+    BROKER_WARNING("clone" << name << "dropped" << dropped_updates
+                           << "updates while waiting for a snapshot,"
+                           << "resynchronizing with the master");
+    clear_pending_updates();
+    request_resync();
+    return;
+  }
+  auto err = pending_remote_updates.drain(
+    [this](internal_command& cmd) { apply_remote(cmd); });
+  if (err) {
+    BROKER_ERROR("clone" << name << "failed to read buffered updates:" << err);
+    request_resync();
+  }
+}
+
+void clone_state::buffer_remote_update(internal_command&& cmd) {
+  if (auto err = pending_remote_updates.push(std::move(cmd))) {
+    BROKER_ERROR("clone" << name << "failed to buffer an update:" << err);
+    ++dropped_updates;
+  }
+}
+
+void clone_state::buffer_mutation(internal_command&& cmd) {
+  apply_local(cmd);
+  if (auto err = mutation_buffer.push(std::move(cmd)))
+    BROKER_ERROR("clone" << name << "failed to buffer a local write:" << err);
+}
+
+void clone_state::flush_mutation_buffer() {
+  auto err = mutation_buffer.drain(
+    [this](internal_command& cmd) { forward(std::move(cmd)); });
+  if (err)
+    BROKER_ERROR("clone" << name << "failed to read buffered writes:" << err);
+  if (dropped_mutations > 0) {
+    BROKER_WARNING("clone" << name << "dropped" << dropped_mutations
+                           << "local writes while the master was unavailable");
+    dropped_mutations = 0;
+  }
+}
+
+void clone_state::clear_mutation_buffer() {
+  mutation_buffer.clear();
+  dropped_mutations = 0;
+}
+
+void clone_state::clear_pending_updates() {
+  pending_remote_updates.clear();
+  dropped_updates = 0;
+}
+
+bool clone_state::can_request_deltas(const caf::actor& new_master) const {
+  // Masters start their sequence numbers at random offsets, so asking another
+  // master for deltas simply results in a full snapshot. A standby that took
+  // over continues the sequence numbers of its primary, which lets clones
+  // restored from their cache or synced with the old master catch up. With
+  // local expiry, content from the cache also needs the expiration times that
+  // come with a snapshot.
+  return new_master && last_seq > 0 && (!local_expiry || deadlines_known);
+}
+
+void clone_state::request_resync() {
+  begin_resync();
+  if (can_request_deltas(master)) {
+    self->send(master, atom::snapshot::value, last_seq);
+    return;
+  }
+  request_snapshot();
+}
+
+void clone_state::track_expiries(const internal_command::variant_type& cmd) {
+  if (!local_expiry)
+    return;
+  // Mirrors the backends of the master, which replace the expiration time of
+  // a key on each modification.
+  auto deadline = [this](const caf::optional<timespan>& expiry) {
+    optional<timestamp> result;
+    if (expiry)
+      result = clock->now() + *expiry;
+    return result;
+  };
+  if (auto x = caf::get_if<put_command>(&cmd)) {
+    set_deadline(x->key, deadline(x->expiry));
+  } else if (auto x = caf::get_if<put_unique_command>(&cmd)) {
+    set_deadline(x->key, deadline(x->expiry));
+  } else if (auto x = caf::get_if<erase_command>(&cmd)) {
+    set_deadline(x->key, caf::none);
+  } else if (auto x = caf::get_if<add_command>(&cmd)) {
+    set_deadline(x->key, deadline(x->expiry));
+  } else if (auto x = caf::get_if<subtract_command>(&cmd)) {
+    set_deadline(x->key, deadline(x->expiry));
+  } else if (auto x = caf::get_if<put_many_command>(&cmd)) {
+    auto t = deadline(x->expiry);
+    for (auto& kvp : x->entries)
+      set_deadline(kvp.first, t);
+  } else if (auto x = caf::get_if<erase_many_command>(&cmd)) {
+    for (auto& key : x->keys)
+      set_deadline(key, caf::none);
+  } else if (caf::holds_alternative<clear_command>(cmd)
+             || caf::holds_alternative<set_command>(cmd)) {
+    deadlines.clear();
+  }
+}
+
+void clone_state::set_deadline(const data& key, optional<timestamp> deadline) {
+  if (!deadline) {
+    deadlines.erase(key);
+    return;
+  }
+  deadlines[key] = *deadline;
+  // Same bucketing as the master, see master_state::remind.
+  auto res = defaults::store::expiry_resolution.count();
+  auto ticks = deadline->time_since_epoch().count();
+  if (res > 0)
+    ticks = (ticks / res + (ticks % res > 0 ? 1 : 0)) * res;
+  auto bucket = timestamp{timespan{ticks}};
+  auto i = expiry_buckets.find(bucket);
+  if (i == expiry_buckets.end()) {
+    i = expiry_buckets.emplace(bucket, std::vector<data>{}).first;
+    clock->send_later(self, bucket - clock->now(),
+                      caf::make_message(atom::expire::value, bucket));
+  }
+  i->second.emplace_back(key);
+}
+
+void clone_state::adopt_staged_deadlines() {
+  deadlines.clear();
+  expiry_buckets.clear();
+  deadlines_known = true;
+  if (local_expiry) {
+    for (auto& kvp : staged_deadlines)
+      if (auto t = caf::get_if<timestamp>(&kvp.second))
+        if (store.count(kvp.first) > 0)
+          set_deadline(kvp.first, *t);
+  }
+  staged_deadlines.clear();
+}
+
+void clone_state::expire(timestamp deadline) {
+  auto now = clock->now();
+  if (now < deadline) {
+    // The real-time clock may fire slightly ahead of the system clock.
+    if (clock->real_time() && expiry_buckets.count(deadline) > 0)
+      clock->send_later(self, deadline - now,
+                        caf::make_message(atom::expire::value, deadline));
+    return;
+  }
+  // A partial snapshot may contain keys that got a new expiration time in the
+  // meantime. Adopting the snapshot schedules all keys again.
+  if (receiving_snapshot && !serve_stale)
+    return;
+  size_t expired = 0;
+  auto i = expiry_buckets.begin();
+  for (; i != expiry_buckets.end() && i->first <= now; ++i) {
+    for (auto& key : i->second) {
+      // Skip keys that were modified or erased after scheduling.
+      auto j = deadlines.find(key);
+      if (j == deadlines.end() || j->second > now)
+        continue;
+      deadlines.erase(j);
+      modified(key);
+      store.erase(key);
+      // A local write would otherwise keep the expired value visible.
+      local_writes.erase(key);
+      ++expired;
+    }
+  }
+  expiry_buckets.erase(expiry_buckets.begin(), i);
+  if (expired > 0)
+    BROKER_INFO("EXPIRE" << expired << "keys");
+}
+
+void clone_state::begin_resync() {
+  if (!awaiting_snapshot && !awaiting_snapshot_sync)
+    resync_start = clock->now();
+  awaiting_snapshot = true;
+}
+
+timespan clone_state::staleness() const {
+  if (!awaiting_snapshot && !awaiting_snapshot_sync)
+    return timespan{0};
+  return clock->now() - resync_start;
+}
+
+void clone_state::request_snapshot() {
+  if (checkpoint_transfer && master && !cache->path().empty()) {
+    BROKER_INFO("request a checkpoint of the master");
+    awaiting_snapshot_sync = false;
+    auto type_name = cache->type() == backend::rocksdb ? "rocksdb" : "sqlite";
+    self->send(master, atom::snapshot::value, atom::write::value,
+               std::string{type_name});
+    return;
+  }
+  awaiting_snapshot_sync = true;
+  self->send(core, atom::store::value, atom::master::value,
+             atom::snapshot::value, name, self);
+}
+
+void clone_state::checkpoint() {
+  // A partial snapshot is inconsistent with any sequence number.
+  if (!cache || receiving_snapshot)
+    return;
+  if (auto err = cache->checkpoint(store, last_seq))
+    BROKER_WARNING("clone" << name << "failed to write its cache:" << err);
+}
+
+void clone_state::apply_local(const internal_command& cmd) {
+  if (auto x = caf::get_if<put_command>(&cmd.content)) {
+    set_local(x->key, &x->value);
+  } else if (auto x = caf::get_if<erase_command>(&cmd.content)) {
+    set_local(x->key, nullptr);
+  } else if (auto x = caf::get_if<put_many_command>(&cmd.content)) {
+    for (auto& kvp : x->entries)
+      set_local(kvp.first, &kvp.second);
+  } else if (auto x = caf::get_if<erase_many_command>(&cmd.content)) {
+    for (auto& key : x->keys)
+      set_local(key, nullptr);
+  }
+}
+
+void clone_state::reconcile(const internal_command& cmd) {
+  if (local_writes.empty())
+    return;
+  auto& content = cmd.content;
+  if (auto x = caf::get_if<put_command>(&content)) {
+    confirm_local(x->key);
+  } else if (auto x = caf::get_if<put_unique_command>(&content)) {
+    confirm_local(x->key);
+  } else if (auto x = caf::get_if<erase_command>(&content)) {
+    confirm_local(x->key);
+  } else if (auto x = caf::get_if<add_command>(&content)) {
+    confirm_local(x->key);
+  } else if (auto x = caf::get_if<subtract_command>(&content)) {
+    confirm_local(x->key);
+  } else if (auto x = caf::get_if<put_many_command>(&content)) {
+    for (auto& kvp : x->entries)
+      confirm_local(kvp.first);
+  } else if (auto x = caf::get_if<erase_many_command>(&content)) {
+    for (auto& key : x->keys)
+      confirm_local(key);
+  } else if (caf::holds_alternative<clear_command>(content)
+             || caf::holds_alternative<set_command>(content)) {
+    local_writes.clear();
+  }
+}
+
+void clone_state::set_local(const data& key, const data* value) {
+  auto& entry = local_writes[key];
+  if (value)
+    entry.value = *value;
+  else
+    entry.value = none;
+  ++entry.pending;
+}
+
+void clone_state::confirm_local(const data& key) {
+  auto i = local_writes.find(key);
+  if (i != local_writes.end() && --i->second.pending == 0)
+    local_writes.erase(i);
+}
+
+void clone_state::discard_local(const internal_command& cmd) {
+  if (auto x = caf::get_if<put_command>(&cmd.content)) {
+    confirm_local(x->key);
+  } else if (auto x = caf::get_if<erase_command>(&cmd.content)) {
+    confirm_local(x->key);
+  } else if (auto x = caf::get_if<put_many_command>(&cmd.content)) {
+    for (auto& kvp : x->entries)
+      confirm_local(kvp.first);
+  } else if (auto x = caf::get_if<erase_many_command>(&cmd.content)) {
+    for (auto& key : x->keys)
+      confirm_local(key);
+  }
+}
+
+const data* clone_state::lookup(const data& key) const {
+  auto i = local_writes.find(key);
+  if (i != local_writes.end())
+    return i->second.value ? &*i->second.value : nullptr;
+  auto j = store.find(key);
+  return j != store.end() ? &j->second : nullptr;
+}
+
 data clone_state::keys() const {
   set result;
   for (auto& kvp : store)
     result.emplace(kvp.first);
+  for (auto& kvp : local_writes) {
+    if (kvp.second.value)
+      result.emplace(kvp.first);
+    else
+      result.erase(kvp.first);
+  }
+  return result;
+}
+
+data clone_state::get_many(const vector& xs) const {
+  table result;
+  for (auto& key : xs)
+    if (auto value = lookup(key))
+      result.emplace(key, *value);
+  return result;
+}
+
+data clone_state::scan(const std::string& prefix, size_t limit) const {
+  table result;
+  auto full = [&] { return limit > 0 && result.size() >= limit; };
+  for (auto& kvp : local_writes) {
+    if (full())
+      return result;
+    if (kvp.second.value && has_prefix(kvp.first, prefix))
+      result.emplace(kvp.first, *kvp.second.value);
+  }
+  for (auto& kvp : store) {
+    if (full())
+      return result;
+    if (has_prefix(kvp.first, prefix) && local_writes.count(kvp.first) == 0)
+      result.emplace(kvp.first, kvp.second);
+  }
   return result;
 }
 
@@ -141,21 +675,38 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
                           caf::actor core, std::string name,
                           double resync_interval, double stale_interval,
                           double mutation_buffer_interval,
-                          endpoint::clock* clock) {
+                          endpoint::clock* clock,
+                          memory_accounting_ptr memory) {
   self->monitor(core);
-  self->state.init(self, std::move(name), std::move(core), clock);
+  self->state.init(self, std::move(name), std::move(core), clock,
+                   std::move(memory));
   self->set_down_handler(
     [=](const caf::down_msg& msg) {
+      auto& feeds = self->state.change_feeds;
+      auto is_source = [&](const std::pair<std::string, caf::actor>& x) {
+        return x.second.address() == msg.source;
+      };
       if (msg.source == core) {
         BROKER_INFO("core is down, kill clone as well");
+        self->state.checkpoint();
         self->quit(msg.reason);
+      } else if (std::any_of(feeds.begin(), feeds.end(), is_source)) {
+        BROKER_INFO("lost a change subscriber");
+        feeds.erase(std::remove_if(feeds.begin(), feeds.end(), is_source),
+                    feeds.end());
       } else {
         BROKER_INFO("lost master");
         self->state.master = nullptr;
-        self->state.awaiting_snapshot = true;
+        self->state.begin_resync();
         self->state.awaiting_snapshot_sync = true;
-        self->state.pending_remote_updates.clear();
-        self->state.pending_remote_updates.shrink_to_fit();
+        self->state.receiving_snapshot = false;
+        self->state.staged_snapshot.clear();
+        self->state.staged_deadlines.clear();
+        self->state.checkpoint_file.close();
+        self->state.checkpoint_file_name.clear();
+        // Local writes in flight may never reach the master.
+        self->state.local_writes.clear();
+        self->state.clear_pending_updates();
         self->send(self, atom::master::value, atom::resolve::value);
 
         if ( stale_interval >= 0 )
@@ -191,6 +742,33 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
     clock->send_later(self, ts, std::move(msg));
     }
 
+  auto cache_interval = caf::get_or(self->config(),
+                                    "broker.store.clone-cache-interval",
+                                    defaults::store::clone_cache_interval);
+
+  if ( self->state.cache )
+    {
+    self->set_exit_handler([=](const caf::exit_msg& msg) {
+      self->state.checkpoint();
+      self->quit(msg.reason);
+    });
+    clock->send_later(self, cache_interval,
+                      caf::make_message(atom::tick::value,
+                                        atom::flush::value));
+
+    // Serve reads from the restored content until the master is back,
+    // but not longer than we would after losing the master.
+    if ( ! self->state.is_stale && stale_interval >= 0 )
+      {
+      self->state.stale_time = now(clock) + stale_interval;
+      auto si = std::chrono::duration<double>(stale_interval);
+      auto ts = std::chrono::duration_cast<timespan>(si);
+      auto msg = caf::make_message(atom::tick::value,
+                                   atom::stale_check::value);
+      clock->send_later(self, ts, std::move(msg));
+      }
+    }
+
   self->send(self, atom::master::value, atom::resolve::value);
 
   return {
@@ -199,6 +777,7 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
       if ( self->state.master )
         {
         // forward all commands to the master
+        self->state.apply_local(x);
         self->state.forward(std::move(x));
         return;
         }
@@ -209,23 +788,60 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
       if ( now(clock) >= self->state.unmutable_time )
         return;
 
-      self->state.mutation_buffer.emplace_back(std::move(x));
+      self->state.buffer_mutation(std::move(x));
     },
     [=](set_command& x) {
       self->state.store = std::move(x.state);
+      self->state.replaced();
+      self->state.adopt_staged_deadlines();
       self->state.awaiting_snapshot = false;
+      self->state.receiving_snapshot = false;
+      self->state.last_seq = 0;
 
-      if ( ! self->state.awaiting_snapshot_sync ) {
-        for ( auto& update : self->state.pending_remote_updates )
-          self->state.command(update);
-
-        self->state.pending_remote_updates.clear();
-        self->state.pending_remote_updates.shrink_to_fit();
+      if ( ! self->state.awaiting_snapshot_sync )
+        self->state.apply_pending_updates();
+    },
+    [=](atom::snapshot, snapshot& chunk, uint64_t seq, bool last) {
+      self->state.apply_snapshot_chunk(chunk, seq, last);
+    },
+    [=](atom::snapshot, const compressed_batch& x, uint64_t seq, bool last) {
+      snapshot chunk;
+      if (auto err = decompress(self->system(), x, chunk)) {
+        BROKER_ERROR("failed to decompress snapshot chunk:" << err);
+        self->state.receiving_snapshot = false;
+        self->state.awaiting_snapshot = true;
+        self->state.request_snapshot();
+        return;
       }
+      self->state.apply_snapshot_chunk(chunk, seq, last);
+    },
+    [=](atom::snapshot, atom::expire, table& xs) {
+      // Precedes the chunks of a snapshot or checkpoint.
+      self->state.staged_deadlines = std::move(xs);
+    },
+    [=](atom::expire, timestamp deadline) {
+      self->state.expire(deadline);
+    },
+    [=](atom::snapshot, std::vector<internal_command>& deltas) {
+      self->state.apply_deltas(deltas);
+    },
+    [=](atom::snapshot, atom::write, const std::string& file,
+        const std::string& bytes, uint64_t seq, bool last) {
+      self->state.apply_checkpoint_chunk(file, bytes, seq, last);
     },
     [=](atom::sync_point, caf::actor& who) {
       self->send(who, atom::sync_point::value);
     },
+    [=](atom::subscribe, std::string& prefix, caf::actor& worker) {
+      // Clones only see the commands of their master, so the master
+      // publishes the changes directly to the subscriber.
+      self->monitor(worker);
+      if (self->state.master)
+        self->send(self->state.master, atom::subscribe::value, prefix,
+                   worker);
+      self->state.change_feeds.emplace_back(std::move(prefix),
+                                            std::move(worker));
+    },
     [=](atom::master, atom::resolve) {
       if ( self->state.master )
         return;
@@ -249,14 +865,24 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
       self->state.unmutable_time = -1.0;
       self->monitor(self->state.master);
 
-      for ( auto& cmd : self->state.mutation_buffer )
-        self->state.forward(std::move(cmd));
+      for (auto& feed : self->state.change_feeds)
+        self->send(self->state.master, atom::subscribe::value, feed.first,
+                   feed.second);
 
-      self->state.mutation_buffer.clear();
-      self->state.mutation_buffer.shrink_to_fit();
+      self->state.flush_mutation_buffer();
 
-      self->send(self->state.core, atom::store::value, atom::master::value,
-                 atom::snapshot::value, self->state.name, self);
+      if ( self->state.can_request_deltas(self->state.master) ) {
+        // Only ask for the commands we have missed. Commands from the stream
+        // get buffered until the master responds and deduplicated via their
+        // sequence number.
+        BROKER_INFO("request commands since" << self->state.last_seq);
+        self->state.awaiting_snapshot_sync = false;
+        self->send(self->state.master, atom::snapshot::value,
+                   self->state.last_seq);
+        return;
+      }
+
+      self->state.request_snapshot();
     },
     [=](atom::master, caf::error err) {
       if ( self->state.master )
@@ -276,6 +902,12 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
 
       self->state.is_stale = true;
     },
+    [=](atom::tick, atom::flush) {
+      self->state.checkpoint();
+      clock->send_later(self, cache_interval,
+                        caf::make_message(atom::tick::value,
+                                          atom::flush::value));
+    },
     [=](atom::tick, atom::mutable_check) {
       if ( self->state.unmutable_time < 0 )
         return;
@@ -283,8 +915,31 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
       if ( now(clock) < self->state.unmutable_time )
         return;
 
-      self->state.mutation_buffer.clear();
-      self->state.mutation_buffer.shrink_to_fit();
+      self->state.clear_mutation_buffer();
+      self->state.local_writes.clear();
+    },
+    [=](atom::get, atom::stats) {
+      auto& st = self->state;
+      return table{{"name", st.name},
+                   {"mailbox-size", count{self->mailbox().size()}},
+                   {"stale", st.is_stale},
+                   {"awaiting-snapshot", st.awaiting_snapshot},
+                   {"mutation-buffer", count{st.mutation_buffer.size()}},
+                   {"pending-updates",
+                    count{st.pending_remote_updates.size()}},
+                   {"buffered-bytes",
+                    count{st.mutation_buffer.memory_usage()
+                          + st.pending_remote_updates.memory_usage()}},
+                   {"spilled", count{st.mutation_buffer.spilled()
+                                     + st.pending_remote_updates.spilled()}},
+                   {"coalesced",
+                    count{st.mutation_buffer.coalesced()
+                          + st.pending_remote_updates.coalesced()}},
+                   {"dropped", count{st.mutation_buffer.dropped()
+                                     + st.pending_remote_updates.dropped()}},
+                   {"unshares", count{st.unshares}},
+                   {"cache-checkpoints",
+                    count{st.cache ? st.cache->checkpoints() : 0}}};
     },
     [=](atom::get, atom::keys) -> expected<data> {
       if ( self->state.is_stale )
@@ -302,11 +957,28 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
       BROKER_INFO("KEYS" << "with id" << id << "->" << x);
       return caf::make_message(std::move(x), id);
     },
+    [=](atom::get, const vector& keys) -> expected<data> {
+      if ( self->state.is_stale )
+        return {ec::stale_data};
+
+      auto x = self->state.get_many(keys);
+      BROKER_INFO("GET" << keys.size() << "keys ->" << x);
+      return {std::move(x)};
+    },
+    [=](atom::scan, const std::string& prefix, uint64_t limit)
+      -> expected<data> {
+      if ( self->state.is_stale )
+        return {ec::stale_data};
+
+      auto x = self->state.scan(prefix, limit);
+      BROKER_INFO("SCAN" << prefix << "limit:" << limit << "->" << x);
+      return {std::move(x)};
+    },
     [=](atom::exists, const data& key) -> expected<data> {
       if ( self->state.is_stale )
         return {ec::stale_data};
 
-      auto result = (self->state.store.find(key) != self->state.store.end());
+      auto result = self->state.lookup(key) != nullptr;
       BROKER_INFO("EXISTS" << key << "->" << result);
       return {result};
     },
@@ -314,7 +986,7 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
       if ( self->state.is_stale )
         return caf::make_message(make_error(ec::stale_data), id);
 
-      auto r = (self->state.store.find(key) != self->state.store.end());
+      auto r = self->state.lookup(key) != nullptr;
       auto result = caf::make_message(data{r}, id);
       BROKER_INFO("EXISTS" << key << "with id" << id << "->" << r);
       return result;
@@ -324,9 +996,8 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
         return {ec::stale_data};
 
       expected<data> result = ec::no_such_key;
-      auto i = self->state.store.find(key);
-      if (i != self->state.store.end())
-        result = i->second;
+      if (auto x = self->state.lookup(key))
+        result = *x;
       BROKER_INFO("GET" << key << "->" << result);
       return result;
     },
@@ -335,9 +1006,8 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
         return {ec::stale_data};
 
       expected<data> result = ec::no_such_key;
-      auto i = self->state.store.find(key);
-      if (i != self->state.store.end())
-        result = caf::visit(retriever{aspect}, i->second);
+      if (auto x = self->state.lookup(key))
+        result = caf::visit(retriever{aspect}, *x);
       BROKER_INFO("GET" << key << aspect << "->" << result);
       return result;
     },
@@ -346,10 +1016,9 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
         return caf::make_message(make_error(ec::stale_data), id);
 
       caf::message result;
-      auto i = self->state.store.find(key);
-      if (i != self->state.store.end()) {
-        result = caf::make_message(i->second, id);
-        BROKER_INFO("GET" << key << "with id" << id << "->" << i->second);
+      if (auto x = self->state.lookup(key)) {
+        result = caf::make_message(*x, id);
+        BROKER_INFO("GET" << key << "with id" << id << "->" << *x);
       } else {
         result = caf::make_message(make_error(ec::no_such_key), id);
         BROKER_INFO("GET" << key << "with id" << id << "-> no_such_key");
@@ -361,9 +1030,8 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
         return caf::make_message(make_error(ec::stale_data), id);
 
       caf::message result;
-      auto i = self->state.store.find(key);
-      if (i != self->state.store.end()) {
-        auto x = caf::visit(retriever{aspect}, i->second);
+      if (auto value = self->state.lookup(key)) {
+        auto x = caf::visit(retriever{aspect}, *value);
         BROKER_INFO("GET" << key << aspect << "with id" << id << "->" << x);
         if (x)
           result = caf::make_message(*x, id);
@@ -376,6 +1044,9 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
       }
       return result;
     },
+    [=](atom::get, atom::stale) {
+      return data{self->state.staleness()};
+    },
     [=](atom::get, atom::name) {
       return self->state.name;
     },
@@ -392,8 +1063,11 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
         [=](caf::unit_t&, store::stream_type::value_type y) {
           // TODO: our operator() overloads require mutable references, but
           //       only a fraction actually benefit from it.
-          auto cmd = move_command(y);
-          if (caf::holds_alternative<snapshot_sync_command>(cmd)) {
+          if (!y.unique())
+            ++self->state.unshares;
+          auto cmd = y.unique() ? std::move(caf::get<1>(y.unshared()))
+                                : caf::get<1>(y);
+          if (caf::holds_alternative<snapshot_sync_command>(cmd.content)) {
             self->state.command(cmd);
             return;
           }
@@ -402,11 +1076,11 @@ caf::behavior clone_actor(caf::stateful_actor<clone_state>* self,
             return;
 
           if ( self->state.awaiting_snapshot ) {
-            self->state.pending_remote_updates.emplace_back(std::move(cmd));
+            self->state.buffer_remote_update(std::move(cmd));
             return;
           }
 
-          self->state.command(cmd);
+          self->state.apply_remote(cmd);
         }
       );
     }
@@ -0,0 +1,188 @@
+#include "broker/detail/clone_cache.hh"
+
+#include <cctype>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#include <caf/actor_system_config.hpp>
+
+#include "broker/config.hh"
+#include "broker/defaults.hh"
+#include "broker/detail/filesystem.hh"
+#include "broker/detail/make_backend.hh"
+#include "broker/enum_value.hh"
+#include "broker/error.hh"
+#include "broker/logger.hh"
+
+namespace broker {
+namespace detail {
+
+clone_cache::clone_cache(std::unique_ptr<abstract_backend> backend,
+                         backend type, std::string path)
+  : backend_(std::move(backend)), type_(type), path_(std::move(path)) {
+  // nop
+}
+
+uint64_t clone_cache::load(content_type& content) {
+  content.clear();
+  auto x = backend_->get(seq_key());
+  if (!x)
+    return 0;
+  auto seq = caf::get_if<count>(&*x);
+  if (seq == nullptr || *seq == 0)
+    return 0;
+  auto ss = backend_->snapshot();
+  if (!ss) {
+    BROKER_ERROR("unable to read the clone cache:" << ss.error());
+    return 0;
+  }
+  content = std::move(*ss);
+  content.erase(seq_key());
+  seq_ = *seq;
+  return seq_;
+}
+
+caf::error clone_cache::checkpoint(const content_type& content, uint64_t seq) {
+  if (!dirty(seq))
+    return caf::none;
+  // Invalidates the sequence number before writes that put_many cannot cover.
+  auto invalidate = [&]() -> caf::error {
+    if (auto res = backend_->put(seq_key(), count{0}); !res)
+      return std::move(res.error());
+    return caf::none;
+  };
+  std::unordered_map<data, data> entries;
+  if (rewrite_) {
+    if (auto err = invalidate())
+      return err;
+    if (auto res = backend_->clear(); !res)
+      return std::move(res.error());
+    for (auto& kvp : content) {
+      entries.emplace(kvp);
+      if (entries.size() >= defaults::store::snapshot_chunk_size) {
+        if (auto res = backend_->put_many(entries); !res)
+          return std::move(res.error());
+        entries.clear();
+      }
+    }
+  } else {
+    std::vector<data> erased;
+    for (auto& key : dirty_) {
+      auto i = content.find(key);
+      if (i != content.end())
+        entries.emplace(*i);
+      else
+        erased.emplace_back(key);
+    }
+    if (!erased.empty()) {
+      if (auto err = invalidate())
+        return err;
+      if (auto res = backend_->erase_many(erased); !res)
+        return std::move(res.error());
+    }
+  }
+  entries.emplace(seq_key(), count{seq});
+  if (auto res = backend_->put_many(entries); !res)
+    return std::move(res.error());
+  if (auto res = backend_->flush(); !res)
+    return std::move(res.error());
+  dirty_.clear();
+  rewrite_ = false;
+  seq_ = seq;
+  ++checkpoints_;
+  return caf::none;
+}
+
+caf::error clone_cache::adopt(const std::string& files, content_type& content,
+                               uint64_t seq) {
+  // Closes the previous files before replacing them.
+  backend_.reset();
+  remove_all(path_);
+  auto renamed = std::rename(files.c_str(), path_.c_str()) == 0;
+  backend_ = make_backend(type_, backend_options{{"path", path_}});
+  // Leaves an empty cache that the next checkpoint rewrites on errors.
+  auto fail = [this](caf::error err) {
+    replaced();
+    return err;
+  };
+  if (!renamed)
+    return fail(make_error(ec::cannot_write_file, path_));
+  auto ss = backend_->snapshot();
+  if (!ss)
+    return fail(std::move(ss.error()));
+  content = std::move(*ss);
+  dirty_.clear();
+  rewrite_ = false;
+  // The files of the master contain no sequence number.
+  seq_ = 0;
+  return checkpoint(content, seq);
+}
+
+const data& clone_cache::seq_key() {
+  static const data key = enum_value{"broker::clone_cache::seq"};
+  return key;
+}
+
+namespace {
+
+/// Turns a store name into a file name. Store names usually contain slashes.
+std::string file_name(const std::string& name) {
+  std::string result;
+  result.reserve(name.size());
+  for (auto c : name)
+    result += std::isalnum(static_cast<unsigned char>(c)) || c == '-'
+                  || c == '_' || c == '.'
+                ? c
+                : '_';
+  return result;
+}
+
+} // namespace
+
+std::unique_ptr<clone_cache> make_clone_cache(const caf::actor_system_config& cfg,
+                                              const std::string& name) {
+  auto dir = caf::get_or(cfg, "broker.store.clone-cache",
+                         defaults::store::clone_cache);
+  if (dir.empty())
+    return nullptr;
+  auto type = backend::sqlite;
+  auto type_str = caf::get_or(cfg, "broker.store.clone-cache-backend",
+                              defaults::store::clone_cache_backend);
+  if (!convert(type_str, type)) {
+    BROKER_WARNING("invalid clone-cache-backend" << type_str
+                   << "(expected 'sqlite' or 'rocksdb'), disable clone cache");
+    return nullptr;
+  }
+#ifndef BROKER_HAVE_ROCKSDB
+  if (type == backend::rocksdb) {
+    BROKER_WARNING("not compiled with RocksDB support, disable clone cache");
+    return nullptr;
+  }
+#endif
+  if (!is_directory(dir) && !mkdirs(dir)) {
+    BROKER_WARNING("unable to create clone cache directory" << dir);
+    return nullptr;
+  }
+  auto path = dir + '/' + file_name(name)
+              + (type == backend::sqlite ? ".sqlite" : ".rocksdb");
+  BROKER_INFO("cache clone" << name << "in" << path);
+  backend_options opts{{"path", path}};
+  return std::make_unique<clone_cache>(make_backend(type, std::move(opts)),
+                                       type, std::move(path));
+}
+
+bool convert(caf::string_view x, backend& y) {
+  if (x == "sqlite") {
+    y = backend::sqlite;
+    return true;
+  }
+  if (x == "rocksdb") {
+    y = backend::rocksdb;
+    return true;
+  }
+  return false;
+}
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,243 @@
+#include "broker/detail/command_buffer.hh"
+
+#include <limits>
+#include <utility>
+
+#include <caf/actor_system.hpp>
+#include <caf/binary_deserializer.hpp>
+
+#include "broker/detail/assert.hh"
+#include "broker/detail/filesystem.hh"
+#include "broker/error.hh"
+#include "broker/logger.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+/// Returns the key of `cmd` if it only modifies a single key and replaces its
+/// previous value entirely.
+const data* coalescing_key(const internal_command& cmd) {
+  if (auto x = caf::get_if<put_command>(&cmd.content))
+    return &x->key;
+  if (auto x = caf::get_if<erase_command>(&cmd.content))
+    return &x->key;
+  return nullptr;
+}
+
+} // namespace
+
+command_buffer::command_buffer() {
+  // nop
+}
+
+command_buffer::~command_buffer() {
+  if (!file_name_.empty()) {
+    file_.close();
+    detail::remove(file_name_);
+  }
+}
+
+void command_buffer::init(caf::actor_system& sys, size_t capacity,
+                          overflow_policy policy,
+                          memory_accounting_ptr memory) {
+  BROKER_ASSERT(empty());
+  sys_ = &sys;
+  capacity_ = capacity;
+  policy_ = policy;
+  memory_.attach(std::move(memory), memory_accounting::clone_buffers);
+}
+
+caf::error command_buffer::push(internal_command cmd) {
+  if (spilled_ > 0)
+    return spill(cmd);
+  coalesce(cmd);
+  if (full()) {
+    if (policy_ == overflow_policy::spill && sys_ != nullptr)
+      return spill(cmd);
+    if (live_ == 0) {
+      // Other buffers exhausted the memory limit.
+      ++dropped_;
+      discard(cmd, discard_reason::dropped);
+      return caf::none;
+    }
+    drop_oldest();
+  }
+  index(cmd, offset_ + mem_.size());
+  auto size = estimated_size(cmd);
+  memory_.add(size);
+  mem_.emplace_back(entry{std::move(cmd), size, true});
+  ++live_;
+  return caf::none;
+}
+
+void command_buffer::clear() {
+  mem_.clear();
+  mem_.shrink_to_fit();
+  live_ = 0;
+  offset_ = 0;
+  index_.clear();
+  memory_.reset();
+  if (spilled_ > 0 || read_pos_ > 0) {
+    spilled_ = 0;
+    read_pos_ = 0;
+    // Start over with an empty file to keep its size bounded.
+    file_.close();
+    file_.open(file_name_, std::ios::in | std::ios::out | std::ios::trunc
+                             | std::ios::binary);
+    if (!file_.is_open())
+      BROKER_WARNING("unable to reopen" << file_name_);
+  }
+}
+
+bool command_buffer::full() const noexcept {
+  return (capacity_ > 0 && live_ >= capacity_) || memory_.exhausted();
+}
+
+void command_buffer::coalesce(const internal_command& cmd) {
+  auto key = coalescing_key(cmd);
+  if (key == nullptr)
+    return;
+  auto i = index_.find(*key);
+  if (i == index_.end())
+    return;
+  BROKER_ASSERT(i->second >= offset_ && i->second - offset_ < mem_.size());
+  // Discard the old command instead of overriding it in place. Otherwise, the
+  // new command would overtake commands for other keys, which breaks the
+  // order of sequence numbers for updates from the master.
+  auto& x = mem_[i->second - offset_];
+  BROKER_ASSERT(x.live);
+  ++coalesced_;
+  discard(x.cmd, discard_reason::coalesced);
+  memory_.remove(x.size);
+  x.cmd = internal_command{};
+  x.live = false;
+  --live_;
+  index_.erase(i);
+  if (mem_.size() > 2 * live_ + 16)
+    compact();
+}
+
+void command_buffer::index(const internal_command& cmd, size_t pos) {
+  if (auto key = coalescing_key(cmd)) {
+    index_[*key] = pos;
+    return;
+  }
+  if (index_.empty())
+    return;
+  auto& content = cmd.content;
+  if (auto x = caf::get_if<put_unique_command>(&content)) {
+    index_.erase(x->key);
+  } else if (auto x = caf::get_if<add_command>(&content)) {
+    index_.erase(x->key);
+  } else if (auto x = caf::get_if<subtract_command>(&content)) {
+    index_.erase(x->key);
+  } else if (auto x = caf::get_if<compare_and_swap_command>(&content)) {
+    index_.erase(x->key);
+  } else if (auto x = caf::get_if<add_and_get_command>(&content)) {
+    index_.erase(x->key);
+  } else if (auto x = caf::get_if<put_many_command>(&content)) {
+    for (auto& kvp : x->entries)
+      index_.erase(kvp.first);
+  } else if (auto x = caf::get_if<erase_many_command>(&content)) {
+    for (auto& key : x->keys)
+      index_.erase(key);
+  } else if (caf::holds_alternative<clear_command>(content)
+             || caf::holds_alternative<set_command>(content)) {
+    index_.clear();
+  }
+}
+
+void command_buffer::drop_oldest() {
+  BROKER_ASSERT(live_ > 0);
+  auto pop = [this] {
+    mem_.pop_front();
+    ++offset_;
+  };
+  while (!mem_.front().live)
+    pop();
+  auto& x = mem_.front();
+  if (auto key = coalescing_key(x.cmd)) {
+    auto i = index_.find(*key);
+    if (i != index_.end() && i->second == offset_)
+      index_.erase(i);
+  }
+  ++dropped_;
+  discard(x.cmd, discard_reason::dropped);
+  memory_.remove(x.size);
+  --live_;
+  pop();
+}
+
+void command_buffer::compact() {
+  std::deque<entry> xs;
+  index_.clear();
+  for (auto& x : mem_) {
+    if (x.live) {
+      index(x.cmd, xs.size());
+      xs.emplace_back(std::move(x));
+    }
+  }
+  mem_.swap(xs);
+  offset_ = 0;
+}
+
+caf::error command_buffer::spill(internal_command& cmd) {
+  if (file_name_.empty()) {
+    file_name_ = make_temp_file_name();
+    file_.open(file_name_, std::ios::in | std::ios::out | std::ios::trunc
+                             | std::ios::binary);
+    if (!file_.is_open())
+      return make_error(ec::cannot_open_file, file_name_);
+    BROKER_DEBUG("spill buffered commands to" << file_name_);
+  }
+  buf_.clear();
+  {
+    caf::binary_serializer sink{*sys_, buf_};
+    if (auto err = sink(cmd))
+      return err;
+  }
+  if (buf_.size() > std::numeric_limits<uint32_t>::max())
+    return make_error(ec::cannot_write_file, file_name_, "command too large");
+  auto size = static_cast<uint32_t>(buf_.size());
+  file_.seekp(0, std::ios::end);
+  if (!file_.write(reinterpret_cast<const char*>(&size), sizeof(size))
+      || !file_.write(reinterpret_cast<const char*>(buf_.data()), size))
+    return make_error(ec::cannot_write_file, file_name_);
+  ++spilled_;
+  return caf::none;
+}
+
+caf::error command_buffer::unspill(internal_command& cmd) {
+  BROKER_ASSERT(spilled_ > 0);
+  uint32_t size = 0;
+  file_.seekg(read_pos_);
+  if (!file_.read(reinterpret_cast<char*>(&size), sizeof(size)))
+    return make_error(ec::invalid_data, file_name_, "unable to read size");
+  buf_.resize(size);
+  if (!file_.read(reinterpret_cast<char*>(buf_.data()), size))
+    return make_error(ec::invalid_data, file_name_, "unable to read command");
+  caf::binary_deserializer source{*sys_, buf_.data(), buf_.size()};
+  if (auto err = source(cmd))
+    return err;
+  read_pos_ += static_cast<std::streamoff>(sizeof(size) + size);
+  --spilled_;
+  return caf::none;
+}
+
+bool convert(caf::string_view x, command_buffer::overflow_policy& y) {
+  using policy = command_buffer::overflow_policy;
+  if (x == "drop-oldest") {
+    y = policy::drop_oldest;
+    return true;
+  }
+  if (x == "spill") {
+    y = policy::spill;
+    return true;
+  }
+  return false;
+}
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,184 @@
+#include "broker/detail/compression.hh"
+
+#include <limits>
+
+#include <caf/binary_deserializer.hpp>
+#include <caf/binary_serializer.hpp>
+
+#include "broker/config.hh"
+#include "broker/error.hh"
+
+#ifdef BROKER_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef BROKER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+/// Upper bound for the size of a batch after decompression. Protects against
+/// malformed or malicious batches.
+constexpr uint32_t max_batch_size = 256 * 1024 * 1024;
+
+} // namespace
+
+const char* to_string(compression x) {
+  switch (x) {
+    case compression::lz4:
+      return "lz4";
+    case compression::zstd:
+      return "zstd";
+    default:
+      return "none";
+  }
+}
+
+bool convert(caf::string_view x, compression& y) {
+  if (x == "none") {
+    y = compression::none;
+    return true;
+  }
+  if (x == "lz4") {
+    y = compression::lz4;
+    return true;
+  }
+  if (x == "zstd") {
+    y = compression::zstd;
+    return true;
+  }
+  return false;
+}
+
+bool supported(compression x) {
+  switch (x) {
+#ifdef BROKER_HAVE_LZ4
+    case compression::lz4:
+      return true;
+#endif
+#ifdef BROKER_HAVE_ZSTD
+    case compression::zstd:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+std::vector<std::string> supported_compressions() {
+  std::vector<std::string> result;
+  for (auto x : {compression::lz4, compression::zstd})
+    if (supported(x))
+      result.emplace_back(to_string(x));
+  return result;
+}
+
+namespace {
+
+template <class T>
+caf::error compress_impl(caf::actor_system& sys, compression algorithm, T& xs,
+                         compressed_batch& result) {
+  caf::binary_serializer::container_type buf;
+  caf::binary_serializer sink{sys, buf};
+  if (auto err = sink(xs))
+    return err;
+  if (buf.size() > max_batch_size)
+    return make_error(ec::invalid_data, "batch too large");
+  result.algorithm = algorithm;
+  result.size = static_cast<uint32_t>(buf.size());
+  switch (algorithm) {
+#ifdef BROKER_HAVE_LZ4
+    case compression::lz4: {
+      auto src_size = static_cast<int>(buf.size());
+      result.bytes.resize(static_cast<size_t>(LZ4_compressBound(src_size)));
+      auto n = LZ4_compress_default(buf.data(), result.bytes.data(), src_size,
+                                    static_cast<int>(result.bytes.size()));
+      if (n <= 0)
+        return make_error(ec::unspecified, "LZ4 compression failed");
+      result.bytes.resize(static_cast<size_t>(n));
+      return caf::none;
+    }
+#endif
+#ifdef BROKER_HAVE_ZSTD
+    case compression::zstd: {
+      result.bytes.resize(ZSTD_compressBound(buf.size()));
+      auto n = ZSTD_compress(result.bytes.data(), result.bytes.size(),
+                             buf.data(), buf.size(), 1);
+      if (ZSTD_isError(n))
+        return make_error(ec::unspecified, ZSTD_getErrorName(n));
+      result.bytes.resize(n);
+      return caf::none;
+    }
+#endif
+    default:
+      return make_error(ec::unspecified, "unsupported compression",
+                        to_string(algorithm));
+  }
+}
+
+template <class T>
+caf::error decompress_impl(caf::actor_system& sys, const compressed_batch& x,
+                           T& result) {
+  if (x.size > max_batch_size)
+    return make_error(ec::invalid_data, "batch too large");
+  caf::binary_serializer::container_type buf;
+  buf.resize(x.size);
+  switch (x.algorithm) {
+#ifdef BROKER_HAVE_LZ4
+    case compression::lz4: {
+      auto max_input = std::numeric_limits<int>::max();
+      if (x.bytes.size() > static_cast<size_t>(max_input))
+        return make_error(ec::invalid_data, "batch too large");
+      auto n = LZ4_decompress_safe(x.bytes.data(), buf.data(),
+                                   static_cast<int>(x.bytes.size()),
+                                   static_cast<int>(buf.size()));
+      if (n < 0 || static_cast<uint32_t>(n) != x.size)
+        return make_error(ec::invalid_data, "LZ4 decompression failed");
+      break;
+    }
+#endif
+#ifdef BROKER_HAVE_ZSTD
+    case compression::zstd: {
+      auto n = ZSTD_decompress(buf.data(), buf.size(), x.bytes.data(),
+                               x.bytes.size());
+      if (ZSTD_isError(n) || n != x.size)
+        return make_error(ec::invalid_data, "zstd decompression failed");
+      break;
+    }
+#endif
+    default:
+      return make_error(ec::invalid_data, "unsupported compression",
+                        to_string(x.algorithm));
+  }
+  caf::binary_deserializer source{sys, buf};
+  return source(result);
+}
+
+} // namespace
+
+caf::error compress(caf::actor_system& sys, compression algorithm,
+                    std::vector<node_message>& xs, compressed_batch& result) {
+  return compress_impl(sys, algorithm, xs, result);
+}
+
+caf::error decompress(caf::actor_system& sys, const compressed_batch& x,
+                      std::vector<node_message>& result) {
+  return decompress_impl(sys, x, result);
+}
+
+caf::error compress(caf::actor_system& sys, compression algorithm,
+                    snapshot& xs, compressed_batch& result) {
+  return compress_impl(sys, algorithm, xs, result);
+}
+
+caf::error decompress(caf::actor_system& sys, const compressed_batch& x,
+                      snapshot& result) {
+  return decompress_impl(sys, x, result);
+}
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,366 @@
+#include "broker/detail/core_metrics.hh"
+
+#include <algorithm>
+#include <chrono>
+
+#include <caf/variant.hpp>
+
+#include "broker/internal_command.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+/// Approximates the binary serialization: one byte for the type tag, a fixed
+/// size for numbers, and a 32-bit length prefix for strings and containers.
+struct size_estimator {
+  static constexpr size_t tag_size = 1;
+
+  static constexpr size_t length_size = sizeof(uint32_t);
+
+  size_t operator()(const none&) const {
+    return tag_size;
+  }
+
+  template <class T>
+  size_t operator()(const T&) const {
+    return tag_size + sizeof(T);
+  }
+
+  size_t operator()(const std::string& x) const {
+    return tag_size + length_size + x.size();
+  }
+
+  size_t operator()(const enum_value& x) const {
+    return tag_size + length_size + x.name.size();
+  }
+
+  size_t operator()(const packed_data& x) const {
+    return tag_size + length_size + x.bytes.size();
+  }
+
+  size_t operator()(const set& xs) const {
+    auto result = tag_size + length_size;
+    for (auto& x : xs)
+      result += (*this)(x);
+    return result;
+  }
+
+  size_t operator()(const table& xs) const {
+    auto result = tag_size + length_size;
+    for (auto& kvp : xs)
+      result += (*this)(kvp.first) + (*this)(kvp.second);
+    return result;
+  }
+
+  size_t operator()(const vector& xs) const {
+    auto result = tag_size + length_size;
+    for (auto& x : xs)
+      result += (*this)(x);
+    return result;
+  }
+
+  size_t operator()(const data& x) const {
+    return caf::visit(*this, x);
+  }
+};
+
+/// Escapes a label value according to the Prometheus text format.
+std::string escape_label(const std::string& x) {
+  std::string result;
+  result.reserve(x.size());
+  for (auto c : x) {
+    switch (c) {
+      case '\\':
+        result += "\\\\";
+        break;
+      case '"':
+        result += "\\\"";
+        break;
+      case '\n':
+        result += "\\n";
+        break;
+      default:
+        result += c;
+    }
+  }
+  return result;
+}
+
+template <class T>
+const T* get_field(const table& xs, const char* key) {
+  auto i = xs.find(key);
+  return i != xs.end() ? caf::get_if<T>(&i->second) : nullptr;
+}
+
+void add_type(std::string& out, const char* metric, const char* type) {
+  out += "# TYPE ";
+  out += metric;
+  out += ' ';
+  out += type;
+  out += '\n';
+}
+
+template <class T>
+void add_sample(std::string& out, const char* metric, const char* label,
+                const std::string& label_value, T value) {
+  out += metric;
+  out += '{';
+  out += label;
+  out += "=\"";
+  out += escape_label(label_value);
+  out += "\"} ";
+  out += std::to_string(value);
+  out += '\n';
+}
+
+/// Renders durations in seconds, as recommended by Prometheus.
+void add_sample(std::string& out, const char* metric, const char* label,
+                const std::string& label_value, timespan value) {
+  using fractional_seconds = std::chrono::duration<double>;
+  auto secs = std::chrono::duration_cast<fractional_seconds>(value);
+  add_sample(out, metric, label, label_value, secs.count());
+}
+
+/// Renders `metric` for all entries `field` in the tables of `xs`.
+template <class T>
+void add_family(std::string& out, const table& xs, const char* metric,
+                const char* type, const char* label, const char* field) {
+  add_type(out, metric, type);
+  for (auto& kvp : xs) {
+    auto name = caf::get_if<std::string>(&kvp.first);
+    auto entry = caf::get_if<table>(&kvp.second);
+    if (name == nullptr || entry == nullptr)
+      continue;
+    if (auto value = get_field<T>(*entry, field))
+      add_sample(out, metric, label, *name, *value);
+  }
+}
+
+/// Renders a histogram in the format of `histogram::to_data`.
+void add_histogram(std::string& out, const table& xs,
+                   const std::string& metric) {
+  auto buckets = get_field<vector>(xs, "buckets");
+  auto samples = get_field<count>(xs, "samples");
+  auto sum = get_field<count>(xs, "sum");
+  if (!buckets || !samples || !sum)
+    return;
+  add_type(out, metric.c_str(), "histogram");
+  // Prometheus expects cumulative buckets.
+  auto bucket_metric = metric + "_bucket";
+  count total = 0;
+  auto n = std::min(buckets->size(), histogram::num_buckets - 1);
+  for (size_t i = 0; i < n; ++i) {
+    if (auto value = caf::get_if<count>(&(*buckets)[i]))
+      total += *value;
+    add_sample(out, bucket_metric.c_str(), "le",
+               std::to_string(histogram::upper_bound(i)), total);
+  }
+  add_sample(out, bucket_metric.c_str(), "le", "+Inf", *samples);
+  out += metric + "_sum " + std::to_string(*sum) + '\n';
+  out += metric + "_count " + std::to_string(*samples) + '\n';
+}
+
+} // namespace
+
+size_t estimated_size(const data& x) {
+  return size_estimator{}(x);
+}
+
+void histogram::observe(uint64_t x) noexcept {
+  size_t index = 0;
+  while (index < num_buckets - 1 && x > upper_bound(index))
+    ++index;
+  ++buckets_[index];
+  ++samples_;
+  sum_ += x;
+}
+
+void histogram::merge(const histogram& other) noexcept {
+  for (size_t index = 0; index < num_buckets; ++index)
+    buckets_[index] += other.buckets_[index];
+  samples_ += other.samples_;
+  sum_ += other.sum_;
+}
+
+bool histogram::merge(const data& x) {
+  auto xs = caf::get_if<table>(&x);
+  if (xs == nullptr)
+    return false;
+  auto buckets = get_field<vector>(*xs, "buckets");
+  auto samples = get_field<count>(*xs, "samples");
+  auto sum = get_field<count>(*xs, "sum");
+  if (!buckets || !samples || !sum || buckets->size() != num_buckets)
+    return false;
+  for (size_t index = 0; index < num_buckets; ++index)
+    if (!caf::holds_alternative<count>((*buckets)[index]))
+      return false;
+  for (size_t index = 0; index < num_buckets; ++index)
+    buckets_[index] += caf::get<count>((*buckets)[index]);
+  samples_ += *samples;
+  sum_ += *sum;
+  return true;
+}
+
+data histogram::to_data() const {
+  vector xs(buckets_.begin(), buckets_.end());
+  return table{{"buckets", std::move(xs)},
+               {"samples", samples_},
+               {"sum", sum_}};
+}
+
+table core_metrics::topics_to_data() const {
+  table result;
+  for (auto& kvp : topics_)
+    result.emplace(kvp.first, table{{"messages", kvp.second.messages},
+                                    {"bytes", kvp.second.bytes}});
+  return result;
+}
+
+void core_metrics::record(const data_message& x) {
+  auto& entry = topics_[get_topic(x).string()];
+  ++entry.messages;
+  entry.bytes += estimated_size(get_data(x));
+}
+
+void core_metrics::record(const command_message& x) {
+  ++topics_[get_topic(x).string()].messages;
+}
+
+void core_metrics::record(const node_message::value_type& x) {
+  if (is_data_message(x))
+    record(caf::get<data_message>(x));
+  else
+    record(caf::get<command_message>(x));
+}
+
+void metrics_aggregator::merge(const table& xs, timestamp received) {
+  for (auto& kvp : xs) {
+    auto name = caf::get_if<std::string>(&kvp.first);
+    auto summary = caf::get_if<table>(&kvp.second);
+    if (name != nullptr && summary != nullptr)
+      summaries_[*name] = entry{*summary, received};
+  }
+}
+
+void metrics_aggregator::expire(timestamp cutoff) {
+  for (auto i = summaries_.begin(); i != summaries_.end();) {
+    if (i->second.received < cutoff)
+      i = summaries_.erase(i);
+    else
+      ++i;
+  }
+}
+
+table metrics_aggregator::total() const {
+  count endpoints = 0;
+  table topics;
+  histogram batch_sizes;
+  histogram peer_rtts;
+  auto add = [](table& stats, const char* key, const count* value) {
+    if (value == nullptr)
+      return;
+    auto& x = stats[key];
+    if (auto sum = caf::get_if<count>(&x))
+      *sum += *value;
+    else
+      x = *value;
+  };
+  for (auto& kvp : summaries_) {
+    auto& summary = kvp.second.summary;
+    if (auto n = get_field<count>(summary, "endpoints"))
+      endpoints += *n;
+    if (auto xs = get_field<table>(summary, "topics")) {
+      for (auto& x : *xs) {
+        auto stats = caf::get_if<table>(&x.second);
+        if (stats == nullptr)
+          continue;
+        auto& entry = topics[x.first];
+        if (!caf::holds_alternative<table>(entry))
+          entry = table{};
+        auto& sums = caf::get<table>(entry);
+        add(sums, "messages", get_field<count>(*stats, "messages"));
+        add(sums, "bytes", get_field<count>(*stats, "bytes"));
+      }
+    }
+    if (auto i = summary.find("batch-sizes"); i != summary.end())
+      batch_sizes.merge(i->second);
+    if (auto i = summary.find("peer-rtts"); i != summary.end())
+      peer_rtts.merge(i->second);
+  }
+  return table{{"endpoints", endpoints},
+               {"topics", std::move(topics)},
+               {"batch-sizes", batch_sizes.to_data()},
+               {"peer-rtts", peer_rtts.to_data()}};
+}
+
+table metrics_aggregator::to_data() const {
+  table result;
+  for (auto& kvp : summaries_)
+    result.emplace(kvp.first, kvp.second.summary);
+  return result;
+}
+
+std::string to_prometheus(const data& snapshot) {
+  std::string out;
+  auto xs = caf::get_if<table>(&snapshot);
+  if (xs == nullptr)
+    return out;
+  if (auto topics = get_field<table>(*xs, "topics")) {
+    add_family<count>(out, *topics, "broker_topic_messages_total", "counter",
+                      "topic", "messages");
+    add_family<count>(out, *topics, "broker_topic_bytes_total", "counter",
+                      "topic", "bytes");
+  }
+  if (auto peers = get_field<table>(*xs, "peers")) {
+    add_family<count>(out, *peers, "broker_peer_queue_depth", "gauge", "peer",
+                      "queue-depth");
+    add_family<integer>(out, *peers, "broker_peer_credit", "gauge", "peer",
+                        "credit");
+    add_family<timespan>(out, *peers, "broker_peer_rtt_seconds", "gauge",
+                         "peer", "srtt");
+    add_family<timespan>(out, *peers, "broker_peer_jitter_seconds", "gauge",
+                         "peer", "jitter");
+    add_family<real>(out, *peers, "broker_peer_throughput", "gauge", "peer",
+                     "throughput");
+  }
+  if (auto unshares = get_field<count>(*xs, "unshares")) {
+    add_type(out, "broker_unshares_total", "counter");
+    out += "broker_unshares_total " + std::to_string(*unshares) + '\n';
+  }
+  if (auto limits = get_field<table>(*xs, "rate-limits")) {
+    add_family<count>(out, *limits, "broker_rate_limit_dropped_total",
+                      "counter", "prefix", "dropped");
+    add_family<count>(out, *limits, "broker_rate_limit_pending", "gauge",
+                      "prefix", "pending");
+  }
+  if (auto memory = get_field<table>(*xs, "memory")) {
+    add_family<count>(out, *memory, "broker_memory_bytes", "gauge",
+                      "subsystem", "bytes");
+    add_family<count>(out, *memory, "broker_memory_limit_bytes", "gauge",
+                      "subsystem", "limit");
+  }
+  if (auto batches = get_field<table>(*xs, "batch-sizes"))
+    add_histogram(out, *batches, "broker_batch_size");
+  if (auto cluster = get_field<table>(*xs, "cluster")) {
+    if (auto endpoints = get_field<count>(*cluster, "endpoints")) {
+      add_type(out, "broker_cluster_endpoints", "gauge");
+      out += "broker_cluster_endpoints " + std::to_string(*endpoints) + '\n';
+    }
+    if (auto topics = get_field<table>(*cluster, "topics")) {
+      add_family<count>(out, *topics, "broker_cluster_topic_messages_total",
+                        "counter", "topic", "messages");
+      add_family<count>(out, *topics, "broker_cluster_topic_bytes_total",
+                        "counter", "topic", "bytes");
+    }
+    if (auto batches = get_field<table>(*cluster, "batch-sizes"))
+      add_histogram(out, *batches, "broker_cluster_batch_size");
+    if (auto rtts = get_field<table>(*cluster, "peer-rtts"))
+      add_histogram(out, *rtts, "broker_cluster_peer_rtt_microseconds");
+  }
+  return out;
+}
+
+} // namespace detail
+} // namespace broker
@@ -1,14 +1,23 @@
 #include "broker/detail/core_policy.hh"
 
 #include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
 
 #include <caf/detail/stream_distribution_tree.hpp>
+#include <caf/event_based_actor.hpp>
 #include <caf/none.hpp>
 
 #include "broker/core_actor.hh"
 #include "broker/defaults.hh"
+#include "broker/detail/compression.hh"
 #include "broker/detail/filesystem.hh"
+#include "broker/detail/packed_batch.hh"
+#include "broker/detail/prefix_matcher.hh"
+#include "broker/detail/tracepoint.hh"
 #include "broker/logger.hh"
+#include "broker/time.hh"
 
 using caf::detail::stream_distribution_tree;
 
@@ -17,24 +26,108 @@ using namespace caf;
 namespace broker {
 namespace detail {
 
+namespace {
+
+// Decompresses batches from peers on behalf of the core.
+behavior batch_decoder(event_based_actor* self) {
+  return {
+    [=](compressed_batch& x) -> result<core_policy::peer_trait::batch> {
+      core_policy::peer_trait::batch batch;
+      if (auto err = decompress(self->system(), x, batch))
+        return err;
+      return batch;
+    },
+  };
+}
+
+} // namespace
+
 core_policy::core_policy(caf::detail::stream_distribution_tree<core_policy>* p,
                          core_state* state, filter_type filter)
-  : parent_(p), state_(state), remaining_records_(0) {
+  : parent_(p), state_(state), remaining_records_(0), next_seq_(0),
+    unshares_(0) {
   // TODO: use filter
   BROKER_ASSERT(parent_ != nullptr);
   BROKER_ASSERT(state_ != nullptr);
+  // Node IDs do not suffice as origin, because all cores in one actor system
+  // share the same ID. Messages without an origin (0) bypass duplicate
+  // detection.
+  std::random_device rd;
+  do {
+    origin_ = (uint64_t{rd()} << 32) | rd();
+  } while (origin_ == 0);
   auto& cfg = state->self->system().config();
+  blocked_peer_buffer_size_ = get_or(cfg, "broker.blocked-peer-buffer-size",
+                                     defaults::blocked_peer_buffer_size);
+  std::vector<rate_limiter::rule> rules;
+  for (auto& str : get_or(cfg, "broker.rate-limits",
+                          std::vector<std::string>{})) {
+    rate_limiter::rule x;
+    if (convert(str, x))
+      rules.emplace_back(std::move(x));
+    else
+      BROKER_WARNING("ignored invalid rate limit:" << str);
+  }
+  if (!rules.empty())
+    limiter_ = std::make_unique<rate_limiter>(std::move(rules));
+  for (auto& str : get_or(cfg, "broker.unreliable-topics",
+                          std::vector<std::string>{}))
+    unreliable_topics_.emplace_back(str);
+  blocked_peer_replay_batches_
+    = std::max(get_or(cfg, "broker.blocked-peer-replay-batches",
+                      defaults::blocked_peer_replay_batches),
+               size_t{1});
+  decode_offload_size_ = get_or(cfg, "broker.decode-offload-size",
+                                defaults::decode_offload_size);
+  auto num_decoders = get_or(cfg, "broker.decode-workers",
+                             defaults::decode_workers);
+  for (size_t i = 0; i < num_decoders; ++i)
+    decoders_.emplace_back(state->self->spawn<linked>(batch_decoder));
+  relay_clone_updates_ = get_or(cfg, "broker.store.relay-clone-updates",
+                                defaults::store::relay_clone_updates);
+  if (get_or(cfg, "broker.metrics.interval", defaults::metrics::interval)
+        .count() > 0
+      || get_or(cfg, "broker.metrics.port", defaults::metrics::port) > 0)
+    metrics_ = std::make_unique<core_metrics>();
   auto meta_dir = get_or(cfg, "broker.recording-directory",
                          defaults::recording_directory);
   if (!meta_dir.empty() && detail::is_directory(meta_dir)) {
-    auto file_name = meta_dir + "/messages.dat";
-    recorder_ = make_generator_file_writer(file_name);
+    auto capacity = get_or(cfg, "broker.recording-queue-size",
+                           defaults::recording_queue_size);
+    auto policy = generator_file_recorder::overflow_policy::block;
+    auto policy_str = get_or(cfg, "broker.recording-overflow",
+                             defaults::recording_overflow);
+    if (!convert(policy_str, policy))
+      BROKER_WARNING("invalid recording-overflow" << policy_str
+                     << "(expected 'drop' or 'block'), use 'block'");
+    generator_file_recorder::segment_options segments;
+    segments.prefix = meta_dir + "/messages";
+    segments.max_size = get_or(cfg, "broker.recording-segment-size",
+                               defaults::recording_segment_size);
+    segments.max_duration = get_or(cfg, "broker.recording-segment-duration",
+                                   defaults::recording_segment_duration);
+    segments.max_segments = get_or(cfg, "broker.recording-max-segments",
+                                   defaults::recording_max_segments);
+    std::string file_name;
+    if (segments.enabled()) {
+      file_name = segment_file_name(segments.prefix, 1);
+      recorder_ = make_generator_file_recorder(std::move(segments), capacity,
+                                               policy);
+    } else {
+      file_name = meta_dir + "/messages.dat";
+      recorder_ = make_generator_file_recorder(file_name, capacity, policy);
+    }
     if (recorder_ == nullptr) {
       BROKER_WARNING("cannot open recording file" << file_name);
     } else {
       BROKER_DEBUG("opened file for recording:" << file_name);
       remaining_records_ = get_or(cfg, "broker.output-generator-file-cap",
                                   defaults::output_generator_file_cap);
+      sampler_ = make_record_sampler(
+        get_or(cfg, "broker.recording-sample-rate",
+               defaults::recording_sample_rate),
+        get_or(cfg, "broker.recording-sample-rules",
+               std::vector<std::string>{}));
     }
   }
 }
@@ -63,37 +156,41 @@ void core_policy::block_peer(caf::actor peer) {
 
 void core_policy::unblock_peer(caf::actor peer) {
   blocked_peers.erase(peer);
+  replay_blocked(peer);
+}
 
+void core_policy::replay_blocked(const caf::actor& peer) {
   auto it = blocked_msgs.find(peer);
-
-  if ( it == blocked_msgs.end() )
+  if (it == blocked_msgs.end() || blocked_peers.count(peer) != 0)
     return;
-
   auto pit = peer_to_ipath_.find(peer);
-
-  if ( pit == peer_to_ipath_.end() ) {
+  if (pit == peer_to_ipath_.end()) {
     blocked_msgs.erase(it);
     BROKER_DEBUG("dropped batches after unblocking peer: path no longer exists" << peer);
     return;
   }
-
-  auto& slot = pit->second;
+  auto slot = pit->second;
   auto sap = actor_cast<strong_actor_ptr>(peer);
-
-  for ( auto& batch : it->second ) {
+  auto& buf = *it->second;
+  for (size_t i = 0; i < blocked_peer_replay_batches_ && !buf.empty(); ++i) {
+    auto batch = buf.pop();
+    if (!batch) {
+      BROKER_ERROR("dropped batches of peer" << peer << ":" << batch.error());
+      blocked_msgs.erase(it);
+      return;
+    }
     BROKER_DEBUG("handle blocked batch" << peer);
     before_handle_batch(slot, sap);
-    handle_batch(slot, sap, batch);
+    handle_peer_batch(*batch);
     after_handle_batch(slot, sap);
   }
-
-  blocked_msgs.erase(it);
-}
-
-static bool ends_with(const std::string& s, const std::string& ending) {
-  if (ending.size() > s.size())
-    return false;
-  return std::equal(ending.rbegin(), ending.rend(), s.rbegin());
+  if (buf.empty()) {
+    blocked_msgs.erase(it);
+    return;
+  }
+  // Give other messages a chance before handling the next batches.
+  state_->self->send(state_->self, atom::resume::value, atom::peer::value,
+                     peer);
 }
 
 void core_policy::handle_batch(stream_slot, const strong_actor_ptr& peer,
@@ -101,51 +198,24 @@ void core_policy::handle_batch(stream_slot, const strong_actor_ptr& peer,
   BROKER_TRACE(BROKER_ARG(xs));
 
   if (xs.match_elements<peer_trait::batch>()) {
-
-    auto peer_actor = caf::actor_cast<actor>(peer);
-    auto it = blocked_peers.find(peer_actor);
-
-    if ( it != blocked_peers.end() ) {
-      BROKER_DEBUG("buffer batch from blocked peer" << peer);
-      auto& bmsgs = blocked_msgs[peer_actor];
-      bmsgs.emplace_back(std::move(xs));
+    auto& batch = xs.get_mutable_as<peer_trait::batch>(0);
+    if (!enqueue_behind_decoders(actor_cast<actor>(peer), batch))
+      receive_peer_batch(peer, batch);
+    return;
+  }
+  if (xs.match_elements<compressed_batch>()) {
+    receive_compressed_batch(peer, xs.get_mutable_as<compressed_batch>(0));
+    return;
+  }
+  if (xs.match_elements<packed_batch>()) {
+    peer_trait::batch batch;
+    if (auto err = unpack(state_->self->system(),
+                          xs.get_as<packed_batch>(0), batch)) {
+      BROKER_ERROR("dropped packed batch from" << peer << ":" << err);
       return;
     }
-
-    auto num_workers = workers().num_paths();
-    auto num_stores = stores().num_paths();
-    BROKER_DEBUG("forward batch from peers;" << BROKER_ARG(num_workers)
-                  << BROKER_ARG(num_stores));
-    // Only received from other peers. Extract content for to local workers
-    // or stores and then forward to other peers.
-    for (auto& msg : xs.get_mutable_as<peer_trait::batch>(0)) {
-      const topic* t;
-      // Dispatch to local workers or stores messages.
-      if (is_data_message(msg)) {
-        auto& dm = get<data_message>(msg.content);
-        t = &get_topic(dm);
-        if (num_workers > 0)
-          workers().push(dm);
-      } else {
-        auto& cm = get<command_message>(msg.content);
-        t = &get_topic(cm);
-        if (num_stores > 0)
-          stores().push(cm);
-      }
-      // Check if forwarding is on.
-      if (!state_->options.forward)
-        continue;
-      // Somewhat hacky, but don't forward data store clone messages.
-      if (ends_with(t->string(), topics::clone_suffix.string()))
-        continue;
-      // Either decrease TTL if message has one already, or add one.
-      if (--msg.ttl == 0) {
-        BROKER_WARNING("dropped a message with expired TTL");
-        continue;
-      }
-      // Forward to other peers.
-      peers().push(std::move(msg));
-    }
+    if (!enqueue_behind_decoders(actor_cast<actor>(peer), batch))
+      receive_peer_batch(peer, batch);
     return;
   }
   using variant_batch = std::vector<node_message::value_type>;
@@ -156,6 +226,169 @@ void core_policy::handle_batch(stream_slot, const strong_actor_ptr& peer,
   BROKER_ERROR("unexpected batch:" << deep_to_string(xs));
 }
 
+void core_policy::receive_peer_batch(const strong_actor_ptr& peer,
+                                     peer_trait::batch& batch) {
+  auto peer_actor = caf::actor_cast<actor>(peer);
+  received_[peer_actor] += batch.size();
+  // Keep buffering while replaying a previously blocked peer to make sure
+  // we process that peer's batches in order.
+  auto it = blocked_msgs.find(peer_actor);
+  if (it != blocked_msgs.end() || blocked_peers.count(peer_actor) != 0) {
+    BROKER_DEBUG("buffer batch from blocked peer" << peer);
+    if (it == blocked_msgs.end()) {
+      auto& sys = state_->self->system();
+      auto ptr = std::make_unique<peer_buffer>(sys, blocked_peer_buffer_size_,
+                                               state_->memory);
+      it = blocked_msgs.emplace(peer_actor, std::move(ptr)).first;
+    }
+    if (auto err = it->second->push(std::move(batch)))
+      BROKER_ERROR("dropped batch from blocked peer" << peer << ":" << err);
+    return;
+  }
+  handle_peer_batch(batch);
+}
+
+void core_policy::receive_compressed_batch(const strong_actor_ptr& peer,
+                                           compressed_batch& x) {
+  auto hdl = actor_cast<actor>(peer);
+  if (decoders_.empty() || x.size < decode_offload_size_) {
+    peer_trait::batch batch;
+    if (auto err = decompress(state_->self->system(), x, batch)) {
+      BROKER_ERROR("dropped compressed batch from" << peer << ":" << err);
+      return;
+    }
+    if (!enqueue_behind_decoders(hdl, batch))
+      receive_peer_batch(peer, batch);
+    return;
+  }
+  auto id = decode_queues_[hdl].next_id++;
+  auto& decoder = decoders_[next_decoder_++ % decoders_.size()];
+  BROKER_DEBUG("hand batch" << id << "of" << peer << "to a decoder");
+  state_->self->request(decoder, infinite, std::move(x))
+    .then(
+      [=](peer_trait::batch& batch) {
+        decoded_batch(hdl, id, std::move(batch));
+      },
+      [=](error& err) {
+        BROKER_ERROR("dropped compressed batch from" << hdl << ":" << err);
+        decoded_batch(hdl, id, {});
+      });
+}
+
+bool core_policy::enqueue_behind_decoders(const actor& peer,
+                                          peer_trait::batch& batch) {
+  auto i = decode_queues_.find(peer);
+  if (i == decode_queues_.end())
+    return false;
+  auto& q = i->second;
+  q.ready.emplace(q.next_id++, std::move(batch));
+  return true;
+}
+
+void core_policy::decoded_batch(const actor& peer, uint64_t id,
+                                peer_trait::batch batch) {
+  auto i = decode_queues_.find(peer);
+  if (i == decode_queues_.end())
+    return;
+  auto& q = i->second;
+  q.ready.emplace(id, std::move(batch));
+  auto pit = peer_to_ipath_.find(peer);
+  auto sap = actor_cast<strong_actor_ptr>(peer);
+  auto j = q.ready.begin();
+  while (j != q.ready.end() && j->first == q.next_ready) {
+    ++q.next_ready;
+    if (pit == peer_to_ipath_.end()) {
+      BROKER_DEBUG("dropped decoded batch: path no longer exists" << peer);
+    } else if (!j->second.empty()) {
+      before_handle_batch(pit->second, sap);
+      receive_peer_batch(sap, j->second);
+      after_handle_batch(pit->second, sap);
+    }
+    j = q.ready.erase(j);
+  }
+  if (q.next_ready == q.next_id)
+    decode_queues_.erase(i);
+}
+
+void core_policy::handle_peer_batch(peer_trait::batch& batch) {
+  worker_groups_.reset();
+  auto num_workers = workers().num_paths();
+  auto num_stores = stores().num_paths();
+  BROKER_DEBUG("forward batch from peers;" << BROKER_ARG(num_workers)
+                << BROKER_ARG(num_stores));
+  BROKER_TRACEPOINT(batch_received, batch.size(), 0);
+  if (metrics_ != nullptr) {
+    metrics_->record_batch(batch.size());
+    for (auto& msg : batch)
+      metrics_->record(msg.content);
+  }
+  size_t num_matched = 0;
+  size_t num_forwarded = 0;
+  // Only received from other peers. Extract content for to local workers
+  // or stores and then forward to other peers.
+  for (auto& msg : batch) {
+    // Drop copies that took another path through the network, including the
+    // ones of our own messages.
+    if (msg.origin == origin_ || !duplicates_.accept(msg.origin, msg.seq)) {
+      BROKER_DEBUG("dropped duplicate from origin" << msg.origin);
+      continue;
+    }
+    // Messages for a single receiver bypass our subscribers unless they are
+    // for this node. Otherwise, we pass them on without checking filters.
+    if (msg.receiver != caf::none) {
+      if (msg.receiver == state_->self->node()) {
+        if (is_data_message(msg)) {
+          if (num_workers > 0)
+            workers().push(get<data_message>(msg.content));
+        } else if (num_stores > 0) {
+          stores().push(get<command_message>(msg.content));
+        }
+        ++num_matched;
+      } else if (state_->options.forward && --msg.ttl > 0) {
+        forward_to_peers(std::move(msg));
+        ++num_forwarded;
+      }
+      continue;
+    }
+    const topic* t;
+    // Dispatch to local workers or stores messages. The indexes memoize
+    // lookups, i.e., we match each distinct topic in a batch only once
+    // until the next filter change.
+    if (is_data_message(msg)) {
+      auto& dm = get<data_message>(msg.content);
+      t = &get_topic(dm);
+      if (num_workers > 0 && !worker_index_.match(*t).empty()) {
+        workers().push(dm);
+        ++num_matched;
+      }
+    } else {
+      auto& cm = get<command_message>(msg.content);
+      t = &get_topic(cm);
+      if (num_stores > 0 && !store_index_.match(*t).empty()) {
+        stores().push(cm);
+        ++num_matched;
+      }
+    }
+    // Check if forwarding is on.
+    if (!state_->options.forward)
+      continue;
+    // Updates for clones only travel over direct peerings to the master
+    // unless we act as a relay for them.
+    if (!relay_clone_updates_ && t->is_clone_topic())
+      continue;
+    // Either decrease TTL if message has one already, or add one.
+    if (--msg.ttl == 0) {
+      BROKER_WARNING("dropped a message with expired TTL");
+      continue;
+    }
+    // Forward to other peers.
+    forward_to_peers(std::move(msg));
+    ++num_forwarded;
+  }
+  BROKER_TRACEPOINT(batch_matched, num_matched, batch.size());
+  BROKER_TRACEPOINT(batch_forwarded, num_forwarded, batch.size());
+}
+
 void core_policy::after_handle_batch(stream_slot, const strong_actor_ptr&) {
   BROKER_TRACE("");
   // Make sure the content of the buffer is pushed to the outbound paths while
@@ -171,7 +404,21 @@ void core_policy::ack_open_success(stream_slot slot,
   if (rebind_from != rebind_to) {
     BROKER_DEBUG("rebind occurred" << BROKER_ARG(slot) << BROKER_ARG(rebind_from)
                   << BROKER_ARG(rebind_to));
-    peers().filter(slot).first = actor_cast<actor_addr>(rebind_to);
+    auto& f = peers().filter(slot);
+    peer_index_.erase(f.first);
+    auto addr = actor_cast<actor_addr>(rebind_to);
+    if (auto i = peer_events_.find(f.first); i != peer_events_.end()) {
+      auto events = std::move(i->second);
+      peer_events_.erase(i);
+      peer_events_.emplace(addr, std::move(events));
+    }
+    if (auto i = peer_summaries_.find(f.first); i != peer_summaries_.end()) {
+      auto summary = std::move(i->second);
+      peer_summaries_.erase(i);
+      peer_summaries_.emplace(addr, std::move(summary));
+    }
+    f.first = std::move(addr);
+    peer_index_.update(f.first, f.second);
   }
 }
 
@@ -189,16 +436,27 @@ void core_policy::ack_open_failure(stream_slot slot,
 }
 
 void core_policy::push_to_substreams(std::vector<message> xs) {
-  // Dispatch on the content of `xs`.
+  // Dispatch on the content of `xs`. We only move out of messages that no
+  // other actor references. Copying the content is the same amount of work as
+  // unsharing the message first, but leaves the shared message intact. After
+  // this point, all workers and stores share a single payload per message.
+  worker_groups_.reset();
   for (auto& x : xs) {
+    auto unique = x.cvals()->unique();
+    if (!unique)
+      ++unshares_;
     if (x.match_elements<topic, data>()) {
-      x.force_unshare();
-      workers().push(std::move(x.get_mutable_as<topic>(0)),
-                     std::move(x.get_mutable_as<data>(1)));
+      if (unique)
+        workers().push(std::move(x.get_mutable_as<topic>(0)),
+                       std::move(x.get_mutable_as<data>(1)));
+      else
+        workers().push(x.get_as<topic>(0), x.get_as<data>(1));
     } else if (x.match_elements<topic, internal_command>()) {
-      x.force_unshare();
-      stores().push(std::move(x.get_mutable_as<topic>(0)),
-                    std::move(x.get_mutable_as<internal_command>(1)));
+      if (unique)
+        stores().push(std::move(x.get_mutable_as<topic>(0)),
+                      std::move(x.get_mutable_as<internal_command>(1)));
+      else
+        stores().push(x.get_as<topic>(0), x.get_as<internal_command>(1));
     }
   }
   workers().emit_batches();
@@ -215,8 +473,10 @@ void core_policy::peer_lost(const actor& hdl) {
   auto x = state_->cache.find(hdl);
   if (!x || x->retry == timeout::seconds(0))
     return;
-  BROKER_INFO("will try reconnecting to" << *x << "in" << to_string(x->retry));
-  state_->self->delayed_send(state_->self, x->retry, atom::peer::value,
+  auto base = std::chrono::duration_cast<timespan>(x->retry);
+  auto delay = state_->reconnect_backoff.delay(base, 0);
+  BROKER_INFO("will try reconnecting to" << *x << "in" << to_string(delay));
+  state_->self->delayed_send(state_->self, delay, atom::peer::value,
                              atom::retry::value, *x);
 }
 
@@ -229,22 +489,38 @@ void core_policy::peer_removed(const actor& hdl) {
 
 void core_policy::path_closed(stream_slot slot) {
   BROKER_TRACE(BROKER_ARG(slot));
+  worker_index_.erase(slot);
+  worker_predicates_.erase(slot);
+  worker_groups_.erase(slot);
+  store_index_.erase(slot);
   remove_cb(slot, ipath_to_peer_, peer_to_ipath_, peer_to_opath_, caf::none);
 }
 
 void core_policy::path_force_closed(stream_slot slot, error reason) {
   BROKER_TRACE(BROKER_ARG(slot) << BROKER_ARG(reason));
+  worker_index_.erase(slot);
+  worker_predicates_.erase(slot);
+  worker_groups_.erase(slot);
+  store_index_.erase(slot);
   remove_cb(slot, ipath_to_peer_, peer_to_ipath_, peer_to_opath_,
             std::move(reason));
 }
 
 void core_policy::path_dropped(stream_slot slot) {
   BROKER_TRACE(BROKER_ARG(slot));
+  worker_index_.erase(slot);
+  worker_predicates_.erase(slot);
+  worker_groups_.erase(slot);
+  store_index_.erase(slot);
   remove_cb(slot, opath_to_peer_, peer_to_opath_, peer_to_ipath_, caf::none);
 }
 
 void core_policy::path_force_dropped(stream_slot slot, error reason) {
   BROKER_TRACE(BROKER_ARG(slot) << BROKER_ARG(reason));
+  worker_index_.erase(slot);
+  worker_predicates_.erase(slot);
+  worker_groups_.erase(slot);
+  store_index_.erase(slot);
   remove_cb(slot, opath_to_peer_, peer_to_opath_, peer_to_ipath_,
             std::move(reason));
 }
@@ -310,6 +586,19 @@ bool core_policy::remove_peer(const actor& hdl, error reason, bool silent,
     if (i != e) {
       BROKER_DEBUG("remove outbound path to peer:" << hdl);
       ++performed_erases;
+      state_->suspend_session(hdl, peers().filter(i->second).second,
+                              !graceful_removal && !shutting_down());
+      peer_index_.erase(peers().filter(i->second).first);
+      peer_events_.erase(peers().filter(i->second).first);
+      peer_summaries_.erase(peers().filter(i->second).first);
+      peers().disable_compression(hdl);
+      peers().disable_packing(hdl);
+      peers().disable_codec(hdl);
+      delta_peers_.erase(hdl);
+      received_.erase(hdl);
+      if (auto j = peer_nodes_.find(hdl.node());
+          j != peer_nodes_.end() && --j->second == 0)
+        peer_nodes_.erase(j);
       out().remove_path(i->second, reason, silent);
       opath_to_peer_.erase(i->second);
       peer_to_opath_.erase(i);
@@ -330,6 +619,9 @@ bool core_policy::remove_peer(const actor& hdl, error reason, bool silent,
     BROKER_DEBUG("no path was removed for peer:" << hdl);
     return false;
   }
+  blocked_peers.erase(hdl);
+  blocked_msgs.erase(hdl);
+  state_->inbound_handshakes.erase(hdl);
   if (graceful_removal)
     peer_removed(hdl);
   else
@@ -354,10 +646,88 @@ bool core_policy::update_peer(const actor& hdl, filter_type filter) {
     BROKER_DEBUG("cannot update filter on unknown peer");
     return false;
   }
-  peers().filter(i->second).second = std::move(filter);
+  normalize(filter);
+  relay_clone_topics(filter);
+  auto& f = peers().filter(i->second);
+  peer_summaries_.erase(f.first);
+  peer_index_.update(f.first, filter);
+  f.second = std::move(filter);
+  return true;
+}
+
+void core_policy::relay_clone_topics(const filter_type& peer_filter) {
+  if (!relay_clone_updates_ || !state_->options.forward)
+    return;
+  filter_type xs;
+  for (auto& x : peer_filter)
+    if (x.is_clone_topic())
+      xs.emplace_back(x);
+  if (!xs.empty())
+    state_->add_to_filter(std::move(xs));
+}
+
+bool core_policy::add_to_peer_filter(const actor& hdl, filter_type xs) {
+  BROKER_TRACE(BROKER_ARG(hdl) << BROKER_ARG(xs));
+  auto i = peer_to_opath_.find(hdl);
+  if (i == peer_to_opath_.end()) {
+    BROKER_DEBUG("cannot update filter on unknown peer");
+    return false;
+  }
+  relay_clone_topics(xs);
+  auto& f = peers().filter(i->second);
+  if (auto j = peer_summaries_.find(f.first); j != peer_summaries_.end()) {
+    j->second.add(xs);
+    return true;
+  }
+  f.second.insert(f.second.end(), std::make_move_iterator(xs.begin()),
+                  std::make_move_iterator(xs.end()));
+  normalize(f.second);
+  peer_index_.update(f.first, f.second);
+  return true;
+}
+
+bool core_policy::update_peer_summary(const actor& hdl, topic_summary summary,
+                                      filter_type exact) {
+  BROKER_TRACE(BROKER_ARG(hdl) << BROKER_ARG(exact));
+  auto i = peer_to_opath_.find(hdl);
+  if (i == peer_to_opath_.end()) {
+    BROKER_DEBUG("cannot update filter on unknown peer");
+    return false;
+  }
+  normalize(exact);
+  relay_clone_topics(exact);
+  auto& f = peers().filter(i->second);
+  peer_summaries_[f.first] = std::move(summary);
+  peers().selector().summaries = &peer_summaries_;
+  peer_index_.update(f.first, exact);
+  f.second = std::move(exact);
   return true;
 }
 
+bool core_policy::update_peer_events(const actor& hdl, event_filter f) {
+  BROKER_TRACE(BROKER_ARG(hdl) << BROKER_ARG(f));
+  auto i = peer_to_opath_.find(hdl);
+  if (i == peer_to_opath_.end()) {
+    BROKER_DEBUG("cannot update event filter on unknown peer");
+    return false;
+  }
+  auto& addr = peers().filter(i->second).first;
+  if (f.empty())
+    peer_events_.erase(addr);
+  else
+    peer_events_[addr] = std::move(f);
+  peers().selector().events = &peer_events_;
+  return true;
+}
+
+void core_policy::enable_filter_deltas(const actor& hdl) {
+  delta_peers_.emplace(hdl);
+}
+
+bool core_policy::accepts_filter_deltas(const actor& hdl) const {
+  return delta_peers_.count(hdl) != 0;
+}
+
 // -- management of worker and storage streams -------------------------------
 
 auto core_policy::add_worker(filter_type filter)
@@ -366,33 +736,90 @@ auto core_policy::add_worker(filter_type filter)
   auto slot = parent_->add_unchecked_outbound_path<worker_trait::element>();
   if (slot != invalid_stream_slot) {
     out().assign<worker_trait::manager>(slot);
-    workers().set_filter(slot, std::move(filter));
+    set_worker_filter(slot, std::move(filter));
+  }
+  return slot;
+}
+
+auto core_policy::add_worker(filter_type filter, predicate pred)
+-> outbound_stream_slot<worker_trait::element> {
+  BROKER_TRACE(BROKER_ARG(filter));
+  auto slot = add_worker(std::move(filter));
+  if (slot != invalid_stream_slot && !pred.empty()) {
+    normalize(pred);
+    worker_predicates_.emplace(slot, std::move(pred));
+    workers().selector().predicates = &worker_predicates_;
   }
   return slot;
 }
 
+auto core_policy::add_worker(filter_type filter, predicate pred,
+                             const consumer_group& group)
+-> outbound_stream_slot<worker_trait::element> {
+  BROKER_TRACE(BROKER_ARG(filter) << BROKER_ARG(group));
+  auto slot = add_worker(std::move(filter), std::move(pred));
+  if (slot != invalid_stream_slot && !group.empty()) {
+    worker_groups_.add(slot, group);
+    workers().selector().groups = &worker_groups_;
+  }
+  return slot;
+}
+
+const predicate* core_policy::worker_predicate(stream_slot slot) const {
+  auto i = worker_predicates_.find(slot);
+  return i != worker_predicates_.end() ? &i->second : nullptr;
+}
+
 auto core_policy::add_store(filter_type filter)
 -> outbound_stream_slot<store_trait::element> {
   CAF_LOG_TRACE(CAF_ARG(filter));
   auto slot = parent_->add_unchecked_outbound_path<store_trait::element>();
   if (slot != invalid_stream_slot) {
     out().assign<store_trait::manager>(slot);
-    stores().set_filter(slot, std::move(filter));
+    set_store_filter(slot, std::move(filter));
   }
   return slot;
 }
 
+void core_policy::set_worker_filter(stream_slot slot, filter_type filter) {
+  BROKER_TRACE(BROKER_ARG(slot) << BROKER_ARG(filter));
+  normalize(filter);
+  workers().selector().index = &worker_index_;
+  worker_index_.update(slot, filter);
+  workers().set_filter(slot, std::make_pair(slot, std::move(filter)));
+}
+
+void core_policy::set_store_filter(stream_slot slot, filter_type filter) {
+  BROKER_TRACE(BROKER_ARG(slot) << BROKER_ARG(filter));
+  normalize(filter);
+  stores().selector().index = &store_index_;
+  store_index_.update(slot, filter);
+  stores().set_filter(slot, std::make_pair(slot, std::move(filter)));
+}
+
 // -- selectively pushing data into the streams ------------------------------
 
 /// Pushes data to workers without forwarding it to peers.
 void core_policy::local_push(data_message x) {
   BROKER_TRACE(BROKER_ARG(x) << BROKER_ARG2("num_paths", workers().num_paths()));
   if (workers().num_paths() > 0) {
+    worker_groups_.reset();
     workers().push(std::move(x));
     workers().emit_batches();
   }
 }
 
+void core_policy::local_push(std::vector<data_message> xs) {
+  BROKER_TRACE(BROKER_ARG2("num_items", xs.size())
+               << BROKER_ARG2("num_paths", workers().num_paths()));
+  if (workers().num_paths() > 0) {
+    worker_groups_.reset();
+    for (auto& x : xs)
+      workers().push(std::move(x));
+    workers().emit_batches();
+  }
+}
+
 /// Pushes data to stores without forwarding it to peers.
 void core_policy::local_push(command_message x) {
   BROKER_TRACE(BROKER_ARG(x) << BROKER_ARG2("num_paths", stores().num_paths()));
@@ -407,21 +834,108 @@ void core_policy::remote_push(node_message msg) {
   BROKER_TRACE(BROKER_ARG(msg));
   if (recorder_ != nullptr)
     try_record(msg);
+  forward_to_peers(std::move(msg));
+  peers().emit_batches();
+}
+
+void core_policy::forward_to_peers(node_message msg) {
+  if (limiter_ == nullptr) {
+    push_to_peers(std::move(msg));
+    return;
+  }
+  auto f = [this](node_message&& x) { push_to_peers(std::move(x)); };
+  if (limiter_->admit(msg, broker::now(), f))
+    push_to_peers(std::move(msg));
+}
+
+void core_policy::push_to_peers(node_message msg) {
+  if (!unreliable_topics_.empty() && is_data_message(msg)
+      && prefix_matcher{}(unreliable_topics_, get_topic(msg))) {
+    send_unreliable(msg);
+    return;
+  }
   peers().push(std::move(msg));
+}
+
+void core_policy::send_unreliable(const node_message& msg) {
+  auto& selector = peers().selector();
+  for (auto& kvp : peers().states()) {
+    auto ptr = peers().path(kvp.first);
+    if (ptr == nullptr || !selector(kvp.second.filter, msg))
+      continue;
+    // Better drop the message than queue it behind bulk data.
+    if (!kvp.second.buf.empty()) {
+      BROKER_DEBUG("drop unreliable message to congested peer" << ptr->hdl);
+      continue;
+    }
+    state_->self->send(actor_cast<actor>(ptr->hdl), atom::unreliable::value,
+                       msg);
+  }
+}
+
+void core_policy::receive_unreliable(const strong_actor_ptr& peer,
+                                     node_message msg) {
+  auto hdl = actor_cast<actor>(peer);
+  if (blocked_peers.count(hdl) != 0 || decode_queues_.count(hdl) != 0) {
+    BROKER_DEBUG("drop unreliable message from blocked peer" << peer);
+    return;
+  }
+  peer_trait::batch batch;
+  batch.emplace_back(std::move(msg));
+  before_handle_batch(invalid_stream_slot, peer);
+  handle_peer_batch(batch);
+  after_handle_batch(invalid_stream_slot, peer);
+  workers().emit_batches();
+  stores().emit_batches();
+  peers().emit_batches();
+}
+
+void core_policy::flush_rate_limits() {
+  if (limiter_ == nullptr)
+    return;
+  limiter_->flush(broker::now(), [this](node_message&& x) {
+    push_to_peers(std::move(x));
+  });
   peers().emit_batches();
 }
 
 /// Pushes data to peers and workers.
 void core_policy::push(data_message msg) {
   BROKER_TRACE(BROKER_ARG(msg));
-  remote_push(make_node_message(std::move(msg), state_->options.ttl));
+  if (metrics_ != nullptr)
+    metrics_->record(msg);
+  remote_push(originate(std::move(msg)));
   //local_push(std::move(x), std::move(y));
 }
 
+void core_policy::push(std::vector<data_message> xs) {
+  BROKER_TRACE(BROKER_ARG2("num_items", xs.size()));
+  for (auto& x : xs) {
+    if (metrics_ != nullptr)
+      metrics_->record(x);
+    auto msg = originate(std::move(x));
+    if (recorder_ != nullptr)
+      try_record(msg);
+    forward_to_peers(std::move(msg));
+  }
+  peers().emit_batches();
+}
+
+void core_policy::unicast(const caf::node_id& receiver, data_message msg) {
+  BROKER_TRACE(BROKER_ARG(receiver) << BROKER_ARG(msg));
+  if (metrics_ != nullptr)
+    metrics_->record(msg);
+  auto x = originate(std::move(msg));
+  x.receiver = receiver;
+  remote_push(std::move(x));
+}
+
 /// Pushes data to peers and stores.
 void core_policy::push(command_message msg) {
   BROKER_TRACE(BROKER_ARG(msg));
-  remote_push(make_node_message(std::move(msg), state_->options.ttl));
+  if (metrics_ != nullptr)
+    metrics_->record(msg);
+  remote_push(originate(std::move(msg)));
   //local_push(std::move(x), std::move(y));
 }
 
@@ -484,6 +998,13 @@ core_policy::ttl core_policy::initial_ttl() const {
   return static_cast<ttl>(state_->options.ttl);
 }
 
+node_message core_policy::originate(node_message::value_type content) {
+  auto result = make_node_message(std::move(content), initial_ttl());
+  result.origin = origin_;
+  result.seq = next_seq_++;
+  return result;
+}
+
 void core_policy::add_ipath(stream_slot slot, const actor& peer_hdl) {
   BROKER_TRACE(BROKER_ARG(slot) << BROKER_ARG(peer_hdl));
   if (slot == invalid_stream_slot) {
@@ -517,7 +1038,8 @@ void core_policy::add_opath(stream_slot slot, const actor& peer_hdl) {
 }
 
 auto core_policy::add(std::true_type, const actor& hdl) -> step1_handshake {
-  auto xs = std::make_tuple(state_->filter, actor_cast<actor>(self()));
+  auto xs = std::make_tuple(state_->handshake_filter(),
+                            actor_cast<actor>(self()));
   return parent_->add_unchecked_outbound_path<node_message>(hdl, std::move(xs));
 }
 
@@ -0,0 +1,386 @@
+#include "broker/detail/data_codec.hh"
+
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include <caf/variant.hpp>
+
+#include "broker/error.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+/// Maximum nesting of containers when decoding. Protects the stack against
+/// malformed input.
+constexpr size_t max_depth = 64;
+
+/// Values below this threshold fit into the upper four bits of the tag.
+constexpr uint64_t inline_limit = 15;
+
+uint8_t make_tag(data::type t, uint8_t payload = 0) {
+  return static_cast<uint8_t>(static_cast<uint8_t>(t) | (payload << 4));
+}
+
+uint64_t zigzag(int64_t x) {
+  return (static_cast<uint64_t>(x) << 1) ^ static_cast<uint64_t>(x >> 63);
+}
+
+int64_t unzigzag(uint64_t x) {
+  return static_cast<int64_t>(x >> 1) ^ -static_cast<int64_t>(x & 1);
+}
+
+struct encoder {
+  using result_type = void;
+
+  data_codec::buffer& buf;
+
+  void put(uint8_t x) {
+    buf.push_back(static_cast<char>(x));
+  }
+
+  void put(const void* x, size_t n) {
+    auto first = static_cast<const char*>(x);
+    buf.insert(buf.end(), first, first + n);
+  }
+
+  // Stores `x` in the tag if possible, otherwise appends a varint.
+  void put_number(data::type t, uint64_t x) {
+    if (x < inline_limit) {
+      put(make_tag(t, static_cast<uint8_t>(x + 1)));
+    } else {
+      put(make_tag(t));
+      data_codec::write_varint(x, buf);
+    }
+  }
+
+  void put_string(data::type t, const std::string& x) {
+    put_number(t, x.size());
+    put(x.data(), x.size());
+  }
+
+  void put_address(const address& x) {
+    auto& bytes = x.bytes();
+    if (x.is_v4())
+      put(bytes.data() + 12, 4);
+    else
+      put(bytes.data(), 16);
+  }
+
+  void operator()(const none&) {
+    put(make_tag(data::type::none));
+  }
+
+  void operator()(boolean x) {
+    put(make_tag(data::type::boolean, x ? 1 : 0));
+  }
+
+  void operator()(count x) {
+    put_number(data::type::count, x);
+  }
+
+  void operator()(integer x) {
+    put_number(data::type::integer, zigzag(x));
+  }
+
+  void operator()(real x) {
+    put(make_tag(data::type::real));
+    put(&x, sizeof(x));
+  }
+
+  void operator()(const std::string& x) {
+    put_string(data::type::string, x);
+  }
+
+  void operator()(const address& x) {
+    put(make_tag(data::type::address, x.is_v4() ? 4 : 6));
+    put_address(x);
+  }
+
+  void operator()(const subnet& x) {
+    put(make_tag(data::type::subnet, x.network().is_v4() ? 4 : 6));
+    put_address(x.network());
+    put(x.length());
+  }
+
+  void operator()(const port& x) {
+    put(make_tag(data::type::port, static_cast<uint8_t>(x.type())));
+    data_codec::write_varint(x.number(), buf);
+  }
+
+  void operator()(const timestamp& x) {
+    put(make_tag(data::type::timestamp));
+    data_codec::write_varint(zigzag(x.time_since_epoch().count()), buf);
+  }
+
+  void operator()(const timespan& x) {
+    put(make_tag(data::type::timespan));
+    data_codec::write_varint(zigzag(x.count()), buf);
+  }
+
+  void operator()(const enum_value& x) {
+    put_string(data::type::enum_value, x.name);
+  }
+
+  void operator()(const set& xs) {
+    put_number(data::type::set, xs.size());
+    for (auto& x : xs)
+      caf::visit(*this, x);
+  }
+
+  void operator()(const table& xs) {
+    put_number(data::type::table, xs.size());
+    for (auto& kvp : xs) {
+      caf::visit(*this, kvp.first);
+      caf::visit(*this, kvp.second);
+    }
+  }
+
+  void operator()(const vector& xs) {
+    put_number(data::type::vector, xs.size());
+    for (auto& x : xs)
+      caf::visit(*this, x);
+  }
+
+  void operator()(const packed_data& x) {
+    put_number(data::type::packed_data, x.bytes.size());
+    put(x.bytes.data(), x.bytes.size());
+  }
+};
+
+struct decoder {
+  const char*& first;
+  const char* last;
+
+  caf::error fail(const char* what) {
+    return make_error(ec::invalid_data, what);
+  }
+
+  bool get(void* dst, size_t n) {
+    if (static_cast<size_t>(last - first) < n)
+      return false;
+    memcpy(dst, first, n);
+    first += n;
+    return true;
+  }
+
+  bool get_number(uint8_t payload, uint64_t& x) {
+    if (payload > 0) {
+      x = payload - 1u;
+      return true;
+    }
+    return data_codec::read_varint(first, last, x);
+  }
+
+  bool get_string(uint8_t payload, std::string& x) {
+    uint64_t n;
+    if (!get_number(payload, n) || n > static_cast<size_t>(last - first))
+      return false;
+    x.assign(first, static_cast<size_t>(n));
+    first += n;
+    return true;
+  }
+
+  bool get_address(uint8_t payload, address& x) {
+    auto& bytes = x.bytes();
+    bytes.fill(0);
+    if (payload == 4) {
+      bytes[10] = 0xFF;
+      bytes[11] = 0xFF;
+      return get(bytes.data() + 12, 4);
+    }
+    return payload == 6 && get(bytes.data(), 16);
+  }
+
+  // Reads a container size that cannot exceed the remaining bytes, since each
+  // element takes at least one byte.
+  bool get_size(uint8_t payload, uint64_t& n) {
+    return get_number(payload, n) && n <= static_cast<size_t>(last - first);
+  }
+
+  caf::error operator()(data& x, size_t depth) {
+    if (depth > max_depth)
+      return fail("nesting too deep");
+    uint8_t tag;
+    if (!get(&tag, 1))
+      return fail("unexpected end of input");
+    auto payload = static_cast<uint8_t>(tag >> 4);
+    switch (static_cast<data::type>(tag & 0x0F)) {
+      case data::type::none:
+        x = data{};
+        return caf::none;
+      case data::type::boolean:
+        x = payload != 0;
+        return caf::none;
+      case data::type::count: {
+        uint64_t value;
+        if (!get_number(payload, value))
+          return fail("invalid count");
+        x = count{value};
+        return caf::none;
+      }
+      case data::type::integer: {
+        uint64_t value;
+        if (!get_number(payload, value))
+          return fail("invalid integer");
+        x = integer{unzigzag(value)};
+        return caf::none;
+      }
+      case data::type::real: {
+        real value;
+        if (!get(&value, sizeof(value)))
+          return fail("invalid real");
+        x = value;
+        return caf::none;
+      }
+      case data::type::string: {
+        std::string value;
+        if (!get_string(payload, value))
+          return fail("invalid string");
+        x = std::move(value);
+        return caf::none;
+      }
+      case data::type::address: {
+        address value;
+        if (!get_address(payload, value))
+          return fail("invalid address");
+        x = value;
+        return caf::none;
+      }
+      case data::type::subnet: {
+        address net;
+        uint8_t length;
+        if (!get_address(payload, net) || !get(&length, 1))
+          return fail("invalid subnet");
+        x = subnet{net, length};
+        return caf::none;
+      }
+      case data::type::port: {
+        uint64_t number;
+        if (!data_codec::read_varint(first, last, number)
+            || number > std::numeric_limits<port::number_type>::max()
+            || payload > static_cast<uint8_t>(port::protocol::icmp))
+          return fail("invalid port");
+        x = port{static_cast<port::number_type>(number),
+                 static_cast<port::protocol>(payload)};
+        return caf::none;
+      }
+      case data::type::timestamp: {
+        uint64_t value;
+        if (!data_codec::read_varint(first, last, value))
+          return fail("invalid timestamp");
+        x = timestamp{timespan{unzigzag(value)}};
+        return caf::none;
+      }
+      case data::type::timespan: {
+        uint64_t value;
+        if (!data_codec::read_varint(first, last, value))
+          return fail("invalid timespan");
+        x = timespan{unzigzag(value)};
+        return caf::none;
+      }
+      case data::type::enum_value: {
+        enum_value value;
+        if (!get_string(payload, value.name))
+          return fail("invalid enum value");
+        x = std::move(value);
+        return caf::none;
+      }
+      case data::type::set: {
+        uint64_t n;
+        if (!get_size(payload, n))
+          return fail("invalid set size");
+        set xs;
+        for (uint64_t i = 0; i < n; ++i) {
+          data element;
+          if (auto err = (*this)(element, depth + 1))
+            return err;
+          xs.emplace_hint(xs.end(), std::move(element));
+        }
+        x = std::move(xs);
+        return caf::none;
+      }
+      case data::type::table: {
+        uint64_t n;
+        if (!get_size(payload, n))
+          return fail("invalid table size");
+        table xs;
+        for (uint64_t i = 0; i < n; ++i) {
+          data key;
+          data value;
+          if (auto err = (*this)(key, depth + 1))
+            return err;
+          if (auto err = (*this)(value, depth + 1))
+            return err;
+          xs.emplace_hint(xs.end(), std::move(key), std::move(value));
+        }
+        x = std::move(xs);
+        return caf::none;
+      }
+      case data::type::vector: {
+        uint64_t n;
+        if (!get_size(payload, n))
+          return fail("invalid vector size");
+        vector xs;
+        xs.reserve(n);
+        for (uint64_t i = 0; i < n; ++i) {
+          xs.emplace_back();
+          if (auto err = (*this)(xs.back(), depth + 1))
+            return err;
+        }
+        x = std::move(xs);
+        return caf::none;
+      }
+      case data::type::packed_data: {
+        uint64_t n;
+        if (!get_size(payload, n))
+          return fail("invalid packed data size");
+        packed_data value;
+        value.bytes.assign(first, first + n);
+        first += n;
+        x = std::move(value);
+        return caf::none;
+      }
+      default:
+        return fail("invalid type tag");
+    }
+  }
+};
+
+} // namespace
+
+void data_codec::encode(const data& x, buffer& buf) {
+  encoder f{buf};
+  caf::visit(f, x);
+}
+
+caf::error data_codec::decode(const char*& first, const char* last,
+                              data& x) {
+  decoder f{first, last};
+  return f(x, 0);
+}
+
+void data_codec::write_varint(uint64_t x, buffer& buf) {
+  while (x >= 0x80) {
+    buf.push_back(static_cast<char>((x & 0x7F) | 0x80));
+    x >>= 7;
+  }
+  buf.push_back(static_cast<char>(x));
+}
+
+bool data_codec::read_varint(const char*& first, const char* last,
+                             uint64_t& x) {
+  x = 0;
+  for (int shift = 0; first != last && shift < 64; shift += 7) {
+    auto byte = static_cast<uint8_t>(*first++);
+    x |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+} // namespace detail
+} // namespace broker
@@ -1,5 +1,8 @@
 #include "broker/detail/data_generator.hh"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -7,6 +10,8 @@
 #include <caf/binary_serializer.hpp>
 #include <caf/sec.hpp>
 
+#include "broker/detail/assert.hh"
+#include "broker/detail/data_codec.hh"
 #include "broker/detail/meta_data_writer.hh"
 #include "broker/logger.hh"
 
@@ -65,6 +70,24 @@ data_generator::data_generator(caf::binary_deserializer& meta_data_source,
   // nop
 }
 
+data_generator::data_generator(caf::binary_deserializer& meta_data_source,
+                               profile prof, unsigned seed)
+  : data_generator(meta_data_source, seed) {
+  profile_ = std::move(prof);
+  auto& words = profile_.words;
+  words.erase(std::remove_if(words.begin(), words.end(),
+                             [](const std::string& w) { return w.empty(); }),
+              words.end());
+  if (profile_.reuse > 0 && profile_.dictionary_size > 0) {
+    zipf_cdf_.reserve(profile_.dictionary_size);
+    double sum = 0;
+    for (size_t i = 1; i <= profile_.dictionary_size; ++i) {
+      sum += 1.0 / std::pow(static_cast<double>(i), profile_.zipf_skew);
+      zipf_cdf_.emplace_back(sum);
+    }
+  }
+}
+
 caf::error data_generator::operator()(data& x) {
   return generate(x);
 }
@@ -96,6 +119,7 @@ caf::error data_generator::generate(data::type tag, data& x) {
     GENERATE_CASE(set)
     GENERATE_CASE(table)
     GENERATE_CASE(vector)
+    GENERATE_CASE(packed_data)
     default:
       return caf::sec::invalid_argument;
   }
@@ -117,7 +141,8 @@ caf::error data_generator::generate(internal_command::type tag,
     case tag_type::put_command: {
       data key;
       data val;
-      GENERATE(key);
+      if (auto err = generate_key(key))
+        return err;
       GENERATE(val);
       x.content = put_command{std::move(key), std::move(val), nil};
       break;
@@ -125,7 +150,8 @@ caf::error data_generator::generate(internal_command::type tag,
     case tag_type::put_unique_command: {
       data key;
       data val;
-      GENERATE(key);
+      if (auto err = generate_key(key))
+        return err;
       GENERATE(val);
       x.content
         = put_unique_command{std::move(key), std::move(val), nil, nullptr, 0};
@@ -133,7 +159,8 @@ caf::error data_generator::generate(internal_command::type tag,
     }
     case tag_type::erase_command: {
       data key;
-      GENERATE(key);
+      if (auto err = generate_key(key))
+        return err;
       x.content = erase_command{std::move(key)};
       break;
     }
@@ -141,7 +168,8 @@ caf::error data_generator::generate(internal_command::type tag,
       data key;
       data val;
       data::type init_type{};
-      GENERATE(key);
+      if (auto err = generate_key(key))
+        return err;
       GENERATE(val);
       READ(init_type);
       x.content = add_command{std::move(key), std::move(val), init_type, nil};
@@ -150,7 +178,8 @@ caf::error data_generator::generate(internal_command::type tag,
     case tag_type::subtract_command: {
       data key;
       data val;
-      GENERATE(key);
+      if (auto err = generate_key(key))
+        return err;
       GENERATE(val);
       x.content = subtract_command{std::move(key), std::move(val)};
       break;
@@ -173,6 +202,43 @@ caf::error data_generator::generate(internal_command::type tag,
       x.content = clear_command{};
       break;
     }
+    case tag_type::put_many_command: {
+      std::unordered_map<data, data> xs;
+      GENERATE(xs);
+      x.content = put_many_command{std::move(xs), nil};
+      break;
+    }
+    case tag_type::erase_many_command: {
+      vector xs;
+      GENERATE(xs);
+      x.content = erase_many_command{std::move(xs)};
+      break;
+    }
+    case tag_type::compare_and_swap_command: {
+      data key;
+      data expected_value;
+      data val;
+      if (auto err = generate_key(key))
+        return err;
+      GENERATE(expected_value);
+      GENERATE(val);
+      x.content = compare_and_swap_command{std::move(key),
+                                           std::move(expected_value),
+                                           std::move(val), nil, nullptr, 0};
+      break;
+    }
+    case tag_type::add_and_get_command: {
+      data key;
+      data val;
+      data::type init_type{};
+      if (auto err = generate_key(key))
+        return err;
+      GENERATE(val);
+      READ(init_type);
+      x.content = add_and_get_command{std::move(key), std::move(val),
+                                      init_type, nil, nullptr, 0};
+      break;
+    }
     default:
       return ec::invalid_tag;
   }
@@ -181,7 +247,8 @@ caf::error data_generator::generate(internal_command::type tag,
 
 caf::error data_generator::generate(vector& xs) {
   uint32_t size = 0;
-  READ(size);
+  if (auto err = read_size(size))
+    return err;
   for (size_t i = 0; i < size; ++i) {
     data value;
     GENERATE(value);
@@ -192,7 +259,8 @@ caf::error data_generator::generate(vector& xs) {
 
 caf::error data_generator::generate(set& xs) {
   uint32_t size = 0;
-  READ(size);
+  if (auto err = read_size(size))
+    return err;
   data value;
   for (size_t i = 0; i < size; ++i) {
     GENERATE(value);
@@ -204,7 +272,8 @@ caf::error data_generator::generate(set& xs) {
 
 caf::error data_generator::generate(table& xs) {
   uint32_t size = 0;
-  READ(size);
+  if (auto err = read_size(size))
+    return err;
   data key;
   data value;
   for (size_t i = 0; i < size; ++i) {
@@ -218,7 +287,8 @@ caf::error data_generator::generate(table& xs) {
 
 caf::error data_generator::generate(std::unordered_map<data, data>& xs) {
   uint32_t size = 0;
-  READ(size);
+  if (auto err = read_size(size))
+    return err;
   data key;
   data value;
   for (size_t i = 0; i < size; ++i) {
@@ -232,8 +302,24 @@ caf::error data_generator::generate(std::unordered_map<data, data>& xs) {
 
 caf::error data_generator::generate(std::string& x) {
   uint32_t string_size = 0;
-  READ(string_size);
+  if (auto err = read_size(string_size))
+    return err;
   x.insert(x.end(), string_size, 'x');
+  if (!profile_.words.empty())
+    compose(x);
+  if (profile_.reuse > 0) {
+    // Reuse only makes a difference if new strings differ from each other.
+    if (profile_.words.empty())
+      shuffle(x);
+    reuse(strings_[x.size()], x);
+  }
+  return caf::none;
+}
+
+caf::error data_generator::generate_key(data& x) {
+  GENERATE(x);
+  if (profile_.reuse > 0)
+    reuse(keys_[static_cast<size_t>(x.get_type())], x);
   return caf::none;
 }
 
@@ -244,6 +330,37 @@ caf::error data_generator::generate(enum_value& x) {
   return caf::none;
 }
 
+caf::error data_generator::generate(packed_data& x) {
+  uint32_t size = 0;
+  if (auto err = read_size(size))
+    return err;
+  x.bytes.resize(size);
+  shuffle(x);
+  return caf::none;
+}
+
+caf::error data_generator::read_size(uint32_t& x) {
+  if (!varint_sizes_)
+    return source_(x);
+  // Collect the bytes of the varint first, since the codec reads from memory.
+  char buf[10];
+  size_t n = 0;
+  uint8_t byte = 0x80;
+  while ((byte & 0x80) != 0) {
+    if (n == sizeof(buf))
+      return ec::invalid_data;
+    READ(byte);
+    buf[n++] = static_cast<char>(byte);
+  }
+  const char* first = buf;
+  uint64_t value = 0;
+  if (!data_codec::read_varint(first, buf + n, value)
+      || value > std::numeric_limits<uint32_t>::max())
+    return ec::invalid_data;
+  x = static_cast<uint32_t>(value);
+  return caf::none;
+}
+
 void data_generator::shuffle(none&) {
   // nop
 }
@@ -261,6 +378,11 @@ void data_generator::shuffle(enum_value& x) {
   shuffle(x.name);
 }
 
+void data_generator::shuffle(packed_data& x) {
+  for (auto& c : x.bytes)
+    c = static_cast<char>(next_byte());
+}
+
 void data_generator::shuffle(port& x) {
   uint16_t num = uint16_t{next_byte()} << 8;
   num |= next_byte();
@@ -269,14 +391,39 @@ void data_generator::shuffle(port& x) {
 }
 
 void data_generator::shuffle(address& x) {
-  for (auto& byte : x.bytes())
-    byte = next_byte();
+  auto& bytes = x.bytes();
+  if (profile_.address_ranges.empty()) {
+    for (auto& byte : bytes)
+      byte = next_byte();
+    return;
+  }
+  auto& range = profile_.address_ranges[engine_()
+                                        % profile_.address_ranges.size()];
+  // Keep the network prefix and randomize the host bits. The length of an
+  // IPv4 subnet does not count the 96 bits of the IPv4-mapped prefix.
+  size_t prefix = range.length();
+  if (range.network().is_v4())
+    prefix += 96;
+  bytes = range.network().bytes();
+  for (size_t i = prefix / 8; i < bytes.size(); ++i) {
+    auto host_bits = next_byte();
+    if (i == prefix / 8 && prefix % 8 != 0)
+      host_bits &= static_cast<uint8_t>(0xFF >> (prefix % 8));
+    bytes[i] |= host_bits;
+  }
 }
 
 void data_generator::shuffle(subnet& x) {
   address addr;
   shuffle(addr);
-  x = subnet{addr, next_byte()};
+  if (profile_.address_ranges.empty()) {
+    x = subnet{addr, next_byte()};
+    return;
+  }
+  // Pick realistic prefix lengths for the address family.
+  auto length = addr.is_v4() ? static_cast<uint8_t>(16 + next_byte() % 17)
+                             : static_cast<uint8_t>(32 + next_byte() % 97);
+  x = subnet{addr, length};
 }
 
 void data_generator::shuffle(timespan& x) {
@@ -320,5 +467,30 @@ uint8_t data_generator::next_byte() {
   return static_cast<uint8_t>(byte_generator_(engine_));
 }
 
+bool data_generator::next_reuse() {
+  return real_generator_(engine_) < profile_.reuse;
+}
+
+size_t data_generator::next_index(size_t n) {
+  BROKER_ASSERT(n > 0 && n <= zipf_cdf_.size());
+  auto last = zipf_cdf_.begin() + n;
+  auto u = real_generator_(engine_) * zipf_cdf_[n - 1];
+  auto i = std::upper_bound(zipf_cdf_.begin(), last, u);
+  return std::min(static_cast<size_t>(i - zipf_cdf_.begin()), n - 1);
+}
+
+void data_generator::compose(std::string& x) {
+  auto& words = profile_.words;
+  size_t pos = 0;
+  while (pos < x.size()) {
+    if (pos > 0)
+      x[pos++] = ' ';
+    auto& word = words[engine_() % words.size()];
+    auto n = std::min(word.size(), x.size() - pos);
+    std::copy_n(word.begin(), n, x.begin() + pos);
+    pos += n;
+  }
+}
+
 } // namespace detail
 } // namespace broker
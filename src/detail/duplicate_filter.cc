@@ -0,0 +1,44 @@
+#include "broker/detail/duplicate_filter.hh"
+
+namespace broker {
+namespace detail {
+
+bool duplicate_filter::accept(uint64_t origin, uint32_t seq) {
+  if (origin == 0)
+    return true;
+  auto i = windows_.find(origin);
+  if (i == windows_.end()) {
+    // Starting over may accept a few duplicates, but keeps the memory usage
+    // bounded when peers restart over and over.
+    if (windows_.size() >= max_origins)
+      windows_.clear();
+    auto& w = windows_[origin];
+    w.top = seq;
+    w.seen.set(0);
+    return true;
+  }
+  auto& w = i->second;
+  // Compare sequence numbers in serial number arithmetic to survive wrapping.
+  auto diff = static_cast<int32_t>(seq - w.top);
+  if (diff > 0) {
+    if (static_cast<size_t>(diff) >= window_size)
+      w.seen.reset();
+    else
+      w.seen <<= static_cast<size_t>(diff);
+    w.seen.set(0);
+    w.top = seq;
+    return true;
+  }
+  auto age = static_cast<size_t>(-static_cast<int64_t>(diff));
+  if (age >= window_size)
+    return true;
+  if (w.seen.test(age)) {
+    ++rejected_;
+    return false;
+  }
+  w.seen.set(age);
+  return true;
+}
+
+} // namespace detail
+} // namespace broker
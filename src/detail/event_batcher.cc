@@ -0,0 +1,45 @@
+#include "broker/detail/event_batcher.hh"
+
+#include <utility>
+
+namespace broker {
+namespace detail {
+
+event_batcher::event_batcher(timespan interval, size_t max_batch_size)
+  : interval_(interval), max_batch_size_(max_batch_size) {
+  // nop
+}
+
+bool event_batcher::admit(const key_type& key) {
+  if (!enabled())
+    return true;
+  // Also counts admitted events that wait for resolving a network address.
+  if (max_batch_size_ > 0 && keys_.size() >= max_batch_size_) {
+    ++dropped_;
+    return false;
+  }
+  if (!keys_.emplace(key).second) {
+    ++suppressed_;
+    return false;
+  }
+  return true;
+}
+
+bool event_batcher::push(data_message msg) {
+  buf_.emplace_back(std::move(msg));
+  if (flush_scheduled_)
+    return false;
+  flush_scheduled_ = true;
+  return true;
+}
+
+std::vector<data_message> event_batcher::flush() {
+  std::vector<data_message> result;
+  result.swap(buf_);
+  keys_.clear();
+  flush_scheduled_ = false;
+  return result;
+}
+
+} // namespace detail
+} // namespace broker
@@ -42,6 +42,10 @@ bool try_again_later() {
 
 #define PIPE_READ ::read
 
+#ifdef BROKER_HAS_EVENTFD
+#include <sys/eventfd.h>
+#endif // BROKER_HAS_EVENTFD
+
 namespace {
 
 bool try_again_later() {
@@ -57,6 +61,24 @@ bool try_again_later() {
 
 namespace broker::detail {
 
+#ifdef BROKER_HAS_EVENTFD
+
+flare::flare() {
+  auto fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE);
+  if (fd == -1) {
+    BROKER_ERROR("failed to create flare eventfd");
+    std::terminate();
+  }
+  fds_[0] = fd;
+  fds_[1] = fd;
+}
+
+flare::~flare() {
+  ::close(fds_[0]);
+}
+
+#else // BROKER_HAS_EVENTFD
+
 namespace {
 
 constexpr size_t stack_buffer_size = 256;
@@ -87,10 +109,46 @@ flare::~flare() {
   close_socket(fds_[1]);
 }
 
+#endif // BROKER_HAS_EVENTFD
+
 flare::native_socket flare::fd() const {
   return fds_[0];
 }
 
+#ifdef BROKER_HAS_EVENTFD
+
+void flare::fire(size_t num) {
+  auto value = static_cast<eventfd_t>(num);
+  for (;;) {
+    if (::eventfd_write(fds_[1], value) == 0)
+      return;
+    if (!try_again_later()) {
+      BROKER_ERROR("unable to write flare eventfd!");
+      std::terminate();
+    }
+  }
+}
+
+size_t flare::extinguish() {
+  // In semaphore mode, each read decrements the counter by one.
+  size_t result = 0;
+  while (extinguish_one())
+    ++result;
+  return result;
+}
+
+bool flare::extinguish_one() {
+  eventfd_t value = 0;
+  for (;;) {
+    if (::eventfd_read(fds_[0], &value) == 0)
+      return true; // Decremented the counter by one.
+    if (try_again_later())
+      return false; // Counter is zero.
+  }
+}
+
+#else // BROKER_HAS_EVENTFD
+
 void flare::fire(size_t num) {
   char tmp[stack_buffer_size];
   size_t remaining = num;
@@ -128,6 +186,8 @@ bool flare::extinguish_one() {
   }
 }
 
+#endif // BROKER_HAS_EVENTFD
+
 void flare::await_one() {
   BROKER_TRACE("");
   pollfd p = {fds_[0], POLLIN, 0};
@@ -10,8 +10,9 @@
 namespace broker {
 namespace detail {
 
-flare_actor::flare_actor(caf::actor_config& sys)
+flare_actor::flare_actor(caf::actor_config& sys, bool fire_per_burst)
     : blocking_actor{sys},
+      fire_per_burst_{fire_per_burst},
       flare_count_{0} {
 }
 
@@ -50,6 +51,8 @@ void flare_actor::enqueue(caf::mailbox_element_ptr ptr, caf::execution_unit*) {
   std::unique_lock<std::mutex> lock{flare_mtx_};
   switch (mailbox().enqueue(ptr.release())) {
     case caf::detail::enqueue_result::unblocked_reader: {
+      if (fire_per_burst_ && flare_count_ > 0)
+        break;
       BROKER_DEBUG("firing flare");
       flare_.fire();
       ++flare_count_;
@@ -62,6 +65,8 @@ void flare_actor::enqueue(caf::mailbox_element_ptr ptr, caf::execution_unit*) {
       }
       break;
     case caf::detail::enqueue_result::success: {
+      if (fire_per_burst_ && flare_count_ > 0)
+        break;
       flare_.fire();
       ++flare_count_;
       break;
@@ -85,10 +90,35 @@ const char* flare_actor::name() const {
 
 void flare_actor::extinguish_one() {
   std::unique_lock<std::mutex> lock{flare_mtx_};
+  if (fire_per_burst_) {
+    extinguish_if_empty_impl();
+    return;
+  }
   auto extinguished = flare_.extinguish_one();
   CAF_ASSERT(extinguished);
   --flare_count_;
 }
 
+void flare_actor::extinguish_if_empty() {
+  std::unique_lock<std::mutex> lock{flare_mtx_};
+  extinguish_if_empty_impl();
+}
+
+bool flare_actor::mailbox_empty() {
+  // Make sure to not access fifo_inbox::empty when blocked.
+  auto& mbox = mailbox();
+  return mbox.blocked() ? mbox.queue().empty() : mbox.empty();
+}
+
+void flare_actor::extinguish_if_empty_impl() {
+  // Enqueue fires while holding flare_mtx_, i.e., no message can slip in
+  // between checking the mailbox and extinguishing the flare.
+  if (flare_count_ == 0 || !mailbox_empty())
+    return;
+  BROKER_DEBUG("extinguishing flare");
+  flare_.extinguish();
+  flare_count_ = 0;
+}
+
 } // namespace detail
 } // namespace broker
@@ -2,11 +2,13 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 #include <caf/byte.hpp>
 #include <caf/detail/scope_guard.hpp>
 #include <caf/error.hpp>
 #include <caf/none.hpp>
+#include <caf/sec.hpp>
 
 #include "broker/config.hh"
 #include "broker/detail/assert.hh"
@@ -58,6 +60,14 @@ void* make_file_view(void* mapper, size_t file_size) {
   return MapViewOfFile(mapper, FILE_MAP_READ, 0, 0, file_size);
 }
 
+void advise_sequential(void*, size_t) {
+  // Covered by FILE_FLAG_SEQUENTIAL_SCAN in open_file.
+}
+
+void prefetch(void*, size_t, size_t) {
+  // nop
+}
+
 } // namespace
 
 #else // BROKER_WINDOWS
@@ -99,26 +109,100 @@ void* make_file_view(void* addr, size_t) {
   return addr;
 }
 
+void advise_sequential(void* addr, size_t file_size) {
+  // Lets the kernel read ahead aggressively and drop pages behind us.
+  madvise(addr, file_size, MADV_SEQUENTIAL);
+}
+
+/// Asks the kernel to page in `[offset, offset + size)` of the mapping at
+/// `addr` asynchronously.
+void prefetch(void* addr, size_t offset, size_t size) {
+  static const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  auto first = offset - offset % page_size;
+  madvise(reinterpret_cast<char*>(addr) + first, size + (offset - first),
+          MADV_WILLNEED);
+}
+
 } // namespace
 
 #endif // BROKER_WINDOWS
 
 namespace broker::detail {
 
+namespace {
+
+using format = generator_file_writer::format;
+
+} // namespace
+
 generator_file_reader::generator_file_reader(file_handle fd,
                                              mapper_handle mapper,
                                              mapped_pointer addr,
-                                             size_t file_size)
+                                             size_t file_size,
+                                             uint8_t version,
+                                             data_generator::profile prof)
   : fd_(fd),
     mapper_(mapper),
     addr_(addr),
     file_size_(file_size),
+    version_(version),
+    content_size_(file_size),
     source_(nullptr,
             caf::make_span(reinterpret_cast<caf::byte*>(addr), file_size)),
-    generator_(source_) {
+    generator_(source_, std::move(prof)) {
   // We've already verified the file header in make_generator_file_reader.
-  source_.skip(sizeof(generator_file_writer::format::magic)
-               + sizeof(generator_file_writer::format::version));
+  generator_.varint_sizes(version_ >= 4);
+  if (version_ >= 2)
+    index_blocks();
+  source_.reset({reinterpret_cast<caf::byte*>(addr_), content_size_});
+  source_.skip(format::header_size);
+  block_end_ = format::header_size;
+}
+
+void generator_file_reader::index_blocks() {
+  auto base = reinterpret_cast<const char*>(addr_);
+  auto pos = format::header_size;
+  while (pos + format::block_header_size <= file_size_) {
+    uint32_t size;
+    uint32_t entries;
+    int64_t first;
+    int64_t last;
+    auto ptr = base + pos;
+    auto read = [&](auto& x) {
+      memcpy(&x, ptr, sizeof(x));
+      ptr += sizeof(x);
+    };
+    read(size);
+    read(entries);
+    read(first);
+    read(last);
+    auto offset = pos + format::block_header_size;
+    if (offset + size > file_size_)
+      break;
+    blocks_.emplace_back(block_info{offset, size, entries,
+                                    timestamp{timespan{first}},
+                                    timestamp{timespan{last}}});
+    pos = offset + size;
+  }
+  if (pos != file_size_)
+    BROKER_WARNING("ignoring" << (file_size_ - pos)
+                              << "bytes of a truncated block");
+  content_size_ = pos;
+}
+
+void generator_file_reader::enter_block(size_t index) {
+  BROKER_ASSERT(index < blocks_.size());
+  auto& block = blocks_[index];
+  source_.reset({reinterpret_cast<caf::byte*>(addr_) + block.offset,
+                 content_size_ - block.offset});
+  block_end_ = block.offset + block.size;
+  next_block_ = index + 1;
+  topic_table_.clear();
+  // Page in the next block while we decode this one.
+  if (next_block_ < blocks_.size()) {
+    auto& next = blocks_[next_block_];
+    prefetch(addr_, next.offset, next.size);
+  }
 }
 
 generator_file_reader::~generator_file_reader() {
@@ -133,47 +217,79 @@ bool generator_file_reader::at_end() const {
 void generator_file_reader::rewind() {
   BROKER_ASSERT(at_end());
   sealed_ = true;
-  source_.reset({reinterpret_cast<caf::byte*>(addr_), file_size_});
-  source_.skip(sizeof(generator_file_writer::format::magic)
-               + sizeof(generator_file_writer::format::version));
+  source_.reset({reinterpret_cast<caf::byte*>(addr_), content_size_});
+  source_.skip(format::header_size);
+  block_end_ = format::header_size;
+  next_block_ = 0;
+  topic_table_.clear();
+}
+
+caf::error generator_file_reader::seek(size_t index) {
+  if (version_ < 2 || index >= blocks_.size())
+    return make_error(caf::sec::invalid_argument, "no such block");
+  enter_block(index);
+  return caf::none;
 }
 
 caf::error generator_file_reader::read(value_type& x) {
+  timestamp t;
+  return read(x, t);
+}
+
+caf::error generator_file_reader::read(value_type& x, timestamp& t) {
   if (at_end())
     return ec::end_of_file;
   using entry_type = generator_file_writer::format::entry_type;
   // Read until we got a data_message, a command_message, or an error.
   for (;;) {
+    if (version_ >= 2 && offset() == block_end_) {
+      if (next_block_ == blocks_.size())
+        return ec::end_of_file;
+      enter_block(next_block_);
+    }
+    auto read_timestamp = [&]() -> caf::error {
+      if (version_ >= 3) {
+        int64_t ts;
+        BROKER_TRY(source_(ts));
+        t = timestamp{timespan{ts}};
+      } else if (version_ == 2 && next_block_ > 0) {
+        t = blocks_[next_block_ - 1].first;
+      } else {
+        t = timestamp{};
+      }
+      return caf::none;
+    };
     entry_type entry{};
     BROKER_TRY(source_(entry));
     switch (entry) {
       case entry_type::new_topic: {
         std::string str;
         BROKER_TRY(source_(str));
-        if (!sealed_)
-          topic_table_.emplace_back(str);
+        topic_table_.emplace_back(topics_.intern(topic{std::move(str)}));
         break;
       }
       case entry_type::data_message: {
         uint16_t topic_id;
-        BROKER_TRY(source_(topic_id));
+        BROKER_TRY(source_(topic_id), read_timestamp());
         if (topic_id >= topic_table_.size())
           return ec::invalid_topic_key;
         data value;
         BROKER_TRY(generator_(value));
-        x = make_data_message(topic_table_[topic_id], std::move(value));
+        x = make_data_message(topics_[topic_table_[topic_id]],
+                              std::move(value));
         if (!sealed_)
           ++data_entries_;
         return caf::none;
       }
       case entry_type::command_message: {
         uint16_t topic_id;
-        BROKER_TRY(source_(topic_id));
+        BROKER_TRY(source_(topic_id), read_timestamp());
         if (topic_id >= topic_table_.size())
           return ec::invalid_topic_key;
         internal_command cmd;
         BROKER_TRY(generator_(cmd));
-        x = make_command_message(topic_table_[topic_id], std::move(cmd));
+        x = make_command_message(topics_[topic_table_[topic_id]],
+                                 std::move(cmd));
         if (!sealed_)
           ++command_entries_;
         return caf::none;
@@ -182,6 +298,23 @@ caf::error generator_file_reader::read(value_type& x) {
   }
 }
 
+caf::error generator_file_reader::read(std::vector<value_type>& xs,
+                                       size_t n) {
+  if (at_end())
+    return ec::end_of_file;
+  xs.reserve(xs.size() + n);
+  for (size_t i = 0; i < n && !at_end(); ++i) {
+    value_type x;
+    if (auto err = read(x)) {
+      if (err == ec::end_of_file)
+        break;
+      return err;
+    }
+    xs.emplace_back(std::move(x));
+  }
+  return caf::none;
+}
+
 caf::error generator_file_reader::skip() {
   if (at_end())
     return ec::end_of_file;
@@ -197,6 +330,12 @@ caf::error generator_file_reader::skip_to_end() {
 }
 
 generator_file_reader_ptr make_generator_file_reader(const std::string& fname) {
+  return make_generator_file_reader(fname, data_generator::profile{});
+}
+
+generator_file_reader_ptr
+make_generator_file_reader(const std::string& fname,
+                           data_generator::profile prof) {
   // Get a file handle for the file.
   auto [fd, fd_ok] = open_file(fname.c_str());
   if (!fd_ok) {
@@ -239,12 +378,14 @@ generator_file_reader_ptr make_generator_file_reader(const std::string& fname) {
     BROKER_ERROR("unexpected file header (magic mismatch):" << fname);
     return nullptr;
   }
-  if (version != generator_file_writer::format::version) {
+  if (version == 0 || version > generator_file_writer::format::version) {
     BROKER_ERROR("unexpected file header (version mismatch):" << fname);
     return nullptr;
   }
+  advise_sequential(addr, fsize);
   // Done.
-  auto ptr = new generator_file_reader(fd, mapper, addr, fsize);
+  auto ptr = new generator_file_reader(fd, mapper, addr, fsize, version,
+                                       std::move(prof));
   guard1.disable();
   guard2.disable();
   return generator_file_reader_ptr{ptr};
@@ -0,0 +1,199 @@
+#include "broker/detail/generator_file_recorder.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <utility>
+
+#include <caf/error.hpp>
+
+#include "broker/detail/assert.hh"
+#include "broker/detail/filesystem.hh"
+#include "broker/logger.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+/// Upper bound for the writer thread sleeping on an empty ring. Only matters
+/// in the rare case that the producer misses the writer going to sleep.
+constexpr auto max_idle_time = std::chrono::milliseconds(10);
+
+} // namespace
+
+generator_file_recorder::generator_file_recorder(
+  generator_file_writer_ptr writer, size_t capacity, overflow_policy policy,
+  segment_options segments)
+  : writer_(std::move(writer)),
+    policy_(policy),
+    segments_(std::move(segments)),
+    ring_(capacity),
+    sleeping_(false),
+    done_(false),
+    failed_(false),
+    dropped_(0) {
+  BROKER_ASSERT(writer_ != nullptr);
+  if (segments_.enabled())
+    segment_files_.emplace_back(writer_->file_name());
+  thread_ = std::thread{[this] { run(); }};
+}
+
+generator_file_recorder::~generator_file_recorder() {
+  done_ = true;
+  { // Make sure the writer thread is either awake or waiting on cv_.
+    std::unique_lock<std::mutex> guard{mtx_};
+  }
+  cv_.notify_one();
+  thread_.join();
+  if (dropped_ > 0)
+    BROKER_WARNING("dropped" << dropped_.load()
+                             << "messages while recording");
+}
+
+bool generator_file_recorder::push(const data_message& x) {
+  return enqueue(entry{x, now()});
+}
+
+bool generator_file_recorder::push(const command_message& x) {
+  return enqueue(entry{x, now()});
+}
+
+bool generator_file_recorder::push(const data_message& x, timestamp t) {
+  return enqueue(entry{x, t});
+}
+
+bool generator_file_recorder::push(const command_message& x, timestamp t) {
+  return enqueue(entry{x, t});
+}
+
+bool generator_file_recorder::enqueue(entry x) {
+  if (failed_)
+    return false;
+  while (!ring_.try_push(std::move(x))) {
+    if (policy_ == overflow_policy::drop) {
+      ++dropped_;
+      return true;
+    }
+    if (failed_)
+      return false;
+    std::this_thread::yield();
+  }
+  if (sleeping_) {
+    { // Wait until the writer thread actually waits on cv_.
+      std::unique_lock<std::mutex> guard{mtx_};
+    }
+    cv_.notify_one();
+  }
+  return true;
+}
+
+void generator_file_recorder::run() {
+  auto write = [this](entry&& x) {
+    if (rotation_due(x)) {
+      if (auto err = rotate()) {
+        BROKER_WARNING("unable to open next segment:" << err);
+        failed_ = true;
+        return;
+      }
+    }
+    if (auto err = writer_->write(x.content, x.time)) {
+      BROKER_WARNING("unable to write to generator file:" << err);
+      failed_ = true;
+      return;
+    }
+    if (segment_entries_++ == 0)
+      segment_start_ = x.time;
+  };
+  for (;;) {
+    while (!failed_ && ring_.try_pop(write))
+      ; // Drain the ring.
+    if (failed_)
+      return;
+    // The producer no longer pushes after setting done_, i.e., we can stop
+    // as soon as we see done_ and an empty ring.
+    if (done_) {
+      if (ring_.empty())
+        break;
+      continue;
+    }
+    std::unique_lock<std::mutex> guard{mtx_};
+    sleeping_ = true;
+    if (ring_.empty() && !done_)
+      cv_.wait_for(guard, max_idle_time);
+    sleeping_ = false;
+  }
+  if (auto err = writer_->flush())
+    BROKER_WARNING("unable to flush generator file:" << err);
+}
+
+bool generator_file_recorder::rotation_due(const entry& x) const {
+  if (segment_entries_ == 0)
+    return false;
+  if (segments_.max_size > 0 && writer_->file_size() >= segments_.max_size)
+    return true;
+  return segments_.max_duration.count() > 0
+         && x.time - segment_start_ >= segments_.max_duration;
+}
+
+caf::error generator_file_recorder::rotate() {
+  auto file_name = segment_file_name(segments_.prefix, ++segment_index_);
+  BROKER_DEBUG("rotate recording to" << file_name);
+  if (auto err = writer_->open(file_name))
+    return err;
+  segment_entries_ = 0;
+  segment_files_.emplace_back(std::move(file_name));
+  if (segments_.max_segments > 0) {
+    while (segment_files_.size() > segments_.max_segments) {
+      if (!detail::remove(segment_files_.front()))
+        BROKER_WARNING("unable to remove old segment"
+                       << segment_files_.front());
+      segment_files_.pop_front();
+    }
+  }
+  return caf::none;
+}
+
+bool convert(caf::string_view x, generator_file_recorder::overflow_policy& y) {
+  using policy = generator_file_recorder::overflow_policy;
+  if (x == "drop") {
+    y = policy::drop;
+    return true;
+  }
+  if (x == "block") {
+    y = policy::block;
+    return true;
+  }
+  return false;
+}
+
+std::string segment_file_name(const std::string& prefix, size_t index) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), "-%04zu.dat", index);
+  return prefix + buf;
+}
+
+generator_file_recorder_ptr
+make_generator_file_recorder(const std::string& fname, size_t capacity,
+                             generator_file_recorder::overflow_policy policy) {
+  auto writer = make_generator_file_writer(fname);
+  if (writer == nullptr)
+    return nullptr;
+  return std::make_unique<generator_file_recorder>(std::move(writer), capacity,
+                                                   policy);
+}
+
+generator_file_recorder_ptr make_generator_file_recorder(
+  generator_file_recorder::segment_options segments, size_t capacity,
+  generator_file_recorder::overflow_policy policy) {
+  BROKER_ASSERT(segments.enabled());
+  auto writer = make_generator_file_writer(segment_file_name(segments.prefix,
+                                                             1));
+  if (writer == nullptr)
+    return nullptr;
+  return std::make_unique<generator_file_recorder>(std::move(writer), capacity,
+                                                   policy,
+                                                   std::move(segments));
+}
+
+} // namespace detail
+} // namespace broker
@@ -1,5 +1,8 @@
 #include "broker/detail/generator_file_writer.hh"
 
+#include <cstring>
+#include <limits>
+
 #include <caf/error.hpp>
 #include <caf/sec.hpp>
 
@@ -26,7 +29,15 @@ caf::error generator_file_writer::open(std::string file_name) {
   if (auto err = flush()) {
     // Log the error, but ignore it otherwise.
     BROKER_ERROR("flushing previous file failed:" << err);
+    buf_.clear();
+    sink_.seek(0);
+    topic_table_.clear();
+    block_entries_ = 0;
   }
+  if (f_.is_open())
+    f_.close();
+  f_.clear();
+  bytes_written_ = 0;
   f_.open(file_name, std::ofstream::binary);
   if (!f_.is_open())
     return make_error(ec::cannot_open_file, file_name);
@@ -46,60 +57,101 @@ caf::error generator_file_writer::open(std::string file_name) {
     return make_error(ec::cannot_write_file, file_name);
   }
   file_name_ = std::move(file_name);
+  bytes_written_ = sizeof(header);
   return caf::none;
 }
 
 caf::error generator_file_writer::flush() {
   if (!f_.is_open() || buf_.empty())
     return caf::none;
-  if (!f_.write(reinterpret_cast<const char*>(buf_.data()), buf_.size()))
+  if (buf_.size() > std::numeric_limits<uint32_t>::max())
+    return make_error(ec::cannot_write_file, file_name_, "block too large");
+  auto size = static_cast<uint32_t>(buf_.size());
+  int64_t first = block_first_.time_since_epoch().count();
+  int64_t last = block_last_.time_since_epoch().count();
+  char header[format::block_header_size];
+  auto pos = header;
+  auto append = [&](const auto& x) {
+    memcpy(pos, &x, sizeof(x));
+    pos += sizeof(x);
+  };
+  append(size);
+  append(block_entries_);
+  append(first);
+  append(last);
+  if (!f_.write(header, sizeof(header))
+      || !f_.write(reinterpret_cast<const char*>(buf_.data()), buf_.size()))
     return make_error(ec::cannot_write_file, file_name_);
+  bytes_written_ += sizeof(header) + buf_.size();
   buf_.clear();
   sink_.seek(0);
+  // Each block starts with an empty topic table.
+  topic_table_.clear();
+  block_entries_ = 0;
+  return caf::none;
+}
+
+caf::error generator_file_writer::finish_entry(timestamp t) {
+  if (block_entries_++ == 0)
+    block_first_ = t;
+  block_last_ = t;
+  if (buf_.size() >= flush_threshold())
+    return flush();
   return caf::none;
 }
 
 caf::error generator_file_writer::write(const data_message& x) {
+  return write(x, now());
+}
+
+caf::error generator_file_writer::write(const command_message& x) {
+  return write(x, now());
+}
+
+caf::error generator_file_writer::write(const data_or_command_message& x) {
+  return write(x, now());
+}
+
+caf::error generator_file_writer::write(const data_message& x, timestamp t) {
   meta_data_writer writer{sink_};
   uint16_t tid;
   auto entry = format::entry_type::data_message;
-  BROKER_TRY(topic_id(get_topic(x), tid), sink_(entry, tid),
+  int64_t ts = t.time_since_epoch().count();
+  BROKER_TRY(topic_id(get_topic(x), tid), sink_(entry, tid, ts),
              writer(get_data(x)));
-  if (buf_.size() >= flush_threshold())
-    return flush();
-  return caf::none;
+  return finish_entry(t);
 }
 
-caf::error generator_file_writer::write(const command_message& x) {
+caf::error generator_file_writer::write(const command_message& x,
+                                        timestamp t) {
   meta_command_writer writer{sink_};
   uint16_t tid;
   auto entry = format::entry_type::command_message;
-  BROKER_TRY(topic_id(get_topic(x), tid), sink_(entry, tid),
+  int64_t ts = t.time_since_epoch().count();
+  BROKER_TRY(topic_id(get_topic(x), tid), sink_(entry, tid, ts),
              writer(get_command(x)));
-  if (buf_.size() >= flush_threshold())
-    return flush();
-  return caf::none;
+  return finish_entry(t);
 }
 
-caf::error generator_file_writer::write(const data_or_command_message& x) {
+caf::error generator_file_writer::write(const data_or_command_message& x,
+                                        timestamp t) {
   if (caf::holds_alternative<data_message>(x))
-    return write(caf::get<data_message>(x));
-  return write(caf::get<command_message>(x));
+    return write(caf::get<data_message>(x), t);
+  return write(caf::get<command_message>(x), t);
 }
 
 caf::error generator_file_writer::topic_id(const topic& x, uint16_t& id) {
-  auto e = topic_table_.end();
-  auto i = std::find(topic_table_.begin(), e, x);
-  if (i == e) {
+  auto i = topic_table_.find(x);
+  if (i == topic_table::invalid_id) {
+    if (topic_table_.size() > std::numeric_limits<uint16_t>::max())
+      return make_error(ec::invalid_topic_key, x.string());
     // Write the new topic to file first.
     auto entry = format::entry_type::new_topic;
     if (auto err = sink_(entry, x.string()))
       return err;
-    id = static_cast<uint16_t>(topic_table_.size());
-    topic_table_.emplace_back(x);
-    return caf::none;
+    i = topic_table_.intern(x);
   }
-  id = static_cast<uint16_t>(std::distance(topic_table_.begin(), i));
+  id = static_cast<uint16_t>(i);
   return caf::none;
 }
 
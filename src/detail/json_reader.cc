@@ -0,0 +1,344 @@
+#include "broker/detail/json_reader.hh"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "broker/error.hh"
+
+#include "broker/detail/simd.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+bool is_whitespace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+bool is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+void append_utf8(std::string& str, uint32_t cp) {
+  if (cp < 0x80) {
+    str += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    str += static_cast<char>(0xC0 | (cp >> 6));
+    str += static_cast<char>(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    str += static_cast<char>(0xE0 | (cp >> 12));
+    str += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    str += static_cast<char>(0x80 | (cp & 0x3F));
+  } else {
+    str += static_cast<char>(0xF0 | (cp >> 18));
+    str += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    str += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    str += static_cast<char>(0x80 | (cp & 0x3F));
+  }
+}
+
+struct parser {
+  const char*& first;
+  const char* last;
+
+  caf::error fail(const char* what) {
+    return make_error(ec::invalid_data, what);
+  }
+
+  caf::error eof() {
+    return make_error(ec::end_of_file, "incomplete JSON value");
+  }
+
+  bool skip_whitespace() {
+    while (first != last && is_whitespace(*first))
+      ++first;
+    return first != last;
+  }
+
+  caf::error literal(const char* str, data value, data& x) {
+    auto len = strlen(str);
+    auto avail = static_cast<size_t>(last - first);
+    if (memcmp(first, str, std::min(len, avail)) != 0)
+      return fail("invalid literal");
+    if (avail < len)
+      return eof();
+    first += len;
+    x = std::move(value);
+    return caf::none;
+  }
+
+  caf::error number(data& x) {
+    auto start = first;
+    auto is_integer = true;
+    auto digits = [&] {
+      auto pos = first;
+      while (first != last && is_digit(*first))
+        ++first;
+      return first != pos;
+    };
+    if (*first == '-')
+      ++first;
+    if (!digits())
+      return first == last ? eof() : fail("invalid number");
+    if (first != last && *first == '.') {
+      is_integer = false;
+      ++first;
+      if (!digits())
+        return first == last ? eof() : fail("invalid number");
+    }
+    if (first != last && (*first == 'e' || *first == 'E')) {
+      is_integer = false;
+      ++first;
+      if (first != last && (*first == '+' || *first == '-'))
+        ++first;
+      if (!digits())
+        return first == last ? eof() : fail("invalid number");
+    }
+    if (first == last)
+      return eof();
+    if (is_integer) {
+      if (*start == '-') {
+        integer value;
+        auto res = std::from_chars(start, first, value);
+        if (res.ec != std::errc{})
+          return fail("integer out of range");
+        x = value;
+      } else {
+        count value;
+        auto res = std::from_chars(start, first, value);
+        if (res.ec != std::errc{})
+          return fail("integer out of range");
+        x = value;
+      }
+      return caf::none;
+    }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    // Falls back to strtod for values out of range.
+    real value;
+    if (auto res = std::from_chars(start, first, value);
+        res.ec == std::errc{}) {
+      x = value;
+      return caf::none;
+    }
+#endif
+    // strtod requires a null-terminated string.
+    char tmp[64];
+    auto len = static_cast<size_t>(first - start);
+    if (len >= sizeof(tmp))
+      return fail("number too long");
+    memcpy(tmp, start, len);
+    tmp[len] = '\0';
+    x = real{strtod(tmp, nullptr)};
+    return caf::none;
+  }
+
+  caf::error read_hex4(uint32_t& cp) {
+    if (last - first < 4)
+      return eof();
+    cp = 0;
+    for (int i = 0; i < 4; ++i) {
+      auto val = hex_value(*first++);
+      if (val < 0)
+        return fail("invalid unicode escape");
+      cp = (cp << 4) | static_cast<uint32_t>(val);
+    }
+    return caf::none;
+  }
+
+  caf::error string(std::string& str) {
+    ++first; // opening quote
+    for (;;) {
+      // Copy runs of characters without escapes in one go.
+      auto run = first;
+      first = find_json_special(first, last);
+      str.append(run, first);
+      if (first == last)
+        return eof();
+      if (*first == '"') {
+        ++first;
+        return caf::none;
+      }
+      if (*first != '\\')
+        return fail("control character in string");
+      if (++first == last)
+        return eof();
+      switch (*first++) {
+        case '"':
+          str += '"';
+          break;
+        case '\\':
+          str += '\\';
+          break;
+        case '/':
+          str += '/';
+          break;
+        case 'b':
+          str += '\b';
+          break;
+        case 'f':
+          str += '\f';
+          break;
+        case 'n':
+          str += '\n';
+          break;
+        case 'r':
+          str += '\r';
+          break;
+        case 't':
+          str += '\t';
+          break;
+        case 'u': {
+          uint32_t cp;
+          if (auto err = read_hex4(cp))
+            return err;
+          if (cp >= 0xD800 && cp < 0xDC00) {
+            // High surrogate, must be followed by a low surrogate.
+            if (last - first < 2)
+              return eof();
+            if (first[0] != '\\' || first[1] != 'u')
+              return fail("unpaired surrogate");
+            first += 2;
+            uint32_t low;
+            if (auto err = read_hex4(low))
+              return err;
+            if (low < 0xDC00 || low >= 0xE000)
+              return fail("unpaired surrogate");
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+          } else if (cp >= 0xDC00 && cp < 0xE000) {
+            return fail("unpaired surrogate");
+          }
+          append_utf8(str, cp);
+          break;
+        }
+        default:
+          return fail("invalid escape sequence");
+      }
+    }
+  }
+
+  caf::error array(data& x, size_t depth) {
+    ++first; // opening bracket
+    vector xs;
+    if (!skip_whitespace())
+      return eof();
+    if (*first == ']') {
+      ++first;
+      x = std::move(xs);
+      return caf::none;
+    }
+    for (;;) {
+      xs.emplace_back();
+      if (auto err = value(xs.back(), depth))
+        return err;
+      if (!skip_whitespace())
+        return eof();
+      if (*first == ']') {
+        ++first;
+        x = std::move(xs);
+        return caf::none;
+      }
+      if (*first++ != ',')
+        return fail("expected ',' or ']'");
+    }
+  }
+
+  caf::error object(data& x, size_t depth) {
+    ++first; // opening brace
+    table xs;
+    if (!skip_whitespace())
+      return eof();
+    if (*first == '}') {
+      ++first;
+      x = std::move(xs);
+      return caf::none;
+    }
+    for (;;) {
+      if (!skip_whitespace())
+        return eof();
+      if (*first != '"')
+        return fail("expected string as object key");
+      std::string key;
+      if (auto err = string(key))
+        return err;
+      if (!skip_whitespace())
+        return eof();
+      if (*first++ != ':')
+        return fail("expected ':'");
+      data val;
+      if (auto err = value(val, depth))
+        return err;
+      // Objects written by Broker list their keys in order.
+      xs.insert_or_assign(xs.end(), std::move(key), std::move(val));
+      if (!skip_whitespace())
+        return eof();
+      if (*first == '}') {
+        ++first;
+        x = std::move(xs);
+        return caf::none;
+      }
+      if (*first++ != ',')
+        return fail("expected ',' or '}'");
+    }
+  }
+
+  caf::error value(data& x, size_t depth) {
+    if (!skip_whitespace())
+      return eof();
+    switch (*first) {
+      case 'n':
+        return literal("null", nil, x);
+      case 't':
+        return literal("true", true, x);
+      case 'f':
+        return literal("false", false, x);
+      case '"': {
+        std::string str;
+        if (auto err = string(str))
+          return err;
+        x = std::move(str);
+        return caf::none;
+      }
+      case '[':
+        if (depth == json_reader::max_depth)
+          return fail("maximum nesting depth exceeded");
+        return array(x, depth + 1);
+      case '{':
+        if (depth == json_reader::max_depth)
+          return fail("maximum nesting depth exceeded");
+        return object(x, depth + 1);
+      default:
+        if (*first == '-' || is_digit(*first))
+          return number(x);
+        return fail("unexpected character");
+    }
+  }
+};
+
+} // namespace
+
+caf::error json_reader::read(const char*& first, const char* last, data& x) {
+  // Leave `first` untouched unless we succeed.
+  auto pos = first;
+  parser f{pos, last};
+  if (auto err = f.value(x, 0))
+    return err;
+  first = pos;
+  return caf::none;
+}
+
+} // namespace detail
+} // namespace broker
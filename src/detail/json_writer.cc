@@ -0,0 +1,223 @@
+#include "broker/detail/json_writer.hh"
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#include "broker/convert.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+template <class T>
+void append_integer(std::string& buf, T x) {
+  char tmp[24];
+  auto res = std::to_chars(tmp, tmp + sizeof(tmp), x);
+  buf.append(tmp, res.ptr);
+}
+
+// Prints nanoseconds as seconds with exactly nine decimal places.
+void append_seconds(std::string& buf, int64_t ns) {
+  auto abs_ns = static_cast<uint64_t>(ns);
+  if (ns < 0) {
+    buf += '-';
+    abs_ns = ~abs_ns + 1;
+  }
+  append_integer(buf, abs_ns / 1000000000u);
+  char tmp[10];
+  tmp[0] = '.';
+  auto frac = abs_ns % 1000000000u;
+  for (int i = 9; i > 0; --i) {
+    tmp[i] = static_cast<char>('0' + frac % 10);
+    frac /= 10;
+  }
+  buf.append(tmp, sizeof(tmp));
+}
+
+struct json_visitor {
+  using result_type = void;
+
+  json_writer& writer;
+  std::string& buf;
+  std::string& scratch;
+
+  void operator()(none) {
+    buf += "null";
+  }
+
+  void operator()(boolean x) {
+    buf += x ? "true" : "false";
+  }
+
+  void operator()(count x) {
+    append_integer(buf, x);
+  }
+
+  void operator()(integer x) {
+    append_integer(buf, x);
+  }
+
+  void operator()(real x) {
+    if (!std::isfinite(x)) {
+      buf += "null";
+      return;
+    }
+    char tmp[32];
+    auto n = snprintf(tmp, sizeof(tmp), "%.17g", x);
+    buf.append(tmp, static_cast<size_t>(n));
+  }
+
+  void operator()(const std::string& x) {
+    json_writer::append_string(buf, x);
+  }
+
+  void operator()(const address& x) {
+    convert(x, scratch);
+    json_writer::append_string(buf, scratch);
+  }
+
+  void operator()(const subnet& x) {
+    convert(x, scratch);
+    json_writer::append_string(buf, scratch);
+  }
+
+  void operator()(port x) {
+    buf += '"';
+    append_integer(buf, x.number());
+    switch (x.type()) {
+      default:
+        buf += "/?\"";
+        break;
+      case port::protocol::tcp:
+        buf += "/tcp\"";
+        break;
+      case port::protocol::udp:
+        buf += "/udp\"";
+        break;
+      case port::protocol::icmp:
+        buf += "/icmp\"";
+        break;
+    }
+  }
+
+  void operator()(timestamp x) {
+    append_seconds(buf, x.time_since_epoch().count());
+  }
+
+  void operator()(timespan x) {
+    append_seconds(buf, x.count());
+  }
+
+  void operator()(const enum_value& x) {
+    json_writer::append_string(buf, x.name);
+  }
+
+  void operator()(const packed_data& x) {
+    convert(x, scratch);
+    json_writer::append_string(buf, scratch);
+  }
+
+  void operator()(const set& xs) {
+    append_array(xs);
+  }
+
+  void operator()(const table& xs) {
+    buf += '[';
+    auto first = true;
+    for (auto& [key, val] : xs) {
+      if (!first)
+        buf += ',';
+      first = false;
+      buf += '[';
+      writer.append(buf, key);
+      buf += ',';
+      writer.append(buf, val);
+      buf += ']';
+    }
+    buf += ']';
+  }
+
+  void operator()(const vector& xs) {
+    append_array(xs);
+  }
+
+  template <class Container>
+  void append_array(const Container& xs) {
+    buf += '[';
+    auto first = true;
+    for (auto& x : xs) {
+      if (!first)
+        buf += ',';
+      first = false;
+      writer.append(buf, x);
+    }
+    buf += ']';
+  }
+};
+
+} // namespace
+
+void json_writer::append(std::string& buf, const data& x) {
+  json_visitor f{*this, buf, scratch_};
+  caf::visit(f, x);
+}
+
+void json_writer::append_line(std::string& buf, const topic& t,
+                              const data& x) {
+  buf += "{\"topic\":";
+  append_string(buf, t.string());
+  buf += ",\"data\":";
+  append(buf, x);
+  buf += "}\n";
+}
+
+void json_writer::append_string(std::string& buf, const std::string& str) {
+  static constexpr char hex[] = "0123456789abcdef";
+  buf += '"';
+  // Copy runs of characters that need no escaping in one go.
+  auto first = str.data();
+  auto last = first + str.size();
+  auto run = first;
+  for (auto i = first; i != last; ++i) {
+    auto c = static_cast<unsigned char>(*i);
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+    buf.append(run, i);
+    run = i + 1;
+    switch (c) {
+      case '"':
+        buf += "\\\"";
+        break;
+      case '\\':
+        buf += "\\\\";
+        break;
+      case '\b':
+        buf += "\\b";
+        break;
+      case '\f':
+        buf += "\\f";
+        break;
+      case '\n':
+        buf += "\\n";
+        break;
+      case '\r':
+        buf += "\\r";
+        break;
+      case '\t':
+        buf += "\\t";
+        break;
+      default: {
+        char tmp[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F]};
+        buf.append(tmp, sizeof(tmp));
+      }
+    }
+  }
+  buf.append(run, last);
+  buf += '"';
+}
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,56 @@
+#include "broker/detail/key_filter.hh"
+
+#include <algorithm>
+#include <functional>
+
+namespace broker {
+namespace detail {
+
+key_filter::key_filter(size_t capacity, size_t bits_per_key)
+  : bits_per_key_(std::max(bits_per_key, size_t{1})) {
+  // The optimal number of hash functions is ln(2) * bits per key.
+  num_hashes_ = std::max(bits_per_key_ * 69 / 100, size_t{1});
+  reset(capacity);
+}
+
+namespace {
+
+// Derives all probe positions from a single hash of the key via double
+// hashing, i.e., position i is h1 + i * h2.
+template <class F>
+void probe(const data& key, size_t num_hashes, size_t num_bits, F f) {
+  uint64_t h1 = std::hash<data>{}(key);
+  uint64_t h2 = (h1 >> 33 | h1 << 31) * 0x9e3779b97f4a7c15ull | 1;
+  for (size_t i = 0; i < num_hashes; ++i) {
+    if (!f((h1 + i * h2) % num_bits))
+      return;
+  }
+}
+
+} // namespace
+
+void key_filter::add(const data& key) {
+  probe(key, num_hashes_, bits_.size() * 64, [this](uint64_t pos) {
+    bits_[pos / 64] |= uint64_t{1} << (pos % 64);
+    return true;
+  });
+  ++size_;
+}
+
+bool key_filter::may_contain(const data& key) const {
+  auto result = true;
+  probe(key, num_hashes_, bits_.size() * 64, [&](uint64_t pos) {
+    result = (bits_[pos / 64] & (uint64_t{1} << (pos % 64))) != 0;
+    return result;
+  });
+  return result;
+}
+
+void key_filter::reset(size_t capacity) {
+  capacity_ = std::max(capacity, size_t{64});
+  size_ = 0;
+  bits_.assign((capacity_ * bits_per_key_ + 63) / 64, 0);
+}
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,62 @@
+#include "broker/detail/ktls.hh"
+
+#include <openssl/bio.h>
+#include <openssl/conf.h>
+#include <openssl/opensslv.h>
+#include <openssl/ssl.h>
+
+#include "broker/config.hh"
+
+#if defined(BROKER_LINUX) && OPENSSL_VERSION_NUMBER >= 0x30000000L         \
+  && !defined(OPENSSL_NO_KTLS)
+#define BROKER_HAVE_KTLS
+#endif
+
+namespace broker {
+namespace detail {
+
+#ifdef BROKER_HAVE_KTLS
+
+namespace {
+
+// CAF creates a new SSL context for each connection without giving us access
+// to it, so we enable kTLS via the default options of all contexts instead.
+constexpr char ktls_conf[] = "openssl_conf = broker_conf\n"
+                             "[broker_conf]\n"
+                             "ssl_conf = broker_ssl\n"
+                             "[broker_ssl]\n"
+                             "system_default = broker_ssl_defaults\n"
+                             "[broker_ssl_defaults]\n"
+                             "Options = KTLS\n";
+
+bool load_ktls_conf() {
+  OPENSSL_init_ssl(OPENSSL_INIT_LOAD_CONFIG, nullptr);
+  auto conf = NCONF_new(nullptr);
+  if (conf == nullptr)
+    return false;
+  auto bio = BIO_new_mem_buf(ktls_conf, -1);
+  long line = 0;
+  auto result = bio != nullptr && NCONF_load_bio(conf, bio, &line) > 0
+                && CONF_modules_load(conf, nullptr, 0) > 0;
+  BIO_free(bio);
+  NCONF_free(conf);
+  return result;
+}
+
+} // namespace
+
+bool enable_ktls() {
+  static const bool result = load_ktls_conf();
+  return result;
+}
+
+#else // BROKER_HAVE_KTLS
+
+bool enable_ktls() {
+  return false;
+}
+
+#endif // BROKER_HAVE_KTLS
+
+} // namespace detail
+} // namespace broker
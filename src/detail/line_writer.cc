@@ -0,0 +1,41 @@
+#include "broker/logger.hh" // Must come before any CAF include.
+#include "broker/detail/line_writer.hh"
+
+#include <vector>
+
+#include <caf/stateful_actor.hpp>
+
+#include "broker/atoms.hh"
+
+namespace broker {
+namespace detail {
+
+const char* line_writer_state::name = "line_writer";
+
+caf::behavior line_writer(caf::stateful_actor<line_writer_state>* self,
+                          const std::string& file_name) {
+  auto& out = self->state.out;
+  out.open(file_name);
+  if (!out.is_open()) {
+    BROKER_WARNING("cannot open recording file" << file_name);
+    return {};
+  }
+  BROKER_DEBUG("opened file for recording:" << file_name);
+  return {
+    [=](const std::vector<std::string>& lines) {
+      auto& out = self->state.out;
+      for (auto& line : lines)
+        out << line << '\n';
+      if (!out.flush()) {
+        BROKER_WARNING("failed to write to" << file_name);
+        self->quit();
+      }
+    },
+    [=](atom::shutdown) {
+      self->quit();
+    },
+  };
+}
+
+} // namespace detail
+} // namespace broker
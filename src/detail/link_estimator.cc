@@ -0,0 +1,27 @@
+#include "broker/detail/link_estimator.hh"
+
+#include <chrono>
+
+namespace broker {
+namespace detail {
+
+void link_estimator::record(timespan rtt, uint64_t received, timestamp t) {
+  if (samples_ == 0) {
+    srtt_ = rtt;
+  } else {
+    auto delta = rtt > rtt_ ? rtt - rtt_ : rtt_ - rtt;
+    jitter_ += (delta - jitter_) / 16;
+    srtt_ += (rtt - srtt_) / 8;
+    auto secs = std::chrono::duration<double>(t - last_).count();
+    // Peers restart their count after reconnecting.
+    if (secs > 0 && received >= received_)
+      throughput_ = static_cast<double>(received - received_) / secs;
+  }
+  rtt_ = rtt;
+  received_ = received;
+  last_ = t;
+  ++samples_;
+}
+
+} // namespace detail
+} // namespace broker
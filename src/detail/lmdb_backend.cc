@@ -0,0 +1,569 @@
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <lmdb.h>
+
+#include "broker/logger.hh"
+
+#include "broker/error.hh"
+
+#include "broker/detail/appliers.hh"
+#include "broker/detail/blob.hh"
+#include "broker/detail/filesystem.hh"
+#include "broker/detail/lmdb_backend.hh"
+
+namespace broker {
+namespace detail {
+
+// The database environment contains two named databases:
+//
+//   - "data" maps serialized keys to serialized values
+//   - "expiries" maps serialized keys to serialized expiration timestamps
+//
+// Both use the same `to_blob` encoding as the other persistent backends.
+//
+namespace {
+
+using blob_type = caf::binary_serializer::container_type;
+
+MDB_val to_val(const blob_type& x) {
+  return MDB_val{x.size(), const_cast<char*>(x.data())};
+}
+
+template <class T>
+T from_val(const MDB_val& x) {
+  return from_blob<T>(x.mv_data, x.mv_size);
+}
+
+/// Aborts the transaction on destruction unless committed.
+class transaction {
+public:
+  transaction() = default;
+
+  transaction(const transaction&) = delete;
+
+  transaction& operator=(const transaction&) = delete;
+
+  ~transaction() {
+    if (hdl_ != nullptr)
+      mdb_txn_abort(hdl_);
+  }
+
+  int begin(MDB_env* env, unsigned flags) {
+    return mdb_txn_begin(env, nullptr, flags, &hdl_);
+  }
+
+  int commit() {
+    auto rc = mdb_txn_commit(hdl_);
+    hdl_ = nullptr;
+    return rc;
+  }
+
+  MDB_txn* get() const noexcept {
+    return hdl_;
+  }
+
+private:
+  MDB_txn* hdl_ = nullptr;
+};
+
+/// Closes the cursor on destruction.
+class cursor {
+public:
+  cursor() = default;
+
+  cursor(const cursor&) = delete;
+
+  cursor& operator=(const cursor&) = delete;
+
+  ~cursor() {
+    if (hdl_ != nullptr)
+      mdb_cursor_close(hdl_);
+  }
+
+  int open(MDB_txn* txn, MDB_dbi dbi) {
+    return mdb_cursor_open(txn, dbi, &hdl_);
+  }
+
+  int get(MDB_val& key, MDB_val& value, MDB_cursor_op op) {
+    return mdb_cursor_get(hdl_, &key, &value, op);
+  }
+
+private:
+  MDB_cursor* hdl_ = nullptr;
+};
+
+} // namespace <anonymous>
+
+struct lmdb_backend::impl {
+  /// Logs `rc` if it signals an error and converts it to a Broker error.
+  static expected<void> check(int rc, const char* what) {
+    if (rc == MDB_SUCCESS)
+      return {};
+    BROKER_ERROR("failed to" << what << ':' << mdb_strerror(rc));
+    return ec::backend_failure;
+  }
+
+  /// Runs `f` in a transaction and commits afterwards unless `f` fails.
+  template <class F>
+  expected<void> write(F f) {
+    if (env == nullptr)
+      return ec::backend_failure;
+    transaction txn;
+    if (auto res = check(txn.begin(env, 0), "begin transaction"); !res)
+      return res;
+    if (auto res = f(txn.get()); !res)
+      return res;
+    return check(txn.commit(), "commit transaction");
+  }
+
+  /// Runs `f` in a read-only transaction.
+  template <class F>
+  auto read(F f) const -> decltype(f(nullptr)) {
+    if (env == nullptr)
+      return ec::backend_failure;
+    transaction txn;
+    if (auto res = check(txn.begin(env, MDB_RDONLY), "begin transaction");
+        !res)
+      return res.error();
+    return f(txn.get());
+  }
+
+  /// Writes `value` and the (optional) expiry for `key`.
+  expected<void> put(MDB_txn* txn, const blob_type& key,
+                     const blob_type& value, optional<timestamp> expiry) {
+    auto k = to_val(key);
+    auto v = to_val(value);
+    if (auto res = check(mdb_put(txn, data_dbi, &k, &v, 0), "put value");
+        !res)
+      return res;
+    if (expiry) {
+      auto blob = to_blob(*expiry);
+      auto e = to_val(blob);
+      return check(mdb_put(txn, expiries_dbi, &k, &e, 0), "put expiry");
+    }
+    return erase(txn, expiries_dbi, key);
+  }
+
+  /// Removes `key` from `dbi`, ignoring keys that do not exist.
+  expected<void> erase(MDB_txn* txn, MDB_dbi dbi, const blob_type& key) {
+    auto k = to_val(key);
+    auto rc = mdb_del(txn, dbi, &k, nullptr);
+    if (rc == MDB_NOTFOUND)
+      return {};
+    return check(rc, "delete key");
+  }
+
+  /// Reads the value for `key` from `dbi` without copying it.
+  expected<MDB_val> get(MDB_txn* txn, MDB_dbi dbi, const blob_type& key) const {
+    auto k = to_val(key);
+    MDB_val v;
+    auto rc = mdb_get(txn, dbi, &k, &v);
+    if (rc == MDB_NOTFOUND)
+      return ec::no_such_key;
+    if (auto res = check(rc, "lookup value"); !res)
+      return res.error();
+    return v;
+  }
+
+  /// Removes `key` from both databases if its expiry lies before `ts`.
+  expected<bool> expire(MDB_txn* txn, const data& key, timestamp ts) {
+    auto key_blob = to_blob(key);
+    auto e = get(txn, expiries_dbi, key_blob);
+    if (!e) {
+      if (e.error() == ec::no_such_key)
+        return false;
+      return e.error();
+    }
+    if (ts < from_val<timestamp>(*e))
+      return false;
+    if (auto res = erase(txn, expiries_dbi, key_blob); !res)
+      return res.error();
+    if (auto res = erase(txn, data_dbi, key_blob); !res)
+      return res.error();
+    return true;
+  }
+
+  /// Calls `f` for each entry in `dbi` until `f` returns `false`.
+  template <class F>
+  expected<void> for_each(MDB_txn* txn, MDB_dbi dbi, F f) const {
+    cursor c;
+    if (auto res = check(c.open(txn, dbi), "open cursor"); !res)
+      return res;
+    MDB_val k;
+    MDB_val v;
+    auto rc = c.get(k, v, MDB_FIRST);
+    while (rc == MDB_SUCCESS && f(k, v))
+      rc = c.get(k, v, MDB_NEXT);
+    if (rc == MDB_NOTFOUND)
+      return {};
+    return check(rc, "iterate database");
+  }
+
+  void close() {
+    if (env == nullptr)
+      return;
+    mdb_env_close(env);
+    env = nullptr;
+  }
+
+  MDB_env* env = nullptr;
+  MDB_dbi data_dbi = 0;
+  MDB_dbi expiries_dbi = 0;
+  std::string path;
+  count map_size = count{1} << 30;
+  bool no_sync = false;
+};
+
+lmdb_backend::lmdb_backend(backend_options opts)
+  : impl_{std::make_unique<impl>()} {
+  // Parse required options.
+  auto i = opts.find("path");
+  if (i == opts.end())
+    return;
+  auto path = caf::get_if<std::string>(&i->second);
+  if (!path)
+    return;
+  impl_->path = *path;
+  // Parse optional options.
+  i = opts.find("map-size");
+  if (i != opts.end()) {
+    if (auto map_size = caf::get_if<count>(&i->second))
+      impl_->map_size = *map_size;
+    else
+      BROKER_ERROR("map-size must be of type count");
+  }
+  i = opts.find("no-sync");
+  if (i != opts.end()) {
+    if (auto no_sync = caf::get_if<boolean>(&i->second))
+      impl_->no_sync = *no_sync;
+    else
+      BROKER_ERROR("no-sync must be of type boolean");
+  }
+  open_db();
+}
+
+bool lmdb_backend::open_db() {
+  if (!detail::mkdirs(impl_->path)) {
+    BROKER_ERROR("failed to create database dir:" << impl_->path);
+    return false;
+  }
+  auto fail = [&](int rc, const char* what) {
+    BROKER_ERROR("failed to" << what << ':' << mdb_strerror(rc));
+    impl_->close();
+    return false;
+  };
+  if (auto rc = mdb_env_create(&impl_->env); rc != MDB_SUCCESS) {
+    impl_->env = nullptr;
+    return fail(rc, "create environment");
+  }
+  if (auto rc = mdb_env_set_maxdbs(impl_->env, 2); rc != MDB_SUCCESS)
+    return fail(rc, "set number of databases");
+  if (auto rc = mdb_env_set_mapsize(impl_->env, impl_->map_size);
+      rc != MDB_SUCCESS)
+    return fail(rc, "set map size");
+  // Actors may run on any thread of the scheduler, i.e., read transactions
+  // must not depend on thread-local storage.
+  unsigned flags = MDB_NOTLS;
+  if (impl_->no_sync)
+    flags |= MDB_NOSYNC;
+  if (auto rc = mdb_env_open(impl_->env, impl_->path.c_str(), flags, 0644);
+      rc != MDB_SUCCESS)
+    return fail(rc, "open environment");
+  transaction txn;
+  if (auto rc = txn.begin(impl_->env, 0); rc != MDB_SUCCESS)
+    return fail(rc, "begin transaction");
+  if (auto rc = mdb_dbi_open(txn.get(), "data", MDB_CREATE, &impl_->data_dbi);
+      rc != MDB_SUCCESS)
+    return fail(rc, "open data database");
+  if (auto rc = mdb_dbi_open(txn.get(), "expiries", MDB_CREATE,
+                             &impl_->expiries_dbi);
+      rc != MDB_SUCCESS)
+    return fail(rc, "open expiries database");
+  if (auto rc = txn.commit(); rc != MDB_SUCCESS)
+    return fail(rc, "commit transaction");
+  return true;
+}
+
+lmdb_backend::~lmdb_backend() {
+  impl_->close();
+}
+
+expected<void> lmdb_backend::put(const data& key, data value,
+                                 optional<timestamp> expiry) {
+  return impl_->write([&](MDB_txn* txn) {
+    return impl_->put(txn, to_blob(key), to_blob(value), expiry);
+  });
+}
+
+expected<void>
+lmdb_backend::put_many(const std::unordered_map<data, data>& entries,
+                       optional<timestamp> expiry) {
+  return impl_->write([&](MDB_txn* txn) -> expected<void> {
+    for (auto& kvp : entries)
+      if (auto res = impl_->put(txn, to_blob(kvp.first), to_blob(kvp.second),
+                                expiry);
+          !res)
+        return res;
+    return {};
+  });
+}
+
+expected<void> lmdb_backend::add(const data& key, const data& value,
+                                 data::type init_type,
+                                 optional<timestamp> expiry) {
+  return impl_->write([&](MDB_txn* txn) -> expected<void> {
+    auto key_blob = to_blob(key);
+    broker::data v;
+    if (auto x = impl_->get(txn, impl_->data_dbi, key_blob))
+      v = from_val<data>(*x);
+    else if (x.error() == ec::no_such_key)
+      v = data::from_type(init_type);
+    else
+      return x.error();
+    if (auto res = caf::visit(adder{value}, v); !res)
+      return res;
+    return impl_->put(txn, key_blob, to_blob(v), expiry);
+  });
+}
+
+expected<void> lmdb_backend::subtract(const data& key, const data& value,
+                                      optional<timestamp> expiry) {
+  return impl_->write([&](MDB_txn* txn) -> expected<void> {
+    auto key_blob = to_blob(key);
+    auto x = impl_->get(txn, impl_->data_dbi, key_blob);
+    if (!x)
+      return x.error();
+    auto v = from_val<data>(*x);
+    if (auto res = caf::visit(remover{value}, v); !res)
+      return res;
+    return impl_->put(txn, key_blob, to_blob(v), expiry);
+  });
+}
+
+expected<void> lmdb_backend::erase(const data& key) {
+  return impl_->write([&](MDB_txn* txn) -> expected<void> {
+    auto key_blob = to_blob(key);
+    if (auto res = impl_->erase(txn, impl_->expiries_dbi, key_blob); !res)
+      return res;
+    return impl_->erase(txn, impl_->data_dbi, key_blob);
+  });
+}
+
+expected<void> lmdb_backend::erase_many(const std::vector<data>& keys) {
+  return impl_->write([&](MDB_txn* txn) -> expected<void> {
+    for (auto& key : keys) {
+      auto key_blob = to_blob(key);
+      if (auto res = impl_->erase(txn, impl_->expiries_dbi, key_blob); !res)
+        return res;
+      if (auto res = impl_->erase(txn, impl_->data_dbi, key_blob); !res)
+        return res;
+    }
+    return {};
+  });
+}
+
+expected<void> lmdb_backend::clear() {
+  return impl_->write([&](MDB_txn* txn) -> expected<void> {
+    if (auto res = impl::check(mdb_drop(txn, impl_->expiries_dbi, 0),
+                               "clear expiries");
+        !res)
+      return res;
+    return impl::check(mdb_drop(txn, impl_->data_dbi, 0), "clear data");
+  });
+}
+
+expected<bool> lmdb_backend::expire(const data& key, timestamp ts) {
+  bool result = false;
+  auto res = impl_->write([&](MDB_txn* txn) -> expected<void> {
+    auto x = impl_->expire(txn, key, ts);
+    if (!x)
+      return x.error();
+    result = *x;
+    return {};
+  });
+  if (!res)
+    return res.error();
+  return result;
+}
+
+expected<std::vector<data>>
+lmdb_backend::expire_many(const std::vector<data>& keys, timestamp ts) {
+  std::vector<data> result;
+  auto res = impl_->write([&](MDB_txn* txn) -> expected<void> {
+    for (auto& key : keys) {
+      auto x = impl_->expire(txn, key, ts);
+      if (!x)
+        return x.error();
+      if (*x)
+        result.emplace_back(key);
+    }
+    return {};
+  });
+  if (!res)
+    return res.error();
+  return result;
+}
+
+expected<data> lmdb_backend::get(const data& key) const {
+  return impl_->read([&](MDB_txn* txn) -> expected<data> {
+    auto x = impl_->get(txn, impl_->data_dbi, to_blob(key));
+    if (!x)
+      return x.error();
+    return from_val<data>(*x);
+  });
+}
+
+expected<data>
+lmdb_backend::get_many(const std::vector<data>& keys) const {
+  return impl_->read([&](MDB_txn* txn) -> expected<data> {
+    table result;
+    for (auto& key : keys) {
+      auto x = impl_->get(txn, impl_->data_dbi, to_blob(key));
+      if (x)
+        result.emplace(key, from_val<data>(*x));
+      else if (x.error() != ec::no_such_key)
+        return x.error();
+    }
+    return {std::move(result)};
+  });
+}
+
+expected<data> lmdb_backend::scan(const std::string& prefix,
+                                  size_t limit) const {
+  return impl_->read([&](MDB_txn* txn) -> expected<data> {
+    cursor c;
+    if (auto res = impl::check(c.open(txn, impl_->data_dbi), "open cursor");
+        !res)
+      return res.error();
+    // Serialized keys start with their type tag, i.e., all string keys are
+    // adjacent and start at the serialized empty string. The serialization
+    // format encodes the length of a string before its characters, so we
+    // still need to check the prefix after decoding.
+    auto first = to_blob(data{std::string{}});
+    auto tag = first[0];
+    auto k = to_val(first);
+    MDB_val v;
+    table result;
+    auto rc = c.get(k, v, MDB_SET_RANGE);
+    while (rc == MDB_SUCCESS && k.mv_size > 0
+           && static_cast<const char*>(k.mv_data)[0] == tag) {
+      auto key = from_val<data>(k);
+      if (has_prefix(key, prefix)) {
+        result.emplace_hint(result.end(), std::move(key), from_val<data>(v));
+        if (result.size() == limit)
+          break;
+      }
+      rc = c.get(k, v, MDB_NEXT);
+    }
+    if (rc != MDB_SUCCESS && rc != MDB_NOTFOUND)
+      if (auto res = impl::check(rc, "scan keys"); !res)
+        return res.error();
+    return {std::move(result)};
+  });
+}
+
+expected<optional<data>>
+lmdb_backend::scan(const optional<data>& start, size_t batch_size,
+                   const scan_callback& f) const {
+  return impl_->read([&](MDB_txn* txn) -> expected<optional<data>> {
+    cursor c;
+    if (auto res = impl::check(c.open(txn, impl_->data_dbi), "open cursor");
+        !res)
+      return res.error();
+    MDB_val k;
+    MDB_val v;
+    int rc;
+    if (start) {
+      auto first = to_blob(*start);
+      k = to_val(first);
+      rc = c.get(k, v, MDB_SET_RANGE);
+    } else {
+      rc = c.get(k, v, MDB_FIRST);
+    }
+    scan_batcher batcher{batch_size, f};
+    while (rc == MDB_SUCCESS) {
+      auto key = from_val<data>(k);
+      if (!batcher.flush_if_full())
+        return optional<data>{std::move(key)};
+      batcher.push(std::move(key), from_val<data>(v));
+      rc = c.get(k, v, MDB_NEXT);
+    }
+    if (rc != MDB_NOTFOUND)
+      if (auto res = impl::check(rc, "scan entries"); !res)
+        return res.error();
+    batcher.finish();
+    return optional<data>{};
+  });
+}
+
+expected<bool> lmdb_backend::exists(const data& key) const {
+  return impl_->read([&](MDB_txn* txn) -> expected<bool> {
+    auto x = impl_->get(txn, impl_->data_dbi, to_blob(key));
+    if (x)
+      return true;
+    if (x.error() == ec::no_such_key)
+      return false;
+    return x.error();
+  });
+}
+
+expected<uint64_t> lmdb_backend::size() const {
+  return impl_->read([&](MDB_txn* txn) -> expected<uint64_t> {
+    MDB_stat stat;
+    if (auto res = impl::check(mdb_stat(txn, impl_->data_dbi, &stat),
+                               "compute size");
+        !res)
+      return res.error();
+    return static_cast<uint64_t>(stat.ms_entries);
+  });
+}
+
+expected<data> lmdb_backend::keys() const {
+  return impl_->read([&](MDB_txn* txn) -> expected<data> {
+    set result;
+    auto res = impl_->for_each(txn, impl_->data_dbi,
+                               [&](const MDB_val& k, const MDB_val&) {
+                                 result.emplace_hint(result.end(),
+                                                     from_val<data>(k));
+                                 return true;
+                               });
+    if (!res)
+      return res.error();
+    return {std::move(result)};
+  });
+}
+
+expected<snapshot> lmdb_backend::snapshot() const {
+  return impl_->read([&](MDB_txn* txn) -> expected<broker::snapshot> {
+    broker::snapshot result;
+    auto res = impl_->for_each(txn, impl_->data_dbi,
+                               [&](const MDB_val& k, const MDB_val& v) {
+                                 result.emplace(from_val<data>(k),
+                                                from_val<data>(v));
+                                 return true;
+                               });
+    if (!res)
+      return res.error();
+    return {std::move(result)};
+  });
+}
+
+expected<expirables> lmdb_backend::expiries() const {
+  return impl_->read([&](MDB_txn* txn) -> expected<expirables> {
+    expirables result;
+    auto res = impl_->for_each(txn, impl_->expiries_dbi,
+                               [&](const MDB_val& k, const MDB_val& v) {
+                                 result.emplace_back(from_val<data>(k),
+                                                     from_val<timestamp>(v));
+                                 return true;
+                               });
+    if (!res)
+      return res.error();
+    return {std::move(result)};
+  });
+}
+
+} // namespace detail
+} // namespace broker
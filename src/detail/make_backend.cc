@@ -1,26 +1,71 @@
 #include "broker/config.hh"
 
+#include <string>
+#include <vector>
+
 #include "broker/detail/die.hh"
+#include "broker/detail/lmdb_backend.hh"
 #include "broker/detail/make_backend.hh"
 #include "broker/detail/memory_backend.hh"
+#include "broker/detail/partitioned_backend.hh"
 #include "broker/detail/rocksdb_backend.hh"
 #include "broker/detail/sqlite_backend.hh"
 
 namespace broker {
 namespace detail {
 
+namespace {
+
+// Returns the number of files for a SQLite store or 0 for a single file.
+size_t sqlite_partitions(const backend_options& opts) {
+  auto i = opts.find("partitions");
+  if (i == opts.end())
+    return 0;
+  if (auto n = caf::get_if<count>(&i->second); n && *n > 1)
+    return static_cast<size_t>(*n);
+  return 0;
+}
+
+// Opens one SQLite database per partition at `<path>.<k>`.
+std::unique_ptr<detail::abstract_backend>
+make_partitioned_sqlite(backend_options opts, size_t n) {
+  opts.erase("partitions");
+  std::string path;
+  if (auto i = opts.find("path"); i != opts.end())
+    if (auto str = caf::get_if<std::string>(&i->second))
+      path = *str;
+  std::vector<partitioned_backend::backend_pointer> partitions;
+  for (size_t k = 0; k < n; ++k) {
+    auto part_opts = opts;
+    part_opts["path"] = path + '.' + std::to_string(k);
+    partitions.emplace_back(
+      std::make_unique<sqlite_backend>(std::move(part_opts)));
+  }
+  return std::make_unique<partitioned_backend>(std::move(partitions));
+}
+
+} // namespace
+
 std::unique_ptr<detail::abstract_backend> make_backend(backend type,
                                                        backend_options opts) {
   switch (type) {
     case memory:
       return std::make_unique<memory_backend>(std::move(opts));
     case sqlite:
+      if (auto n = sqlite_partitions(opts); n > 0)
+        return make_partitioned_sqlite(std::move(opts), n);
       return std::make_unique<sqlite_backend>(std::move(opts));
     case rocksdb:
 #ifdef BROKER_HAVE_ROCKSDB
       return std::make_unique<rocksdb_backend>(std::move(opts));
 #else
       die("not compiled with RocksDB support");
+#endif
+    case lmdb:
+#ifdef BROKER_HAVE_LMDB
+      return std::make_unique<lmdb_backend>(std::move(opts));
+#else
+      die("not compiled with LMDB support");
 #endif
   }
 
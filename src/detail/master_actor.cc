@@ -3,6 +3,7 @@
 #include <caf/event_based_actor.hpp>
 #include <caf/actor.hpp>
 #include <caf/make_message.hpp>
+#include <caf/message_handler.hpp>
 #include <caf/sum_type.hpp>
 #include <caf/behavior.hpp>
 #include <caf/stateful_actor.hpp>
@@ -10,16 +11,30 @@
 #include <caf/unit.hpp>
 #include <caf/error.hpp>
 
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <vector>
+
 #include "broker/atoms.hh"
 #include "broker/convert.hh"
 #include "broker/data.hh"
+#include "broker/defaults.hh"
+#include "broker/error.hh"
 #include "broker/store.hh"
 #include "broker/time.hh"
 #include "broker/topic.hh"
 
 #include "broker/detail/abstract_backend.hh"
+#include "broker/detail/clone_cache.hh"
 #include "broker/detail/die.hh"
+#include "broker/detail/filesystem.hh"
+#include "broker/detail/make_backend.hh"
 #include "broker/detail/master_actor.hh"
+#include "broker/detail/tracepoint.hh"
 
 namespace broker {
 namespace detail {
@@ -29,33 +44,135 @@ static inline optional<timestamp> to_opt_timestamp(timestamp ts,
   return span ? ts + *span : optional<timestamp>();
 }
 
+/// Adds `delta` to `x` if both have the same numeric type.
+static bool add_delta(data& x, const data& delta) {
+  if (x.get_type() != delta.get_type())
+    return false;
+  if (auto i = caf::get_if<count>(&x)) {
+    *i += caf::get<count>(delta);
+    return true;
+  }
+  if (auto i = caf::get_if<integer>(&x)) {
+    *i += caf::get<integer>(delta);
+    return true;
+  }
+  if (auto i = caf::get_if<real>(&x)) {
+    *i += caf::get<real>(delta);
+    return true;
+  }
+  return false;
+}
+
 const char* master_state::name = "master_actor";
 
 master_state::master_state() : self(nullptr), clock(nullptr) {
   // nop
 }
 
+master_state::~master_state() {
+  for (auto& kvp : checkpoint_transfers)
+    remove_all(kvp.second.dir);
+}
+
 void master_state::init(caf::event_based_actor* ptr, std::string&& nm,
                         backend_pointer&& bp, caf::actor&& parent,
-                        endpoint::clock* ep_clock) {
+                        endpoint::clock* ep_clock, memory_accounting_ptr mem) {
   BROKER_ASSERT(ep_clock != nullptr);
   self = ptr;
   id = std::move(nm);
   clones_topic = id / topics::clone_suffix;
   backend = std::move(bp);
+  memory.attach(std::move(mem), memory_accounting::master_stores);
+  update_memory_usage();
   core = std::move(parent);
   clock = ep_clock;
-  auto es = backend->expiries();
+  // Sequence numbers of different masters for the same store never overlap
+  // in practice. Hence, clones may ask any master for the commands after
+  // their last sequence number, e.g., after restoring from their cache.
+  std::random_device rd;
+  seq = static_cast<uint64_t>(rd() & 0x7FFFFFFFu) << 32;
+  coalesce_window = caf::get_or(self->config(), "broker.store.coalesce-window",
+                                defaults::store::coalesce_window);
+  expiry_window = caf::get_or(self->config(), "broker.store.expiry-window",
+                              defaults::store::expiry_window);
+  auto str = caf::get_or(self->config(), "broker.store.snapshot-compression",
+                         defaults::store::snapshot_compression);
+  if (!convert(str, snapshot_compression))
+    BROKER_WARNING("ignored invalid snapshot-compression:" << str);
+  else if (snapshot_compression != compression::none
+           && !supported(snapshot_compression))
+    BROKER_WARNING("ignored unsupported snapshot-compression:" << str);
+  if (!supported(snapshot_compression))
+    snapshot_compression = compression::none;
+  auto bits_per_key = caf::get_or(self->config(),
+                                  "broker.store.key-filter-bits-per-key",
+                                  defaults::store::key_filter_bits_per_key);
+  if (bits_per_key > 0) {
+    known_keys = std::make_unique<key_filter>(0, bits_per_key);
+    rebuild_key_filter();
+  }
+  clone_local_expiry = caf::get_or(self->config(),
+                                   "broker.store.clone-local-expiry",
+                                   defaults::store::clone_local_expiry);
+  open_workload_recording();
+  // A standby leaves expirations to the primary until taking over.
+  if (standby)
+    return;
+  if (caf::get_or(self->config(), "broker.store.deferred-expiries",
+                  defaults::store::deferred_expiries)) {
+    // Handle all messages that arrived during startup before reading the
+    // expiration times. Getting expired keys in the meantime is acceptable.
+    self->send(self, atom::expire::value, atom::init::value);
+    return;
+  }
+  load_expiries(false);
+}
+
+void master_state::load_expiries(bool deferred) {
+  auto es = read_expiries();
   if (!es)
     die("failed to get master expiries while initializing");
-  for (auto& e : *es) {
-    auto& key = e.first;
-    auto& expire_time = e.second;
-    auto n = clock->now();
-    auto dur = expire_time - n;
-    auto msg = caf::make_message(atom::expire::value, std::move(key));
-    clock->send_later(self, dur, std::move(msg));
+  if (deferred) {
+    BROKER_INFO("loading" << es->size() << "expiries in the background");
+    pending_expiries = std::move(*es);
+    load_pending_expiries();
+    return;
+  }
+  for (auto& e : *es)
+    remind(e.second, std::move(e.first));
+}
+
+expected<expirables> master_state::read_expiries() {
+  if (expiry_window.count() <= 0)
+    return backend->expiries();
+  auto from = expiries_loaded_until;
+  expiries_loaded_until = clock->now() + expiry_window;
+  clock->send_later(self, expiry_window / 2,
+                    caf::make_message(atom::expire::value, atom::scan::value));
+  return backend->expiries_between(from, expiries_loaded_until);
+}
+
+void master_state::load_expiry_window() {
+  auto es = read_expiries();
+  if (!es) {
+    BROKER_ERROR("failed to read expiries:" << to_string(es.error()));
+    return;
   }
+  BROKER_DEBUG("loaded" << es->size() << "upcoming expiries");
+  for (auto& e : *es)
+    remind(e.second, std::move(e.first));
+}
+
+void master_state::load_pending_expiries() {
+  auto n = std::min(pending_expiries.size(),
+                    defaults::store::expiry_load_chunk_size);
+  for (size_t i = 0; i < n; ++i) {
+    auto& e = pending_expiries.front();
+    remind(e.second, std::move(e.first));
+    pending_expiries.pop_front();
+  }
+  if (!pending_expiries.empty())
+    self->send(self, atom::expire::value, atom::resume::value);
 }
 
 void master_state::broadcast(internal_command&& x) {
@@ -63,29 +180,651 @@ void master_state::broadcast(internal_command&& x) {
              make_command_message(clones_topic, std::move(x)));
 }
 
+void master_state::sequence(internal_command&& x) {
+  x.seq = ++seq;
+  if (defaults::store::replay_log_size == 0) {
+    if (!clones.empty())
+      broadcast(std::move(x));
+    return;
+  }
+  if (replay_log.size() == defaults::store::replay_log_size)
+    replay_log.pop_front();
+  if (clones.empty()) {
+    replay_log.emplace_back(std::move(x));
+  } else {
+    replay_log.emplace_back(x);
+    broadcast(std::move(x));
+  }
+}
+
+void master_state::broadcast_cmd_to_clones(put_command cmd) {
+  // A standby must assign the sequence number of the primary right away.
+  if (standby || coalesce_window.count() <= 0) {
+    sequence(internal_command{std::move(cmd)});
+    return;
+  }
+  // Clones count their unconfirmed writes per key and expect one broadcast
+  // for each of them.
+  if (from_clone) {
+    flush_coalesced();
+    sequence(internal_command{std::move(cmd)});
+    return;
+  }
+  auto i = coalesced_index.find(cmd.key);
+  if (i != coalesced_index.end()) {
+    // The put overrides the effect of any previous command on the key.
+    coalesced[i->second].content = std::move(cmd);
+    return;
+  }
+  if (coalesced.empty())
+    clock->send_later(self, coalesce_window,
+                      caf::make_message(atom::flush::value,
+                                        atom::clone::value));
+  coalesced_index.emplace(cmd.key, coalesced.size());
+  coalesced.emplace_back(std::move(cmd));
+}
+
+void master_state::broadcast_cmd_to_clones(add_command cmd) {
+  if (standby || coalesce_window.count() <= 0) {
+    sequence(internal_command{std::move(cmd)});
+    return;
+  }
+  auto i = coalesced_index.find(cmd.key);
+  if (i != coalesced_index.end()) {
+    // Merge numeric deltas without expiry, since the expiry of an add takes
+    // effect relative to the time the clone receives it.
+    auto& prev = coalesced[i->second];
+    if (!cmd.expiry) {
+      if (auto x = caf::get_if<add_command>(&prev.content);
+          x && !x->expiry && x->init_type == cmd.init_type
+          && add_delta(x->value, cmd.value))
+        return;
+      if (auto x = caf::get_if<put_command>(&prev.content);
+          x && !x->expiry && add_delta(x->value, cmd.value))
+        return;
+    }
+    // Send the previous command to keep the order of updates for this key.
+    sequence(std::move(prev));
+    prev = internal_command{std::move(cmd)};
+    return;
+  }
+  if (coalesced.empty())
+    clock->send_later(self, coalesce_window,
+                      caf::make_message(atom::flush::value,
+                                        atom::clone::value));
+  coalesced_index.emplace(cmd.key, coalesced.size());
+  coalesced.emplace_back(std::move(cmd));
+}
+
+void master_state::flush_coalesced() {
+  if (coalesced.empty())
+    return;
+  BROKER_DEBUG("send" << coalesced.size() << "coalesced commands to clones");
+  for (auto& x : coalesced)
+    sequence(std::move(x));
+  coalesced.clear();
+  coalesced_index.clear();
+}
+
+void master_state::resync(const caf::actor& clone, uint64_t last_seq) {
+  BROKER_INFO("RESYNC" << clone << "from sequence number" << last_seq);
+  auto first = replay_log.empty() ? seq + 1 : replay_log.front().seq;
+  if (last_seq > seq || last_seq + 1 < first) {
+    BROKER_DEBUG("clone fell out of the replay log window");
+    start_snapshot(clone, clone);
+    return;
+  }
+  self->monitor(clone);
+  clones.emplace(clone->address(), clone);
+  std::vector<internal_command> deltas;
+  deltas.reserve(seq - last_seq);
+  for (auto i = replay_log.begin() + (last_seq + 1 - first);
+       i != replay_log.end(); ++i)
+    deltas.emplace_back(*i);
+  self->send(clone, atom::snapshot::value, std::move(deltas));
+}
+
 void master_state::remind(timespan expiry, const data& key) {
-  auto msg = caf::make_message(atom::expire::value, key);
-  clock->send_later(self, expiry, std::move(msg));
+  remind(clock->now() + expiry, key);
 }
 
-void master_state::expire(data& key) {
-  BROKER_INFO("EXPIRE" << key);
-  auto result = backend->expire(key, clock->now());
-  if (!result)
-    BROKER_ERROR("failed to expire key:" << to_string(result.error()));
-  else if (!*result)
-    BROKER_WARNING("ignoring stale expiration reminder");
-  else {
-    broadcast_cmd_to_clones(erase_command{std::move(key)});
+void master_state::remind(timestamp expiry, data key) {
+  // The primary (or its clones with local expiry) takes care of expired
+  // keys. The standby reads all expiries from its backend when taking over.
+  if (standby)
+    return;
+  // Round up to the next multiple of the resolution to never expire early.
+  auto res = defaults::store::expiry_resolution.count();
+  auto ticks = expiry.time_since_epoch().count();
+  if (res > 0)
+    ticks = (ticks / res + (ticks % res > 0 ? 1 : 0)) * res;
+  auto deadline = timestamp{timespan{ticks}};
+  auto i = expiry_buckets.find(deadline);
+  if (i == expiry_buckets.end()) {
+    i = expiry_buckets.emplace(deadline, std::vector<data>{}).first;
+    clock->send_later(self, deadline - clock->now(),
+                      caf::make_message(atom::expire::value, deadline));
   }
+  i->second.emplace_back(std::move(key));
+}
+
+void master_state::expire(timestamp deadline) {
+  auto now = clock->now();
+  if (now < deadline) {
+    // The real-time clock may fire slightly ahead of the system clock.
+    if (clock->real_time() && expiry_buckets.count(deadline) > 0)
+      clock->send_later(self, deadline - now,
+                        caf::make_message(atom::expire::value, deadline));
+    return;
+  }
+  std::vector<data> keys;
+  auto i = expiry_buckets.begin();
+  for (; i != expiry_buckets.end() && i->first <= now; ++i) {
+    if (keys.empty())
+      keys.swap(i->second);
+    else
+      keys.insert(keys.end(), std::make_move_iterator(i->second.begin()),
+                  std::make_move_iterator(i->second.end()));
+  }
+  expiry_buckets.erase(expiry_buckets.begin(), i);
+  if (keys.empty())
+    return;
+  BROKER_INFO("EXPIRE" << keys.size() << "keys");
+  auto result = backend->expire_many(keys, now);
+  if (!result) {
+    BROKER_ERROR("failed to expire keys:" << to_string(result.error()));
+    return;
+  }
+  if (result->size() < keys.size())
+    BROKER_DEBUG("ignored" << (keys.size() - result->size())
+                           << "stale expiration reminders");
+  if (result->empty())
+    return;
+  update_memory_usage();
+  cached_snapshot.reset();
+  schedule_publish();
+  notify_all(store_change::kind::expire, *result);
+  // Clones with local expiry drop the same keys on their own.
+  if (clone_local_expiry) {
+    schedule_flush();
+    return;
+  }
+  // Send all keys that expired in this sweep as a single command to avoid
+  // flooding clones with one message per key.
+  if (result->size() == 1)
+    broadcast_cmd_to_clones(erase_command{std::move(result->front())});
+  else
+    broadcast_cmd_to_clones(erase_many_command{std::move(*result)});
+  schedule_flush();
+}
+
+void master_state::send_expiries(const caf::actor& clone) {
+  // Standby masters request snapshots just like clones and need the
+  // expiration times regardless of clone_local_expiry, so we send them to
+  // every target. Clones without local expiry simply ignore them.
+  auto es = backend->expiries();
+  if (!es) {
+    BROKER_ERROR("failed to read expiries:" << to_string(es.error()));
+    return;
+  }
+  table xs;
+  for (auto& e : *es)
+    xs.emplace(std::move(e.first), e.second);
+  self->send(clone, atom::snapshot::value, atom::expire::value, std::move(xs));
+}
+
+std::shared_ptr<const snapshot> master_state::make_snapshot() {
+  if (cached_snapshot) {
+    BROKER_DEBUG("re-use cached snapshot");
+    return cached_snapshot;
+  }
+  auto ss = backend->snapshot();
+  if (!ss)
+    die("failed to snapshot master");
+  cached_snapshot = std::make_shared<const snapshot>(std::move(*ss));
+  cached_snapshot_seq = seq;
+  clock->send_later(self, defaults::store::snapshot_cache_window,
+                    caf::make_message(atom::snapshot::value,
+                                      atom::clear::value));
+  return cached_snapshot;
+}
+
+void master_state::schedule_publish() {
+  if (read_snapshot == nullptr || publish_scheduled)
+    return;
+  // Going through our mailbox collects all modifications from messages that
+  // are already waiting into a single snapshot.
+  publish_scheduled = true;
+  self->send(self, atom::snapshot::value, atom::publish::value);
+}
+
+void master_state::publish() {
+  publish_scheduled = false;
+  if (read_snapshot != nullptr)
+    read_snapshot->store(make_snapshot());
+}
+
+void master_state::send_snapshot_chunk(const caf::actor& clone) {
+  auto i = snapshot_transfers.find(clone);
+  if (i == snapshot_transfers.end())
+    return;
+  auto& transfer = i->second;
+  auto end = transfer.content->end();
+  snapshot chunk;
+  while (transfer.position != end
+         && chunk.size() < defaults::store::snapshot_chunk_size) {
+    chunk.emplace(*transfer.position);
+    ++transfer.position;
+  }
+  auto last = transfer.position == end;
+  auto seq = transfer.seq;
+  compressed_batch batch;
+  if (transfer.algorithm != compression::none) {
+    if (auto err = compress(self->system(), transfer.algorithm, chunk, batch)) {
+      BROKER_WARNING("failed to compress snapshot chunk:" << err);
+      transfer.algorithm = compression::none;
+    }
+  }
+  auto compressed = transfer.algorithm != compression::none;
+  if (last)
+    snapshot_transfers.erase(i);
+  if (compressed)
+    self->send(clone, atom::snapshot::value, std::move(batch), seq, last);
+  else
+    self->send(clone, atom::snapshot::value, std::move(chunk), seq, last);
+}
+
+void master_state::negotiate_compression(const caf::actor& clone,
+                                         const std::vector<std::string>& offer) {
+  auto i = snapshot_transfers.find(clone);
+  if (i == snapshot_transfers.end()
+      || snapshot_compression == compression::none
+      || i->second.algorithm != compression::none)
+    return;
+  if (std::find(offer.begin(), offer.end(), to_string(snapshot_compression))
+      != offer.end()) {
+    BROKER_DEBUG("compress snapshot chunks to" << clone << "with"
+                 << to_string(snapshot_compression));
+    i->second.algorithm = snapshot_compression;
+  }
+}
+
+void master_state::send_checkpoint_chunk(const caf::actor& clone) {
+  auto i = checkpoint_transfers.find(clone);
+  if (i == checkpoint_transfers.end())
+    return;
+  auto& transfer = i->second;
+  auto& file = transfer.files[transfer.file_index];
+  std::ifstream in{file, std::ios::binary};
+  if (!in) {
+    // The clone discards the partial checkpoint once the snapshot arrives.
+    BROKER_ERROR("unable to read checkpoint file" << file);
+    remove_all(transfer.dir);
+    checkpoint_transfers.erase(i);
+    start_snapshot(clone, clone);
+    return;
+  }
+  std::string chunk;
+  chunk.resize(defaults::store::checkpoint_chunk_size);
+  in.seekg(static_cast<std::streamoff>(transfer.offset));
+  in.read(&chunk[0], static_cast<std::streamsize>(chunk.size()));
+  chunk.resize(static_cast<size_t>(in.gcount()));
+  transfer.offset += chunk.size();
+  auto name = file == transfer.root ? std::string{}
+                                    : file.substr(transfer.root.size() + 1);
+  if (chunk.size() < defaults::store::checkpoint_chunk_size) {
+    ++transfer.file_index;
+    transfer.offset = 0;
+  }
+  auto last = transfer.file_index == transfer.files.size();
+  auto seq = transfer.seq;
+  if (last) {
+    remove_all(transfer.dir);
+    checkpoint_transfers.erase(i);
+  }
+  self->send(clone, atom::snapshot::value, atom::write::value, std::move(name),
+             std::move(chunk), seq, last);
+}
+
+void master_state::schedule_flush() {
+  if (flush_scheduled)
+    return;
+  auto interval = backend->flush_interval();
+  if (interval.count() <= 0)
+    return;
+  flush_scheduled = true;
+  clock->send_later(self, interval, caf::make_message(atom::flush::value));
+}
+
+void master_state::flush() {
+  flush_scheduled = false;
+  auto result = backend->flush();
+  if (!result)
+    BROKER_ERROR("failed to flush backend:" << to_string(result.error()));
 }
 
 void master_state::command(internal_command& cmd) {
   command(cmd.content);
 }
 
+void master_state::resolve_primary() {
+  if (!standby || primary)
+    return;
+  BROKER_INFO("standby" << id << "requests the primary master");
+  self->send(core, atom::store::value, atom::master::value,
+             atom::resolve::value, id, caf::actor_cast<caf::actor>(self));
+  auto interval = caf::get_or(self->config(),
+                              "broker.store.standby-resolve-interval",
+                              defaults::store::standby_resolve_interval);
+  clock->send_later(self, interval,
+                    caf::make_message(atom::master::value,
+                                      atom::resolve::value));
+}
+
+void master_state::request_standby_snapshot() {
+  standby_synced = false;
+  receiving_standby_snapshot = false;
+  standby_expiries.clear();
+  self->send(core, atom::store::value, atom::master::value,
+             atom::snapshot::value, id, caf::actor_cast<caf::actor>(self));
+}
+
+void master_state::apply_standby_chunk(snapshot& chunk, uint64_t snapshot_seq,
+                                       bool last) {
+  BROKER_INFO("STANDBY SNAPSHOT CHUNK" << chunk.size() << "entries, last:"
+                                       << last);
+  if (!receiving_standby_snapshot) {
+    if (auto res = backend->clear(); !res)
+      die("failed to clear standby master");
+    if (known_keys)
+      known_keys->reset(known_keys->capacity());
+    notify(store_change::kind::clear, data{});
+    receiving_standby_snapshot = true;
+  }
+  for (auto& kvp : chunk) {
+    optional<timestamp> expiry;
+    auto i = standby_expiries.find(kvp.first);
+    if (i != standby_expiries.end())
+      if (auto ts = caf::get_if<timestamp>(&i->second))
+        expiry = *ts;
+    if (!backend->put(kvp.first, kvp.second, expiry)) {
+      BROKER_WARNING("failed to put" << kvp.first << "->" << kvp.second);
+      continue;
+    }
+    key_added(kvp.first);
+    notify(store_change::kind::put, kvp.first, kvp.second);
+  }
+  cached_snapshot.reset();
+  schedule_publish();
+  update_memory_usage();
+  schedule_flush();
+  if (!last) {
+    auto hdl = caf::actor_cast<caf::actor>(self->current_sender());
+    auto offer = supported_compressions();
+    if (offer.empty())
+      self->send(hdl, atom::snapshot::value, atom::ack::value);
+    else
+      self->send(hdl, atom::snapshot::value, atom::ack::value,
+                 std::move(offer));
+    return;
+  }
+  BROKER_INFO("standby" << id << "synced at sequence number" << snapshot_seq);
+  receiving_standby_snapshot = false;
+  standby_expiries.clear();
+  standby_synced = true;
+  seq = snapshot_seq;
+  replay_log.clear();
+  auto buffered = std::move(standby_buffer);
+  standby_buffer.clear();
+  for (auto& cmd : buffered)
+    if (cmd.seq > seq)
+      replicate(cmd);
+}
+
+void master_state::replicate(internal_command& cmd) {
+  if (!standby_synced) {
+    standby_buffer.emplace_back(std::move(cmd));
+    return;
+  }
+  if (cmd.seq <= seq)
+    return;
+  if (cmd.seq != seq + 1) {
+    BROKER_WARNING("standby" << id << "missed commands" << seq + 1 << "to"
+                             << cmd.seq - 1 << ", request a new snapshot");
+    standby_buffer.emplace_back(std::move(cmd));
+    request_standby_snapshot();
+    return;
+  }
+  if (caf::holds_alternative<snapshot_sync_command>(cmd.content)) {
+    // Keeps the replay log in sync with the primary for resyncing clones.
+    seq = cmd.seq - 1;
+    sequence(std::move(cmd));
+    return;
+  }
+  if (auto x = caf::get_if<put_unique_command>(&cmd.content)) {
+    // The primary has already checked for an existing key and answered the
+    // request.
+    put_command tmp{std::move(x->key), std::move(x->value), x->expiry};
+    cmd.content = std::move(tmp);
+  }
+  auto cmd_seq = cmd.seq;
+  seq = cmd_seq - 1;
+  command(cmd.content);
+  seq = cmd_seq;
+}
+
+void master_state::promote() {
+  BROKER_INFO("standby" << id << "takes over as master at sequence number"
+                        << seq);
+  standby = false;
+  primary = nullptr;
+  standby_buffer.clear();
+  load_expiries(false);
+  self->send(core, atom::store::value, atom::standby::value,
+             atom::master::value, id);
+}
+
+void master_state::open_workload_recording() {
+  auto dir = caf::get_or(self->config(), "broker.store.workload-directory",
+                         defaults::store::workload_directory);
+  if (dir.empty())
+    return;
+  if (!is_directory(dir)) {
+    BROKER_WARNING("workload-directory" << dir << "does not exist");
+    return;
+  }
+  auto file_name = workload_file_name(dir, id);
+  auto writer = make_generator_file_writer(file_name);
+  if (writer == nullptr) {
+    BROKER_WARNING("cannot open workload recording" << file_name);
+    return;
+  }
+  auto capacity = caf::get_or(self->config(), "broker.recording-queue-size",
+                              defaults::recording_queue_size);
+  auto policy = generator_file_recorder::overflow_policy::block;
+  auto policy_str = caf::get_or(self->config(), "broker.recording-overflow",
+                                defaults::recording_overflow);
+  if (!convert(policy_str, policy))
+    BROKER_WARNING("invalid recording-overflow" << policy_str
+                   << "(expected 'drop' or 'block'), use 'block'");
+  BROKER_INFO("record workload to" << file_name);
+  workload = std::make_unique<generator_file_recorder>(std::move(writer),
+                                                       capacity, policy);
+}
+
+void master_state::record(const internal_command::variant_type& cmd) {
+  if (workload == nullptr)
+    return;
+  // Snapshot commands are part of the clone protocol, not of the workload.
+  if (caf::holds_alternative<snapshot_command>(cmd)
+      || caf::holds_alternative<snapshot_sync_command>(cmd))
+    return;
+  auto msg = make_command_message(topic{id}, internal_command{cmd});
+  if (!workload->push(msg)) {
+    BROKER_WARNING("workload recorder failed, stop recording");
+    workload = nullptr;
+  }
+}
+
+void master_state::record(store_query query, const data& x) {
+  if (workload == nullptr)
+    return;
+  auto msg = make_data_message(workload_topic(id, query), x);
+  if (!workload->push(msg)) {
+    BROKER_WARNING("workload recorder failed, stop recording");
+    workload = nullptr;
+  }
+}
+
 void master_state::command(internal_command::variant_type& cmd) {
+  record(cmd);
+  // Any modification renders the cached snapshot outdated.
+  if (!caf::holds_alternative<snapshot_command>(cmd)) {
+    cached_snapshot.reset();
+    schedule_publish();
+  }
+  // Dropping replicated writes would make the standby diverge.
+  if (!standby && reject(cmd))
+    return;
   caf::visit(*this, cmd);
+  update_memory_usage();
+  BROKER_TRACEPOINT(store_command_applied, cmd.index(), 0);
+  schedule_flush();
+}
+
+void master_state::rebuild_key_filter() {
+  BROKER_ASSERT(known_keys != nullptr);
+  auto num_keys = backend->size();
+  if (!num_keys) {
+    BROKER_ERROR("failed to get the size of the backend, disable key filter");
+    known_keys.reset();
+    return;
+  }
+  known_keys->reset(static_cast<size_t>(*num_keys) * 2);
+  auto res = backend->scan(optional<data>{},
+                           defaults::store::snapshot_chunk_size,
+                           [this](scan_batch& xs) {
+                             for (auto& kvp : xs)
+                               known_keys->add(kvp.first);
+                             return true;
+                           });
+  if (!res) {
+    BROKER_ERROR("failed to read the keys of the backend, disable key filter:"
+                 << res.error());
+    known_keys.reset();
+    return;
+  }
+  BROKER_DEBUG("rebuilt key filter with" << known_keys->size() << "keys");
+}
+
+void master_state::key_added(const data& key) {
+  // Skipping known keys keeps updates of existing keys from filling up the
+  // filter.
+  if (!known_keys || known_keys->may_contain(key))
+    return;
+  known_keys->add(key);
+  if (known_keys->saturated())
+    rebuild_key_filter();
+}
+
+bool master_state::may_contain(const data& key) {
+  if (!known_keys || known_keys->may_contain(key))
+    return true;
+  ++key_filter_hits;
+  return false;
+}
+
+bool master_state::change_feed::selects(const data& key) const {
+  if (prefix.empty())
+    return true;
+  auto str = caf::get_if<std::string>(&key);
+  return str != nullptr && str->compare(0, prefix.size(), prefix) == 0;
+}
+
+bool master_state::watched(const data& key) const {
+  return std::any_of(change_feeds.begin(), change_feeds.end(),
+                     [&](const change_feed& x) { return x.selects(key); });
+}
+
+void master_state::notify(const std::vector<store_change>& changes) {
+  for (auto& feed : change_feeds) {
+    std::vector<store_change> xs;
+    for (auto& x : changes)
+      if (x.type == store_change::kind::clear || feed.selects(x.key))
+        xs.emplace_back(x);
+    if (!xs.empty())
+      self->send(feed.worker, std::move(xs));
+  }
+}
+
+void master_state::notify(store_change::kind type, const data& key,
+                          const data& value) {
+  if (change_feeds.empty())
+    return;
+  notify(std::vector<store_change>{store_change{type, key, value}});
+}
+
+void master_state::notify_all(store_change::kind type,
+                              const std::vector<data>& keys) {
+  if (change_feeds.empty())
+    return;
+  std::vector<store_change> changes;
+  changes.reserve(keys.size());
+  for (auto& key : keys)
+    changes.emplace_back(store_change{type, key, data{}});
+  notify(changes);
+}
+
+void master_state::notify_put(const data& key) {
+  if (change_feeds.empty() || !watched(key))
+    return;
+  if (auto value = backend->get(key))
+    notify(store_change::kind::put, key, *value);
+  else if (value.error() != ec::no_such_key)
+    BROKER_WARNING("failed to read" << key << "for change feeds");
+}
+
+void master_state::update_memory_usage() {
+  auto now = backend->memory_usage();
+  auto before = memory.bytes();
+  if (now > before)
+    memory.add(now - before);
+  else if (now < before)
+    memory.remove(before - now);
+  if (rejected > 0 && !memory.exhausted()) {
+    BROKER_INFO("master" << id << "accepts writes again after dropping"
+                         << rejected << "commands");
+    rejected = 0;
+  }
+}
+
+bool master_state::reject(const internal_command::variant_type& cmd) {
+  if (!memory.exhausted())
+    return false;
+  auto grows = [](const internal_command::variant_type& x) {
+    return caf::holds_alternative<put_command>(x)
+           || caf::holds_alternative<put_unique_command>(x)
+           || caf::holds_alternative<add_command>(x)
+           || caf::holds_alternative<put_many_command>(x)
+           || caf::holds_alternative<compare_and_swap_command>(x)
+           || caf::holds_alternative<add_and_get_command>(x);
+  };
+  if (!grows(cmd))
+    return false;
+  if (rejected++ == 0)
+    BROKER_WARNING("master" << id << "reached its memory limit,"
+                            << "dropping writes until it shrinks");
+  // Unblock the frontend waiting for the result.
+  if (auto x = caf::get_if<put_unique_command>(&cmd))
+    self->send(x->who, caf::make_message(data{false}, x->req_id));
+  else if (auto x = caf::get_if<compare_and_swap_command>(&cmd))
+    self->send(x->who, caf::make_message(data{false}, x->req_id));
+  else if (auto x = caf::get_if<add_and_get_command>(&cmd))
+    self->send(x->who,
+               caf::make_message(make_error(ec::backend_failure,
+                                            "memory limit reached"),
+                                 x->req_id));
+  return true;
 }
 
 void master_state::operator()(none) {
@@ -93,22 +832,25 @@ void master_state::operator()(none) {
 }
 
 void master_state::operator()(put_command& x) {
-  BROKER_INFO("PUT" << x.key << "->" << x.value << "with expiry" << (x.expiry ? to_string(*x.expiry) : "none"));
+  BROKER_DEBUG("PUT" << x.key << "->" << x.value << "with expiry" << (x.expiry ? to_string(*x.expiry) : "none"));
   auto et = to_opt_timestamp(clock->now(), x.expiry);
   auto result = backend->put(x.key, x.value, et);
   if (!result) {
     BROKER_WARNING("failed to put" << x.key << "->" << x.value);
     return; // TODO: propagate failure? to all clones? as status msg?
   }
+  key_added(x.key);
   if (x.expiry)
     remind(*x.expiry, x.key);
+  notify(store_change::kind::put, x.key, x.value);
   broadcast_cmd_to_clones(std::move(x));
 }
 
 void master_state::operator()(put_unique_command& x) {
-  BROKER_INFO("PUT_UNIQUE" << x.key << "->" << x.value << "with expiry" << (x.expiry ? to_string(*x.expiry) : "none"));
+  BROKER_DEBUG("PUT_UNIQUE" << x.key << "->" << x.value << "with expiry" << (x.expiry ? to_string(*x.expiry) : "none"));
 
-  auto exists_result = backend->exists(x.key);
+  auto exists_result = may_contain(x.key) ? backend->exists(x.key)
+                                          : expected<bool>{false};
 
   if (!exists_result) {
     BROKER_WARNING("failed to put_unique existence check" << x.key << "->" << x.value);
@@ -131,39 +873,46 @@ void master_state::operator()(put_unique_command& x) {
     return; // TODO: propagate failure? to all clones? as status msg?
   }
 
+  key_added(x.key);
+
   if (x.expiry)
     remind(*x.expiry, x.key);
 
+  notify(store_change::kind::put, x.key, x.value);
+
   // Note that we could just broadcast a regular "put" command here instead
   // since clones shouldn't have to do their own existence check.
   broadcast_cmd_to_clones(std::move(x));
 }
 
 void master_state::operator()(erase_command& x) {
-  BROKER_INFO("ERASE" << x.key);
+  BROKER_DEBUG("ERASE" << x.key);
   auto result = backend->erase(x.key);
   if (!result) {
     BROKER_WARNING("failed to erase" << x.key);
     return; // TODO: propagate failure? to all clones? as status msg?
   }
+  notify(store_change::kind::erase, x.key);
   broadcast_cmd_to_clones(std::move(x));
 }
 
 void master_state::operator()(add_command& x) {
-  BROKER_INFO("ADD" << x);
+  BROKER_DEBUG("ADD" << x);
   auto et = to_opt_timestamp(clock->now(), x.expiry);
   auto result = backend->add(x.key, x.value, x.init_type, et);
   if (!result) {
     BROKER_WARNING("failed to add" << x.value << "to" << x.key);
     return; // TODO: propagate failure? to all clones? as status msg?
   }
+  key_added(x.key);
   if (x.expiry)
     remind(*x.expiry, x.key);
+  notify_put(x.key);
   broadcast_cmd_to_clones(std::move(x));
 }
 
 void master_state::operator()(subtract_command& x) {
-  BROKER_INFO("SUBTRACT" << x);
+  BROKER_DEBUG("SUBTRACT" << x);
   auto et = to_opt_timestamp(clock->now(), x.expiry);
   auto result = backend->subtract(x.key, x.value, et);
   if (!result) {
@@ -172,6 +921,7 @@ void master_state::operator()(subtract_command& x) {
   }
   if (x.expiry)
     remind(*x.expiry, x.key);
+  notify_put(x.key);
   broadcast_cmd_to_clones(std::move(x));
 }
 
@@ -181,31 +931,71 @@ void master_state::operator()(snapshot_command& x) {
     BROKER_INFO("snapshot command with invalid address received");
     return;
   }
-  auto ss = backend->snapshot();
-  if (!ss)
-    die("failed to snapshot master");
-  self->monitor(x.remote_core);
-  clones.emplace(x.remote_core->address(), x.remote_clone);
+  start_snapshot(x.remote_core, x.remote_clone);
+}
+
+void master_state::start_snapshot(const caf::actor& monitored,
+                                  const caf::actor& clone) {
+  // The snapshot already reflects all coalesced commands, so they must have a
+  // sequence number that the clone can skip.
+  flush_coalesced();
+  auto ss = make_snapshot();
+  auto ss_seq = cached_snapshot_seq;
+  self->monitor(monitored);
+  clones.emplace(monitored->address(), clone);
 
   // The snapshot gets sent over a different channel than updates,
   // so we send a "sync" point over the update channel that target clone
   // can use in order to apply any updates that arrived before it
   // received the now-outdated snapshot.
-  broadcast_cmd_to_clones(snapshot_sync_command{x.remote_clone});
-
-  // TODO: possible improvements to do here
-  // (1) Use a separate *streaming* channel to send the snapshot.
-  //     A benefit of that would potentially be less latent queries
-  //     that go directly against the master store.
-  // (2) Always keep an updated snapshot in memory on the master to
-  //     avoid numerous expensive retrievals from persistent backends
-  //     in quick succession (e.g. at startup).
-  // (3) As an alternative to (2), give backends an API to stream
-  //     key-value pairs without ever needing the full snapshot in
-  //     memory.  Note that this would require halting the application
-  //     of updates on the master while there are any snapshot streams
-  //     still underway.
-  self->send(x.remote_clone, set_command{std::move(*ss)});
+  broadcast_cmd_to_clones(snapshot_sync_command{clone});
+
+  // We send the snapshot in bounded chunks. The clone acknowledges each
+  // chunk before we send the next one, which keeps the number of in-flight
+  // bytes small. Concurrent transfers share the same snapshot.
+  // TODO: give backends an API to stream key-value pairs without ever needing
+  //       the full snapshot in memory. Note that this would require halting
+  //       the application of updates on the master while there are any
+  //       snapshot transfers still underway.
+  auto pos = ss->begin();
+  auto& transfer = snapshot_transfers[clone];
+  transfer = snapshot_transfer{std::move(ss), pos, ss_seq};
+  transfer.monitored = monitored->address();
+  send_expiries(clone);
+  send_snapshot_chunk(clone);
+}
+
+void master_state::start_checkpoint_transfer(const caf::actor& clone,
+                                             const std::string& type_name) {
+  auto type = backend::memory;
+  if (!convert(type_name, type) || type != backend_type) {
+    BROKER_INFO("clone uses another backend type, send a snapshot instead");
+    start_snapshot(clone, clone);
+    return;
+  }
+  // The checkpoint reflects all coalesced commands, see start_snapshot.
+  flush_coalesced();
+  auto dir = make_temp_file_name();
+  auto root = dir + "/checkpoint";
+  auto files = backend->checkpoint(root);
+  if (!files || files->empty()) {
+    BROKER_WARNING("failed to create a checkpoint, send a snapshot instead");
+    remove_all(dir);
+    start_snapshot(clone, clone);
+    return;
+  }
+  BROKER_INFO("send" << files->size() << "checkpoint files to" << clone);
+  self->monitor(clone);
+  clones.emplace(clone->address(), clone);
+  checkpoint_transfers[clone] = checkpoint_transfer{std::move(dir),
+                                                    std::move(root),
+                                                    std::move(*files),
+                                                    0,
+                                                    0,
+                                                    seq,
+                                                    clone->address()};
+  send_expiries(clone);
+  send_checkpoint_chunk(clone);
 }
 
 void master_state::operator()(snapshot_sync_command&) {
@@ -221,88 +1011,538 @@ void master_state::operator()(clear_command& x) {
   auto res = backend->clear();
   if (!res)
     die("failed to clear master");
+  if (known_keys)
+    known_keys->reset(known_keys->capacity());
+  notify(store_change::kind::clear, data{});
   broadcast_cmd_to_clones(std::move(x));
 }
 
-caf::behavior master_actor(caf::stateful_actor<master_state>* self,
-                           caf::actor core, std::string id,
-                           master_state::backend_pointer backend,
-                           endpoint::clock* clock) {
-  self->monitor(core);
-  self->state.init(self, std::move(id), std::move(backend),
-                   std::move(core), clock);
-  self->set_down_handler(
-    [=](const caf::down_msg& msg) {
-      if (msg.source == core) {
-        BROKER_INFO("core is down, kill master as well");
-        self->quit(msg.reason);
-      } else {
-        BROKER_INFO("lost a clone");
-        self->state.clones.erase(msg.source);
-      }
-    }
-  );
+void master_state::operator()(put_many_command& x) {
+  BROKER_INFO("PUT_MANY" << x.entries.size() << "entries with expiry"
+                         << (x.expiry ? to_string(*x.expiry) : "none"));
+  auto et = to_opt_timestamp(clock->now(), x.expiry);
+  auto result = backend->put_many(x.entries, et);
+  if (!result) {
+    BROKER_WARNING("failed to put" << x.entries.size() << "entries");
+    return; // TODO: propagate failure? to all clones? as status msg?
+  }
+  for (auto& kvp : x.entries)
+    key_added(kvp.first);
+  if (x.expiry)
+    for (auto& kvp : x.entries)
+      remind(*x.expiry, kvp.first);
+  if (!change_feeds.empty()) {
+    std::vector<store_change> changes;
+    changes.reserve(x.entries.size());
+    for (auto& kvp : x.entries)
+      changes.emplace_back(
+        store_change{store_change::kind::put, kvp.first, kvp.second});
+    notify(changes);
+  }
+  broadcast_cmd_to_clones(std::move(x));
+}
+
+void master_state::operator()(erase_many_command& x) {
+  BROKER_INFO("ERASE_MANY" << x.keys.size() << "keys");
+  auto result = backend->erase_many(x.keys);
+  if (!result) {
+    BROKER_WARNING("failed to erase" << x.keys.size() << "keys");
+    return; // TODO: propagate failure? to all clones? as status msg?
+  }
+  notify_all(store_change::kind::erase, x.keys);
+  broadcast_cmd_to_clones(std::move(x));
+}
+
+void master_state::operator()(compare_and_swap_command& x) {
+  BROKER_DEBUG("COMPARE_AND_SWAP" << x.key << "from" << x.expected_value
+                                  << "to" << x.value);
+  auto current = may_contain(x.key) ? backend->get(x.key)
+                                    : expected<data>{ec::no_such_key};
+  if (!current && current.error() != ec::no_such_key) {
+    BROKER_WARNING("failed to read" << x.key << "for compare_and_swap");
+    self->send(x.who, caf::make_message(std::move(current.error()), x.req_id));
+    return;
+  }
+  // A nil expected value matches a missing key.
+  if ((current ? *current : data{}) != x.expected_value) {
+    self->send(x.who, caf::make_message(data{false}, x.req_id));
+    return;
+  }
+  auto et = to_opt_timestamp(clock->now(), x.expiry);
+  if (auto res = backend->put(x.key, x.value, et); !res) {
+    BROKER_WARNING("failed to put" << x.key << "->" << x.value);
+    self->send(x.who, caf::make_message(std::move(res.error()), x.req_id));
+    return;
+  }
+  self->send(x.who, caf::make_message(data{true}, x.req_id));
+  key_added(x.key);
+  if (x.expiry)
+    remind(*x.expiry, x.key);
+  notify(store_change::kind::put, x.key, x.value);
+  // Clones only need the outcome.
+  broadcast_cmd_to_clones(
+    put_command{std::move(x.key), std::move(x.value), x.expiry});
+}
+
+void master_state::operator()(add_and_get_command& x) {
+  BROKER_DEBUG("ADD_AND_GET" << x.value << "to" << x.key);
+  auto et = to_opt_timestamp(clock->now(), x.expiry);
+  if (auto res = backend->add(x.key, x.value, x.init_type, et); !res) {
+    BROKER_WARNING("failed to add" << x.value << "to" << x.key);
+    self->send(x.who, caf::make_message(std::move(res.error()), x.req_id));
+    return;
+  }
+  auto value = backend->get(x.key);
+  if (!value) {
+    BROKER_WARNING("failed to read" << x.key << "after add_and_get");
+    self->send(x.who, caf::make_message(std::move(value.error()), x.req_id));
+    return;
+  }
+  self->send(x.who, caf::make_message(*value, x.req_id));
+  key_added(x.key);
+  if (x.expiry)
+    remind(*x.expiry, x.key);
+  notify(store_change::kind::put, x.key, *value);
+  // Sending the result keeps clones consistent regardless of the order in
+  // which they see concurrent updates.
+  broadcast_cmd_to_clones(
+    put_command{std::move(x.key), std::move(*value), x.expiry});
+}
+
+namespace {
+
+using key_predicate = std::function<bool(const data&)>;
+
+/// Adds a query to the workload recording.
+using query_hook = std::function<void(store_query, const data&)>;
+
+/// Answers queries from `backend`. Lookups for keys that `may_contain`
+/// rules out fail without touching the backend, unless `may_contain` is
+/// empty. Passes each query to `record` first, unless `record` is empty.
+template <class BackendPointer>
+caf::message_handler backend_queries(BackendPointer backend,
+                                     key_predicate may_contain,
+                                     query_hook record) {
+  auto ruled_out = [=](const data& key) {
+    return may_contain && !may_contain(key);
+  };
   return {
-    // --- local communication -------------------------------------------------
-    [=](atom::local, internal_command& x) {
-      // treat locally and remotely received commands in the same way
-      self->state.command(x);
-    },
-    [=](atom::sync_point, caf::actor& who) {
-      self->send(who, atom::sync_point::value);
-    },
-    [=](atom::expire, data& key) {
-      self->state.expire(key);
-    },
     [=](atom::get, atom::keys) -> expected<data> {
-      auto x = self->state.backend->keys();
+      if (record)
+        record(store_query::keys, data{});
+      auto x = backend->keys();
       BROKER_INFO("KEYS ->" << x);
       return x;
     },
     [=](atom::get, atom::keys, request_id id) {
-      auto x = self->state.backend->keys();
+      if (record)
+        record(store_query::keys, data{});
+      auto x = backend->keys();
       BROKER_INFO("KEYS" << "with id:" << id << "->" << x);
       if (x)
         return caf::make_message(std::move(*x), id);
       return caf::make_message(std::move(x.error()), id);
     },
+    [=](atom::get, const vector& keys) -> expected<data> {
+      if (record)
+        record(store_query::get_many, data{keys});
+      if (may_contain) {
+        vector candidates;
+        for (auto& key : keys)
+          if (may_contain(key))
+            candidates.emplace_back(key);
+        auto x = backend->get_many(candidates);
+        BROKER_INFO("GET" << keys.size() << "keys ->" << x);
+        return x;
+      }
+      auto x = backend->get_many(keys);
+      BROKER_INFO("GET" << keys.size() << "keys ->" << x);
+      return x;
+    },
+    [=](atom::scan, const std::string& prefix, uint64_t limit)
+      -> expected<data> {
+      if (record)
+        record(store_query::scan, data{prefix});
+      auto x = backend->scan(prefix, limit);
+      BROKER_INFO("SCAN" << prefix << "limit:" << limit << "->" << x);
+      return x;
+    },
     [=](atom::exists, const data& key) -> expected<data> {
-      auto x = self->state.backend->exists(key);
+      if (record)
+        record(store_query::exists, key);
+      if (ruled_out(key))
+        return {data{false}};
+      auto x = backend->exists(key);
       BROKER_INFO("EXISTS" << key << "->" << x);
       return {data{std::move(*x)}};
     },
     [=](atom::exists, const data& key, request_id id) {
-      auto x = self->state.backend->exists(key);
+      if (record)
+        record(store_query::exists, key);
+      if (ruled_out(key))
+        return caf::make_message(data{false}, id);
+      auto x = backend->exists(key);
       BROKER_INFO("EXISTS" << key << "with id:" << id << "->" << x);
       return caf::make_message(data{std::move(*x)}, id);
     },
     [=](atom::get, const data& key) -> expected<data> {
-      auto x = self->state.backend->get(key);
+      if (record)
+        record(store_query::get, key);
+      if (ruled_out(key))
+        return ec::no_such_key;
+      auto x = backend->get(key);
       BROKER_INFO("GET" << key << "->" << x);
       return x;
     },
     [=](atom::get, const data& key, const data& aspect) -> expected<data> {
-      auto x = self->state.backend->get(key, aspect);
+      if (record)
+        record(store_query::get_index, vector{key, aspect});
+      if (ruled_out(key))
+        return ec::no_such_key;
+      auto x = backend->get(key, aspect);
       BROKER_INFO("GET" << key << aspect << "->" << x);
       return x;
     },
     [=](atom::get, const data& key, request_id id) {
-      auto x = self->state.backend->get(key);
+      if (record)
+        record(store_query::get, key);
+      if (ruled_out(key))
+        return caf::make_message(make_error(ec::no_such_key), id);
+      auto x = backend->get(key);
       BROKER_INFO("GET" << key << "with id:" << id << "->" << x);
       if (x)
         return caf::make_message(std::move(*x), id);
       return caf::make_message(std::move(x.error()), id);
     },
     [=](atom::get, const data& key, const data& value, request_id id) {
-      auto x = self->state.backend->get(key, value);
+      if (record)
+        record(store_query::get_index, vector{key, value});
+      if (ruled_out(key))
+        return caf::make_message(make_error(ec::no_such_key), id);
+      auto x = backend->get(key, value);
       BROKER_INFO("GET" << key << "->" << value << "with id:" << id << "->" << x);
       if (x)
         return caf::make_message(std::move(*x), id);
       return caf::make_message(std::move(x.error()), id);
     },
+  };
+}
+
+/// Passes queries on to the readers of the master. Only answers lookups for
+/// keys that the key filter rules out by itself. Passes each query to
+/// `record` first, unless `record` is empty.
+caf::message_handler delegated_queries(caf::stateful_actor<master_state>* self,
+                                       query_hook record) {
+  auto reply = [=](auto&&... xs) {
+    self->send(caf::actor_cast<caf::actor>(self->current_sender()),
+               std::forward<decltype(xs)>(xs)...);
+  };
+  return {
+    [=](atom::get, atom::keys) {
+      if (record)
+        record(store_query::keys, data{});
+      return self->delegate(self->state.next_reader(), atom::get::value,
+                            atom::keys::value);
+    },
+    [=](atom::get, atom::keys, request_id id) {
+      if (record)
+        record(store_query::keys, data{});
+      return self->delegate(self->state.next_reader(), atom::get::value,
+                            atom::keys::value, id);
+    },
+    [=](atom::get, vector& keys) {
+      if (record)
+        record(store_query::get_many, data{keys});
+      auto& st = self->state;
+      if (st.known_keys)
+        keys.erase(std::remove_if(keys.begin(), keys.end(),
+                                  [&](const data& key) {
+                                    return !st.may_contain(key);
+                                  }),
+                   keys.end());
+      return self->delegate(st.next_reader(), atom::get::value,
+                            std::move(keys));
+    },
+    [=](atom::scan, std::string& prefix, uint64_t limit) {
+      if (record)
+        record(store_query::scan, data{prefix});
+      return self->delegate(self->state.next_reader(), atom::scan::value,
+                            std::move(prefix), limit);
+    },
+    [=](atom::exists, data& key) -> caf::result<data> {
+      if (record)
+        record(store_query::exists, key);
+      if (!self->state.may_contain(key))
+        return data{false};
+      return self->delegate(self->state.next_reader(), atom::exists::value,
+                            std::move(key));
+    },
+    [=](atom::exists, data& key, request_id id) {
+      if (record)
+        record(store_query::exists, key);
+      if (!self->state.may_contain(key))
+        reply(data{false}, id);
+      else
+        self->delegate(self->state.next_reader(), atom::exists::value,
+                       std::move(key), id);
+    },
+    [=](atom::get, data& key) -> caf::result<data> {
+      if (record)
+        record(store_query::get, key);
+      if (!self->state.may_contain(key))
+        return make_error(ec::no_such_key);
+      return self->delegate(self->state.next_reader(), atom::get::value,
+                            std::move(key));
+    },
+    [=](atom::get, data& key, data& aspect) -> caf::result<data> {
+      if (record)
+        record(store_query::get_index, vector{key, aspect});
+      if (!self->state.may_contain(key))
+        return make_error(ec::no_such_key);
+      return self->delegate(self->state.next_reader(), atom::get::value,
+                            std::move(key), std::move(aspect));
+    },
+    [=](atom::get, data& key, request_id id) {
+      if (record)
+        record(store_query::get, key);
+      if (!self->state.may_contain(key))
+        reply(make_error(ec::no_such_key), id);
+      else
+        self->delegate(self->state.next_reader(), atom::get::value,
+                       std::move(key), id);
+    },
+    [=](atom::get, data& key, data& aspect, request_id id) {
+      if (record)
+        record(store_query::get_index, vector{key, aspect});
+      if (!self->state.may_contain(key))
+        reply(make_error(ec::no_such_key), id);
+      else
+        self->delegate(self->state.next_reader(), atom::get::value,
+                       std::move(key), std::move(aspect), id);
+    },
+  };
+}
+
+} // namespace
+
+caf::behavior master_reader(caf::event_based_actor*,
+                            std::shared_ptr<const abstract_backend> backend) {
+  return caf::behavior{backend_queries(std::move(backend), nullptr, nullptr)};
+}
+
+caf::behavior master_actor(caf::stateful_actor<master_state>* self,
+                           caf::actor core, std::string id,
+                           backend backend_type, backend_options opts,
+                           endpoint::clock* clock,
+                           memory_accounting_ptr memory) {
+  BROKER_INFO("instantiating backend");
+  auto ptr = make_backend(backend_type, std::move(opts));
+  BROKER_ASSERT(ptr);
+  self->monitor(core);
+  self->state.init(self, std::move(id), std::move(ptr), std::move(core),
+                   clock, std::move(memory));
+  auto& st = self->state;
+  st.backend_type = backend_type;
+  auto num_readers = caf::get_or(self->config(), "broker.store.read-workers",
+                                 defaults::store::read_workers);
+  for (size_t i = 0; i < num_readers; ++i) {
+    auto reader = st.backend->make_reader();
+    if (!reader)
+      break;
+    st.readers.emplace_back(self->spawn<caf::linked + caf::detached>(
+      master_reader, std::shared_ptr<const abstract_backend>{std::move(reader)}));
+  }
+  if (!st.readers.empty())
+    BROKER_INFO("serving queries with" << st.readers.size() << "readers");
+  key_predicate may_contain;
+  if (st.known_keys)
+    may_contain = [=](const data& key) { return self->state.may_contain(key); };
+  query_hook record;
+  if (st.workload)
+    record = [=](store_query query, const data& x) {
+      self->state.record(query, x);
+    };
+  auto queries = st.readers.empty()
+                   ? backend_queries(st.backend.get(), std::move(may_contain),
+                                     record)
+                   : delegated_queries(self, record);
+  self->set_down_handler(
+    [=](const caf::down_msg& msg) {
+      auto& feeds = self->state.change_feeds;
+      auto is_source = [&](const master_state::change_feed& x) {
+        return x.worker.address() == msg.source;
+      };
+      auto& st = self->state;
+      if (msg.source == core) {
+        BROKER_INFO("core is down, kill master as well");
+        self->quit(msg.reason);
+      } else if (st.standby && msg.source == st.primary) {
+        BROKER_INFO("lost the primary master");
+        if (st.standby_synced) {
+          st.promote();
+          return;
+        }
+        st.primary = nullptr;
+        st.resolve_primary();
+      } else if (std::any_of(feeds.begin(), feeds.end(), is_source)) {
+        BROKER_INFO("lost a change subscriber");
+        feeds.erase(std::remove_if(feeds.begin(), feeds.end(), is_source),
+                    feeds.end());
+      } else {
+        BROKER_INFO("lost a clone");
+        self->state.clones.erase(msg.source);
+        auto& transfers = self->state.snapshot_transfers;
+        for (auto i = transfers.begin(); i != transfers.end();) {
+          if (i->second.monitored == msg.source)
+            i = transfers.erase(i);
+          else
+            ++i;
+        }
+        auto& files = self->state.checkpoint_transfers;
+        for (auto i = files.begin(); i != files.end();) {
+          if (i->second.monitored == msg.source) {
+            remove_all(i->second.dir);
+            i = files.erase(i);
+          } else {
+            ++i;
+          }
+        }
+      }
+    }
+  );
+  caf::message_handler handlers{
+    // --- local communication -------------------------------------------------
+    [=](atom::local, internal_command& x) {
+      auto& st = self->state;
+      if (st.standby) {
+        // Only the primary may assign sequence numbers.
+        if (st.primary)
+          self->send(st.primary, atom::local::value, std::move(x));
+        else
+          BROKER_WARNING("standby" << st.id << "has no primary, drop write");
+        return;
+      }
+      // treat locally and remotely received commands in the same way
+      st.command(x);
+    },
+    [=](atom::sync_point, caf::actor& who) {
+      self->send(who, atom::sync_point::value);
+    },
+    [=](atom::subscribe, std::string& prefix, caf::actor& worker) {
+      BROKER_INFO("add change feed for prefix" << prefix);
+      self->monitor(worker);
+      self->state.change_feeds.emplace_back(
+        master_state::change_feed{std::move(worker), std::move(prefix)});
+    },
+    [=](atom::expire, timestamp deadline) {
+      self->state.expire(deadline);
+    },
+    [=](atom::expire, atom::init) {
+      self->state.load_expiries(true);
+    },
+    [=](atom::expire, atom::resume) {
+      self->state.load_pending_expiries();
+    },
+    [=](atom::expire, atom::scan) {
+      self->state.load_expiry_window();
+    },
+    [=](atom::flush) {
+      self->state.flush();
+    },
+    [=](atom::flush, atom::clone) {
+      self->state.flush_coalesced();
+    },
+    [=](atom::snapshot, atom::clear) {
+      self->state.cached_snapshot.reset();
+    },
+    [=](atom::snapshot, atom::publish) {
+      self->state.publish();
+    },
+    [=](atom::snapshot, atom::publish, shared_snapshot_ptr& ptr) {
+      // Sent by the core to enable read snapshots.
+      self->state.read_snapshot = std::move(ptr);
+      self->state.publish();
+    },
+    [=](atom::get, atom::snapshot) -> expected<shared_snapshot_ptr> {
+      if (auto& ptr = self->state.read_snapshot)
+        return ptr;
+      return make_error(ec::unspecified, "read snapshots disabled");
+    },
+    [=](atom::snapshot, uint64_t last_seq) {
+      auto clone = caf::actor_cast<caf::actor>(self->current_sender());
+      self->state.resync(clone, last_seq);
+    },
+    [=](atom::snapshot, atom::ack) {
+      auto clone = caf::actor_cast<caf::actor>(self->current_sender());
+      self->state.send_snapshot_chunk(clone);
+    },
+    // Sent by clones that support compression instead of a plain ack.
+    [=](atom::snapshot, atom::ack, const std::vector<std::string>& offer) {
+      auto clone = caf::actor_cast<caf::actor>(self->current_sender());
+      self->state.negotiate_compression(clone, offer);
+      self->state.send_snapshot_chunk(clone);
+    },
+    [=](atom::snapshot, atom::write, const std::string& type_name) {
+      auto clone = caf::actor_cast<caf::actor>(self->current_sender());
+      self->state.start_checkpoint_transfer(clone, type_name);
+    },
+    [=](atom::snapshot, atom::write, atom::ack) {
+      auto clone = caf::actor_cast<caf::actor>(self->current_sender());
+      self->state.send_checkpoint_chunk(clone);
+    },
+    // --- standby mode --------------------------------------------------------
+    [=](atom::master, atom::resolve) {
+      self->state.resolve_primary();
+    },
+    [=](atom::master, caf::actor& primary) {
+      auto& st = self->state;
+      if (!st.standby || st.primary)
+        return;
+      BROKER_INFO("standby" << st.id << "found its primary");
+      st.primary = std::move(primary);
+      self->monitor(st.primary);
+      st.request_standby_snapshot();
+    },
+    [=](atom::master, const caf::error& err) {
+      BROKER_INFO("standby" << self->state.id
+                            << "failed to resolve its primary:" << err);
+    },
+    [=](atom::snapshot, snapshot& chunk, uint64_t seq, bool last) {
+      self->state.apply_standby_chunk(chunk, seq, last);
+    },
+    [=](atom::snapshot, const compressed_batch& x, uint64_t seq, bool last) {
+      snapshot chunk;
+      if (auto err = decompress(self->system(), x, chunk)) {
+        BROKER_ERROR("failed to decompress snapshot chunk:" << err);
+        self->state.request_standby_snapshot();
+        return;
+      }
+      self->state.apply_standby_chunk(chunk, seq, last);
+    },
+    [=](atom::snapshot, atom::expire, table& xs) {
+      // Keeps the expiration times of the keys in the upcoming snapshot.
+      self->state.standby_expiries = std::move(xs);
+    },
+    [=](atom::get, atom::stale) {
+      // Masters are always up to date.
+      return data{timespan{0}};
+    },
     [=](atom::get, atom::name) {
       return self->state.id;
     },
+    [=](atom::get, atom::stats) {
+      auto& st = self->state;
+      return table{{"name", st.id},
+                   {"mailbox-size", count{self->mailbox().size()}},
+                   {"clones", count{st.clones.size()}},
+                   {"snapshot-transfers", count{st.snapshot_transfers.size()}},
+                   {"checkpoint-transfers",
+                    count{st.checkpoint_transfers.size()}},
+                   {"coalesced-commands", count{st.coalesced.size()}},
+                   {"change-feeds", count{st.change_feeds.size()}},
+                   {"unshares", count{st.unshares}},
+                   {"key-filter-hits", count{st.key_filter_hits}}};
+    },
     // --- stream handshake with core ------------------------------------------
     [=](const store::stream_type& in) {
       BROKER_DEBUG("received stream handshake from core");
@@ -317,8 +1557,23 @@ caf::behavior master_actor(caf::stateful_actor<master_state>* self,
         [=](caf::unit_t&, store::stream_type::value_type y) {
           // TODO: our operator() overloads require mutable references, but
           //       only a fraction actually benefit from it.
-          auto cmd = move_command(y);
-          self->state.command(cmd);
+          if (!y.unique())
+            ++self->state.unshares;
+          auto& st = self->state;
+          if (st.standby) {
+            // Replicate what the primary sends to its clones and leave
+            // writes to the primary.
+            if (get_topic(y) == st.clones_topic) {
+              auto cmd = y.unique() ? std::move(caf::get<1>(y.unshared()))
+                                    : caf::get<1>(y);
+              st.replicate(cmd);
+            }
+            return;
+          }
+          auto cmd = y.unique() ? move_command(y) : get_command(y);
+          st.from_clone = true;
+          st.command(cmd);
+          st.from_clone = false;
         },
         // cleanup
         [](caf::unit_t&, const caf::error&) {
@@ -327,6 +1582,20 @@ caf::behavior master_actor(caf::stateful_actor<master_state>* self,
       );
     }
   };
+  return caf::behavior{handlers.or_else(queries)};
+}
+
+caf::behavior standby_master_actor(caf::stateful_actor<master_state>* self,
+                                   caf::actor core, std::string id,
+                                   backend backend_type, backend_options opts,
+                                   endpoint::clock* clock,
+                                   memory_accounting_ptr memory) {
+  self->state.standby = true;
+  auto result = master_actor(self, std::move(core), std::move(id),
+                             backend_type, std::move(opts), clock,
+                             std::move(memory));
+  self->send(self, atom::master::value, atom::resolve::value);
+  return result;
 }
 
 } // namespace detail
@@ -12,21 +12,25 @@
 #include "broker/atoms.hh"
 #include "broker/error.hh"
 #include "broker/logger.hh"
+#include "broker/timeout.hh"
 
 namespace broker {
 namespace detail {
 
 caf::behavior master_resolver(master_resolver_actor* self) {
+  auto fail = [=](const char* reason) {
+    BROKER_DEBUG("resolver failed to find a master:" << reason);
+    self->send(self->state.who_asked, atom::master::value,
+               atom::resolve::value, std::move(self->state.name),
+               make_error(ec::no_such_master, reason));
+    self->quit();
+  };
   self->set_error_handler([=](error&) {
-    if (--self->state.remaining_responses == 0) {
-      BROKER_DEBUG("resolver failed to find a master");
-      self->send(self->state.who_asked, atom::master::value,
-                 make_error(ec::no_such_master, "no master on peers"));
-      self->quit();
-    }
+    if (--self->state.remaining_responses == 0)
+      fail("no master on peers");
   });
   return {
-    [=](const std::vector<caf::actor>& peers, const std::string& name,
+    [=](const std::vector<caf::actor>& peers, std::string& name,
         caf::actor& who_asked) {
       BROKER_DEBUG("resolver starts looking for:" << name);
       for (auto& peer : peers)
@@ -34,13 +38,20 @@ caf::behavior master_resolver(master_resolver_actor* self) {
                    atom::get::value, name);
 
       self->state.remaining_responses = peers.size();
+      self->state.name = std::move(name);
       self->state.who_asked = std::move(who_asked);
+      // Peers that go down never respond.
+      self->delayed_send(self, timeout::frontend, atom::tick::value);
     },
     [=](caf::actor& master) {
       BROKER_DEBUG("resolver found master:" << master);
       self->send(self->state.who_asked, atom::master::value,
+                 atom::resolve::value, std::move(self->state.name),
                  std::move(master));
       self->quit();
+    },
+    [=](atom::tick) {
+      fail("peers did not respond in time");
     }
   };
 }
@@ -0,0 +1,120 @@
+#include "broker/detail/memory_accounting.hh"
+
+#include <caf/actor_system_config.hpp>
+#include <caf/variant.hpp>
+
+#include "broker/defaults.hh"
+#include "broker/detail/core_metrics.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+struct command_size_estimator {
+  template <class T>
+  size_t operator()(const T&) const {
+    return 0;
+  }
+
+  size_t operator()(const put_command& x) const {
+    return estimated_size(x.key) + estimated_size(x.value);
+  }
+
+  size_t operator()(const put_unique_command& x) const {
+    return estimated_size(x.key) + estimated_size(x.value);
+  }
+
+  size_t operator()(const erase_command& x) const {
+    return estimated_size(x.key);
+  }
+
+  size_t operator()(const add_command& x) const {
+    return estimated_size(x.key) + estimated_size(x.value);
+  }
+
+  size_t operator()(const subtract_command& x) const {
+    return estimated_size(x.key) + estimated_size(x.value);
+  }
+
+  size_t operator()(const set_command& x) const {
+    size_t result = 0;
+    for (auto& kvp : x.state)
+      result += estimated_size(kvp.first) + estimated_size(kvp.second);
+    return result;
+  }
+
+  size_t operator()(const put_many_command& x) const {
+    size_t result = 0;
+    for (auto& kvp : x.entries)
+      result += estimated_size(kvp.first) + estimated_size(kvp.second);
+    return result;
+  }
+
+  size_t operator()(const compare_and_swap_command& x) const {
+    return estimated_size(x.key) + estimated_size(x.expected_value)
+           + estimated_size(x.value);
+  }
+
+  size_t operator()(const add_and_get_command& x) const {
+    return estimated_size(x.key) + estimated_size(x.value);
+  }
+
+  size_t operator()(const erase_many_command& x) const {
+    size_t result = 0;
+    for (auto& key : x.keys)
+      result += estimated_size(key);
+    return result;
+  }
+};
+
+} // namespace
+
+memory_accounting::memory_accounting() {
+  for (auto& x : usage_)
+    x = 0;
+  limits_.fill(0);
+}
+
+memory_accounting::memory_accounting(const caf::actor_system_config& cfg)
+  : memory_accounting() {
+  limits_[subscriber_queues] = get_or(cfg, "broker.memory.subscriber-queues",
+                                      defaults::memory::subscriber_queues);
+  limits_[blocked_peers] = get_or(cfg, "broker.memory.blocked-peers",
+                                  defaults::memory::blocked_peers);
+  limits_[master_stores] = get_or(cfg, "broker.memory.master-stores",
+                                  defaults::memory::master_stores);
+  limits_[clone_buffers] = get_or(cfg, "broker.memory.clone-buffers",
+                                  defaults::memory::clone_buffers);
+}
+
+const char* memory_accounting::name(subsystem s) noexcept {
+  switch (s) {
+    case subscriber_queues:
+      return "subscriber-queues";
+    case blocked_peers:
+      return "blocked-peers";
+    case master_stores:
+      return "master-stores";
+    case clone_buffers:
+      return "clone-buffers";
+  }
+  return "???";
+}
+
+data memory_accounting::to_data() const {
+  table result;
+  for (size_t i = 0; i < num_subsystems; ++i) {
+    auto s = static_cast<subsystem>(i);
+    result.emplace(name(s), table{{"bytes", count{usage(s)}},
+                                  {"limit", count{limit(s)}}});
+  }
+  return result;
+}
+
+size_t estimated_size(const internal_command& x) {
+  return caf::visit(command_size_estimator{}, x.content);
+}
+
+} // namespace detail
+} // namespace broker
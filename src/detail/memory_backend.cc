@@ -1,22 +1,163 @@
+#include <algorithm>
+#include <chrono>
 #include <set>
 #include <cstdint>
 #include <utility>
 
 #include "broker/detail/appliers.hh"
+#include "broker/detail/core_metrics.hh"
+#include "broker/detail/filesystem.hh"
 #include "broker/detail/memory_backend.hh"
+#include "broker/logger.hh"
 
 namespace broker {
 namespace detail {
 
+namespace {
+
+/// Estimates the size of the part of `x` that adding or subtracting `value`
+/// modifies. Sets and tables only count the element for `key`, which avoids
+/// visiting all elements of large containers on each update. Vectors return
+/// 0, because the callers account appended and removed elements directly.
+size_t affected_size(const data& x, const data& key) {
+  if (auto xs = get_if<set>(x))
+    return xs->count(key) > 0 ? estimated_size(key) : 0;
+  if (auto xs = get_if<table>(x)) {
+    auto i = xs->find(key);
+    return i != xs->end() ? estimated_size(i->first) + estimated_size(i->second)
+                          : 0;
+  }
+  if (is<vector>(x))
+    return 0;
+  return estimated_size(x);
+}
+
+/// Keeps small logs from triggering a new snapshot on each flush.
+constexpr size_t min_log_size = 1024 * 1024;
+
+} // namespace
 
 memory_backend::memory_backend(backend_options opts)
   : options_{std::move(opts)} {
-  // nop
+  auto i = options_.find("capacity");
+  if (i != options_.end())
+    if (auto capacity = caf::get_if<count>(&i->second))
+      store_.reserve(*capacity);
+  i = options_.find("prefix-index");
+  if (i != options_.end())
+    if (auto enabled = caf::get_if<bool>(&i->second); enabled && *enabled)
+      index_ = std::make_unique<index_type>();
+  checkpoint_interval_ = std::chrono::milliseconds{1000};
+  i = options_.find("checkpoint-ms");
+  if (i != options_.end())
+    if (auto ms = caf::get_if<count>(&i->second))
+      checkpoint_interval_ = std::chrono::milliseconds{*ms};
+  i = options_.find("checkpoint");
+  if (i != options_.end())
+    if (auto path = caf::get_if<std::string>(&i->second))
+      open_journal(*path);
+}
+
+void memory_backend::open_journal(const std::string& path) {
+  auto dir = dirname(path);
+  if (!dir.empty() && !is_directory(dir) && !mkdirs(dir)) {
+    BROKER_ERROR("failed to create checkpoint dir:" << dir);
+    return;
+  }
+  auto journal = std::make_unique<memory_journal>(path);
+  auto replayed = journal->load(
+    [this](data& key, data& value, optional<timestamp> expiry) {
+      put(key, std::move(value), expiry);
+    },
+    [this](memory_journal::command& cmd) { replay(cmd); });
+  if (!replayed) {
+    // Leave the files untouched for manual recovery.
+    BROKER_ERROR("unable to load checkpoint" << path << ":"
+                                             << replayed.error());
+    return;
+  }
+  BROKER_INFO("restored" << store_.size() << "entries and replayed"
+                         << *replayed << "commands from" << path);
+  journal_ = std::move(journal);
+  // Fold replayed commands into a new snapshot to keep the log short.
+  auto err = *replayed > 0 || journal_->snapshot_size() == 0
+               ? write_snapshot()
+               : journal_->reset_log();
+  if (err) {
+    BROKER_ERROR("unable to write checkpoint" << path << ":" << err);
+    journal_.reset();
+  }
+}
+
+void memory_backend::replay(memory_journal::command& cmd) {
+  using journal = memory_journal;
+  if (auto x = caf::get_if<put_command>(&cmd))
+    put(x->key, std::move(x->value), journal::decode_expiry(x->expiry));
+  else if (auto x = caf::get_if<add_command>(&cmd))
+    add(x->key, x->value, x->init_type, journal::decode_expiry(x->expiry));
+  else if (auto x = caf::get_if<subtract_command>(&cmd))
+    subtract(x->key, x->value, journal::decode_expiry(x->expiry));
+  else if (auto x = caf::get_if<erase_command>(&cmd))
+    erase(x->key);
+  else if (caf::holds_alternative<clear_command>(cmd))
+    clear();
+}
+
+void memory_backend::log(memory_journal::command cmd) {
+  if (journal_failed_)
+    return;
+  if (auto err = journal_->append(cmd)) {
+    BROKER_ERROR("unable to write to journal:" << err);
+    journal_failed_ = true;
+  }
+}
+
+caf::error memory_backend::write_snapshot() {
+  if (auto err = journal_->begin_snapshot())
+    return err;
+  for (auto& [key, entry] : store_)
+    if (auto err = journal_->add_to_snapshot(key, entry.first, entry.second))
+      return err;
+  return journal_->commit_snapshot();
+}
+
+void memory_backend::add_to_index(store_type::value_type& entry) {
+  if (!index_)
+    return;
+  if (auto str = caf::get_if<std::string>(&entry.first)) {
+    if (str->find('\0') == std::string::npos)
+      index_->insert({*str, &entry});
+    else
+      ++unindexed_;
+  }
+}
+
+void memory_backend::remove_from_index(const data& key) {
+  if (!index_)
+    return;
+  if (auto str = caf::get_if<std::string>(&key)) {
+    if (str->find('\0') == std::string::npos)
+      index_->erase(*str);
+    else
+      --unindexed_;
+  }
 }
 
 expected<void>
 memory_backend::put(const data& key, data value, optional<timestamp> expiry) {
-  store_[key] = {std::move(value), std::move(expiry)};
+  auto i = store_.find(key);
+  if (i != store_.end()) {
+    bytes_ -= estimated_size(i->second.first);
+    bytes_ += estimated_size(value);
+    i->second = std::make_pair(std::move(value), expiry);
+  } else {
+    bytes_ += estimated_size(key) + estimated_size(value);
+    i = store_.emplace(key, std::make_pair(std::move(value), expiry)).first;
+    add_to_index(*i);
+  }
+  if (journal_)
+    log(put_command{key, i->second.first,
+                    memory_journal::encode_expiry(expiry)});
   return {};
 }
 
@@ -29,10 +170,26 @@ expected<void> memory_backend::add(const data& key, const data& value,
       return ec::type_clash;
     auto newv = std::make_pair(data::from_type(init_type), expiry);
     i = store_.emplace(std::move(key), std::move(newv)).first;
+    add_to_index(*i);
+    bytes_ += estimated_size(i->first) + estimated_size(i->second.first);
   }
-  auto result = caf::visit(adder{value}, i->second.first);
-  if (result)
+  auto& x = i->second.first;
+  // Adding to a table requires a key-value pair.
+  auto elem = &value;
+  if (auto kvp = get_if<vector>(value); kvp && kvp->size() == 2)
+    elem = &kvp->front();
+  auto before = affected_size(x, *elem);
+  auto result = caf::visit(adder{value}, x);
+  if (result) {
     i->second.second = std::move(expiry);
+    if (is<vector>(x))
+      bytes_ += estimated_size(value);
+    else
+      bytes_ = bytes_ - before + affected_size(x, *elem);
+    if (journal_)
+      log(add_command{key, value, init_type,
+                      memory_journal::encode_expiry(expiry)});
+  }
   return result;
 }
 
@@ -41,19 +198,43 @@ expected<void> memory_backend::subtract(const data& key, const data& value,
   auto i = store_.find(key);
   if (i == store_.end())
     return ec::no_such_key;
-  auto result = caf::visit(remover{value}, i->second.first);
-  if (result)
+  auto& x = i->second.first;
+  auto before = affected_size(x, value);
+  if (auto xs = get_if<vector>(x); xs && !xs->empty())
+    before = estimated_size(xs->back());
+  auto result = caf::visit(remover{value}, x);
+  if (result) {
     i->second.second = std::move(expiry);
+    if (is<vector>(x))
+      bytes_ -= before;
+    else
+      bytes_ = bytes_ - before + affected_size(x, value);
+    if (journal_)
+      log(subtract_command{key, value, memory_journal::encode_expiry(expiry)});
+  }
   return result;
 }
 
 expected<void> memory_backend::erase(const data& key) {
-  store_.erase(key);
+  auto i = store_.find(key);
+  if (i != store_.end()) {
+    bytes_ -= estimated_size(i->first) + estimated_size(i->second.first);
+    remove_from_index(key);
+    store_.erase(i);
+    if (journal_)
+      log(erase_command{key});
+  }
   return {};
 }
 
 expected<void> memory_backend::clear() {
    store_.clear();
+   if (index_)
+     index_->clear();
+   unindexed_ = 0;
+   bytes_ = 0;
+   if (journal_)
+     log(clear_command{});
    return {};
 }
 
@@ -63,6 +244,10 @@ expected<bool> memory_backend::expire(const data& key, timestamp ts) {
     return ec::no_such_key;
   if (!i->second.second || ts < i->second.second)
     return false;
+  bytes_ -= estimated_size(i->first) + estimated_size(i->second.first);
+  remove_from_index(i->first);
+  if (journal_)
+    log(erase_command{i->first});
   store_.erase(i);
   return true;
 }
@@ -91,6 +276,47 @@ expected<data> memory_backend::get(const data& key, const data& value) const {
   return caf::visit(retriever{value}, i->second.first);
 }
 
+expected<data> memory_backend::scan(const std::string& prefix,
+                                    size_t limit) const {
+  table result;
+  if (index_ && unindexed_ == 0) {
+    for (auto& i : index_->prefixed_by(prefix)) {
+      auto entry = i->second;
+      result.emplace(entry->first, entry->second.first);
+      if (result.size() == limit)
+        break;
+    }
+    return {std::move(result)};
+  }
+  for (auto& kvp : store_) {
+    if (!has_prefix(kvp.first, prefix))
+      continue;
+    result.emplace(kvp.first, kvp.second.first);
+    if (result.size() == limit)
+      break;
+  }
+  return {std::move(result)};
+}
+
+expected<optional<data>>
+memory_backend::scan(const optional<data>& start, size_t batch_size,
+                     const scan_callback& f) const {
+  auto i = store_.begin();
+  if (start) {
+    i = store_.find(*start);
+    if (i == store_.end())
+      return ec::no_such_key;
+  }
+  scan_batcher batcher{batch_size, f};
+  for (; i != store_.end(); ++i) {
+    if (!batcher.flush_if_full())
+      return optional<data>{i->first};
+    batcher.push(i->first, i->second.first);
+  }
+  batcher.finish();
+  return optional<data>{};
+}
+
 expected<bool> memory_backend::exists(const data& key) const {
   return store_.count(key) == 1;
 }
@@ -101,6 +327,7 @@ expected<uint64_t> memory_backend::size() const {
 
 expected<snapshot> memory_backend::snapshot() const {
   broker::snapshot ss;
+  ss.reserve(store_.size());
   for (auto& p : store_)
     ss.emplace(p.first, p.second.first);
   return {std::move(ss)};
@@ -117,5 +344,27 @@ expected<expirables> memory_backend::expiries() const {
   return {std::move(rval)};
 }
 
+size_t memory_backend::memory_usage() const {
+  return bytes_;
+}
+
+expected<void> memory_backend::flush() {
+  if (!journal_)
+    return {};
+  auto compact = journal_failed_
+                 || journal_->log_size()
+                      > std::max(journal_->snapshot_size(), min_log_size);
+  if (auto err = compact ? write_snapshot() : journal_->flush()) {
+    journal_failed_ = true;
+    return err;
+  }
+  journal_failed_ = false;
+  return {};
+}
+
+timespan memory_backend::flush_interval() const {
+  return journal_ ? checkpoint_interval_ : timespan{0};
+}
+
 } // namespace detail
 } // namespace broker
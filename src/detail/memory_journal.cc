@@ -0,0 +1,193 @@
+#include "broker/detail/memory_journal.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <caf/binary_deserializer.hpp>
+
+#include "broker/error.hh"
+#include "broker/logger.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+constexpr size_t header_size = sizeof(uint32_t) + sizeof(uint8_t)
+                               + sizeof(uint64_t);
+
+/// Reads the entire file at `file_name` into `buf`.
+bool read_file(const std::string& file_name, std::vector<char>& buf) {
+  std::ifstream in{file_name, std::ios::binary | std::ios::ate};
+  if (!in)
+    return false;
+  buf.resize(static_cast<size_t>(in.tellg()));
+  in.seekg(0);
+  return static_cast<bool>(in.read(buf.data(), buf.size()));
+}
+
+/// Returns the generation in the header of `buf` if the header is valid.
+optional<uint64_t> read_header(const std::vector<char>& buf) {
+  if (buf.size() < header_size)
+    return nil;
+  uint32_t magic;
+  uint8_t version;
+  uint64_t gen;
+  auto pos = buf.data();
+  auto extract = [&](auto& x) {
+    memcpy(&x, pos, sizeof(x));
+    pos += sizeof(x);
+  };
+  extract(magic);
+  extract(version);
+  extract(gen);
+  if (magic != memory_journal::magic || version != memory_journal::version)
+    return nil;
+  return gen;
+}
+
+/// Deserializes all complete records after the header of `buf` and calls `f`
+/// for each one. Returns the number of records.
+template <class F>
+size_t for_each_record(const std::vector<char>& buf, F f) {
+  size_t result = 0;
+  memory_journal::command cmd;
+  auto pos = buf.data() + header_size;
+  auto end = buf.data() + buf.size();
+  while (static_cast<size_t>(end - pos) >= sizeof(uint32_t)) {
+    uint32_t size;
+    memcpy(&size, pos, sizeof(size));
+    pos += sizeof(size);
+    if (static_cast<size_t>(end - pos) < size)
+      break;
+    caf::binary_deserializer source{nullptr, pos, size};
+    if (auto err = source(cmd)) {
+      BROKER_WARNING("dropping corrupted journal record:" << err);
+      break;
+    }
+    pos += size;
+    f(cmd);
+    ++result;
+  }
+  return result;
+}
+
+} // namespace
+
+memory_journal::memory_journal(std::string path) : path_(std::move(path)) {
+  // nop
+}
+
+memory_journal::~memory_journal() {
+  if (auto err = flush())
+    BROKER_ERROR("flushing journal in destructor failed:" << err);
+}
+
+expected<size_t> memory_journal::load(const entry_callback& on_entry,
+                                      const command_callback& on_command) {
+  std::vector<char> buf;
+  if (!read_file(path_, buf))
+    return size_t{0};
+  auto gen = read_header(buf);
+  if (!gen)
+    return make_error(ec::invalid_data, path_, "invalid snapshot header");
+  generation_ = *gen;
+  snapshot_size_ = buf.size();
+  for_each_record(buf, [&](command& cmd) {
+    if (auto x = caf::get_if<put_command>(&cmd))
+      on_entry(x->key, x->value, decode_expiry(x->expiry));
+  });
+  if (!read_file(path_ + ".log", buf))
+    return size_t{0};
+  if (auto log_gen = read_header(buf); !log_gen || *log_gen != generation_)
+    return size_t{0};
+  return for_each_record(buf, on_command);
+}
+
+caf::error memory_journal::open(std::ofstream& out,
+                                const std::string& file_name, uint64_t gen) {
+  if (out.is_open())
+    out.close();
+  out.clear();
+  out.open(file_name, std::ofstream::binary | std::ofstream::trunc);
+  if (!out.is_open())
+    return make_error(ec::cannot_open_file, file_name);
+  char header[header_size];
+  auto pos = header;
+  auto append = [&](const auto& x) {
+    memcpy(pos, &x, sizeof(x));
+    pos += sizeof(x);
+  };
+  append(magic);
+  append(version);
+  append(gen);
+  if (!out.write(header, sizeof(header)))
+    return make_error(ec::cannot_write_file, file_name);
+  return caf::none;
+}
+
+caf::error memory_journal::write(std::ofstream& out,
+                                 const std::string& file_name,
+                                 const command& cmd, size_t& bytes) {
+  buf_.clear();
+  {
+    caf::binary_serializer sink{nullptr, buf_};
+    if (auto err = sink(const_cast<command&>(cmd)))
+      return err;
+  }
+  if (buf_.size() > std::numeric_limits<uint32_t>::max())
+    return make_error(ec::cannot_write_file, file_name, "record too large");
+  auto size = static_cast<uint32_t>(buf_.size());
+  if (!out.write(reinterpret_cast<const char*>(&size), sizeof(size))
+      || !out.write(reinterpret_cast<const char*>(buf_.data()), size))
+    return make_error(ec::cannot_write_file, file_name);
+  bytes += sizeof(size) + size;
+  return caf::none;
+}
+
+caf::error memory_journal::reset_log() {
+  log_size_ = header_size;
+  return open(log_, path_ + ".log", generation_);
+}
+
+caf::error memory_journal::append(const command& cmd) {
+  if (!log_.is_open())
+    return make_error(ec::cannot_write_file, path_ + ".log");
+  return write(log_, path_ + ".log", cmd, log_size_);
+}
+
+caf::error memory_journal::flush() {
+  if (log_.is_open() && !log_.flush())
+    return make_error(ec::cannot_write_file, path_ + ".log");
+  return caf::none;
+}
+
+caf::error memory_journal::begin_snapshot() {
+  pending_size_ = header_size;
+  return open(snapshot_, path_ + ".tmp", generation_ + 1);
+}
+
+caf::error memory_journal::add_to_snapshot(const data& key, const data& value,
+                                           optional<timestamp> expiry) {
+  return write(snapshot_, path_ + ".tmp",
+               put_command{key, value, encode_expiry(expiry)}, pending_size_);
+}
+
+caf::error memory_journal::commit_snapshot() {
+  auto tmp = path_ + ".tmp";
+  snapshot_.close();
+  if (snapshot_.fail())
+    return make_error(ec::cannot_write_file, tmp);
+  if (std::rename(tmp.c_str(), path_.c_str()) != 0)
+    return make_error(ec::cannot_write_file, path_,
+                      "unable to replace snapshot");
+  ++generation_;
+  snapshot_size_ = pending_size_;
+  return reset_log();
+}
+
+} // namespace detail
+} // namespace broker
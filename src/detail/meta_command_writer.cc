@@ -71,6 +71,31 @@ caf::error meta_command_writer::operator()(const clear_command& x) {
   return apply_tag(internal_command_uint_tag<clear_command>());
 }
 
+caf::error meta_command_writer::operator()(const put_many_command& x) {
+  BROKER_TRY(apply_tag(internal_command_uint_tag<put_many_command>()),
+             writer_.apply_container(x.entries));
+  return caf::none;
+}
+
+caf::error meta_command_writer::operator()(const erase_many_command& x) {
+  BROKER_TRY(apply_tag(internal_command_uint_tag<erase_many_command>()),
+             writer_.apply_container(x.keys));
+  return caf::none;
+}
+
+caf::error meta_command_writer::operator()(const compare_and_swap_command& x) {
+  BROKER_TRY(apply_tag(internal_command_uint_tag<compare_and_swap_command>()),
+             writer_(x.key), writer_(x.expected_value), writer_(x.value));
+  return caf::none;
+}
+
+caf::error meta_command_writer::operator()(const add_and_get_command& x) {
+  auto& sink = writer_.sink();
+  BROKER_TRY(apply_tag(internal_command_uint_tag<add_and_get_command>()),
+             writer_(x.key), writer_(x.value), sink(x.init_type));
+  return caf::none;
+}
+
 caf::error meta_command_writer::apply_tag(uint8_t tag) {
   auto& sink = writer_.sink();
   return sink(tag);
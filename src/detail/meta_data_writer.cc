@@ -2,6 +2,8 @@
 
 #include <caf/binary_serializer.hpp>
 
+#include "broker/detail/data_codec.hh"
+
 namespace broker {
 namespace detail {
 
@@ -13,8 +15,12 @@ caf::error meta_data_writer::apply(data::type tag) {
   return sink_(tag);
 }
 
-caf::error meta_data_writer::apply(size_t container_size){
-  return sink_(static_cast<uint32_t>(container_size));
+caf::error meta_data_writer::apply(size_t container_size) {
+  data_codec::buffer buf;
+  data_codec::write_varint(container_size, buf);
+  for (auto c : buf)
+    BROKER_TRY(sink_(static_cast<uint8_t>(c)));
+  return caf::none;
 }
 
 } // namespace detail
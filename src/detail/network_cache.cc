@@ -5,7 +5,8 @@
 namespace broker {
 namespace detail {
 
-network_cache::network_cache(caf::event_based_actor* selfptr) : self(selfptr) {
+network_cache::network_cache(caf::event_based_actor* selfptr)
+  : self(selfptr), resolver_ttl_(0) {
   // nop
 }
 
@@ -35,6 +36,18 @@ caf::optional<network_info> network_cache::find(const caf::actor& x) {
   return caf::none;
 }
 
+caf::optional<std::string>
+network_cache::find_address(const std::string& host) {
+  auto i = resolved_.find(host);
+  if (i == resolved_.end())
+    return caf::none;
+  if (i->second.expires < now()) {
+    resolved_.erase(i);
+    return caf::none;
+  }
+  return i->second.address;
+}
+
 void network_cache::add(const caf::actor& x, const network_info& y) {
   BROKER_TRACE(BROKER_ARG(x) << BROKER_ARG(y));
   addrs_.emplace(x, y);
@@ -0,0 +1,134 @@
+#include "broker/detail/packed_batch.hh"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+#include <caf/binary_deserializer.hpp>
+#include <caf/binary_serializer.hpp>
+
+#include "broker/detail/data_codec.hh"
+#include "broker/error.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+/// Upper bound for the size of a packed batch. Protects against malformed or
+/// malicious batches.
+constexpr uint32_t max_batch_size = 256 * 1024 * 1024;
+
+/// Returns whether `y` continues the run that starts at `x` and contains `n`
+/// messages so far.
+bool continues_run(const node_message& x, const node_message& y, size_t n) {
+  if (x.content.index() != y.content.index() || x.ttl != y.ttl
+      || x.origin != y.origin || x.receiver != y.receiver)
+    return false;
+  // Messages without an origin carry no meaningful sequence number.
+  auto seq = x.origin != 0 ? x.seq + static_cast<uint32_t>(n) : x.seq;
+  return y.seq == seq && get_topic(x) == get_topic(y);
+}
+
+} // namespace
+
+caf::error pack(caf::actor_system& sys, const std::vector<node_message>& xs,
+                packed_batch& result, bool compact) {
+  if (xs.size() > std::numeric_limits<uint32_t>::max())
+    return make_error(ec::invalid_data, "batch too large");
+  caf::binary_serializer::container_type buf;
+  caf::binary_serializer sink{sys, buf};
+  auto first = xs.begin();
+  while (first != xs.end()) {
+    auto last = std::next(first);
+    while (last != xs.end()
+           && continues_run(*first, *last,
+                            static_cast<size_t>(last - first)))
+      ++last;
+    auto& hdr = *first;
+    auto kind = static_cast<uint8_t>(hdr.content.index());
+    auto n = static_cast<uint32_t>(last - first);
+    if (auto err = sink(kind, hdr.ttl, hdr.origin, hdr.seq, hdr.receiver,
+                        get_topic(hdr), n))
+      return err;
+    if (compact && is_data_message(hdr)) {
+      for (; first != last; ++first)
+        data_codec::encode(get_data(caf::get<data_message>(first->content)),
+                           buf);
+      // The codec appends to the buffer behind the back of the serializer.
+      sink.seek(buf.size());
+      continue;
+    }
+    for (; first != last; ++first) {
+      caf::error err;
+      if (is_data_message(*first))
+        err = sink(get_data(caf::get<data_message>(first->content)));
+      else
+        err = sink(get_command(caf::get<command_message>(first->content)));
+      if (err)
+        return err;
+    }
+  }
+  if (buf.size() > max_batch_size)
+    return make_error(ec::invalid_data, "batch too large");
+  result.size = static_cast<uint32_t>(xs.size());
+  result.compact = compact;
+  result.bytes = std::move(buf);
+  return caf::none;
+}
+
+caf::error unpack(caf::actor_system& sys, const packed_batch& x,
+                  std::vector<node_message>& result) {
+  if (x.bytes.size() > max_batch_size)
+    return make_error(ec::invalid_data, "batch too large");
+  // Each message occupies at least one byte.
+  result.reserve(result.size() + std::min(size_t{x.size}, x.bytes.size()));
+  caf::binary_deserializer source{sys, x.bytes};
+  size_t remaining = x.size;
+  while (remaining > 0) {
+    uint8_t kind = 0;
+    uint16_t ttl = 0;
+    uint64_t origin = 0;
+    uint32_t seq = 0;
+    caf::node_id receiver;
+    topic t;
+    uint32_t n = 0;
+    if (auto err = source(kind, ttl, origin, seq, receiver, t, n))
+      return err;
+    if (kind > 1 || n == 0 || n > remaining)
+      return make_error(ec::invalid_data, "malformed packed batch");
+    remaining -= n;
+    // Decide on the kind once per run rather than once per message.
+    if (kind == 0) {
+      for (uint32_t i = 0; i < n; ++i) {
+        data payload;
+        if (x.compact) {
+          auto first = x.bytes.data() + (x.bytes.size() - source.remaining());
+          auto last = x.bytes.data() + x.bytes.size();
+          auto pos = first;
+          if (auto err = data_codec::decode(pos, last, payload))
+            return err;
+          source.skip(static_cast<size_t>(pos - first));
+        } else if (auto err = source(payload)) {
+          return err;
+        }
+        result.emplace_back(node_message{
+          make_data_message(t, std::move(payload)), ttl, origin,
+          origin != 0 ? seq + i : seq, receiver});
+      }
+    } else {
+      for (uint32_t i = 0; i < n; ++i) {
+        internal_command payload;
+        if (auto err = source(payload))
+          return err;
+        result.emplace_back(node_message{
+          make_command_message(t, std::move(payload)), ttl, origin,
+          origin != 0 ? seq + i : seq, receiver});
+      }
+    }
+  }
+  return caf::none;
+}
+
+} // namespace detail
+} // namespace broker
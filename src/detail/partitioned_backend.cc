@@ -0,0 +1,346 @@
+#include "broker/detail/partitioned_backend.hh"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+
+#include "broker/detail/assert.hh"
+#include "broker/detail/store_router.hh"
+
+namespace broker {
+namespace detail {
+
+/// Runs a function for each partition on a thread of its own. The calling
+/// thread takes care of the first partition.
+class partitioned_backend::thread_pool {
+public:
+  explicit thread_pool(size_t num_partitions) {
+    for (size_t i = 1; i < num_partitions; ++i)
+      threads_.emplace_back([this, i] { run(i); });
+  }
+
+  ~thread_pool() {
+    {
+      std::unique_lock<std::mutex> guard{mtx_};
+      stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& t : threads_)
+      t.join();
+  }
+
+  void for_each(const std::function<void(size_t)>& f) {
+    {
+      std::unique_lock<std::mutex> guard{mtx_};
+      job_ = &f;
+      pending_ = threads_.size();
+      ++generation_;
+    }
+    work_cv_.notify_all();
+    f(0);
+    std::unique_lock<std::mutex> guard{mtx_};
+    done_cv_.wait(guard, [this] { return pending_ == 0; });
+    job_ = nullptr;
+  }
+
+private:
+  void run(size_t index) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> guard{mtx_};
+    for (;;) {
+      work_cv_.wait(guard,
+                    [&] { return stopping_ || generation_ != seen; });
+      if (stopping_)
+        return;
+      seen = generation_;
+      auto f = job_;
+      guard.unlock();
+      (*f)(index);
+      guard.lock();
+      if (--pending_ == 0)
+        done_cv_.notify_one();
+    }
+  }
+
+  std::mutex mtx_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(size_t)>* job_ = nullptr;
+  uint64_t generation_ = 0;
+  size_t pending_ = 0;
+  bool stopping_ = false;
+  std::vector<std::thread> threads_;
+};
+
+partitioned_backend::partitioned_backend(std::vector<backend_pointer> xs)
+  : partitions_(std::move(xs)),
+    pool_(std::make_unique<thread_pool>(partitions_.size())) {
+  BROKER_ASSERT(!partitions_.empty());
+}
+
+partitioned_backend::~partitioned_backend() {
+  // Stop the threads before destroying the partitions.
+  pool_.reset();
+}
+
+abstract_backend& partitioned_backend::partition_of(const data& key) const {
+  return *partitions_[shard_of(key, partitions_.size())];
+}
+
+error partitioned_backend::for_each_partition(
+  const std::function<error(size_t)>& f) const {
+  std::vector<error> errs(partitions_.size());
+  pool_->for_each([&](size_t i) { errs[i] = f(i); });
+  for (auto& err : errs)
+    if (err)
+      return std::move(err);
+  return {};
+}
+
+expected<void> partitioned_backend::put(const data& key, data value,
+                                        optional<timestamp> expiry) {
+  return partition_of(key).put(key, std::move(value), expiry);
+}
+
+expected<void>
+partitioned_backend::put_many(const std::unordered_map<data, data>& entries,
+                              optional<timestamp> expiry) {
+  std::vector<std::unordered_map<data, data>> xss(partitions_.size());
+  for (auto& kvp : entries)
+    xss[shard_of(kvp.first, xss.size())].emplace(kvp);
+  auto err = for_each_partition([&](size_t i) -> error {
+    if (xss[i].empty())
+      return {};
+    auto res = partitions_[i]->put_many(xss[i], expiry);
+    return res ? error{} : std::move(res.error());
+  });
+  if (err)
+    return err;
+  return {};
+}
+
+expected<void> partitioned_backend::add(const data& key, const data& value,
+                                        data::type init_type,
+                                        optional<timestamp> expiry) {
+  return partition_of(key).add(key, value, init_type, expiry);
+}
+
+expected<void> partitioned_backend::subtract(const data& key,
+                                             const data& value,
+                                             optional<timestamp> expiry) {
+  return partition_of(key).subtract(key, value, expiry);
+}
+
+expected<void> partitioned_backend::erase(const data& key) {
+  return partition_of(key).erase(key);
+}
+
+expected<void> partitioned_backend::erase_many(const std::vector<data>& keys) {
+  std::vector<std::vector<data>> xss(partitions_.size());
+  for (auto& key : keys)
+    xss[shard_of(key, xss.size())].emplace_back(key);
+  auto err = for_each_partition([&](size_t i) -> error {
+    if (xss[i].empty())
+      return {};
+    auto res = partitions_[i]->erase_many(xss[i]);
+    return res ? error{} : std::move(res.error());
+  });
+  if (err)
+    return err;
+  return {};
+}
+
+expected<void> partitioned_backend::clear() {
+  auto err = for_each_partition([&](size_t i) -> error {
+    auto res = partitions_[i]->clear();
+    return res ? error{} : std::move(res.error());
+  });
+  if (err)
+    return err;
+  return {};
+}
+
+expected<bool> partitioned_backend::expire(const data& key,
+                                           timestamp current_time) {
+  return partition_of(key).expire(key, current_time);
+}
+
+expected<std::vector<data>>
+partitioned_backend::expire_many(const std::vector<data>& keys,
+                                 timestamp current_time) {
+  std::vector<std::vector<data>> xss(partitions_.size());
+  for (auto& key : keys)
+    xss[shard_of(key, xss.size())].emplace_back(key);
+  auto err = for_each_partition([&](size_t i) -> error {
+    if (xss[i].empty())
+      return {};
+    auto res = partitions_[i]->expire_many(xss[i], current_time);
+    if (!res)
+      return std::move(res.error());
+    xss[i] = std::move(*res);
+    return {};
+  });
+  if (err)
+    return err;
+  // Report the expired keys in their original order.
+  std::unordered_set<data> expired;
+  for (auto& xs : xss)
+    expired.insert(std::make_move_iterator(xs.begin()),
+                   std::make_move_iterator(xs.end()));
+  std::vector<data> result;
+  for (auto& key : keys)
+    if (expired.count(key) > 0)
+      result.emplace_back(key);
+  return result;
+}
+
+expected<void> partitioned_backend::flush() {
+  auto err = for_each_partition([&](size_t i) -> error {
+    auto res = partitions_[i]->flush();
+    return res ? error{} : std::move(res.error());
+  });
+  if (err)
+    return err;
+  return {};
+}
+
+timespan partitioned_backend::flush_interval() const {
+  timespan result{0};
+  for (auto& x : partitions_) {
+    auto interval = x->flush_interval();
+    if (interval.count() > 0 && (result.count() == 0 || interval < result))
+      result = interval;
+  }
+  return result;
+}
+
+expected<data> partitioned_backend::get(const data& key) const {
+  return partition_of(key).get(key);
+}
+
+expected<data> partitioned_backend::get(const data& key,
+                                        const data& aspect) const {
+  return partition_of(key).get(key, aspect);
+}
+
+expected<data>
+partitioned_backend::get_many(const std::vector<data>& keys) const {
+  table result;
+  for (auto& key : keys) {
+    auto res = partition_of(key).get(key);
+    if (res)
+      result.emplace(key, std::move(*res));
+    else if (res.error() != ec::no_such_key)
+      return std::move(res.error());
+  }
+  return {std::move(result)};
+}
+
+expected<data> partitioned_backend::scan(const std::string& prefix,
+                                         size_t limit) const {
+  table result;
+  for (auto& x : partitions_) {
+    auto remaining = limit > 0 ? limit - result.size() : 0;
+    auto res = x->scan(prefix, remaining);
+    if (!res)
+      return res;
+    for (auto& kvp : caf::get<table>(*res))
+      result.emplace(kvp.first, kvp.second);
+    if (limit > 0 && result.size() >= limit)
+      break;
+  }
+  return {std::move(result)};
+}
+
+expected<bool> partitioned_backend::exists(const data& key) const {
+  return partition_of(key).exists(key);
+}
+
+expected<uint64_t> partitioned_backend::size() const {
+  uint64_t result = 0;
+  for (auto& x : partitions_) {
+    auto res = x->size();
+    if (!res)
+      return res;
+    result += *res;
+  }
+  return result;
+}
+
+expected<data> partitioned_backend::keys() const {
+  std::vector<set> xss(partitions_.size());
+  auto err = for_each_partition([&](size_t i) -> error {
+    auto res = partitions_[i]->keys();
+    if (!res)
+      return std::move(res.error());
+    if (auto xs = caf::get_if<set>(&*res))
+      xss[i] = std::move(*xs);
+    return {};
+  });
+  if (err)
+    return err;
+  set result;
+  for (auto& xs : xss)
+    result.merge(xs);
+  return {std::move(result)};
+}
+
+expected<broker::snapshot> partitioned_backend::snapshot() const {
+  std::vector<broker::snapshot> xss(partitions_.size());
+  auto err = for_each_partition([&](size_t i) -> error {
+    auto res = partitions_[i]->snapshot();
+    if (!res)
+      return std::move(res.error());
+    xss[i] = std::move(*res);
+    return {};
+  });
+  if (err)
+    return err;
+  broker::snapshot result;
+  for (auto& xs : xss) {
+    if (result.empty())
+      result = std::move(xs);
+    else
+      result.merge(xs);
+  }
+  return result;
+}
+
+expected<expirables> partitioned_backend::expiries() const {
+  return expiries_between(timestamp::min(), timestamp::max());
+}
+
+expected<expirables>
+partitioned_backend::expiries_between(timestamp from, timestamp until) const {
+  std::vector<expirables> xss(partitions_.size());
+  auto err = for_each_partition([&](size_t i) -> error {
+    auto res = from == timestamp::min() && until == timestamp::max()
+                 ? partitions_[i]->expiries()
+                 : partitions_[i]->expiries_between(from, until);
+    if (!res)
+      return std::move(res.error());
+    xss[i] = std::move(*res);
+    return {};
+  });
+  if (err)
+    return err;
+  expirables result;
+  for (auto& xs : xss)
+    result.insert(result.end(), std::make_move_iterator(xs.begin()),
+                  std::make_move_iterator(xs.end()));
+  return result;
+}
+
+size_t partitioned_backend::memory_usage() const {
+  size_t result = 0;
+  for (auto& x : partitions_)
+    result += x->memory_usage();
+  return result;
+}
+
+} // namespace detail
+} // namespace broker
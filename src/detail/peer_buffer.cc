@@ -0,0 +1,232 @@
+#include "broker/detail/peer_buffer.hh"
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+#include <caf/actor_system.hpp>
+#include <caf/binary_deserializer.hpp>
+
+#include "broker/detail/assert.hh"
+#include "broker/detail/core_metrics.hh"
+#include "broker/detail/data_codec.hh"
+#include "broker/detail/filesystem.hh"
+#include "broker/error.hh"
+#include "broker/internal_command.hh"
+#include "broker/logger.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+// Spill files store each batch as a varint message count followed by the
+// messages. Each message consists of its TTL, a kind byte, the topic, and
+// either the data in the compact data_codec encoding or the command in the
+// regular binary serialization.
+
+enum class spill_kind : uint8_t {
+  data,
+  command,
+};
+
+void write_string(const std::string& x, data_codec::buffer& buf) {
+  data_codec::write_varint(x.size(), buf);
+  buf.insert(buf.end(), x.begin(), x.end());
+}
+
+bool read_string(const char*& first, const char* last, std::string& x) {
+  uint64_t n;
+  if (!data_codec::read_varint(first, last, n)
+      || n > static_cast<size_t>(last - first))
+    return false;
+  x.assign(first, static_cast<size_t>(n));
+  first += n;
+  return true;
+}
+
+} // namespace
+
+peer_buffer::peer_buffer(caf::actor_system& sys, size_t memory_limit,
+                         memory_accounting_ptr memory)
+  : sys_(sys),
+    memory_limit_(memory_limit),
+    accounting_(std::move(memory), memory_accounting::blocked_peers) {
+  // nop
+}
+
+peer_buffer::~peer_buffer() {
+  if (!file_name_.empty()) {
+    file_.close();
+    detail::remove(file_name_);
+  }
+}
+
+caf::error peer_buffer::push(batch_type xs) {
+  auto size = estimated_size(xs);
+  // Once we started spilling, all batches go to disk until the file is empty
+  // again. Otherwise, we would break the order of batches.
+  if (spilled_ > 0 || memory_usage_ + size > memory_limit_
+      || accounting_.exhausted())
+    return spill(xs);
+  memory_usage_ += size;
+  accounting_.add(size);
+  mem_.emplace_back(entry{std::move(xs), size});
+  return caf::none;
+}
+
+caf::expected<peer_buffer::batch_type> peer_buffer::pop() {
+  if (!mem_.empty()) {
+    auto result = std::move(mem_.front().batch);
+    memory_usage_ -= mem_.front().size;
+    accounting_.remove(mem_.front().size);
+    mem_.pop_front();
+    return result;
+  }
+  return unspill();
+}
+
+caf::error peer_buffer::spill(batch_type& xs) {
+  if (file_name_.empty()) {
+    file_name_ = make_temp_file_name();
+    file_.open(file_name_, std::ios::in | std::ios::out | std::ios::trunc
+                             | std::ios::binary);
+    if (!file_.is_open())
+      return make_error(ec::cannot_open_file, file_name_);
+    BROKER_DEBUG("spill batches of a blocked peer to" << file_name_);
+  }
+  buf_.clear();
+  data_codec::write_varint(xs.size(), buf_);
+  for (auto& x : xs) {
+    data_codec::write_varint(x.ttl, buf_);
+    data_codec::write_varint(x.origin, buf_);
+    data_codec::write_varint(x.seq, buf_);
+    {
+      // The serializer appends to the end of the buffer.
+      caf::binary_serializer sink{sys_, buf_};
+      if (auto err = sink(x.receiver))
+        return err;
+    }
+    if (is_data_message(x)) {
+      auto& msg = caf::get<data_message>(x.content);
+      buf_.push_back(static_cast<char>(spill_kind::data));
+      write_string(get_topic(msg).string(), buf_);
+      data_codec::encode(get_data(msg), buf_);
+    } else {
+      auto& msg = caf::get<command_message>(x.content);
+      buf_.push_back(static_cast<char>(spill_kind::command));
+      write_string(get_topic(msg).string(), buf_);
+      // The serializer appends to the end of the buffer.
+      caf::binary_serializer sink{sys_, buf_};
+      auto cmd = get_command(msg);
+      if (auto err = sink(cmd))
+        return err;
+    }
+  }
+  if (buf_.size() > std::numeric_limits<uint32_t>::max())
+    return make_error(ec::cannot_write_file, file_name_, "batch too large");
+  auto size = static_cast<uint32_t>(buf_.size());
+  file_.seekp(0, std::ios::end);
+  if (!file_.write(reinterpret_cast<const char*>(&size), sizeof(size))
+      || !file_.write(reinterpret_cast<const char*>(buf_.data()), size))
+    return make_error(ec::cannot_write_file, file_name_);
+  ++spilled_;
+  return caf::none;
+}
+
+caf::expected<peer_buffer::batch_type> peer_buffer::unspill() {
+  BROKER_ASSERT(spilled_ > 0);
+  uint32_t size = 0;
+  file_.seekg(read_pos_);
+  if (!file_.read(reinterpret_cast<char*>(&size), sizeof(size)))
+    return make_error(ec::invalid_data, file_name_, "unable to read size");
+  buf_.resize(size);
+  if (!file_.read(reinterpret_cast<char*>(buf_.data()), size))
+    return make_error(ec::invalid_data, file_name_, "unable to read batch");
+  batch_type result;
+  const char* first = buf_.data();
+  const char* last = first + buf_.size();
+  auto invalid = [&] {
+    return make_error(ec::invalid_data, file_name_, "unable to decode batch");
+  };
+  uint64_t n;
+  if (!data_codec::read_varint(first, last, n)
+      || n > static_cast<size_t>(last - first))
+    return invalid();
+  result.reserve(n);
+  for (uint64_t i = 0; i < n; ++i) {
+    uint64_t ttl;
+    uint64_t origin;
+    uint64_t seq;
+    std::string str;
+    if (!data_codec::read_varint(first, last, ttl)
+        || ttl > std::numeric_limits<uint16_t>::max()
+        || !data_codec::read_varint(first, last, origin)
+        || !data_codec::read_varint(first, last, seq)
+        || seq > std::numeric_limits<uint32_t>::max())
+      return invalid();
+    caf::node_id receiver;
+    {
+      caf::binary_deserializer source{sys_, first,
+                                      static_cast<size_t>(last - first)};
+      if (auto err = source(receiver))
+        return err;
+      first = last - source.remaining();
+    }
+    if (first == last)
+      return invalid();
+    auto kind = static_cast<spill_kind>(*first++);
+    if (!read_string(first, last, str))
+      return invalid();
+    if (kind == spill_kind::data) {
+      data value;
+      if (auto err = data_codec::decode(first, last, value))
+        return err;
+      result.emplace_back(make_node_message(
+        make_data_message(topic{std::move(str)}, std::move(value)),
+        static_cast<uint16_t>(ttl)));
+    } else if (kind == spill_kind::command) {
+      internal_command cmd;
+      caf::binary_deserializer source{sys_, first,
+                                      static_cast<size_t>(last - first)};
+      if (auto err = source(cmd))
+        return err;
+      first = last - source.remaining();
+      result.emplace_back(make_node_message(
+        make_command_message(topic{std::move(str)}, std::move(cmd)),
+        static_cast<uint16_t>(ttl)));
+    } else {
+      return invalid();
+    }
+    auto& x = result.back();
+    x.origin = origin;
+    x.seq = static_cast<uint32_t>(seq);
+    x.receiver = std::move(receiver);
+  }
+  read_pos_ += static_cast<std::streamoff>(sizeof(size) + size);
+  if (--spilled_ == 0) {
+    // Start over with an empty file to keep its size bounded.
+    file_.close();
+    file_.open(file_name_, std::ios::in | std::ios::out | std::ios::trunc
+                             | std::ios::binary);
+    read_pos_ = 0;
+    if (!file_.is_open())
+      BROKER_WARNING("unable to reopen" << file_name_);
+  }
+  return result;
+}
+
+size_t estimated_size(const peer_buffer::batch_type& xs) {
+  size_t result = 0;
+  for (auto& x : xs) {
+    if (is_data_message(x.content))
+      result += estimated_size(get_data(caf::get<data_message>(x.content)));
+    else
+      result += sizeof(internal_command);
+    result += get_topic(x.content).string().size();
+  }
+  return result;
+}
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,370 @@
+#include "broker/detail/peer_manager.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <iterator>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <caf/actor.hpp>
+#include <caf/actor_cast.hpp>
+#include <caf/make_message.hpp>
+#include <caf/outbound_path.hpp>
+#include <caf/scheduled_actor.hpp>
+#include <caf/settings.hpp>
+#include <caf/stream_manager.hpp>
+
+#include "broker/defaults.hh"
+#include "broker/detail/data_codec.hh"
+#include "broker/detail/packed_batch.hh"
+#include "broker/detail/peer_buffer.hh"
+#include "broker/logger.hh"
+#include "broker/time.hh"
+#include "broker/topic.hh"
+
+namespace broker {
+namespace detail {
+
+priority_class priority_of(const node_message& x) {
+  if (is_command_message(x))
+    return priority_class::store;
+  if (get_topic(caf::get<data_message>(x.content)).is_control())
+    return priority_class::control;
+  return priority_class::bulk;
+}
+
+template <class Container>
+void prioritize(Container& xs) {
+  auto less = [](const node_message& x, const node_message& y) {
+    return priority_of(x) < priority_of(y);
+  };
+  // Most buffers only contain bulk data, so check before moving elements.
+  if (!std::is_sorted(xs.begin(), xs.end(), less))
+    std::stable_sort(xs.begin(), xs.end(), less);
+}
+
+template void prioritize(std::vector<node_message>&);
+
+template void prioritize(std::deque<node_message>&);
+
+bool convert(const std::string& str, overload_policy::mode& x,
+             size_t& sample_rate) {
+  if (str == "buffer") {
+    x = overload_policy::mode::buffer;
+    return true;
+  }
+  if (str == "drop") {
+    x = overload_policy::mode::drop;
+    return true;
+  }
+  if (str.compare(0, 7, "sample/") == 0) {
+    char* end = nullptr;
+    auto n = strtoul(str.c_str() + 7, &end, 10);
+    if (end == str.c_str() + 7 || *end != '\0' || n < 1)
+      return false;
+    x = overload_policy::mode::sample;
+    sample_rate = static_cast<size_t>(n);
+    return true;
+  }
+  return false;
+}
+
+template <class Container>
+void throttle(const overload_policy& cfg, overload_state& st, Container& buf,
+              size_t keep) {
+  auto old = std::min(st.held, buf.size());
+  auto first = buf.begin() + static_cast<ptrdiff_t>(old);
+  // New messages may take free slots in the buffer, unless older messages
+  // still wait aside.
+  if (st.pending.empty() && old < keep)
+    first += static_cast<ptrdiff_t>(std::min(keep - old, buf.size() - old));
+  for (auto i = first; i != buf.end(); ++i) {
+    // Clones behind the peer cannot recover from lost store commands, so
+    // policies only ever shed data messages.
+    if (is_command_message(*i)) {
+      st.pending.emplace_back(std::move(*i));
+      continue;
+    }
+    if (cfg.what == overload_policy::mode::drop) {
+      ++st.dropped;
+      continue;
+    }
+    if (cfg.what == overload_policy::mode::sample
+        && ++st.excess < cfg.sample_rate) {
+      ++st.dropped;
+      continue;
+    }
+    st.excess = 0;
+    if (st.pending.size() < cfg.buffer_size)
+      st.pending.emplace_back(std::move(*i));
+    else
+      ++st.dropped;
+  }
+  buf.erase(first, buf.end());
+  while (buf.size() < keep && !st.pending.empty()) {
+    buf.emplace_back(std::move(st.pending.front()));
+    st.pending.pop_front();
+  }
+}
+
+template void throttle(const overload_policy&, overload_state&,
+                       std::vector<node_message>&, size_t);
+
+peer_manager::peer_manager(caf::stream_manager* parent)
+  : super(parent),
+    prioritized_(get_or(parent->self()->config(), "broker.peer-priorities",
+                        defaults::peer_priorities)),
+    compression_(compression::none),
+    compression_min_size_(get_or(parent->self()->config(),
+                                 "broker.peer-compression-min-size",
+                                 defaults::peer_compression_min_size)),
+    packing_(get_or(parent->self()->config(), "broker.peer-packing",
+                    defaults::peer_packing)),
+    compact_data_(get_or(parent->self()->config(), "broker.peer-compact-data",
+                         defaults::peer_compact_data)) {
+  auto str = get_or(parent->self()->config(), "broker.peer-compression",
+                    defaults::peer_compression);
+  if (!convert(str, compression_))
+    BROKER_WARNING("ignored invalid peer-compression:" << str);
+  else if (compression_ != compression::none && !supported(compression_))
+    BROKER_WARNING("ignored unsupported peer-compression:" << str);
+  if (!supported(compression_))
+    compression_ = compression::none;
+  auto& cfg = parent->self()->config();
+  overload_.timeout = get_or(cfg, "broker.slow-peer.timeout",
+                             defaults::slow_peer::timeout);
+  overload_.buffer_size = get_or(cfg, "broker.slow-peer.buffer-size",
+                                 defaults::slow_peer::buffer_size);
+  auto policy = get_or(cfg, "broker.slow-peer.policy",
+                       defaults::slow_peer::policy);
+  if (!convert(policy, overload_.what, overload_.sample_rate))
+    BROKER_WARNING("ignored invalid slow-peer policy:" << policy);
+}
+
+void peer_manager::emit_batches() {
+  throttle_slow_peers();
+  prioritize_paths();
+  emit_encoded_batches(false);
+  super::emit_batches();
+  update_held();
+}
+
+void peer_manager::force_emit_batches() {
+  throttle_slow_peers();
+  prioritize_paths();
+  emit_encoded_batches(true);
+  super::force_emit_batches();
+  update_held();
+}
+
+void peer_manager::negotiate_compression(
+  const caf::actor& hdl, const std::vector<std::string>& offer) {
+  if (compression_ == compression::none)
+    return;
+  if (std::find(offer.begin(), offer.end(), to_string(compression_))
+      != offer.end()) {
+    BROKER_DEBUG("compress batches to" << hdl << "with"
+                 << to_string(compression_));
+    compressed_peers_[hdl.address()] = compression_;
+  }
+}
+
+void peer_manager::disable_compression(const caf::actor& hdl) {
+  compressed_peers_.erase(hdl.address());
+}
+
+void peer_manager::enable_packing(const caf::actor& hdl) {
+  if (packing_)
+    packed_peers_.emplace(hdl.address());
+}
+
+void peer_manager::disable_packing(const caf::actor& hdl) {
+  packed_peers_.erase(hdl.address());
+}
+
+bool peer_manager::packs_for(const caf::actor& hdl) const {
+  return packed_peers_.count(hdl.address()) != 0;
+}
+
+void peer_manager::negotiate_codec(const caf::actor& hdl,
+                                   const std::vector<std::string>& offer) {
+  if (!compact_data_)
+    return;
+  if (std::find(offer.begin(), offer.end(), data_codec::id) != offer.end()) {
+    BROKER_DEBUG("encode data to" << hdl << "with" << data_codec::id);
+    coded_peers_.emplace(hdl.address());
+  }
+}
+
+void peer_manager::disable_codec(const caf::actor& hdl) {
+  coded_peers_.erase(hdl.address());
+}
+
+bool peer_manager::encodes_for(const caf::actor& hdl) const {
+  return coded_peers_.count(hdl.address()) != 0;
+}
+
+size_t peer_manager::unsent() {
+  fan_out_flush();
+  size_t result = 0;
+  for (auto& kvp : states())
+    result += kvp.second.buf.size();
+  for (auto& kvp : slow_peers_)
+    result += kvp.second.pending.size();
+  return result;
+}
+
+std::vector<node_message> peer_manager::take_unsent() {
+  fan_out_flush();
+  std::vector<node_message> result;
+  std::set<std::pair<uint64_t, uint32_t>> ids;
+  for (auto& kvp : states()) {
+    auto& buf = kvp.second.buf;
+    for (auto& x : buf)
+      if (x.origin == 0 || ids.emplace(x.origin, x.seq).second)
+        result.emplace_back(std::move(x));
+    buf.clear();
+  }
+  for (auto& kvp : slow_peers_) {
+    for (auto& x : kvp.second.pending)
+      if (x.origin == 0 || ids.emplace(x.origin, x.seq).second)
+        result.emplace_back(std::move(x));
+    kvp.second.pending.clear();
+  }
+  return result;
+}
+
+compression peer_manager::compression_for(const caf::actor& hdl) const {
+  auto i = compressed_peers_.find(hdl.address());
+  return i != compressed_peers_.end() ? i->second : compression::none;
+}
+
+void peer_manager::prioritize_paths() {
+  if (!prioritized_)
+    return;
+  // Move all pending messages to the paths first.
+  fan_out_flush();
+  for (auto& kvp : states())
+    prioritize(kvp.second.buf);
+}
+
+void peer_manager::throttle_slow_peers() {
+  if (overload_.timeout.count() <= 0)
+    return;
+  fan_out_flush();
+  // Forget paths that no longer exist.
+  for (auto i = slow_peers_.begin(); i != slow_peers_.end();) {
+    if (states().find(i->first) == states().end())
+      i = slow_peers_.erase(i);
+    else
+      ++i;
+  }
+  auto now = broker::now();
+  for (auto& kvp : states()) {
+    auto ptr = path(kvp.first);
+    if (ptr == nullptr)
+      continue;
+    auto& buf = kvp.second.buf;
+    auto keep = static_cast<size_t>(std::max(ptr->desired_batch_size,
+                                             int32_t{1}));
+    auto i = slow_peers_.find(kvp.first);
+    if (i == slow_peers_.end() || !i->second.isolated) {
+      if (ptr->open_credit > 0 || buf.size() <= keep) {
+        if (i != slow_peers_.end())
+          slow_peers_.erase(i);
+        continue;
+      }
+      if (i == slow_peers_.end()) {
+        slow_peers_[kvp.first].congested_since = now;
+        continue;
+      }
+      if (now - i->second.congested_since < overload_.timeout)
+        continue;
+      BROKER_WARNING("isolate slow peer" << ptr->hdl << "with"
+                     << buf.size() << "buffered messages");
+      i->second.isolated = true;
+      i->second.held = keep;
+    }
+    auto& st = i->second;
+    throttle(overload_, st, buf, keep);
+    if (st.pending.empty() && buf.size() < keep) {
+      BROKER_INFO("slow peer" << ptr->hdl << "caught up after dropping"
+                  << st.dropped << "messages");
+      slow_peers_.erase(i);
+    }
+  }
+}
+
+void peer_manager::update_held() {
+  for (auto& kvp : slow_peers_) {
+    auto i = states().find(kvp.first);
+    if (i != states().end())
+      kvp.second.held = i->second.buf.size();
+  }
+}
+
+void peer_manager::emit_encoded_batches(bool force_underfull) {
+  if (compressed_peers_.empty() && packed_peers_.empty())
+    return;
+  fan_out_flush();
+  for (auto& kvp : states()) {
+    auto ptr = path(kvp.first);
+    if (ptr == nullptr || ptr->pending())
+      continue;
+    auto addr = caf::actor_cast<caf::actor_addr>(ptr->hdl);
+    auto i = compressed_peers_.find(addr);
+    auto algorithm = i != compressed_peers_.end() ? i->second
+                                                  : compression::none;
+    auto packed = packed_peers_.count(addr) != 0;
+    if (algorithm == compression::none && !packed)
+      continue;
+    auto compact = packed && coded_peers_.count(addr) != 0;
+    // Mirrors outbound_path::emit_batches, but encodes each batch.
+    auto& buf = kvp.second.buf;
+    auto batch_size = static_cast<size_t>(std::max(ptr->desired_batch_size,
+                                                   int32_t{1}));
+    auto credit = static_cast<size_t>(std::max(ptr->open_credit, int32_t{0}));
+    auto n = std::min(buf.size(), credit);
+    size_t pos = 0;
+    while (n - pos >= batch_size || (force_underfull && pos < n)) {
+      auto k = std::min(batch_size, n - pos);
+      auto first = std::make_move_iterator(buf.begin() + pos);
+      emit_encoded(ptr, algorithm, packed, compact,
+                   std::vector<node_message>(first, first + k));
+      pos += k;
+    }
+    buf.erase(buf.begin(), buf.begin() + pos);
+  }
+}
+
+void peer_manager::emit_encoded(caf::outbound_path* ptr, compression algorithm,
+                                bool packed, bool compact,
+                                std::vector<node_message> xs) {
+  auto xs_size = static_cast<int32_t>(xs.size());
+  if (algorithm != compression::none
+      && estimated_size(xs) >= compression_min_size_) {
+    compressed_batch compressed;
+    auto err = compress(self()->system(), algorithm, xs, compressed);
+    if (!err) {
+      ptr->emit_batch(self(), xs_size,
+                      caf::make_message(std::move(compressed)));
+      return;
+    }
+    BROKER_WARNING("send uncompressed batch:" << err);
+  }
+  if (packed) {
+    packed_batch pb;
+    auto err = pack(self()->system(), xs, pb, compact);
+    if (!err) {
+      ptr->emit_batch(self(), xs_size, caf::make_message(std::move(pb)));
+      return;
+    }
+    BROKER_WARNING("send unpacked batch:" << err);
+  }
+  ptr->emit_batch(self(), xs_size, caf::make_message(std::move(xs)));
+}
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,81 @@
+#include "broker/detail/prometheus_actor.hh"
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+#include <caf/error.hpp>
+#include <caf/io/receive_policy.hpp>
+#include <caf/io/system_messages.hpp>
+
+#include "broker/atoms.hh"
+#include "broker/data.hh"
+#include "broker/detail/core_metrics.hh"
+#include "broker/logger.hh"
+#include "broker/timeout.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+void respond(caf::io::broker* self, caf::io::connection_handle hdl,
+             const char* status, const std::string& body) {
+  std::string out = "HTTP/1.1 ";
+  out += status;
+  out += "\r\nContent-Type: text/plain; version=0.0.4\r\n"
+         "Content-Length: ";
+  out += std::to_string(body.size());
+  out += "\r\nConnection: close\r\n\r\n";
+  out += body;
+  self->write(hdl, out.size(), out.data());
+  self->flush(hdl);
+  self->close(hdl);
+}
+
+} // namespace
+
+caf::behavior prometheus_actor(caf::io::broker* self, caf::actor core) {
+  self->monitor(core);
+  self->set_down_handler([=](const caf::down_msg& msg) {
+    BROKER_DEBUG("core terminated, stop serving metrics");
+    self->quit(msg.reason);
+  });
+  // Connections that wait for their response.
+  using handle_set = std::unordered_set<caf::io::connection_handle>;
+  auto pending = std::make_shared<handle_set>();
+  return {
+    [=](const caf::io::new_connection_msg& msg) {
+      self->configure_read(msg.handle, caf::io::receive_policy::at_most(1024));
+    },
+    [=](const caf::io::new_data_msg& msg) {
+      // Any request receives the same response. Hence, we don't need to parse
+      // the request and simply reply after receiving the first bytes.
+      auto hdl = msg.handle;
+      if (!pending->emplace(hdl).second)
+        return;
+      self->request(core, timeout::frontend, atom::get::value,
+                    atom::metrics::value)
+        .then(
+          [=](const data& snapshot) {
+            if (pending->erase(hdl) > 0)
+              respond(self, hdl, "200 OK", to_prometheus(snapshot));
+          },
+          [=](const caf::error& err) {
+            BROKER_WARNING("unable to retrieve metrics:" << err);
+            if (pending->erase(hdl) > 0)
+              respond(self, hdl, "503 Service Unavailable", "");
+          });
+    },
+    [=](const caf::io::connection_closed_msg& msg) {
+      pending->erase(msg.handle);
+    },
+    [=](const caf::io::acceptor_closed_msg&) {
+      BROKER_DEBUG("lost the metrics port, stop serving metrics");
+      self->quit();
+    },
+  };
+}
+
+} // namespace detail
+} // namespace broker
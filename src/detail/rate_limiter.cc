@@ -0,0 +1,128 @@
+#include "broker/detail/rate_limiter.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <utility>
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+bool parse_double(const std::string& str, double& x) {
+  if (str.empty())
+    return false;
+  char* end = nullptr;
+  x = strtod(str.c_str(), &end);
+  return end == str.c_str() + str.size() && x > 0;
+}
+
+/// Checks whether `prefix` matches `t` up to a separator, e.g., `foo/bar`
+/// matches `foo/bar/baz` but not `foo/barn`.
+bool component_prefix_of(const topic& prefix, const topic& t) {
+  auto& str = t.string();
+  auto n = prefix.string().size();
+  return prefix.prefix_of(t)
+         && (n == str.size() || n == 0 || str[n] == topic::sep);
+}
+
+} // namespace
+
+rate_limiter::rate_limiter(std::vector<rule> rules) {
+  rules_.reserve(rules.size());
+  for (auto& x : rules) {
+    rule_state st;
+    st.tokens = x.burst;
+    st.config = std::move(x);
+    rules_.emplace_back(std::move(st));
+  }
+}
+
+bool rate_limiter::coalesces() const noexcept {
+  return std::any_of(rules_.begin(), rules_.end(), [](const rule_state& x) {
+    return x.config.mode == policy::coalesce;
+  });
+}
+
+rate_limiter::rule_state* rate_limiter::find(const topic& t) {
+  rule_state* result = nullptr;
+  for (auto& st : rules_)
+    if (component_prefix_of(st.config.prefix, t)
+        && (result == nullptr
+            || st.config.prefix.string().size()
+                 > result->config.prefix.string().size()))
+      result = &st;
+  return result;
+}
+
+void rate_limiter::refill(rule_state& st, timestamp t) {
+  if (st.last_refill == timestamp{}) {
+    st.last_refill = t;
+    return;
+  }
+  if (t <= st.last_refill)
+    return;
+  using fractional_seconds = std::chrono::duration<double>;
+  auto elapsed = std::chrono::duration_cast<fractional_seconds>(
+    t - st.last_refill);
+  st.tokens = std::min(st.config.burst,
+                       st.tokens + elapsed.count() * st.config.rate);
+  st.last_refill = t;
+}
+
+void rate_limiter::hold(rule_state& st, node_message& x) {
+  auto& t = get_topic(x);
+  auto i = st.pending.find(t);
+  if (i != st.pending.end()) {
+    ++st.dropped;
+    i->second = std::move(x);
+  } else {
+    st.pending.emplace(t, std::move(x));
+  }
+}
+
+bool convert(const std::string& str, rate_limiter::rule& x) {
+  std::vector<std::string> fields;
+  size_t first = 0;
+  for (;;) {
+    auto last = str.find(':', first);
+    fields.emplace_back(str.substr(first, last - first));
+    if (last == std::string::npos)
+      break;
+    first = last + 1;
+  }
+  if (fields.size() < 2 || fields.size() > 4 || fields[0].empty())
+    return false;
+  rate_limiter::rule result;
+  result.prefix = topic{fields[0]};
+  if (!parse_double(fields[1], result.rate))
+    return false;
+  result.burst = std::max(result.rate, 1.0);
+  if (fields.size() > 2) {
+    if (!parse_double(fields[2], result.burst))
+      return false;
+    result.burst = std::max(result.burst, 1.0);
+  }
+  if (fields.size() > 3) {
+    auto& mode = fields[3];
+    if (mode == "drop") {
+      result.mode = rate_limiter::policy::drop;
+    } else if (mode == "coalesce") {
+      result.mode = rate_limiter::policy::coalesce;
+    } else if (mode.compare(0, 7, "sample/") == 0) {
+      double n;
+      if (!parse_double(mode.substr(7), n) || n < 1)
+        return false;
+      result.mode = rate_limiter::policy::sample;
+      result.sample_rate = static_cast<size_t>(n);
+    } else {
+      return false;
+    }
+  }
+  x = std::move(result);
+  return true;
+}
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,59 @@
+#include "broker/detail/record_sampler.hh"
+
+#include <cstdlib>
+#include <utility>
+
+#include "broker/logger.hh"
+
+namespace broker {
+namespace detail {
+
+record_sampler::record_sampler(size_t rate, std::vector<rule> rules)
+  : rate_(rate) {
+  rules_.reserve(rules.size());
+  for (auto& x : rules)
+    rules_.emplace_back(rule_state{std::move(x)});
+}
+
+bool record_sampler::select_slow(const topic& t) {
+  rule_state* match = nullptr;
+  for (auto& st : rules_)
+    if (st.config.prefix.prefix_of(t)
+        && (match == nullptr
+            || st.config.prefix.string().size()
+                 > match->config.prefix.string().size()))
+      match = &st;
+  if (match == nullptr)
+    return sample(rate_, seen_);
+  return sample(match->config.rate, match->seen);
+}
+
+bool convert(const std::string& str, record_sampler::rule& x) {
+  auto sep = str.rfind(':');
+  if (sep == std::string::npos || sep == 0 || sep + 1 == str.size())
+    return false;
+  auto num = str.c_str() + sep + 1;
+  char* end = nullptr;
+  auto rate = strtoull(num, &end, 10);
+  if (*end != '\0' || *num == '-')
+    return false;
+  x.prefix = topic{str.substr(0, sep)};
+  x.rate = static_cast<size_t>(rate);
+  return true;
+}
+
+record_sampler make_record_sampler(size_t rate,
+                                   const std::vector<std::string>& rules) {
+  std::vector<record_sampler::rule> xs;
+  for (auto& str : rules) {
+    record_sampler::rule x;
+    if (convert(str, x))
+      xs.emplace_back(std::move(x));
+    else
+      BROKER_WARNING("ignored invalid recording sample rule:" << str);
+  }
+  return record_sampler{rate, std::move(xs)};
+}
+
+} // namespace detail
+} // namespace broker
@@ -1,5 +1,17 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <rocksdb/cache.h>
 #include <rocksdb/db.h>
+#include <rocksdb/env.h>
+#include <rocksdb/filter_policy.h>
+#include <rocksdb/merge_operator.h>
 #include <rocksdb/options.h>
+#include <rocksdb/table.h>
+#include <rocksdb/utilities/checkpoint.h>
 
 #include "broker/logger.hh"
 
@@ -21,6 +33,23 @@ namespace detail {
 //   - 'm' for meta data
 //   - 'd' for application data
 //   - 'e' for expiration values
+//   - 'c' for the elements of sets and tables
+//
+// Sets and tables leave only a placeholder, i.e., the serialized empty
+// container, under their 'd' key and store one entry per element under the
+// 'c' key prefix of the same key. Since serialized keys delimit themselves,
+// all elements of a container form a contiguous range. Hence, lookups and
+// modifications of a single element only touch a single entry.
+//
+// With the backend option `merge-adds`, `add` writes the serialized pair of
+// initial type and operand as a merge operand instead of reading the current
+// value, and RocksDB applies the operands lazily via the `add_operator` on
+// reads and compactions.
+//
+// Meta data and application data live in the default column family, while
+// expiration values live in a separate column family. Hence, scanning all
+// expirations at startup does not touch the SST files with application data
+// and both column families get compacted independently.
 //
 namespace {
 
@@ -28,6 +57,7 @@ enum class prefix : char {
   meta = 'm',
   data = 'd',
   expiry = 'e',
+  member = 'c',
 };
 
 template <prefix P, class T, class... Ts>
@@ -42,53 +72,31 @@ data from_key_blob(const char* data, size_t size) {
   return from_blob<broker::data>(data + 1, size - 1);
 }
 
+template <class T>
+std::string to_value_blob(const T& x) {
+  auto buf = to_blob(x);
+  return std::string(buf.begin(), buf.end());
+}
+
 } // namespace <anonymous>
 
 struct rocksdb_backend::impl {
-  template <class Key, class Value>
-  bool put(const Key& key, const Value& value) {
-    if (!db)
-      return false;
-    auto status = db->Put({}, key, value);
-    if (!status.ok()) {
-      BROKER_ERROR("failed put key-value-pair:" << status.ToString());
-      return false;
-    }
-    return true;
-  }
-
-  template <class Key, class Value>
-  bool put(Key& key, const Value& value, optional<timestamp> expiry) {
-    if (!db)
-      return false;
-    rocksdb::WriteBatch batch;
-    batch.Put(key, value);
-    // Write expiry.
-    if (expiry) {
-      BROKER_ASSERT(key.size() > 1);
-      key[0] = static_cast<char>(prefix::expiry); // reuse key blob
-      auto blob = to_blob(*expiry);
-      batch.Put(key, blob);
-    }
-    auto status = db->Write({}, &batch);
-    if (!status.ok()) {
-      BROKER_ERROR("failed to put key-value pair:" << status.ToString());
-      return false;
-    }
-    return true;
-  }
+  class add_operator;
 
   template <class Key>
-  expected<std::string> get(const Key& key) {
+  expected<std::string> get(const Key& key,
+                            rocksdb::ColumnFamilyHandle* cf = nullptr) {
     if (!db)
       return ec::backend_failure;
+    if (cf == nullptr)
+      cf = db->DefaultColumnFamily();
     std::string value;
     bool exists;
-    if (!db->KeyMayExist({}, key, &value, &exists))
+    if (!db->KeyMayExist({}, cf, key, &value, &exists))
       return ec::no_such_key;
     if (exists)
       return value;
-    auto status = db->Get(rocksdb::ReadOptions{}, key, &value);
+    auto status = db->Get(rocksdb::ReadOptions{}, cf, key, &value);
     if (status.IsNotFound())
       return ec::no_such_key;
     if (!status.ok()) {
@@ -121,6 +129,203 @@ struct rocksdb_backend::impl {
     return true;
   }
 
+  /// Describes how the default column family holds the value for a key.
+  enum class layout {
+    /// The store has no such key.
+    absent,
+    /// The data entry contains the entire value.
+    blob,
+    /// The value is a set with one member entry per element.
+    set,
+    /// The value is a table with one member entry per key-value pair.
+    table,
+  };
+
+  /// Returns whether `value` keeps its elements in member entries.
+  static bool decomposed(const data& value) {
+    return caf::holds_alternative<broker::set>(value)
+           || caf::holds_alternative<broker::table>(value);
+  }
+
+  /// Returns the data entry for a set or table, i.e., the serialized empty
+  /// container of the same type.
+  static const std::string& placeholder(data::type type) {
+    static const auto set_blob = to_value_blob(data{broker::set{}});
+    static const auto table_blob = to_value_blob(data{broker::table{}});
+    return type == data::type::set ? set_blob : table_blob;
+  }
+
+  /// Returns the layout for the data entry `value`.
+  static layout classify(const rocksdb::Slice& value) {
+    if (value == placeholder(data::type::set))
+      return layout::set;
+    if (value == placeholder(data::type::table))
+      return layout::table;
+    return layout::blob;
+  }
+
+  /// Returns the layout for the value of `key_blob`.
+  expected<layout> stored_layout(const std::string& key_blob) {
+    auto value = get(key_blob);
+    if (value)
+      return classify(*value);
+    if (value.error() == ec::no_such_key)
+      return layout::absent;
+    return std::move(value.error());
+  }
+
+  /// Returns the common prefix of all member entries for `key_blob`.
+  static std::string member_prefix(const std::string& key_blob) {
+    BROKER_ASSERT(key_blob.size() > 1);
+    auto result = key_blob;
+    result[0] = static_cast<char>(prefix::member);
+    return result;
+  }
+
+  /// Returns the key of the member entry for `member`.
+  static std::string member_key(const std::string& key_blob,
+                                const data& member) {
+    auto result = member_prefix(key_blob);
+    auto member_blob = to_blob(member);
+    result.append(member_blob.begin(), member_blob.end());
+    return result;
+  }
+
+  /// Adds the member entry for a set element or table entry to `batch`. Set
+  /// elements have an empty value.
+  static void put_member(rocksdb::WriteBatch& batch,
+                         const std::string& key_blob, const data& member,
+                         const data* value) {
+    batch.Put(member_key(key_blob, member),
+              value ? to_value_blob(*value) : std::string{});
+  }
+
+  /// Adds the expiry for `key_blob` to `batch`.
+  void put_expiry(rocksdb::WriteBatch& batch, std::string key_blob,
+                  timestamp expiry) {
+    key_blob[0] = static_cast<char>(prefix::expiry);
+    batch.Put(expiries, key_blob, to_value_blob(expiry));
+  }
+
+  /// Calls `f` with the key suffix and the value of each member entry for
+  /// `key_blob`.
+  template <class F>
+  bool for_each_member(const std::string& key_blob, F f) {
+    auto pfx = member_prefix(key_blob);
+    auto i = std::unique_ptr<rocksdb::Iterator>{db->NewIterator(scan_options())};
+    for (i->Seek(pfx); i->Valid() && i->key().starts_with(pfx); i->Next())
+      f(i->key().data() + pfx.size(), i->key().size() - pfx.size(),
+        i->value());
+    if (!i->status().ok()) {
+      BROKER_ERROR("failed to read members:" << i->status().ToString());
+      return false;
+    }
+    return true;
+  }
+
+  /// Adds the removal of all member entries for `key_blob` to `batch`.
+  bool erase_members(rocksdb::WriteBatch& batch, const std::string& key_blob) {
+    auto pfx = member_prefix(key_blob);
+    return for_each_member(key_blob, [&](const char* member, size_t size,
+                                         const rocksdb::Slice&) {
+      batch.Delete(pfx + std::string(member, size));
+    });
+  }
+
+  /// Adds all writes for replacing the value of `key_blob` to `batch`.
+  bool put_value(rocksdb::WriteBatch& batch, const std::string& key_blob,
+                 const data& value, optional<timestamp> expiry) {
+    auto stored = stored_layout(key_blob);
+    if (!stored)
+      return false;
+    if ((*stored == layout::set || *stored == layout::table)
+        && !erase_members(batch, key_blob))
+      return false;
+    if (auto xs = caf::get_if<broker::set>(&value)) {
+      batch.Put(key_blob, placeholder(data::type::set));
+      for (auto& x : *xs)
+        put_member(batch, key_blob, x, nullptr);
+    } else if (auto xs = caf::get_if<broker::table>(&value)) {
+      batch.Put(key_blob, placeholder(data::type::table));
+      for (auto& kvp : *xs)
+        put_member(batch, key_blob, kvp.first, &kvp.second);
+    } else {
+      batch.Put(key_blob, to_value_blob(value));
+    }
+    if (expiry)
+      put_expiry(batch, key_blob, *expiry);
+    return true;
+  }
+
+  /// Adds the removal of the value for `key_blob` and its expiry to `batch`.
+  bool erase_value(rocksdb::WriteBatch& batch, std::string key_blob) {
+    if (!erase_members(batch, key_blob))
+      return false;
+    batch.Delete(key_blob);
+    key_blob[0] = static_cast<char>(prefix::expiry);
+    batch.Delete(expiries, key_blob);
+    return true;
+  }
+
+  /// Looks up a single element of a set or table. Returns whether a set
+  /// contains `member` or the value that a table maps `member` to.
+  expected<data> get_member(const std::string& key_blob, const data& member,
+                            layout kind) {
+    auto value = get(member_key(key_blob, member));
+    if (kind == layout::set) {
+      if (value)
+        return data{true};
+      if (value.error() == ec::no_such_key)
+        return data{false};
+      return std::move(value.error());
+    }
+    if (!value)
+      return std::move(value.error());
+    return from_blob<data>(*value);
+  }
+
+  /// Reassembles a set or table from its member entries. RocksDB visits
+  /// members in the order of their serialized form, which matches the order
+  /// of `data` for most types, so we insert at the end.
+  expected<data> get_members(const std::string& key_blob, layout kind) {
+    broker::set xs;
+    broker::table ys;
+    auto ok = for_each_member(key_blob, [&](const char* member, size_t size,
+                                            const rocksdb::Slice& value) {
+      auto x = from_blob<data>(member, size);
+      if (kind == layout::set)
+        xs.emplace_hint(xs.end(), std::move(x));
+      else
+        ys.emplace_hint(ys.end(), std::move(x),
+                        from_blob<data>(value.data(), value.size()));
+    });
+    if (!ok)
+      return ec::backend_failure;
+    if (kind == layout::set)
+      return data{std::move(xs)};
+    return data{std::move(ys)};
+  }
+
+  /// Decodes the data entry `value` for `key_blob`, reassembling sets and
+  /// tables from their member entries.
+  expected<data> decode_value(const std::string& key_blob,
+                              const rocksdb::Slice& value) {
+    auto kind = classify(value);
+    if (kind == layout::blob)
+      return from_blob<data>(value.data(), value.size());
+    return get_members(key_blob, kind);
+  }
+
+  /// Applies `batch` to the database.
+  bool write(rocksdb::WriteBatch& batch) {
+    auto status = db->Write({}, &batch);
+    if (!status.ok()) {
+      BROKER_ERROR("failed to write batch:" << status.ToString());
+      return false;
+    }
+    return true;
+  }
+
   template <class Key>
   expected<void> erase(const Key& key) {
     if (!db)
@@ -132,11 +337,139 @@ struct rocksdb_backend::impl {
     }
   }
 
+  /// Returns read options for iterating over a range of keys. Bypasses the
+  /// block cache and forces total order, since prefix-based indexes of the
+  /// point lookup profile could otherwise end iterations early.
+  static rocksdb::ReadOptions scan_options() {
+    rocksdb::ReadOptions opts;
+    opts.fill_cache = false;
+    opts.total_order_seek = true;
+    return opts;
+  }
+
+  /// Moves expiration values of databases created by previous versions from
+  /// the default column family to the expiries column family.
+  bool migrate_expiries() {
+    static const auto pfx = static_cast<char>(prefix::expiry);
+    rocksdb::WriteBatch batch;
+    auto i = std::unique_ptr<rocksdb::Iterator>{db->NewIterator(scan_options())};
+    for (i->Seek(rocksdb::Slice{&pfx, 1}); i->Valid() && i->key()[0] == pfx;
+         i->Next()) {
+      batch.Put(expiries, i->key(), i->value());
+      batch.Delete(i->key());
+    }
+    if (!i->status().ok()) {
+      BROKER_ERROR("failed to read legacy expiries:" << i->status().ToString());
+      return false;
+    }
+    if (batch.Count() == 0)
+      return true;
+    BROKER_INFO("migrating" << batch.Count() / 2 << "legacy expiries");
+    auto status = db->Write({}, &batch);
+    if (!status.ok()) {
+      BROKER_ERROR("failed to migrate expiries:" << status.ToString());
+      return false;
+    }
+    return true;
+  }
+
+  /// Releases all column family handles and closes the database.
+  void close() {
+    if (!db)
+      return;
+    if (expiries) {
+      db->DestroyColumnFamilyHandle(expiries);
+      expiries = nullptr;
+    }
+    delete db;
+    db = nullptr;
+  }
+
   rocksdb::DB* db = nullptr;
+  rocksdb::ColumnFamilyHandle* expiries = nullptr;
   count exact_size_threshold = 10000;
   std::string path;
+
+  // Tuning knobs, where 0 or empty selects the RocksDB default.
+  count block_cache_size = 0;
+  count bloom_bits_per_key = 0;
+  count write_buffer_size = 0;
+  count max_background_jobs = 0;
+  std::string compression;
+  bool point_lookup_profile = false;
+
+  /// Turns `add` into a blind write for values other than sets and tables.
+  bool merge_adds = false;
+};
+
+/// Applies the merge operands of `add` to the stored value. Operands that do
+/// not apply to the stored value leave it unchanged, since merges have no way
+/// of reporting errors back to the writer.
+class rocksdb_backend::impl::add_operator : public rocksdb::MergeOperator {
+public:
+  bool FullMergeV2(const MergeOperationInput& in,
+                   MergeOperationOutput* out) const override {
+    // Merges never touch the member entries of sets and tables.
+    if (in.existing_value != nullptr
+        && classify(*in.existing_value) != layout::blob) {
+      out->existing_operand = *in.existing_value;
+      return true;
+    }
+    optional<data> value;
+    if (in.existing_value != nullptr)
+      value = from_blob<data>(in.existing_value->data(),
+                              in.existing_value->size());
+    for (auto& operand : in.operand_list) {
+      auto x = from_blob<data>(operand.data(), operand.size());
+      auto args = caf::get_if<vector>(&x);
+      if (args == nullptr || args->size() != 2
+          || !caf::holds_alternative<count>(args->front())) {
+        BROKER_ERROR("invalid merge operand for" << in.key.ToString(true));
+        return false;
+      }
+      if (!value)
+        value = data::from_type(
+          static_cast<data::type>(caf::get<count>(args->front())));
+      if (!caf::visit(adder{args->back()}, *value))
+        BROKER_WARNING("dropped merge operand" << args->back()
+                       << "for value" << *value);
+    }
+    out->new_value = to_value_blob(*value);
+    return true;
+  }
+
+  const char* Name() const override {
+    return "broker.add";
+  }
+
+  /// Returns the merge operand for adding `value` with `init_type`.
+  static std::string make_operand(const data& value, data::type init_type) {
+    return to_value_blob(
+      data{vector{count{static_cast<count>(init_type)}, value}});
+  }
 };
 
+namespace {
+
+bool parse_compression(const std::string& name,
+                       rocksdb::CompressionType& result) {
+  static const std::pair<const char*, rocksdb::CompressionType> types[] = {
+    {"none", rocksdb::kNoCompression},
+    {"snappy", rocksdb::kSnappyCompression},
+    {"zlib", rocksdb::kZlibCompression},
+    {"lz4", rocksdb::kLZ4Compression},
+    {"zstd", rocksdb::kZSTD},
+  };
+  for (auto& type : types)
+    if (name == type.first) {
+      result = type.second;
+      return true;
+    }
+  return false;
+}
+
+} // namespace <anonymous>
+
 rocksdb_backend::rocksdb_backend(backend_options opts)
   : impl_{std::make_unique<impl>()} {
   // Parse required options.
@@ -155,6 +488,41 @@ rocksdb_backend::rocksdb_backend(backend_options opts)
     else
       BROKER_ERROR("exact-size-threshold must be of type count");
   }
+  auto get_count = [&](const char* name, count& dst) {
+    auto j = opts.find(name);
+    if (j == opts.end())
+      return;
+    if (auto val = caf::get_if<count>(&j->second))
+      dst = *val;
+    else
+      BROKER_ERROR(name << "must be of type count");
+  };
+  get_count("block-cache-size", impl_->block_cache_size);
+  get_count("bloom-bits-per-key", impl_->bloom_bits_per_key);
+  get_count("write-buffer-size", impl_->write_buffer_size);
+  get_count("max-background-jobs", impl_->max_background_jobs);
+  i = opts.find("compression");
+  if (i != opts.end()) {
+    if (auto compression = caf::get_if<std::string>(&i->second))
+      impl_->compression = *compression;
+    else
+      BROKER_ERROR("compression must be of type string");
+  }
+  i = opts.find("profile");
+  if (i != opts.end()) {
+    auto profile = caf::get_if<std::string>(&i->second);
+    if (profile && *profile == "point-lookup")
+      impl_->point_lookup_profile = true;
+    else
+      BROKER_ERROR("profile must be \"point-lookup\"");
+  }
+  i = opts.find("merge-adds");
+  if (i != opts.end()) {
+    if (auto merge_adds = caf::get_if<bool>(&i->second))
+      impl_->merge_adds = *merge_adds;
+    else
+      BROKER_ERROR("merge-adds must be of type bool");
+  }
 
   open_db();
 }
@@ -171,18 +539,63 @@ bool rocksdb_backend::open_db() {
 
   rocksdb::Options rocks_opts;
   rocks_opts.create_if_missing = true;
-  auto status = rocksdb::DB::Open(rocks_opts, impl_->path.c_str(), &impl_->db);
+  if (impl_->point_lookup_profile) {
+    // Configures a hash index, bloom filters, and a block cache of the given
+    // size in MB.
+    auto cache_mb = impl_->block_cache_size > 0
+                      ? std::max(impl_->block_cache_size >> 20, count{1})
+                      : count{64};
+    rocks_opts.OptimizeForPointLookup(cache_mb);
+  } else if (impl_->block_cache_size > 0 || impl_->bloom_bits_per_key > 0) {
+    rocksdb::BlockBasedTableOptions table_opts;
+    if (impl_->block_cache_size > 0)
+      table_opts.block_cache = rocksdb::NewLRUCache(impl_->block_cache_size);
+    if (impl_->bloom_bits_per_key > 0)
+      table_opts.filter_policy.reset(rocksdb::NewBloomFilterPolicy(
+        static_cast<int>(impl_->bloom_bits_per_key), false));
+    rocks_opts.table_factory.reset(
+      rocksdb::NewBlockBasedTableFactory(table_opts));
+  }
+  if (impl_->write_buffer_size > 0)
+    rocks_opts.write_buffer_size = impl_->write_buffer_size;
+  if (impl_->max_background_jobs > 0)
+    rocks_opts.max_background_jobs
+      = static_cast<int>(impl_->max_background_jobs);
+  if (!impl_->compression.empty()
+      && !parse_compression(impl_->compression, rocks_opts.compression))
+    BROKER_ERROR("unknown compression algorithm:" << impl_->compression
+                                                  << "(using default)");
+  // Databases may contain merge operands from previous runs, so we always
+  // install the operator regardless of `merge_adds`.
+  rocks_opts.merge_operator = std::make_shared<impl::add_operator>();
+  rocks_opts.create_missing_column_families = true;
+  rocksdb::ColumnFamilyOptions cf_opts{rocks_opts};
+  std::vector<rocksdb::ColumnFamilyDescriptor> column_families{
+    {rocksdb::kDefaultColumnFamilyName, cf_opts},
+    {"expiries", cf_opts},
+  };
+  std::vector<rocksdb::ColumnFamilyHandle*> handles;
+  auto status = rocksdb::DB::Open(rocksdb::DBOptions{rocks_opts},
+                                  impl_->path, column_families, &handles,
+                                  &impl_->db);
   if (!status.ok()) {
     BROKER_ERROR("failed to open DB:" << status.ToString());
     impl_->db = nullptr;
     return false;
   }
+  // We only keep the handle for the expiries. The database owns the handle
+  // for the default column family.
+  impl_->db->DestroyColumnFamilyHandle(handles[0]);
+  impl_->expiries = handles[1];
+  if (!impl_->migrate_expiries()) {
+    impl_->close();
+    return false;
+  }
   // Check/write the broker version.
   status = impl_->db->Put({}, "mbroker_version", version::string());
   if (!status.ok()) {
     BROKER_ERROR("failed to open DB:" << status.ToString());
-    delete impl_->db;
-    impl_->db = nullptr;
+    impl_->close();
     return false;
   }
 
@@ -190,17 +603,31 @@ bool rocksdb_backend::open_db() {
 }
 
 rocksdb_backend::~rocksdb_backend() {
-  if (impl_->db)
-    delete impl_->db;
+  impl_->close();
 }
 
 expected<void> rocksdb_backend::put(const data& key, data value,
                                     optional<timestamp> expiry) {
   if (!impl_->db)
     return ec::backend_failure;
-  auto key_blob = to_key_blob<prefix::data>(key);
-  auto value_blob = to_blob(value);
-  if (!impl_->put(key_blob, value_blob, expiry))
+  rocksdb::WriteBatch batch;
+  if (!impl_->put_value(batch, to_key_blob<prefix::data>(key), value, expiry)
+      || !impl_->write(batch))
+    return ec::backend_failure;
+  return {};
+}
+
+expected<void>
+rocksdb_backend::put_many(const std::unordered_map<data, data>& entries,
+                          optional<timestamp> expiry) {
+  if (!impl_->db)
+    return ec::backend_failure;
+  rocksdb::WriteBatch batch;
+  for (auto& kvp : entries)
+    if (!impl_->put_value(batch, to_key_blob<prefix::data>(kvp.first),
+                          kvp.second, expiry))
+      return ec::backend_failure;
+  if (!impl_->write(batch))
     return ec::backend_failure;
   return {};
 }
@@ -208,36 +635,92 @@ expected<void> rocksdb_backend::put(const data& key, data value,
 expected<void> rocksdb_backend::add(const data& key, const data& value,
                                     data::type init_type,
                                     optional<timestamp> expiry) {
+  if (!impl_->db)
+    return ec::backend_failure;
   auto key_blob = to_key_blob<prefix::data>(key);
+  if (impl_->merge_adds && init_type != data::type::set
+      && init_type != data::type::table) {
+    // Write without reading the current value.
+    rocksdb::WriteBatch batch;
+    batch.Merge(key_blob, impl::add_operator::make_operand(value, init_type));
+    if (expiry)
+      impl_->put_expiry(batch, key_blob, *expiry);
+    if (!impl_->write(batch))
+      return ec::backend_failure;
+    return {};
+  }
   auto value_blob = impl_->get(key_blob);
+  if (!value_blob && value_blob.error() != ec::no_such_key)
+    return value_blob.error();
+  auto kind = !value_blob ? impl::layout::absent : impl::classify(*value_blob);
+  auto absent = kind == impl::layout::absent;
+  if (absent && init_type == data::type::set)
+    kind = impl::layout::set;
+  else if (absent && init_type == data::type::table)
+    kind = impl::layout::table;
+  if (kind == impl::layout::set || kind == impl::layout::table) {
+    // Write a single member entry instead of rewriting the entire container.
+    auto member = &value;
+    const data* member_value = nullptr;
+    if (kind == impl::layout::table) {
+      // Table entries come as key-value pairs, see the adder.
+      auto kvp = caf::get_if<vector>(&value);
+      if (!kvp)
+        return ec::type_clash;
+      if (kvp->size() != 2)
+        return ec::invalid_data;
+      member = &kvp->front();
+      member_value = &kvp->back();
+    }
+    rocksdb::WriteBatch batch;
+    if (absent)
+      batch.Put(key_blob, impl::placeholder(init_type));
+    impl::put_member(batch, key_blob, *member, member_value);
+    if (expiry)
+      impl_->put_expiry(batch, key_blob, *expiry);
+    if (!impl_->write(batch))
+      return ec::backend_failure;
+    return {};
+  }
   broker::data v;
-  if (!value_blob) {
-    if (value_blob.error() != ec::no_such_key)
-      return value_blob.error();
+  if (absent)
     v = data::from_type(init_type);
-  } else {
+  else
     v = from_blob<data>(*value_blob);
-  }
   auto result = caf::visit(adder{value}, v);
   if (!result)
     return result;
-  if (!impl_->put(key_blob, to_blob(v), expiry))
+  rocksdb::WriteBatch batch;
+  if (!impl_->put_value(batch, key_blob, v, expiry) || !impl_->write(batch))
     return ec::backend_failure;
   return {};
 }
 
 expected<void> rocksdb_backend::subtract(const data& key, const data& value,
                                          optional<timestamp> expiry) {
+  if (!impl_->db)
+    return ec::backend_failure;
   auto key_blob = to_key_blob<prefix::data>(key);
   auto value_blob = impl_->get(key_blob);
   if (!value_blob)
     return value_blob.error();
+  rocksdb::WriteBatch batch;
+  auto kind = impl::classify(*value_blob);
+  if (kind == impl::layout::set || kind == impl::layout::table) {
+    batch.Delete(impl::member_key(key_blob, value));
+    if (expiry)
+      impl_->put_expiry(batch, key_blob, *expiry);
+    if (!impl_->write(batch))
+      return ec::backend_failure;
+    return {};
+  }
   auto v = from_blob<data>(*value_blob);
   auto result = caf::visit(remover{value}, v);
   if (!result)
     return result;
-  *value_blob = to_blob(v);
-  if (!impl_->put(key_blob, *value_blob, expiry))
+  // Sets and tables from databases prior to the member entries end up here
+  // once and get converted to the new layout.
+  if (!impl_->put_value(batch, key_blob, v, expiry) || !impl_->write(batch))
     return ec::backend_failure;
   return {};
 }
@@ -246,15 +729,21 @@ expected<void> rocksdb_backend::erase(const data& key) {
   if (!impl_->db)
     return ec::backend_failure;
   rocksdb::WriteBatch batch;
-  auto key_blob = to_key_blob<prefix::data>(key);
-  batch.Delete(key_blob);
-  key_blob[0] = static_cast<char>(prefix::expiry);
-  batch.Delete(key_blob);
-  auto status = impl_->db->Write({}, &batch);
-  if (!status.ok()) {
-    BROKER_ERROR("failed to delete key:" << status.ToString());
+  if (!impl_->erase_value(batch, to_key_blob<prefix::data>(key))
+      || !impl_->write(batch))
+    return ec::backend_failure;
+  return {};
+}
+
+expected<void> rocksdb_backend::erase_many(const std::vector<data>& keys) {
+  if (!impl_->db)
+    return ec::backend_failure;
+  rocksdb::WriteBatch batch;
+  for (auto& key : keys)
+    if (!impl_->erase_value(batch, to_key_blob<prefix::data>(key)))
+      return ec::backend_failure;
+  if (!impl_->write(batch))
     return ec::backend_failure;
-  }
   return {};
 }
 
@@ -262,8 +751,7 @@ expected<void> rocksdb_backend::clear() {
   if (!impl_->db)
     return ec::backend_failure;
   std::string path = impl_->path;
-  delete impl_->db;
-  impl_->db = nullptr;
+  impl_->close();
   auto status = rocksdb::DestroyDB(path.c_str(), rocksdb::Options());
   if (!status.ok()) {
     BROKER_ERROR("failed to destroy DB:" << status.ToString());
@@ -278,7 +766,7 @@ expected<void> rocksdb_backend::clear() {
 
 expected<bool> rocksdb_backend::expire(const data& key, timestamp ts) {
   auto key_blob = to_key_blob<prefix::expiry>(key);
-  auto expiry_blob = impl_->get(key_blob);
+  auto expiry_blob = impl_->get(key_blob, impl_->expiries);
   if (!expiry_blob) {
     if (expiry_blob == ec::no_such_key)
       return false;
@@ -288,36 +776,135 @@ expected<bool> rocksdb_backend::expire(const data& key, timestamp ts) {
   if (ts < expiry)
     return false;
   rocksdb::WriteBatch batch;
-  batch.Delete(key_blob);
   key_blob[0] = static_cast<char>(prefix::data);
-  batch.Delete(key_blob);
-  auto status = impl_->db->Write({}, &batch);
-  if (!status.ok()) {
-    BROKER_ERROR("failed to delete key:" << status.ToString());
+  if (!impl_->erase_value(batch, std::move(key_blob)) || !impl_->write(batch))
     return ec::backend_failure;
-  }
   return true;
 }
 
 expected<data> rocksdb_backend::get(const data& key) const {
-  auto value_blob = impl_->get(to_key_blob<prefix::data>(key));
+  auto key_blob = to_key_blob<prefix::data>(key);
+  auto value_blob = impl_->get(key_blob);
+  if (!value_blob)
+    return value_blob.error();
+  return impl_->decode_value(key_blob, *value_blob);
+}
+
+expected<data> rocksdb_backend::get(const data& key, const data& aspect) const {
+  auto key_blob = to_key_blob<prefix::data>(key);
+  auto value_blob = impl_->get(key_blob);
   if (!value_blob)
     return value_blob.error();
-  return from_blob<data>(*value_blob);
+  auto kind = impl::classify(*value_blob);
+  if (kind == impl::layout::set || kind == impl::layout::table)
+    return impl_->get_member(key_blob, aspect, kind);
+  auto v = from_blob<data>(*value_blob);
+  return caf::visit(retriever{aspect}, v);
+}
+
+expected<data>
+rocksdb_backend::get_many(const std::vector<data>& keys) const {
+  if (!impl_->db)
+    return ec::backend_failure;
+  std::vector<std::string> key_blobs;
+  key_blobs.reserve(keys.size());
+  for (auto& key : keys)
+    key_blobs.emplace_back(to_key_blob<prefix::data>(key));
+  std::vector<rocksdb::Slice> slices{key_blobs.begin(), key_blobs.end()};
+  std::vector<std::string> values;
+  auto statuses = impl_->db->MultiGet(rocksdb::ReadOptions{}, slices, &values);
+  table result;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (statuses[i].IsNotFound())
+      continue;
+    if (!statuses[i].ok()) {
+      BROKER_ERROR("failed to lookup value:" << statuses[i].ToString());
+      return ec::backend_failure;
+    }
+    auto value = impl_->decode_value(key_blobs[i], values[i]);
+    if (!value)
+      return value;
+    result.emplace(keys[i], std::move(*value));
+  }
+  return {std::move(result)};
+}
+
+expected<data> rocksdb_backend::scan(const std::string& prefix,
+                                     size_t limit) const {
+  if (!impl_->db)
+    return ec::backend_failure;
+  table result;
+  auto opts = impl::scan_options();
+  auto i = std::unique_ptr<rocksdb::Iterator>{impl_->db->NewIterator(opts)};
+  // Serialized keys start with their type tag, i.e., all string keys are
+  // adjacent and start at the serialized empty string. The serialization
+  // format encodes the length of a string before its characters, so we still
+  // need to check the prefix after decoding.
+  auto first = to_key_blob<prefix::data>(data{std::string{}});
+  auto tag = first[1];
+  i->Seek(first);
+  while (i->Valid() && i->key().size() > 1 && i->key()[0] == first[0]
+         && i->key()[1] == tag) {
+    auto key = from_key_blob<prefix::data>(i->key().data(), i->key().size());
+    if (has_prefix(key, prefix)) {
+      auto value = impl_->decode_value(i->key().ToString(), i->value());
+      if (!value)
+        return value;
+      result.emplace_hint(result.end(), std::move(key), std::move(*value));
+      if (result.size() == limit)
+        break;
+    }
+    i->Next();
+  }
+  if (!i->status().ok()) {
+    BROKER_ERROR("failed to scan keys:" << i->status().ToString());
+    return ec::backend_failure;
+  }
+  return {std::move(result)};
+}
+
+expected<optional<data>>
+rocksdb_backend::scan(const optional<data>& start, size_t batch_size,
+                      const scan_callback& f) const {
+  if (!impl_->db)
+    return ec::backend_failure;
+  auto opts = impl::scan_options();
+  auto i = std::unique_ptr<rocksdb::Iterator>{impl_->db->NewIterator(opts)};
+  static const auto pfx = static_cast<char>(prefix::data);
+  if (start)
+    i->Seek(to_key_blob<prefix::data>(*start));
+  else
+    i->Seek(rocksdb::Slice{&pfx, 1}); // initializes iterator
+  scan_batcher batcher{batch_size, f};
+  while (i->Valid() && i->key()[0] == pfx) {
+    auto key = from_key_blob<prefix::data>(i->key().data(), i->key().size());
+    if (!batcher.flush_if_full())
+      return optional<data>{std::move(key)};
+    auto value = impl_->decode_value(i->key().ToString(), i->value());
+    if (!value)
+      return std::move(value.error());
+    batcher.push(std::move(key), std::move(*value));
+    i->Next();
+  }
+  if (!i->status().ok()) {
+    BROKER_ERROR("failed to scan entries:" << i->status().ToString());
+    return ec::backend_failure;
+  }
+  batcher.finish();
+  return optional<data>{};
 }
 
 expected<data> rocksdb_backend::keys() const {
   if (!impl_->db)
     return ec::backend_failure;
   set result;
-  rocksdb::ReadOptions opts;
-  opts.fill_cache = false;
+  auto opts = impl::scan_options();
   auto i = std::unique_ptr<rocksdb::Iterator>{impl_->db->NewIterator(opts)};
   static const auto pfx = static_cast<char>(prefix::data);
   i->Seek(rocksdb::Slice{&pfx, 1}); // initializes iterator
   while (i->Valid() && i->key()[0] == pfx) {
     auto key = from_key_blob<prefix::data>(i->key().data(), i->key().size());
-    result.insert(std::move(key));
+    result.emplace_hint(result.end(), std::move(key));
     i->Next();
   }
   if (!i->status().ok()) {
@@ -340,8 +927,7 @@ expected<uint64_t> rocksdb_backend::size() const {
   if (result > impl_->exact_size_threshold)
     return result;
   result = 0;
-  rocksdb::ReadOptions opts;
-  opts.fill_cache = false;
+  auto opts = impl::scan_options();
   auto i = std::unique_ptr<rocksdb::Iterator>{impl_->db->NewIterator(opts)};
   static const auto data_prefix = static_cast<char>(prefix::data);
   i->Seek(rocksdb::Slice{&data_prefix, 1}); // initializes iterator
@@ -360,15 +946,16 @@ expected<snapshot> rocksdb_backend::snapshot() const {
   if (!impl_->db)
     return ec::backend_failure;
   broker::snapshot result;
-  rocksdb::ReadOptions opts;
-  opts.fill_cache = false;
+  auto opts = impl::scan_options();
   auto i = std::unique_ptr<rocksdb::Iterator>{impl_->db->NewIterator(opts)};
   static const auto pfx = static_cast<char>(prefix::data);
   i->Seek(rocksdb::Slice{&pfx, 1}); // initializes iterator
   while (i->Valid() && i->key()[0] == pfx) {
     auto key = from_key_blob<prefix::data>(i->key().data(), i->key().size());
-    auto value = from_blob<data>(i->value().data(), i->value().size());
-    result.emplace(std::move(key), std::move(value));
+    auto value = impl_->decode_value(i->key().ToString(), i->value());
+    if (!value)
+      return std::move(value.error());
+    result.emplace(std::move(key), std::move(*value));
     i->Next();
   }
   if (!i->status().ok()) {
@@ -382,9 +969,9 @@ expected<expirables> rocksdb_backend::expiries() const {
   if (!impl_->db)
     return ec::backend_failure;
   expirables result;
-  rocksdb::ReadOptions opts;
-  opts.fill_cache = false;
-  auto i = std::unique_ptr<rocksdb::Iterator>{impl_->db->NewIterator(opts)};
+  auto opts = impl::scan_options();
+  auto i = std::unique_ptr<rocksdb::Iterator>{
+    impl_->db->NewIterator(opts, impl_->expiries)};
   static const auto pfx = static_cast<char>(prefix::expiry);
   i->Seek(rocksdb::Slice{&pfx, 1}); // initializes iterator
   while (i->Valid() && i->key()[0] == pfx) {
@@ -401,5 +988,34 @@ expected<expirables> rocksdb_backend::expiries() const {
   return {std::move(result)};
 }
 
+expected<std::vector<std::string>>
+rocksdb_backend::checkpoint(const std::string& path) {
+  if (!impl_->db)
+    return ec::backend_failure;
+  auto dir = detail::dirname(path);
+  if (!dir.empty() && !detail::is_directory(dir) && !detail::mkdirs(dir))
+    return make_error(ec::cannot_write_file, path);
+  rocksdb::Checkpoint* ptr = nullptr;
+  auto status = rocksdb::Checkpoint::Create(impl_->db, &ptr);
+  std::unique_ptr<rocksdb::Checkpoint> cp{ptr};
+  if (status.ok())
+    status = cp->CreateCheckpoint(path);
+  if (!status.ok()) {
+    BROKER_ERROR("failed to create checkpoint:" << status.ToString());
+    return ec::backend_failure;
+  }
+  std::vector<std::string> children;
+  status = rocksdb::Env::Default()->GetChildren(path, &children);
+  if (!status.ok()) {
+    BROKER_ERROR("failed to list checkpoint:" << status.ToString());
+    return ec::backend_failure;
+  }
+  std::vector<std::string> result;
+  for (auto& child : children)
+    if (child != "." && child != "..")
+      result.emplace_back(path + '/' + child);
+  return result;
+}
+
 } // namespace detail
 } // namespace broker
@@ -1,6 +1,10 @@
 #include "broker/logger.hh"
 
+#include <chrono>
 #include <cstdio> // std::snprintf
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
 #include <utility>
 #include <cstdint>
 #include <set>
@@ -30,10 +34,82 @@ auto make_statement_guard = [](sqlite3_stmt* stmt) {
   return caf::detail::make_scope_guard([=] { sqlite3_reset(stmt); });
 };
 
+/// Returns the serialized empty string, i.e., the smallest blob of all string
+/// keys. Since serialized keys start with the type tag, all string keys are in
+/// the half-open range from this blob to the next type tag.
+const std::vector<char>& min_string_key_blob() {
+  static const auto blob = to_blob(data{std::string{}});
+  return blob;
+}
+
+/// Returns the string option `name` if present and contained in `allowed`.
+const char* get_pragma_option(const backend_options& opts, const char* name,
+                              std::initializer_list<const char*> allowed) {
+  auto i = opts.find(name);
+  if (i == opts.end())
+    return nullptr;
+  if (auto str = caf::get_if<std::string>(&i->second))
+    for (auto value : allowed)
+      if (*str == value)
+        return value;
+  BROKER_ERROR("invalid value for SQLite option" << name);
+  return nullptr;
+}
+
+/// Returns `n` copies of `row`, separated by commas.
+std::string repeat_row(const char* row, size_t n) {
+  std::string result;
+  for (size_t i = 0; i < n; ++i) {
+    if (i > 0)
+      result += ", ";
+    result += row;
+  }
+  return result;
+}
+
+/// Collects the (key, expiry) rows of `stmt`.
+expected<expirables> collect_expiries(sqlite3_stmt* stmt) {
+  expirables rval;
+  auto result = SQLITE_DONE;
+
+  while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+    auto key = from_blob<data>(sqlite3_column_blob(stmt, 0),
+                               sqlite3_column_bytes(stmt, 0));
+    auto expiry_count = sqlite3_column_int64(stmt, 1);
+    auto duration = timespan(expiry_count);
+    auto expiry = timestamp(duration);
+    auto e = expirable(std::move(key), std::move(expiry));
+    rval.emplace_back(std::move(e));
+  }
+
+  if (result == SQLITE_DONE)
+    return {std::move(rval)};
+
+  return ec::backend_failure;
+}
+
 } // namespace <anonymous>
 
 struct sqlite_backend::impl {
+  using blob_type = caf::binary_serializer::container_type;
+
+  /// Number of rows per bulk statement. Stays well below the default limit of
+  /// 999 parameters per statement.
+  static constexpr size_t bulk_rows = 64;
+
   impl(backend_options opts) : options{std::move(opts)} {
+    auto get_count = [&](const char* name, count fallback) {
+      auto i = options.find(name);
+      if (i != options.end())
+        if (auto val = caf::get_if<count>(&i->second))
+          return *val;
+      return fallback;
+    };
+    batch_size = get_count("batch_size", 0);
+    batch_interval = std::chrono::milliseconds{get_count("batch_ms", 10)};
+    if (auto i = options.find("read_only"); i != options.end())
+      if (auto val = caf::get_if<bool>(&i->second))
+        read_only = *val;
     auto i = options.find("path");
     if (i == options.end()) {
       BROKER_ERROR("no path found in backend options");
@@ -50,6 +126,8 @@ struct sqlite_backend::impl {
   ~impl() {
     if (!db)
       return;
+    // Write pending modifications to disk.
+    commit();
     // Deallocate prepared statements.
     for (auto stmt : finalize)
       sqlite3_finalize(stmt);
@@ -59,6 +137,8 @@ struct sqlite_backend::impl {
 
   bool open(const std::string& path) {
     BROKER_TRACE(BROKER_ARG(path));
+    if (read_only)
+      return open_read_only(path);
 
     auto dir = detail::dirname(path);
     if ( ! dir.empty() ) {
@@ -78,6 +158,30 @@ struct sqlite_backend::impl {
       BROKER_ERROR("failed to open database:" << path);
       return false;
     }
+    // Apply optional tuning knobs.
+    auto apply_pragma = [&](const char* name,
+                            std::initializer_list<const char*> allowed) {
+      auto value = get_pragma_option(options, name, allowed);
+      if (!value)
+        return true;
+      char tmp[64];
+      std::snprintf(tmp, sizeof(tmp), "pragma %s=%s;", name, value);
+      return sqlite3_exec(db, tmp, nullptr, nullptr, nullptr) == SQLITE_OK;
+    };
+    if (!apply_pragma("journal_mode", {"delete", "truncate", "persist",
+                                       "memory", "wal", "off"})
+        || !apply_pragma("synchronous", {"off", "normal", "full", "extra"})) {
+      BROKER_ERROR("failed to apply SQLite pragmas");
+      return false;
+    }
+    // The members table relies on a delete trigger, which SQLite only fires
+    // for rows that a REPLACE removes if recursive triggers are enabled.
+    result = sqlite3_exec(db, "pragma recursive_triggers = on;", nullptr,
+                          nullptr, nullptr);
+    if (result != SQLITE_OK) {
+      BROKER_ERROR("failed to enable recursive triggers");
+      return false;
+    }
     // Create table for store meta data.
     result = sqlite3_exec(db,
                           "create table if not exists "
@@ -96,6 +200,8 @@ struct sqlite_backend::impl {
       BROKER_ERROR("failed to create store table");
       return false;
     }
+    if (!migrate())
+      return false;
     // Store Broker version in meta table.
     char tmp[128];
     std::snprintf(tmp, sizeof(tmp),
@@ -108,9 +214,16 @@ struct sqlite_backend::impl {
       return false;
     }
     // Prepare statements.
+    auto replace_bulk_sql = "replace into store(key, value, expiry) values "
+                            + repeat_row("(?, ?, ?)", bulk_rows) + ";";
+    auto erase_bulk_sql = "delete from store where key in ("
+                          + repeat_row("?", bulk_rows) + ");";
     std::vector<std::pair<sqlite3_stmt**, const char*>> statements{
+      {&replace_bulk, replace_bulk_sql.c_str()},
+      {&erase_bulk, erase_bulk_sql.c_str()},
       {&replace, "replace into store(key, value, expiry) values(?, ?, ?);"},
       {&update, "update store set value = ?, expiry = ? where key = ?;"},
+      {&update_expiry, "update store set expiry = ? where key = ?;"},
       {&erase, "delete from store where key = ?;"},
       {&expire, "delete from store where key = ? and expiry <= ?;"},
 
@@ -119,8 +232,19 @@ struct sqlite_backend::impl {
       {&size, "select count(*) from store;"},
       {&snapshot, "select key, value from store;"},
       {&expiries, "select key, expiry from store where expiry is not null;"},
+      {&expiries_between,
+       "select key, expiry from store where expiry > ? and expiry <= ?;"},
       {&clear, "delete from store;"},
       {&keys, "select key from store;"},
+      {&scan, "select key, value from store where key >= ? and key < ?;"},
+      {&scan_from,
+       "select key, value from store where key >= ? order by key;"},
+      {&member_replace,
+       "replace into members(key, member, value) values(?, ?, ?);"},
+      {&member_erase, "delete from members where key = ? and member = ?;"},
+      {&member_lookup,
+       "select value from members where key = ? and member = ?;"},
+      {&members_of, "select member, value from members where key = ?;"},
     };
     auto prepare = [&](sqlite3_stmt** stmt, const char* sql) {
       finalize.push_back(*stmt);
@@ -134,6 +258,373 @@ struct sqlite_backend::impl {
     return true;
   }
 
+  /// Opens an existing database without touching its schema or content.
+  bool open_read_only(const std::string& path) {
+    BROKER_LSAN_DISABLE();
+    auto result = sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY,
+                                  nullptr);
+    BROKER_LSAN_ENABLE();
+    if (result != SQLITE_OK) {
+      sqlite3_close(db);
+      db = nullptr;
+      BROKER_ERROR("failed to open database read-only:" << path);
+      return false;
+    }
+    // Readers may still see SQLITE_BUSY briefly, e.g., while the writer
+    // restarts the write-ahead log.
+    sqlite3_busy_timeout(db, 1000);
+    std::vector<std::pair<sqlite3_stmt**, const char*>> statements{
+      {&lookup, "select value from store where key = ?;"},
+      {&exists, "select 1 from store where key = ?;"},
+      {&size, "select count(*) from store;"},
+      {&snapshot, "select key, value from store;"},
+      {&expiries, "select key, expiry from store where expiry is not null;"},
+      {&expiries_between,
+       "select key, expiry from store where expiry > ? and expiry <= ?;"},
+      {&keys, "select key from store;"},
+      {&scan, "select key, value from store where key >= ? and key < ?;"},
+      {&scan_from,
+       "select key, value from store where key >= ? order by key;"},
+      {&member_lookup,
+       "select value from members where key = ? and member = ?;"},
+      {&members_of, "select member, value from members where key = ?;"},
+    };
+    for (auto& stmt : statements) {
+      if (sqlite3_prepare_v2(db, stmt.second, -1, stmt.first, nullptr)
+          != SQLITE_OK) {
+        BROKER_ERROR("failed to prepare statement:" << stmt.second);
+        return false;
+      }
+      finalize.push_back(*stmt.first);
+    }
+    return true;
+  }
+
+  /// Returns the current journal mode of the database.
+  std::string journal_mode() {
+    std::string result;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "pragma journal_mode;", -1, &stmt, nullptr)
+        != SQLITE_OK)
+      return result;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+      if (auto str = sqlite3_column_text(stmt, 0))
+        result = reinterpret_cast<const char*>(str);
+    sqlite3_finalize(stmt);
+    return result;
+  }
+
+  /// Brings the schema of the database up to date. The meta table stores the
+  /// version of the schema, whereas databases without this entry have
+  /// version 0.
+  bool migrate() {
+    // Each entry upgrades the schema from its index to the next version.
+    static const char* migrations[] = {
+      // Version 1: allows scanning expiries without a full table scan.
+      "create index if not exists store_expiry on store(expiry) "
+      "where expiry is not null;",
+      // Version 2: stores the elements of sets and tables as individual rows.
+      "create table if not exists members"
+      "(key blob, member blob, value blob, primary key(key, member)) "
+      "without rowid;"
+      "create trigger if not exists members_cleanup after delete on store "
+      "begin delete from members where key = old.key; end;",
+    };
+    static constexpr int latest = static_cast<int>(std::size(migrations));
+    int version = 0;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db,
+                           "select value from meta "
+                           "where key = 'schema_version';",
+                           -1, &stmt, nullptr)
+        != SQLITE_OK) {
+      BROKER_ERROR("failed to read the schema version");
+      return false;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+      version = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    if (version > latest) {
+      BROKER_ERROR("database schema version" << version
+                                             << "is newer than supported");
+      return false;
+    }
+    if (version == latest)
+      return true;
+    if (sqlite3_exec(db, "begin transaction;", nullptr, nullptr, nullptr)
+        != SQLITE_OK)
+      return false;
+    for (auto i = version; i < latest; ++i) {
+      BROKER_INFO("migrating SQLite schema to version" << i + 1);
+      if (sqlite3_exec(db, migrations[i], nullptr, nullptr, nullptr)
+          != SQLITE_OK) {
+        BROKER_ERROR("failed to migrate SQLite schema to version" << i + 1);
+        sqlite3_exec(db, "rollback;", nullptr, nullptr, nullptr);
+        return false;
+      }
+    }
+    char tmp[128];
+    std::snprintf(tmp, sizeof(tmp),
+                  "replace into meta(key, value) "
+                  "values('schema_version', '%d');",
+                  latest);
+    if (sqlite3_exec(db, tmp, nullptr, nullptr, nullptr) != SQLITE_OK
+        || sqlite3_exec(db, "commit;", nullptr, nullptr, nullptr)
+             != SQLITE_OK) {
+      BROKER_ERROR("failed to store the schema version");
+      sqlite3_exec(db, "rollback;", nullptr, nullptr, nullptr);
+      return false;
+    }
+    return true;
+  }
+
+  /// Writes the next `bulk_rows` entries of `i`, which points to pointers to
+  /// key-value pairs, with a single statement and advances `i` accordingly.
+  template <class Iterator>
+  bool put_bulk(Iterator& i, optional<timestamp> expiry) {
+    // SQLITE_STATIC requires the blobs to outlive the statement execution.
+    std::vector<blob_type> blobs;
+    blobs.reserve(2 * bulk_rows);
+    auto guard = make_statement_guard(replace_bulk);
+    int col = 1;
+    for (size_t row = 0; row < bulk_rows; ++row, ++i) {
+      auto& key_blob = blobs.emplace_back(to_blob((*i)->first));
+      auto& value_blob = blobs.emplace_back(to_blob((*i)->second));
+      if (sqlite3_bind_blob64(replace_bulk, col++, key_blob.data(),
+                              key_blob.size(), SQLITE_STATIC)
+            != SQLITE_OK
+          || sqlite3_bind_blob64(replace_bulk, col++, value_blob.data(),
+                                 value_blob.size(), SQLITE_STATIC)
+               != SQLITE_OK)
+        return false;
+      auto result = expiry ? sqlite3_bind_int64(replace_bulk, col++,
+                                                expiry->time_since_epoch()
+                                                  .count())
+                           : sqlite3_bind_null(replace_bulk, col++);
+      if (result != SQLITE_OK)
+        return false;
+    }
+    return sqlite3_step(replace_bulk) == SQLITE_DONE;
+  }
+
+  /// Erases the next `bulk_rows` keys of `i` with a single statement and
+  /// advances `i` accordingly.
+  template <class Iterator>
+  bool erase_bulk_keys(Iterator& i) {
+    std::vector<blob_type> blobs;
+    blobs.reserve(bulk_rows);
+    auto guard = make_statement_guard(erase_bulk);
+    for (size_t row = 0; row < bulk_rows; ++row, ++i) {
+      auto& key_blob = blobs.emplace_back(to_blob(*i));
+      if (sqlite3_bind_blob64(erase_bulk, static_cast<int>(row + 1),
+                              key_blob.data(), key_blob.size(), SQLITE_STATIC)
+          != SQLITE_OK)
+        return false;
+    }
+    return sqlite3_step(erase_bulk) == SQLITE_DONE;
+  }
+
+  /// Describes how the store table holds the value for a key.
+  enum class layout {
+    /// The store has no such key.
+    absent,
+    /// The value column contains the entire value.
+    blob,
+    /// The value is a set with one row per element in the members table.
+    set,
+    /// The value is a table with one row per entry in the members table.
+    table,
+  };
+
+  /// Returns whether `value` keeps its elements in the members table.
+  static bool decomposed(const data& value) {
+    return caf::holds_alternative<broker::set>(value)
+           || caf::holds_alternative<broker::table>(value);
+  }
+
+  /// Returns the value column for a set or table, i.e., the serialized empty
+  /// container of the same type.
+  static const blob_type& placeholder(data::type type) {
+    static const auto set_blob = to_blob(data{broker::set{}});
+    static const auto table_blob = to_blob(data{broker::table{}});
+    return type == data::type::set ? set_blob : table_blob;
+  }
+
+  /// Returns the layout for the value column `value`.
+  static layout classify(const void* value, int value_size) {
+    auto matches = [&](data::type type) {
+      auto& blob = placeholder(type);
+      return static_cast<size_t>(value_size) == blob.size()
+             && std::memcmp(value, blob.data(), blob.size()) == 0;
+    };
+    if (matches(data::type::set))
+      return layout::set;
+    if (matches(data::type::table))
+      return layout::table;
+    return layout::blob;
+  }
+
+  /// Returns the layout for the value of `key_blob`.
+  expected<layout> stored_layout(const blob_type& key_blob) {
+    auto guard = make_statement_guard(lookup);
+    if (sqlite3_bind_blob64(lookup, 1, key_blob.data(), key_blob.size(),
+                            SQLITE_STATIC)
+        != SQLITE_OK)
+      return ec::backend_failure;
+    auto result = sqlite3_step(lookup);
+    if (result == SQLITE_DONE)
+      return layout::absent;
+    if (result != SQLITE_ROW)
+      return ec::backend_failure;
+    return classify(sqlite3_column_blob(lookup, 0),
+                    sqlite3_column_bytes(lookup, 0));
+  }
+
+  /// Writes a single row into the store table.
+  bool put_row(const blob_type& key_blob, const blob_type& value_blob,
+               optional<timestamp> expiry) {
+    auto guard = make_statement_guard(replace);
+    if (sqlite3_bind_blob64(replace, 1, key_blob.data(), key_blob.size(),
+                            SQLITE_STATIC)
+          != SQLITE_OK
+        || sqlite3_bind_blob64(replace, 2, value_blob.data(),
+                               value_blob.size(), SQLITE_STATIC)
+             != SQLITE_OK)
+      return false;
+    auto result = expiry ? sqlite3_bind_int64(replace, 3,
+                                              expiry->time_since_epoch()
+                                                .count())
+                         : sqlite3_bind_null(replace, 3);
+    return result == SQLITE_OK && sqlite3_step(replace) == SQLITE_DONE;
+  }
+
+  /// Changes the expiry of `key_blob` without touching its value.
+  bool set_expiry(const blob_type& key_blob, optional<timestamp> expiry) {
+    auto guard = make_statement_guard(update_expiry);
+    auto result = expiry ? sqlite3_bind_int64(update_expiry, 1,
+                                              expiry->time_since_epoch()
+                                                .count())
+                         : sqlite3_bind_null(update_expiry, 1);
+    return result == SQLITE_OK
+           && sqlite3_bind_blob64(update_expiry, 2, key_blob.data(),
+                                  key_blob.size(), SQLITE_STATIC)
+                == SQLITE_OK
+           && sqlite3_step(update_expiry) == SQLITE_DONE;
+  }
+
+  /// Inserts or replaces a single row of the members table. Set elements have
+  /// no value.
+  bool put_member(const blob_type& key_blob, const data& member,
+                  const data* value) {
+    auto member_blob = to_blob(member);
+    blob_type value_blob;
+    if (value)
+      value_blob = to_blob(*value);
+    auto guard = make_statement_guard(member_replace);
+    if (sqlite3_bind_blob64(member_replace, 1, key_blob.data(),
+                            key_blob.size(), SQLITE_STATIC)
+          != SQLITE_OK
+        || sqlite3_bind_blob64(member_replace, 2, member_blob.data(),
+                               member_blob.size(), SQLITE_STATIC)
+             != SQLITE_OK)
+      return false;
+    auto result = value ? sqlite3_bind_blob64(member_replace, 3,
+                                              value_blob.data(),
+                                              value_blob.size(), SQLITE_STATIC)
+                        : sqlite3_bind_null(member_replace, 3);
+    return result == SQLITE_OK && sqlite3_step(member_replace) == SQLITE_DONE;
+  }
+
+  /// Writes all elements of a set or table into the members table.
+  bool put_members(const blob_type& key_blob, const data& value) {
+    if (auto xs = caf::get_if<broker::set>(&value)) {
+      for (auto& x : *xs)
+        if (!put_member(key_blob, x, nullptr))
+          return false;
+    } else if (auto xs = caf::get_if<broker::table>(&value)) {
+      for (auto& kvp : *xs)
+        if (!put_member(key_blob, kvp.first, &kvp.second))
+          return false;
+    }
+    return true;
+  }
+
+  /// Removes a single row from the members table.
+  bool erase_member(const blob_type& key_blob, const data& member) {
+    auto member_blob = to_blob(member);
+    auto guard = make_statement_guard(member_erase);
+    return sqlite3_bind_blob64(member_erase, 1, key_blob.data(),
+                               key_blob.size(), SQLITE_STATIC)
+             == SQLITE_OK
+           && sqlite3_bind_blob64(member_erase, 2, member_blob.data(),
+                                  member_blob.size(), SQLITE_STATIC)
+                == SQLITE_OK
+           && sqlite3_step(member_erase) == SQLITE_DONE;
+  }
+
+  /// Looks up a single element of a set or table. Returns whether a set
+  /// contains `member` or the value that a table maps `member` to.
+  expected<data> get_member(const blob_type& key_blob, const data& member,
+                            layout kind) {
+    auto member_blob = to_blob(member);
+    auto guard = make_statement_guard(member_lookup);
+    if (sqlite3_bind_blob64(member_lookup, 1, key_blob.data(),
+                            key_blob.size(), SQLITE_STATIC)
+          != SQLITE_OK
+        || sqlite3_bind_blob64(member_lookup, 2, member_blob.data(),
+                               member_blob.size(), SQLITE_STATIC)
+             != SQLITE_OK)
+      return ec::backend_failure;
+    auto result = sqlite3_step(member_lookup);
+    if (result != SQLITE_ROW && result != SQLITE_DONE)
+      return ec::backend_failure;
+    if (kind == layout::set)
+      return data{result == SQLITE_ROW};
+    if (result == SQLITE_DONE)
+      return ec::no_such_key;
+    return from_blob<data>(sqlite3_column_blob(member_lookup, 0),
+                           sqlite3_column_bytes(member_lookup, 0));
+  }
+
+  /// Reassembles a set or table from the members table. The primary key
+  /// returns members in the order of their serialized form, which matches the
+  /// order of `data` for most types. Hence, inserting at the end usually
+  /// costs a single comparison instead of a full tree descent.
+  expected<data> get_members(const void* key, size_t key_size, layout kind) {
+    auto guard = make_statement_guard(members_of);
+    if (sqlite3_bind_blob64(members_of, 1, key, key_size, SQLITE_STATIC)
+        != SQLITE_OK)
+      return ec::backend_failure;
+    broker::set xs;
+    broker::table ys;
+    auto result = SQLITE_DONE;
+    while ((result = sqlite3_step(members_of)) == SQLITE_ROW) {
+      auto member = from_blob<data>(sqlite3_column_blob(members_of, 0),
+                                    sqlite3_column_bytes(members_of, 0));
+      if (kind == layout::set)
+        xs.emplace_hint(xs.end(), std::move(member));
+      else
+        ys.emplace_hint(ys.end(), std::move(member),
+                        from_blob<data>(sqlite3_column_blob(members_of, 1),
+                                        sqlite3_column_bytes(members_of, 1)));
+    }
+    if (result != SQLITE_DONE)
+      return ec::backend_failure;
+    if (kind == layout::set)
+      return data{std::move(xs)};
+    return data{std::move(ys)};
+  }
+
+  /// Decodes the value column of a row in the store table, reassembling sets
+  /// and tables from the members table.
+  expected<data> decode_value(const void* key, size_t key_size,
+                              const void* value, int value_size) {
+    auto kind = classify(value, value_size);
+    if (kind == layout::blob)
+      return from_blob<data>(value, value_size);
+    return get_members(key, key_size, kind);
+  }
+
   bool modify(const data& key, const data& value,
               optional<timestamp> expiry) {
     auto key_blob = to_blob(key);
@@ -169,19 +660,103 @@ struct sqlite_backend::impl {
     return sqlite3_step(update) == SQLITE_DONE;
   }
 
+  /// Returns whether the backend groups multiple modifications into a single
+  /// transaction.
+  bool group_commit() const {
+    return batch_size > 1;
+  }
+
+  /// Commits the currently active group transaction, if any.
+  bool commit() {
+    if (!in_transaction)
+      return true;
+    in_transaction = false;
+    pending = 0;
+    if (sqlite3_exec(db, "commit;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+      BROKER_ERROR("failed to commit pending modifications");
+      return false;
+    }
+    return true;
+  }
+
+  /// Groups modifications into transactions of up to `batch_size` writes if
+  /// group commit is enabled. Nested scopes count as a single modification.
+  class write_scope {
+  public:
+    explicit write_scope(impl* ptr) : ptr_(ptr) {
+      if (ptr_->depth++ == 0 && ptr_->group_commit() && !ptr_->in_transaction)
+        ptr_->in_transaction = sqlite3_exec(ptr_->db, "begin transaction;",
+                                            nullptr, nullptr, nullptr)
+                               == SQLITE_OK;
+    }
+
+    ~write_scope() {
+      if (--ptr_->depth == 0 && ptr_->in_transaction
+          && ++ptr_->pending >= ptr_->batch_size)
+        ptr_->commit();
+    }
+
+    write_scope(const write_scope&) = delete;
+
+    write_scope& operator=(const write_scope&) = delete;
+
+  private:
+    impl* ptr_;
+  };
+
+  /// Runs `f` inside a single transaction. Rolls back all changes if `f`
+  /// returns an error. With group commit enabled or inside another
+  /// transaction, `f` simply becomes part of the enclosing transaction.
+  template <class F>
+  auto transaction(F f) -> decltype(f()) {
+    if (group_commit() || sqlite3_get_autocommit(db) == 0) {
+      write_scope scope{this};
+      return f();
+    }
+    if (sqlite3_exec(db, "begin transaction;", nullptr, nullptr, nullptr)
+        != SQLITE_OK)
+      return ec::backend_failure;
+    auto result = f();
+    if (!result) {
+      sqlite3_exec(db, "rollback;", nullptr, nullptr, nullptr);
+      return result;
+    }
+    if (sqlite3_exec(db, "commit;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+      sqlite3_exec(db, "rollback;", nullptr, nullptr, nullptr);
+      return ec::backend_failure;
+    }
+    return result;
+  }
+
   backend_options options;
+  bool read_only = false;
+  count batch_size = 0;
+  timespan batch_interval;
+  count pending = 0;
+  size_t depth = 0;
+  bool in_transaction = false;
   sqlite3* db = nullptr;
   sqlite3_stmt* replace = nullptr;
+  sqlite3_stmt* replace_bulk = nullptr;
   sqlite3_stmt* update = nullptr;
+  sqlite3_stmt* update_expiry = nullptr;
   sqlite3_stmt* erase = nullptr;
+  sqlite3_stmt* erase_bulk = nullptr;
   sqlite3_stmt* expire = nullptr;
   sqlite3_stmt* lookup = nullptr;
   sqlite3_stmt* exists = nullptr;
   sqlite3_stmt* size = nullptr;
   sqlite3_stmt* snapshot = nullptr;
   sqlite3_stmt* expiries = nullptr;
+  sqlite3_stmt* expiries_between = nullptr;
   sqlite3_stmt* clear = nullptr;
   sqlite3_stmt* keys = nullptr;
+  sqlite3_stmt* scan = nullptr;
+  sqlite3_stmt* scan_from = nullptr;
+  sqlite3_stmt* member_replace = nullptr;
+  sqlite3_stmt* member_erase = nullptr;
+  sqlite3_stmt* member_lookup = nullptr;
+  sqlite3_stmt* members_of = nullptr;
   std::vector<sqlite3_stmt*> finalize;
 };
 
@@ -197,35 +772,90 @@ expected<void> sqlite_backend::put(const data& key, data value,
                                    optional<timestamp> expiry) {
   if (!impl_->db)
     return ec::backend_failure;
-  auto guard = make_statement_guard(impl_->replace);
-  // Bind key.
   auto key_blob = to_blob(key);
-  auto result = sqlite3_bind_blob64(impl_->replace, 1, key_blob.data(),
-                                    key_blob.size(), SQLITE_STATIC);
-  if (result != SQLITE_OK)
-    return ec::backend_failure;
-  // Bind value.
-  auto value_blob = to_blob(value);
-  result = sqlite3_bind_blob64(impl_->replace, 2, value_blob.data(),
-                               value_blob.size(), SQLITE_STATIC);
-  if (result != SQLITE_OK)
-    return ec::backend_failure;
-  if (expiry)
-    result = sqlite3_bind_int64(impl_->replace, 3,
-                                expiry->time_since_epoch().count());
-  else
-    result = sqlite3_bind_null(impl_->replace, 3);
-  if (result != SQLITE_OK)
-    return ec::backend_failure;
-  // Execute statement.
-  if (sqlite3_step(impl_->replace) != SQLITE_DONE)
+  if (!impl::decomposed(value)) {
+    impl::write_scope scope{impl_.get()};
+    if (!impl_->put_row(key_blob, to_blob(value), expiry))
+      return ec::backend_failure;
+    return {};
+  }
+  // Sets and tables only leave a placeholder in the store table and keep
+  // their elements in the members table.
+  return impl_->transaction([&]() -> expected<void> {
+    if (!impl_->put_row(key_blob, impl::placeholder(value.get_type()), expiry)
+        || !impl_->put_members(key_blob, value))
+      return ec::backend_failure;
+    return {};
+  });
+}
+
+expected<void>
+sqlite_backend::put_many(const std::unordered_map<data, data>& entries,
+                         optional<timestamp> expiry) {
+  if (!impl_->db)
     return ec::backend_failure;
-  return {};
+  return impl_->transaction([&]() -> expected<void> {
+    // Only values without rows in the members table go into bulk statements.
+    std::vector<const std::pair<const data, data>*> rows;
+    rows.reserve(entries.size());
+    for (auto& kvp : entries) {
+      if (!impl::decomposed(kvp.second))
+        rows.emplace_back(&kvp);
+      else if (auto res = put(kvp.first, kvp.second, expiry); !res)
+        return res;
+    }
+    auto i = rows.begin();
+    for (auto n = rows.size(); n >= impl::bulk_rows; n -= impl::bulk_rows)
+      if (!impl_->put_bulk(i, expiry))
+        return ec::backend_failure;
+    for (; i != rows.end(); ++i)
+      if (auto res = put((*i)->first, (*i)->second, expiry); !res)
+        return res;
+    return {};
+  });
 }
 
 expected<void> sqlite_backend::add(const data& key, const data& value,
                                    data::type init_type,
                                    optional<timestamp> expiry) {
+  if (!impl_->db)
+    return ec::backend_failure;
+  auto key_blob = to_blob(key);
+  auto stored = impl_->stored_layout(key_blob);
+  if (!stored)
+    return stored.error();
+  auto kind = *stored;
+  auto absent = kind == impl::layout::absent;
+  if (absent && init_type == data::type::set)
+    kind = impl::layout::set;
+  else if (absent && init_type == data::type::table)
+    kind = impl::layout::table;
+  if (kind == impl::layout::set || kind == impl::layout::table) {
+    // Insert a single row into the members table instead of rewriting the
+    // entire container.
+    auto member = &value;
+    const data* member_value = nullptr;
+    if (kind == impl::layout::table) {
+      // Table entries come as key-value pairs, see the adder.
+      auto kvp = caf::get_if<vector>(&value);
+      if (!kvp)
+        return ec::type_clash;
+      if (kvp->size() != 2)
+        return ec::invalid_data;
+      member = &kvp->front();
+      member_value = &kvp->back();
+    }
+    return impl_->transaction([&]() -> expected<void> {
+      auto ok = absent
+                  ? impl_->put_row(key_blob, impl::placeholder(init_type),
+                                   expiry)
+                  : impl_->set_expiry(key_blob, expiry);
+      if (!ok || !impl_->put_member(key_blob, *member, member_value))
+        return ec::backend_failure;
+      return {};
+    });
+  }
+  impl::write_scope scope{impl_.get()};
   auto v = get(key);
   data vv;
   if (!v) {
@@ -243,12 +873,32 @@ expected<void> sqlite_backend::add(const data& key, const data& value,
 
 expected<void> sqlite_backend::subtract(const data& key, const data& value,
                                         optional<timestamp> expiry) {
+  if (!impl_->db)
+    return ec::backend_failure;
+  auto key_blob = to_blob(key);
+  auto stored = impl_->stored_layout(key_blob);
+  if (!stored)
+    return stored.error();
+  if (*stored == impl::layout::absent)
+    return ec::no_such_key;
+  if (*stored == impl::layout::set || *stored == impl::layout::table)
+    return impl_->transaction([&]() -> expected<void> {
+      if (!impl_->erase_member(key_blob, value)
+          || !impl_->set_expiry(key_blob, expiry))
+        return ec::backend_failure;
+      return {};
+    });
+  impl::write_scope scope{impl_.get()};
   auto v = get(key);
   if (!v)
     return v.error();
   auto result = caf::visit(remover{value}, *v);
   if (!result)
     return result;
+  // Sets and tables from databases prior to the members table end up here
+  // once and get converted to the new layout.
+  if (impl::decomposed(*v))
+    return put(key, std::move(*v), expiry);
   if (!impl_->modify(key, *v, expiry))
     return ec::backend_failure;
   return {};
@@ -257,6 +907,7 @@ expected<void> sqlite_backend::subtract(const data& key, const data& value,
 expected<void> sqlite_backend::erase(const data& key) {
   if (!impl_->db)
     return ec::backend_failure;
+  impl::write_scope scope{impl_.get()};
   auto guard = make_statement_guard(impl_->erase);
 	auto key_blob = to_blob(key);
   auto result = sqlite3_bind_blob64(impl_->erase, 1, key_blob.data(),
@@ -271,9 +922,25 @@ expected<void> sqlite_backend::erase(const data& key) {
   return {};
 }
 
+expected<void> sqlite_backend::erase_many(const std::vector<data>& keys) {
+  if (!impl_->db)
+    return ec::backend_failure;
+  return impl_->transaction([&]() -> expected<void> {
+    auto i = keys.begin();
+    for (auto n = keys.size(); n >= impl::bulk_rows; n -= impl::bulk_rows)
+      if (!impl_->erase_bulk_keys(i))
+        return ec::backend_failure;
+    for (; i != keys.end(); ++i)
+      if (auto res = erase(*i); !res)
+        return res;
+    return {};
+  });
+}
+
 expected<void> sqlite_backend::clear() {
   if (!impl_->db)
     return ec::backend_failure;
+  impl::write_scope scope{impl_.get()};
   auto guard = make_statement_guard(impl_->clear);
   auto result = sqlite3_step(impl_->clear);
   if (result != SQLITE_DONE)
@@ -284,6 +951,7 @@ expected<void> sqlite_backend::clear() {
 expected<bool> sqlite_backend::expire(const data& key, timestamp ts) {
   if (!impl_->db)
     return ec::backend_failure;
+  impl::write_scope scope{impl_.get()};
   auto guard = make_statement_guard(impl_->expire);
   // Bind key.
 	auto key_blob = to_blob(key);
@@ -302,6 +970,26 @@ expected<bool> sqlite_backend::expire(const data& key, timestamp ts) {
   return sqlite3_changes(impl_->db) == 1;
 }
 
+expected<std::vector<data>>
+sqlite_backend::expire_many(const std::vector<data>& keys, timestamp ts) {
+  if (!impl_->db)
+    return ec::backend_failure;
+  return impl_->transaction(
+    [&] { return abstract_backend::expire_many(keys, ts); });
+}
+
+expected<void> sqlite_backend::flush() {
+  if (!impl_->db)
+    return ec::backend_failure;
+  if (!impl_->commit())
+    return ec::backend_failure;
+  return {};
+}
+
+timespan sqlite_backend::flush_interval() const {
+  return impl_->group_commit() ? impl_->batch_interval : timespan{0};
+}
+
 expected<data> sqlite_backend::get(const data& key) const {
   if (!impl_->db)
     return ec::backend_failure;
@@ -316,8 +1004,27 @@ expected<data> sqlite_backend::get(const data& key) const {
 	  return ec::no_such_key;
 	if (result != SQLITE_ROW)
     return ec::backend_failure;
-	return from_blob<data>(sqlite3_column_blob(impl_->lookup, 0),
-                         sqlite3_column_bytes(impl_->lookup, 0));
+  return impl_->decode_value(key_blob.data(), key_blob.size(),
+                             sqlite3_column_blob(impl_->lookup, 0),
+                             sqlite3_column_bytes(impl_->lookup, 0));
+}
+
+expected<data> sqlite_backend::get(const data& key, const data& aspect) const {
+  if (!impl_->db)
+    return ec::backend_failure;
+  auto key_blob = to_blob(key);
+  auto stored = impl_->stored_layout(key_blob);
+  if (!stored)
+    return stored.error();
+  switch (*stored) {
+    case impl::layout::absent:
+      return ec::no_such_key;
+    case impl::layout::set:
+    case impl::layout::table:
+      return impl_->get_member(key_blob, aspect, *stored);
+    default:
+      return abstract_backend::get(key, aspect);
+  }
 }
 
 expected<data> sqlite_backend::keys() const {
@@ -329,13 +1036,90 @@ expected<data> sqlite_backend::keys() const {
   while ((result = sqlite3_step(impl_->keys)) == SQLITE_ROW) {
     auto key = from_blob<data>(sqlite3_column_blob(impl_->keys, 0),
                                sqlite3_column_bytes(impl_->keys, 0));
-    keys.insert(std::move(key));
+    keys.emplace_hint(keys.end(), std::move(key));
   }
   if (result == SQLITE_DONE)
     return {std::move(keys)};
   return ec::backend_failure;
 }
 
+expected<data> sqlite_backend::scan(const std::string& prefix,
+                                    size_t limit) const {
+  if (!impl_->db)
+    return ec::backend_failure;
+  auto guard = make_statement_guard(impl_->scan);
+  // Restrict the query to string keys, which allows SQLite to use the primary
+  // key index. The serialization format encodes the length of a string before
+  // its characters, so we still need to check the prefix after decoding.
+  auto& lower = min_string_key_blob();
+  char upper = static_cast<char>(lower[0] + 1);
+  if (sqlite3_bind_blob64(impl_->scan, 1, lower.data(), lower.size(),
+                          SQLITE_STATIC) != SQLITE_OK
+      || sqlite3_bind_blob64(impl_->scan, 2, &upper, 1, SQLITE_STATIC)
+           != SQLITE_OK)
+    return ec::backend_failure;
+  table xs;
+  auto result = SQLITE_DONE;
+  while ((result = sqlite3_step(impl_->scan)) == SQLITE_ROW) {
+    auto key = from_blob<data>(sqlite3_column_blob(impl_->scan, 0),
+                               sqlite3_column_bytes(impl_->scan, 0));
+    if (!has_prefix(key, prefix))
+      continue;
+    auto value = impl_->decode_value(sqlite3_column_blob(impl_->scan, 0),
+                                     sqlite3_column_bytes(impl_->scan, 0),
+                                     sqlite3_column_blob(impl_->scan, 1),
+                                     sqlite3_column_bytes(impl_->scan, 1));
+    if (!value)
+      return value.error();
+    xs.emplace_hint(xs.end(), std::move(key), std::move(*value));
+    if (xs.size() == limit) {
+      result = SQLITE_DONE;
+      break;
+    }
+  }
+  if (result == SQLITE_DONE)
+    return {std::move(xs)};
+  return ec::backend_failure;
+}
+
+expected<optional<data>>
+sqlite_backend::scan(const optional<data>& start, size_t batch_size,
+                     const scan_callback& f) const {
+  if (!impl_->db)
+    return ec::backend_failure;
+  auto stmt = impl_->scan_from;
+  auto guard = make_statement_guard(stmt);
+  // The empty blob is smaller than all serialized keys.
+  impl::blob_type start_blob;
+  if (start)
+    start_blob = to_blob(*start);
+  auto bound = start_blob.empty()
+                 ? sqlite3_bind_zeroblob(stmt, 1, 0)
+                 : sqlite3_bind_blob64(stmt, 1, start_blob.data(),
+                                       start_blob.size(), SQLITE_STATIC);
+  if (bound != SQLITE_OK)
+    return ec::backend_failure;
+  scan_batcher batcher{batch_size, f};
+  auto result = SQLITE_DONE;
+  while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+    auto key = from_blob<data>(sqlite3_column_blob(stmt, 0),
+                               sqlite3_column_bytes(stmt, 0));
+    if (!batcher.flush_if_full())
+      return optional<data>{std::move(key)};
+    auto value = impl_->decode_value(sqlite3_column_blob(stmt, 0),
+                                     sqlite3_column_bytes(stmt, 0),
+                                     sqlite3_column_blob(stmt, 1),
+                                     sqlite3_column_bytes(stmt, 1));
+    if (!value)
+      return value.error();
+    batcher.push(std::move(key), std::move(*value));
+  }
+  if (result != SQLITE_DONE)
+    return ec::backend_failure;
+  batcher.finish();
+  return optional<data>{};
+}
+
 expected<bool> sqlite_backend::exists(const data& key) const {
   if (!impl_->db)
     return ec::backend_failure;
@@ -375,9 +1159,13 @@ expected<snapshot> sqlite_backend::snapshot() const {
   while ((result = sqlite3_step(impl_->snapshot)) == SQLITE_ROW) {
     auto key = from_blob<data>(sqlite3_column_blob(impl_->snapshot, 0),
                                sqlite3_column_bytes(impl_->snapshot, 0));
-    auto value = from_blob<data>(sqlite3_column_blob(impl_->snapshot, 1),
-                                 sqlite3_column_bytes(impl_->snapshot, 1));
-    ss.emplace(std::move(key), std::move(value));
+    auto value = impl_->decode_value(sqlite3_column_blob(impl_->snapshot, 0),
+                                     sqlite3_column_bytes(impl_->snapshot, 0),
+                                     sqlite3_column_blob(impl_->snapshot, 1),
+                                     sqlite3_column_bytes(impl_->snapshot, 1));
+    if (!value)
+      return value.error();
+    ss.emplace(std::move(key), std::move(*value));
   }
   if (result == SQLITE_DONE)
     return {std::move(ss)};
@@ -389,23 +1177,62 @@ expected<expirables> sqlite_backend::expiries() const {
     return ec::backend_failure;
 
   auto guard = make_statement_guard(impl_->expiries);
-  expirables rval;
-  auto result = SQLITE_DONE;
+  return collect_expiries(impl_->expiries);
+}
 
-  while ((result = sqlite3_step(impl_->expiries)) == SQLITE_ROW) {
-    auto key = from_blob<data>(sqlite3_column_blob(impl_->expiries, 0),
-                               sqlite3_column_bytes(impl_->expiries, 0));
-    auto expiry_count = sqlite3_column_int64(impl_->expiries, 1);
-    auto duration = timespan(expiry_count);
-    auto expiry = timestamp(duration);
-    auto e = expirable(std::move(key), std::move(expiry));
-    rval.emplace_back(std::move(e));
-  }
+expected<expirables> sqlite_backend::expiries_between(timestamp from,
+                                                      timestamp until) const {
+  if (!impl_->db)
+    return ec::backend_failure;
+  auto stmt = impl_->expiries_between;
+  auto guard = make_statement_guard(stmt);
+  if (sqlite3_bind_int64(stmt, 1, from.time_since_epoch().count()) != SQLITE_OK
+      || sqlite3_bind_int64(stmt, 2, until.time_since_epoch().count())
+           != SQLITE_OK)
+    return ec::backend_failure;
+  return collect_expiries(stmt);
+}
 
-  if (result == SQLITE_DONE)
-    return {std::move(rval)};
+std::unique_ptr<abstract_backend> sqlite_backend::make_reader() const {
+  if (!impl_->db || impl_->read_only || impl_->journal_mode() != "wal")
+    return nullptr;
+  auto opts = impl_->options;
+  opts["read_only"] = true;
+  auto result = std::make_unique<sqlite_backend>(std::move(opts));
+  if (!result->impl_->db)
+    return nullptr;
+  return result;
+}
 
-  return ec::backend_failure;
+expected<std::vector<std::string>>
+sqlite_backend::checkpoint(const std::string& path) {
+  if (!impl_->db)
+    return ec::backend_failure;
+  if (!impl_->commit())
+    return make_error(ec::backend_failure, "failed to commit");
+  if (detail::exists(path))
+    return make_error(ec::cannot_write_file, path, "file exists");
+  auto dir = dirname(path);
+  if (!dir.empty() && !is_directory(dir) && !mkdirs(dir))
+    return make_error(ec::cannot_write_file, path);
+  sqlite3* dst = nullptr;
+  auto result = sqlite3_open(path.c_str(), &dst);
+  if (result == SQLITE_OK) {
+    auto backup = sqlite3_backup_init(dst, "main", impl_->db, "main");
+    if (backup != nullptr) {
+      result = sqlite3_backup_step(backup, -1);
+      sqlite3_backup_finish(backup);
+    } else {
+      result = sqlite3_errcode(dst);
+    }
+  }
+  sqlite3_close(dst);
+  if (result != SQLITE_DONE) {
+    BROKER_ERROR("failed to copy database:" << sqlite3_errstr(result));
+    remove_all(path);
+    return make_error(ec::backend_failure, "failed to copy database");
+  }
+  return std::vector<std::string>{path};
 }
 
 } // namespace detail
@@ -0,0 +1,124 @@
+#include "broker/detail/store_async_actor.hh"
+
+#include <utility>
+
+#include <caf/actor.hpp>
+#include <caf/behavior.hpp>
+#include <caf/error.hpp>
+#include <caf/event_based_actor.hpp>
+#include <caf/stateful_actor.hpp>
+
+#include "broker/atoms.hh"
+#include "broker/error.hh"
+#include "broker/logger.hh"
+#include "broker/timeout.hh"
+
+namespace broker {
+namespace detail {
+
+const char* store_async_state::name = "store_async_actor";
+
+store_async_state::store_async_state(caf::event_based_actor* ptr) : self(ptr) {
+  // nop
+}
+
+void store_async_state::init(caf::actor frontend_hdl) {
+  frontend = std::move(frontend_hdl);
+  self->monitor(frontend);
+}
+
+template <class... Ts>
+void store_async_state::request(callback f, Ts&&... xs) {
+  auto rid = ++id;
+  pending.emplace(rid, std::move(f));
+  deadlines.emplace_back(self->clock().now() + timeout::frontend, rid);
+  self->send(frontend, std::forward<Ts>(xs)..., rid);
+  if (!tick_scheduled) {
+    tick_scheduled = true;
+    self->delayed_send(self, timeout::frontend, atom::tick::value);
+  }
+}
+
+void store_async_state::deliver(request_id rid, expected<data> x) {
+  auto i = pending.find(rid);
+  if (i == pending.end()) {
+    BROKER_DEBUG("drop response for unknown request" << rid);
+    return;
+  }
+  auto f = std::move(i->second);
+  pending.erase(i);
+  // Keeps the deadlines from growing while responses arrive in order.
+  while (!deadlines.empty() && pending.count(deadlines.front().second) == 0)
+    deadlines.pop_front();
+  f(std::move(x));
+}
+
+void store_async_state::fail_all(const caf::error& reason) {
+  auto xs = std::move(pending);
+  pending.clear();
+  deadlines.clear();
+  for (auto& kvp : xs)
+    kvp.second(reason);
+}
+
+void store_async_state::tick() {
+  tick_scheduled = false;
+  auto now = self->clock().now();
+  while (!deadlines.empty() && deadlines.front().first <= now) {
+    auto rid = deadlines.front().second;
+    deadlines.pop_front();
+    if (pending.count(rid) == 0)
+      continue;
+    BROKER_DEBUG("request" << rid << "timed out");
+    deliver(rid, make_error(ec::request_timeout,
+                            "store did not respond in time"));
+  }
+  if (!deadlines.empty()) {
+    tick_scheduled = true;
+    self->delayed_send(self, deadlines.front().first - now,
+                       atom::tick::value);
+  }
+}
+
+caf::behavior store_async_actor(store_async_actor_type* self,
+                                caf::actor frontend) {
+  using callback = store_async_state::callback;
+  self->state.init(std::move(frontend));
+  self->set_down_handler([=](const caf::down_msg& msg) {
+    BROKER_DEBUG("frontend terminated, fail" << self->state.pending.size()
+                                             << "pending requests");
+    self->state.fail_all(msg.reason ? msg.reason
+                                    : make_error(ec::unspecified,
+                                                 "store terminated"));
+    self->quit(msg.reason);
+  });
+  return {
+    // -- requests from the store API ------------------------------------------
+    [=](atom::exists, data& key, callback& f) {
+      self->state.request(std::move(f), atom::exists::value, std::move(key));
+    },
+    [=](atom::get, atom::keys, callback& f) {
+      self->state.request(std::move(f), atom::get::value, atom::keys::value);
+    },
+    [=](atom::get, data& key, callback& f) {
+      self->state.request(std::move(f), atom::get::value, std::move(key));
+    },
+    [=](atom::get, data& key, data& index, callback& f) {
+      self->state.request(std::move(f), atom::get::value, std::move(key),
+                          std::move(index));
+    },
+    // -- responses from the frontend ------------------------------------------
+    [=](data& x, request_id rid) {
+      self->state.deliver(rid, std::move(x));
+    },
+    [=](caf::error& e, request_id rid) {
+      self->state.deliver(rid, std::move(e));
+    },
+    [=](atom::tick) {
+      self->state.tick();
+    }
+  };
+}
+
+} // namespace detail
+} // namespace broker
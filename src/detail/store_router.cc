@@ -0,0 +1,325 @@
+#include "broker/detail/store_router.hh"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+#include <caf/actor.hpp>
+#include <caf/behavior.hpp>
+#include <caf/event_based_actor.hpp>
+#include <caf/make_message.hpp>
+#include <caf/response_promise.hpp>
+
+#include "broker/atoms.hh"
+#include "broker/detail/assert.hh"
+#include "broker/error.hh"
+#include "broker/internal_command.hh"
+#include "broker/logger.hh"
+#include "broker/store.hh"
+#include "broker/topic.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+using shard_list = std::vector<caf::actor>;
+
+/// Sends each command to the shard(s) for its key(s).
+struct command_router {
+  using result_type = void;
+
+  caf::event_based_actor* self;
+  const shard_list& shards;
+
+  void send(size_t index, internal_command::variant_type x) {
+    self->send(shards[index], atom::local::value,
+               internal_command{std::move(x)});
+  }
+
+  template <class T>
+  void route_by_key(T& x) {
+    auto index = shard_of(x.key, shards.size());
+    send(index, std::move(x));
+  }
+
+  void operator()(none) {
+    // nop
+  }
+
+  void operator()(put_command& x) {
+    route_by_key(x);
+  }
+
+  void operator()(put_unique_command& x) {
+    route_by_key(x);
+  }
+
+  void operator()(erase_command& x) {
+    route_by_key(x);
+  }
+
+  void operator()(add_command& x) {
+    route_by_key(x);
+  }
+
+  void operator()(subtract_command& x) {
+    route_by_key(x);
+  }
+
+  void operator()(compare_and_swap_command& x) {
+    route_by_key(x);
+  }
+
+  void operator()(add_and_get_command& x) {
+    route_by_key(x);
+  }
+
+  void operator()(clear_command& x) {
+    for (size_t i = 0; i < shards.size(); ++i)
+      send(i, x);
+  }
+
+  void operator()(put_many_command& x) {
+    std::vector<put_many_command> parts(shards.size());
+    for (auto& kvp : x.entries)
+      parts[shard_of(kvp.first, shards.size())].entries.emplace(kvp);
+    for (size_t i = 0; i < parts.size(); ++i) {
+      if (!parts[i].entries.empty()) {
+        parts[i].expiry = x.expiry;
+        send(i, std::move(parts[i]));
+      }
+    }
+  }
+
+  void operator()(erase_many_command& x) {
+    std::vector<erase_many_command> parts(shards.size());
+    for (auto& key : x.keys)
+      parts[shard_of(key, shards.size())].keys.emplace_back(std::move(key));
+    for (size_t i = 0; i < parts.size(); ++i)
+      if (!parts[i].keys.empty())
+        send(i, std::move(parts[i]));
+  }
+
+  template <class T>
+  void operator()(T&) {
+    BROKER_WARNING("store router dropped an unexpected command");
+  }
+};
+
+/// Collects the responses of all shards to a query.
+struct fan_out_state {
+  size_t pending;
+  std::vector<data> results;
+  caf::error err;
+};
+
+using fan_out_callback = std::function<void(expected<std::vector<data>>)>;
+
+/// Sends `msg` to all shards and calls `f` after receiving all results or
+/// after receiving the first error.
+void fan_out(caf::event_based_actor* self, const shard_list& shards,
+             caf::message msg, fan_out_callback f) {
+  auto st = std::make_shared<fan_out_state>();
+  st->pending = shards.size();
+  st->results.resize(shards.size());
+  for (size_t i = 0; i < shards.size(); ++i) {
+    self->request(shards[i], caf::infinite, msg)
+      .then(
+        [=](data& x) {
+          st->results[i] = std::move(x);
+          if (--st->pending == 0 && !st->err)
+            f(std::move(st->results));
+        },
+        [=](caf::error& err) {
+          if (!st->err) {
+            st->err = std::move(err);
+            f(st->err);
+          }
+        });
+  }
+}
+
+/// Merges sets or tables by inserting all elements into the first value.
+data merge(std::vector<data>& xs, size_t limit = 0) {
+  if (xs.empty())
+    return data{};
+  auto result = std::move(xs.front());
+  for (size_t i = 1; i < xs.size(); ++i) {
+    if (auto dst = caf::get_if<set>(&result)) {
+      if (auto src = caf::get_if<set>(&xs[i]))
+        dst->insert(src->begin(), src->end());
+    } else if (auto dst = caf::get_if<table>(&result)) {
+      if (auto src = caf::get_if<table>(&xs[i]))
+        for (auto& kvp : *src) {
+          if (limit > 0 && dst->size() >= limit)
+            break;
+          dst->emplace(kvp);
+        }
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+std::string shard_name(const std::string& name, size_t index) {
+  auto result = topic{name} / topics::reserved / topic{"shard"}
+                / topic{std::to_string(index)};
+  return result.string();
+}
+
+size_t shard_of(const data& key, size_t num_shards) {
+  return static_cast<size_t>(stable_hash(key) % num_shards);
+}
+
+caf::behavior store_router(caf::event_based_actor* self, std::string name,
+                           std::vector<caf::actor> shards) {
+  auto ptr = std::make_shared<shard_list>(std::move(shards));
+  BROKER_ASSERT(!ptr->empty());
+  auto shard = [ptr](const data& key) -> const caf::actor& {
+    return (*ptr)[shard_of(key, ptr->size())];
+  };
+  // Responds either with a value or with the pair (value, request ID).
+  auto respond_with_id = [](caf::response_promise rp, request_id id) {
+    return [rp, id](expected<std::vector<data>> xs) mutable {
+      if (xs)
+        rp.deliver(caf::make_message(merge(*xs), id));
+      else
+        rp.deliver(caf::make_message(std::move(xs.error()), id));
+    };
+  };
+  return {
+    // --- commands ------------------------------------------------------------
+    [=](atom::local, internal_command& x) {
+      command_router f{self, *ptr};
+      caf::visit(f, x.content);
+    },
+    [=](atom::sync_point, caf::actor& who) {
+      // Respond to `who` once all shards reached the sync point.
+      auto n = ptr->size();
+      auto helper = self->spawn([=](caf::event_based_actor* helper_self) {
+        auto remaining = std::make_shared<size_t>(n);
+        return caf::behavior{
+          [=](atom::sync_point) {
+            if (--*remaining == 0) {
+              helper_self->send(who, atom::sync_point::value);
+              helper_self->quit();
+            }
+          },
+        };
+      });
+      for (auto& x : *ptr)
+        self->send(x, atom::sync_point::value, helper);
+    },
+    // --- queries for a single key --------------------------------------------
+    [=](atom::exists, data& key) {
+      auto& dst = shard(key);
+      return self->delegate(dst, atom::exists::value, std::move(key));
+    },
+    [=](atom::exists, data& key, request_id id) {
+      auto& dst = shard(key);
+      return self->delegate(dst, atom::exists::value, std::move(key), id);
+    },
+    [=](atom::get, data& key) {
+      auto& dst = shard(key);
+      return self->delegate(dst, atom::get::value, std::move(key));
+    },
+    [=](atom::get, data& key, data& aspect) {
+      auto& dst = shard(key);
+      return self->delegate(dst, atom::get::value, std::move(key),
+                            std::move(aspect));
+    },
+    [=](atom::get, data& key, request_id id) {
+      auto& dst = shard(key);
+      return self->delegate(dst, atom::get::value, std::move(key), id);
+    },
+    [=](atom::get, data& key, data& aspect, request_id id) {
+      auto& dst = shard(key);
+      return self->delegate(dst, atom::get::value, std::move(key),
+                            std::move(aspect), id);
+    },
+    // --- queries spanning all shards -----------------------------------------
+    [=](atom::get, atom::keys) -> caf::result<data> {
+      auto rp = self->make_response_promise();
+      fan_out(self, *ptr, caf::make_message(atom::get::value, atom::keys::value),
+              [rp](expected<std::vector<data>> xs) mutable {
+                if (xs)
+                  rp.deliver(merge(*xs));
+                else
+                  rp.deliver(std::move(xs.error()));
+              });
+      return rp;
+    },
+    [=](atom::get, atom::keys, request_id id) {
+      fan_out(self, *ptr, caf::make_message(atom::get::value, atom::keys::value),
+              respond_with_id(self->make_response_promise(), id));
+    },
+    [=](atom::get, const vector& keys) -> caf::result<data> {
+      std::vector<vector> parts(ptr->size());
+      for (auto& key : keys)
+        parts[shard_of(key, ptr->size())].emplace_back(key);
+      auto rp = self->make_response_promise();
+      auto st = std::make_shared<fan_out_state>();
+      st->pending = parts.size();
+      auto result = std::make_shared<table>();
+      for (size_t i = 0; i < parts.size(); ++i) {
+        self->request((*ptr)[i], caf::infinite, atom::get::value,
+                      std::move(parts[i]))
+          .then(
+            [=](data& x) mutable {
+              if (auto xs = caf::get_if<table>(&x))
+                result->insert(xs->begin(), xs->end());
+              if (--st->pending == 0 && !st->err)
+                rp.deliver(data{std::move(*result)});
+            },
+            [=](caf::error& err) mutable {
+              if (!st->err) {
+                st->err = err;
+                rp.deliver(std::move(err));
+              }
+            });
+      }
+      return rp;
+    },
+    [=](atom::scan, const std::string& prefix,
+        uint64_t limit) -> caf::result<data> {
+      auto rp = self->make_response_promise();
+      auto n = static_cast<size_t>(limit);
+      fan_out(self, *ptr, caf::make_message(atom::scan::value, prefix, limit),
+              [rp, n](expected<std::vector<data>> xs) mutable {
+                if (xs)
+                  rp.deliver(merge(*xs, n));
+                else
+                  rp.deliver(std::move(xs.error()));
+              });
+      return rp;
+    },
+    [=](atom::get, atom::stale) -> caf::result<data> {
+      auto rp = self->make_response_promise();
+      auto msg = caf::make_message(atom::get::value, atom::stale::value);
+      fan_out(self, *ptr, std::move(msg),
+              [rp](expected<std::vector<data>> xs) mutable {
+                if (!xs) {
+                  rp.deliver(std::move(xs.error()));
+                  return;
+                }
+                // The store is as stale as its most outdated shard.
+                timespan result{0};
+                for (auto& x : *xs)
+                  if (auto t = caf::get_if<timespan>(&x))
+                    result = std::max(result, *t);
+                rp.deliver(data{result});
+              });
+      return rp;
+    },
+    [=](atom::get, atom::name) {
+      return name;
+    },
+  };
+}
+
+} // namespace detail
+} // namespace broker
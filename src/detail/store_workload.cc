@@ -0,0 +1,56 @@
+#include "broker/detail/store_workload.hh"
+
+#include <algorithm>
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+constexpr const char* query_names[] = {
+  "get", "get_index", "exists", "keys", "get_many", "scan",
+};
+
+} // namespace
+
+const char* to_string(store_query x) {
+  return query_names[static_cast<uint8_t>(x)];
+}
+
+bool convert(caf::string_view x, store_query& y) {
+  auto first = std::begin(query_names);
+  auto last = std::end(query_names);
+  auto i = std::find_if(first, last, [&](const char* name) {
+    return x.compare(name) == 0;
+  });
+  if (i == last)
+    return false;
+  y = static_cast<store_query>(std::distance(first, i));
+  return true;
+}
+
+topic workload_topic(const std::string& name, store_query x) {
+  return topic{name} / topic{to_string(x)};
+}
+
+bool convert(const topic& x, store_query& y) {
+  auto& str = x.string();
+  auto pos = str.rfind(topic::sep);
+  if (pos == std::string::npos)
+    return false;
+  auto suffix = caf::string_view{str}.substr(pos + 1);
+  return convert(suffix, y);
+}
+
+std::string workload_file_name(const std::string& dir,
+                               const std::string& name) {
+  auto result = dir;
+  result += "/store-";
+  for (auto c : name)
+    result += c == '/' || c == '\\' ? '_' : c;
+  result += ".dat";
+  return result;
+}
+
+} // namespace detail
+} // namespace broker
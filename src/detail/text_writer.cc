@@ -0,0 +1,149 @@
+#include "broker/detail/text_writer.hh"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+
+#include "broker/convert.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+template <class T>
+void append_integer(std::string& buf, T x) {
+  char tmp[24];
+  auto res = std::to_chars(tmp, tmp + sizeof(tmp), x);
+  buf.append(tmp, res.ptr);
+}
+
+struct text_visitor {
+  using result_type = void;
+
+  text_writer& writer;
+  std::string& buf;
+  std::string& scratch;
+
+  void operator()(none) {
+    buf += "nil";
+  }
+
+  void operator()(boolean x) {
+    buf += x ? 'T' : 'F';
+  }
+
+  void operator()(count x) {
+    append_integer(buf, x);
+  }
+
+  void operator()(integer x) {
+    append_integer(buf, x);
+  }
+
+  void operator()(real x) {
+    // Same format as std::to_string. Large values need up to 317 characters.
+    char tmp[384];
+    auto n = snprintf(tmp, sizeof(tmp), "%f", x);
+    if (n > 0)
+      buf.append(tmp, std::min(static_cast<size_t>(n), sizeof(tmp) - 1));
+  }
+
+  void operator()(const std::string& x) {
+    buf += x;
+  }
+
+  void operator()(const address& x) {
+    convert(x, scratch);
+    buf += scratch;
+  }
+
+  void operator()(const subnet& x) {
+    convert(x, scratch);
+    buf += scratch;
+  }
+
+  void operator()(port x) {
+    append_integer(buf, x.number());
+    switch (x.type()) {
+      default:
+        buf += "/?";
+        break;
+      case port::protocol::tcp:
+        buf += "/tcp";
+        break;
+      case port::protocol::udp:
+        buf += "/udp";
+        break;
+      case port::protocol::icmp:
+        buf += "/icmp";
+        break;
+    }
+  }
+
+  void operator()(timestamp x) {
+    append_integer(buf, x.time_since_epoch().count());
+    buf += "ns";
+  }
+
+  void operator()(timespan x) {
+    append_integer(buf, x.count());
+    buf += "ns";
+  }
+
+  void operator()(const enum_value& x) {
+    buf += x.name;
+  }
+
+  void operator()(const packed_data& x) {
+    convert(x, scratch);
+    buf += scratch;
+  }
+
+  template <class Container>
+  void operator()(const Container& xs) {
+    writer.append(buf, xs);
+  }
+};
+
+template <class Container, class F>
+void append_container(std::string& buf, const Container& xs, char left,
+                      char right, F f) {
+  buf += left;
+  auto first = true;
+  for (auto& x : xs) {
+    if (!first)
+      buf += ", ";
+    first = false;
+    f(x);
+  }
+  buf += right;
+}
+
+} // namespace
+
+void text_writer::append(std::string& buf, const data& x) {
+  text_visitor f{*this, buf, scratch_};
+  caf::visit(f, x);
+}
+
+void text_writer::append(std::string& buf, const vector& xs) {
+  append_container(buf, xs, '(', ')',
+                   [&](const data& x) { append(buf, x); });
+}
+
+void text_writer::append(std::string& buf, const set& xs) {
+  append_container(buf, xs, '{', '}',
+                   [&](const data& x) { append(buf, x); });
+}
+
+void text_writer::append(std::string& buf, const table& xs) {
+  append_container(buf, xs, '{', '}', [&](const table::value_type& x) {
+    append(buf, x.first);
+    buf += " -> ";
+    append(buf, x.second);
+  });
+}
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,125 @@
+#include "broker/detail/thread_affinity.hh"
+
+#include <exception>
+#include <fstream>
+#include <string>
+
+#include <caf/actor_system.hpp>
+#include <caf/actor_system_config.hpp>
+
+#include "broker/config.hh"
+#include "broker/defaults.hh"
+#include "broker/logger.hh"
+
+#ifdef BROKER_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace broker {
+namespace detail {
+
+bool pin_current_thread(int cpu) {
+#ifdef BROKER_LINUX
+  if (cpu < 0 || cpu >= CPU_SETSIZE)
+    return false;
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+  static_cast<void>(cpu);
+  return false;
+#endif
+}
+
+bool pin_current_thread(const std::vector<int>& cpus) {
+#ifdef BROKER_LINUX
+  cpu_set_t xs;
+  CPU_ZERO(&xs);
+  for (auto cpu : cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+      return false;
+    CPU_SET(cpu, &xs);
+  }
+  if (CPU_COUNT(&xs) == 0)
+    return false;
+  return pthread_setaffinity_np(pthread_self(), sizeof(xs), &xs) == 0;
+#else
+  static_cast<void>(cpus);
+  return false;
+#endif
+}
+
+std::vector<int> numa_node_cpus(int node) {
+  std::vector<int> result;
+#ifdef BROKER_LINUX
+  if (node < 0)
+    return result;
+  // The kernel lists the CPUs in ranges, e.g., "0-7,16-23".
+  std::ifstream in{"/sys/devices/system/node/node" + std::to_string(node)
+                   + "/cpulist"};
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    try {
+      auto dash = range.find('-');
+      auto first = std::stoi(range.substr(0, dash));
+      auto last = dash == std::string::npos ? first
+                                            : std::stoi(range.substr(dash + 1));
+      for (auto cpu = first; cpu <= last; ++cpu)
+        result.emplace_back(cpu);
+    } catch (std::exception&) {
+      return {};
+    }
+  }
+#else
+  static_cast<void>(node);
+#endif
+  return result;
+}
+
+bool prefer_numa_node(int node) {
+#if defined(BROKER_LINUX) && defined(SYS_set_mempolicy)
+  // Same value as MPOL_PREFERRED in <linux/mempolicy.h>.
+  constexpr int mpol_preferred = 1;
+  constexpr int max_nodes = 1024;
+  if (node < 0 || node >= max_nodes)
+    return false;
+  unsigned long mask[max_nodes / (8 * sizeof(unsigned long))] = {};
+  constexpr auto bits = 8 * sizeof(unsigned long);
+  mask[node / bits] = 1ul << (node % bits);
+  return syscall(SYS_set_mempolicy, mpol_preferred, mask, max_nodes) == 0;
+#else
+  static_cast<void>(node);
+  return false;
+#endif
+}
+
+void numa_hook::init(caf::actor_system& sys) {
+  node_ = caf::get_or(sys.config(), "broker.numa-node", defaults::numa_node);
+  if (node_ < 0)
+    return;
+  cpus_ = numa_node_cpus(node_);
+  if (cpus_.empty()) {
+    BROKER_WARNING("unable to find the CPUs of NUMA node" << node_);
+    node_ = -1;
+  }
+}
+
+void numa_hook::thread_started() {
+  if (node_ < 0)
+    return;
+  if (!pin_current_thread(cpus_))
+    BROKER_WARNING("unable to pin thread to NUMA node" << node_);
+  if (!prefer_numa_node(node_))
+    BROKER_WARNING("unable to prefer memory of NUMA node" << node_);
+}
+
+void numa_hook::thread_terminates() {
+  // nop
+}
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,34 @@
+#include "broker/detail/topic_table.hh"
+
+namespace broker {
+namespace detail {
+
+constexpr topic_table::id_type topic_table::invalid_id;
+
+topic_table::id_type topic_table::intern(const topic& x, bool* added) {
+  auto i = ids_.find(x.string());
+  if (i != ids_.end()) {
+    if (added)
+      *added = false;
+    return i->second;
+  }
+  auto id = static_cast<id_type>(topics_.size());
+  ids_.emplace(x.string(), id);
+  topics_.emplace_back(x);
+  if (added)
+    *added = true;
+  return id;
+}
+
+void topic_table::clear() {
+  topics_.clear();
+  ids_.clear();
+}
+
+topic_table::id_type topic_table::find(const topic& x) const {
+  auto i = ids_.find(x.string());
+  return i != ids_.end() ? i->second : invalid_id;
+}
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,90 @@
+#include "broker/detail/tracepoint.hh"
+
+#include <atomic>
+#include <chrono>
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+static_assert((trace_buffer_size & (trace_buffer_size - 1)) == 0,
+              "trace_buffer_size must be a power of two");
+
+// Each slot is a seqlock: writers of the n-th event set the sequence number
+// to 2n + 1 while writing and to 2n + 2 when done, allowing readers to detect
+// incomplete or overwritten events.
+struct trace_slot {
+  std::atomic<uint64_t> seq{0};
+  std::atomic<uint64_t> timestamp{0};
+  std::atomic<uint64_t> id{0};
+  std::atomic<uint64_t> arg0{0};
+  std::atomic<uint64_t> arg1{0};
+};
+
+trace_slot slots[trace_buffer_size];
+
+std::atomic<uint64_t> head{0};
+
+} // namespace
+
+const char* to_string(tracepoint x) {
+  switch (x) {
+    case tracepoint::batch_received:
+      return "batch_received";
+    case tracepoint::batch_matched:
+      return "batch_matched";
+    case tracepoint::batch_forwarded:
+      return "batch_forwarded";
+    case tracepoint::batch_delivered:
+      return "batch_delivered";
+    case tracepoint::store_command_applied:
+      return "store_command_applied";
+  }
+  return "???";
+}
+
+void trace(tracepoint id, uint64_t arg0, uint64_t arg1) noexcept {
+  using namespace std::chrono;
+  auto t = steady_clock::now().time_since_epoch();
+  auto n = head.fetch_add(1, std::memory_order_relaxed);
+  auto& slot = slots[n & (trace_buffer_size - 1)];
+  slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.timestamp.store(duration_cast<nanoseconds>(t).count(),
+                       std::memory_order_relaxed);
+  slot.id.store(static_cast<uint64_t>(id), std::memory_order_relaxed);
+  slot.arg0.store(arg0, std::memory_order_relaxed);
+  slot.arg1.store(arg1, std::memory_order_relaxed);
+  slot.seq.store(2 * n + 2, std::memory_order_release);
+}
+
+std::vector<trace_event> trace_events() {
+  std::vector<trace_event> result;
+  auto last = head.load(std::memory_order_acquire);
+  auto first = last > trace_buffer_size ? last - trace_buffer_size : 0;
+  result.reserve(last - first);
+  for (auto n = first; n < last; ++n) {
+    auto& slot = slots[n & (trace_buffer_size - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != 2 * n + 2)
+      continue;
+    trace_event ev;
+    ev.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+    ev.id = static_cast<tracepoint>(slot.id.load(std::memory_order_relaxed));
+    ev.arg0 = slot.arg0.load(std::memory_order_relaxed);
+    ev.arg1 = slot.arg1.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) == 2 * n + 2)
+      result.emplace_back(ev);
+  }
+  return result;
+}
+
+void clear_trace_events() noexcept {
+  for (auto& slot : slots)
+    slot.seq.store(0, std::memory_order_relaxed);
+  head.store(0, std::memory_order_release);
+}
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,38 @@
+#include "broker/detail/worker_groups.hh"
+
+#include <algorithm>
+
+namespace broker {
+namespace detail {
+
+void worker_groups::add(caf::stream_slot slot, const consumer_group& group) {
+  auto& grp = groups_[group.name];
+  if (grp.members.empty())
+    grp.policy = group.policy;
+  grp.members.emplace_back(slot);
+  slots_.emplace(slot, group.name);
+}
+
+void worker_groups::erase(caf::stream_slot slot) {
+  auto i = slots_.find(slot);
+  if (i == slots_.end())
+    return;
+  auto j = groups_.find(i->second);
+  auto& xs = j->second.members;
+  xs.erase(std::remove(xs.begin(), xs.end(), slot), xs.end());
+  if (xs.empty())
+    groups_.erase(j);
+  slots_.erase(i);
+}
+
+void worker_groups::reset() {
+  for (auto& kvp : groups_)
+    kvp.second.choices.clear();
+}
+
+bool worker_groups::group::has_member(caf::stream_slot slot) const {
+  return std::find(members.begin(), members.end(), slot) != members.end();
+}
+
+} // namespace detail
+} // namespace broker
@@ -0,0 +1,58 @@
+#include "broker/detail/zeek_batcher.hh"
+
+#include <algorithm>
+
+#include "broker/zeek.hh"
+
+namespace broker {
+namespace detail {
+
+namespace {
+
+bool is_batch(const data_message& x) {
+  return zeek::Message::type(get_data(x)) == zeek::Message::Type::Batch;
+}
+
+} // namespace
+
+zeek_batcher::batch_list::iterator zeek_batcher::find(const topic& t) {
+  return std::find_if(batches_.begin(), batches_.end(),
+                      [&](const batch_list::value_type& x) {
+                        return x.first == t;
+                      });
+}
+
+bool zeek_batcher::is_event(const data& x) {
+  return zeek::Message::type(x) == zeek::Message::Type::Event;
+}
+
+data_message zeek_batcher::make_batch(batch_list::value_type& x) {
+  if (x.second.size() == 1)
+    return make_data_message(std::move(x.first), std::move(x.second.front()));
+  zeek::Batch batch{std::move(x.second)};
+  return make_data_message(std::move(x.first), batch.move_data());
+}
+
+void unbatch_zeek_messages(std::vector<data_message>& xs) {
+  if (std::none_of(xs.begin(), xs.end(), is_batch))
+    return;
+  std::vector<data_message> result;
+  result.reserve(xs.size());
+  for (auto& x : xs) {
+    if (!is_batch(x)) {
+      result.emplace_back(std::move(x));
+      continue;
+    }
+    zeek::Batch batch{move_data(x)};
+    if (!batch.valid()) {
+      result.emplace_back(get_topic(x), batch.move_data());
+      continue;
+    }
+    for (auto& msg : batch.batch())
+      result.emplace_back(get_topic(x), std::move(msg));
+  }
+  xs.swap(result);
+}
+
+} // namespace detail
+} // namespace broker
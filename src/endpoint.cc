@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <unordered_set>
 
@@ -9,6 +11,7 @@
 #include <caf/error.hpp>
 #include <caf/duration.hpp>
 #include <caf/send.hpp>
+#include <caf/spawn_options.hpp>
 #include <caf/actor.hpp>
 #include <caf/message.hpp>
 #include <caf/io/middleman.hpp>
@@ -19,6 +22,8 @@
 #include "broker/defaults.hh"
 #include "broker/detail/die.hh"
 #include "broker/detail/filesystem.hh"
+#include "broker/detail/ktls.hh"
+#include "broker/detail/shared_snapshot.hh"
 #include "broker/endpoint.hh"
 #include "broker/logger.hh"
 #include "broker/publisher.hh"
@@ -30,12 +35,25 @@ namespace broker {
 
 // --- nested classes ----------------------------------------------------------
 
+namespace {
+
+// Turns the heap of pending messages into a min-heap.
+struct later {
+  template <class T>
+  bool operator()(const T& x, const T& y) const noexcept {
+    return x.due != y.due ? x.due > y.due : x.seq > y.seq;
+  }
+};
+
+} // namespace
+
 endpoint::clock::clock(caf::actor_system* sys, bool use_real_time)
   : sys_(sys),
     real_time_(use_real_time),
     time_since_epoch_(),
     mtx_(),
     pending_(),
+    next_seq_(0),
     pending_count_() {
   // nop
 }
@@ -58,36 +76,45 @@ void endpoint::clock::advance_time(timestamp t) {
 
   lock_type guard{mtx_};
 
-  auto it = pending_.begin();
-
-  if (it->first > t)
+  if (pending_.front().due > t)
     return;
 
+  // Pop all due messages in order and send them after releasing the lock, so
+  // that actors calling send_later do not wait for us.
+  pending_msgs_heap_type due;
+  while (!pending_.empty() && pending_.front().due <= t) {
+    std::pop_heap(pending_.begin(), pending_.end(), later{});
+    due.emplace_back(std::move(pending_.back()));
+    pending_.pop_back();
+  }
+  pending_count_ -= due.size();
+
+  guard.unlock();
+
   // Note: this function is performance-sensitive in the case of Zeek
   // reading pcaps and it's important to not construct this set unless
   // it's actually going to be used.
   std::unordered_set<caf::actor> sync_with_actors;
 
-  while (it != pending_.end() && it->first <= t) {
-    auto& pm = it->second;
-    caf::anon_send(pm.first, std::move(pm.second));
-    sync_with_actors.emplace(pm.first);
-    it = pending_.erase(it);
-    --pending_count_;
+  for (auto& pm : due) {
+    caf::anon_send(pm.dest, std::move(pm.msg));
+    sync_with_actors.emplace(pm.dest);
   }
 
-  guard.unlock();
-
+  // Sync with all actors at once rather than waiting for each actor in turn.
   caf::scoped_actor self{*sys_};
-  for (auto& who : sync_with_actors) {
+  for (auto& who : sync_with_actors)
     self->send(who, atom::sync_point::value, self);
-    self->delayed_send(self, timeout::frontend, atom::tick::value);
+  self->delayed_send(self, timeout::frontend, atom::tick::value);
+  auto timed_out = false;
+  for (size_t i = 0; i < sync_with_actors.size() && !timed_out; ++i) {
     self->receive(
       [&](atom::sync_point) {
         // nop
       },
       [&](atom::tick) {
         BROKER_DEBUG("advance_time actor syncing timed out");
+        timed_out = true;
       },
       [&](caf::error& e) {
         BROKER_DEBUG("advance_time actor syncing failed");
@@ -109,7 +136,9 @@ void endpoint::clock::send_later(caf::actor dest, timespan after,
   }
   lock_type guard{mtx_};
   auto t = this->now() + after;
-  pending_.emplace(t, pending_msg_type{std::move(dest), std::move(msg)});
+  pending_.emplace_back(
+    pending_msg_type{t, next_seq_++, std::move(dest), std::move(msg)});
+  std::push_heap(pending_.begin(), pending_.end(), later{});
   ++pending_count_;
 }
 
@@ -166,16 +195,28 @@ void pretty_print(std::ostream& out, const caf::settings& xs,
 } // namespace
 
 endpoint::endpoint(configuration config)
+  : endpoint(std::move(config), nullptr) {
+  // nop
+}
+
+endpoint::endpoint(configuration config, shared_system_ptr sys)
   : config_(std::move(config)),
+    shared_system_(std::move(sys)),
+    system_(nullptr),
     await_stores_on_shutdown_(false),
     destroyed_(false) {
   // Stop immediately if any helptext was printed.
   if (config_.cli_helptext_printed)
     exit(0);
+  // Actors read their settings from the configuration of the actor system,
+  // which only differs from ours on a shared system.
+  auto& sys_cfg = shared_system_ ? shared_system_->config() : config_;
   // Create a directory for storing the meta data if requested.
-  auto meta_dir = get_or(config_, "broker.recording-directory",
+  auto meta_dir = get_or(sys_cfg, "broker.recording-directory",
                          defaults::recording_directory);
-  if (!meta_dir.empty()) {
+  if (shared_system_ && !meta_dir.empty()) {
+    BROKER_WARNING("recording requires an actor system per endpoint");
+  } else if (!meta_dir.empty()) {
     if (detail::is_directory(meta_dir))
       detail::remove_all(meta_dir);
     if (detail::mkdirs(meta_dir)) {
@@ -191,12 +232,43 @@ endpoint::endpoint(configuration config)
     }
   }
   // Initialize remaining state.
-  new (&system_) caf::actor_system(config_);
-  clock_ = new clock(&system_, config_.options().use_real_time);
-  if (( !config_.options().disable_ssl) && !system_.has_openssl_manager())
+  if (shared_system_) {
+    system_ = &shared_system_->system();
+  } else {
+    new (&own_system_) caf::actor_system(config_);
+    system_ = &own_system_;
+  }
+  clock_ = new clock(system_, config_.options().use_real_time);
+  if (( !config_.options().disable_ssl) && !system_->has_openssl_manager())
       detail::die("CAF OpenSSL manager is not available");
+  if (!config_.options().disable_ssl
+      && get_or(sys_cfg, "broker.ktls", defaults::ktls)
+      && !detail::enable_ktls())
+    BROKER_WARNING("kTLS unavailable: encrypt TLS records in user space");
   BROKER_INFO("creating endpoint");
-  core_ = system_.spawn(core_actor, filter_type{}, config_.options(), clock_);
+  memory_ = caf::make_counted<detail::memory_accounting>(config_);
+  // A pinned core needs a thread of its own.
+  if (get_or(sys_cfg, "broker.core-cpu", defaults::core_cpu) >= 0)
+    core_ = system_->spawn<caf::detached>(accounted_core_actor,
+                                         filter_type{}, config_.options(),
+                                         clock_, memory_);
+  else
+    core_ = system_->spawn(accounted_core_actor, filter_type{},
+                          config_.options(), clock_, memory_);
+  publish_batch_size_ = get_or(config_, "broker.publish-batch-size",
+                               defaults::publish_batch_size);
+  publish_batch_delay_ = get_or(config_, "broker.publish-batch-delay",
+                                defaults::publish_batch_delay);
+  if (publish_batch_size_ > 1) {
+    publish_buf_.reserve(publish_batch_size_);
+    publish_flusher_ = make_actor([this](caf::event_based_actor* self) {
+      self->become(
+        [this](atom::flush) { flush_publish_buffer(); },
+        [self](atom::sync_point, caf::actor& who) {
+          self->send(who, atom::sync_point::value);
+        });
+    });
+  }
 }
 
 endpoint::~endpoint() {
@@ -205,16 +277,23 @@ endpoint::~endpoint() {
 }
 
 void endpoint::shutdown() {
-  BROKER_INFO("shutting down endpoint");
+  shutdown(get_or(config_, "broker.shutdown.timeout",
+                  defaults::shutdown::timeout));
+}
+
+size_t endpoint::shutdown(timespan timeout) {
+  BROKER_INFO("shutting down endpoint" << BROKER_ARG(timeout));
   if (destroyed_)
-    return;
+    return 0;
   destroyed_ = true;
+  if (publish_batch_size_ > 1)
+    flush_publish_buffer();
   if (!await_stores_on_shutdown_) {
     BROKER_DEBUG("tell core actor to terminate stores");
     anon_send(core_, atom::shutdown::value, atom::store::value);
   }
   if (!children_.empty()) {
-    caf::scoped_actor self{system_};
+    caf::scoped_actor self{*system_};
     BROKER_DEBUG("send exit messages to all children");
     for (auto& child : children_)
       // exit_reason::kill seems more reliable than
@@ -226,12 +305,38 @@ void endpoint::shutdown() {
     self->wait_for(children_);
     children_.clear();
   }
-  BROKER_DEBUG("send shutdown message to core actor");
-  anon_send(core_, atom::shutdown::value);
+  size_t unsent = 0;
+  if (timeout.count() > 0) {
+    BROKER_DEBUG("wait for core actor to send buffered messages to peers");
+    caf::scoped_actor self{*system_};
+    self->request(core_, caf::infinite, atom::shutdown::value, timeout)
+      .receive(
+        [&](count n) {
+          unsent = n;
+        },
+        [&](caf::error& err) {
+          BROKER_DEBUG("core actor failed to shut down gracefully:" << err);
+        });
+  } else {
+    BROKER_DEBUG("send shutdown message to core actor");
+    anon_send(core_, atom::shutdown::value);
+  }
+  if (shared_system_) {
+    // Other endpoints keep the system running. Hence, wait for our core
+    // instead of waiting for the system to shut down.
+    BROKER_DEBUG("wait for core actor to terminate");
+    caf::scoped_actor self{*system_};
+    self->wait_for(core_);
+  }
   core_ = nullptr;
-  system_.~actor_system();
+  if (shared_system_)
+    shared_system_ = nullptr;
+  else
+    own_system_.~actor_system();
+  system_ = nullptr;
   delete clock_;
   clock_ = nullptr;
+  return unsent;
 }
 
 uint16_t endpoint::listen(const std::string& address, uint16_t port) {
@@ -241,7 +346,7 @@ uint16_t endpoint::listen(const std::string& address, uint16_t port) {
   char const* addr = address.empty() ? nullptr : address.c_str();
   expected<uint16_t> res = caf::error{};
   if (config_.options().disable_ssl)
-    res = system_.middleman().publish(core(), port, addr, true);
+    res = system_->middleman().publish(core(), port, addr, true);
   else
     res = caf::openssl::publish(core(), port, addr, true);
   return res ? *res : 0;
@@ -254,7 +359,7 @@ bool endpoint::peer(const std::string& address, uint16_t port,
                                       << "retry:" << to_string(retry)
                                       << "[synchronous]");
   bool result = false;
-  caf::scoped_actor self{system_};
+  caf::scoped_actor self{*system_};
   self->request(core_, caf::infinite, atom::peer::value,
                 network_info{address, port, retry})
   .receive(
@@ -283,7 +388,7 @@ bool endpoint::unpeer(const std::string& address, uint16_t port) {
   BROKER_INFO("stopping to peer with" << address << ":" << port
                                       << "[synchronous]");
   bool result = false;
-  caf::scoped_actor self{system_};
+  caf::scoped_actor self{*system_};
   self->request(core_, caf::infinite, atom::unpeer::value,
                 network_info{address, port})
   .receive(
@@ -308,7 +413,7 @@ void endpoint::unpeer_nosync(const std::string& address, uint16_t port) {
 
 std::vector<peer_info> endpoint::peers() const {
   std::vector<peer_info> result;
-  caf::scoped_actor self{system_};
+  caf::scoped_actor self{*system_};
   self->request(core(), caf::infinite, atom::get::value, atom::peer::value)
   .receive(
     [&](std::vector<peer_info>& peers) {
@@ -321,9 +426,69 @@ std::vector<peer_info> endpoint::peers() const {
   return result;
 }
 
+data endpoint::stats() const {
+  table result;
+  caf::scoped_actor self{*system_};
+  self->request<caf::message_priority::high>(core(), caf::infinite,
+                                             atom::get::value,
+                                             atom::stats::value)
+  .receive(
+    [&](data& x) {
+      if (auto xs = caf::get_if<table>(&x)) {
+        auto i = xs->find("data-stores");
+        if (i != xs->end()) {
+          result.emplace("data-stores", std::move(i->second));
+          xs->erase(i);
+        } else {
+          result.emplace("data-stores", vector{});
+        }
+        result.emplace("core", std::move(x));
+      }
+    },
+    [](const caf::error& e) {
+      detail::die("failed to get stats:", to_string(e));
+    }
+  );
+  // Drop queues that only we still know about.
+  auto prune = [](auto& xs) {
+    xs.erase(std::remove_if(xs.begin(), xs.end(),
+                            [](auto& x) { return x.second->unique(); }),
+             xs.end());
+  };
+  vector subscribers;
+  vector publishers;
+  {
+    std::unique_lock<std::mutex> guard{queues_mtx_};
+    prune(subscriber_queues_);
+    prune(publisher_queues_);
+    for (auto& kvp : subscriber_queues_) {
+      vector topics;
+      for (auto& t : kvp.first)
+        topics.emplace_back(t.string());
+      subscribers.emplace_back(
+        table{{"topics", std::move(topics)},
+              {"buffered", count{kvp.second->buffer_size()}},
+              {"buffered-bytes", count{kvp.second->buffered_bytes()}},
+              {"rate", count{kvp.second->rate()}}});
+    }
+    for (auto& kvp : publisher_queues_) {
+      auto pending = kvp.second->pending();
+      publishers.emplace_back(
+        table{{"topic", kvp.first.string()},
+              {"buffered", count{kvp.second->buffer_size()}},
+              {"capacity", count{kvp.second->capacity()}},
+              {"buffered-bytes", count{kvp.second->buffered_bytes()}},
+              {"demand", count{pending > 0 ? static_cast<count>(pending) : 0}}});
+    }
+  }
+  result.emplace("subscribers", std::move(subscribers));
+  result.emplace("publishers", std::move(publishers));
+  return result;
+}
+
 std::vector<topic> endpoint::peer_subscriptions() const {
   std::vector<topic> result;
-  caf::scoped_actor self{system_};
+  caf::scoped_actor self{*system_};
   self->request(core(), caf::infinite, atom::get::value,
                 atom::peer::value, atom::subscriptions::value)
   .receive(
@@ -343,26 +508,62 @@ void endpoint::forward(std::vector<topic> ts)
   caf::anon_send(core(), atom::subscribe::value, std::move(ts));
 }
 
+void endpoint::sample_recording(size_t rate, std::vector<std::string> rules) {
+  BROKER_INFO("sample recording" << BROKER_ARG(rate) << BROKER_ARG(rules));
+  caf::anon_send(core(), atom::recording::value, atom::update::value,
+                 static_cast<uint64_t>(rate), std::move(rules));
+}
+
 void endpoint::publish(topic t, data d) {
-  BROKER_INFO("publishing" << std::make_pair(t, d));
-  caf::anon_send(core(), atom::publish::value,
-                 make_data_message(std::move(t), std::move(d)));
+  BROKER_DEBUG("publishing" << std::make_pair(t, d));
+  publish_to_core(make_data_message(std::move(t), std::move(d)));
 }
 
 void endpoint::publish(const endpoint_info& dst, topic t, data d) {
-  BROKER_INFO("publishing" << std::make_pair(t, d) << "to" << dst.node);
+  BROKER_DEBUG("publishing" << std::make_pair(t, d) << "to" << dst.node);
+  // Earlier messages must reach the core first.
+  if (publish_batch_size_ > 1)
+    flush_publish_buffer();
   caf::anon_send(core(), atom::publish::value, dst,
                  make_data_message(std::move(t), std::move(d)));
 }
 
 void endpoint::publish(data_message x){
-  BROKER_INFO("publishing" << x);
-  caf::anon_send(core(), atom::publish::value, std::move(x));
+  BROKER_DEBUG("publishing" << x);
+  publish_to_core(std::move(x));
+}
+
+void endpoint::publish_to_core(data_message x) {
+  if (publish_batch_size_ < 2) {
+    caf::anon_send(core(), atom::publish::value, std::move(x));
+    return;
+  }
+  std::unique_lock<std::mutex> guard{publish_mtx_};
+  publish_buf_.emplace_back(std::move(x));
+  if (publish_buf_.size() >= publish_batch_size_)
+    flush_publish_buffer_locked();
+  else if (publish_buf_.size() == 1)
+    clock_->send_later(publish_flusher_, publish_batch_delay_,
+                       caf::make_message(atom::flush::value));
+}
+
+void endpoint::flush_publish_buffer() {
+  std::unique_lock<std::mutex> guard{publish_mtx_};
+  flush_publish_buffer_locked();
+}
+
+void endpoint::flush_publish_buffer_locked() {
+  if (publish_buf_.empty())
+    return;
+  std::vector<data_message> xs;
+  xs.reserve(publish_batch_size_);
+  xs.swap(publish_buf_);
+  caf::anon_send(core(), atom::publish::value, std::move(xs));
 }
 
 
 void endpoint::publish(std::vector<data_message> xs) {
-  BROKER_INFO("publishing" << xs.size() << "messages");
+  BROKER_DEBUG("publishing" << xs.size() << "messages");
   for (auto& x : xs)
     publish(std::move(x));
 }
@@ -373,6 +574,12 @@ publisher endpoint::make_publisher(topic ts) {
   return result;
 }
 
+publisher endpoint::make_publisher(topic ts, size_t queue_size) {
+  publisher result{*this, std::move(ts), queue_size};
+  children_.emplace_back(result.worker());
+  return result;
+}
+
 status_subscriber endpoint::make_status_subscriber(bool receive_statuses) {
   status_subscriber result{*this, receive_statuses};
   children_.emplace_back(result.worker());
@@ -385,8 +592,24 @@ subscriber endpoint::make_subscriber(std::vector<topic> ts, size_t max_qsize) {
   return result;
 }
 
+subscriber endpoint::make_subscriber(std::vector<topic> ts, predicate pred,
+                                     size_t max_qsize) {
+  subscriber result{*this, std::move(ts), max_qsize, std::move(pred)};
+  children_.emplace_back(result.worker());
+  return result;
+}
+
+subscriber endpoint::make_subscriber(std::vector<topic> ts,
+                                     consumer_group group, predicate pred,
+                                     size_t max_qsize) {
+  subscriber result{*this, std::move(ts), max_qsize, std::move(pred),
+                    std::move(group)};
+  children_.emplace_back(result.worker());
+  return result;
+}
+
 caf::actor endpoint::make_actor(actor_init_fun f) {
-  auto hdl = system_.spawn([=](caf::event_based_actor* self) {
+  auto hdl = system_->spawn([=](caf::event_based_actor* self) {
 #ifndef CAF_NO_EXCEPTION
     // "Hide" unhandled-exception warning if users throw.
     self->set_exception_handler(
@@ -402,11 +625,34 @@ caf::actor endpoint::make_actor(actor_init_fun f) {
   return hdl;
 }
 
+void endpoint::register_queue(filter_type filter,
+                              detail::shared_subscriber_queue_ptr<> queue) {
+  std::unique_lock<std::mutex> guard{queues_mtx_};
+  subscriber_queues_.emplace_back(std::move(filter), std::move(queue));
+}
+
+void endpoint::register_queue(topic t,
+                              detail::shared_publisher_queue_ptr<> queue) {
+  std::unique_lock<std::mutex> guard{queues_mtx_};
+  publisher_queues_.emplace_back(std::move(t), std::move(queue));
+}
+
+void endpoint::update_queue(const detail::shared_subscriber_queue_ptr<>& queue,
+                            filter_type filter) {
+  std::unique_lock<std::mutex> guard{queues_mtx_};
+  for (auto& kvp : subscriber_queues_) {
+    if (kvp.second == queue) {
+      kvp.first = std::move(filter);
+      return;
+    }
+  }
+}
+
 expected<store> endpoint::attach_master(std::string name, backend type,
                                         backend_options opts) {
   BROKER_INFO("attaching master store" << name << "of type" << type);
   expected<store> res{ec::unspecified};
-  caf::scoped_actor self{system_};
+  caf::scoped_actor self{*system_};
   self->request(core(), caf::infinite, atom::store::value, atom::master::value,
                 atom::attach::value, name, type, std::move(opts))
   .receive(
@@ -417,6 +663,40 @@ expected<store> endpoint::attach_master(std::string name, backend type,
       res = std::move(e);
     }
   );
+  if (res && type == backend::memory
+      && get_or(config_, "broker.store.read-snapshots",
+                defaults::store::read_snapshots)) {
+    // Sharded stores have no single snapshot. In this case, the request fails
+    // and the store keeps sending all reads to its frontend.
+    self->request(res->frontend(), caf::infinite, atom::get::value,
+                  atom::snapshot::value)
+    .receive(
+      [&](detail::shared_snapshot_ptr& ptr) {
+        res->snapshot_ = std::move(ptr);
+      },
+      [&](caf::error&) {
+        // nop
+      }
+    );
+  }
+  return res;
+}
+
+expected<store> endpoint::attach_standby(std::string name, backend type,
+                                         backend_options opts) {
+  BROKER_INFO("attaching standby store" << name << "of type" << type);
+  expected<store> res{ec::unspecified};
+  caf::scoped_actor self{*system_};
+  self->request(core(), caf::infinite, atom::store::value, atom::standby::value,
+                atom::attach::value, name, type, std::move(opts))
+  .receive(
+    [&](caf::actor& standby) {
+      res = store{std::move(standby), std::move(name)};
+    },
+    [&](caf::error& e) {
+      res = std::move(e);
+    }
+  );
   return res;
 }
 
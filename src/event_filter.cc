@@ -0,0 +1,84 @@
+#include "broker/event_filter.hh"
+
+#include <algorithm>
+#include <iterator>
+
+#include "broker/packed.hh"
+#include "broker/predicate.hh"
+
+namespace broker {
+
+namespace {
+
+// Merges the sorted names `ys` into the sorted names `xs`.
+bool merge_names(std::vector<std::string>& xs,
+                 const std::vector<std::string>& ys) {
+  std::vector<std::string> result;
+  result.reserve(xs.size() + ys.size());
+  std::set_union(xs.begin(), xs.end(), ys.begin(), ys.end(),
+                 std::back_inserter(result));
+  if (result.size() == xs.size())
+    return false;
+  xs.swap(result);
+  return true;
+}
+
+} // namespace
+
+bool accepts(const event_filter& f, const topic& t, const data& x) {
+  if (f.empty() || is_packed(x))
+    return true;
+  // Entries only exist for topics that cover no unrestricted subscriber.
+  // Hence, the first entry with a prefix of `t` decides.
+  for (auto& [key, names] : f)
+    if (key.prefix_of(t))
+      return has_event_name(names, x);
+  return true;
+}
+
+bool add_subscribers(event_filter& f, const filter_type& g,
+                     const filter_type& xs,
+                     const std::vector<std::string>& names) {
+  auto changed = false;
+  for (auto& x : xs) {
+    if (names.empty()) {
+      // Lift the restriction of all topics that overlap with `x`.
+      for (auto i = f.begin(); i != f.end();) {
+        if (i->first.prefix_of(x) || x.prefix_of(i->first)) {
+          i = f.erase(i);
+          changed = true;
+        } else {
+          ++i;
+        }
+      }
+    } else if (covers(g, x)) {
+      // Topics without an entry remain unrestricted.
+      for (auto& [key, ys] : f)
+        if (key.prefix_of(x) && merge_names(ys, names))
+          changed = true;
+    } else {
+      // `x` replaces all topics of `g` that it is a prefix of and inherits
+      // their restrictions, unless one of them has none.
+      auto restricted = true;
+      auto merged = names;
+      for (auto& y : g) {
+        if (!x.prefix_of(y))
+          continue;
+        if (auto i = f.find(y); i != f.end()) {
+          merge_names(merged, i->second);
+          f.erase(i);
+          changed = true;
+        } else {
+          restricted = false;
+        }
+      }
+      if (restricted) {
+        f[x] = std::move(merged);
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+} // namespace broker
@@ -0,0 +1,56 @@
+#include "broker/filter_type.hh"
+
+#include <algorithm>
+#include <string>
+
+#include "broker/detail/hash.hh"
+
+namespace broker {
+
+void normalize(filter_type& f) {
+  if (f.empty())
+    return;
+  // After sorting, all topics that start with a given prefix directly follow
+  // that prefix. Hence, comparing with the last topic we keep suffices.
+  std::sort(f.begin(), f.end());
+  auto prefix = f.begin();
+  auto last = f.begin();
+  for (auto i = std::next(f.begin()); i != f.end(); ++i) {
+    if (*i == *last)
+      continue;
+    auto covered = prefix->prefix_of(*i);
+    // Cores look for master topics explicitly to detect existing masters.
+    if (covered && !i->is_master_topic())
+      continue;
+    if (++last != i)
+      *last = std::move(*i);
+    if (!covered)
+      prefix = last;
+  }
+  f.erase(std::next(last), f.end());
+}
+
+uint64_t digest(const filter_type& f) {
+  detail::hash_state h;
+  h.add(f.size());
+  for (auto& x : f)
+    h.add_bytes(x.string().data(), x.string().size());
+  return h.result();
+}
+
+bool covers(const filter_type& f, const topic& x) {
+  // In a normalized filter, any topic between a prefix of `x` and `x` itself
+  // starts with that prefix and thus must be a master topic. Hence, we only
+  // need to look at the predecessors of `x` up to the first regular topic.
+  auto i = std::upper_bound(f.begin(), f.end(), x);
+  while (i != f.begin()) {
+    --i;
+    if (i->prefix_of(x))
+      return true;
+    if (!i->is_master_topic())
+      return false;
+  }
+  return false;
+}
+
+} // namespace broker
@@ -0,0 +1,23 @@
+#include "broker/packed.hh"
+
+#include "broker/error.hh"
+
+#include "broker/detail/blob.hh"
+
+namespace broker {
+
+data pack(const data& x) {
+  return packed_data{detail::to_compact_blob(x)};
+}
+
+expected<data> unpack(const data& x) {
+  auto ptr = caf::get_if<packed_data>(&x);
+  if (ptr == nullptr)
+    return ec::invalid_data;
+  data result;
+  if (detail::from_compact_blob(ptr->bytes.data(), ptr->bytes.size(), result))
+    return ec::invalid_data;
+  return result;
+}
+
+} // namespace broker
@@ -0,0 +1,72 @@
+#include "broker/predicate.hh"
+
+#include <algorithm>
+
+#include <caf/variant.hpp>
+
+#include "broker/packed.hh"
+#include "broker/zeek.hh"
+
+namespace broker {
+
+const data* get_field(const data& x, const std::vector<count>& path) {
+  auto result = &x;
+  for (auto index : path) {
+    auto xs = caf::get_if<vector>(result);
+    if (xs == nullptr || index >= xs->size())
+      return nullptr;
+    result = &(*xs)[index];
+  }
+  return result;
+}
+
+// Inspects the content of `x` in place, because the Zeek message classes
+// require a copy of the data.
+bool has_event_name(const std::vector<std::string>& names, const data& x) {
+  auto type = zeek::Message::type(x);
+  if (type != zeek::Message::Type::Event && type != zeek::Message::Type::Batch)
+    return false;
+  auto& msg = caf::get<vector>(x);
+  if (msg.size() < 3)
+    return false;
+  auto content = caf::get_if<vector>(&msg[2]);
+  if (content == nullptr)
+    return false;
+  if (type == zeek::Message::Type::Batch)
+    return std::any_of(content->begin(), content->end(), [&](const data& y) {
+      return has_event_name(names, y);
+    });
+  if (content->empty())
+    return false;
+  auto name = caf::get_if<std::string>(&content->front());
+  return name != nullptr
+         && std::binary_search(names.begin(), names.end(), *name);
+}
+
+bool operator==(const field_condition& x, const field_condition& y) {
+  return x.path == y.path && x.value == y.value;
+}
+
+bool operator==(const predicate& x, const predicate& y) {
+  return x.event_names == y.event_names && x.fields == y.fields;
+}
+
+void normalize(predicate& x) {
+  auto& xs = x.event_names;
+  std::sort(xs.begin(), xs.end());
+  xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+}
+
+bool matches(const predicate& pred, const data& x) {
+  if (pred.empty() || is_packed(x))
+    return true;
+  if (!pred.event_names.empty() && !has_event_name(pred.event_names, x))
+    return false;
+  return std::all_of(pred.fields.begin(), pred.fields.end(),
+                     [&](const field_condition& cond) {
+                       auto y = get_field(x, cond.path);
+                       return y != nullptr && *y == cond.value;
+                     });
+}
+
+} // namespace broker
@@ -4,29 +4,44 @@
 #include <caf/send.hpp>
 
 #include "broker/data.hh"
+#include "broker/defaults.hh"
 #include "broker/endpoint.hh"
 #include "broker/message.hh"
 #include "broker/topic.hh"
 
+#include "broker/detail/zeek_batcher.hh"
+
 using namespace caf;
 
 namespace broker {
 
 namespace {
 
-// TODO: make these constants configurable
-
-/// Defines how many seconds are averaged for the computation of the send rate.
-constexpr size_t sample_size = 10;
-
-/// Defines how many items are stored in the queue.
-constexpr size_t queue_size = 30;
-
 struct publisher_worker_state {
   std::vector<size_t> buf;
   size_t counter = 0;
   bool shutting_down = false;
 
+  /// Upper bound for the time items wait in partial batches. 0 leaves
+  /// batching to CAF.
+  timespan latency_target = defaults::publisher::latency_target;
+
+  /// Signals whether a delayed flush is on its way.
+  bool flush_scheduled = false;
+
+  /// Packs Zeek events into batch messages if enabled.
+  detail::zeek_batcher zeek_batches;
+
+  /// Upper bound for the time Zeek events wait in partial batches.
+  timespan zeek_batch_latency = defaults::publisher::zeek_batch_latency;
+
+  /// Signals whether a delayed flush of partial Zeek batches is on its way.
+  bool zeek_flush_scheduled = false;
+
+  /// Defines how many seconds are averaged for the computation of the send
+  /// rate.
+  size_t sample_size = defaults::publisher::rate_window;
+
   static const char* name;
 
   void tick() {
@@ -51,6 +66,18 @@ const char* publisher_worker_state::name = "publisher_worker";
 behavior publisher_worker(stateful_actor<publisher_worker_state>* self,
                           endpoint* ep,
                           detail::shared_publisher_queue_ptr<> qptr) {
+  self->state.sample_size = get_or(self->system().config(),
+                                   "broker.publisher.rate-window",
+                                   defaults::publisher::rate_window);
+  self->state.latency_target = get_or(self->system().config(),
+                                      "broker.publisher.latency-target",
+                                      defaults::publisher::latency_target);
+  self->state.zeek_batches = detail::zeek_batcher{
+    get_or(self->system().config(), "broker.publisher.zeek-batch-size",
+           defaults::publisher::zeek_batch_size)};
+  self->state.zeek_batch_latency = get_or(
+    self->system().config(), "broker.publisher.zeek-batch-latency",
+    defaults::publisher::zeek_batch_latency);
   auto handler = self->make_source(
     ep->core(),
     [](unit_t&) {
@@ -58,22 +85,66 @@ behavior publisher_worker(stateful_actor<publisher_worker_state>* self,
     },
     [=](unit_t&, downstream<data_message>& out, size_t num) {
       auto& st = self->state;
+      auto emit = [&](data_message&& x) { out.push(std::move(x)); };
       auto consumed = qptr->consume(num, [&](data_message&& x) {
-        out.push(std::move(x));
+        st.zeek_batches.add(std::move(x), emit);
       });
       if (consumed > 0) {
         st.counter += consumed;
       }
+      // Bounds the time Zeek events wait in partial batches.
+      if (!st.zeek_batches.empty() && !st.zeek_flush_scheduled) {
+        st.zeek_flush_scheduled = true;
+        self->delayed_send(self, st.zeek_batch_latency, atom::tick::value,
+                           atom::flush::value);
+      }
     },
     [=](const unit_t&) {
-      return self->state.shutting_down && qptr->buffer_size() == 0;
+      auto& st = self->state;
+      return st.shutting_down && qptr->buffer_size() == 0
+             && st.zeek_batches.empty();
     }
   ).ptr();
+  // With a latency target, sends partial batches right away when the
+  // publisher has nothing more in its queue (i.e., the rate is low) and
+  // otherwise within the target. Busy publishers still fill full batches.
+  auto flush_partial_batches = [=] {
+    auto& st = self->state;
+    if (st.latency_target.count() == 0 || handler->out().buffered() == 0)
+      return;
+    if (qptr->buffer_size() == 0) {
+      handler->out().force_emit_batches();
+    } else if (!st.flush_scheduled) {
+      st.flush_scheduled = true;
+      self->delayed_send(self, st.latency_target, atom::flush::value);
+    }
+  };
+  // Emits all partial batches of Zeek events.
+  auto flush_zeek_batches = [=] {
+    auto& out = handler->out();
+    self->state.zeek_batches.flush(
+      [&](data_message&& x) { out.push(std::move(x)); });
+  };
   //self->delayed_send(self, std::chrono::seconds(1), atom::tick::value);
   return {
     [=](atom::resume) {
+      qptr->wakeup_received();
       if (handler->generate_messages())
         handler->push();
+      flush_partial_batches();
+    },
+    [=](atom::flush) {
+      self->state.flush_scheduled = false;
+      if (handler->out().buffered() > 0)
+        handler->out().force_emit_batches();
+    },
+    [=](atom::tick, atom::flush) {
+      self->state.zeek_flush_scheduled = false;
+      if (self->state.zeek_batches.empty())
+        return;
+      flush_zeek_batches();
+      handler->push();
+      flush_partial_batches();
     },
     [=](atom::tick) {
       auto& st = self->state;
@@ -85,6 +156,7 @@ behavior publisher_worker(stateful_actor<publisher_worker_state>* self,
       self->state.shutting_down = true;
       self->unbecome();
       handler->generate_messages();
+      flush_zeek_batches();
       // triggers the stream to terminate if the queue is already empty
       handler->push();
     }
@@ -94,11 +166,21 @@ behavior publisher_worker(stateful_actor<publisher_worker_state>* self,
 } // namespace <anonymous>
 
 publisher::publisher(endpoint& ep, topic t)
+  : publisher(ep, std::move(t),
+              get_or(ep.system().config(), "broker.publisher.queue-size",
+                     defaults::publisher::queue_size)) {
+  // nop
+}
+
+publisher::publisher(endpoint& ep, topic t, size_t queue_size)
   : drop_on_destruction_(false),
-    queue_(detail::make_shared_publisher_queue(queue_size)),
+    queue_(detail::make_shared_publisher_queue(
+      std::max(queue_size, size_t{1}),
+      get_or(ep.system().config(), "broker.publisher.queue-bytes",
+             defaults::publisher::queue_bytes))),
     worker_(ep.system().spawn(publisher_worker, &ep, queue_)),
     topic_(std::move(t)) {
-  // nop
+  ep.register_queue(topic_, queue_);
 }
 
 publisher::~publisher() {
@@ -121,6 +203,10 @@ size_t publisher::capacity() const {
   return queue_->capacity();
 }
 
+size_t publisher::buffered_bytes() const {
+  return queue_->buffered_bytes();
+}
+
 size_t publisher::free_capacity() const {
   auto x = capacity();
   auto y = buffered();
@@ -136,27 +222,56 @@ void publisher::drop_all_on_destruction() {
 }
 
 void publisher::publish(data x) {
-  BROKER_INFO("publishing" << std::make_pair(topic_, x));
+  BROKER_DEBUG("publishing" << std::make_pair(topic_, x));
   if (queue_->produce(topic_, std::move(x)))
-    anon_send(worker_, atom::resume::value);
+    wakeup();
 }
 
 void publisher::publish(std::vector<data> xs) {
-  auto t = static_cast<ptrdiff_t>(queue_->capacity());
-  auto i = xs.begin();
-  auto e = xs.end();
-  while (i != e) {
-    auto j = i + std::min(std::distance(i, e), t);
 #ifdef DEBUG
-    BROKER_INFO("publishing batch of size" << (j - i));
-    for (auto l = i; l < j; l++) {
-      BROKER_INFO("publishing" << std::make_pair(topic_, *l));
-    }
+  BROKER_DEBUG("publishing batch of size" << xs.size());
+  for (auto& x : xs)
+    BROKER_DEBUG("publishing" << std::make_pair(topic_, x));
 #endif
-    if (queue_->produce(topic_, i, j))
-      anon_send(worker_, atom::resume::value);
-    i = j;
-  }
+  // Hands the entire batch to the worker, which creates the messages while
+  // pushing them downstream.
+  if (queue_->produce(topic_, std::move(xs)))
+    wakeup();
+}
+
+void publisher::publish(topic t, data x) {
+  BROKER_DEBUG("publishing" << std::make_pair(t, x));
+  if (queue_->produce(data_message{std::move(t), std::move(x)}))
+    wakeup();
+}
+
+void publisher::publish(std::vector<data_message> xs) {
+  if (queue_->produce(std::move(xs)))
+    wakeup();
+}
+
+bool publisher::try_publish(data x) {
+  bool wakeup_consumer = false;
+  auto first = &x;
+  auto last = first + 1;
+  if (queue_->try_produce(topic_, first, last, wakeup_consumer) == first)
+    return false;
+  if (wakeup_consumer)
+    wakeup();
+  return true;
+}
+
+size_t publisher::try_publish(std::vector<data>& xs) {
+  bool wakeup_consumer = false;
+  auto i = queue_->try_produce(topic_, xs.begin(), xs.end(), wakeup_consumer);
+  if (wakeup_consumer)
+    wakeup();
+  return static_cast<size_t>(std::distance(xs.begin(), i));
+}
+
+void publisher::wakeup() {
+  if (queue_->request_wakeup())
+    anon_send(worker_, atom::resume::value);
 }
 
 } // namespace broker
@@ -0,0 +1,16 @@
+#include "broker/shared_system.hh"
+
+#include <utility>
+
+namespace broker {
+
+shared_system::shared_system(configuration config)
+  : config_(std::move(config)), system_(config_) {
+  // nop
+}
+
+shared_system_ptr make_shared_system(configuration config) {
+  return std::make_shared<shared_system>(std::move(config));
+}
+
+} // namespace broker
@@ -55,7 +55,7 @@ using value_type = status_subscriber::value_type;
 
 status_subscriber::status_subscriber(endpoint& ep, bool receive_statuses)
   : impl_(ep, make_status_topics(receive_statuses),
-          std::numeric_limits<long>::max()) {
+          std::numeric_limits<long>::max(), subscriber::direct_delivery) {
   // nop
 }
 
@@ -1,3 +1,4 @@
+#include <memory>
 #include <utility>
 #include <string>
 
@@ -14,13 +15,49 @@
 #include "broker/expected.hh"
 #include "broker/internal_command.hh"
 #include "broker/detail/flare_actor.hh"
+#include "broker/detail/shared_snapshot.hh"
+#include "broker/detail/store_async_actor.hh"
 
 using namespace broker::detail;
 
 namespace broker {
 
+namespace {
+
+// Sends a command that the master answers with `(data, request_id)` and
+// blocks until the response arrives.
+template <class Command, class... Ts>
+expected<data> await_command(const caf::actor& frontend, Ts&&... xs) {
+  if (!frontend)
+    return make_error(ec::unspecified, "store not initialized");
+  expected<data> res{ec::unspecified};
+  caf::scoped_actor self{frontend->home_system()};
+  auto cmd = make_internal_command<Command>(std::forward<Ts>(xs)..., self,
+                                            request_id(-1));
+  self->send(frontend, atom::local::value, std::move(cmd));
+  self->delayed_send(self, timeout::frontend, atom::tick::value);
+  self->receive(
+    [&](data& x, request_id) {
+      res = std::move(x);
+    },
+    [&](atom::tick) {
+    },
+    [&](caf::error& e, request_id) {
+      res = std::move(e);
+    },
+    [&](caf::error& e) {
+      res = std::move(e);
+    }
+  );
+  return res;
+}
+
+} // namespace
+
 store::proxy::proxy(store& s) : frontend_{s.frontend_} {
-  proxy_ = frontend_.home_system().spawn<flare_actor>();
+  // Fire the mailbox once per burst of responses rather than once per
+  // response to keep the number of syscalls independent of the load.
+  proxy_ = frontend_.home_system().spawn<flare_actor>(true);
 }
 
 request_id store::proxy::exists(data key) {
@@ -46,6 +83,30 @@ request_id store::proxy::put_unique(data key, data val, optional<timespan> expir
   return id_;
 }
 
+request_id store::proxy::compare_and_swap(data key, data expected_value,
+                                          data value,
+                                          optional<timespan> expiry) {
+  if (!frontend_)
+    return 0;
+  send_as(proxy_, frontend_, atom::local::value,
+          make_internal_command<compare_and_swap_command>(
+            std::move(key), std::move(expected_value), std::move(value),
+            expiry, proxy_, ++id_));
+  return id_;
+}
+
+request_id store::proxy::increment_and_get(data key, data amount,
+                                           optional<timespan> expiry) {
+  if (!frontend_)
+    return 0;
+  auto init_type = increment_init_type(amount);
+  send_as(proxy_, frontend_, atom::local::value,
+          make_internal_command<add_and_get_command>(
+            std::move(key), std::move(amount), init_type, expiry, proxy_,
+            ++id_));
+  return id_;
+}
+
 request_id store::proxy::get_index_from_value(data key, data index) {
   if (!frontend_)
     return 0;
@@ -102,43 +163,93 @@ std::vector<store::response> store::proxy::receive(size_t n) {
   return rval;
 }
 
+size_t store::proxy::receive_all(std::vector<response>& xs) {
+  xs.clear();
+  auto fa = caf::actor_cast<broker::detail::flare_actor*>(proxy_);
+  if (fa == nullptr)
+    return 0;
+  // Only consume what is ready now. Since the proxy receives nothing but
+  // responses, receive_for never blocks for these messages.
+  auto n = mailbox().size();
+  if (n > 0) {
+    xs.reserve(n);
+    size_t i = 0;
+    fa->receive_for(i, n) (
+      [&](data& x, request_id id) {
+        xs.emplace_back(store::response{std::move(x), id});
+      },
+      [&](caf::error& e, request_id id) {
+        BROKER_ERROR("proxy failed to receive response from store" << id);
+        xs.emplace_back(store::response{std::move(e), id});
+      }
+    );
+  }
+  fa->extinguish_if_empty();
+  return xs.size();
+}
+
+template <class... Ts>
+void store::request_async(callback f, Ts&&... xs) const {
+  if (!async_) {
+    f(make_error(ec::unspecified, "store not initialized"));
+    return;
+  }
+  anon_send(async_, std::forward<Ts>(xs)..., std::move(f));
+}
+
+template <class... Ts>
+std::future<expected<data>> store::request_future(Ts&&... xs) const {
+  auto promise = std::make_shared<std::promise<expected<data>>>();
+  auto result = promise->get_future();
+  request_async([promise](expected<data> x) {
+                  promise->set_value(std::move(x));
+                },
+                std::forward<Ts>(xs)...);
+  return result;
+}
+
 const std::string& store::name() const {
   return name_;
 }
 
 expected<data> store::exists(data key) const {
+  if (snapshot_)
+    if (auto ss = snapshot_->load())
+      return data{ss->count(key) > 0};
   return request<data>(atom::exists::value, std::move(key));
 }
 
 expected<data> store::get(data key) const {
+  if (snapshot_) {
+    if (auto ss = snapshot_->load()) {
+      auto i = ss->find(key);
+      if (i == ss->end())
+        return make_error(ec::no_such_key);
+      return i->second;
+    }
+  }
   return request<data>(atom::get::value, std::move(key));
 }
 
 expected<data> store::put_unique(data key, data val, optional<timespan> expiry) const {
-  if (!frontend_)
-    return make_error(ec::unspecified, "store not initialized");
-
-  expected<data> res{ec::unspecified};
-  caf::scoped_actor self{frontend_->home_system()};
-  auto cmd = make_internal_command<put_unique_command>(std::move(key),
-                                                       std::move(val), expiry,
-                                                       self, request_id(-1));
-  auto msg = caf::make_message(atom::local::value, std::move(cmd));
+  return await_command<put_unique_command>(frontend_, std::move(key),
+                                           std::move(val), expiry);
+}
 
-  self->send(frontend_, std::move(msg));
-  self->delayed_send(self, timeout::frontend, atom::tick::value);
-  self->receive(
-    [&](data& x, request_id) {
-      res = std::move(x);
-    },
-    [&](atom::tick) {
-    },
-    [&](caf::error& e) {
-      res = std::move(e);
-    }
-  );
+expected<data> store::compare_and_swap(data key, data expected_value,
+                                       data value,
+                                       optional<timespan> expiry) const {
+  return await_command<compare_and_swap_command>(frontend_, std::move(key),
+                                                 std::move(expected_value),
+                                                 std::move(value), expiry);
+}
 
-  return res;
+expected<data> store::increment_and_get(data key, data amount,
+                                        optional<timespan> expiry) const {
+  auto init_type = increment_init_type(amount);
+  return await_command<add_and_get_command>(frontend_, std::move(key),
+                                            std::move(amount), init_type,
+                                            expiry);
 }
 
 expected<data> store::get_index_from_value(data key, data index) const {
@@ -149,17 +260,86 @@ expected<data> store::keys() const {
   return request<data>(atom::get::value, atom::keys::value);
 }
 
+expected<timespan> store::staleness() const {
+  auto x = request<data>(atom::get::value, atom::stale::value);
+  if (!x)
+    return std::move(x.error());
+  if (auto t = caf::get_if<timespan>(&*x))
+    return *t;
+  return make_error(ec::type_clash, "expected a timespan");
+}
+
+expected<data> store::get_many(vector keys) const {
+  return request<data>(atom::get::value, std::move(keys));
+}
+
+expected<data> store::scan(std::string prefix, size_t limit) const {
+  return request<data>(atom::scan::value, std::move(prefix),
+                       static_cast<uint64_t>(limit));
+}
+
+change_subscriber store::subscribe_changes(std::string prefix) const {
+  return change_subscriber{frontend_, std::move(prefix)};
+}
+
+void store::exists_async(data key, callback f) const {
+  request_async(std::move(f), atom::exists::value, std::move(key));
+}
+
+std::future<expected<data>> store::exists_async(data key) const {
+  return request_future(atom::exists::value, std::move(key));
+}
+
+void store::get_async(data key, callback f) const {
+  request_async(std::move(f), atom::get::value, std::move(key));
+}
+
+std::future<expected<data>> store::get_async(data key) const {
+  return request_future(atom::get::value, std::move(key));
+}
+
+void store::get_index_from_value_async(data key, data index,
+                                       callback f) const {
+  request_async(std::move(f), atom::get::value, std::move(key),
+                std::move(index));
+}
+
+std::future<expected<data>>
+store::get_index_from_value_async(data key, data index) const {
+  return request_future(atom::get::value, std::move(key), std::move(index));
+}
+
+void store::keys_async(callback f) const {
+  request_async(std::move(f), atom::get::value, atom::keys::value);
+}
+
+std::future<expected<data>> store::keys_async() const {
+  return request_future(atom::get::value, atom::keys::value);
+}
+
 void store::put(data key, data value, optional<timespan> expiry) const {
   anon_send(frontend_, atom::local::value,
             make_internal_command<put_command>(
               std::move(key), std::move(value), expiry));
 }
 
+void store::put_many(std::unordered_map<data, data> entries,
+                     optional<timespan> expiry) const {
+  anon_send(frontend_, atom::local::value,
+            make_internal_command<put_many_command>(std::move(entries),
+                                                    expiry));
+}
+
 void store::erase(data key) const {
   anon_send(frontend_, atom::local::value,
             make_internal_command<erase_command>(std::move(key)));
 }
 
+void store::erase_many(std::vector<data> keys) const {
+  anon_send(frontend_, atom::local::value,
+            make_internal_command<erase_many_command>(std::move(keys)));
+}
+
 void store::add(data key, data value, data::type init_type,
                 optional<timespan> expiry) const {
   anon_send(frontend_, atom::local::value,
@@ -167,6 +347,21 @@ void store::add(data key, data value, data::type init_type,
                                                init_type, expiry));
 }
 
+data::type store::increment_init_type(const data& amount) {
+  switch (amount.get_type()) {
+    case data::type::count:
+      return data::type::count;
+    case data::type::integer:
+      return data::type::integer;
+    case data::type::real:
+      return data::type::real;
+    case data::type::timespan:
+      return data::type::timestamp;
+    default:
+      return data::type::none;
+  }
+}
+
 void store::subtract(data key, data value, optional<timespan> expiry) const {
   anon_send(frontend_, atom::local::value,
             make_internal_command<subtract_command>(std::move(key),
@@ -180,7 +375,8 @@ void store::clear() const {
 
 store::store(caf::actor actor, std::string name)
   : frontend_{std::move(actor)}, name_{std::move(name)} {
-  // nop
+  if (frontend_)
+    async_ = frontend_.home_system().spawn(store_async_actor, frontend_);
 }
 
 } // namespace broker
@@ -1,7 +1,9 @@
 #include "broker/logger.hh" // Must come before any CAF include.
 #include "broker/subscriber.hh"
 
+#include <algorithm>
 #include <cstddef>
+#include <map>
 #include <utility>
 #include <chrono>
 #include <numeric>
@@ -10,11 +12,20 @@
 #include <caf/send.hpp>
 
 #include "broker/atoms.hh"
+#include "broker/defaults.hh"
 #include "broker/endpoint.hh"
 #include "broker/filter_type.hh"
 #include "broker/logger.hh"
+#include "broker/predicate.hh"
 
 #include "broker/detail/assert.hh"
+#include "broker/detail/subscription_index.hh"
+#include "broker/detail/tracepoint.hh"
+#include "broker/detail/zeek_batcher.hh"
+
+CAF_ALLOW_UNSAFE_MESSAGE_TYPE(broker::detail::shared_subscriber_queue_ptr<>)
+CAF_ALLOW_UNSAFE_MESSAGE_TYPE(
+  std::vector<broker::detail::shared_subscriber_queue_ptr<>>)
 
 using namespace caf;
 
@@ -59,17 +70,55 @@ public:
   using queue_ptr = detail::shared_subscriber_queue_ptr<>;
 
   subscriber_sink(scheduled_actor* self, subscriber_worker_state* state,
-                  queue_ptr qptr, size_t max_qsize)
+                  queue_ptr qptr, size_t max_qsize, bool unpack_zeek_batches)
     : stream_manager(self),
       super(self),
       state_(state),
       queue_(std::move(qptr)),
-      max_qsize_(max_qsize) {
+      max_qsize_(max_qsize),
+      unpack_zeek_batches_(unpack_zeek_batches) {
     // nop
   }
 
   bool congested() const noexcept override {
-    return queue_->buffer_size() >= max_qsize_;
+    if (full(queue_) || queue_->memory_exhausted())
+      return true;
+    for (auto& kvp : channels_)
+      if (full(kvp.second.queue))
+        return true;
+    for (auto& x : partitions_)
+      if (full(x.queue))
+        return true;
+    return false;
+  }
+
+  void add_channel(const filter_type& filter, queue_ptr qptr) {
+    auto id = next_channel_id_++;
+    index_.update(id, filter);
+    channels_.emplace(id, channel{std::move(qptr), {}});
+  }
+
+  void remove_channel(const queue_ptr& qptr) {
+    for (auto i = channels_.begin(); i != channels_.end(); ++i) {
+      if (i->second.queue == qptr) {
+        index_.erase(i->first);
+        channels_.erase(i);
+        return;
+      }
+    }
+    auto pred = [&](const channel& x) { return x.queue == qptr; };
+    auto i = std::find_if(partitions_.begin(), partitions_.end(), pred);
+    if (i != partitions_.end())
+      partitions_.erase(i);
+  }
+
+  void set_partitions(std::vector<count> key_path,
+                      std::vector<queue_ptr> queues, bool balance = false) {
+    key_path_ = std::move(key_path);
+    balance_ = balance;
+    partitions_.clear();
+    for (auto& qptr : queues)
+      partitions_.emplace_back(channel{std::move(qptr), {}});
   }
 
 protected:
@@ -79,31 +128,136 @@ protected:
     if (x.xs.match_elements<vec_type>()) {
       auto& xs = x.xs.get_mutable_as<vec_type>(0);
       auto xs_size = xs.size();
+      BROKER_TRACEPOINT(batch_delivered, xs_size, 0);
       state_->counter += xs_size;
-      queue_->produce(xs_size, std::make_move_iterator(xs.begin()),
-                      std::make_move_iterator(xs.end()));
+      if (unpack_zeek_batches_)
+        detail::unbatch_zeek_messages(xs);
+      if (channels_.empty() && partitions_.empty()) {
+        queue_->produce(std::move(xs));
+        return;
+      }
+      if (balance_) {
+        loads_.clear();
+        for (auto& part : partitions_)
+          loads_.emplace_back(part.queue->buffer_size());
+      }
+      // Hand each queue its share of the batch at once. The buffers recycle
+      // the storage of batches that the queues have drained.
+      for (auto& msg : xs) {
+        auto& ids = index_.match(get_topic(msg));
+        if (!ids.empty()) {
+          auto& ch = channels_[ids.front()];
+          add(ch.queue, ch.buf, std::move(msg));
+        } else if (!partitions_.empty()) {
+          auto& part = partitions_[balance_ ? least_loaded()
+                                            : partition_of(msg)];
+          add(part.queue, part.buf, std::move(msg));
+        } else {
+          add(queue_, buf_, std::move(msg));
+        }
+      }
+      queue_->produce(std::move(buf_));
+      for (auto& kvp : channels_)
+        kvp.second.queue->produce(std::move(kvp.second.buf));
+      for (auto& part : partitions_)
+        part.queue->produce(std::move(part.buf));
       return;
     }
     BROKER_ERROR("received unexpected batch type (dropped)");
   }
 
 private:
+  using batch_type = detail::shared_subscriber_queue<>::batch_type;
+
+  struct channel {
+    queue_ptr queue;
+    batch_type buf;
+  };
+
+  /// Picks the partition for `msg` by hashing its key. Messages without a key
+  /// go to the first partition.
+  size_t partition_of(const data_message& msg) const {
+    auto key = get_field(get_data(msg), key_path_);
+    if (key == nullptr)
+      return 0;
+    return std::hash<data>{}(*key) % partitions_.size();
+  }
+
+  /// Picks the partition with the fewest buffered messages, including the
+  /// messages it receives from the current batch.
+  size_t least_loaded() {
+    auto i = std::min_element(loads_.begin(), loads_.end());
+    ++*i;
+    return static_cast<size_t>(std::distance(loads_.begin(), i));
+  }
+
+  bool full(const queue_ptr& q) const noexcept {
+    return q->buffer_size() >= max_qsize_ || q->bytes_exhausted();
+  }
+
+  static void add(const queue_ptr& q, batch_type& buf, data_message&& msg) {
+    if (buf.empty())
+      q->reuse_batch(buf);
+    buf.emplace_back(std::move(msg));
+  }
+
   subscriber_worker_state* state_;
   queue_ptr queue_;
   size_t max_qsize_;
+
+  /// Configures whether the sink replaces Zeek batches with their messages.
+  bool unpack_zeek_batches_;
+
+  /// Collects the messages of a batch for `queue_` if the batch also contains
+  /// messages for channels.
+  batch_type buf_;
+
+  /// Maps the filter of each channel to its ID.
+  detail::subscription_index<size_t> index_;
+
+  /// Queues of all channels. IDs grow monotonically, i.e., smaller IDs belong
+  /// to older channels.
+  std::map<size_t, channel> channels_;
+
+  size_t next_channel_id_ = 0;
+
+  /// Selects the key of a message for picking its partition.
+  std::vector<count> key_path_;
+
+  /// Queues for the messages that match no channel, if any.
+  std::vector<channel> partitions_;
+
+  /// Configures whether messages go to the least loaded partition instead of
+  /// the partition of their key.
+  bool balance_ = false;
+
+  /// Number of messages per partition while distributing a batch if
+  /// `balance_`.
+  std::vector<size_t> loads_;
 };
 
 behavior subscriber_worker(stateful_actor<subscriber_worker_state>* self,
                            endpoint* ep,
                            detail::shared_subscriber_queue_ptr<> qptr,
-                           std::vector<topic> ts, size_t max_qsize) {
-  self->send(self * ep->core(), atom::join::value, std::move(ts));
+                           std::vector<topic> ts, size_t max_qsize,
+                           predicate pred, consumer_group group) {
+  if (!group.empty())
+    self->send(self * ep->core(), atom::join::value, std::move(ts),
+               std::move(pred), std::move(group));
+  else if (pred.empty())
+    self->send(self * ep->core(), atom::join::value, std::move(ts));
+  else
+    self->send(self * ep->core(), atom::join::value, std::move(ts),
+               std::move(pred));
   self->set_default_handler(skip);
   return {
     [=](const endpoint::stream_type& in) {
       BROKER_ASSERT(qptr != nullptr);
+      auto unpack = get_or(self->system().config(),
+                           "broker.subscriber.unpack-zeek-batches",
+                           defaults::subscriber::unpack_zeek_batches);
       auto mgr = make_counted<subscriber_sink>(self, &self->state, qptr,
-                                               max_qsize);
+                                               max_qsize, unpack);
       auto slot = mgr->add_unchecked_inbound_path(in);
       if (slot == invalid_stream_slot) {
         BROKER_WARNING("failed to init stream to subscriber_worker");
@@ -121,6 +275,21 @@ behavior subscriber_worker(stateful_actor<subscriber_worker_state>* self,
           // again in order to handle batches from a previously congested
           // manager.
         },
+        [=](atom::attach, const filter_type& f,
+            detail::shared_subscriber_queue_ptr<>& channel) {
+          mgr->add_channel(f, std::move(channel));
+        },
+        [=](atom::erase, const detail::shared_subscriber_queue_ptr<>& channel) {
+          mgr->remove_channel(channel);
+        },
+        [=](atom::attach, std::vector<count>& key_path,
+            std::vector<detail::shared_subscriber_queue_ptr<>>& partitions) {
+          mgr->set_partitions(std::move(key_path), std::move(partitions));
+        },
+        [=](atom::attach, atom::worker,
+            std::vector<detail::shared_subscriber_queue_ptr<>>& partitions) {
+          mgr->set_partitions({}, std::move(partitions), true);
+        },
         [=](atom::join a0, atom::update a1, filter_type& f) {
           self->send(ep->core(), a0, a1, slot_at_sender, std::move(f));
         },
@@ -150,13 +319,47 @@ behavior subscriber_worker(stateful_actor<subscriber_worker_state>* self,
   };
 }
 
+// Registers the queue of a subscriber with direct delivery at the core. The
+// queue never fills up, since the core writes events without waiting for
+// demand.
+behavior direct_subscriber_worker(event_based_actor* self, endpoint* ep,
+                                  detail::shared_subscriber_queue_ptr<> qptr,
+                                  std::vector<topic> ts) {
+  self->send(ep->core(), atom::join::value, atom::status::value,
+             std::move(ts), std::move(qptr));
+  return {
+    [](atom::resume) {
+      // nop
+    },
+    [](atom::tick, bool) {
+      // nop
+    },
+  };
+}
+
 } // namespace <anonymous>
 
-subscriber::subscriber(endpoint& e, std::vector<topic> ts, size_t max_qsize)
-  : super(max_qsize), ep_(e) {
+subscriber::subscriber(endpoint& e, std::vector<topic> ts, size_t max_qsize,
+                       predicate pred, consumer_group group)
+  : super(max_qsize), filter_(ts), ep_(e) {
   BROKER_INFO("creating subscriber for topic(s)" << ts);
+  queue_->track_memory(ep_.get().memory_);
+  queue_->max_bytes(get_or(e.system().config(), "broker.subscriber.queue-bytes",
+                           defaults::subscriber::queue_bytes));
+  queue_->max_age(get_or(e.system().config(), "broker.subscriber.max-age",
+                         defaults::subscriber::max_age));
+  ep_.get().register_queue(ts, queue_);
   worker_ = ep_.get().system().spawn(subscriber_worker, &ep_.get(), queue_, std::move(ts),
-                               max_qsize);
+                               max_qsize, std::move(pred), std::move(group));
+}
+
+subscriber::subscriber(endpoint& e, std::vector<topic> ts, size_t max_qsize,
+                       direct_delivery_t)
+  : super(max_qsize), filter_(ts), ep_(e) {
+  BROKER_INFO("creating subscriber with direct delivery for topic(s)" << ts);
+  queue_->track_memory(ep_.get().memory_);
+  worker_ = ep_.get().system().spawn(direct_subscriber_worker, &ep_.get(),
+                                     queue_, std::move(ts));
 }
 
 subscriber::~subscriber() {
@@ -173,13 +376,7 @@ void subscriber::add_topic(topic x, bool block) {
   auto i = std::find(filter_.begin(), e, x);
   if (i == e) {
     filter_.emplace_back(std::move(x));
-    if (block) {
-      caf::scoped_actor self{ep_.get().system()};
-      self->send(worker_, atom::join::value, atom::update::value, filter_, self);
-      self->receive([&](bool){});
-    } else {
-      anon_send(worker_, atom::join::value, atom::update::value, filter_);
-    }
+    send_filter(block);
   }
 }
 
@@ -189,14 +386,101 @@ void subscriber::remove_topic(topic x, bool block) {
   auto i = std::find(filter_.begin(), e, x);
   if (i != filter_.end()) {
     filter_.erase(i);
-    if (block) {
-      caf::scoped_actor self{ep_.get().system()};
-      self->send(worker_, atom::join::value, atom::update::value, filter_, self);
-      self->receive([&](bool){});
-    } else {
-      anon_send(worker_, atom::join::value, atom::update::value, filter_);
+    send_filter(block);
+  }
+}
+
+bool subscriber::update_topics(filter_type add, filter_type remove,
+                               bool block) {
+  BROKER_INFO("updating subscriber topics" << BROKER_ARG(add)
+                                           << BROKER_ARG(remove));
+  auto changed = false;
+  for (auto& x : add) {
+    if (std::find(filter_.begin(), filter_.end(), x) == filter_.end()) {
+      filter_.emplace_back(std::move(x));
+      changed = true;
+    }
+  }
+  for (auto& x : remove) {
+    auto i = std::find(filter_.begin(), filter_.end(), x);
+    if (i != filter_.end()) {
+      filter_.erase(i);
+      changed = true;
+    }
+  }
+  if (changed)
+    send_filter(block);
+  return changed;
+}
+
+void subscriber::send_filter(bool block) {
+  if (block) {
+    caf::scoped_actor self{ep_.get().system()};
+    self->send(worker_, atom::join::value, atom::update::value, filter_, self);
+    self->receive([&](bool){});
+  } else {
+    anon_send(worker_, atom::join::value, atom::update::value, filter_);
+  }
+  ep_.get().update_queue(queue_, filter_);
+}
+
+subscriber_channel subscriber::add_channel(filter_type filter) {
+  BROKER_INFO("adding channel for topic(s)" << filter << "to subscriber");
+  subscriber_channel result{worker_, filter, static_cast<size_t>(max_qsize_)};
+  result.queue_->track_memory(ep_.get().memory_);
+  result.queue_->max_bytes(queue_->max_bytes());
+  result.queue_->max_age(queue_->max_age());
+  // The worker must know the channel before receiving its messages.
+  anon_send(worker_, atom::attach::value, filter, result.queue_);
+  auto changed = false;
+  for (auto& x : filter) {
+    if (std::find(filter_.begin(), filter_.end(), x) == filter_.end()) {
+      filter_.emplace_back(x);
+      changed = true;
     }
   }
+  if (changed)
+    send_filter(false);
+  return result;
+}
+
+std::vector<subscriber_channel>
+subscriber::add_partitions(size_t n, std::vector<count> key_path) {
+  BROKER_INFO("splitting subscriber into" << n << "partitions");
+  std::vector<detail::shared_subscriber_queue_ptr<>> queues;
+  auto result = make_partitions(n, queues);
+  if (!result.empty())
+    anon_send(worker_, atom::attach::value, std::move(key_path),
+              std::move(queues));
+  return result;
+}
+
+std::vector<subscriber_channel> subscriber::add_workers(size_t n) {
+  BROKER_INFO("splitting subscriber into" << n << "worker queues");
+  std::vector<detail::shared_subscriber_queue_ptr<>> queues;
+  auto result = make_partitions(n, queues);
+  if (!result.empty())
+    anon_send(worker_, atom::attach::value, atom::worker::value,
+              std::move(queues));
+  return result;
+}
+
+std::vector<subscriber_channel> subscriber::make_partitions(
+  size_t n, std::vector<detail::shared_subscriber_queue_ptr<>>& queues) {
+  std::vector<subscriber_channel> result;
+  if (n == 0)
+    return result;
+  result.reserve(n);
+  queues.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    result.emplace_back(
+      subscriber_channel{worker_, filter_, static_cast<size_t>(max_qsize_)});
+    result.back().queue_->track_memory(ep_.get().memory_);
+    result.back().queue_->max_bytes(queue_->max_bytes());
+    result.back().queue_->max_age(queue_->max_age());
+    queues.emplace_back(result.back().queue_);
+  }
+  return result;
 }
 
 void subscriber::set_rate_calculation(bool x) {
@@ -207,4 +491,36 @@ void subscriber::became_not_full() {
   anon_send(worker_, atom::resume::value);
 }
 
+subscriber_channel::subscriber_channel(caf::actor worker, filter_type filter,
+                                       size_t max_qsize)
+  : super(static_cast<long>(max_qsize)),
+    worker_(std::move(worker)),
+    filter_(std::move(filter)) {
+  // nop
+}
+
+subscriber_channel&
+subscriber_channel::operator=(subscriber_channel&& other) {
+  if (this != &other) {
+    // Otherwise, the worker keeps filling our queue, which eventually stalls
+    // the whole subscriber.
+    if (worker_)
+      anon_send(worker_, atom::erase::value, queue_);
+    super::operator=(std::move(other));
+    worker_ = std::move(other.worker_);
+    filter_ = std::move(other.filter_);
+  }
+  return *this;
+}
+
+subscriber_channel::~subscriber_channel() {
+  // Moved-from channels have no worker.
+  if (worker_)
+    anon_send(worker_, atom::erase::value, queue_);
+}
+
+void subscriber_channel::became_not_full() {
+  anon_send(worker_, atom::resume::value);
+}
+
 } // namespace broker
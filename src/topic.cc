@@ -1,25 +1,42 @@
 #include "broker/topic.hh"
 
+#include "broker/detail/simd.hh"
+
 namespace broker {
 
+namespace {
+
+// Spelled out to avoid depending on the initialization order of the
+// constants in `topics`.
+constexpr char master_suffix[] = "<$>/data/master";
+constexpr char clone_suffix[] = "<$>/data/clone";
+
+template <size_t N>
+bool ends_with(const std::string& str, const char (&suffix)[N]) {
+  constexpr auto n = N - 1;
+  return str.size() >= n && str.compare(str.size() - n, n, suffix) == 0;
+}
+
+} // namespace
+
 constexpr char topic::reserved[];
 
 std::vector<std::string> topic::split(const topic& t) {
   std::vector<std::string> result;
-  std::string::size_type i = 0;
-  while (i != std::string::npos) {
-    auto j = t.str_.find(sep, i);
-    if (j == i) {
-      ++i;
-      continue;
-    }
-    if (j == std::string::npos)  {
-      result.push_back(t.str_.substr(i));
+  auto first = t.str_.data();
+  auto last = first + t.str_.size();
+  while (first != last) {
+    auto i = detail::find_byte(first, last, sep);
+    // Skip empty components.
+    if (i != first)
+      result.emplace_back(first, i);
+    if (i == last)
       break;
-    }
-    result.push_back(t.str_.substr(i, j - i));
-    i = (j == t.str_.size() - 1) ? std::string::npos : j + 1;
+    first = i + 1;
   }
+  // Splitting the empty topic results in a single, empty component.
+  if (result.empty())
+    result.emplace_back();
   return result;
 }
 
@@ -36,6 +53,7 @@ topic& topic::operator/=(const topic& rhs) {
   str_ += rhs.str_;
   if (!str_.empty() && str_.back() == sep)
     str_.pop_back();
+  classify();
   return *this;
 }
 
@@ -45,7 +63,7 @@ const std::string& topic::string() const {
 
 bool topic::prefix_of(const topic& t) const {
   return str_.size() <= t.str_.size()
-         && t.str_.compare(0, str_.size(), str_) == 0;
+         && detail::equal_bytes(str_.data(), t.str_.data(), str_.size());
 }
 
 void topic::clean() {
@@ -59,6 +77,21 @@ void topic::clean() {
     auto j = str_.find_first_not_of(sep, i);
     str_.replace(i, j - i, 1, sep);
   }
+  classify();
+}
+
+void topic::classify() noexcept {
+  flags_ = 0;
+  auto pos = str_.find(reserved, 0, sizeof(reserved) - 1);
+  if (pos == std::string::npos)
+    return;
+  flags_ |= internal_flag;
+  if (pos == 0)
+    flags_ |= control_flag;
+  if (ends_with(str_, master_suffix))
+    flags_ |= master_flag;
+  else if (ends_with(str_, clone_suffix))
+    flags_ |= clone_flag;
 }
 
 bool operator==(const topic& lhs, const topic& rhs) {
@@ -0,0 +1,92 @@
+#include "broker/topic_summary.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace broker {
+
+namespace {
+
+constexpr uint64_t fnv_offset = 14695981039346656037ull;
+
+constexpr uint64_t fnv_prime = 1099511628211ull;
+
+// Derives the second hash for double hashing from the first one. Forcing the
+// result to be odd makes sure that all probes differ.
+uint64_t rehash(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  return x | 1;
+}
+
+} // namespace
+
+topic_summary::topic_summary(const filter_type& xs, size_t capacity,
+                             double fp_rate) {
+  auto n = static_cast<double>(std::max({capacity, xs.size(), size_t{1}}));
+  auto ln2 = std::log(2.0);
+  auto m = std::ceil(-n * std::log(fp_rate) / (ln2 * ln2));
+  auto words = std::max(size_t{1}, static_cast<size_t>(m + 63) / 64);
+  bits_.resize(words);
+  auto k = std::round(static_cast<double>(words * 64) / n * ln2);
+  num_hashes_ = static_cast<uint32_t>(std::clamp(k, 1.0, 16.0));
+  add(xs);
+}
+
+void topic_summary::add(const topic& x) {
+  if (bits_.empty())
+    return;
+  auto& str = x.string();
+  auto hash = fnv_offset;
+  for (auto c : str)
+    hash = (hash ^ static_cast<uint8_t>(c)) * fnv_prime;
+  set(hash);
+  auto len = static_cast<uint32_t>(str.size());
+  min_length_ = std::min(min_length_, len);
+  max_length_ = std::max(max_length_, len);
+}
+
+void topic_summary::add(const filter_type& xs) {
+  for (auto& x : xs)
+    add(x);
+}
+
+bool topic_summary::covers(const topic& x) const {
+  if (empty())
+    return false;
+  // Test each prefix of `x` that may be in the summary. FNV-1a allows us to
+  // compute the hashes of all prefixes in a single pass.
+  auto& str = x.string();
+  auto last = std::min(static_cast<size_t>(max_length_), str.size());
+  auto hash = fnv_offset;
+  for (size_t len = 0; len <= last; ++len) {
+    if (len >= min_length_ && test(hash))
+      return true;
+    if (len < str.size())
+      hash = (hash ^ static_cast<uint8_t>(str[len])) * fnv_prime;
+  }
+  return false;
+}
+
+bool topic_summary::test(uint64_t hash) const {
+  auto m = bits_.size() * 64;
+  auto h2 = rehash(hash);
+  for (uint32_t i = 0; i < num_hashes_; ++i) {
+    auto bit = (hash + i * h2) % m;
+    if ((bits_[bit / 64] & (uint64_t{1} << (bit % 64))) == 0)
+      return false;
+  }
+  return true;
+}
+
+void topic_summary::set(uint64_t hash) {
+  auto m = bits_.size() * 64;
+  auto h2 = rehash(hash);
+  for (uint32_t i = 0; i < num_hashes_; ++i) {
+    auto bit = (hash + i * h2) % m;
+    bits_[bit / 64] |= uint64_t{1} << (bit % 64);
+  }
+}
+
+} // namespace broker
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cstdint>
@@ -36,6 +37,10 @@ uint64_t max_received = 0;
 uint64_t max_in_flight = 0;
 bool server = false;
 bool verbose = false;
+bool latency = false;
+std::vector<double> latency_rates{100, 1000, 10000};
+double latency_duration = 10;
+std::string relay;
 
 // Global state
 size_t total_recv;
@@ -296,6 +301,212 @@ void client_mode(endpoint& ep, const std::string& host, int port) {
   }
 }
 
+// -- latency mode -------------------------------------------------------------
+
+/// A histogram in the spirit of HdrHistogram: values below 256 have their own
+/// bucket, larger values share buckets with all values that agree in their
+/// eight most significant bits. Hence, reported percentiles are at most 1%
+/// above the recorded value (and never above the maximum).
+class latency_histogram {
+public:
+  static constexpr size_t sub_buckets = 256;
+
+  static constexpr size_t half = sub_buckets / 2;
+
+  latency_histogram() : buckets_(sub_buckets + (64 - 8) * half) {
+    // nop
+  }
+
+  void record(uint64_t x) {
+    ++buckets_[index_of(x)];
+    ++total_;
+    max_ = std::max(max_, x);
+  }
+
+  void reset() {
+    std::fill(buckets_.begin(), buckets_.end(), 0);
+    total_ = 0;
+    max_ = 0;
+  }
+
+  uint64_t total() const {
+    return total_;
+  }
+
+  uint64_t max() const {
+    return max_;
+  }
+
+  /// Returns the smallest value such that `p` percent of all recorded values
+  /// are less or equal.
+  uint64_t percentile(double p) const {
+    if (total_ == 0)
+      return 0;
+    auto target = std::max(uint64_t{1},
+                           static_cast<uint64_t>(p / 100 * total_ + 0.5));
+    uint64_t acc = 0;
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+      acc += buckets_[i];
+      if (acc >= target)
+        return std::min(highest_equivalent(i), max_);
+    }
+    return max_;
+  }
+
+private:
+  static size_t index_of(uint64_t x) {
+    if (x < sub_buckets)
+      return static_cast<size_t>(x);
+    size_t shift = 0;
+    while ((x >> shift) >= sub_buckets)
+      ++shift;
+    auto mantissa = static_cast<size_t>(x >> shift);
+    return sub_buckets + (shift - 1) * half + (mantissa - half);
+  }
+
+  static uint64_t highest_equivalent(size_t i) {
+    if (i < sub_buckets)
+      return i;
+    auto shift = (i - sub_buckets) / half + 1;
+    uint64_t mantissa = (i - sub_buckets) % half + half;
+    return ((mantissa + 1) << shift) - 1;
+  }
+
+  std::vector<uint64_t> buckets_;
+  uint64_t total_ = 0;
+  uint64_t max_ = 0;
+};
+
+uint64_t steady_ns() {
+  using namespace std::chrono;
+  auto t = steady_clock::now().time_since_epoch();
+  return static_cast<uint64_t>(duration_cast<nanoseconds>(t).count());
+}
+
+// Echoes each ping back to the sender and adds our own receive time, which
+// allows the client to compute one-way latency when clocks are in sync.
+void answer_pings(endpoint& ep) {
+  ep.subscribe_nosync(
+    {"/benchmark/ping"},
+    [](caf::unit_t&) {
+      // nop
+    },
+    [&](caf::unit_t&, data_message x) {
+      zeek::Event ping(move_data(x));
+      auto args = std::move(ping.args());
+      args.emplace_back(broker::now());
+      ep.publish("/benchmark/pong", zeek::Event("pong", std::move(args)));
+    },
+    [](caf::unit_t&, const caf::error&) {
+      // nop
+    });
+}
+
+// Sends pings at each rate in `latency_rates` for `latency_duration` seconds
+// and prints one line per rate for plotting latency against throughput.
+void latency_mode(endpoint& ep, const std::string& host, int port) {
+  // Guards `round_trip`, `one_way` and `step`.
+  std::mutex mtx;
+  latency_histogram round_trip;
+  latency_histogram one_way;
+  count step = 0;
+  ep.subscribe_nosync(
+    {"/benchmark/pong"},
+    [](caf::unit_t&) {
+      // nop
+    },
+    [&](caf::unit_t&, data_message x) {
+      auto t = steady_ns();
+      zeek::Event pong(move_data(x));
+      auto& args = pong.args();
+      if (args.size() != 4) {
+        std::cerr << "unexpected pong: " << to_string(args) << std::endl;
+        return;
+      }
+      auto sent = caf::get<count>(args[1]);
+      auto dt = caf::get<timestamp>(args[3]) - caf::get<timestamp>(args[2]);
+      std::unique_lock<std::mutex> guard{mtx};
+      // Drop late responses from previous rates.
+      if (caf::get<count>(args[0]) != step)
+        return;
+      round_trip.record(t - sent);
+      one_way.record(static_cast<uint64_t>(std::max(dt.count(), int64_t{0})));
+    },
+    [](caf::unit_t&, const caf::error&) {
+      // nop
+    });
+  if (verbose)
+    std::cout << "*** init peering: host = " << host << ", port = " << port
+              << std::endl;
+  if (!ep.peer(host, port, timeout::seconds(1))) {
+    std::cerr << "unable to peer to " << host << " on port " << port
+              << std::endl;
+    return;
+  }
+  // Give subscriptions some time to propagate through all hops.
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  auto p = ep.make_publisher("/benchmark/ping");
+  auto print_percentiles = [](const latency_histogram& h) {
+    auto us = [](uint64_t ns) { return ns / 1e3; };
+    std::cout << ' ' << us(h.percentile(50)) << ' ' << us(h.percentile(99))
+              << ' ' << us(h.percentile(99.9)) << ' ' << us(h.max());
+  };
+  std::cout << "# rate throughput rtt-p50 rtt-p99 rtt-p99.9 rtt-max"
+               " one-way-p50 one-way-p99 one-way-p99.9 one-way-max (in us)"
+            << std::endl;
+  for (auto rate : latency_rates) {
+    {
+      std::unique_lock<std::mutex> guard{mtx};
+      ++step;
+      round_trip.reset();
+      one_way.reset();
+    }
+    // Wake up once per millisecond and send all pings that are due.
+    using fractional_second = std::chrono::duration<double>;
+    auto start = std::chrono::steady_clock::now();
+    auto stop = start + fractional_second{latency_duration};
+    auto deadline = start;
+    uint64_t sent = 0;
+    while (deadline < stop) {
+      deadline += std::chrono::milliseconds(1);
+      std::this_thread::sleep_until(deadline);
+      fractional_second elapsed = deadline - start;
+      auto due = static_cast<uint64_t>(elapsed.count() * rate);
+      for (; sent < due; ++sent)
+        p.publish(zeek::Event("ping", vector{step, count{steady_ns()},
+                                             broker::now()}));
+    }
+    // Wait for outstanding responses.
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    std::unique_lock<std::mutex> guard{mtx};
+    std::cout << rate << ' ' << round_trip.total() / latency_duration;
+    print_percentiles(round_trip);
+    print_percentiles(one_way);
+    std::cout << std::endl;
+  }
+}
+
+// Forwards pings and pongs between the client and the next hop.
+void relay_mode(endpoint& ep, const std::string& iface, int listen_port,
+                const std::string& host, int port) {
+  auto nop = [](caf::unit_t&, data_message) {};
+  ep.subscribe_nosync({"/benchmark/ping", "/benchmark/pong"},
+                      [](caf::unit_t&) {}, nop,
+                      [](caf::unit_t&, const caf::error&) {});
+  ep.listen(iface, listen_port);
+  if (!ep.peer(host, port, timeout::seconds(1))) {
+    std::cerr << "unable to peer to " << host << " on port " << port
+              << std::endl;
+    return;
+  }
+  auto ss = ep.make_status_subscriber(true);
+  for (;;) {
+    auto ev = ss.get();
+    if (verbose)
+      std::cout << caf::deep_to_string(ev) << std::endl;
+  }
+}
+
 // This mode mimics what benchmark.bro does.
 void server_mode(endpoint& ep, const std::string& iface, int port) {
   // Make sure to receive status updates.
@@ -336,6 +547,8 @@ void server_mode(endpoint& ep, const std::string& iface, int port) {
     [](caf::unit_t&, const caf::error&) {
       // nop
     });
+  // Answer pings from clients in latency mode.
+  answer_pings(ep);
   // Start listening for peers.
   ep.listen(iface, port);
   // Collects stats once per second until receiving stop message.
@@ -380,6 +593,14 @@ struct config : configuration {
       .add(max_received, "max-received,m", "stop benchmark after given count")
       .add(max_in_flight, "max-in-flight,f", "report when exceeding this count")
       .add(server, "server", "run in server mode")
+      .add(latency, "latency", "measure latency instead of throughput")
+      .add(latency_rates, "latency-rates",
+           "pings/sec for each step in latency mode (default: [100, 1000, "
+           "10000])")
+      .add(latency_duration, "latency-duration",
+           "seconds per step in latency mode (default: 10)")
+      .add(relay, "relay",
+           "forward pings between <interface>:port and the given peer")
       .add(verbose, "verbose", "enable status output");
   }
 
@@ -393,10 +614,34 @@ struct config : configuration {
 void usage(const config& cfg, const char* cmd_name) {
   std::cerr << "Usage: " << cmd_name
             << " [<options>] <zeek-host>[:<port>] | [--disable-ssl] --server "
-               "<interface>:port\n\n"
+               "<interface>:port | --relay <interface>:port <host>:<port>\n\n"
             << cfg.help_text();
 }
 
+// Parses `<host>:[<port>]` and leaves `port` unchanged if omitted.
+bool parse_host_and_port(const std::string& arg, std::string& host,
+                         uint16_t& port) {
+  auto separator = arg.find(':');
+  if (separator == std::string::npos) {
+    std::cerr << "*** invalid argument\n\n";
+    return false;
+  }
+  host = arg.substr(0, separator);
+  try {
+    auto str_port = arg.substr(separator + 1);
+    if (!str_port.empty()) {
+      auto int_port = std::stoi(str_port);
+      if (int_port < 0 || int_port > std::numeric_limits<uint16_t>::max())
+        throw std::out_of_range("not an uint16_t");
+      port = static_cast<uint16_t>(int_port);
+    }
+  } catch (std::exception& e) {
+    std::cerr << "*** invalid port: " << e.what() << "\n\n";
+    return false;
+  }
+  return true;
+}
+
 } // namespace
 
 int main(int argc, char** argv) {
@@ -416,32 +661,26 @@ int main(int argc, char** argv) {
     return EXIT_FAILURE;
   }
   // Local variables configurable via CLI.
-  auto arg = cfg.remainder[0];
-  auto separator = arg.find(':');
-  if (separator == std::string::npos) {
-    std::cerr << "*** invalid argument\n\n";
+  std::string host;
+  uint16_t port = 9999;
+  if (!parse_host_and_port(cfg.remainder[0], host, port)) {
     usage(cfg, argv[0]);
     return EXIT_FAILURE;
   }
-  std::string host = arg.substr(0, separator);
-  uint16_t port = 9999;
-  try {
-    auto str_port = arg.substr(separator + 1);
-    if (!str_port.empty()) {
-      auto int_port = std::stoi(str_port);
-      if (int_port < 0 || int_port > std::numeric_limits<uint16_t>::max())
-        throw std::out_of_range("not an uint16_t");
-      port = static_cast<uint16_t>(int_port);
-    }
-  } catch (std::exception& e) {
-    std::cerr << "*** invalid port: " << e.what() << "\n\n";
+  std::string relay_iface;
+  uint16_t relay_port = 9999;
+  if (!relay.empty() && !parse_host_and_port(relay, relay_iface, relay_port)) {
     usage(cfg, argv[0]);
     return EXIT_FAILURE;
   }
   // Run benchmark.
   endpoint ep(std::move(cfg));
-  if (server)
+  if (!relay.empty())
+    relay_mode(ep, relay_iface, relay_port, host, port);
+  else if (server)
     server_mode(ep, host, port);
+  else if (latency)
+    latency_mode(ep, host, port);
   else
     client_mode(ep, host, port);
   return EXIT_SUCCESS;
@@ -1,6 +1,8 @@
 #include <atomic>
 #include <chrono>
 #include <iostream>
+#include <limits>
+#include <numeric>
 #include <string>
 #include <thread>
 
@@ -223,6 +225,10 @@ struct node {
   // we produce the number of messages in the generator file.
   caf::optional<size_t> num_outputs;
 
+  /// Stores how many generators publish in parallel. Each generator replays
+  /// an even share of the blocks in the generator file.
+  size_t generator_shards = 1;
+
   /// Stores parent nodes in the pub/sub topology.
   std::vector<node*> left;
 
@@ -312,6 +318,7 @@ expected<node> make_node(const string& name, const caf::settings& parameters) {
   SET_FIELD(num_inputs, optional);
   SET_FIELD(forward, optional);
   SET_FIELD(num_outputs, optional);
+  SET_FIELD(generator_shards, optional);
   SET_FIELD(inputs_by_node, optional);
   SET_FIELD(log_verbosity, optional);
   if (!result.generator_file.empty() && !is_file(result.generator_file))
@@ -369,98 +376,176 @@ struct generator_state {
 
 const char* generator_state::name = "generator";
 
+/// Describes the part of a generator file that a single generator replays.
+struct generator_shard {
+  /// Index of the first block. Ignored when replaying the whole file.
+  size_t first_block = 0;
+
+  /// Number of messages in the blocks of this shard or `none` when replaying
+  /// the whole file.
+  caf::optional<size_t> entries;
+
+  /// Number of messages to produce or `none` when producing all `entries`
+  /// exactly once.
+  caf::optional<size_t> num_outputs;
+};
+
+/// Splits the blocks of `reader` into up to `n` consecutive ranges with
+/// roughly the same number of messages. Returns a single shard for the whole
+/// file if the reader has no block index.
+std::vector<generator_shard>
+make_shards(const broker::detail::generator_file_reader& reader, size_t n,
+            caf::optional<size_t> num_outputs) {
+  std::vector<generator_shard> result;
+  auto& blocks = reader.blocks();
+  n = std::min(n, blocks.size());
+  if (n <= 1) {
+    result.emplace_back();
+    result.back().num_outputs = num_outputs;
+    return result;
+  }
+  auto total = std::accumulate(blocks.begin(), blocks.end(), size_t{0},
+                               [](size_t acc, const auto& block) {
+                                 return acc + block.entries;
+                               });
+  size_t block = 0;
+  size_t assigned = 0;
+  for (size_t i = 0; i < n; ++i) {
+    generator_shard shard;
+    shard.first_block = block;
+    // Each shard gets at least one block and leaves at least one block for
+    // each remaining shard.
+    auto goal = total * (i + 1) / n;
+    size_t entries = 0;
+    do {
+      entries += blocks[block++].entries;
+    } while (block < blocks.size() - (n - i - 1)
+             && assigned + entries < goal);
+    if (i == n - 1)
+      while (block < blocks.size())
+        entries += blocks[block++].entries;
+    assigned += entries;
+    shard.entries = entries;
+    if (num_outputs)
+      shard.num_outputs = *num_outputs / n + (i < *num_outputs % n ? 1 : 0);
+    result.emplace_back(shard);
+  }
+  return result;
+}
+
 void generator(caf::stateful_actor<generator_state>* self, node* this_node,
-               caf::actor core, broker::detail::generator_file_reader_ptr ptr) {
+               caf::actor core, broker::detail::generator_file_reader_ptr ptr,
+               generator_shard shard) {
   using generator_ptr = broker::detail::generator_file_reader_ptr;
   using value_type = broker::node_message::value_type;
-  if (this_node->num_outputs != caf::none) {
-    struct state {
-      generator_ptr gptr;
-      size_t remaining;
-      size_t pushed = 0;
-    };
-    self->make_source(
-      core,
-      [&](state& st) {
-        // Take ownership of `ptr`.
-        st.gptr = std::move(ptr);
-        st.remaining = *this_node->num_outputs;
-      },
-      [=](state& st, caf::downstream<value_type>& out, size_t hint) {
-        if (st.gptr == nullptr)
-          return;
-        auto n = std::min(hint, st.remaining);
-        for (size_t i = 0; i < n; ++i) {
-          if (st.gptr->at_end())
-            st.gptr->rewind();
-          value_type x;
-          if (auto err = st.gptr->read(x)) {
-            err::println("error while parsing ", this_node->generator_file,
-                         ": ", self->system().render(err));
-            st.gptr = nullptr;
-            st.remaining = 0;
-            return;
-          }
-          out.push(std::move(x));
+  struct state {
+    generator_ptr gptr;
+    generator_shard shard;
+    size_t pass_pos = 0;
+    size_t remaining = 0;
+    size_t pushed = 0;
+
+    bool end_of_shard() const {
+      return gptr->at_end() || (shard.entries && pass_pos == *shard.entries);
+    }
+
+    caf::error restart() {
+      pass_pos = 0;
+      if (shard.entries)
+        return gptr->seek(shard.first_block);
+      gptr->rewind();
+      return caf::none;
+    }
+  };
+  auto done = [](const state& st) {
+    // We are done when gptr becomes null as result of an error, after
+    // producing all outputs, or when reaching the end of our shard without a
+    // fixed number of outputs.
+    return st.gptr == nullptr || st.remaining == 0
+           || (!st.shard.num_outputs && st.end_of_shard());
+  };
+  self->make_source(
+    core,
+    [&](state& st) {
+      // Take ownership of `ptr`.
+      st.gptr = std::move(ptr);
+      st.shard = shard;
+      st.remaining = shard.num_outputs ? *shard.num_outputs
+                                       : std::numeric_limits<size_t>::max();
+      if (shard.entries)
+        if (auto err = st.gptr->seek(shard.first_block)) {
+          err::println("unable to seek in ", this_node->generator_file, ": ",
+                       self->system().render(err));
+          st.gptr = nullptr;
         }
-        st.remaining -= n;
-        if (st.pushed / 1000 != (st.pushed + n) / 1000)
-          verbose::println(this_node->name, " pushed ", st.pushed + n,
-                           " messages");
-        st.pushed += n;
-      },
-      [](const state& st) { return st.remaining == 0; });
-  } else {
-    struct state {
-      generator_ptr gptr;
-      size_t pushed = 0;
-    };
-    auto done = [](const state& st) {
-      // We are done when gptr becomes null as result of an error or when
-      // reacing the end of the generator file.
-      return st.gptr == nullptr || st.gptr->at_end();
-    };
-    self->make_source(
-      core,
-      [&](state& st) {
-        // Take ownership of `ptr`.
-        st.gptr = std::move(ptr);
-      },
-      [=](state& st, caf::downstream<value_type>& out, size_t hint) {
-        size_t n = 0;
-        for (; n < hint; ++n) {
-          if (done(st))
-            break;
-          value_type x;
-          if (auto err = st.gptr->read(x)) {
-            err::println("error while parsing ", this_node->generator_file,
-                         ": ", self->system().render(err));
+    },
+    [=](state& st, caf::downstream<value_type>& out, size_t hint) {
+      size_t n = 0;
+      for (; n < hint; ++n) {
+        if (done(st))
+          break;
+        if (st.end_of_shard()) {
+          if (auto err = st.restart()) {
+            err::println("unable to seek in ", this_node->generator_file, ": ",
+                         self->system().render(err));
             st.gptr = nullptr;
             break;
           }
-          out.push(std::move(x));
         }
-        // Make some noise every 1k messages or when done.
-        if (done(st) || st.pushed / 1000 != (st.pushed + n) / 1000)
-          verbose::println(this_node->name, " pushed ", st.pushed + n,
-                           " messages");
-        st.pushed += n;
-      },
-      done);
-  }
+        value_type x;
+        if (auto err = st.gptr->read(x)) {
+          err::println("error while parsing ", this_node->generator_file, ": ",
+                       self->system().render(err));
+          st.gptr = nullptr;
+          break;
+        }
+        ++st.pass_pos;
+        --st.remaining;
+        out.push(std::move(x));
+      }
+      // Make some noise every 1k messages or when done.
+      if (done(st) || st.pushed / 1000 != (st.pushed + n) / 1000)
+        verbose::println(this_node->name, " pushed ", st.pushed + n,
+                         " messages");
+      st.pushed += n;
+    },
+    done);
 }
 
 void run_send_mode(node_manager_actor* self, caf::actor observer) {
   auto this_node = self->state.this_node;
-  verbose::println(this_node->name, " starts publishing");
+  auto shards = make_shards(*self->state.generator,
+                            std::max(this_node->generator_shards, size_t{1}),
+                            this_node->num_outputs);
+  verbose::println(this_node->name, " starts publishing with ", shards.size(),
+                   " generator(s)");
+  // Open one reader per additional shard before starting the clock.
+  std::vector<broker::detail::generator_file_reader_ptr> readers;
+  readers.emplace_back(std::move(self->state.generator));
+  for (size_t i = 1; i < shards.size(); ++i) {
+    using broker::detail::make_generator_file_reader;
+    readers.emplace_back(make_generator_file_reader(this_node->generator_file));
+    if (readers.back() == nullptr) {
+      err::println("unable to open generator file: ",
+                   this_node->generator_file);
+      return;
+    }
+  }
   auto t0 = std::chrono::steady_clock::now();
-  auto g = self->spawn(generator, this_node, self->state.ep.core(),
-                       std::move(self->state.generator));
-  g->attach_functor([this_node, t0, observer]() mutable {
-    auto t1 = std::chrono::steady_clock::now();
-    anon_send(observer, broker::atom::ok::value, broker::atom::write::value,
-              this_node->name, duration_cast<caf::timespan>(t1 - t0));
-  });
+  auto pending = std::make_shared<std::atomic<size_t>>(shards.size());
+  for (size_t i = 0; i < shards.size(); ++i) {
+    // Generators run detached to replay shards in parallel.
+    auto g = self->spawn<caf::detached>(generator, this_node,
+                                        self->state.ep.core(),
+                                        std::move(readers[i]), shards[i]);
+    g->attach_functor([this_node, t0, observer, pending]() mutable {
+      if (--*pending > 0)
+        return;
+      auto t1 = std::chrono::steady_clock::now();
+      anon_send(observer, broker::atom::ok::value, broker::atom::write::value,
+                this_node->name, duration_cast<caf::timespan>(t1 - t0));
+    });
+  }
 }
 
 struct consumer_state {
@@ -0,0 +1,442 @@
+// Runs a fixed workload on a single thread and reports hardware counters per
+// operation instead of wall-clock time. The workload takes all timestamps from
+// a non-real-time endpoint clock and uses no random input, so repeated runs on
+// the same binary execute the same instructions. This makes the output
+// suitable for comparing individual changes, even on noisy hosts.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "broker/address.hh"
+#include "broker/configuration.hh"
+#include "broker/convert.hh"
+#include "broker/data.hh"
+#include "broker/endpoint.hh"
+#include "broker/filter_type.hh"
+#include "broker/message.hh"
+#include "broker/topic.hh"
+
+#include "broker/detail/blob.hh"
+#include "broker/detail/memory_backend.hh"
+#include "broker/detail/subscription_index.hh"
+
+using namespace broker;
+
+// -- allocation counting ------------------------------------------------------
+
+namespace {
+
+// Only the benchmark thread allocates while measuring.
+uint64_t num_allocations = 0;
+
+} // namespace
+
+void* operator new(size_t size) {
+  ++num_allocations;
+  if (auto ptr = malloc(size > 0 ? size : 1))
+    return ptr;
+  throw std::bad_alloc{};
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+namespace {
+
+size_t num_operations = 100000;
+size_t num_warmup = 10000;
+size_t num_subscriptions = 1000;
+std::vector<std::string> workloads{"serialize",  "deserialize", "route",
+                                   "store-put",  "store-get",   "store-erase",
+                                   "store-expire"};
+
+// -- hardware counters --------------------------------------------------------
+
+/// Counts instructions, cycles and cache misses of the calling thread in user
+/// space via `perf_event_open`. Reports no values if the kernel denies access
+/// (see `/proc/sys/kernel/perf_event_paranoid`) or on other platforms.
+class perf_counters {
+public:
+  static constexpr size_t num_events = 3;
+
+  struct sample {
+    bool valid = false;
+    uint64_t values[num_events] = {0, 0, 0};
+  };
+
+  perf_counters() {
+#ifdef __linux__
+    uint64_t configs[num_events] = {PERF_COUNT_HW_INSTRUCTIONS,
+                                    PERF_COUNT_HW_CPU_CYCLES,
+                                    PERF_COUNT_HW_CACHE_MISSES};
+    for (size_t i = 0; i < num_events; ++i) {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(attr);
+      attr.config = configs[i];
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      auto group = i == 0 ? -1 : fds_[0];
+      fds_[i] = static_cast<int>(
+        syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+      if (fds_[i] < 0) {
+        close_all();
+        return;
+      }
+    }
+#endif
+  }
+
+  ~perf_counters() {
+    close_all();
+  }
+
+  bool available() const {
+    return fds_[0] >= 0;
+  }
+
+  void start() {
+#ifdef __linux__
+    if (available()) {
+      ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+  }
+
+  sample stop() {
+    sample result;
+#ifdef __linux__
+    if (available()) {
+      ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+      // Layout for PERF_FORMAT_GROUP: number of events, then one value each.
+      uint64_t buf[num_events + 1];
+      if (read(fds_[0], buf, sizeof(buf)) == sizeof(buf)
+          && buf[0] == num_events) {
+        result.valid = true;
+        for (size_t i = 0; i < num_events; ++i)
+          result.values[i] = buf[i + 1];
+      }
+    }
+#endif
+    return result;
+  }
+
+private:
+  void close_all() {
+#ifdef __linux__
+    for (auto& fd : fds_) {
+      if (fd >= 0)
+        close(fd);
+      fd = -1;
+    }
+#endif
+  }
+
+  int fds_[num_events] = {-1, -1, -1};
+};
+
+// -- workloads ----------------------------------------------------------------
+
+/// A workload calls `prepare` once per run and then `run(i)` for each
+/// operation `i`, measuring only the calls to `run`.
+struct workload {
+  virtual ~workload() = default;
+
+  virtual void prepare(size_t n) = 0;
+
+  virtual void run(size_t i) = 0;
+};
+
+topic subscription(size_t i) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "/bench/%07zu", i);
+  return topic{buf};
+}
+
+// Resembles a line in conn.log. Takes its timestamp from the simulated clock.
+data make_record(const endpoint::clock& clock, size_t i) {
+  address orig;
+  address resp;
+  convert("10.0.0.1", orig);
+  convert("2001:db8::1", resp);
+  return vector{clock.now(),
+                "C" + std::to_string(i),
+                orig,
+                port(49152, port::protocol::tcp),
+                resp,
+                port(443, port::protocol::tcp),
+                enum_value("tcp"),
+                timespan{3141592},
+                count{i},
+                true,
+                set{"ssl", "http"}};
+}
+
+struct serialize_workload : workload {
+  endpoint::clock& clock;
+  std::vector<data_message> msgs;
+  size_t bytes = 0;
+
+  explicit serialize_workload(endpoint::clock& clock) : clock(clock) {
+    // nop
+  }
+
+  void prepare(size_t) override {
+    msgs.clear();
+    for (size_t i = 0; i < 64; ++i)
+      msgs.emplace_back(make_data_message(subscription(i),
+                                          make_record(clock, i)));
+  }
+
+  void run(size_t i) override {
+    auto& msg = msgs[i % msgs.size()];
+    bytes += detail::to_blob(get_topic(msg), get_data(msg)).size();
+  }
+};
+
+struct deserialize_workload : workload {
+  endpoint::clock& clock;
+  std::vector<decltype(detail::to_blob(data{}))> blobs;
+  size_t elements = 0;
+
+  explicit deserialize_workload(endpoint::clock& clock) : clock(clock) {
+    // nop
+  }
+
+  void prepare(size_t) override {
+    blobs.clear();
+    for (size_t i = 0; i < 64; ++i)
+      blobs.emplace_back(detail::to_blob(make_record(clock, i)));
+  }
+
+  void run(size_t i) override {
+    auto x = detail::from_blob<data>(blobs[i % blobs.size()]);
+    elements += caf::get<vector>(x).size();
+  }
+};
+
+struct route_workload : workload {
+  detail::subscription_index<size_t> peers;
+  std::vector<topic> topics;
+  size_t receivers = 0;
+
+  void prepare(size_t) override {
+    // Ten peers, each subscribing to every tenth topic. Keeps the index of
+    // the warmup, whose memoized results are part of the measured state.
+    if (!topics.empty())
+      return;
+    std::vector<filter_type> filters(10);
+    for (size_t i = 0; i < num_subscriptions; ++i)
+      filters[i % filters.size()].emplace_back(subscription(i));
+    for (size_t i = 0; i < filters.size(); ++i)
+      peers.update(i, filters[i]);
+    for (size_t i = 0; i < num_subscriptions; ++i)
+      topics.emplace_back(subscription(i) / topic{"event"});
+  }
+
+  void run(size_t i) override {
+    receivers += peers.match(topics[i % topics.size()]).size();
+  }
+};
+
+/// Runs one kind of store operation against a memory backend filled with `n`
+/// keys. Expiring keys use the simulated clock.
+struct store_workload : workload {
+  enum op_type { put_op, get_op, erase_op, expire_op };
+
+  endpoint::clock& clock;
+  op_type op;
+  std::unique_ptr<detail::memory_backend> backend;
+  std::vector<data> keys;
+  size_t hits = 0;
+
+  store_workload(endpoint::clock& clock, op_type op) : clock(clock), op(op) {
+    // nop
+  }
+
+  void prepare(size_t n) override {
+    backend = std::make_unique<detail::memory_backend>();
+    keys.clear();
+    for (size_t i = 0; i < n; ++i)
+      keys.emplace_back("key-" + std::to_string(i));
+    if (op == put_op)
+      return;
+    optional<timestamp> expiry;
+    if (op == expire_op)
+      expiry = clock.now() + std::chrono::seconds(1);
+    for (size_t i = 0; i < n; ++i)
+      backend->put(keys[i], make_record(clock, i), expiry);
+    if (op == expire_op)
+      clock.advance_time(clock.now() + std::chrono::seconds(2));
+  }
+
+  void run(size_t i) override {
+    auto& key = keys[i];
+    switch (op) {
+      case put_op:
+        hits += backend->put(key, count{i}, caf::none) ? 1 : 0;
+        break;
+      case get_op:
+        hits += backend->get(key) ? 1 : 0;
+        break;
+      case erase_op:
+        hits += backend->erase(key) ? 1 : 0;
+        break;
+      case expire_op: {
+        auto res = backend->expire(key, clock.now());
+        hits += res && *res ? 1 : 0;
+        break;
+      }
+    }
+  }
+};
+
+std::unique_ptr<workload> make_workload(const std::string& name,
+                                        endpoint::clock& clock) {
+  if (name == "serialize")
+    return std::make_unique<serialize_workload>(clock);
+  if (name == "deserialize")
+    return std::make_unique<deserialize_workload>(clock);
+  if (name == "route")
+    return std::make_unique<route_workload>();
+  if (name == "store-put")
+    return std::make_unique<store_workload>(clock, store_workload::put_op);
+  if (name == "store-get")
+    return std::make_unique<store_workload>(clock, store_workload::get_op);
+  if (name == "store-erase")
+    return std::make_unique<store_workload>(clock, store_workload::erase_op);
+  if (name == "store-expire")
+    return std::make_unique<store_workload>(clock, store_workload::expire_op);
+  return nullptr;
+}
+
+void print_per_op(uint64_t value, size_t n) {
+  std::cout << ' ' << std::fixed << std::setprecision(2)
+            << static_cast<double>(value) / n;
+}
+
+void measure(const std::string& name, workload& w, perf_counters& counters) {
+  // Warm up caches and lazily initialized state.
+  if (num_warmup > 0) {
+    w.prepare(num_warmup);
+    for (size_t i = 0; i < num_warmup; ++i)
+      w.run(i);
+  }
+  w.prepare(num_operations);
+  auto allocations = num_allocations;
+  counters.start();
+  for (size_t i = 0; i < num_operations; ++i)
+    w.run(i);
+  auto sample = counters.stop();
+  allocations = num_allocations - allocations;
+  std::cout << name;
+  if (sample.valid) {
+    for (auto value : sample.values)
+      print_per_op(value, num_operations);
+  } else {
+    std::cout << " - - -";
+  }
+  print_per_op(allocations, num_operations);
+  std::cout << std::endl;
+}
+
+struct config : configuration {
+  using super = configuration;
+
+  config() : configuration(skip_init) {
+    opt_group{custom_options_, "global"}
+      .add(num_operations, "operations,n",
+           "measured operations per workload (default: 100000)")
+      .add(num_warmup, "warmup,w",
+           "unmeasured operations before each run (default: 10000)")
+      .add(num_subscriptions, "subscriptions,s",
+           "distinct topics for the routing workload (default: 1000)")
+      .add(workloads, "workloads",
+           "subset of: serialize, deserialize, route, store-put, store-get, "
+           "store-erase, store-expire");
+  }
+
+  using super::init;
+
+  std::string help_text() const {
+    return custom_options_.help_text();
+  }
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+  config cfg;
+  try {
+    cfg.init(argc, argv);
+  } catch (std::exception& ex) {
+    std::cerr << ex.what() << "\n\n";
+    std::cerr << "Usage: " << argv[0] << " [<options>]\n\n"
+              << cfg.help_text();
+    return EXIT_FAILURE;
+  }
+  if (cfg.cli_helptext_printed)
+    return EXIT_SUCCESS;
+  if (num_operations == 0 || num_subscriptions == 0) {
+    std::cerr << "*** --operations and --subscriptions must be positive"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  // The simulated clock only moves when the workload advances it.
+  endpoint::clock clock{nullptr, false};
+  clock.advance_time(timestamp{std::chrono::seconds(1000000000)});
+  perf_counters counters;
+  if (!counters.available())
+    std::cerr << "*** hardware counters unavailable, reporting allocations "
+                 "only"
+              << std::endl;
+  std::cout << "# workload instructions/op cycles/op cache-misses/op"
+               " allocations/op"
+            << std::endl;
+  for (auto& name : workloads) {
+    auto w = make_workload(name, clock);
+    if (!w) {
+      std::cerr << "*** unknown workload: " << name << std::endl;
+      return EXIT_FAILURE;
+    }
+    measure(name, *w, counters);
+  }
+  return EXIT_SUCCESS;
+}
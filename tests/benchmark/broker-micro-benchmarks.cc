@@ -0,0 +1,327 @@
+// Microbenchmarks for individual hot paths. Uses Google Benchmark, i.e., run
+// with `--benchmark_format=json` or `--benchmark_out=<file>
+// --benchmark_out_format=json` for results that can be tracked over time.
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "broker/address.hh"
+#include "broker/data.hh"
+#include "broker/message.hh"
+#include "broker/topic.hh"
+#include "broker/zeek.hh"
+
+#include "broker/detail/blob.hh"
+#include "broker/detail/data_codec.hh"
+#include "broker/detail/filesystem.hh"
+#include "broker/detail/generator_file_reader.hh"
+#include "broker/detail/generator_file_writer.hh"
+#include "broker/detail/memory_backend.hh"
+#include "broker/detail/prefix_matcher.hh"
+#include "broker/detail/radix_tree.hh"
+#include "broker/detail/shared_subscriber_queue.hh"
+
+using namespace broker;
+
+namespace {
+
+// -- sample values ------------------------------------------------------------
+
+data make_count() {
+  return count{4711};
+}
+
+data make_string() {
+  return std::string{"zeek/event/conn/established"};
+}
+
+data make_address() {
+  address result;
+  convert("2001:db8::1", result);
+  return result;
+}
+
+data make_vector() {
+  vector result;
+  for (integer i = 0; i < 32; ++i)
+    result.emplace_back(i);
+  return result;
+}
+
+data make_table() {
+  table result;
+  for (count i = 0; i < 32; ++i)
+    result.emplace(std::to_string(i), i);
+  return result;
+}
+
+data make_record() {
+  // Resembles a Zeek log entry.
+  return vector{now(), "CHhAvVGS1DHFjwGM9", make_address(), count{49152},
+                make_address(), count{443}, "tcp", 3.7, count{1234}, true};
+}
+
+std::vector<topic> make_topics(size_t n) {
+  std::vector<topic> result;
+  for (size_t i = 0; i < n; ++i)
+    result.emplace_back("zeek/logs/worker-" + std::to_string(i) + "/conn");
+  return result;
+}
+
+// -- data serialization -------------------------------------------------------
+
+template <data (*Make)()>
+void serialize_binary(benchmark::State& state) {
+  auto x = Make();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(detail::to_blob(x));
+}
+
+template <data (*Make)()>
+void deserialize_binary(benchmark::State& state) {
+  auto buf = detail::to_blob(Make());
+  for (auto _ : state)
+    benchmark::DoNotOptimize(detail::from_blob<data>(buf));
+  state.SetBytesProcessed(state.iterations() * buf.size());
+}
+
+template <data (*Make)()>
+void encode_codec(benchmark::State& state) {
+  auto x = Make();
+  detail::data_codec::buffer buf;
+  for (auto _ : state) {
+    buf.clear();
+    detail::data_codec::encode(x, buf);
+    benchmark::DoNotOptimize(buf.data());
+  }
+}
+
+template <data (*Make)()>
+void decode_codec(benchmark::State& state) {
+  detail::data_codec::buffer buf;
+  detail::data_codec::encode(Make(), buf);
+  for (auto _ : state) {
+    data x;
+    const char* first = buf.data();
+    if (auto err = detail::data_codec::decode(first, first + buf.size(), x))
+      state.SkipWithError("decode failed");
+    benchmark::DoNotOptimize(x);
+  }
+  state.SetBytesProcessed(state.iterations() * buf.size());
+}
+
+template <data (*Make)()>
+void compare_data(benchmark::State& state) {
+  auto x = Make();
+  auto y = x;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(x < y);
+}
+
+template <data (*Make)()>
+void hash_data(benchmark::State& state) {
+  auto x = Make();
+  std::hash<data> f;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(f(x));
+}
+
+#define DATA_BENCHMARKS(fn)                                                    \
+  BENCHMARK_TEMPLATE(fn, make_count);                                          \
+  BENCHMARK_TEMPLATE(fn, make_string);                                         \
+  BENCHMARK_TEMPLATE(fn, make_address);                                        \
+  BENCHMARK_TEMPLATE(fn, make_vector);                                         \
+  BENCHMARK_TEMPLATE(fn, make_table);                                          \
+  BENCHMARK_TEMPLATE(fn, make_record)
+
+DATA_BENCHMARKS(serialize_binary);
+DATA_BENCHMARKS(deserialize_binary);
+DATA_BENCHMARKS(encode_codec);
+DATA_BENCHMARKS(decode_codec);
+DATA_BENCHMARKS(compare_data);
+DATA_BENCHMARKS(hash_data);
+
+// -- topics -------------------------------------------------------------------
+
+void topic_prefix_of(benchmark::State& state) {
+  topic prefix{"zeek/logs/worker-17"};
+  auto topics = make_topics(64);
+  size_t i = 0;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(prefix.prefix_of(topics[i++ % topics.size()]));
+}
+
+BENCHMARK(topic_prefix_of);
+
+void prefix_matcher_filter(benchmark::State& state) {
+  detail::prefix_matcher::filter_type filter;
+  for (int i = 0; i < state.range(0); ++i)
+    filter.emplace_back("zeek/logs/worker-" + std::to_string(i * 2));
+  auto topics = make_topics(64);
+  detail::prefix_matcher f;
+  size_t i = 0;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(f(filter, topics[i++ % topics.size()]));
+}
+
+BENCHMARK(prefix_matcher_filter)->Arg(1)->Arg(8)->Arg(64);
+
+// -- radix tree ---------------------------------------------------------------
+
+std::vector<std::string> make_keys(size_t n) {
+  std::vector<std::string> result;
+  for (size_t i = 0; i < n; ++i)
+    result.emplace_back("host-" + std::to_string(i * 7919 % n) + ".example.com");
+  return result;
+}
+
+void radix_tree_insert_erase(benchmark::State& state) {
+  auto keys = make_keys(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    detail::radix_tree<int> tree;
+    for (auto& key : keys)
+      tree.insert({key, 1});
+    for (auto& key : keys)
+      tree.erase(key);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+BENCHMARK(radix_tree_insert_erase)->Arg(64)->Arg(4096);
+
+void radix_tree_find(benchmark::State& state) {
+  auto keys = make_keys(static_cast<size_t>(state.range(0)));
+  detail::radix_tree<int> tree;
+  for (auto& key : keys)
+    tree.insert({key, 1});
+  size_t i = 0;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(tree.find(keys[i++ % keys.size()]));
+}
+
+BENCHMARK(radix_tree_find)->Arg(64)->Arg(4096);
+
+void radix_tree_prefixed_by(benchmark::State& state) {
+  auto keys = make_keys(4096);
+  detail::radix_tree<int> tree;
+  for (auto& key : keys)
+    tree.insert({key, 1});
+  for (auto _ : state)
+    benchmark::DoNotOptimize(tree.prefixed_by("host-12"));
+}
+
+BENCHMARK(radix_tree_prefixed_by);
+
+// -- shared queues ------------------------------------------------------------
+
+void subscriber_queue_produce_consume(benchmark::State& state) {
+  auto batch_size = static_cast<size_t>(state.range(0));
+  auto q = detail::make_shared_subscriber_queue<data_message>();
+  std::vector<data_message> batch;
+  for (size_t i = 0; i < batch_size; ++i)
+    batch.emplace_back(make_data_message("a/b/c", count{i}));
+  size_t consumed = 0;
+  auto f = [&](data_message&&) { ++consumed; };
+  for (auto _ : state) {
+    q->produce(batch.size(), batch.begin(), batch.end());
+    q->consume(batch.size(), nullptr, f);
+  }
+  state.SetItemsProcessed(state.iterations() * batch_size);
+  benchmark::DoNotOptimize(consumed);
+}
+
+BENCHMARK(subscriber_queue_produce_consume)->Arg(1)->Arg(32)->Arg(512);
+
+// -- generator files ----------------------------------------------------------
+
+void generator_file_read(benchmark::State& state) {
+  auto fname = detail::make_temp_file_name();
+  {
+    detail::generator_file_writer out;
+    if (out.open(fname)) {
+      state.SkipWithError("unable to open generator file");
+      return;
+    }
+    auto topics = make_topics(8);
+    for (size_t i = 0; i < 1024; ++i)
+      out.write(make_data_message(topics[i % topics.size()], make_record()));
+    out.flush();
+  }
+  auto in = detail::make_generator_file_reader(fname);
+  if (!in) {
+    state.SkipWithError("unable to read generator file");
+    return;
+  }
+  detail::generator_file_reader::value_type x;
+  for (auto _ : state) {
+    if (in->at_end())
+      in->rewind();
+    if (in->read(x))
+      state.SkipWithError("unable to decode generator file");
+  }
+  state.SetItemsProcessed(state.iterations());
+  in.reset();
+  detail::remove(fname);
+}
+
+BENCHMARK(generator_file_read);
+
+// -- memory backend -----------------------------------------------------------
+
+void memory_backend_put(benchmark::State& state) {
+  auto keys = make_keys(4096);
+  detail::memory_backend backend;
+  size_t i = 0;
+  for (auto _ : state)
+    backend.put(keys[i++ % keys.size()], make_record(), {});
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(memory_backend_put);
+
+void memory_backend_get(benchmark::State& state) {
+  auto keys = make_keys(4096);
+  detail::memory_backend backend;
+  std::vector<data> xs;
+  for (auto& key : keys) {
+    backend.put(key, make_record(), {});
+    xs.emplace_back(key);
+  }
+  size_t i = 0;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(backend.get(xs[i++ % xs.size()]));
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(memory_backend_get);
+
+// -- Zeek events --------------------------------------------------------------
+
+void zeek_event_construct(benchmark::State& state) {
+  for (auto _ : state) {
+    zeek::Event ev{"connection_established",
+                   vector{make_address(), count{443}, "tcp", 3.7}};
+    benchmark::DoNotOptimize(ev);
+  }
+}
+
+BENCHMARK(zeek_event_construct);
+
+void zeek_event_builder(benchmark::State& state) {
+  for (auto _ : state) {
+    zeek::EventBuilder builder{"connection_established", 4};
+    builder.add(make_address());
+    builder.add(count{443});
+    builder.add("tcp");
+    builder.add(3.7);
+    benchmark::DoNotOptimize(std::move(builder).build());
+  }
+}
+
+BENCHMARK(zeek_event_builder);
+
+} // namespace
+
+BENCHMARK_MAIN();
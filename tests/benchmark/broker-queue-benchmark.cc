@@ -0,0 +1,135 @@
+// Compares the lock-free shared_subscriber_queue against a mutex-based queue
+// with the same flare protocol. Both sides run in their own thread, one
+// producing batches of messages and one consuming them.
+
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "broker/data.hh"
+#include "broker/message.hh"
+#include "broker/topic.hh"
+
+#include "broker/detail/flare.hh"
+#include "broker/detail/shared_subscriber_queue.hh"
+
+using namespace broker;
+
+namespace {
+
+/// The previous implementation of shared_subscriber_queue: a std::deque
+/// guarded by a mutex.
+class mutex_queue {
+public:
+  template <class F>
+  size_t consume(size_t num, F fun) {
+    std::unique_lock<std::mutex> guard{mtx_};
+    if (xs_.empty())
+      return 0;
+    auto n = std::min(num, xs_.size());
+    auto b = xs_.begin();
+    auto e = b + static_cast<ptrdiff_t>(n);
+    for (auto i = b; i != e; ++i)
+      fun(std::move(*i));
+    xs_.erase(b, e);
+    if (xs_.empty())
+      fx_.extinguish_one();
+    return n;
+  }
+
+  template <class Iter>
+  void produce(size_t, Iter i, Iter e) {
+    std::unique_lock<std::mutex> guard{mtx_};
+    if (xs_.empty())
+      fx_.fire();
+    xs_.insert(xs_.end(), i, e);
+  }
+
+  void wait_on_flare() {
+    fx_.await_one();
+  }
+
+private:
+  std::mutex mtx_;
+  detail::flare fx_;
+  std::deque<data_message> xs_;
+};
+
+/// Adapts shared_subscriber_queue to the interface of `mutex_queue`.
+class lock_free_queue {
+public:
+  lock_free_queue() : q_(detail::make_shared_subscriber_queue<>()) {
+    // nop
+  }
+
+  template <class F>
+  size_t consume(size_t num, F fun) {
+    return q_->consume(num, nullptr, std::move(fun));
+  }
+
+  template <class Iter>
+  void produce(size_t num, Iter i, Iter e) {
+    q_->produce(num, i, e);
+  }
+
+  void wait_on_flare() {
+    q_->wait_on_flare();
+  }
+
+private:
+  detail::shared_subscriber_queue_ptr<> q_;
+};
+
+template <class Queue>
+double run(size_t num_items, size_t batch_size) {
+  Queue q;
+  auto msg = make_data_message("/benchmark/queue", data{count{42}});
+  auto t0 = std::chrono::steady_clock::now();
+  std::thread producer{[&] {
+    std::vector<data_message> batch;
+    for (size_t produced = 0; produced < num_items;) {
+      auto n = std::min(batch_size, num_items - produced);
+      batch.assign(n, msg);
+      q.produce(n, std::make_move_iterator(batch.begin()),
+                std::make_move_iterator(batch.end()));
+      produced += n;
+    }
+  }};
+  size_t consumed = 0;
+  while (consumed < num_items) {
+    q.wait_on_flare();
+    consumed += q.consume(batch_size, [](data_message&&) {});
+  }
+  producer.join();
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t num_items = 10000000;
+  size_t batch_size = 50;
+  if (argc > 1)
+    num_items = std::strtoul(argv[1], nullptr, 10);
+  if (argc > 2)
+    batch_size = std::strtoul(argv[2], nullptr, 10);
+  if (num_items == 0 || batch_size == 0) {
+    std::cerr << "usage: " << argv[0] << " [NUM-ITEMS [BATCH-SIZE]]"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto print = [&](const char* name, double secs) {
+    std::cout << name << ": " << secs << "s, "
+              << static_cast<size_t>(num_items / secs) << " items/s"
+              << std::endl;
+  };
+  print("mutex queue", run<mutex_queue>(num_items, batch_size));
+  print("lock-free queue", run<lock_free_queue>(num_items, batch_size));
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+// Measures the node16 child search of the radix tree against the linear
+// search it replaced, both in isolation and for lookups in a tree that
+// consists mostly of node16 nodes.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "broker/detail/radix_tree.hh"
+#include "broker/detail/simd.hh"
+
+using namespace broker;
+
+namespace {
+
+int linear_find(const unsigned char* keys, int n, unsigned char c) {
+  int i = 0;
+  while (i < n && keys[i] != c)
+    ++i;
+  return i;
+}
+
+template <class F>
+void measure(const char* name, size_t iterations, F f) {
+  auto t0 = std::chrono::steady_clock::now();
+  size_t hits = 0;
+  for (size_t i = 0; i < iterations; ++i)
+    hits += f(i);
+  auto t1 = std::chrono::steady_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0);
+  std::cout << name << ": " << (ns.count() / static_cast<double>(iterations))
+            << " ns/op (" << hits << " hits)" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000000;
+  // A full node16 with keys spread across the byte range.
+  unsigned char keys[16];
+  for (int i = 0; i < 16; ++i)
+    keys[i] = static_cast<unsigned char>(i * 16 + 3);
+  auto needle = [&](size_t i) {
+    // Alternates between hits at all positions and misses.
+    return static_cast<unsigned char>((i % 32) * 8 + 3);
+  };
+  measure("node16 search (linear)", iterations, [&](size_t i) {
+    return linear_find(keys, 16, needle(i)) < 16;
+  });
+  measure("node16 search (find_byte16)", iterations, [&](size_t i) {
+    return detail::find_byte16(keys, 16, needle(i)) < 16;
+  });
+  // Three levels of 12 children each keep all inner nodes at node16.
+  detail::radix_tree<int> tree;
+  std::vector<std::string> names;
+  for (char a = 'a'; a < 'a' + 12; ++a)
+    for (char b = 'a'; b < 'a' + 12; ++b)
+      for (char c = 'a'; c < 'a' + 12; ++c) {
+        std::string name{a, b, c};
+        tree.insert({name, static_cast<int>(names.size())});
+        names.emplace_back(std::move(name));
+      }
+  measure("radix_tree::find", iterations, [&](size_t i) {
+    return tree.find(names[i % names.size()]) != tree.end();
+  });
+  measure("radix_tree::prefix_of", iterations / 10, [&](size_t i) {
+    return tree.prefix_of(names[i % names.size()]).size();
+  });
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,260 @@
+// Measures how routing scales with the number of subscriptions, peers and
+// local subscribers. By default, the benchmark drives the subscription index
+// of the core directly. With `--end-to-end`, it instead runs a hub endpoint
+// with real peers and subscribers in this process.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "broker/configuration.hh"
+#include "broker/data.hh"
+#include "broker/endpoint.hh"
+#include "broker/filter_type.hh"
+#include "broker/topic.hh"
+
+#include "broker/detail/subscription_index.hh"
+
+using namespace broker;
+
+namespace {
+
+using fractional_seconds = std::chrono::duration<double>;
+
+std::vector<size_t> num_subscriptions{10, 1000, 100000};
+std::vector<size_t> num_peers{1, 10, 1000};
+std::vector<size_t> num_local_subscribers{1, 100};
+size_t num_messages = 100000;
+bool end_to_end = false;
+double max_wait = 60;
+
+/// Number of distinct topics we publish to. Exceeds the cache of the index
+/// to keep memoization from hiding the matching cost.
+constexpr size_t num_topics = 4096;
+
+double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return fractional_seconds{std::chrono::steady_clock::now() - t0}.count();
+}
+
+// Subscription `i` is a prefix of exactly one published topic. Zero-padding
+// keeps "/scale/1" from matching "/scale/10".
+topic subscription(size_t i) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "/scale/%07zu", i);
+  return topic{buf};
+}
+
+topic published_topic(size_t i) {
+  return subscription(i) / topic{"event"};
+}
+
+// Distributes `n` subscriptions round-robin over `k` subscribers, giving
+// each subscriber at least one subscription.
+std::vector<filter_type> make_filters(size_t n, size_t k) {
+  std::vector<filter_type> result(k);
+  for (size_t i = 0; i < std::max(n, k); ++i)
+    result[i % k].emplace_back(subscription(i % n));
+  return result;
+}
+
+// -- index mode ---------------------------------------------------------------
+
+template <class F>
+double ns_per_op(size_t n, F f) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n; ++i)
+    f(i);
+  return seconds_since(t0) * 1e9 / n;
+}
+
+void run_index(size_t subscriptions, size_t peers, size_t locals) {
+  // Filter propagation: the core replaces the filter of a peer on each
+  // update, so we measure a full replace per peer and per added topic.
+  detail::subscription_index<size_t> peer_index;
+  detail::subscription_index<size_t> worker_index;
+  auto peer_filters = make_filters(subscriptions, peers);
+  auto local_filters = make_filters(subscriptions, locals);
+  auto install = ns_per_op(peers, [&](size_t i) {
+    peer_index.update(i, peer_filters[i]);
+  });
+  for (size_t i = 0; i < locals; ++i)
+    worker_index.update(i, local_filters[i]);
+  size_t num_updates = std::min(peers, size_t{100});
+  auto incremental = ns_per_op(num_updates, [&](size_t i) {
+    peer_filters[i].emplace_back(subscription(subscriptions + i));
+    peer_index.update(i, peer_filters[i]);
+  });
+  // Routing: finding all peers and local subscribers for a message.
+  std::vector<topic> topics;
+  for (size_t i = 0; i < num_topics; ++i)
+    topics.emplace_back(published_topic(i % subscriptions));
+  size_t receivers = 0;
+  auto route = [&](const topic& t) {
+    receivers += peer_index.match(t).size() + worker_index.match(t).size();
+  };
+  auto uncached = ns_per_op(num_messages, [&](size_t i) {
+    route(topics[i % topics.size()]);
+  });
+  auto cached = ns_per_op(num_messages, [&](size_t) { route(topics[0]); });
+  std::cout << subscriptions << ' ' << peers << ' ' << locals << ' '
+            << install << ' ' << incremental << ' ' << uncached << ' '
+            << cached << ' '
+            << static_cast<double>(receivers) / (2 * num_messages)
+            << std::endl;
+}
+
+// -- end-to-end mode ----------------------------------------------------------
+
+struct counter {
+  std::atomic<size_t> value{0};
+};
+
+// Subscribes to `filter` and counts all matching messages in `cnt`.
+void count_messages(endpoint& ep, filter_type filter, counter& cnt) {
+  ep.subscribe_nosync(
+    std::move(filter),
+    [](caf::unit_t&) {
+      // nop
+    },
+    [&cnt](caf::unit_t&, data_message) { ++cnt.value; },
+    [](caf::unit_t&, const caf::error&) {
+      // nop
+    });
+}
+
+int run_end_to_end(size_t subscriptions, size_t peers, size_t locals) {
+  endpoint hub;
+  auto port = hub.listen("127.0.0.1", 0);
+  if (port == 0) {
+    std::cerr << "*** unable to open a port for the hub" << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Receivers 0 to peers - 1 are remote, the others are local.
+  auto peer_filters = make_filters(subscriptions, peers);
+  auto local_filters = make_filters(subscriptions, locals);
+  std::vector<counter> counters(peers + locals);
+  std::vector<std::unique_ptr<endpoint>> remotes;
+  for (size_t i = 0; i < locals; ++i)
+    count_messages(hub, local_filters[i], counters[peers + i]);
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < peers; ++i) {
+    remotes.emplace_back(std::make_unique<endpoint>());
+    count_messages(*remotes.back(), peer_filters[i], counters[i]);
+    if (!remotes.back()->peer("127.0.0.1", port, timeout::seconds(1))) {
+      std::cerr << "*** peer " << i << " unable to connect" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  // Wait until the hub knows the filters of all peers.
+  while (hub.peer_subscriptions().size() < subscriptions) {
+    if (seconds_since(t0) > max_wait) {
+      std::cerr << "*** filters did not propagate in time" << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto propagation = seconds_since(t0);
+  // Each message reaches exactly the receivers with its subscription. Mirrors
+  // the round-robin assignment of `make_filters`.
+  std::vector<size_t> expected(counters.size());
+  auto add_expected = [&](size_t num_receivers, size_t offset) {
+    for (size_t i = 0; i < std::max(subscriptions, num_receivers); ++i) {
+      auto s = i % subscriptions;
+      auto hits = num_messages / subscriptions
+                  + (s < num_messages % subscriptions ? 1 : 0);
+      expected[offset + i % num_receivers] += hits;
+    }
+  };
+  add_expected(peers, 0);
+  add_expected(locals, peers);
+  t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < num_messages; ++i)
+    hub.publish(published_topic(i % subscriptions), count{i});
+  for (size_t i = 0; i < counters.size(); ++i)
+    while (counters[i].value < expected[i]) {
+      if (seconds_since(t0) > max_wait) {
+        std::cerr << "*** receiver " << i << " got only " << counters[i].value
+                  << " of " << expected[i] << " messages" << std::endl;
+        return EXIT_FAILURE;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  auto delivery = seconds_since(t0);
+  std::cout << subscriptions << ' ' << peers << ' ' << locals << ' '
+            << propagation << ' ' << delivery * 1e9 / num_messages
+            << std::endl;
+  remotes.clear();
+  return EXIT_SUCCESS;
+}
+
+struct config : configuration {
+  using super = configuration;
+
+  config() : configuration(skip_init) {
+    opt_group{custom_options_, "global"}
+      .add(num_subscriptions, "subscriptions,s",
+           "distinct topics per run (default: [10, 1000, 100000])")
+      .add(num_peers, "peers,p", "peers per run (default: [1, 10, 1000])")
+      .add(num_local_subscribers, "local-subscribers,l",
+           "local subscribers per run (default: [1, 100])")
+      .add(num_messages, "messages,m", "messages per run (default: 100000)")
+      .add(end_to_end, "end-to-end",
+           "route through real endpoints instead of the index")
+      .add(max_wait, "max-wait",
+           "seconds to wait for deliveries in end-to-end mode (default: 60)");
+  }
+
+  using super::init;
+
+  std::string help_text() const {
+    return custom_options_.help_text();
+  }
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+  config cfg;
+  try {
+    cfg.init(argc, argv);
+  } catch (std::exception& ex) {
+    std::cerr << ex.what() << "\n\n";
+    std::cerr << "Usage: " << argv[0] << " [<options>]\n\n"
+              << cfg.help_text();
+    return EXIT_FAILURE;
+  }
+  if (cfg.cli_helptext_printed)
+    return EXIT_SUCCESS;
+  if (num_messages == 0) {
+    std::cerr << "*** --messages must be positive" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (end_to_end)
+    std::cout << "# subscriptions peers local-subscribers propagation-time"
+                 " ns/msg"
+              << std::endl;
+  else
+    std::cout << "# subscriptions peers local-subscribers ns/install"
+                 " ns/incremental-update ns/route ns/route-cached"
+                 " receivers/msg"
+              << std::endl;
+  for (auto subscriptions : num_subscriptions)
+    for (auto peers : num_peers)
+      for (auto locals : num_local_subscribers) {
+        if (subscriptions == 0 || peers == 0 || locals == 0)
+          continue;
+        if (!end_to_end)
+          run_index(subscriptions, peers, locals);
+        else if (run_end_to_end(subscriptions, peers, locals) != EXIT_SUCCESS)
+          return EXIT_FAILURE;
+      }
+  return EXIT_SUCCESS;
+}
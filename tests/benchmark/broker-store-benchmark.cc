@@ -0,0 +1,276 @@
+// Drives a mix of store operations against a master and measures throughput,
+// clone convergence lag and the time for (re-)synchronizing clones. All
+// endpoints run in this process but peer via TCP on the loopback interface.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "broker/backend.hh"
+#include "broker/backend_options.hh"
+#include "broker/configuration.hh"
+#include "broker/data.hh"
+#include "broker/detail/filesystem.hh"
+#include "broker/endpoint.hh"
+#include "broker/store.hh"
+
+using namespace broker;
+
+namespace {
+
+using fractional_seconds = std::chrono::duration<double>;
+
+std::string backend_name = "memory";
+size_t num_clones = 1;
+std::vector<size_t> store_sizes{1000, 10000, 100000};
+size_t num_operations = 100000;
+size_t put_weight = 40;
+size_t get_weight = 40;
+size_t add_weight = 10;
+size_t erase_weight = 5;
+size_t expire_weight = 5;
+double max_wait = 60;
+bool verbose = false;
+
+double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return fractional_seconds{std::chrono::steady_clock::now() - t0}.count();
+}
+
+// Blocks until `key` has the value `value` in `st`, returning false if it
+// happens not within `max_wait` seconds.
+bool await_value(const store& st, const data& key, const data& value) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (;;) {
+    auto x = st.get(key);
+    if (x && *x == value)
+      return true;
+    if (seconds_since(t0) > max_wait)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// Blocks until the master processed all previously issued operations.
+bool await_master(const store& st, count round) {
+  st.put("sentinel", round);
+  return await_value(st, "sentinel", round);
+}
+
+struct node {
+  explicit node(configuration cfg = configuration{}) : ep(std::move(cfg)) {
+    // nop
+  }
+
+  endpoint ep;
+  store st;
+};
+
+bool make_backend(backend& type, backend_options& opts, std::string& path) {
+  if (backend_name == "memory") {
+    type = backend::memory;
+    return true;
+  }
+  path = detail::make_temp_file_name();
+  opts["path"] = path;
+  if (backend_name == "sqlite")
+    type = backend::sqlite;
+  else if (backend_name == "rocksdb")
+    type = backend::rocksdb;
+  else if (backend_name == "lmdb")
+    type = backend::lmdb;
+  else
+    return false;
+  return true;
+}
+
+int run(size_t store_size) {
+  auto name = "store-benchmark-" + std::to_string(store_size);
+  backend type;
+  backend_options opts;
+  std::string path;
+  if (!make_backend(type, opts, path)) {
+    std::cerr << "*** invalid backend: " << backend_name << std::endl;
+    return EXIT_FAILURE;
+  }
+  node master;
+  auto master_port = master.ep.listen("127.0.0.1", 0);
+  if (master_port == 0) {
+    std::cerr << "*** unable to open a port for the master" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (auto st = master.ep.attach_master(name, type, opts)) {
+    master.st = std::move(*st);
+  } else {
+    std::cerr << "*** unable to attach master: " << to_string(st.error())
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<data> keys;
+  keys.reserve(store_size);
+  for (size_t i = 0; i < store_size; ++i)
+    keys.emplace_back("key-" + std::to_string(i));
+  // Fill the store before any clone attaches.
+  count round = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < store_size; ++i)
+    master.st.put(keys[i], count{i});
+  if (!await_master(master.st, ++round)) {
+    std::cerr << "*** master did not fill up in time" << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto fill_time = seconds_since(t0);
+  // Attach clones, each receives a snapshot of the full store.
+  std::vector<std::unique_ptr<node>> clones;
+  std::vector<const store*> clone_stores;
+  t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < num_clones; ++i) {
+    clones.emplace_back(std::make_unique<node>());
+    auto& clone = *clones.back();
+    if (!clone.ep.peer("127.0.0.1", master_port, timeout::seconds(1))) {
+      std::cerr << "*** clone " << i << " unable to peer" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (auto st = clone.ep.attach_clone(name, 0.1)) {
+      clone.st = std::move(*st);
+      clone_stores.emplace_back(&clone.st);
+    } else {
+      std::cerr << "*** unable to attach clone: " << to_string(st.error())
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  for (auto clone : clone_stores)
+    if (!await_value(*clone, "sentinel", round)) {
+      std::cerr << "*** clone did not receive its snapshot in time"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+  auto snapshot_time = seconds_since(t0);
+  // Run the operation mix against the master.
+  std::minstd_rand rng{static_cast<unsigned>(store_size)};
+  std::uniform_int_distribution<size_t> key_dist{0, store_size - 1};
+  auto total_weight = put_weight + get_weight + add_weight + erase_weight
+                      + expire_weight;
+  if (total_weight == 0) {
+    std::cerr << "*** all operation weights are zero" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::uniform_int_distribution<size_t> op_dist{0, total_weight - 1};
+  auto expiry = std::chrono::duration_cast<timespan>(std::chrono::seconds(1));
+  size_t failed_gets = 0;
+  t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < num_operations; ++i) {
+    auto& key = keys[key_dist(rng)];
+    auto op = op_dist(rng);
+    if (op < put_weight) {
+      master.st.put(key, count{i});
+    } else if ((op -= put_weight) < get_weight) {
+      if (!master.st.get(key))
+        ++failed_gets;
+    } else if ((op -= get_weight) < add_weight) {
+      master.st.increment(key, count{1});
+    } else if ((op -= add_weight) < erase_weight) {
+      master.st.erase(key);
+    } else {
+      master.st.put(key, count{i}, expiry);
+    }
+  }
+  if (!await_master(master.st, ++round)) {
+    std::cerr << "*** master did not process all operations in time"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto ops_time = seconds_since(t0);
+  // Convergence lag: time until the clones catch up after the master did.
+  t0 = std::chrono::steady_clock::now();
+  for (auto clone : clone_stores)
+    if (!await_value(*clone, "sentinel", round)) {
+      std::cerr << "*** clone did not converge in time" << std::endl;
+      return EXIT_FAILURE;
+    }
+  auto convergence_lag = seconds_since(t0);
+  // Resync: disconnect the first clone, modify the store, and reconnect.
+  double resync_time = 0;
+  if (!clones.empty()) {
+    auto& clone = *clones.front();
+    clone.ep.unpeer("127.0.0.1", master_port);
+    master.st.put("sentinel", ++round);
+    t0 = std::chrono::steady_clock::now();
+    if (!clone.ep.peer("127.0.0.1", master_port, timeout::seconds(1))
+        || !await_value(clone.st, "sentinel", round)) {
+      std::cerr << "*** clone did not resync in time" << std::endl;
+      return EXIT_FAILURE;
+    }
+    resync_time = seconds_since(t0);
+  }
+  std::cout << backend_name << ' ' << store_size << ' ' << num_clones << ' '
+            << store_size / fill_time << ' ' << num_operations / ops_time << ' '
+            << convergence_lag << ' ' << snapshot_time << ' ' << resync_time
+            << std::endl;
+  if (verbose && failed_gets > 0)
+    std::cout << "*** " << failed_gets << " gets returned an error"
+              << std::endl;
+  clones.clear();
+  if (!path.empty())
+    detail::remove_all(path);
+  return EXIT_SUCCESS;
+}
+
+struct config : configuration {
+  using super = configuration;
+
+  config() : configuration(skip_init) {
+    opt_group{custom_options_, "global"}
+      .add(backend_name, "backend,b",
+           "memory (default) | sqlite | rocksdb | lmdb")
+      .add(num_clones, "clones,c", "number of clones (default: 1)")
+      .add(store_sizes, "store-sizes,s",
+           "number of keys per run (default: [1000, 10000, 100000])")
+      .add(num_operations, "operations,n",
+           "operations per run (default: 100000)")
+      .add(put_weight, "put-weight", "share of puts (default: 40)")
+      .add(get_weight, "get-weight", "share of gets (default: 40)")
+      .add(add_weight, "add-weight", "share of adds (default: 10)")
+      .add(erase_weight, "erase-weight", "share of erases (default: 5)")
+      .add(expire_weight, "expire-weight",
+           "share of puts with an expiry of 1s (default: 5)")
+      .add(max_wait, "max-wait",
+           "seconds to wait for synchronization (default: 60)")
+      .add(verbose, "verbose", "enable status output");
+  }
+
+  using super::init;
+
+  std::string help_text() const {
+    return custom_options_.help_text();
+  }
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+  config cfg;
+  try {
+    cfg.init(argc, argv);
+  } catch (std::exception& ex) {
+    std::cerr << ex.what() << "\n\n";
+    std::cerr << "Usage: " << argv[0] << " [<options>]\n\n"
+              << cfg.help_text();
+    return EXIT_FAILURE;
+  }
+  if (cfg.cli_helptext_printed)
+    return EXIT_SUCCESS;
+  std::cout << "# backend store-size clones fill-ops/s ops/s convergence-lag"
+               " snapshot-time resync-time (in seconds)"
+            << std::endl;
+  for (auto store_size : store_sizes)
+    if (store_size > 0 && run(store_size) != EXIT_SUCCESS)
+      return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
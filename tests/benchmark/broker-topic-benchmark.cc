@@ -0,0 +1,78 @@
+// Measures topic::prefix_of and topic::split on hierarchical topics against
+// the previous implementations based on std::string::compare and
+// std::string::find.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "broker/topic.hh"
+
+using namespace broker;
+
+namespace {
+
+bool string_prefix_of(const std::string& x, const std::string& y) {
+  return x.size() <= y.size() && y.compare(0, x.size(), x) == 0;
+}
+
+std::vector<std::string> string_split(const std::string& str) {
+  std::vector<std::string> result;
+  std::string::size_type i = 0;
+  while (i != std::string::npos) {
+    auto j = str.find(topic::sep, i);
+    if (j == i) {
+      ++i;
+      continue;
+    }
+    if (j == std::string::npos) {
+      result.push_back(str.substr(i));
+      break;
+    }
+    result.push_back(str.substr(i, j - i));
+    i = (j == str.size() - 1) ? std::string::npos : j + 1;
+  }
+  return result;
+}
+
+template <class F>
+void measure(const char* name, size_t iterations, F f) {
+  auto t0 = std::chrono::steady_clock::now();
+  size_t hits = 0;
+  for (size_t i = 0; i < iterations; ++i)
+    hits += f(i);
+  auto t1 = std::chrono::steady_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0);
+  std::cout << name << ": " << (ns.count() / static_cast<double>(iterations))
+            << " ns/op (" << hits << " hits)" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000000;
+  std::vector<topic> topics;
+  std::vector<topic> prefixes;
+  for (int i = 0; i < 64; ++i) {
+    auto worker = "worker-" + std::to_string(i);
+    topics.emplace_back("zeek/logs/conn/" + worker + "/tcp/established");
+    prefixes.emplace_back("zeek/logs/conn/" + worker);
+  }
+  auto n = topics.size();
+  measure("std::string::compare", iterations, [&](size_t i) {
+    return string_prefix_of(prefixes[i % n].string(),
+                            topics[(i / n) % n].string());
+  });
+  measure("topic::prefix_of", iterations, [&](size_t i) {
+    return prefixes[i % n].prefix_of(topics[(i / n) % n]);
+  });
+  measure("std::string::find split", iterations / 10, [&](size_t i) {
+    return string_split(topics[i % n].string()).size();
+  });
+  measure("topic::split", iterations / 10, [&](size_t i) {
+    return topic::split(topics[i % n]).size();
+  });
+  return 0;
+}
@@ -0,0 +1,125 @@
+#define SUITE arrow
+
+#include "broker/arrow.hh"
+
+#include "test.hh"
+
+#include <cstring>
+
+#include "broker/data.hh"
+#include "broker/message.hh"
+#include "broker/topic.hh"
+
+using namespace broker;
+
+namespace {
+
+struct fixture {
+  ArrowArray array;
+  ArrowSchema schema;
+
+  fixture() {
+    array.release = nullptr;
+    schema.release = nullptr;
+  }
+
+  ~fixture() {
+    if (array.release != nullptr)
+      array.release(&array);
+    if (schema.release != nullptr)
+      schema.release(&schema);
+  }
+
+  error run(std::vector<data> rows, std::vector<count> path = {},
+            std::vector<std::string> names = {}) {
+    std::vector<data_message> xs;
+    for (auto& row : rows)
+      xs.emplace_back(make_data_message("a", std::move(row)));
+    return export_arrow(xs, path, names, &array, &schema);
+  }
+
+  template <class T>
+  T value(size_t column, size_t row) {
+    T result;
+    auto buf = static_cast<const char*>(array.children[column]->buffers[1]);
+    std::memcpy(&result, buf + row * sizeof(T), sizeof(T));
+    return result;
+  }
+
+  bool valid(size_t column, size_t row) {
+    auto buf = static_cast<const uint8_t*>(array.children[column]->buffers[0]);
+    return buf == nullptr || (buf[row / 8] & (1u << (row % 8))) != 0;
+  }
+};
+
+} // namespace <anonymous>
+
+FIXTURE_SCOPE(arrow_tests, fixture)
+
+TEST(rows become a struct array with one child per column) {
+  auto err = run({vector{count{1}, "foo", nil, true},
+                  vector{count{2}, nil, nil, false},
+                  vector{count{3}, "bar", nil, true}},
+                 {}, {"id", "name"});
+  REQUIRE_EQUAL(err, error{});
+  CHECK_EQUAL(array.length, 3);
+  CHECK_EQUAL(array.n_children, 4);
+  CHECK_EQUAL(schema.format, std::string{"+s"});
+  REQUIRE_EQUAL(schema.n_children, 4);
+  CHECK_EQUAL(schema.children[0]->name, std::string{"id"});
+  CHECK_EQUAL(schema.children[1]->name, std::string{"name"});
+  CHECK_EQUAL(schema.children[2]->name, std::string{"f2"});
+  CHECK_EQUAL(schema.children[0]->format, std::string{"L"});
+  CHECK_EQUAL(schema.children[1]->format, std::string{"u"});
+  CHECK_EQUAL(schema.children[2]->format, std::string{"n"});
+  CHECK_EQUAL(schema.children[3]->format, std::string{"b"});
+  CHECK_EQUAL(value<uint64_t>(0, 0), 1u);
+  CHECK_EQUAL(value<uint64_t>(0, 2), 3u);
+  CHECK_EQUAL(array.children[0]->null_count, 0);
+  CHECK_EQUAL(array.children[1]->null_count, 1);
+  CHECK(valid(1, 0));
+  CHECK(!valid(1, 1));
+  CHECK_EQUAL(value<int32_t>(1, 1), 3);
+  CHECK_EQUAL(value<int32_t>(1, 3), 6);
+  auto chars = static_cast<const char*>(array.children[1]->buffers[2]);
+  CHECK_EQUAL(std::string(chars, 6), "foobar");
+  CHECK_EQUAL(array.children[2]->null_count, 3);
+  CHECK_EQUAL(array.children[2]->n_buffers, 0);
+  auto bits = static_cast<const uint8_t*>(array.children[3]->buffers[1]);
+  CHECK_EQUAL(bits[0], 0x05u);
+}
+
+TEST(the row path selects nested vectors) {
+  auto err = run({vector{"x", vector{integer{-1}, real{0.5}}},
+                  vector{"y", vector{integer{2}, real{1.5}}}},
+                 {1});
+  REQUIRE_EQUAL(err, error{});
+  REQUIRE_EQUAL(array.n_children, 2);
+  CHECK_EQUAL(schema.children[0]->format, std::string{"l"});
+  CHECK_EQUAL(schema.children[1]->format, std::string{"g"});
+  CHECK_EQUAL(value<int64_t>(0, 0), -1);
+  CHECK_EQUAL(value<double>(1, 1), 1.5);
+}
+
+TEST(children outlive their parent) {
+  REQUIRE_EQUAL(run({vector{"foo"}}), error{});
+  auto child = *array.children[0];
+  array.children[0]->release = nullptr;
+  array.release(&array);
+  CHECK(array.release == nullptr);
+  auto chars = static_cast<const char*>(child.buffers[2]);
+  CHECK_EQUAL(std::string(chars, 3), "foo");
+  child.release(&child);
+  CHECK(child.release == nullptr);
+}
+
+TEST(inconsistent rows result in errors) {
+  CHECK_EQUAL(run({data{count{1}}}), ec::type_clash);
+  CHECK_EQUAL(run({vector{count{1}}, vector{count{1}, count{2}}}),
+              ec::type_clash);
+  CHECK_EQUAL(run({vector{count{1}}, vector{integer{1}}}), ec::type_clash);
+  CHECK(array.release == nullptr);
+  CHECK(schema.release == nullptr);
+}
+
+FIXTURE_SCOPE_END()
@@ -21,6 +21,7 @@
 #include "broker/detail/abstract_backend.hh"
 #include "broker/detail/assert.hh"
 #include "broker/detail/filesystem.hh"
+#include "broker/detail/lmdb_backend.hh"
 #include "broker/detail/make_backend.hh"
 #include "broker/detail/memory_backend.hh"
 #include "broker/detail/rocksdb_backend.hh"
@@ -41,6 +42,29 @@ bool all_equal(const std::vector<T>& xs) {
   return i == xs.end();
 }
 
+// Visits all entries of `backend` with a scan that stops after each batch and
+// resumes where it stopped.
+expected<broker::snapshot> drain(const detail::abstract_backend& backend,
+                                 size_t batch_size) {
+  broker::snapshot result;
+  optional<data> start;
+  auto oversized = false;
+  do {
+    auto next = backend.scan(start, batch_size, [&](detail::scan_batch& xs) {
+      oversized |= xs.size() > batch_size;
+      for (auto& x : xs)
+        result.emplace(std::move(x.first), std::move(x.second));
+      return false;
+    });
+    if (!next)
+      return next.error();
+    start = std::move(*next);
+  } while (start && !oversized);
+  if (oversized)
+    return make_error(ec::unspecified, "batch exceeds the batch size");
+  return {std::move(result)};
+}
+
 class meta_backend : public detail::abstract_backend {
 public:
   meta_backend(backend_options opts) {
@@ -50,11 +74,25 @@ public:
     path += ".sqlite";
     paths_.push_back(path);
     backends_.push_back(detail::make_backend(sqlite, opts));
+    {
+      auto part_opts = opts;
+      auto& part_path = caf::get<std::string>(part_opts["path"]);
+      part_path = paths_.front() + ".partitioned";
+      for (size_t k = 0; k < 3; ++k)
+        paths_.push_back(part_path + '.' + std::to_string(k));
+      part_opts["partitions"] = count{3};
+      backends_.push_back(detail::make_backend(sqlite, std::move(part_opts)));
+    }
 #ifdef BROKER_HAVE_ROCKSDB
     auto base = path;
     path = base + ".rocksdb";
     paths_.push_back(path);
     backends_.push_back(detail::make_backend(rocksdb, opts));
+#endif
+#ifdef BROKER_HAVE_LMDB
+    path = paths_.front() + ".lmdb";
+    paths_.push_back(path);
+    backends_.push_back(detail::make_backend(lmdb, opts));
 #endif
   }
 
@@ -72,6 +110,15 @@ public:
     );
   }
 
+  expected<void> put_many(const std::unordered_map<data, data>& entries,
+                          optional<timestamp> expiry) override {
+    return perform<void>(
+      [&](detail::abstract_backend& backend) {
+        return backend.put_many(entries, expiry);
+      }
+    );
+  }
+
   expected<void> add(const data& key, const data& value, data::type init_type,
                      optional<timestamp> expiry) override {
     return perform<void>(
@@ -98,6 +145,14 @@ public:
     );
   }
 
+  expected<void> erase_many(const std::vector<data>& keys) override {
+    return perform<void>(
+      [&](detail::abstract_backend& backend) {
+        return backend.erase_many(keys);
+      }
+    );
+  }
+
   expected<void> clear() override {
     return perform<void>(
       [&](detail::abstract_backend& backend) {
@@ -114,6 +169,15 @@ public:
     );
   }
 
+  expected<std::vector<data>> expire_many(const std::vector<data>& keys,
+                                          timestamp ts) override {
+    return perform<std::vector<data>>(
+      [&](detail::abstract_backend& backend) {
+        return backend.expire_many(keys, ts);
+      }
+    );
+  }
+
   expected<data> get(const data& key) const override {
     return perform<data>(
       [&](detail::abstract_backend& backend) {
@@ -130,6 +194,22 @@ public:
     );
   }
 
+  expected<data> get_many(const std::vector<data>& keys) const override {
+    return perform<data>(
+      [&](detail::abstract_backend& backend) {
+        return backend.get_many(keys);
+      }
+    );
+  }
+
+  expected<data> scan(const std::string& prefix, size_t limit) const override {
+    return perform<data>(
+      [&](detail::abstract_backend& backend) {
+        return backend.scan(prefix, limit);
+      }
+    );
+  }
+
   expected<data> keys() const override {
     return perform<data>(
       [&](detail::abstract_backend& backend) {
@@ -162,6 +242,16 @@ public:
     );
   }
 
+  /// Drains each backend with `scan`. Each backend visits the entries in its
+  /// own order, so we can only compare the visited entries as a whole.
+  expected<broker::snapshot> drain(size_t batch_size) const {
+    return perform<broker::snapshot>(
+      [&](detail::abstract_backend& backend) {
+        return ::drain(backend, batch_size);
+      }
+    );
+  }
+
   expected<broker::detail::expirables> expiries() const override {
     return perform<broker::detail::expirables>(
       [](detail::abstract_backend& backend) {
@@ -170,6 +260,15 @@ public:
     );
   }
 
+  expected<broker::detail::expirables>
+  expiries_between(timestamp from, timestamp until) const override {
+    return perform<broker::detail::expirables>(
+      [&](detail::abstract_backend& backend) {
+        return backend.expiries_between(from, until);
+      }
+    );
+  }
+
 private:
   template <class T, class F>
   expected<T> perform(F f) {
@@ -198,6 +297,10 @@ struct fixture : base_fixture {
 
   std::unique_ptr<detail::abstract_backend> backend;
 
+  meta_backend& meta() {
+    return static_cast<meta_backend&>(*backend);
+  }
+
   template <class F>
   auto run(F expr, const char* expr_str) {
     auto res = expr();
@@ -262,6 +365,70 @@ TEST(add/remove) {
   CHECK_EQUAL(*get, data{34});
 }
 
+TEST(add/remove with containers) {
+  MESSAGE("sets");
+  RUN(backend->add("foo", 1, data::type::set));
+  RUN(backend->add("foo", 2, data::type::set));
+  RUN(backend->add("foo", 2, data::type::set));
+  CHECK_EQUAL(RUN(backend->get("foo")), data{set{1, 2}});
+  CHECK_EQUAL(RUN(backend->get("foo", 2)), data{true});
+  RUN(backend->subtract("foo", 1));
+  RUN(backend->subtract("foo", 3));
+  CHECK_EQUAL(RUN(backend->get("foo")), data{set{2}});
+  CHECK_EQUAL(RUN(backend->get("foo", 1)), data{false});
+  MESSAGE("tables");
+  RUN(backend->put("bar", table{{"a", 1}}));
+  RUN(backend->add("bar", vector{"b", 2}, data::type::table));
+  RUN(backend->add("bar", vector{"a", 3}, data::type::table));
+  CHECK_EQUAL(RUN(backend->get("bar")), data{table{{"a", 3}, {"b", 2}}});
+  CHECK_EQUAL(RUN(backend->get("bar", "b")), data{2});
+  CHECK_EQUAL(backend->get("bar", "c"), ec::no_such_key);
+  CHECK_EQUAL(backend->add("bar", 4, data::type::table), ec::type_clash);
+  RUN(backend->subtract("bar", "a"));
+  CHECK_EQUAL(RUN(backend->get("bar")), data{table{{"b", 2}}});
+  MESSAGE("overwrite and erase");
+  RUN(backend->put("foo", 42));
+  CHECK_EQUAL(RUN(backend->get("foo")), data{42});
+  RUN(backend->put("foo", set{3}));
+  CHECK_EQUAL(RUN(backend->get("foo")), data{set{3}});
+  auto ss = RUN(backend->snapshot());
+  CHECK_EQUAL(ss["bar"], data{table{{"b", 2}}});
+  RUN(backend->erase("bar"));
+  RUN(backend->add("bar", vector{"c", 5}, data::type::table));
+  CHECK_EQUAL(RUN(backend->get("bar")), data{table{{"c", 5}}});
+}
+
+TEST(aspect lookups in large containers) {
+  set xs;
+  table ys;
+  for (integer i = 0; i < 1000; ++i) {
+    xs.emplace(i);
+    ys.emplace(i, i * 2);
+  }
+  RUN(backend->put_many({{"xs", xs}, {"ys", ys}}));
+  CHECK_EQUAL(RUN(backend->get("xs", integer{500})), data{true});
+  CHECK_EQUAL(RUN(backend->get("xs", integer{1000})), data{false});
+  CHECK_EQUAL(RUN(backend->get("ys", integer{500})), data{integer{1000}});
+  CHECK_EQUAL(backend->get("ys", integer{1000}), ec::no_such_key);
+  CHECK_EQUAL(backend->get("zs", integer{1}), ec::no_such_key);
+  RUN(backend->subtract("xs", integer{500}));
+  RUN(backend->add("ys", vector{integer{500}, integer{1}}, data::type::table));
+  CHECK_EQUAL(RUN(backend->get("xs", integer{500})), data{false});
+  CHECK_EQUAL(RUN(backend->get("ys", integer{500})), data{integer{1}});
+  xs.erase(integer{500});
+  ys[integer{500}] = integer{1};
+  auto many = RUN(backend->get_many({"xs", "ys"}));
+  CHECK_EQUAL(many, data{table{{"xs", xs}, {"ys", ys}}});
+  MESSAGE("replacing a container drops its old elements");
+  RUN(backend->put("xs", set{integer{2000}}));
+  CHECK_EQUAL(RUN(backend->get("xs", integer{1})), data{false});
+  CHECK_EQUAL(RUN(backend->get("xs")), data{set{integer{2000}}});
+  RUN(backend->put("ys", vector{integer{7}, integer{8}}));
+  CHECK_EQUAL(RUN(backend->get("ys", count{1})), data{integer{8}});
+  RUN(backend->put("ys", table{}));
+  CHECK_EQUAL(RUN(backend->get("ys")), data{table{}});
+}
+
 TEST(erase/exists) {
   using namespace std::chrono;
   auto exists = backend->exists("foo");
@@ -285,6 +452,233 @@ TEST(erase/exists) {
   REQUIRE(erase);
 }
 
+TEST(put_many/erase_many) {
+  RUN(backend->put_many({{"foo", 1}, {"bar", 2}, {"baz", 3}}));
+  CHECK_EQUAL(RUN(backend->size()), 3u);
+  CHECK_EQUAL(RUN(backend->get("bar")), data{2});
+  RUN(backend->erase_many({"foo", "baz", "qux"}));
+  CHECK_EQUAL(RUN(backend->size()), 1u);
+  CHECK_EQUAL(RUN(backend->get("bar")), data{2});
+}
+
+TEST(put_many/erase_many with many entries) {
+  // Exceeds the number of rows per bulk statement of the SQLite backend.
+  std::unordered_map<data, data> entries;
+  std::vector<data> keys;
+  for (integer i = 0; i < 150; ++i) {
+    entries.emplace(i, i * 2);
+    keys.emplace_back(i);
+  }
+  RUN(backend->put_many(entries));
+  CHECK_EQUAL(RUN(backend->size()), 150u);
+  CHECK_EQUAL(RUN(backend->get(integer{70})), data{integer{140}});
+  keys.pop_back();
+  RUN(backend->erase_many(keys));
+  CHECK_EQUAL(RUN(backend->size()), 1u);
+  CHECK_EQUAL(RUN(backend->get(integer{149})), data{integer{298}});
+}
+
+TEST(get_many/scan) {
+  RUN(backend->put_many({{"foo", 1},
+                         {"foo.bar", 2},
+                         {"foobar", 3},
+                         {"fo", 4},
+                         {"bar", 5},
+                         {42u, 6}}));
+  CHECK_EQUAL(RUN(backend->get_many({"foo", "bar", "baz", 42u})),
+              data(table{{"foo", 1}, {"bar", 5}, {42u, 6}}));
+  CHECK_EQUAL(RUN(backend->scan("foo", 0)),
+              data(table{{"foo", 1}, {"foo.bar", 2}, {"foobar", 3}}));
+  CHECK_EQUAL(RUN(backend->scan("foo.", 10)), data(table{{"foo.bar", 2}}));
+  CHECK_EQUAL(RUN(backend->scan("qux", 0)), data(table{}));
+  CHECK_EQUAL(get<table>(RUN(backend->scan("", 0))).size(), 5u);
+  MESSAGE("a limited scan returns any subset of the matches");
+  detail::memory_backend mem;
+  mem.put_many({{"foo", 1}, {"foo.bar", 2}, {"foobar", 3}});
+  auto xs = mem.scan("foo", 2);
+  REQUIRE(xs);
+  CHECK_EQUAL(get<table>(*xs).size(), 2u);
+}
+
+TEST(scan in batches) {
+  broker::snapshot entries;
+  for (count i = 0; i < 10; ++i)
+    entries.emplace(i, i * 2);
+  entries.emplace("foo", set{1, 2});
+  entries.emplace("bar", table{{"x", 1}});
+  for (auto& kvp : entries)
+    RUN(backend->put(kvp.first, kvp.second));
+  CHECK_EQUAL(RUN(meta().drain(1)), entries);
+  CHECK_EQUAL(RUN(meta().drain(3)), entries);
+  CHECK_EQUAL(RUN(meta().drain(100)), entries);
+  MESSAGE("the callback sees each entry once when never stopping");
+  size_t visited = 0;
+  auto next = backend->scan(nil, 4, [&](detail::scan_batch& xs) {
+    visited += xs.size();
+    return true;
+  });
+  REQUIRE(next);
+  CHECK_EQUAL(*next, nil);
+  CHECK_EQUAL(visited, entries.size());
+  MESSAGE("an empty store never calls the callback");
+  RUN(backend->clear());
+  CHECK_EQUAL(RUN(meta().drain(1)), broker::snapshot{});
+}
+
+TEST(memory scan with erased start) {
+  detail::memory_backend mem;
+  mem.put_many({{"foo", 1}, {"bar", 2}, {"baz", 3}});
+  auto next = mem.scan(nil, 1, [](detail::scan_batch&) { return false; });
+  REQUIRE(next);
+  REQUIRE(*next);
+  mem.erase(**next);
+  auto res = mem.scan(*next, 1, [](detail::scan_batch&) { return true; });
+  REQUIRE(!res);
+  CHECK_EQUAL(res.error(), ec::no_such_key);
+}
+
+TEST(memory capacity) {
+  detail::memory_backend mem{backend_options{{"capacity", count{1000}}}};
+  for (count i = 0; i < 1000; ++i)
+    mem.put(i, i * 2);
+  CHECK_EQUAL(*mem.size(), 1000u);
+  CHECK_EQUAL(*mem.get(count{500}), data{count{1000}});
+}
+
+TEST(memory prefix index) {
+  detail::memory_backend mem{backend_options{{"prefix-index", true}}};
+  mem.put_many({{"example.com", 1},
+                {"example.com.mail", 2},
+                {"example.org", 3},
+                {std::string{"examp\0le", 8}, 4},
+                {42u, 5}});
+  auto scan = [&](const char* prefix) {
+    auto xs = mem.scan(prefix, 0);
+    REQUIRE(xs);
+    return std::move(*xs);
+  };
+  MESSAGE("fall back to visiting all entries for keys with null characters");
+  CHECK_EQUAL(get<table>(scan("examp")).size(), 4u);
+  REQUIRE(mem.erase(std::string{"examp\0le", 8}));
+  MESSAGE("answer scans from the radix tree");
+  CHECK_EQUAL(scan("example.com"),
+              data(table{{"example.com", 1}, {"example.com.mail", 2}}));
+  CHECK_EQUAL(get<table>(scan("")).size(), 3u);
+  REQUIRE(mem.erase("example.com"));
+  REQUIRE(mem.put("example.org", 3, broker::now() - std::chrono::seconds{1}));
+  auto expired = mem.expire("example.org", broker::now());
+  REQUIRE(expired);
+  CHECK(*expired);
+  CHECK_EQUAL(scan("example"), data(table{{"example.com.mail", 2}}));
+  REQUIRE(mem.add("example.net", 6, data::type::integer));
+  CHECK_EQUAL(get<table>(scan("example.")).size(), 2u);
+  REQUIRE(mem.clear());
+  CHECK_EQUAL(scan(""), data(table{}));
+}
+
+TEST(memory checkpoint) {
+  auto dir = detail::make_temp_file_name();
+  auto path = dir + "/store.checkpoint";
+  backend_options opts{{"checkpoint", path}};
+  auto expiry = broker::now() + std::chrono::hours{1};
+  {
+    detail::memory_backend mem{opts};
+    CHECK(mem.flush_interval() > timespan{0});
+    for (count i = 0; i < 10; ++i)
+      REQUIRE(mem.put(i, i * 2));
+    REQUIRE(mem.put("foo", "bar", expiry));
+    REQUIRE(mem.add("xs", 1, data::type::set));
+    REQUIRE(mem.add("xs", 2, data::type::set));
+    REQUIRE(mem.subtract("xs", 1));
+    REQUIRE(mem.erase(count{9}));
+  }
+  MESSAGE("restore the content from the snapshot and the log");
+  {
+    detail::memory_backend mem{opts};
+    CHECK_EQUAL(*mem.size(), 11u);
+    CHECK_EQUAL(*mem.get(count{5}), data{count{10}});
+    CHECK_EQUAL(*mem.exists(count{9}), false);
+    CHECK_EQUAL(*mem.get("xs"), data(set{2}));
+    auto expiries = mem.expiries();
+    REQUIRE(expiries);
+    REQUIRE_EQUAL(expiries->size(), 1u);
+    CHECK_EQUAL(expiries->front().first, data{"foo"});
+    CHECK(expiries->front().second == expiry);
+    REQUIRE(mem.clear());
+    REQUIRE(mem.put("baz", 42));
+    REQUIRE(mem.flush());
+  }
+  {
+    detail::memory_backend mem{opts};
+    CHECK_EQUAL(*mem.size(), 1u);
+    CHECK_EQUAL(*mem.get("baz"), data{42});
+  }
+  detail::remove_all(dir);
+}
+
+#ifdef BROKER_HAVE_ROCKSDB
+
+TEST(rocksdb tuning) {
+  auto path = detail::make_temp_file_name();
+  {
+    detail::rocksdb_backend db{backend_options{
+      {"path", path},
+      {"block-cache-size", count{8 << 20}},
+      {"bloom-bits-per-key", count{10}},
+      {"write-buffer-size", count{4 << 20}},
+      {"max-background-jobs", count{2}},
+      {"compression", "none"},
+      {"profile", "point-lookup"},
+    }};
+    RUN(db.put("foo", 1));
+    RUN(db.put("foobar", 2));
+    CHECK_EQUAL(RUN(db.get("foo")), data{1});
+    CHECK_EQUAL(RUN(db.keys()), data(set{"foo", "foobar"}));
+    CHECK_EQUAL(RUN(db.scan("foo", 0)),
+                data(table{{"foo", 1}, {"foobar", 2}}));
+  }
+  detail::remove_all(path);
+}
+
+TEST(rocksdb merge adds) {
+  auto path = detail::make_temp_file_name();
+  {
+    detail::rocksdb_backend db{backend_options{
+      {"path", path},
+      {"merge-adds", true},
+    }};
+    RUN(db.add("n", count{1}, data::type::count));
+    RUN(db.add("n", count{2}, data::type::count));
+    RUN(db.add("s", "foo", data::type::string));
+    RUN(db.add("s", "bar", data::type::string));
+    RUN(db.add("v", 1, data::type::vector));
+    RUN(db.add("xs", 1, data::type::set));
+    CHECK_EQUAL(RUN(db.get("n")), data{count{3}});
+    CHECK_EQUAL(RUN(db.get("s")), data{"foobar"});
+    CHECK_EQUAL(RUN(db.get("v")), data{vector{1}});
+    MESSAGE("operands that do not apply leave the value unchanged");
+    RUN(db.add("n", "foo", data::type::count));
+    RUN(db.add("xs", 2, data::type::count));
+    CHECK_EQUAL(RUN(db.get("n")), data{count{3}});
+    CHECK_EQUAL(RUN(db.get("xs")), data{set{1}});
+    MESSAGE("merges apply to values from puts and get dropped by erases");
+    RUN(db.put("n", count{10}));
+    RUN(db.add("n", count{5}, data::type::count));
+    CHECK_EQUAL(RUN(db.get("n")), data{count{15}});
+    RUN(db.erase("n"));
+    RUN(db.add("n", count{5}, data::type::count));
+    CHECK_EQUAL(RUN(db.get("n")), data{count{5}});
+    CHECK_EQUAL(RUN(db.snapshot()),
+                (broker::snapshot{{"n", count{5}},
+                                  {"s", "foobar"},
+                                  {"v", vector{1}},
+                                  {"xs", set{1}}}));
+  }
+  detail::remove_all(path);
+}
+
+#endif // BROKER_HAVE_ROCKSDB
+
 TEST(clear/keys) {
   using namespace std::chrono;
   auto put = backend->put("foo", "1");
@@ -324,6 +718,38 @@ TEST(expiration with expiry) {
   CHECK(!*exists); // element removed
 }
 
+TEST(expire_many) {
+  using namespace std::chrono;
+  auto t0 = broker::now();
+  RUN(backend->put("a", 1, t0 + seconds(1)));
+  RUN(backend->put("b", 2, t0 + seconds(3)));
+  RUN(backend->put("c", 3));
+  std::vector<data> keys{"a", "b", "c", "d"};
+  CHECK_EQUAL(RUN(backend->expire_many(keys, t0)), std::vector<data>{});
+  CHECK_EQUAL(RUN(backend->expire_many(keys, t0 + seconds(2))),
+              std::vector<data>{"a"});
+  CHECK_EQUAL(RUN(backend->size()), 2u);
+  CHECK_EQUAL(RUN(backend->expire_many(keys, t0 + seconds(4))),
+              std::vector<data>{"b"});
+  CHECK_EQUAL(RUN(backend->keys()), data(set{"c"}));
+}
+
+TEST(expiries_between) {
+  using namespace std::chrono;
+  auto t0 = broker::now();
+  RUN(backend->put("a", 1, t0 + seconds(1)));
+  RUN(backend->put("b", 2, t0 + seconds(3)));
+  RUN(backend->put("c", 3));
+  auto es = RUN(backend->expiries_between(t0, t0 + seconds(2)));
+  REQUIRE_EQUAL(es.size(), 1u);
+  CHECK_EQUAL(es.front().first, data{"a"});
+  es = RUN(backend->expiries_between(t0 + seconds(1), t0 + seconds(3)));
+  REQUIRE_EQUAL(es.size(), 1u);
+  CHECK_EQUAL(es.front().first, data{"b"});
+  CHECK(RUN(backend->expiries_between(t0 + seconds(3), t0 + hours(1)))
+          .empty());
+}
+
 TEST(expiration without expiry) {
   auto put = backend->put("foo", 4.2);
   REQUIRE(put);
@@ -350,3 +776,58 @@ TEST(size/snapshot) {
 }
 
 FIXTURE_SCOPE_END()
+
+TEST(sqlite group commit) {
+  auto path = detail::make_temp_file_name();
+  backend_options opts{{"path", path},
+                       {"batch_size", count{3}},
+                       {"journal_mode", "wal"},
+                       {"synchronous", "normal"}};
+  {
+    detail::sqlite_backend backend{opts};
+    CHECK(backend.flush_interval() > timespan{0});
+    for (count i = 0; i < 5; ++i)
+      REQUIRE(backend.put(i, i * 2, nil));
+    auto size = backend.size();
+    REQUIRE(size);
+    CHECK_EQUAL(*size, 5u);
+    REQUIRE(backend.flush());
+  }
+  {
+    detail::sqlite_backend backend{backend_options{{"path", path}}};
+    CHECK_EQUAL(backend.flush_interval(), timespan{0});
+    auto size = backend.size();
+    REQUIRE(size);
+    CHECK_EQUAL(*size, 5u);
+    auto value = backend.get(count{4});
+    REQUIRE(value);
+    CHECK_EQUAL(*value, data{count{8}});
+  }
+  detail::remove_all(path);
+}
+
+TEST(sqlite readers) {
+  auto path = detail::make_temp_file_name();
+  {
+    detail::sqlite_backend backend{backend_options{{"path", path}}};
+    CHECK_EQUAL(backend.make_reader(), nullptr);
+  }
+  detail::remove_all(path);
+  backend_options opts{{"path", path}, {"journal_mode", "wal"}};
+  {
+    detail::sqlite_backend backend{opts};
+    REQUIRE(backend.put("foo", 1, nil));
+    auto reader = backend.make_reader();
+    REQUIRE(reader != nullptr);
+    auto foo = reader->get("foo");
+    REQUIRE(foo);
+    CHECK_EQUAL(*foo, data{1});
+    REQUIRE(backend.put("bar", 2, nil));
+    auto bar = reader->get("bar");
+    REQUIRE(bar);
+    CHECK_EQUAL(*bar, data{2});
+    CHECK(!reader->put("baz", 3, nil));
+    CHECK_EQUAL(reader->make_reader(), nullptr);
+  }
+  detail::remove_all(path);
+}
@@ -205,14 +205,11 @@ CAF_TEST(local_peers) {
       CAF_REQUIRE_EQUAL(xs, expected);
     }
   );
-  CAF_MESSAGE("send message 'directly' from core1 to core2 (bypass streaming)");
+  CAF_MESSAGE("send message from core1 to the subscribers of core2 only");
   anon_send(core1, atom::publish::value, endpoint_info{core2.node(), caf::none},
             make_data_message(topic("b"), data{true}));
   expect((atom::publish, endpoint_info, data_message),
          from(_).to(core1).with(_, _, _));
-  expect((atom::publish, atom::local, data_message),
-         from(core1).to(core2).with(_, _,
-                                    make_data_message(topic("b"), data{true})));
   run();
   CAF_MESSAGE("check log of the consumer again");
   self->send(leaf, atom::get::value);
@@ -492,6 +489,149 @@ CAF_TEST(sequenced_peering) {
   anon_send_exit(core3, exit_reason::user_shutdown);
 }
 
+// Checks that cores collect subscriptions and only send new topics to peers.
+CAF_TEST(incremental_filter_updates) {
+  broker_options options;
+  options.disable_ssl = true;
+  auto core1 = sys.spawn(core_actor, filter_type{"a"}, options, nullptr);
+  auto core2 = sys.spawn(core_actor, filter_type{"x"}, options, nullptr);
+  anon_send(core1, atom::no_events::value);
+  anon_send(core2, atom::no_events::value);
+  run();
+  CAF_MESSAGE("peer core1 and core2");
+  self->send(core1, atom::peer::value, core2);
+  run();
+  CAF_MESSAGE("subscribe to several topics on core1 at once");
+  anon_send(core1, atom::subscribe::value, filter_type{"c", "b"});
+  anon_send(core1, atom::subscribe::value, filter_type{"a", "b"});
+  anon_send(core1, atom::subscribe::value, filter_type{"d"});
+  expect((atom::subscribe, filter_type), from(_).to(core1).with(_, _));
+  expect((atom::subscribe, filter_type), from(_).to(core1).with(_, _));
+  expect((atom::subscribe, filter_type), from(_).to(core1).with(_, _));
+  expect((atom::tick, atom::update), from(core1).to(core1));
+  expect((atom::update, atom::add, filter_type),
+         from(core1).to(core2).with(_, _, filter_type{"b", "c", "d"}));
+  run();
+  sched.inline_next_enqueue();
+  self
+    ->request(core2, infinite, atom::get::value, atom::peer::value,
+              atom::subscriptions::value)
+    .receive(
+      [&](const std::vector<topic>& xs) {
+        CAF_CHECK_EQUAL(xs, filter_type({"a", "b", "c", "d"}));
+      },
+      [&](const error& err) { CAF_FAIL(sys.render(err)); });
+  anon_send_exit(core1, exit_reason::user_shutdown);
+  anon_send_exit(core2, exit_reason::user_shutdown);
+}
+
+CAF_TEST_FIXTURE_SCOPE_END()
+
+namespace {
+
+struct relay_config : config {
+  relay_config() {
+    set("broker.store.relay-clone-updates", true);
+  }
+};
+
+struct relay_fixture : test_coordinator_fixture<relay_config> {
+  relay_fixture() {
+    base_fixture::init_socket_api();
+  }
+
+  ~relay_fixture() {
+    base_fixture::deinit_socket_api();
+  }
+};
+
+} // namespace <anonymous>
+
+CAF_TEST_FIXTURE_SCOPE(relay_tests, relay_fixture)
+
+CAF_TEST(relays_subscribe_to_clone_topics_of_their_peers) {
+  broker_options options;
+  options.disable_ssl = true;
+  auto clone_topic = topic{"foo"} / topics::clone_suffix;
+  auto core1 = sys.spawn(core_actor, filter_type{}, options, nullptr);
+  auto core2 = sys.spawn(core_actor, filter_type{}, options, nullptr);
+  auto core3 = sys.spawn(core_actor, filter_type{}, options, nullptr);
+  for (auto& core : {core1, core2, core3})
+    anon_send(core, atom::no_events::value);
+  run();
+  CAF_MESSAGE("connect core1 to core3 via core2");
+  self->send(core1, atom::peer::value, core2);
+  self->send(core2, atom::peer::value, core3);
+  run();
+  CAF_MESSAGE("subscribe to a clone topic on core3");
+  anon_send(core3, atom::subscribe::value, filter_type{clone_topic});
+  run();
+  CAF_MESSAGE("core2 announces the clone topic to core1");
+  sched.inline_next_enqueue();
+  self
+    ->request(core1, infinite, atom::get::value, atom::peer::value,
+              atom::subscriptions::value)
+    .receive(
+      [&](const std::vector<topic>& xs) {
+        CAF_CHECK_EQUAL(xs, filter_type({clone_topic}));
+      },
+      [&](const error& err) { CAF_FAIL(sys.render(err)); });
+  for (auto& core : {core1, core2, core3})
+    anon_send_exit(core, exit_reason::user_shutdown);
+}
+
+CAF_TEST_FIXTURE_SCOPE_END()
+
+namespace {
+
+struct unreliable_config : config {
+  unreliable_config() {
+    set("broker.unreliable-topics", std::vector<std::string>{"a"});
+  }
+};
+
+struct unreliable_fixture : test_coordinator_fixture<unreliable_config> {
+  unreliable_fixture() {
+    base_fixture::init_socket_api();
+  }
+
+  ~unreliable_fixture() {
+    base_fixture::deinit_socket_api();
+  }
+};
+
+} // namespace <anonymous>
+
+CAF_TEST_FIXTURE_SCOPE(unreliable_tests, unreliable_fixture)
+
+CAF_TEST(unreliable_topics_bypass_the_streams_to_peers) {
+  broker_options options;
+  options.disable_ssl = true;
+  auto core1 = sys.spawn(core_actor, filter_type{}, options, nullptr);
+  auto core2 = sys.spawn(core_actor, filter_type{"a", "b"}, options, nullptr);
+  for (auto& core : {core1, core2})
+    anon_send(core, atom::no_events::value);
+  run();
+  auto leaf = sys.spawn(consumer, filter_type{"a", "b"}, core2);
+  run();
+  self->send(core1, atom::peer::value, core2);
+  run();
+  CAF_MESSAGE("publish on a reliable and an unreliable topic");
+  anon_send(core1, atom::publish::value, make_data_message("a", data{1}));
+  expect((atom::publish, data_message), from(_).to(core1).with(_, _));
+  expect((atom::unreliable, node_message), from(core1).to(core2).with(_, _));
+  anon_send(core1, atom::publish::value, make_data_message("b", data{2}));
+  run();
+  self->send(leaf, atom::get::value);
+  sched.prioritize(leaf);
+  consume_message();
+  self->receive([](const std::vector<element_type>& xs) {
+    CAF_CHECK_EQUAL(xs, data_msgs({{"a", 1}, {"b", 2}}));
+  });
+  for (auto& core : {core1, core2})
+    anon_send_exit(core, exit_reason::user_shutdown);
+}
+
 CAF_TEST_FIXTURE_SCOPE_END()
 
 namespace {
@@ -36,6 +36,9 @@ TEST(timestamp) {
 TEST(enum) {
   auto e = enum_value{"foo"};
   CHECK_EQUAL(e.name, "foo");
+  CHECK(e.name_view() == "foo");
+  CHECK(e == "foo");
+  CHECK(e != "bar");
 }
 
 TEST(address) {
@@ -120,6 +123,53 @@ TEST(data - relational operators) {
   CHECK_EQUAL(data{1.111}, data{1.111});
 }
 
+TEST(data - ordering) {
+  // Values of different types order by their position in data_variant.
+  CHECK_LESS(data{}, data{false});
+  CHECK_LESS(data{count{42}}, data{integer{1}});
+  CHECK_LESS(data{integer{42}}, data{"a"});
+  CHECK_LESS(data{"b"}, data{"ba"});
+  CHECK_LESS(data{-0.5}, data{0.0});
+  CHECK(!(data{0.0} < data{-0.0}));
+  CHECK(!(data{-0.0} < data{0.0}));
+  CHECK_LESS(data(vector{1, 2}), data(vector{1, 2, 0}));
+  CHECK_LESS(data(vector{1, 2, 3}), data(vector{1, 3}));
+  CHECK_LESS(data(table{{"a", 2}}), data(table{{"a", 3}}));
+  CHECK_LESS(data(table{{"a", 3}}), data(table{{"b", 0}}));
+  CHECK_LESS(data(set{1}), data(vector{0}));
+  CHECK(data{"b"} >= data{"a"});
+  CHECK(data{"a"} <= data{"a"});
+}
+
+TEST(data - hashing) {
+  auto h = [](const data& x) { return std::hash<data>{}(x); };
+  CHECK_EQUAL(h(data{0.0}), h(data{-0.0}));
+  CHECK_EQUAL(h(data(vector{1, "foo"})), h(data(vector{1, "foo"})));
+  CHECK_NOT_EQUAL(h(data{count{1}}), h(data{integer{1}}));
+  CHECK_NOT_EQUAL(h(data{"foo"}), h(data{"foo bar baz qux"}));
+  CHECK_NOT_EQUAL(h(data(vector{1, 2})), h(data(vector{2, 1})));
+  CHECK_NOT_EQUAL(h(data(vector{vector{1}, 2})), h(data(vector{1, vector{2}})));
+  CHECK_NOT_EQUAL(h(data(table{{1, 2}})), h(data(table{{2, 1}})));
+}
+
+TEST(data - stable hashing) {
+  // These values must never change, since Broker persists placements of keys.
+  CHECK_EQUAL(detail::stable_hash(data{integer{42}}), 0xb1a5fe9657c6f54cull);
+  CHECK_EQUAL(detail::stable_hash(data{"foo"}), 0x3d1d680cbd85d50dull);
+  CHECK_EQUAL(detail::stable_hash(data{0.0}), detail::stable_hash(data{-0.0}));
+  CHECK_NOT_EQUAL(detail::stable_hash(data{count{1}}),
+                  detail::stable_hash(data{integer{1}}));
+}
+
+TEST(data - string views) {
+  data x{"foo"};
+  CHECK(get_string_view(x) == "foo");
+  auto view = get_if_string_view(x);
+  REQUIRE(view);
+  CHECK(*view == "foo");
+  CHECK(!get_if_string_view(data{42}));
+}
+
 TEST(data - vector) {
   vector v{42, 43, 44};
   REQUIRE_EQUAL(v.size(), 3u);
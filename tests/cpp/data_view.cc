@@ -0,0 +1,38 @@
+#define SUITE data_view
+
+#include "broker/data_view.hh"
+
+#include "test.hh"
+
+#include "broker/packed.hh"
+
+using namespace broker;
+
+TEST(plain messages require no decoding) {
+  data_view view{make_data_message("foo", 42)};
+  CHECK_EQUAL(view.get_topic(), "foo"_t);
+  CHECK(!view.packed());
+  CHECK(view.decoded());
+  REQUIRE(view.get() != nullptr);
+  CHECK_EQUAL(*view.get(), data{42});
+}
+
+TEST(packed messages decode on first access) {
+  data x = vector{1, "two", 3.0};
+  data_view view{make_data_message("foo", pack(x))};
+  CHECK(view.packed());
+  CHECK(!view.decoded());
+  REQUIRE(view.get() != nullptr);
+  CHECK_EQUAL(*view.get(), x);
+  CHECK(view.decoded());
+  auto copy = view;
+  CHECK(copy.decoded());
+  CHECK(copy.get() == view.get());
+}
+
+TEST(invalid packed payloads yield nullptr) {
+  packed_data invalid{packed_data::buffer_type{'\xFF'}};
+  data_view view{make_data_message("foo", invalid)};
+  CHECK(view.packed());
+  CHECK(view.get() == nullptr);
+}
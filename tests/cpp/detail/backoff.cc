@@ -0,0 +1,39 @@
+#define SUITE backoff
+
+#include "broker/detail/backoff.hh"
+
+#include "test.hh"
+
+using namespace broker;
+
+using std::chrono::seconds;
+
+CAF_TEST(delays grow exponentially up to the maximum) {
+  detail::backoff uut{2.0, seconds{60}, 0.0};
+  CHECK_EQUAL(uut.delay(seconds{10}, 0), timespan{seconds{10}});
+  CHECK_EQUAL(uut.delay(seconds{10}, 1), timespan{seconds{20}});
+  CHECK_EQUAL(uut.delay(seconds{10}, 2), timespan{seconds{40}});
+  CHECK_EQUAL(uut.delay(seconds{10}, 3), timespan{seconds{60}});
+  CHECK_EQUAL(uut.delay(seconds{10}, 100), timespan{seconds{60}});
+}
+
+CAF_TEST(the maximum never shrinks the initial delay) {
+  detail::backoff uut{2.0, seconds{5}, 0.0};
+  CHECK_EQUAL(uut.delay(seconds{10}, 0), timespan{seconds{10}});
+  CHECK_EQUAL(uut.delay(seconds{10}, 3), timespan{seconds{10}});
+}
+
+CAF_TEST(a factor of one disables the backoff) {
+  detail::backoff uut{1.0, seconds{60}, 0.0};
+  CHECK_EQUAL(uut.delay(seconds{10}, 0), timespan{seconds{10}});
+  CHECK_EQUAL(uut.delay(seconds{10}, 5), timespan{seconds{10}});
+}
+
+CAF_TEST(jitter randomizes the delay within bounds) {
+  detail::backoff uut{2.0, seconds{60}, 0.5};
+  for (size_t i = 0; i < 100; ++i) {
+    auto x = uut.delay(seconds{10}, 1);
+    CHECK_GREATER_EQUAL(x, timespan{seconds{10}});
+    CHECK_LESS_EQUAL(x, timespan{seconds{20}});
+  }
+}
@@ -0,0 +1,132 @@
+#define SUITE clone_cache
+
+#include "broker/detail/clone_cache.hh"
+
+#include "test.hh"
+
+#include "broker/backend_options.hh"
+#include "broker/detail/filesystem.hh"
+#include "broker/detail/make_backend.hh"
+
+using namespace broker;
+
+using content_type = detail::clone_cache::content_type;
+
+namespace {
+
+struct fixture : base_fixture {
+  std::string path = detail::make_temp_file_name() + ".sqlite";
+
+  ~fixture() {
+    detail::remove_all(path);
+  }
+
+  std::unique_ptr<detail::abstract_backend> open() {
+    return detail::make_backend(backend::sqlite,
+                                backend_options{{"path", path}});
+  }
+
+  std::unique_ptr<detail::clone_cache> make_cache() {
+    return std::make_unique<detail::clone_cache>(open());
+  }
+};
+
+} // namespace
+
+FIXTURE_SCOPE(clone_cache_tests, fixture)
+
+TEST(an empty cache restores nothing) {
+  content_type content{{"a", 1}};
+  CHECK_EQUAL(make_cache()->load(content), 0u);
+  CHECK(content.empty());
+}
+
+TEST(caches restore the last checkpoint) {
+  content_type content{{"a", 1}, {"b", 2}};
+  {
+    auto cache = make_cache();
+    cache->replaced();
+    CHECK_EQUAL(cache->checkpoint(content, 10), caf::none);
+    content["a"] = 3;
+    content.erase("b");
+    content["c"] = 4;
+    cache->modified("a");
+    cache->modified("b");
+    cache->modified("c");
+    CHECK(cache->dirty(10));
+    CHECK_EQUAL(cache->checkpoint(content, 12), caf::none);
+    CHECK(!cache->dirty(12));
+    CHECK_EQUAL(cache->checkpoints(), 2u);
+  }
+  content_type restored;
+  CHECK_EQUAL(make_cache()->load(restored), 12u);
+  CHECK_EQUAL(restored, content);
+}
+
+TEST(checkpoints skip unmodified caches) {
+  auto cache = make_cache();
+  content_type content{{"a", 1}};
+  cache->replaced();
+  CHECK_EQUAL(cache->checkpoint(content, 1), caf::none);
+  CHECK_EQUAL(cache->checkpoint(content, 1), caf::none);
+  CHECK_EQUAL(cache->checkpoints(), 1u);
+}
+
+TEST(interrupted checkpoints invalidate the sequence number) {
+  {
+    auto cache = make_cache();
+    content_type content{{"a", 1}, {"b", 2}};
+    cache->replaced();
+    CHECK_EQUAL(cache->checkpoint(content, 5), caf::none);
+  }
+  {
+    // Simulate a crash after erasing keys but before writing the new
+    // sequence number.
+    auto backend = open();
+    CHECK(backend->put(detail::clone_cache::seq_key(), count{0}));
+    CHECK(backend->erase("b"));
+  }
+  content_type restored;
+  CHECK_EQUAL(make_cache()->load(restored), 0u);
+  CHECK(restored.empty());
+}
+
+TEST(caches adopt checkpoints of masters) {
+  auto dir = detail::make_temp_file_name();
+  auto master_path = dir + "/master.sqlite";
+  auto checkpoint_path = dir + "/checkpoint";
+  content_type content{{"a", 1}, {"b", 2}};
+  {
+    auto master = detail::make_backend(backend::sqlite,
+                                       backend_options{{"path", master_path}});
+    CHECK(master->put_many(content));
+    auto files = master->checkpoint(checkpoint_path);
+    REQUIRE(files);
+    CHECK_EQUAL(*files, std::vector<std::string>{checkpoint_path});
+  }
+  content_type adopted{{"c", 3}};
+  {
+    detail::clone_cache cache{open(), backend::sqlite, path};
+    cache.replaced();
+    CHECK_EQUAL(cache.checkpoint(adopted, 1), caf::none);
+    CHECK_EQUAL(cache.adopt(checkpoint_path, adopted, 42), caf::none);
+    CHECK_EQUAL(adopted, content);
+    CHECK(!cache.dirty(42));
+  }
+  CHECK(!detail::exists(checkpoint_path));
+  content_type restored;
+  CHECK_EQUAL(make_cache()->load(restored), 42u);
+  CHECK_EQUAL(restored, content);
+  detail::remove_all(dir);
+}
+
+TEST(backends parse from strings) {
+  auto x = backend::memory;
+  CHECK(detail::convert("sqlite", x));
+  CHECK(x == backend::sqlite);
+  CHECK(detail::convert("rocksdb", x));
+  CHECK(x == backend::rocksdb);
+  CHECK(!detail::convert("memory", x));
+}
+
+FIXTURE_SCOPE_END()
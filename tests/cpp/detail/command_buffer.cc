@@ -0,0 +1,161 @@
+#define SUITE command_buffer
+
+#include "broker/detail/command_buffer.hh"
+
+#include "test.hh"
+
+#include <initializer_list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <caf/deep_to_string.hpp>
+
+using namespace broker;
+
+using buffer = detail::command_buffer;
+
+namespace {
+
+struct fixture : base_fixture {
+  detail::memory_accounting_ptr mem
+    = caf::make_counted<detail::memory_accounting>();
+
+  buffer buf;
+
+  std::vector<std::pair<internal_command, buffer::discard_reason>> discarded;
+
+  fixture() {
+    buf.on_discard([this](const internal_command& cmd,
+                          buffer::discard_reason reason) {
+      discarded.emplace_back(cmd, reason);
+    });
+  }
+
+  static internal_command put(data key, data value) {
+    return make_internal_command<put_command>(std::move(key),
+                                              std::move(value));
+  }
+
+  static internal_command erase(data key) {
+    return make_internal_command<erase_command>(std::move(key));
+  }
+
+  static internal_command add(data key, data value) {
+    return make_internal_command<add_command>(std::move(key), std::move(value),
+                                              data::type::integer);
+  }
+
+  // internal_command has no equality operator, so we compare strings.
+  static std::string str(const internal_command& cmd) {
+    return caf::deep_to_string(cmd);
+  }
+
+  static std::vector<std::string>
+  strs(std::initializer_list<internal_command> xs) {
+    std::vector<std::string> result;
+    for (auto& x : xs)
+      result.emplace_back(str(x));
+    return result;
+  }
+
+  std::vector<std::string> drain() {
+    std::vector<std::string> result;
+    auto err = buf.drain([&](internal_command& cmd) {
+      result.emplace_back(str(cmd));
+    });
+    if (err)
+      FAIL("unable to drain the buffer: " << to_string(err));
+    return result;
+  }
+};
+
+} // namespace
+
+FIXTURE_SCOPE(command_buffer_tests, fixture)
+
+TEST(coalescing moves the newest command to the back) {
+  buf.init(sys, 0, buffer::overflow_policy::drop_oldest, nullptr);
+  buf.push(put("a", 1));
+  buf.push(put("b", 2));
+  buf.push(erase("a"));
+  buf.push(put("b", 3));
+  CHECK_EQUAL(buf.size(), 2u);
+  CHECK_EQUAL(buf.coalesced(), 2u);
+  REQUIRE_EQUAL(discarded.size(), 2u);
+  CHECK_EQUAL(str(discarded[0].first), str(put("a", 1)));
+  CHECK(discarded[0].second == buffer::discard_reason::coalesced);
+  CHECK_EQUAL(str(discarded[1].first), str(put("b", 2)));
+  CHECK_EQUAL(drain(), strs({erase("a"), put("b", 3)}));
+  CHECK(buf.empty());
+}
+
+TEST(partial updates prevent coalescing) {
+  buf.init(sys, 0, buffer::overflow_policy::drop_oldest, nullptr);
+  buf.push(put("a", 1));
+  buf.push(add("a", 1));
+  buf.push(put("a", 3));
+  CHECK_EQUAL(buf.size(), 3u);
+  CHECK_EQUAL(buf.coalesced(), 0u);
+  CHECK_EQUAL(drain(), strs({put("a", 1), add("a", 1), put("a", 3)}));
+}
+
+TEST(drop oldest discards the oldest commands on overflow) {
+  buf.init(sys, 2, buffer::overflow_policy::drop_oldest, nullptr);
+  buf.push(put("a", 1));
+  buf.push(put("b", 2));
+  buf.push(put("c", 3));
+  CHECK_EQUAL(buf.size(), 2u);
+  CHECK_EQUAL(buf.dropped(), 1u);
+  REQUIRE_EQUAL(discarded.size(), 1u);
+  CHECK_EQUAL(str(discarded[0].first), str(put("a", 1)));
+  CHECK(discarded[0].second == buffer::discard_reason::dropped);
+  // Dropping "a" must not break coalescing for the remaining keys.
+  buf.push(put("b", 4));
+  CHECK_EQUAL(buf.dropped(), 1u);
+  CHECK_EQUAL(drain(), strs({put("c", 3), put("b", 4)}));
+}
+
+TEST(spilling keeps all commands in order) {
+  buf.init(sys, 2, buffer::overflow_policy::spill, nullptr);
+  for (integer i = 0; i < 5; ++i)
+    CHECK_EQUAL(buf.push(put(i, i)), caf::none);
+  CHECK_EQUAL(buf.size(), 5u);
+  CHECK_EQUAL(buf.spilled(), 3u);
+  CHECK_EQUAL(buf.dropped(), 0u);
+  std::vector<std::string> expected;
+  for (integer i = 0; i < 5; ++i)
+    expected.emplace_back(str(put(i, i)));
+  CHECK_EQUAL(drain(), expected);
+  CHECK(buf.empty());
+  // The buffer starts over after draining.
+  CHECK_EQUAL(buf.push(put("a", 1)), caf::none);
+  CHECK_EQUAL(buf.spilled(), 0u);
+  CHECK_EQUAL(drain(), strs({put("a", 1)}));
+}
+
+TEST(buffers report their memory usage) {
+  buf.init(sys, 0, buffer::overflow_policy::drop_oldest, mem);
+  auto x = put("a", std::string(100, 'x'));
+  auto y = put("a", "y");
+  buf.push(x);
+  CHECK_EQUAL(buf.memory_usage(), detail::estimated_size(x));
+  buf.push(y);
+  CHECK_EQUAL(buf.memory_usage(), detail::estimated_size(y));
+  CHECK_EQUAL(mem->usage(detail::memory_accounting::clone_buffers),
+              detail::estimated_size(y));
+  buf.clear();
+  CHECK_EQUAL(mem->usage(detail::memory_accounting::clone_buffers), 0u);
+}
+
+TEST(buffers treat an exhausted memory limit like a full buffer) {
+  mem->limit(detail::memory_accounting::clone_buffers, 1);
+  buf.init(sys, 0, buffer::overflow_policy::drop_oldest, mem);
+  buf.push(put("a", 1));
+  buf.push(put("b", 2));
+  CHECK_EQUAL(buf.size(), 1u);
+  CHECK_EQUAL(buf.dropped(), 1u);
+  CHECK_EQUAL(drain(), strs({put("b", 2)}));
+}
+
+FIXTURE_SCOPE_END()
@@ -0,0 +1,96 @@
+#define SUITE compression
+
+#include "broker/detail/compression.hh"
+
+#include "test.hh"
+
+#include <string>
+#include <vector>
+
+using namespace broker;
+using namespace broker::detail;
+
+namespace {
+
+std::vector<node_message> make_batch() {
+  std::vector<node_message> result;
+  for (integer i = 0; i < 100; ++i)
+    result.emplace_back(
+      make_node_message(make_data_message("zeek/logs/conn",
+                                          vector{i, "192.168.1.1", 80}),
+                        20));
+  auto cmd = make_internal_command<put_command>(data{"key"}, data{42});
+  result.emplace_back(
+    make_node_message(make_command_message("foo/store", std::move(cmd)), 10));
+  return result;
+}
+
+} // namespace
+
+CAF_TEST_FIXTURE_SCOPE(compression_tests, base_fixture)
+
+CAF_TEST(algorithms convert to and from strings) {
+  for (auto x : {compression::none, compression::lz4, compression::zstd}) {
+    auto y = compression::none;
+    CHECK(convert(to_string(x), y));
+    CHECK(x == y);
+  }
+  auto x = compression::none;
+  CHECK(!convert("gzip", x));
+  CHECK(!supported(compression::none));
+  for (auto& str : supported_compressions()) {
+    CHECK(convert(str, x));
+    CHECK(supported(x));
+  }
+}
+
+CAF_TEST(supported algorithms round trip batches) {
+  for (auto& str : supported_compressions()) {
+    MESSAGE("algorithm: " << str);
+    auto algorithm = compression::none;
+    REQUIRE(convert(str, algorithm));
+    auto xs = make_batch();
+    compressed_batch packed;
+    REQUIRE_EQUAL(compress(sys, algorithm, xs, packed), caf::none);
+    CHECK_LESS(packed.bytes.size(), packed.size);
+    std::vector<node_message> ys;
+    REQUIRE_EQUAL(decompress(sys, packed, ys), caf::none);
+    REQUIRE_EQUAL(ys.size(), xs.size());
+    for (size_t i = 0; i < xs.size(); ++i) {
+      CHECK_EQUAL(ys[i].ttl, xs[i].ttl);
+      CHECK_EQUAL(get_topic(ys[i]), get_topic(xs[i]));
+    }
+    CHECK_EQUAL(get_data(caf::get<data_message>(ys[7].content)),
+                get_data(caf::get<data_message>(xs[7].content)));
+    // Corrupted input must not decompress.
+    packed.size += 1;
+    CHECK_NOT_EQUAL(decompress(sys, packed, ys), caf::none);
+  }
+}
+
+CAF_TEST(supported algorithms round trip snapshot chunks) {
+  snapshot xs;
+  for (integer i = 0; i < 100; ++i)
+    xs.emplace(data{i}, data{"value number " + std::to_string(i)});
+  for (auto& str : supported_compressions()) {
+    MESSAGE("algorithm: " << str);
+    auto algorithm = compression::none;
+    REQUIRE(convert(str, algorithm));
+    compressed_batch packed;
+    REQUIRE_EQUAL(compress(sys, algorithm, xs, packed), caf::none);
+    CHECK_LESS(packed.bytes.size(), packed.size);
+    snapshot ys;
+    REQUIRE_EQUAL(decompress(sys, packed, ys), caf::none);
+    CHECK(ys == xs);
+  }
+}
+
+CAF_TEST(unsupported algorithms result in errors) {
+  auto xs = make_batch();
+  compressed_batch packed;
+  CHECK_NOT_EQUAL(compress(sys, compression::none, xs, packed), caf::none);
+  std::vector<node_message> ys;
+  CHECK_NOT_EQUAL(decompress(sys, packed, ys), caf::none);
+}
+
+CAF_TEST_FIXTURE_SCOPE_END()
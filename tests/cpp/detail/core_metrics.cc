@@ -0,0 +1,114 @@
+#define SUITE core_metrics
+
+#include "broker/detail/core_metrics.hh"
+
+#include "test.hh"
+
+using namespace broker;
+
+namespace {
+
+bool contains(const std::string& haystack, const std::string& needle) {
+  return haystack.find(needle) != std::string::npos;
+}
+
+} // namespace
+
+TEST(histograms use power of two buckets) {
+  detail::histogram h;
+  for (uint64_t x : {0, 1, 2, 3, 4, 5, 1000000})
+    h.observe(x);
+  CHECK_EQUAL(h.samples(), 7u);
+  CHECK_EQUAL(h.sum(), 1000015u);
+  CHECK_EQUAL(h.buckets()[0], 2u); // 0 and 1
+  CHECK_EQUAL(h.buckets()[1], 1u); // 2
+  CHECK_EQUAL(h.buckets()[2], 2u); // 3 and 4
+  CHECK_EQUAL(h.buckets()[3], 1u); // 5
+  CHECK_EQUAL(h.buckets()[detail::histogram::num_buckets - 1], 1u);
+}
+
+TEST(size estimates grow with the payload) {
+  auto small = detail::estimated_size(data{"abc"});
+  auto large = detail::estimated_size(data{std::string(100, 'x')});
+  CHECK_EQUAL(large - small, 97u);
+  auto xs = vector{1, 2, 3};
+  CHECK(detail::estimated_size(data{xs}) > 3 * detail::estimated_size(1));
+}
+
+TEST(core metrics count messages per topic) {
+  detail::core_metrics m;
+  m.record(make_data_message("foo", "abc"));
+  m.record(make_data_message("foo", "abcdef"));
+  m.record(make_data_message("bar", 42));
+  m.record_batch(2);
+  REQUIRE_EQUAL(m.topics().size(), 2u);
+  auto& foo = m.topics().at("foo");
+  CHECK_EQUAL(foo.messages, 2u);
+  CHECK_EQUAL(foo.bytes, detail::estimated_size(data{"abc"})
+                           + detail::estimated_size(data{"abcdef"}));
+  CHECK_EQUAL(m.topics().at("bar").messages, 1u);
+  CHECK_EQUAL(m.batch_sizes().samples(), 1u);
+}
+
+TEST(snapshots render in the Prometheus text format) {
+  detail::core_metrics m;
+  m.record(make_data_message("foo", "abc"));
+  m.record_batch(3);
+  auto topics = m.topics_to_data();
+  table peers{{"peer-1", table{{"queue-depth", count{5}},
+                               {"credit", integer{-1}}}}};
+  table snapshot{{"topics", std::move(topics)},
+                 {"peers", std::move(peers)},
+                 {"batch-sizes", m.batch_sizes().to_data()},
+                 {"unshares", count{2}}};
+  auto text = detail::to_prometheus(snapshot);
+  CHECK(contains(text, "# TYPE broker_topic_messages_total counter\n"));
+  CHECK(contains(text, "broker_topic_messages_total{topic=\"foo\"} 1\n"));
+  CHECK(contains(text, "broker_peer_queue_depth{peer=\"peer-1\"} 5\n"));
+  CHECK(contains(text, "broker_peer_credit{peer=\"peer-1\"} -1\n"));
+  CHECK(contains(text, "broker_batch_size_bucket{le=\"2\"} 0\n"));
+  CHECK(contains(text, "broker_batch_size_bucket{le=\"4\"} 1\n"));
+  CHECK(contains(text, "broker_batch_size_bucket{le=\"+Inf\"} 1\n"));
+  CHECK(contains(text, "broker_batch_size_sum 3\n"));
+  CHECK(contains(text, "broker_batch_size_count 1\n"));
+  CHECK(contains(text, "# TYPE broker_unshares_total counter\n"));
+  CHECK(contains(text, "broker_unshares_total 2\n"));
+}
+
+TEST(aggregators combine summaries of multiple endpoints) {
+  auto summary = [](count endpoints, count messages, uint64_t batch_size) {
+    detail::histogram batch_sizes;
+    batch_sizes.observe(batch_size);
+    return table{{"endpoints", endpoints},
+                 {"topics", table{{"foo", table{{"messages", messages},
+                                                {"bytes", count{10}}}}}},
+                 {"batch-sizes", batch_sizes.to_data()}};
+  };
+  auto t0 = broker::now();
+  auto t1 = t0 + std::chrono::seconds(1);
+  detail::metrics_aggregator aggregator;
+  aggregator.merge(table{{"a", summary(1, 1, 1)}, {"b", summary(2, 5, 8)}},
+                   t0);
+  MESSAGE("newer summaries replace older summaries of the same endpoint");
+  aggregator.merge(table{{"a", summary(1, 3, 1)}}, t1);
+  auto total = aggregator.total();
+  CHECK_EQUAL(total["endpoints"], data{count{3}});
+  auto& foo = caf::get<table>(caf::get<table>(total["topics"])["foo"]);
+  CHECK_EQUAL(foo["messages"], data{count{8}});
+  CHECK_EQUAL(foo["bytes"], data{count{20}});
+  detail::histogram batch_sizes;
+  REQUIRE(batch_sizes.merge(total["batch-sizes"]));
+  CHECK_EQUAL(batch_sizes.samples(), 2u);
+  CHECK_EQUAL(batch_sizes.sum(), 9u);
+  CHECK(!batch_sizes.merge(data{42}));
+  auto text = detail::to_prometheus(table{{"cluster", total}});
+  CHECK(contains(text, "broker_cluster_endpoints 3\n"));
+  CHECK(contains(text,
+                 "broker_cluster_topic_messages_total{topic=\"foo\"} 8\n"));
+  CHECK(contains(text, "broker_cluster_batch_size_count 2\n"));
+  MESSAGE("summaries expire unless refreshed");
+  aggregator.expire(t1);
+  CHECK_EQUAL(aggregator.to_data().size(), 1u);
+  aggregator.expire(t1 + std::chrono::seconds(1));
+  CHECK(aggregator.empty());
+}
@@ -0,0 +1,116 @@
+#define SUITE data_codec
+
+#include "broker/detail/data_codec.hh"
+
+#include "test.hh"
+
+#include <limits>
+#include <string>
+
+#include "broker/convert.hh"
+
+using namespace broker;
+
+using buffer = detail::data_codec::buffer;
+
+namespace {
+
+buffer encode(const data& x) {
+  buffer result;
+  detail::data_codec::encode(x, result);
+  return result;
+}
+
+data round_trip(const data& x) {
+  auto buf = encode(x);
+  const char* first = buf.data();
+  const char* last = first + buf.size();
+  data result;
+  if (auto err = detail::data_codec::decode(first, last, result))
+    CAF_FAIL("decode failed: " << to_string(err));
+  if (first != last)
+    CAF_FAIL("decode did not consume all bytes");
+  return result;
+}
+
+address addr(const char* str) {
+  auto result = to<address>(str);
+  if (!result)
+    CAF_FAIL("invalid address: " << str);
+  return *result;
+}
+
+} // namespace
+
+TEST(varints round trip) {
+  for (uint64_t x : {uint64_t{0}, uint64_t{127}, uint64_t{128},
+                     uint64_t{300}, std::numeric_limits<uint64_t>::max()}) {
+    buffer buf;
+    detail::data_codec::write_varint(x, buf);
+    const char* first = buf.data();
+    uint64_t y = 0;
+    CHECK(detail::data_codec::read_varint(first, buf.data() + buf.size(), y));
+    CHECK_EQUAL(x, y);
+  }
+}
+
+TEST(all types round trip) {
+  data values[] = {
+    data{},
+    true,
+    false,
+    count{0},
+    count{14},
+    count{15},
+    std::numeric_limits<count>::max(),
+    integer{-7},
+    integer{1000},
+    std::numeric_limits<integer>::min(),
+    real{4.2},
+    std::string{},
+    std::string{"foo"},
+    std::string(300, 'x'),
+    addr("1.2.3.4"),
+    addr("dead::beef"),
+    subnet{addr("10.0.0.0"), 8},
+    subnet{addr("dead::"), 64},
+    port{80, port::protocol::tcp},
+    port{65535, port::protocol::icmp},
+    timestamp{timespan{-42}},
+    timespan{123456789},
+    enum_value{"foo::bar"},
+    set{1, 2, 3},
+    table{{"a", 1}, {"b", vector{1, "x"}}},
+    vector{data{}, vector{set{}, table{}}, "foo"},
+  };
+  for (auto& x : values)
+    CHECK_EQUAL(round_trip(x), x);
+}
+
+TEST(small values use a single byte) {
+  CHECK_EQUAL(encode(data{}).size(), 1u);
+  CHECK_EQUAL(encode(true).size(), 1u);
+  CHECK_EQUAL(encode(count{14}).size(), 1u);
+  CHECK_EQUAL(encode(count{15}).size(), 2u);
+  CHECK_EQUAL(encode(integer{-7}).size(), 1u);
+  CHECK_EQUAL(encode(std::string{"foo"}).size(), 4u);
+  CHECK_EQUAL(encode(addr("1.2.3.4")).size(), 5u);
+  CHECK_EQUAL(encode(addr("dead::beef")).size(), 17u);
+}
+
+TEST(malformed input results in an error) {
+  auto buf = encode(vector{1, "foo", set{2, 3}});
+  for (size_t n = 0; n < buf.size(); ++n) {
+    const char* first = buf.data();
+    data x;
+    CHECK_NOT_EQUAL(detail::data_codec::decode(first, first + n, x),
+                    caf::none);
+  }
+  // A chain of tags for vectors with one element each.
+  buffer deep(100, encode(vector{data{}})[0]);
+  const char* first = deep.data();
+  data x;
+  CHECK_NOT_EQUAL(
+    detail::data_codec::decode(first, deep.data() + deep.size(), x),
+    caf::none);
+}
@@ -5,11 +5,13 @@
 #include "test.hh"
 
 #include <cctype>
+#include <set>
 #include <vector>
 
 #include <caf/binary_deserializer.hpp>
 #include <caf/binary_serializer.hpp>
 
+#include "broker/detail/data_codec.hh"
 #include "broker/detail/meta_data_writer.hh"
 
 using namespace broker;
@@ -32,7 +34,11 @@ struct fixture {
   }
 
   void add_meta(data::type tag, uint32_t container_size) {
-    CHECK_EQUAL(sink(tag, container_size), caf::none);
+    CHECK_EQUAL(sink(tag), caf::none);
+    detail::data_codec::buffer size;
+    detail::data_codec::write_varint(container_size, size);
+    for (auto c : size)
+      CHECK_EQUAL(sink(static_cast<uint8_t>(c)), caf::none);
   }
 
   data generate() {
@@ -43,6 +49,23 @@ struct fixture {
     CHECK_EQUAL(source.remaining(), 0u);
     return result;
   }
+
+  /// Generates `n` values from the same meta data with a single generator.
+  std::vector<data> generate(detail::data_generator::profile prof, size_t n) {
+    std::vector<data> result;
+    auto meta = buf;
+    for (size_t i = 1; i < n; ++i)
+      buf.insert(buf.end(), meta.begin(), meta.end());
+    caf::binary_deserializer source{nullptr, buf};
+    detail::data_generator generator{source, std::move(prof)};
+    for (size_t i = 0; i < n; ++i) {
+      data x;
+      CHECK_EQUAL(generator(x), caf::none);
+      result.emplace_back(std::move(x));
+    }
+    CHECK_EQUAL(source.remaining(), 0u);
+    return result;
+  }
 };
 
 template <class T>
@@ -237,4 +260,53 @@ TEST(roundtrip with meta_data_writer) {
   CHECK_EQUAL(get<std::string>(x[3]).size(), get<std::string>(y[3]).size());
 }
 
+TEST(generator files prior to version 4 store fixed-size sizes) {
+  CHECK_EQUAL(sink(data::type::string, uint32_t{300}), caf::none);
+  caf::binary_deserializer source{nullptr, buf};
+  detail::data_generator generator{source};
+  generator.varint_sizes(false);
+  data x;
+  CHECK_EQUAL(generator(x), caf::none);
+  CHECK_EQUAL(source.remaining(), 0u);
+  REQUIRE(holds_alternative<std::string>(x));
+  CHECK_EQUAL(get<std::string>(x).size(), 300u);
+}
+
+TEST(profiles compose strings from words) {
+  add_meta(data::type::string, 11);
+  detail::data_generator::profile prof;
+  prof.words = {"foo", "bar"};
+  for (auto& x : generate(prof, 10)) {
+    REQUIRE(holds_alternative<std::string>(x));
+    auto& str = get<std::string>(x);
+    CHECK_EQUAL(str.size(), 11u);
+    CHECK(str.compare(0, 3, "foo") == 0 || str.compare(0, 3, "bar") == 0);
+    CHECK_EQUAL(str[3], ' ');
+  }
+}
+
+TEST(profiles reuse previously generated values) {
+  add_meta(data::type::string, 16);
+  detail::data_generator::profile prof;
+  prof.reuse = 0.9;
+  auto xs = generate(prof, 100);
+  std::set<data> unique_values{xs.begin(), xs.end()};
+  CHECK_GREATER(unique_values.size(), 1u);
+  CHECK_LESS(unique_values.size(), 50u);
+  for (auto& x : xs)
+    CHECK_EQUAL(get<std::string>(x).size(), 16u);
+}
+
+TEST(profiles pick addresses from ranges) {
+  add_meta(data::type::address);
+  detail::data_generator::profile prof;
+  address net;
+  REQUIRE(convert(std::string{"10.1.0.0"}, net));
+  prof.address_ranges.emplace_back(net, 16);
+  for (auto& x : generate(prof, 20)) {
+    REQUIRE(holds_alternative<address>(x));
+    CHECK(prof.address_ranges.front().contains(get<address>(x)));
+  }
+}
+
 FIXTURE_SCOPE_END()
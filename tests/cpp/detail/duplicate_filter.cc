@@ -0,0 +1,55 @@
+#define SUITE duplicate_filter
+
+#include "broker/detail/duplicate_filter.hh"
+
+#include "test.hh"
+
+using namespace broker;
+
+using detail::duplicate_filter;
+
+CAF_TEST(the filter rejects repeated messages) {
+  duplicate_filter uut;
+  CHECK(uut.accept(1, 10));
+  CHECK(uut.accept(1, 11));
+  CHECK(!uut.accept(1, 10));
+  CHECK(!uut.accept(1, 11));
+  CHECK(uut.accept(2, 10));
+  CHECK_EQUAL(uut.rejected(), 2u);
+}
+
+CAF_TEST(the filter accepts reordered messages once) {
+  duplicate_filter uut;
+  CHECK(uut.accept(1, 100));
+  CHECK(uut.accept(1, 98));
+  CHECK(uut.accept(1, 99));
+  CHECK(!uut.accept(1, 98));
+  CHECK(!uut.accept(1, 99));
+  CHECK(uut.accept(1, 200));
+  CHECK(!uut.accept(1, 100));
+  CHECK(uut.accept(1, 150));
+}
+
+CAF_TEST(the filter accepts messages older than its window) {
+  duplicate_filter uut;
+  CHECK(uut.accept(1, 0));
+  CHECK(uut.accept(1, duplicate_filter::window_size));
+  CHECK(uut.accept(1, 0));
+  CHECK(!uut.accept(1, duplicate_filter::window_size));
+}
+
+CAF_TEST(the filter handles wrapping sequence numbers) {
+  duplicate_filter uut;
+  CHECK(uut.accept(1, 0xFFFFFFFFu));
+  CHECK(uut.accept(1, 0));
+  CHECK(uut.accept(1, 1));
+  CHECK(!uut.accept(1, 0xFFFFFFFFu));
+  CHECK(!uut.accept(1, 0));
+}
+
+CAF_TEST(the filter ignores messages without origin) {
+  duplicate_filter uut;
+  CHECK(uut.accept(0, 1));
+  CHECK(uut.accept(0, 1));
+  CHECK_EQUAL(uut.rejected(), 0u);
+}
@@ -0,0 +1,60 @@
+#define SUITE event_batcher
+
+#include "broker/detail/event_batcher.hh"
+
+#include "test.hh"
+
+#include "broker/topic.hh"
+
+using namespace broker;
+
+using detail::event_batcher;
+
+namespace {
+
+auto peer_a = network_info{"10.0.0.1", 4242};
+
+auto peer_b = network_info{"10.0.0.2", 4242};
+
+data_message event(int code) {
+  return make_data_message(topics::statuses, code);
+}
+
+} // namespace
+
+CAF_TEST(disabled batchers admit all events) {
+  event_batcher uut;
+  CHECK(!uut.enabled());
+  auto key = event_batcher::make_key(false, 1, peer_a);
+  CHECK(uut.admit(key));
+  CHECK(uut.admit(key));
+  CHECK_EQUAL(uut.suppressed(), 0u);
+}
+
+CAF_TEST(batchers drop repeated events per peer) {
+  event_batcher uut{std::chrono::milliseconds(100)};
+  CHECK(uut.admit(event_batcher::make_key(false, 1, peer_a)));
+  CHECK(uut.admit(event_batcher::make_key(false, 1, peer_b)));
+  CHECK(uut.admit(event_batcher::make_key(false, 2, peer_a)));
+  CHECK(uut.admit(event_batcher::make_key(true, 1, peer_a)));
+  CHECK(!uut.admit(event_batcher::make_key(false, 1, peer_a)));
+  CHECK_EQUAL(uut.suppressed(), 1u);
+  CHECK(uut.push(event(1)));
+  CHECK(!uut.push(event(2)));
+  CHECK_EQUAL(uut.size(), 2u);
+  CHECK_EQUAL(uut.flush().size(), 2u);
+  CHECK_EQUAL(uut.size(), 0u);
+  MESSAGE("a new batch admits the event again");
+  CHECK(uut.admit(event_batcher::make_key(false, 1, peer_a)));
+  CHECK(uut.push(event(1)));
+}
+
+CAF_TEST(batchers bound the number of events per batch) {
+  event_batcher uut{std::chrono::milliseconds(100), 2};
+  CHECK(uut.admit(event_batcher::make_key(false, 1, peer_a)));
+  CHECK(uut.admit(event_batcher::make_key(false, 2, peer_a)));
+  CHECK(!uut.admit(event_batcher::make_key(false, 3, peer_a)));
+  CHECK_EQUAL(uut.dropped(), 1u);
+  uut.flush();
+  CHECK(uut.admit(event_batcher::make_key(false, 3, peer_a)));
+}
@@ -0,0 +1,105 @@
+#define SUITE generator_file_recorder
+
+#include "broker/detail/generator_file_recorder.hh"
+
+#include "test.hh"
+
+#include "broker/detail/filesystem.hh"
+#include "broker/detail/generator_file_reader.hh"
+
+using namespace broker;
+
+namespace {
+
+using overflow_policy = detail::generator_file_recorder::overflow_policy;
+
+struct fixture {
+  fixture() {
+    file_name = detail::make_temp_file_name();
+  }
+
+  ~fixture() {
+    detail::remove(file_name);
+  }
+
+  std::string file_name;
+};
+
+} // namespace
+
+CAF_TEST_FIXTURE_SCOPE(generator_file_recorder_tests, fixture)
+
+CAF_TEST(the recorder writes all messages when blocking on overflow) {
+  {
+    auto rec = detail::make_generator_file_recorder(file_name, 4,
+                                                    overflow_policy::block);
+    REQUIRE_NOT_EQUAL(rec, nullptr);
+    for (integer i = 0; i < 1000; ++i)
+      CHECK(rec->push(make_data_message("foo", i)));
+    CHECK_EQUAL(rec->dropped(), 0u);
+    CHECK(!rec->failed());
+  }
+  auto reader = detail::make_generator_file_reader(file_name);
+  REQUIRE_NOT_EQUAL(reader, nullptr);
+  CHECK_EQUAL(reader->skip_to_end(), caf::none);
+  CHECK_EQUAL(reader->data_entries(), 1000u);
+}
+
+CAF_TEST(the recorder accounts for dropped messages) {
+  size_t dropped = 0;
+  {
+    auto rec = detail::make_generator_file_recorder(file_name, 2,
+                                                    overflow_policy::drop);
+    REQUIRE_NOT_EQUAL(rec, nullptr);
+    for (integer i = 0; i < 1000; ++i)
+      CHECK(rec->push(make_data_message("foo", i)));
+    dropped = rec->dropped();
+  }
+  auto reader = detail::make_generator_file_reader(file_name);
+  REQUIRE_NOT_EQUAL(reader, nullptr);
+  CHECK_EQUAL(reader->skip_to_end(), caf::none);
+  CHECK_EQUAL(reader->data_entries() + dropped, 1000u);
+}
+
+CAF_TEST(the recorder rotates segments and keeps the most recent ones) {
+  auto dir = file_name + "-segments";
+  REQUIRE(detail::mkdirs(dir));
+  detail::generator_file_recorder::segment_options segments;
+  segments.prefix = dir + "/messages";
+  segments.max_duration = std::chrono::seconds(1);
+  segments.max_segments = 2;
+  auto t0 = timestamp{};
+  {
+    auto writer = detail::make_generator_file_writer(
+      detail::segment_file_name(segments.prefix, 1));
+    REQUIRE_NOT_EQUAL(writer, nullptr);
+    detail::generator_file_recorder rec{std::move(writer), 8,
+                                        overflow_policy::block, segments};
+    // Three seconds of traffic with one message every 500ms.
+    for (integer i = 0; i < 6; ++i) {
+      auto msg = make_data_message("foo", i);
+      CHECK(rec.push(msg, t0 + std::chrono::milliseconds(500 * i)));
+    }
+  }
+  CHECK_EQUAL(detail::segment_file_name("messages", 1), "messages-0001.dat");
+  CHECK(!detail::exists(detail::segment_file_name(segments.prefix, 1)));
+  for (size_t index : {2u, 3u}) {
+    auto fname = detail::segment_file_name(segments.prefix, index);
+    auto reader = detail::make_generator_file_reader(fname);
+    REQUIRE_NOT_EQUAL(reader, nullptr);
+    CHECK_EQUAL(reader->skip_to_end(), caf::none);
+    CHECK_EQUAL(reader->data_entries(), 2u);
+  }
+  detail::remove_all(dir);
+}
+
+CAF_TEST(overflow policies are convertible from strings) {
+  auto policy = overflow_policy::block;
+  CHECK(detail::convert("drop", policy));
+  CHECK(policy == overflow_policy::drop);
+  CHECK(detail::convert("block", policy));
+  CHECK(policy == overflow_policy::block);
+  CHECK(!detail::convert("foo", policy));
+}
+
+CAF_TEST_FIXTURE_SCOPE_END()
@@ -85,4 +85,89 @@ CAF_TEST(command_message roundtrip with generator_file_reader) {
   CHECK_EQUAL(reader->read(y_msg), ec::end_of_file);
 }
 
+CAF_TEST(generator files consist of self-contained blocks) {
+  {
+    auto out = detail::make_generator_file_writer(file_name);
+    REQUIRE_NOT_EQUAL(out, nullptr);
+    out->flush_threshold(1); // Forces one block per entry.
+    *out << make_data_message("foo", 1);
+    *out << make_data_message("bar", "abc");
+    *out << make_data_message("foo", 2);
+  }
+  auto reader = detail::make_generator_file_reader(file_name);
+  REQUIRE_NOT_EQUAL(reader, nullptr);
+  CHECK_EQUAL(reader->version(), 4u);
+  REQUIRE_EQUAL(reader->blocks().size(), 3u);
+  for (auto& block : reader->blocks()) {
+    CHECK_EQUAL(block.entries, 1u);
+    CHECK(block.first <= block.last);
+  }
+  MESSAGE("read all blocks in order");
+  caf::variant<data_message, command_message> x;
+  CHECK_EQUAL(reader->read(x), caf::none);
+  CHECK_EQUAL(get_topic(x), topic{"foo"});
+  CHECK_EQUAL(reader->read(x), caf::none);
+  CHECK_EQUAL(get_topic(x), topic{"bar"});
+  CHECK_EQUAL(reader->read(x), caf::none);
+  CHECK_EQUAL(get_topic(x), topic{"foo"});
+  CHECK(reader->at_end());
+  CHECK_EQUAL(reader->read(x), ec::end_of_file);
+  CHECK_EQUAL(reader->topics(), std::vector<topic>({"foo", "bar"}));
+  MESSAGE("start reading at the last block");
+  CHECK_EQUAL(reader->seek(2), caf::none);
+  CHECK_EQUAL(reader->read(x), caf::none);
+  CHECK_EQUAL(get_topic(x), topic{"foo"});
+  CHECK(reader->at_end());
+  CHECK_NOT_EQUAL(reader->seek(3), caf::none);
+}
+
+CAF_TEST(readers return messages in batches) {
+  {
+    auto out = detail::make_generator_file_writer(file_name);
+    REQUIRE_NOT_EQUAL(out, nullptr);
+    out->flush_threshold(1); // Batches span multiple blocks.
+    for (integer i = 0; i < 5; ++i)
+      *out << make_data_message("foo", i);
+  }
+  auto reader = detail::make_generator_file_reader(file_name);
+  REQUIRE_NOT_EQUAL(reader, nullptr);
+  std::vector<detail::generator_file_reader::value_type> xs;
+  CHECK_EQUAL(reader->read(xs, 3), caf::none);
+  CHECK_EQUAL(xs.size(), 3u);
+  CHECK_EQUAL(reader->read(xs, 3), caf::none);
+  REQUIRE_EQUAL(xs.size(), 5u);
+  for (integer i = 0; i < 5; ++i)
+    CHECK_EQUAL(get_data(get<data_message>(xs[i])), data{i});
+  CHECK(reader->at_end());
+  CHECK_EQUAL(reader->read(xs, 3), ec::end_of_file);
+}
+
+CAF_TEST(generator files store per-message timestamps) {
+  auto t0 = timestamp{timespan{1000}};
+  auto t1 = t0 + std::chrono::milliseconds(5);
+  auto t2 = t0 + std::chrono::seconds(2);
+  {
+    auto out = detail::make_generator_file_writer(file_name);
+    REQUIRE_NOT_EQUAL(out, nullptr);
+    CHECK_EQUAL(out->write(make_data_message("foo", 1), t0), caf::none);
+    CHECK_EQUAL(out->write(make_data_message("foo", 2), t1), caf::none);
+    CHECK_EQUAL(out->write(make_data_message("bar", 3), t2), caf::none);
+  }
+  auto reader = detail::make_generator_file_reader(file_name);
+  REQUIRE_NOT_EQUAL(reader, nullptr);
+  REQUIRE_EQUAL(reader->blocks().size(), 1u);
+  CHECK_EQUAL(reader->blocks().front().first, t0);
+  CHECK_EQUAL(reader->blocks().front().last, t2);
+  caf::variant<data_message, command_message> x;
+  timestamp t;
+  CHECK_EQUAL(reader->read(x, t), caf::none);
+  CHECK_EQUAL(t, t0);
+  CHECK_EQUAL(reader->read(x, t), caf::none);
+  CHECK_EQUAL(t, t1);
+  CHECK_EQUAL(reader->read(x, t), caf::none);
+  CHECK_EQUAL(t, t2);
+  CHECK_EQUAL(get_topic(x), topic{"bar"});
+  CHECK(reader->at_end());
+}
+
 CAF_TEST_FIXTURE_SCOPE_END()
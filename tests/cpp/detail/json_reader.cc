@@ -0,0 +1,112 @@
+#define SUITE json_reader
+
+#include "broker/detail/json_reader.hh"
+
+#include "test.hh"
+
+#include <string>
+
+#include "broker/detail/json_writer.hh"
+#include "broker/error.hh"
+
+using namespace broker;
+
+namespace {
+
+struct fixture {
+  // Parses a single value, requiring trailing whitespace like the reader.
+  data parse(std::string str) {
+    str += '\n';
+    data result;
+    const char* first = str.data();
+    if (auto err = detail::json_reader::read(first, str.data() + str.size(),
+                                             result))
+      FAIL("failed to parse " << str << ": " << to_string(err));
+    return result;
+  }
+
+  caf::error parse_error(const std::string& str) {
+    data result;
+    const char* first = str.data();
+    return detail::json_reader::read(first, str.data() + str.size(), result);
+  }
+};
+
+} // namespace
+
+FIXTURE_SCOPE(json_reader_tests, fixture)
+
+TEST(scalars) {
+  CHECK_EQUAL(parse("null"), data{});
+  CHECK_EQUAL(parse("true"), data{true});
+  CHECK_EQUAL(parse(" false"), data{false});
+  CHECK_EQUAL(parse("42"), data{count{42}});
+  CHECK_EQUAL(parse("-42"), data{integer{-42}});
+  CHECK_EQUAL(parse("0.5"), data{0.5});
+  CHECK_EQUAL(parse("1e3"), data{1000.0});
+  CHECK_EQUAL(parse(R"("a\"b\\c\n\u00e4\ud83d\ude00")"),
+              data{"a\"b\\c\n\xc3\xa4\xf0\x9f\x98\x80"});
+}
+
+TEST(long strings) {
+  // Covers escapes before, within, and after the 16-byte blocks.
+  std::string plain(40, 'x');
+  CHECK_EQUAL(parse('"' + plain + '"'), data{plain});
+  for (size_t i = 0; i <= plain.size(); i += 7) {
+    auto input = plain;
+    input.insert(i, "\\n");
+    auto expected = plain;
+    expected.insert(i, "\n");
+    CHECK_EQUAL(parse('"' + input + '"'), data{expected});
+  }
+  CHECK_EQUAL(parse_error('"' + plain + "\x01" + plain + "\"\n"),
+              ec::invalid_data);
+}
+
+TEST(containers) {
+  CHECK_EQUAL(parse(R"([1, "a", []])"), data(vector{count{1}, "a", vector{}}));
+  CHECK_EQUAL(parse(R"({"b": null, "a": [true]})"),
+              data(table{{"a", vector{true}}, {"b", nil}}));
+}
+
+TEST(values of a stream parse one after another) {
+  std::string str = "{\"x\":1}\n[2]\n3\n";
+  const char* first = str.data();
+  const char* last = str.data() + str.size();
+  std::vector<data> xs;
+  data x;
+  while (!detail::json_reader::read(first, last, x))
+    xs.emplace_back(std::move(x));
+  CHECK_EQUAL(xs, std::vector<data>({table{{"x", count{1}}},
+                                     vector{count{2}}, count{3}}));
+}
+
+TEST(incomplete input results in end of file) {
+  CHECK_EQUAL(parse_error(""), ec::end_of_file);
+  CHECK_EQUAL(parse_error("  "), ec::end_of_file);
+  CHECK_EQUAL(parse_error("12"), ec::end_of_file);
+  CHECK_EQUAL(parse_error("tr"), ec::end_of_file);
+  CHECK_EQUAL(parse_error(R"({"a": [1, )"), ec::end_of_file);
+  CHECK_EQUAL(parse_error(R"("abc)"), ec::end_of_file);
+}
+
+TEST(malformed input results in invalid data) {
+  CHECK_EQUAL(parse_error("nul "), ec::invalid_data);
+  CHECK_EQUAL(parse_error("[1 2] "), ec::invalid_data);
+  CHECK_EQUAL(parse_error("{1: 2} "), ec::invalid_data);
+  CHECK_EQUAL(parse_error("- "), ec::invalid_data);
+  CHECK_EQUAL(parse_error("99999999999999999999 "), ec::invalid_data);
+  CHECK_EQUAL(parse_error(R"("\x" )"), ec::invalid_data);
+  CHECK_EQUAL(parse_error(std::string(1000, '[')), ec::invalid_data);
+}
+
+TEST(round trip with the writer) {
+  data x = vector{count{1}, integer{-2}, 0.25, "foo\tbar", nil, true,
+                  vector{}, vector{"x"}};
+  detail::json_writer writer;
+  std::string buf;
+  writer.append(buf, x);
+  CHECK_EQUAL(parse(buf), x);
+}
+
+FIXTURE_SCOPE_END()
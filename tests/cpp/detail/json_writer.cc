@@ -0,0 +1,70 @@
+#define SUITE json_writer
+
+#include "broker/detail/json_writer.hh"
+
+#include "test.hh"
+
+#include <limits>
+
+#include "broker/convert.hh"
+
+using namespace broker;
+
+namespace {
+
+struct fixture {
+  detail::json_writer writer;
+  std::string buf;
+
+  std::string render(const data& x) {
+    buf.clear();
+    writer.append(buf, x);
+    return buf;
+  }
+};
+
+} // namespace
+
+FIXTURE_SCOPE(json_writer_tests, fixture)
+
+TEST(scalars) {
+  CHECK_EQUAL(render(nil), "null");
+  CHECK_EQUAL(render(true), "true");
+  CHECK_EQUAL(render(count{42}), "42");
+  CHECK_EQUAL(render(integer{-7}), "-7");
+  CHECK_EQUAL(render(0.5), "0.5");
+  CHECK_EQUAL(render(std::numeric_limits<real>::infinity()), "null");
+  CHECK_EQUAL(render(port{443, port::protocol::tcp}), R"("443/tcp")");
+  CHECK_EQUAL(render(enum_value{"Conn::LOG"}), R"("Conn::LOG")");
+  address addr;
+  REQUIRE(convert("10.0.0.1", addr));
+  CHECK_EQUAL(render(addr), R"("10.0.0.1")");
+}
+
+TEST(times render as seconds) {
+  CHECK_EQUAL(render(timespan{1500000000}), "1.500000000");
+  CHECK_EQUAL(render(timespan{-1500000000}), "-1.500000000");
+  CHECK_EQUAL(render(timestamp{timespan{42}}), "0.000000042");
+}
+
+TEST(strings are escaped) {
+  CHECK_EQUAL(render("plain"), R"("plain")");
+  CHECK_EQUAL(render("a\"b\\c\nd"), R"("a\"b\\c\nd")");
+  CHECK_EQUAL(render(std::string{"\x01", 1}), R"("\u0001")");
+}
+
+TEST(containers) {
+  CHECK_EQUAL(render(vector{1, "a", vector{}}), R"([1,"a",[]])");
+  CHECK_EQUAL(render(set{count{2}, count{1}}), "[1,2]");
+  CHECK_EQUAL(render(table{{"a", 1}, {count{2}, nil}}),
+              R"([[2,null],["a",1]])");
+}
+
+TEST(lines contain topic and data) {
+  writer.append_line(buf, "zeek/logs", vector{1, 2});
+  writer.append_line(buf, "zeek/\"x\"", nil);
+  CHECK_EQUAL(buf, "{\"topic\":\"zeek/logs\",\"data\":[1,2]}\n"
+                   "{\"topic\":\"zeek/\\\"x\\\"\",\"data\":null}\n");
+}
+
+FIXTURE_SCOPE_END()
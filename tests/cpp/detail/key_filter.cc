@@ -0,0 +1,40 @@
+#define SUITE key_filter
+
+#include "broker/detail/key_filter.hh"
+
+#include "test.hh"
+
+using namespace broker;
+
+using detail::key_filter;
+
+CAF_TEST(the filter has no false negatives) {
+  key_filter uut{1000, 10};
+  for (integer i = 0; i < 1000; ++i)
+    uut.add(data{i});
+  for (integer i = 0; i < 1000; ++i)
+    CHECK(uut.may_contain(data{i}));
+  CHECK_EQUAL(uut.size(), 1000u);
+  CHECK(!uut.saturated());
+}
+
+CAF_TEST(the filter rejects most unknown keys) {
+  key_filter uut{1000, 10};
+  for (integer i = 0; i < 1000; ++i)
+    uut.add(data{i});
+  size_t false_positives = 0;
+  for (integer i = 1000; i < 11000; ++i)
+    if (uut.may_contain(data{i}))
+      ++false_positives;
+  // Ten bits per key result in about 1% false positives.
+  CHECK_LESS(false_positives, 500u);
+}
+
+CAF_TEST(reset removes all keys) {
+  key_filter uut{10, 10};
+  uut.add(data{"foo"});
+  CHECK(uut.may_contain(data{"foo"}));
+  uut.reset(100);
+  CHECK(!uut.may_contain(data{"foo"}));
+  CHECK_EQUAL(uut.size(), 0u);
+}
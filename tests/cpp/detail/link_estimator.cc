@@ -0,0 +1,40 @@
+#define SUITE link_estimator
+
+#include "broker/detail/link_estimator.hh"
+
+#include "test.hh"
+
+using namespace broker;
+using namespace std::chrono_literals;
+
+using detail::link_estimator;
+
+TEST(the first probe initializes the estimates) {
+  link_estimator x;
+  x.record(10ms, 100, timestamp{1s});
+  CHECK_EQUAL(x.samples(), 1u);
+  CHECK_EQUAL(x.rtt(), timespan{10ms});
+  CHECK_EQUAL(x.srtt(), timespan{10ms});
+  CHECK_EQUAL(x.jitter(), timespan{0});
+  CHECK_EQUAL(x.throughput(), 0.0);
+}
+
+TEST(later probes smooth RTT and jitter) {
+  link_estimator x;
+  x.record(10ms, 0, timestamp{1s});
+  x.record(26ms, 500, timestamp{2s});
+  CHECK_EQUAL(x.rtt(), timespan{26ms});
+  CHECK_EQUAL(x.srtt(), timespan{12ms});
+  CHECK_EQUAL(x.jitter(), timespan{1ms});
+  CHECK_EQUAL(x.throughput(), 500.0);
+  x.record(26ms, 1500, timestamp{4s});
+  CHECK_EQUAL(x.throughput(), 500.0);
+}
+
+TEST(reconnects keep the last throughput) {
+  link_estimator x;
+  x.record(10ms, 1000, timestamp{1s});
+  x.record(10ms, 2000, timestamp{2s});
+  x.record(10ms, 5, timestamp{3s});
+  CHECK_EQUAL(x.throughput(), 1000.0);
+}
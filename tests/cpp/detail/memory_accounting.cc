@@ -0,0 +1,139 @@
+#define SUITE memory_accounting
+
+#include "broker/detail/memory_accounting.hh"
+
+#include "test.hh"
+
+#include "broker/detail/core_metrics.hh"
+#include "broker/detail/memory_backend.hh"
+#include "broker/detail/peer_buffer.hh"
+#include "broker/detail/shared_subscriber_queue.hh"
+
+using namespace broker;
+
+using accounting = detail::memory_accounting;
+
+namespace {
+
+struct fixture : base_fixture {
+  detail::memory_accounting_ptr mem = caf::make_counted<accounting>();
+
+  size_t usage(accounting::subsystem s) {
+    return mem->usage(s);
+  }
+};
+
+} // namespace
+
+FIXTURE_SCOPE(memory_accounting_tests, fixture)
+
+TEST(counters return their bytes when going out of scope) {
+  {
+    detail::memory_counter x{mem, accounting::clone_buffers};
+    x.add(100);
+    x.remove(40);
+    CHECK_EQUAL(x.bytes(), 60u);
+    CHECK_EQUAL(usage(accounting::clone_buffers), 60u);
+  }
+  CHECK_EQUAL(usage(accounting::clone_buffers), 0u);
+}
+
+TEST(subsystems are exhausted once reaching their limit) {
+  CHECK(!mem->exhausted(accounting::master_stores));
+  mem->add(accounting::master_stores, 1000);
+  CHECK(!mem->exhausted(accounting::master_stores));
+  mem->limit(accounting::master_stores, 1000);
+  CHECK(mem->exhausted(accounting::master_stores));
+  mem->remove(accounting::master_stores, 1);
+  CHECK(!mem->exhausted(accounting::master_stores));
+  mem->remove(accounting::master_stores, 999);
+}
+
+TEST(subscriber queues account their payload) {
+  auto q = detail::make_shared_subscriber_queue<>(2);
+  q->track_memory(mem);
+  auto msg = make_data_message("foo", std::string(100, 'x'));
+  auto size = detail::estimated_size(get_data(msg));
+  for (int i = 0; i < 3; ++i)
+    q->produce(msg);
+  CHECK_EQUAL(usage(accounting::subscriber_queues), 3 * size);
+  mem->limit(accounting::subscriber_queues, 3 * size);
+  CHECK(q->memory_exhausted());
+  q->consume(2, nullptr, [](data_message&&) {});
+  CHECK_EQUAL(usage(accounting::subscriber_queues), size);
+  CHECK(!q->memory_exhausted());
+  q.reset();
+  CHECK_EQUAL(usage(accounting::subscriber_queues), 0u);
+}
+
+TEST(peer buffers spill once blocked peers reach the limit) {
+  detail::peer_buffer::batch_type batch;
+  batch.emplace_back(make_node_message(make_data_message("foo", 42), 1));
+  auto size = detail::estimated_size(batch);
+  mem->limit(accounting::blocked_peers, size);
+  detail::peer_buffer buf{sys, size * 10, mem};
+  CHECK_EQUAL(buf.push(batch), caf::none);
+  CHECK_EQUAL(usage(accounting::blocked_peers), size);
+  CHECK_EQUAL(buf.push(batch), caf::none);
+  CHECK_EQUAL(buf.spilled(), 1u);
+  CHECK_EQUAL(usage(accounting::blocked_peers), size);
+  CHECK(buf.pop());
+  CHECK_EQUAL(usage(accounting::blocked_peers), 0u);
+}
+
+TEST(memory backends track the size of their entries) {
+  detail::memory_backend backend;
+  CHECK_EQUAL(backend.memory_usage(), 0u);
+  backend.put("a", std::string(100, 'x'), {});
+  auto entry_size = detail::estimated_size(data{"a"})
+                    + detail::estimated_size(data{std::string(100, 'x')});
+  CHECK_EQUAL(backend.memory_usage(), entry_size);
+  backend.put("a", "y", {});
+  CHECK_EQUAL(backend.memory_usage(), detail::estimated_size(data{"a"})
+                                        + detail::estimated_size(data{"y"}));
+  backend.add("s", "elem", data::type::set, {});
+  backend.add("s", "elem", data::type::set, {});
+  backend.add("v", 1, data::type::vector, {});
+  backend.subtract("v", 1, {});
+  backend.subtract("s", "elem", {});
+  CHECK_EQUAL(backend.memory_usage(),
+              detail::estimated_size(data{"a"})
+                + detail::estimated_size(data{"y"})
+                + detail::estimated_size(data{"s"})
+                + detail::estimated_size(data{set{}})
+                + detail::estimated_size(data{"v"})
+                + detail::estimated_size(data{vector{}}));
+  backend.erase("s");
+  backend.erase("v");
+  backend.erase("a");
+  CHECK_EQUAL(backend.memory_usage(), 0u);
+}
+
+TEST(commands estimate their payload) {
+  auto cmd = make_internal_command<put_command>(data{"key"}, data{"value"});
+  CHECK_EQUAL(detail::estimated_size(cmd),
+              detail::estimated_size(data{"key"})
+                + detail::estimated_size(data{"value"}));
+  auto clear = make_internal_command<clear_command>();
+  CHECK_EQUAL(detail::estimated_size(clear), 0u);
+}
+
+TEST(usage converts to a table and to prometheus metrics) {
+  mem->add(accounting::clone_buffers, 42);
+  mem->limit(accounting::clone_buffers, 100);
+  auto xs = mem->to_data();
+  auto tbl = caf::get_if<table>(&xs);
+  REQUIRE(tbl != nullptr);
+  CHECK_EQUAL(tbl->size(), accounting::num_subsystems);
+  CHECK_EQUAL(tbl->at("clone-buffers"),
+              data(table{{"bytes", count{42}}, {"limit", count{100}}}));
+  auto text = detail::to_prometheus(table{{"memory", xs}});
+  CHECK(text.find("broker_memory_bytes{subsystem=\"clone-buffers\"} 42\n")
+        != std::string::npos);
+  CHECK(text.find("broker_memory_limit_bytes{subsystem=\"clone-buffers\"} "
+                  "100\n")
+        != std::string::npos);
+  mem->remove(accounting::clone_buffers, 42);
+}
+
+FIXTURE_SCOPE_END()
@@ -136,4 +136,53 @@ CAF_TEST(set_command) {
   CHECK(at_end());
 }
 
+CAF_TEST(put_many_command) {
+  push(put_many_command{{{data{"key"}, data{"value"}}}, nil});
+  CHECK_EQUAL(pull<internal_command::type>(),
+              internal_command::type::put_many_command);
+  CHECK_EQUAL(pull<uint32_t>(), 1u);
+  CHECK_EQUAL(pull<data::type>(), data::type::string);
+  CHECK_EQUAL(pull<uint32_t>(), 3u);
+  CHECK_EQUAL(pull<data::type>(), data::type::string);
+  CHECK_EQUAL(pull<uint32_t>(), 5u);
+  CHECK(at_end());
+}
+
+CAF_TEST(erase_many_command) {
+  push(erase_many_command{{data{"foo"}, data{"bar"}}});
+  CHECK_EQUAL(pull<internal_command::type>(),
+              internal_command::type::erase_many_command);
+  CHECK_EQUAL(pull<uint32_t>(), 2u);
+  CHECK_EQUAL(pull<data::type>(), data::type::string);
+  CHECK_EQUAL(pull<uint32_t>(), 3u);
+  CHECK_EQUAL(pull<data::type>(), data::type::string);
+  CHECK_EQUAL(pull<uint32_t>(), 3u);
+  CHECK(at_end());
+}
+
+CAF_TEST(compare_and_swap_command) {
+  push(compare_and_swap_command{data{"key"}, data{}, data{"value"}, nil,
+                                nullptr, 0});
+  CHECK_EQUAL(pull<internal_command::type>(),
+              internal_command::type::compare_and_swap_command);
+  CHECK_EQUAL(pull<data::type>(), data::type::string);
+  CHECK_EQUAL(pull<uint32_t>(), 3u);
+  CHECK_EQUAL(pull<data::type>(), data::type::none);
+  CHECK_EQUAL(pull<data::type>(), data::type::string);
+  CHECK_EQUAL(pull<uint32_t>(), 5u);
+  CHECK(at_end());
+}
+
+CAF_TEST(add_and_get_command) {
+  push(add_and_get_command{data{"key"}, data{count{1}}, data::type::count,
+                           nil, nullptr, 0});
+  CHECK_EQUAL(pull<internal_command::type>(),
+              internal_command::type::add_and_get_command);
+  CHECK_EQUAL(pull<data::type>(), data::type::string);
+  CHECK_EQUAL(pull<uint32_t>(), 3u);
+  CHECK_EQUAL(pull<data::type>(), data::type::count);
+  CHECK_EQUAL(pull<data::type>(), data::type::count);
+  CHECK(at_end());
+}
+
 CAF_TEST_FIXTURE_SCOPE_END()
@@ -80,7 +80,15 @@ CAF_TEST(real data) {
 CAF_TEST(string data) {
   push(data{"hello world"});
   CHECK_EQUAL(pull<data::type>(), data::type::string);
-  CHECK_EQUAL(pull<uint32_t>(), 11u);
+  CHECK_EQUAL(pull<uint8_t>(), 11u);
+  CHECK(at_end());
+}
+
+CAF_TEST(sizes are varints) {
+  push(data{std::string(300, 'x')});
+  CHECK_EQUAL(pull<data::type>(), data::type::string);
+  CHECK_EQUAL(pull<uint8_t>(), 0xACu);
+  CHECK_EQUAL(pull<uint8_t>(), 0x02u);
   CHECK(at_end());
 }
 
@@ -117,7 +125,7 @@ CAF_TEST(timespan data) {
 CAF_TEST(enum_value data) {
   push(data{enum_value{"foobar"}});
   CHECK_EQUAL(pull<data::type>(), data::type::enum_value);
-  CHECK_EQUAL(pull<uint32_t>(), 6u);
+  CHECK_EQUAL(pull<uint8_t>(), 6u);
   CHECK(at_end());
 }
 
@@ -128,7 +136,7 @@ CAF_TEST(set data) {
   xs.emplace(integer{3});
   push(data{xs});
   CHECK_EQUAL(pull<data::type>(), data::type::set);
-  CHECK_EQUAL(pull<uint32_t>(), 3u);
+  CHECK_EQUAL(pull<uint8_t>(), 3u);
   CHECK_EQUAL(pull<data::type>(), data::type::integer);
   CHECK_EQUAL(pull<data::type>(), data::type::integer);
   CHECK_EQUAL(pull<data::type>(), data::type::integer);
@@ -142,12 +150,12 @@ CAF_TEST(table data) {
   xs.emplace(integer{3}, address{});
   push(data{xs});
   CHECK_EQUAL(pull<data::type>(), data::type::table);
-  CHECK_EQUAL(pull<uint32_t>(), 3u);
+  CHECK_EQUAL(pull<uint8_t>(), 3u);
   CHECK_EQUAL(pull<data::type>(), data::type::integer);
   CHECK_EQUAL(pull<data::type>(), data::type::real);
   CHECK_EQUAL(pull<data::type>(), data::type::integer);
   CHECK_EQUAL(pull<data::type>(), data::type::string);
-  CHECK_EQUAL(pull<uint32_t>(), 11u);
+  CHECK_EQUAL(pull<uint8_t>(), 11u);
   CHECK_EQUAL(pull<data::type>(), data::type::integer);
   CHECK_EQUAL(pull<data::type>(), data::type::address);
   CHECK(at_end());
@@ -160,10 +168,10 @@ CAF_TEST(vector data) {
   xs.emplace_back(12.34);
   push(data{xs});
   CHECK_EQUAL(pull<data::type>(), data::type::vector);
-  CHECK_EQUAL(pull<uint32_t>(), 3u);
+  CHECK_EQUAL(pull<uint8_t>(), 3u);
   CHECK_EQUAL(pull<data::type>(), data::type::integer);
   CHECK_EQUAL(pull<data::type>(), data::type::string);
-  CHECK_EQUAL(pull<uint32_t>(), 11u);
+  CHECK_EQUAL(pull<uint8_t>(), 11u);
   CHECK_EQUAL(pull<data::type>(), data::type::real);
   CHECK(at_end());
 }
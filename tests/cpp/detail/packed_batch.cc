@@ -0,0 +1,120 @@
+#define SUITE packed_batch
+
+#include "broker/detail/packed_batch.hh"
+
+#include "test.hh"
+
+#include <vector>
+
+#include <caf/binary_serializer.hpp>
+
+using namespace broker;
+using namespace broker::detail;
+
+namespace {
+
+node_message data_msg(std::string t, integer x, uint16_t ttl, uint32_t seq) {
+  auto result = make_node_message(make_data_message(std::move(t), x), ttl);
+  result.origin = 42;
+  result.seq = seq;
+  return result;
+}
+
+node_message command_msg(integer x, uint32_t seq) {
+  auto cmd = make_internal_command<put_command>(data{x}, data{x});
+  auto result = make_node_message(make_command_message("foo/store",
+                                                       std::move(cmd)),
+                                  10);
+  result.origin = 42;
+  result.seq = seq;
+  return result;
+}
+
+std::vector<node_message> make_batch() {
+  std::vector<node_message> result;
+  uint32_t seq = 0;
+  for (integer i = 0; i < 50; ++i)
+    result.emplace_back(data_msg("zeek/logs/conn", i, 20, seq++));
+  result.emplace_back(command_msg(1, seq++));
+  result.emplace_back(data_msg("zeek/logs/dns", 1, 20, seq++));
+  result.emplace_back(data_msg("zeek/logs/dns", 2, 19, seq++));
+  // Gap in the sequence numbers starts a new run.
+  result.emplace_back(data_msg("zeek/logs/dns", 3, 19, seq + 10));
+  // Messages without origin.
+  result.emplace_back(make_node_message(make_data_message("a/b", 1), 5));
+  result.emplace_back(make_node_message(make_data_message("a/b", 2), 5));
+  return result;
+}
+
+} // namespace
+
+CAF_TEST_FIXTURE_SCOPE(packed_batch_tests, base_fixture)
+
+CAF_TEST(packed batches round trip) {
+  auto xs = make_batch();
+  packed_batch packed;
+  REQUIRE_EQUAL(pack(sys, xs, packed), caf::none);
+  CHECK_EQUAL(packed.size, xs.size());
+  std::vector<node_message> ys;
+  REQUIRE_EQUAL(unpack(sys, packed, ys), caf::none);
+  REQUIRE_EQUAL(ys.size(), xs.size());
+  for (size_t i = 0; i < xs.size(); ++i) {
+    CHECK_EQUAL(is_data_message(ys[i]), is_data_message(xs[i]));
+    CHECK_EQUAL(get_topic(ys[i]), get_topic(xs[i]));
+    CHECK_EQUAL(ys[i].ttl, xs[i].ttl);
+    CHECK_EQUAL(ys[i].origin, xs[i].origin);
+    CHECK_EQUAL(ys[i].seq, xs[i].seq);
+    CHECK_EQUAL(ys[i].receiver, xs[i].receiver);
+  }
+  CHECK_EQUAL(get_data(caf::get<data_message>(ys[7].content)),
+              get_data(caf::get<data_message>(xs[7].content)));
+  auto& cmd = get_command(caf::get<command_message>(ys[50].content));
+  CHECK_EQUAL(caf::get<put_command>(cmd.content).key, data{1});
+}
+
+CAF_TEST(packed batches share headers) {
+  auto xs = make_batch();
+  packed_batch packed;
+  REQUIRE_EQUAL(pack(sys, xs, packed), caf::none);
+  caf::binary_serializer::container_type buf;
+  caf::binary_serializer sink{sys, buf};
+  REQUIRE_EQUAL(sink(xs), caf::none);
+  CHECK_LESS(packed.bytes.size() * 2, buf.size());
+}
+
+CAF_TEST(compact packed batches round trip) {
+  auto xs = make_batch();
+  packed_batch regular;
+  REQUIRE_EQUAL(pack(sys, xs, regular), caf::none);
+  packed_batch compact;
+  REQUIRE_EQUAL(pack(sys, xs, compact, true), caf::none);
+  CHECK(compact.compact);
+  CHECK_LESS(compact.bytes.size(), regular.bytes.size());
+  std::vector<node_message> ys;
+  REQUIRE_EQUAL(unpack(sys, compact, ys), caf::none);
+  REQUIRE_EQUAL(ys.size(), xs.size());
+  for (size_t i = 0; i < xs.size(); ++i) {
+    CHECK_EQUAL(get_topic(ys[i]), get_topic(xs[i]));
+    CHECK_EQUAL(ys[i].seq, xs[i].seq);
+    if (is_data_message(xs[i]))
+      CHECK_EQUAL(get_data(caf::get<data_message>(ys[i].content)),
+                  get_data(caf::get<data_message>(xs[i].content)));
+  }
+  auto& cmd = get_command(caf::get<command_message>(ys[50].content));
+  CHECK_EQUAL(caf::get<put_command>(cmd.content).key, data{1});
+}
+
+CAF_TEST(malformed packed batches result in errors) {
+  auto xs = make_batch();
+  packed_batch packed;
+  REQUIRE_EQUAL(pack(sys, xs, packed), caf::none);
+  std::vector<node_message> ys;
+  packed.size += 1;
+  CHECK_NOT_EQUAL(unpack(sys, packed, ys), caf::none);
+  packed.size -= 1;
+  packed.bytes.resize(packed.bytes.size() / 2);
+  ys.clear();
+  CHECK_NOT_EQUAL(unpack(sys, packed, ys), caf::none);
+}
+
+CAF_TEST_FIXTURE_SCOPE_END()
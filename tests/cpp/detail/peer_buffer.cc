@@ -0,0 +1,100 @@
+#define SUITE peer_buffer
+
+#include "broker/detail/peer_buffer.hh"
+
+#include "test.hh"
+
+using namespace broker;
+
+namespace {
+
+using batch_type = detail::peer_buffer::batch_type;
+
+batch_type make_batch(integer first, integer n) {
+  batch_type result;
+  for (integer i = first; i < first + n; ++i)
+    result.emplace_back(node_message{make_data_message("foo/bar", i), 20});
+  return result;
+}
+
+integer value_at(const batch_type& xs, size_t index) {
+  auto& msg = caf::get<data_message>(xs[index].content);
+  return caf::get<integer>(get_data(msg));
+}
+
+} // namespace
+
+CAF_TEST_FIXTURE_SCOPE(peer_buffer_tests, base_fixture)
+
+CAF_TEST(the buffer spills batches to disk when exceeding its memory limit) {
+  detail::peer_buffer buf{sys, 0};
+  CHECK(buf.empty());
+  for (integer i = 0; i < 10; ++i)
+    CHECK_EQUAL(buf.push(make_batch(i * 3, 3)), caf::none);
+  CHECK_EQUAL(buf.memory_usage(), 0u);
+  CHECK_EQUAL(buf.spilled(), 10u);
+  for (integer i = 0; i < 10; ++i) {
+    auto xs = buf.pop();
+    REQUIRE(xs);
+    REQUIRE_EQUAL(xs->size(), 3u);
+    CHECK_EQUAL(value_at(*xs, 0), i * 3);
+    CHECK_EQUAL(value_at(*xs, 2), i * 3 + 2);
+    CHECK_EQUAL((*xs)[0].ttl, 20u);
+  }
+  CHECK(buf.empty());
+}
+
+CAF_TEST(the buffer preserves the order of in-memory and spilled batches) {
+  auto batch_size = detail::estimated_size(make_batch(0, 2));
+  detail::peer_buffer buf{sys, batch_size * 2};
+  for (integer i = 0; i < 5; ++i)
+    CHECK_EQUAL(buf.push(make_batch(i * 2, 2)), caf::none);
+  CHECK_EQUAL(buf.memory_usage(), batch_size * 2);
+  CHECK_EQUAL(buf.spilled(), 3u);
+  // Consuming from memory must not cause new batches to overtake the
+  // batches on disk.
+  auto xs = buf.pop();
+  REQUIRE(xs);
+  CHECK_EQUAL(value_at(*xs, 0), 0);
+  CHECK_EQUAL(buf.push(make_batch(10, 2)), caf::none);
+  CHECK_EQUAL(buf.spilled(), 4u);
+  for (integer i = 1; i < 6; ++i) {
+    auto ys = buf.pop();
+    REQUIRE(ys);
+    CHECK_EQUAL(value_at(*ys, 0), i * 2);
+    CHECK_EQUAL(value_at(*ys, 1), i * 2 + 1);
+  }
+  CHECK(buf.empty());
+  // After draining the file, the buffer keeps batches in memory again.
+  CHECK_EQUAL(buf.push(make_batch(12, 2)), caf::none);
+  CHECK_EQUAL(buf.spilled(), 0u);
+  CHECK_EQUAL(buf.memory_usage(), batch_size);
+}
+
+CAF_TEST(the buffer restores data and command messages from disk) {
+  detail::peer_buffer buf{sys, 0};
+  batch_type xs;
+  xs.emplace_back(make_node_message(
+    make_data_message("foo/bar", vector{1, "two", set{3.0}}), 7));
+  auto cmd = make_internal_command<put_command>(data{"key"}, data{42});
+  xs.emplace_back(make_node_message(
+    make_command_message("foo/store", std::move(cmd)), 9));
+  CHECK_EQUAL(buf.push(xs), caf::none);
+  CHECK_EQUAL(buf.spilled(), 1u);
+  auto ys = buf.pop();
+  REQUIRE(ys);
+  REQUIRE_EQUAL(ys->size(), 2u);
+  auto& msg = caf::get<data_message>((*ys)[0].content);
+  CHECK_EQUAL(get_topic(msg), topic{"foo/bar"});
+  CHECK_EQUAL(get_data(msg), (vector{1, "two", set{3.0}}));
+  CHECK_EQUAL((*ys)[0].ttl, 7u);
+  auto& cmsg = caf::get<command_message>((*ys)[1].content);
+  CHECK_EQUAL(get_topic(cmsg), topic{"foo/store"});
+  auto put = caf::get_if<put_command>(&get_command(cmsg).content);
+  REQUIRE(put != nullptr);
+  CHECK_EQUAL(put->key, data{"key"});
+  CHECK_EQUAL(put->value, data{42});
+  CHECK_EQUAL((*ys)[1].ttl, 9u);
+}
+
+CAF_TEST_FIXTURE_SCOPE_END()
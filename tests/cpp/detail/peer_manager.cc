@@ -0,0 +1,170 @@
+#define SUITE peer_manager
+
+#include "broker/detail/peer_manager.hh"
+
+#include "test.hh"
+
+#include <vector>
+
+#include "broker/internal_command.hh"
+#include "broker/topic.hh"
+
+using namespace broker;
+
+using detail::overload_policy;
+using detail::overload_state;
+using detail::priority_class;
+
+namespace {
+
+node_message bulk(integer x) {
+  return make_node_message(make_data_message("foo/bar", x), 20);
+}
+
+node_message control(integer x) {
+  return make_node_message(make_data_message(topics::reserved / "foo", x), 20);
+}
+
+node_message store(integer x) {
+  auto cmd = make_internal_command<put_command>(data{x}, data{x});
+  return make_node_message(make_command_message("foo/store", std::move(cmd)),
+                           20);
+}
+
+// Returns the priority class and the value of each message.
+std::vector<std::pair<priority_class, integer>>
+summarize(const std::vector<node_message>& xs) {
+  std::vector<std::pair<priority_class, integer>> result;
+  for (auto& x : xs) {
+    integer value;
+    if (is_data_message(x)) {
+      value = caf::get<integer>(get_data(caf::get<data_message>(x.content)));
+    } else {
+      auto& cmd = get_command(caf::get<command_message>(x.content));
+      value = caf::get<integer>(caf::get<put_command>(cmd.content).key);
+    }
+    result.emplace_back(detail::priority_of(x), value);
+  }
+  return result;
+}
+
+std::vector<integer> values(const std::vector<node_message>& xs) {
+  std::vector<integer> result;
+  for (auto& x : summarize(xs))
+    result.emplace_back(x.second);
+  return result;
+}
+
+std::vector<node_message> bulk_range(integer first, integer last) {
+  std::vector<node_message> result;
+  for (auto i = first; i <= last; ++i)
+    result.emplace_back(bulk(i));
+  return result;
+}
+
+} // namespace
+
+TEST(messages have priority classes) {
+  CHECK(detail::priority_of(control(1)) == priority_class::control);
+  CHECK(detail::priority_of(store(1)) == priority_class::store);
+  CHECK(detail::priority_of(bulk(1)) == priority_class::bulk);
+}
+
+TEST(prioritizing keeps the order within each class) {
+  std::vector<node_message> xs{bulk(1),  store(2), bulk(3),   control(4),
+                               store(5), bulk(6),  control(7)};
+  detail::prioritize(xs);
+  using pc = priority_class;
+  std::vector<std::pair<pc, integer>> expected{
+    {pc::control, 4}, {pc::control, 7}, {pc::store, 2}, {pc::store, 5},
+    {pc::bulk, 1},    {pc::bulk, 3},    {pc::bulk, 6}};
+  CHECK(summarize(xs) == expected);
+}
+
+TEST(overload policies convert from strings) {
+  auto x = overload_policy::mode::buffer;
+  size_t n = 1;
+  CHECK(detail::convert("drop", x, n));
+  CHECK(x == overload_policy::mode::drop);
+  CHECK(detail::convert("sample/10", x, n));
+  CHECK(x == overload_policy::mode::sample);
+  CHECK_EQUAL(n, 10u);
+  CHECK(detail::convert("buffer", x, n));
+  CHECK(x == overload_policy::mode::buffer);
+  CHECK(!detail::convert("sample/0", x, n));
+  CHECK(!detail::convert("sample/", x, n));
+  CHECK(!detail::convert("block", x, n));
+}
+
+TEST(isolated paths keep new messages aside in order) {
+  overload_policy cfg;
+  cfg.buffer_size = 4;
+  overload_state st;
+  st.held = 2;
+  auto buf = bulk_range(1, 5);
+  detail::throttle(cfg, st, buf, 2);
+  CHECK_EQUAL(values(buf), std::vector<integer>({1, 2}));
+  CHECK_EQUAL(st.pending.size(), 3u);
+  // The peer consumes one batch, then new messages arrive.
+  buf.clear();
+  st.held = 0;
+  buf.emplace_back(bulk(6));
+  detail::throttle(cfg, st, buf, 2);
+  CHECK_EQUAL(values(buf), std::vector<integer>({3, 4}));
+  CHECK_EQUAL(st.pending.size(), 2u);
+  CHECK_EQUAL(st.dropped, 0u);
+  // Exceeding the buffer size drops messages.
+  st.held = 2;
+  for (integer i = 7; i < 10; ++i)
+    buf.emplace_back(bulk(i));
+  detail::throttle(cfg, st, buf, 2);
+  CHECK_EQUAL(values(buf), std::vector<integer>({3, 4}));
+  CHECK_EQUAL(st.pending.size(), 4u);
+  CHECK_EQUAL(st.dropped, 1u);
+}
+
+TEST(isolated paths drop or sample new messages) {
+  overload_policy cfg;
+  cfg.what = overload_policy::mode::drop;
+  cfg.buffer_size = 100;
+  overload_state st;
+  st.held = 2;
+  auto buf = bulk_range(1, 6);
+  detail::throttle(cfg, st, buf, 2);
+  CHECK_EQUAL(values(buf), std::vector<integer>({1, 2}));
+  CHECK_EQUAL(st.dropped, 4u);
+  cfg.what = overload_policy::mode::sample;
+  cfg.sample_rate = 2;
+  st = overload_state{};
+  st.held = 2;
+  buf = bulk_range(1, 6);
+  detail::throttle(cfg, st, buf, 2);
+  CHECK_EQUAL(values(buf), std::vector<integer>({1, 2}));
+  CHECK_EQUAL(st.pending.size(), 2u);
+  CHECK_EQUAL(st.dropped, 2u);
+}
+
+TEST(isolated paths never drop store commands) {
+  overload_policy cfg;
+  cfg.what = overload_policy::mode::drop;
+  overload_state st;
+  st.held = 2;
+  std::vector<node_message> buf{bulk(1), bulk(2), bulk(3), store(4), bulk(5)};
+  detail::throttle(cfg, st, buf, 2);
+  CHECK_EQUAL(values(buf), std::vector<integer>({1, 2}));
+  CHECK_EQUAL(st.pending.size(), 1u);
+  CHECK_EQUAL(st.dropped, 2u);
+  // Store commands wait aside even if the buffer for data messages is full.
+  cfg.what = overload_policy::mode::buffer;
+  cfg.buffer_size = 1;
+  buf.emplace_back(bulk(6));
+  buf.emplace_back(store(7));
+  detail::throttle(cfg, st, buf, 2);
+  CHECK_EQUAL(values(buf), std::vector<integer>({1, 2}));
+  CHECK_EQUAL(st.pending.size(), 2u);
+  CHECK_EQUAL(st.dropped, 3u);
+  buf.clear();
+  st.held = 0;
+  detail::throttle(cfg, st, buf, 2);
+  CHECK_EQUAL(values(buf), std::vector<integer>({4, 7}));
+}
@@ -0,0 +1,134 @@
+#define SUITE rate_limiter
+
+#include "broker/detail/rate_limiter.hh"
+
+#include "test.hh"
+
+#include <vector>
+
+using namespace broker;
+
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+namespace {
+
+using policy = detail::rate_limiter::policy;
+
+detail::rate_limiter::rule make_rule(const char* str) {
+  detail::rate_limiter::rule result;
+  if (!convert(std::string{str}, result))
+    FAIL("invalid rule: " << str);
+  return result;
+}
+
+node_message msg(const char* t, integer x) {
+  return make_node_message(make_data_message(t, x), 20);
+}
+
+struct fixture {
+  timestamp t0 = broker::now();
+
+  std::vector<node_message> released;
+
+  // Returns whether `x` passes the limiter at `t0 + dt`.
+  bool admit(detail::rate_limiter& uut, node_message x, timespan dt) {
+    return uut.admit(x, t0 + dt, [this](node_message&& y) {
+      released.emplace_back(std::move(y));
+    });
+  }
+};
+
+} // namespace
+
+CAF_TEST_FIXTURE_SCOPE(rate_limiter_tests, fixture)
+
+CAF_TEST(rules have a prefix, rate, optional burst and optional policy) {
+  auto x = make_rule("zeek/logs:100");
+  CHECK_EQUAL(x.prefix, topic{"zeek/logs"});
+  CHECK_EQUAL(x.rate, 100.0);
+  CHECK_EQUAL(x.burst, 100.0);
+  CHECK(x.mode == policy::drop);
+  auto y = make_rule("foo:10:50:sample/4");
+  CHECK_EQUAL(y.burst, 50.0);
+  CHECK(y.mode == policy::sample);
+  CHECK_EQUAL(y.sample_rate, 4u);
+  CHECK(make_rule("foo:1:1:coalesce").mode == policy::coalesce);
+  detail::rate_limiter::rule z;
+  CHECK(!convert(std::string{"foo"}, z));
+  CHECK(!convert(std::string{"foo:bar"}, z));
+  CHECK(!convert(std::string{"foo:10:10:never"}, z));
+}
+
+CAF_TEST(the drop policy discards messages above the limit) {
+  detail::rate_limiter uut{{make_rule("foo:10:2")}};
+  CHECK(admit(uut, msg("foo/a", 1), timespan{0}));
+  CHECK(admit(uut, msg("foo/a", 2), timespan{0}));
+  CHECK(!admit(uut, msg("foo/a", 3), timespan{0}));
+  CHECK(admit(uut, msg("bar", 4), timespan{0}));
+  CHECK_EQUAL(uut.rules()[0].dropped, 1u);
+  // Refills one token per 100ms.
+  CHECK(admit(uut, msg("foo/a", 5), milliseconds{100}));
+  CHECK(!admit(uut, msg("foo/a", 6), milliseconds{100}));
+  CHECK_EQUAL(uut.rules()[0].dropped, 2u);
+}
+
+CAF_TEST(the sample policy forwards every nth message above the limit) {
+  detail::rate_limiter uut{{make_rule("foo:1:1:sample/3")}};
+  CHECK(admit(uut, msg("foo", 0), timespan{0}));
+  std::vector<bool> passed;
+  for (integer i = 1; i <= 6; ++i)
+    passed.push_back(admit(uut, msg("foo", i), timespan{0}));
+  CHECK_EQUAL(passed,
+              std::vector<bool>({false, false, true, false, false, true}));
+  CHECK_EQUAL(uut.rules()[0].dropped, 4u);
+}
+
+CAF_TEST(the coalesce policy keeps the latest message per topic) {
+  detail::rate_limiter uut{{make_rule("foo:1:1:coalesce")}};
+  CHECK(admit(uut, msg("foo/a", 1), timespan{0}));
+  CHECK(!admit(uut, msg("foo/a", 2), timespan{0}));
+  CHECK(!admit(uut, msg("foo/a", 3), timespan{0}));
+  CHECK(!admit(uut, msg("foo/b", 4), timespan{0}));
+  CHECK_EQUAL(uut.rules()[0].dropped, 1u);
+  CHECK_EQUAL(uut.rules()[0].pending.size(), 2u);
+  auto f = [this](node_message&& y) { released.emplace_back(std::move(y)); };
+  uut.flush(t0 + seconds{1}, f);
+  REQUIRE_EQUAL(released.size(), 1u);
+  CHECK_EQUAL(get_topic(released[0]), topic{"foo/a"});
+  CHECK_EQUAL(get_data(caf::get<data_message>(released[0].content)), data{3});
+  uut.flush(t0 + seconds{2}, f);
+  REQUIRE_EQUAL(released.size(), 2u);
+  CHECK_EQUAL(get_topic(released[1]), topic{"foo/b"});
+  CHECK(uut.rules()[0].pending.empty());
+}
+
+CAF_TEST(the most specific prefix applies) {
+  detail::rate_limiter uut{{make_rule("foo:100"), make_rule("foo/bar:1")}};
+  CHECK(admit(uut, msg("foo/bar/baz", 1), timespan{0}));
+  CHECK(!admit(uut, msg("foo/bar/baz", 2), timespan{0}));
+  CHECK(admit(uut, msg("foo/baz", 3), timespan{0}));
+}
+
+CAF_TEST(prefixes only match entire topic components) {
+  detail::rate_limiter uut{{make_rule("foo/bar:1")}};
+  CHECK(admit(uut, msg("foo/bar", 1), timespan{0}));
+  CHECK(!admit(uut, msg("foo/bar/baz", 2), timespan{0}));
+  CHECK(admit(uut, msg("foo/barn", 3), timespan{0}));
+}
+
+CAF_TEST(store commands and internal topics are exempt) {
+  detail::rate_limiter uut{{make_rule("foo:1")}};
+  CHECK(admit(uut, msg("foo/a", 1), timespan{0}));
+  auto cmd = make_command_message(
+    topic{"foo"} / topics::master_suffix,
+    make_internal_command<put_command>(data{"key"}, data{"value"}));
+  for (int i = 0; i < 3; ++i)
+    CHECK(admit(uut, make_node_message(cmd, 20), timespan{0}));
+  auto internal = topic{"foo"} / topics::clone_suffix;
+  CHECK(admit(uut, make_node_message(make_data_message(internal, 1), 20),
+              timespan{0}));
+  CHECK(!admit(uut, msg("foo/a", 2), timespan{0}));
+}
+
+CAF_TEST_FIXTURE_SCOPE_END()
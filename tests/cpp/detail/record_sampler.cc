@@ -0,0 +1,71 @@
+#define SUITE record_sampler
+
+#include "broker/detail/record_sampler.hh"
+
+#include "test.hh"
+
+using namespace broker;
+
+namespace {
+
+detail::record_sampler::rule make_rule(const char* str) {
+  detail::record_sampler::rule result;
+  if (!convert(std::string{str}, result))
+    FAIL("invalid rule: " << str);
+  return result;
+}
+
+// Returns how many of `n` messages on topic `t` the sampler selects.
+size_t selected(detail::record_sampler& uut, const topic& t, size_t n) {
+  size_t result = 0;
+  for (size_t i = 0; i < n; ++i)
+    if (uut.select(t))
+      ++result;
+  return result;
+}
+
+} // namespace
+
+TEST(rules have the format prefix colon rate) {
+  auto x = make_rule("zeek/logs:100");
+  CHECK_EQUAL(x.prefix, "zeek/logs"_t);
+  CHECK_EQUAL(x.rate, 100u);
+  detail::record_sampler::rule y;
+  CHECK(!convert(std::string{"zeek/logs"}, y));
+  CHECK(!convert(std::string{":10"}, y));
+  CHECK(!convert(std::string{"zeek:"}, y));
+  CHECK(!convert(std::string{"zeek:-1"}, y));
+  CHECK(!convert(std::string{"zeek:1x"}, y));
+}
+
+TEST(the default sampler selects all messages) {
+  detail::record_sampler uut;
+  CHECK(uut.selects_all());
+  CHECK_EQUAL(selected(uut, "foo", 10), 10u);
+}
+
+TEST(the sampler selects every nth message) {
+  detail::record_sampler uut{4, {}};
+  CHECK(!uut.select("foo"));
+  CHECK(!uut.select("foo"));
+  CHECK(!uut.select("foo"));
+  CHECK(uut.select("foo"));
+  CHECK_EQUAL(selected(uut, "foo", 100), 25u);
+}
+
+TEST(the most specific rule wins) {
+  detail::record_sampler uut{10,
+                             {make_rule("zeek:0"), make_rule("zeek/logs:1"),
+                              make_rule("zeek/logs/conn:2")}};
+  CHECK(!uut.selects_all());
+  CHECK_EQUAL(selected(uut, "zeek/events", 100), 0u);
+  CHECK_EQUAL(selected(uut, "zeek/logs/dns", 100), 100u);
+  CHECK_EQUAL(selected(uut, "zeek/logs/conn", 100), 50u);
+  CHECK_EQUAL(selected(uut, "foo", 100), 10u);
+}
+
+TEST(make_record_sampler ignores invalid rules) {
+  auto uut = detail::make_record_sampler(0, {"foo:1", "bar"});
+  CHECK_EQUAL(selected(uut, "foo", 10), 10u);
+  CHECK_EQUAL(selected(uut, "bar", 10), 0u);
+}
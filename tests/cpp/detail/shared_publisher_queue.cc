@@ -0,0 +1,80 @@
+#define SUITE shared_publisher_queue
+
+#include "broker/detail/shared_publisher_queue.hh"
+
+#include "test.hh"
+
+#include <vector>
+
+using namespace broker;
+
+namespace {
+
+struct fixture {
+  detail::shared_publisher_queue_ptr<> q
+    = detail::make_shared_publisher_queue(10);
+
+  std::vector<data_message> consume(size_t num) {
+    std::vector<data_message> result;
+    q->consume(num, [&](data_message&& x) {
+      result.emplace_back(std::move(x));
+    });
+    return result;
+  }
+};
+
+} // namespace
+
+FIXTURE_SCOPE(shared_publisher_queue_tests, fixture)
+
+TEST(batches turn into messages on consumption) {
+  CHECK(q->produce(topic{"a"}, std::vector<data>{1, 2, 3}));
+  CHECK(!q->produce(make_data_message("b", 4)));
+  CHECK(!q->produce(std::vector<data_message>{make_data_message("c", 5),
+                                              make_data_message("d", 6)}));
+  CHECK_EQUAL(q->buffer_size(), 6u);
+  using msg_list = std::vector<data_message>;
+  CHECK_EQUAL(consume(2), msg_list({make_data_message("a", 1),
+                                    make_data_message("a", 2)}));
+  CHECK_EQUAL(q->buffer_size(), 4u);
+  CHECK_EQUAL(consume(10), msg_list({make_data_message("a", 3),
+                                     make_data_message("b", 4),
+                                     make_data_message("c", 5),
+                                     make_data_message("d", 6)}));
+  CHECK_EQUAL(q->buffer_size(), 0u);
+}
+
+TEST(batches may exceed the capacity) {
+  std::vector<data> xs;
+  for (int i = 0; i < 25; ++i)
+    xs.emplace_back(i);
+  CHECK(q->produce(topic{"a"}, std::move(xs)));
+  CHECK_EQUAL(q->buffer_size(), 25u);
+  bool wakeup = false;
+  data x = 42;
+  CHECK(q->try_produce(topic{"a"}, &x, &x + 1, wakeup) == &x);
+  CHECK_EQUAL(consume(20).size(), 20u);
+  auto rest = consume(20);
+  REQUIRE_EQUAL(rest.size(), 5u);
+  CHECK_EQUAL(rest.back(), make_data_message("a", 24));
+}
+
+TEST(byte limits stop producers before reaching the capacity) {
+  q = detail::make_shared_publisher_queue(10, 1500);
+  std::vector<data> xs(3, data{std::string(1000, 'x')});
+  bool wakeup = false;
+  MESSAGE("the queue takes items until reaching the byte limit");
+  auto i = q->try_produce(topic{"a"}, xs.begin(), xs.end(), wakeup);
+  CHECK(wakeup);
+  CHECK(i == xs.begin() + 2);
+  CHECK_EQUAL(q->buffer_size(), 2u);
+  CHECK_GREATER_EQUAL(q->buffered_bytes(), 2000u);
+  CHECK(q->try_produce(topic{"a"}, i, xs.end(), wakeup) == i);
+  MESSAGE("consuming an item makes room for the next one");
+  CHECK_EQUAL(consume(1).size(), 1u);
+  CHECK(q->try_produce(topic{"a"}, i, xs.end(), wakeup) == xs.end());
+  CHECK_EQUAL(consume(10).size(), 2u);
+  CHECK_EQUAL(q->buffered_bytes(), 0u);
+}
+
+FIXTURE_SCOPE_END()
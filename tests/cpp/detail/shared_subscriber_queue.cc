@@ -0,0 +1,184 @@
+#define SUITE shared_subscriber_queue
+
+#include "broker/detail/shared_subscriber_queue.hh"
+
+#include "test.hh"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace broker;
+
+namespace {
+
+using queue_type = detail::shared_subscriber_queue<int>;
+
+struct fixture {
+  detail::shared_subscriber_queue_ptr<int> q
+    = detail::make_shared_subscriber_queue<int>(4);
+
+  std::vector<int> consume_all() {
+    return q->consume_all();
+  }
+};
+
+std::vector<int> iota(int first, int last) {
+  std::vector<int> result;
+  for (auto i = first; i < last; ++i)
+    result.emplace_back(i);
+  return result;
+}
+
+} // namespace
+
+FIXTURE_SCOPE(shared_subscriber_queue_tests, fixture)
+
+TEST(batches overflow the ring as a whole) {
+  q->produce(iota(0, 10));
+  CHECK_EQUAL(q->buffer_size(), 10u);
+  q->produce(iota(10, 12));
+  q->produce(12);
+  CHECK_EQUAL(q->buffer_size(), 13u);
+  CHECK_EQUAL(consume_all(), iota(0, 13));
+  CHECK_EQUAL(q->buffer_size(), 0u);
+}
+
+TEST(batches that fit into the ring skip the overflow buffer) {
+  q->produce(iota(0, 2));
+  q->produce(iota(2, 4));
+  CHECK_EQUAL(consume_all(), iota(0, 4));
+}
+
+TEST(drained batches recycle their storage) {
+  auto xs = iota(0, 100);
+  auto capacity = xs.capacity();
+  q->produce(std::move(xs));
+  CHECK_EQUAL(consume_all(), iota(0, 100));
+  queue_type::batch_type ys;
+  q->reuse_batch(ys);
+  CHECK(ys.empty());
+  CHECK_EQUAL(ys.capacity(), capacity);
+  MESSAGE("the queue hands out each buffer only once");
+  queue_type::batch_type zs;
+  q->reuse_batch(zs);
+  CHECK_EQUAL(zs.capacity(), 0u);
+}
+
+TEST(byte limits count the payload of data messages) {
+  auto dq = detail::make_shared_subscriber_queue<data_message>(4);
+  dq->max_bytes(1500);
+  CHECK(!dq->bytes_exhausted());
+  dq->produce(make_data_message("a", std::string(1000, 'x')));
+  CHECK_GREATER_EQUAL(dq->buffered_bytes(), 1000u);
+  CHECK(!dq->bytes_exhausted());
+  dq->produce(make_data_message("a", std::string(1000, 'x')));
+  CHECK(dq->bytes_exhausted());
+  CHECK_EQUAL(dq->consume(1, nullptr, [](data_message&&) {}), 1u);
+  CHECK(!dq->bytes_exhausted());
+  CHECK_EQUAL(dq->consume_all().size(), 1u);
+  CHECK_EQUAL(dq->buffered_bytes(), 0u);
+}
+
+TEST(items exceeding the maximum age get dropped) {
+  using namespace std::chrono_literals;
+  q->produce(iota(0, 6));
+  MESSAGE("items produced before setting a maximum age never expire");
+  q->max_age(50ms);
+  q->produce(iota(6, 8));
+  std::this_thread::sleep_for(100ms);
+  CHECK_EQUAL(q->drop_stale(), 0u);
+  CHECK_EQUAL(q->consume(6, nullptr, [](int) {}), 6u);
+  MESSAGE("items produced afterwards expire once they reach the front");
+  CHECK_EQUAL(q->drop_stale(), 2u);
+  CHECK_EQUAL(q->buffer_size(), 0u);
+  MESSAGE("items older than the maximum age go away in order");
+  q->produce(iota(0, 6));
+  q->produce(6);
+  std::this_thread::sleep_for(100ms);
+  q->produce(iota(7, 10));
+  size_t prev_size = 0;
+  CHECK_EQUAL(q->drop_stale(&prev_size), 7u);
+  CHECK_EQUAL(prev_size, 10u);
+  CHECK_EQUAL(q->stale(), 9u);
+  CHECK_EQUAL(q->buffer_size(), 3u);
+  CHECK_EQUAL(consume_all(), iota(7, 10));
+  MESSAGE("dropping all items leaves the flare inactive");
+  q->produce(iota(0, 2));
+  std::this_thread::sleep_for(100ms);
+  CHECK_EQUAL(q->drop_stale(), 2u);
+  CHECK_EQUAL(q->buffer_size(), 0u);
+  CHECK(!q->wait_on_flare_abs(broker::now()));
+}
+
+TEST(conflating queues keep the latest item per key) {
+  q->produce(iota(0, 6));
+  MESSAGE("items produced before conflating stay in the queue");
+  q->conflate([](const int& x, data& key) {
+    if (x < 0)
+      return false;
+    key = static_cast<count>(x % 3);
+    return true;
+  });
+  CHECK(q->conflating());
+  q->produce(iota(6, 12));
+  q->produce(-1);
+  q->produce(-2);
+  q->produce(12);
+  CHECK_EQUAL(q->conflated(), 4u);
+  CHECK_EQUAL(q->buffer_size(), 11u);
+  CHECK_EQUAL(consume_all(),
+              (std::vector<int>{0, 1, 2, 3, 4, 5, 12, 10, 11, -1, -2}));
+  MESSAGE("consuming an item makes room for its key again");
+  q->produce(3);
+  CHECK_EQUAL(consume_all(), std::vector<int>{3});
+  q->produce(4);
+  q->produce(iota(5, 8));
+  CHECK_EQUAL(q->conflated(), 5u);
+  CHECK_EQUAL(consume_all(), (std::vector<int>{7, 5, 6}));
+  CHECK_EQUAL(q->buffer_size(), 0u);
+}
+
+TEST(replacements refresh the age of conflated items) {
+  using namespace std::chrono_literals;
+  q->max_age(50ms);
+  q->conflate([](const int& x, data& key) {
+    key = static_cast<count>(x % 3);
+    return true;
+  });
+  q->produce(1);
+  q->produce(0);
+  q->produce(2);
+  std::this_thread::sleep_for(100ms);
+  q->produce(3);
+  MESSAGE("stale items go away up to the refreshed item");
+  CHECK_EQUAL(q->drop_stale(), 1u);
+  CHECK_EQUAL(q->buffer_size(), 2u);
+  MESSAGE("the refreshed item expires once its new value gets stale");
+  std::this_thread::sleep_for(100ms);
+  CHECK_EQUAL(q->drop_stale(), 2u);
+  CHECK_EQUAL(q->stale(), 3u);
+  MESSAGE("replacing a stale item keeps the latest value");
+  q->produce(4);
+  std::this_thread::sleep_for(100ms);
+  q->produce(7);
+  CHECK_EQUAL(q->drop_stale(), 0u);
+  CHECK_EQUAL(consume_all(), std::vector<int>{7});
+}
+
+TEST(conflating queues adjust their byte count on replacements) {
+  auto dq = detail::make_shared_subscriber_queue<data_message>(4);
+  dq->max_bytes(1500);
+  dq->conflate([](const data_message& x, data& key) {
+    key = get_topic(x).string();
+    return true;
+  });
+  dq->produce(make_data_message("a", std::string(1000, 'x')));
+  dq->produce(make_data_message("a", std::string(10, 'x')));
+  CHECK_EQUAL(dq->buffer_size(), 1u);
+  CHECK_LESS(dq->buffered_bytes(), 1000u);
+  CHECK_EQUAL(dq->consume_all().size(), 1u);
+  CHECK_EQUAL(dq->buffered_bytes(), 0u);
+}
+
+FIXTURE_SCOPE_END()
@@ -0,0 +1,114 @@
+#define SUITE simd
+
+#include "broker/detail/simd.hh"
+
+#include "test.hh"
+
+#include <algorithm>
+#include <string>
+
+using namespace broker;
+
+namespace {
+
+// Covers lengths below, at, and above multiples of the 16-byte blocks.
+constexpr size_t max_length = 50;
+
+std::string make_string(size_t n) {
+  std::string result;
+  for (size_t i = 0; i < n; ++i)
+    result += static_cast<char>('a' + i % 26);
+  return result;
+}
+
+} // namespace
+
+TEST(equal_bytes compares all bytes) {
+  for (size_t n = 0; n <= max_length; ++n) {
+    auto x = make_string(n);
+    auto y = x;
+    CHECK(detail::equal_bytes(x.data(), y.data(), n));
+    for (size_t i = 0; i < n; ++i) {
+      y[i] = '/';
+      CHECK(!detail::equal_bytes(x.data(), y.data(), n));
+      y[i] = x[i];
+    }
+  }
+}
+
+TEST(find_byte returns the first occurrence) {
+  for (size_t n = 0; n <= max_length; ++n) {
+    auto x = make_string(n);
+    auto first = x.data();
+    auto last = first + n;
+    CHECK_EQUAL(detail::find_byte(first, last, '/'), last);
+    for (size_t i = 0; i < n; ++i) {
+      auto y = x;
+      y[i] = '/';
+      if (i + 1 < n)
+        y[n - 1] = '/';
+      auto yfirst = y.data();
+      CHECK_EQUAL(detail::find_byte(yfirst, yfirst + n, '/'), yfirst + i);
+    }
+  }
+}
+
+TEST(find_json_special finds quotes backslashes and control characters) {
+  for (size_t n = 0; n <= max_length; ++n) {
+    auto x = make_string(n);
+    auto first = x.data();
+    CHECK_EQUAL(detail::find_json_special(first, first + n), first + n);
+    for (auto c : {'"', '\\', '\n', '\x1f'}) {
+      for (size_t i = 0; i < n; ++i) {
+        auto y = x;
+        y[i] = c;
+        auto yfirst = y.data();
+        CHECK_EQUAL(detail::find_json_special(yfirst, yfirst + n),
+                    yfirst + i);
+      }
+    }
+  }
+  // Bytes above 0x7F and the space are no special characters.
+  std::string z(40, ' ');
+  z[20] = '\xc3';
+  CHECK_EQUAL(detail::find_json_special(z.data(), z.data() + z.size()),
+              z.data() + z.size());
+}
+
+TEST(find_byte16 ignores bytes past the size) {
+  unsigned char keys[16];
+  for (int i = 0; i < 16; ++i)
+    keys[i] = static_cast<unsigned char>(i * 16 + 1);
+  for (int n = 0; n <= 16; ++n)
+    for (int i = 0; i < 16; ++i)
+      CHECK_EQUAL(detail::find_byte16(keys, n, keys[i]), i < n ? i : n);
+  CHECK_EQUAL(detail::find_byte16(keys, 16, 0), 16);
+}
+
+TEST(upper_bound16 compares unsigned bytes) {
+  // Covers keys on both sides of 0x80, where signed comparisons go wrong.
+  unsigned char keys[16];
+  for (int i = 0; i < 16; ++i)
+    keys[i] = static_cast<unsigned char>(i * 16 + 8);
+  for (int n = 0; n <= 16; ++n)
+    for (int c = 0; c < 256; ++c) {
+      auto expected = static_cast<int>(
+        std::upper_bound(keys, keys + n, static_cast<unsigned char>(c))
+        - keys);
+      CHECK_EQUAL(detail::upper_bound16(keys, n,
+                                        static_cast<unsigned char>(c)),
+                  expected);
+    }
+}
+
+TEST(topics match long prefixes) {
+  topic t{"zeek/logs/conn/worker-17/very/deeply/nested/topic"};
+  CHECK(topic{"zeek/logs/conn/worker-17/very/deeply"}.prefix_of(t));
+  CHECK(!topic{"zeek/logs/conn/worker-18/very/deeply"}.prefix_of(t));
+  CHECK(t.prefix_of(t));
+  CHECK(!topic{t.string() + "x"}.prefix_of(t));
+  auto xs = topic::split(t);
+  REQUIRE_EQUAL(xs.size(), 8u);
+  CHECK_EQUAL(xs[3], "worker-17");
+  CHECK_EQUAL(xs[7], "topic");
+}
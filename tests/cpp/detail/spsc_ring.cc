@@ -0,0 +1,67 @@
+#define SUITE spsc_ring
+
+#include "broker/detail/spsc_ring.hh"
+
+#include "test.hh"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace broker;
+
+using detail::spsc_ring;
+
+namespace {
+
+template <class T>
+struct collector {
+  std::vector<T> xs;
+
+  void operator()(T&& x) {
+    xs.emplace_back(std::move(x));
+  }
+};
+
+} // namespace
+
+TEST(capacity is rounded up to a power of two) {
+  spsc_ring<int> ring{5};
+  CHECK_EQUAL(ring.capacity(), 8u);
+  CHECK(ring.empty());
+}
+
+TEST(push and pop) {
+  spsc_ring<std::string> ring{4};
+  for (auto str : {"a", "b", "c", "d"})
+    CHECK(ring.try_push(str));
+  CHECK(!ring.try_push("e"));
+  CHECK_EQUAL(ring.size(), 4u);
+  collector<std::string> f;
+  while (ring.try_pop(f))
+    ; // nop
+  CHECK_EQUAL(f.xs, std::vector<std::string>({"a", "b", "c", "d"}));
+  CHECK(ring.try_push("e"));
+  CHECK(ring.try_pop(f));
+  CHECK_EQUAL(f.xs.back(), "e");
+}
+
+TEST(concurrent producer and consumer) {
+  constexpr int n = 100000;
+  spsc_ring<int> ring{64};
+  std::thread producer{[&] {
+    for (int i = 0; i < n; ++i)
+      while (!ring.try_push(int{i}))
+        std::this_thread::yield();
+  }};
+  collector<int> f;
+  while (f.xs.size() < static_cast<size_t>(n))
+    if (!ring.try_pop(f))
+      std::this_thread::yield();
+  producer.join();
+  bool in_order = true;
+  for (int i = 0; i < n; ++i)
+    if (f.xs[i] != i)
+      in_order = false;
+  CHECK(in_order);
+}
@@ -0,0 +1,109 @@
+#define SUITE store_router
+
+#include "broker/detail/store_router.hh"
+
+#include "test.hh"
+
+#include "broker/atoms.hh"
+#include "broker/internal_command.hh"
+
+using namespace broker;
+
+namespace {
+
+/// Remembers the keys of all put commands and answers key queries with them.
+caf::behavior dummy_shard(caf::stateful_actor<set>* self) {
+  return {
+    [=](atom::local, internal_command& x) {
+      if (auto cmd = caf::get_if<put_command>(&x.content)) {
+        self->state.emplace(cmd->key);
+      } else if (auto cmd = caf::get_if<put_many_command>(&x.content)) {
+        for (auto& kvp : cmd->entries)
+          self->state.emplace(kvp.first);
+      }
+    },
+    [=](atom::get, atom::keys) {
+      return data{self->state};
+    },
+  };
+}
+
+struct fixture : base_fixture {
+  std::vector<caf::actor> shards;
+
+  caf::actor router;
+
+  fixture() {
+    for (size_t i = 0; i < 4; ++i)
+      shards.emplace_back(sys.spawn(dummy_shard));
+    router = sys.spawn(detail::store_router, "foo", shards);
+  }
+
+  ~fixture() {
+    for (auto& hdl : shards)
+      anon_send_exit(hdl, caf::exit_reason::user_shutdown);
+    anon_send_exit(router, caf::exit_reason::user_shutdown);
+  }
+
+  set keys_of(const caf::actor& hdl) {
+    set result;
+    auto rh = self->request(hdl, caf::infinite, atom::get::value,
+                            atom::keys::value);
+    run();
+    rh.receive(
+      [&](data& x) {
+        if (auto xs = caf::get_if<set>(&x))
+          result = std::move(*xs);
+      },
+      [&](const caf::error& err) { FAIL(sys.render(err)); });
+    return result;
+  }
+};
+
+} // namespace
+
+CAF_TEST(shard names are unique per index) {
+  CHECK_NOT_EQUAL(detail::shard_name("foo", 0), detail::shard_name("foo", 1));
+  CHECK_NOT_EQUAL(detail::shard_name("foo", 0), detail::shard_name("bar", 0));
+}
+
+CAF_TEST(keys always map to the same shard) {
+  for (integer i = 0; i < 100; ++i) {
+    auto index = detail::shard_of(data{i}, 4);
+    CHECK_LESS(index, 4u);
+    CHECK_EQUAL(index, detail::shard_of(data{i}, 4));
+  }
+}
+
+CAF_FIXTURE_SCOPE(store_router_tests, fixture)
+
+CAF_TEST(commands go to the shard that owns the key) {
+  put_many_command cmd;
+  for (integer i = 0; i < 20; ++i) {
+    anon_send(router, atom::local::value,
+              make_internal_command<put_command>(data{i}, data{i},
+                                                 caf::none));
+    cmd.entries.emplace(data{i + 100}, data{i});
+  }
+  anon_send(router, atom::local::value, internal_command{std::move(cmd)});
+  run();
+  size_t total = 0;
+  for (size_t i = 0; i < shards.size(); ++i) {
+    auto keys = keys_of(shards[i]);
+    for (auto& key : keys)
+      CHECK_EQUAL(detail::shard_of(key, shards.size()), i);
+    total += keys.size();
+  }
+  CHECK_EQUAL(total, 40u);
+}
+
+CAF_TEST(key queries merge the results of all shards) {
+  for (integer i = 0; i < 20; ++i)
+    anon_send(router, atom::local::value,
+              make_internal_command<put_command>(data{i}, data{i},
+                                                 caf::none));
+  run();
+  CHECK_EQUAL(keys_of(router).size(), 20u);
+}
+
+CAF_FIXTURE_SCOPE_END()
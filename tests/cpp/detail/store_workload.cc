@@ -0,0 +1,27 @@
+#define SUITE store_workload
+
+#include "broker/detail/store_workload.hh"
+
+#include "test.hh"
+
+using namespace broker;
+using namespace broker::detail;
+
+CAF_TEST(queries round trip through topics) {
+  for (auto x : {store_query::get, store_query::get_index, store_query::exists,
+                 store_query::keys, store_query::get_many, store_query::scan}) {
+    auto t = workload_topic("foo/bar", x);
+    CHECK_EQUAL(t.string(), "foo/bar/" + std::string{to_string(x)});
+    auto y = store_query::get;
+    CHECK(convert(t, y));
+    CHECK(x == y);
+  }
+  auto y = store_query::get;
+  CHECK(!convert(topic{"foo"}, y));
+  CHECK(!convert(topic{"foo/put"}, y));
+}
+
+CAF_TEST(file names stay in the recording directory) {
+  CHECK_EQUAL(workload_file_name("/tmp", "foo/bar"), "/tmp/store-foo_bar.dat");
+  CHECK_EQUAL(workload_file_name("/tmp", "baz"), "/tmp/store-baz.dat");
+}
@@ -0,0 +1,63 @@
+#define SUITE text_writer
+
+#include "broker/detail/text_writer.hh"
+
+#include "test.hh"
+
+#include "broker/convert.hh"
+
+using namespace broker;
+
+namespace {
+
+struct fixture {
+  detail::text_writer writer;
+  std::string buf;
+
+  std::string render(const data& x) {
+    buf.clear();
+    writer.append(buf, x);
+    return buf;
+  }
+};
+
+} // namespace
+
+FIXTURE_SCOPE(text_writer_tests, fixture)
+
+TEST(scalars) {
+  CHECK_EQUAL(render(nil), "nil");
+  CHECK_EQUAL(render(true), "T");
+  CHECK_EQUAL(render(count{42}), "42");
+  CHECK_EQUAL(render(integer{-42}), "-42");
+  CHECK_EQUAL(render(real{1.5}), "1.500000");
+  CHECK_EQUAL(render(1e300), std::to_string(1e300));
+  CHECK_EQUAL(render("foo"), "foo");
+  CHECK_EQUAL(render(port{80, port::protocol::tcp}), "80/tcp");
+  CHECK_EQUAL(render(timespan{42}), "42ns");
+  CHECK_EQUAL(render(enum_value{"foo"}), "foo");
+}
+
+TEST(containers) {
+  CHECK_EQUAL(render(vector{1, "a", vector{}}), "(1, a, ())");
+  CHECK_EQUAL(render(set{1, 2}), "{1, 2}");
+  CHECK_EQUAL(render(table{{1, "a"}, {2, set{}}}), "{1 -> a, 2 -> {}}");
+}
+
+TEST(the writer appends to the buffer) {
+  buf = "x=";
+  writer.append(buf, vector{1, 2});
+  CHECK_EQUAL(buf, "x=(1, 2)");
+}
+
+TEST(the writer matches to_string) {
+  address addr;
+  REQUIRE(convert("10.0.0.1", addr));
+  data x = vector{addr, subnet{addr, 8}, timestamp{timespan{5}}, 2.5,
+                  table{{"k", vector{true, count{7}}}}};
+  CHECK_EQUAL(render(x), to_string(x));
+  CHECK_EQUAL(to_string(x),
+              "(10.0.0.1, 10.0.0.0/8, 5ns, 2.500000, {k -> (T, 7)})");
+}
+
+FIXTURE_SCOPE_END()
@@ -0,0 +1,35 @@
+#define SUITE topic_table
+
+#include "broker/detail/topic_table.hh"
+
+#include "test.hh"
+
+using namespace broker;
+
+using detail::topic_table;
+
+TEST(interning assigns dense IDs) {
+  topic_table tbl;
+  bool added = false;
+  CHECK_EQUAL(tbl.intern("foo"_t, &added), 0u);
+  CHECK(added);
+  CHECK_EQUAL(tbl.intern("bar"_t, &added), 1u);
+  CHECK(added);
+  CHECK_EQUAL(tbl.intern("foo"_t, &added), 0u);
+  CHECK(!added);
+  CHECK_EQUAL(tbl.size(), 2u);
+  CHECK_EQUAL(tbl[0], "foo"_t);
+  CHECK_EQUAL(tbl[1], "bar"_t);
+}
+
+TEST(lookups) {
+  topic_table tbl;
+  tbl.intern("foo"_t);
+  CHECK_EQUAL(tbl.find("foo"_t), 0u);
+  CHECK_EQUAL(tbl.find("bar"_t), topic_table::invalid_id);
+  CHECK(tbl.contains(0));
+  CHECK(!tbl.contains(1));
+  tbl.clear();
+  CHECK(tbl.empty());
+  CHECK_EQUAL(tbl.find("foo"_t), topic_table::invalid_id);
+}
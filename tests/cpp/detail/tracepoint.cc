@@ -0,0 +1,75 @@
+#define SUITE tracepoint
+
+#include "broker/detail/tracepoint.hh"
+
+#include "test.hh"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace broker;
+using namespace broker::detail;
+
+namespace {
+
+struct fixture {
+  fixture() {
+    clear_trace_events();
+  }
+
+  ~fixture() {
+    clear_trace_events();
+  }
+};
+
+} // namespace
+
+FIXTURE_SCOPE(tracepoint_tests, fixture)
+
+TEST(events come out in order) {
+  trace(tracepoint::batch_received, 10, 0);
+  trace(tracepoint::batch_forwarded, 7, 10);
+  auto xs = trace_events();
+  REQUIRE_EQUAL(xs.size(), 2u);
+  CHECK(xs[0].id == tracepoint::batch_received);
+  CHECK_EQUAL(xs[0].arg0, 10u);
+  CHECK(xs[1].id == tracepoint::batch_forwarded);
+  CHECK_EQUAL(xs[1].arg0, 7u);
+  CHECK_EQUAL(xs[1].arg1, 10u);
+  CHECK(xs[0].timestamp <= xs[1].timestamp);
+  CHECK_EQUAL(std::string{to_string(xs[1].id)}, "batch_forwarded");
+}
+
+TEST(the buffer keeps only the most recent events) {
+  auto n = trace_buffer_size + 10;
+  for (size_t i = 0; i < n; ++i)
+    trace(tracepoint::batch_delivered, i, 0);
+  auto xs = trace_events();
+  REQUIRE_EQUAL(xs.size(), trace_buffer_size);
+  CHECK_EQUAL(xs.front().arg0, 10u);
+  CHECK_EQUAL(xs.back().arg0, n - 1);
+}
+
+TEST(concurrent writers produce complete events) {
+  constexpr size_t num_threads = 4;
+  constexpr size_t per_thread = 1000;
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; ++i)
+    threads.emplace_back([i] {
+      for (size_t j = 0; j < per_thread; ++j)
+        trace(tracepoint::store_command_applied, i, j);
+    });
+  for (auto& t : threads)
+    t.join();
+  auto xs = trace_events();
+  REQUIRE_EQUAL(xs.size(), num_threads * per_thread);
+  std::vector<size_t> next(num_threads);
+  for (auto& x : xs) {
+    REQUIRE(x.arg0 < num_threads);
+    CHECK_EQUAL(x.arg1, next[x.arg0]);
+    ++next[x.arg0];
+  }
+}
+
+FIXTURE_SCOPE_END()
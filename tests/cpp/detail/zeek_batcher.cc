@@ -0,0 +1,80 @@
+#define SUITE zeek_batcher
+
+#include "broker/detail/zeek_batcher.hh"
+
+#include "test.hh"
+
+#include "broker/zeek.hh"
+
+using namespace broker;
+
+using detail::zeek_batcher;
+
+namespace {
+
+struct fixture {
+  std::vector<data_message> out;
+
+  zeek_batcher batcher{3};
+
+  void add(topic t, data x) {
+    batcher.add(make_data_message(std::move(t), std::move(x)),
+                [this](data_message&& y) { out.emplace_back(std::move(y)); });
+  }
+
+  void flush() {
+    batcher.flush([this](data_message&& y) { out.emplace_back(std::move(y)); });
+  }
+
+  static data event(count n) {
+    return zeek::Event("ev", vector{n}).move_data();
+  }
+};
+
+} // namespace
+
+FIXTURE_SCOPE(zeek_batcher_tests, fixture)
+
+TEST(the batcher emits full batches) {
+  for (count i = 0; i < 4; ++i)
+    add("a", event(i));
+  REQUIRE_EQUAL(out.size(), 1u);
+  CHECK_EQUAL(get_topic(out[0]), "a"_t);
+  zeek::Batch batch{get_data(out[0])};
+  REQUIRE(batch.valid());
+  CHECK_EQUAL(batch.batch(), (vector{event(0), event(1), event(2)}));
+  CHECK(!batcher.empty());
+  flush();
+  REQUIRE_EQUAL(out.size(), 2u);
+  CHECK_EQUAL(get_data(out[1]), event(3));
+  CHECK(batcher.empty());
+}
+
+TEST(the batcher keeps topics apart and preserves ordering) {
+  add("a", event(0));
+  add("b", event(1));
+  add("a", event(2));
+  add("a", 42);
+  REQUIRE_EQUAL(out.size(), 2u);
+  CHECK_EQUAL(get_topic(out[0]), "a"_t);
+  CHECK_EQUAL(zeek::Batch{get_data(out[0])}.batch(),
+              (vector{event(0), event(2)}));
+  CHECK_EQUAL(get_data(out[1]), data{42});
+  flush();
+  REQUIRE_EQUAL(out.size(), 3u);
+  CHECK_EQUAL(get_topic(out[2]), "b"_t);
+  CHECK_EQUAL(get_data(out[2]), event(1));
+}
+
+TEST(unbatching restores the original messages) {
+  for (count i = 0; i < 3; ++i)
+    add("a", event(i));
+  add("b", 42);
+  detail::unbatch_zeek_messages(out);
+  CHECK_EQUAL(out, data_msgs({{"a", event(0)},
+                              {"a", event(1)},
+                              {"a", event(2)},
+                              {"b", 42}}));
+}
+
+FIXTURE_SCOPE_END()
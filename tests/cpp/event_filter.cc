@@ -0,0 +1,84 @@
+#define SUITE event_filter
+
+#include "broker/event_filter.hh"
+
+#include "test.hh"
+
+#include "broker/data.hh"
+#include "broker/packed.hh"
+#include "broker/zeek.hh"
+
+using namespace broker;
+
+namespace {
+
+using names = std::vector<std::string>;
+
+data event(std::string name) {
+  return zeek::Event{std::move(name), vector{}}.as_data();
+}
+
+// Mimics how a core adds subscribers to its filter and event filter.
+struct fixture {
+  filter_type filter;
+  event_filter events;
+
+  bool add(filter_type xs, names ys = {}) {
+    normalize(xs);
+    auto result = add_subscribers(events, filter, xs, ys);
+    filter.insert(filter.end(), xs.begin(), xs.end());
+    normalize(filter);
+    return result;
+  }
+};
+
+} // namespace <anonymous>
+
+FIXTURE_SCOPE(event_filter_tests, fixture)
+
+TEST(topics without entry accept everything) {
+  CHECK(accepts(events, "zeek/cluster", event("foo")));
+  CHECK(accepts(events, "zeek/cluster", data{"foo"}));
+}
+
+TEST(restricted topics accept only listed events) {
+  CHECK(add({"zeek/cluster"}, {"bar", "foo"}));
+  CHECK(events == event_filter({{"zeek/cluster", {"bar", "foo"}}}));
+  CHECK(accepts(events, "zeek/cluster/worker", event("foo")));
+  CHECK(!accepts(events, "zeek/cluster/worker", event("baz")));
+  CHECK(!accepts(events, "zeek/cluster/worker", data{"foo"}));
+  CHECK(accepts(events, "zeek/cluster/worker", pack(event("baz"))));
+  CHECK(accepts(events, "zeek/logs", event("baz")));
+  CHECK(accepts(events, "zeek/cluster/worker",
+                zeek::Batch{vector{event("baz"), event("foo")}}.as_data()));
+}
+
+TEST(restricted subscribers merge their event names) {
+  add({"zeek/cluster"}, {"foo"});
+  CHECK(add({"zeek/cluster/worker"}, {"bar"}));
+  CHECK(!add({"zeek/cluster"}, {"foo"}));
+  CHECK(events == event_filter({{"zeek/cluster", {"bar", "foo"}}}));
+  CHECK(add({"zeek"}, {"baz"}));
+  CHECK(events == event_filter({{"zeek", {"bar", "baz", "foo"}}}));
+}
+
+TEST(unrestricted subscribers lift restrictions) {
+  add({"zeek/cluster"}, {"foo"});
+  CHECK(add({"zeek/cluster/worker"}));
+  CHECK(events.empty());
+  CHECK(!add({"zeek/cluster"}, {"bar"}));
+  CHECK(events.empty());
+  add({"zeek/logs"}, {"foo"});
+  CHECK(add({"zeek"}));
+  CHECK(events.empty());
+}
+
+TEST(shorter restricted topics inherit unrestricted subscribers) {
+  add({"zeek/cluster"});
+  add({"zeek/events"}, {"foo"});
+  CHECK(add({"zeek"}, {"bar"}));
+  CHECK(events.empty());
+  CHECK(accepts(events, "zeek/events", event("baz")));
+}
+
+FIXTURE_SCOPE_END()
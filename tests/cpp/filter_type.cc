@@ -0,0 +1,67 @@
+#define SUITE filter_type
+
+#include "broker/filter_type.hh"
+
+#include "test.hh"
+
+using namespace broker;
+
+namespace {
+
+filter_type normalized(filter_type xs) {
+  normalize(xs);
+  return xs;
+}
+
+} // namespace <anonymous>
+
+TEST(normalizing sorts and removes duplicates) {
+  CHECK_EQUAL(normalized({}), filter_type{});
+  CHECK_EQUAL(normalized({"b", "a", "c", "a"}), filter_type({"a", "b", "c"}));
+}
+
+TEST(normalizing drops topics that a shorter topic covers) {
+  CHECK_EQUAL(normalized({"zeek/logs/conn", "zeek/logs", "zeek/events",
+                          "zeek/logs/dns", "zeek/logs"}),
+              filter_type({"zeek/events", "zeek/logs"}));
+  CHECK_EQUAL(normalized({"a/b/c", "a/b", "a", "b"}), filter_type({"a", "b"}));
+  CHECK_EQUAL(normalized({"zeek/logs", "", "foo"}), filter_type{""});
+}
+
+TEST(normalizing keeps topics with a common prefix that is not a topic) {
+  CHECK_EQUAL(normalized({"zeek/logs", "zeek/events"}),
+              filter_type({"zeek/events", "zeek/logs"}));
+}
+
+TEST(normalizing keeps topics of data store masters) {
+  auto foo_master = topic{"foo"} / topics::master_suffix;
+  auto foo_clone = topic{"foo"} / topics::clone_suffix;
+  CHECK_EQUAL(normalized({foo_clone, foo_master, "foo", foo_master}),
+              filter_type({"foo", foo_master}));
+  auto f = normalized({"foo", foo_master});
+  CHECK(covers(f, "foo/bar"));
+  CHECK(covers(f, "foo/zzz"));
+  CHECK(!covers(f, "fo"));
+}
+
+TEST(covers checks whether any topic is a prefix) {
+  auto f = normalized({"zeek/logs", "zeek/events", "foo"});
+  CHECK(covers(f, "zeek/logs"));
+  CHECK(covers(f, "zeek/logs/conn"));
+  CHECK(covers(f, "foo/bar"));
+  CHECK(covers(f, "zeek/events/x"));
+  CHECK(!covers(f, "zeek"));
+  CHECK(!covers(f, "zeek/l"));
+  CHECK(!covers(f, "bar"));
+  CHECK(!covers(filter_type{}, "foo"));
+}
+
+TEST(filters with the same topics have the same digest) {
+  auto f1 = normalized({"zeek/logs", "foo", "zeek/logs/conn"});
+  auto f2 = normalized({"foo", "zeek/logs"});
+  CHECK_EQUAL(digest(f1), digest(f2));
+  CHECK_NOT_EQUAL(digest(f1), digest(normalized({"foo"})));
+  CHECK_NOT_EQUAL(digest(normalized({"ab", "c"})),
+                  digest(normalized({"a", "bc"})));
+  CHECK_NOT_EQUAL(digest(filter_type{}), digest(filter_type{""}));
+}
@@ -8,13 +8,18 @@
 
 #include "broker/atoms.hh"
 #include "broker/backend.hh"
+#include "broker/backend_options.hh"
 #include "broker/data.hh"
+#include "broker/defaults.hh"
 #include "broker/endpoint.hh"
 #include "broker/error.hh"
 #include "broker/filter_type.hh"
 #include "broker/internal_command.hh"
+#include "broker/snapshot.hh"
 #include "broker/topic.hh"
 
+#include "broker/detail/master_actor.hh"
+
 using std::cout;
 using std::endl;
 using std::string;
@@ -56,6 +61,15 @@ CAF_TEST(local_master) {
   // read back what we have written
   sched.inline_next_enqueue(); // ds.get talks to the master_actor (blocking)
   CAF_CHECK_EQUAL(value_of(ds.get("hello")), data{"universe"});
+  // test batched modifications
+  ds.put_many({{"a", 1}, {"b", 2}});
+  run();
+  sched.inline_next_enqueue();
+  CAF_CHECK_EQUAL(value_of(ds.get("b")), data{2});
+  ds.erase_many({"a", "b"});
+  run();
+  sched.inline_next_enqueue();
+  CAF_CHECK_EQUAL(error_of(ds.get("a")), caf::error{ec::no_such_key});
   ds.clear();
   run();
   sched.inline_next_enqueue();
@@ -116,6 +130,12 @@ CAF_TEST(master_with_clone) {
   exec_all();
   earth.sched.inline_next_enqueue(); // .get talks to the master
   CAF_CHECK_EQUAL(value_of(ds_earth.get("test")), data{123});
+  // Make sure the clone needs more than one snapshot chunk.
+  std::unordered_map<data, data> entries;
+  for (count i = 0; i < 3 * defaults::store::snapshot_chunk_size; ++i)
+    entries.emplace(i, i);
+  ds_earth.put_many(std::move(entries));
+  exec_all();
   // --- phase 5: peer from earth to mars --------------------------------------
   auto foo_master = "foo" / topics::master_suffix;
   // Initiate handshake between core1 and core2.
@@ -133,9 +153,11 @@ CAF_TEST(master_with_clone) {
   //          core1  ---> (upstream_msg::ack_open) ---> core2
   forward_stream_traffic();
   expect_on(mars, (open_stream_msg), from(_).to(core2));
+  expect_on(mars, (atom::peer, atom::update, atom::add), from(_).to(core2));
   expect_on(mars, (upstream_msg::ack_open), from(_).to(core2));
   // Step #4: core1  <--- (upstream_msg::ack_open) <--- core2
   forward_stream_traffic();
+  expect_on(earth, (atom::peer, atom::update, atom::add), from(_).to(core1));
   expect_on(earth, (upstream_msg::ack_open), from(_).to(core1));
   // Make sure there is no communication pending at this point.
   exec_all();
@@ -151,12 +173,13 @@ CAF_TEST(master_with_clone) {
   // handshake
   auto foo_clone = "foo" / topics::clone_suffix;
   expect_on(mars, (open_stream_msg), from(_).to(ms_mars));
+  // the core also sends the new topic to all peers ...
+  expect_on(mars, (atom::tick, atom::update), from(_).to(core2));
   expect_on(mars, (upstream_msg::ack_open),
             from(ms_mars).to(core2).with(_, _, _, false));
-  // the core also updates its filter on all peers ...
   network_traffic();
-  expect_on(earth, (atom::update, filter_type),
-            from(_).to(core1).with(_, filter_type{foo_clone}));
+  expect_on(earth, (atom::update, atom::add, filter_type),
+            from(_).to(core1).with(_, _, filter_type{foo_clone}));
   // -- phase 8: run it all & check results ------------------------------------
   exec_all();
   CAF_MESSAGE("put 'user' -> 'neverlord'");
@@ -165,13 +188,33 @@ CAF_TEST(master_with_clone) {
             from(_).to(ds_mars.frontend()).with(atom::local::value, _));
   expect_on(mars, (atom_value, command_message),
             from(_).to(mars.ep.core()).with(atom::publish::value, _));
+  CAF_MESSAGE("the clone sees its own write before the master confirms it");
+  mars.sched.inline_next_enqueue(); // .get talks to the clone
+  CAF_CHECK_EQUAL(value_of(ds_mars.get("user")), data{"neverlord"});
   exec_all();
   earth.sched.inline_next_enqueue(); // .get talks to the master
   CAF_CHECK_EQUAL(value_of(ds_earth.get("user")), data{"neverlord"});
   mars.sched.inline_next_enqueue(); // .get talks to the master
   CAF_CHECK_EQUAL(value_of(ds_mars.get("test")), data{123});
   mars.sched.inline_next_enqueue(); // .get talks to the master
+  CAF_CHECK_EQUAL(value_of(ds_mars.get(count{42})), data{count{42}});
+  mars.sched.inline_next_enqueue(); // .get talks to the master
   CAF_CHECK_EQUAL(value_of(ds_mars.get("user")), data{"neverlord"});
+  CAF_MESSAGE("get_many and scan on the clone include unconfirmed writes");
+  ds_mars.put("username", "dominik");
+  expect_on(mars, (atom_value, internal_command),
+            from(_).to(ds_mars.frontend()).with(atom::local::value, _));
+  mars.sched.inline_next_enqueue(); // .get_many talks to the clone
+  CAF_CHECK_EQUAL(value_of(ds_mars.get_many({"test", "username", "nil"})),
+                  data(table{{"test", 123}, {"username", "dominik"}}));
+  mars.sched.inline_next_enqueue(); // .scan talks to the clone
+  CAF_CHECK_EQUAL(value_of(ds_mars.scan("user")),
+                  data(table{{"user", "neverlord"}, {"username", "dominik"}}));
+  mars.sched.inline_next_enqueue(); // .scan talks to the clone
+  auto limited = value_of(ds_mars.scan("user", 1));
+  CAF_REQUIRE(broker::is<table>(limited));
+  CAF_CHECK_EQUAL(broker::get<table>(limited).size(), 1u);
+  exec_all();
   // done
   anon_send_exit(earth.ep.core(), exit_reason::user_shutdown);
   anon_send_exit(mars.ep.core(), exit_reason::user_shutdown);
@@ -179,3 +222,338 @@ CAF_TEST(master_with_clone) {
 }
 
 CAF_TEST_FIXTURE_SCOPE_END()
+
+namespace {
+
+// Records what a master asks of its core.
+struct dummy_core_state {
+  size_t snapshot_requests = 0;
+  std::vector<std::string> promoted;
+  std::vector<internal_command> published;
+  static inline const char* name = "dummy_core";
+};
+
+using dummy_core_actor = caf::stateful_actor<dummy_core_state>;
+
+caf::behavior dummy_core(dummy_core_actor* self) {
+  self->set_default_handler(caf::drop);
+  return {
+    [=](atom::store, atom::master, atom::snapshot, const std::string&,
+        const caf::actor&) {
+      ++self->state.snapshot_requests;
+    },
+    [=](atom::store, atom::standby, atom::master, const std::string& name) {
+      self->state.promoted.emplace_back(name);
+    },
+    [=](atom::publish, const command_message& msg) {
+      self->state.published.emplace_back(get_command(msg));
+    },
+  };
+}
+
+// Stands in for the primary master and swallows forwarded writes.
+caf::behavior dummy_primary(caf::event_based_actor* self) {
+  self->set_default_handler(caf::drop);
+  return {
+    [](atom::local, internal_command&) {
+      // nop
+    },
+  };
+}
+
+template <class T>
+T& deref(const caf::actor& hdl) {
+  return dynamic_cast<T&>(*caf::actor_cast<caf::abstract_actor*>(hdl));
+}
+
+struct standby_fixture : base_fixture {
+  endpoint::clock clk;
+  caf::actor core;
+  caf::actor primary;
+  caf::actor standby;
+
+  standby_fixture() : clk(&sys, false) {
+    core = sys.spawn(dummy_core);
+    primary = sys.spawn(dummy_primary);
+    standby = sys.spawn(standby_master_actor, core, "foo", backend::memory,
+                        backend_options{}, &clk, nullptr);
+    run();
+  }
+
+  ~standby_fixture() {
+    anon_send_exit(standby, exit_reason::user_shutdown);
+    anon_send_exit(primary, exit_reason::user_shutdown);
+    anon_send_exit(core, exit_reason::user_shutdown);
+  }
+
+  master_state& state() {
+    return deref<caf::stateful_actor<master_state>>(standby).state;
+  }
+
+  dummy_core_state& core_state() {
+    return deref<dummy_core_actor>(core).state;
+  }
+
+  data get(const data& key) {
+    auto res = state().backend->get(key);
+    return res ? std::move(*res) : data{};
+  }
+
+  // Sends a snapshot the way the primary does: expiries go first.
+  void send_snapshot(snapshot ss, uint64_t seq, table expiries = {}) {
+    anon_send(standby, atom::snapshot::value, atom::expire::value,
+              std::move(expiries));
+    anon_send(standby, atom::snapshot::value, std::move(ss), seq, true);
+    run();
+  }
+
+  void replicate(uint64_t seq, data key, data value) {
+    auto cmd = make_internal_command<put_command>(std::move(key),
+                                                  std::move(value));
+    cmd.seq = seq;
+    state().replicate(cmd);
+    run();
+  }
+};
+
+} // namespace
+
+CAF_TEST_FIXTURE_SCOPE(standby_master, standby_fixture)
+
+CAF_TEST(standbys load a snapshot with expiries from the primary) {
+  anon_send(standby, atom::master::value, primary);
+  run();
+  CHECK_EQUAL(core_state().snapshot_requests, 1u);
+  CHECK(!state().standby_synced);
+  auto deadline = clk.now() + std::chrono::hours(1);
+  send_snapshot(snapshot{{"a", 1}, {"b", 2}}, 100, table{{"b", deadline}});
+  CHECK(state().standby_synced);
+  CHECK_EQUAL(state().seq, 100u);
+  CHECK_EQUAL(get("a"), data{1});
+  CHECK_EQUAL(get("b"), data{2});
+  auto es = state().backend->expiries();
+  REQUIRE(es);
+  REQUIRE_EQUAL(es->size(), 1u);
+  CHECK_EQUAL(es->front().first, data{"b"});
+  CHECK_EQUAL(es->front().second, deadline);
+}
+
+CAF_TEST(standbys request a new snapshot after missing commands) {
+  anon_send(standby, atom::master::value, primary);
+  run();
+  send_snapshot(snapshot{{"a", 1}}, 100);
+  replicate(101, "b", 2);
+  CHECK_EQUAL(state().seq, 101u);
+  CHECK_EQUAL(get("b"), data{2});
+  MESSAGE("commands that arrive twice have no effect");
+  replicate(101, "b", 3);
+  CHECK_EQUAL(get("b"), data{2});
+  MESSAGE("a gap triggers a new snapshot");
+  replicate(103, "d", 4);
+  CHECK_EQUAL(core_state().snapshot_requests, 2u);
+  CHECK(!state().standby_synced);
+  CHECK_EQUAL(get("d"), data{});
+  MESSAGE("buffered commands apply on top of the new snapshot");
+  send_snapshot(snapshot{{"a", 1}, {"b", 2}, {"c", 3}}, 102);
+  CHECK(state().standby_synced);
+  CHECK_EQUAL(state().seq, 103u);
+  CHECK_EQUAL(get("c"), data{3});
+  CHECK_EQUAL(get("d"), data{4});
+}
+
+CAF_TEST(standbys take over when the primary goes down) {
+  anon_send(standby, atom::master::value, primary);
+  run();
+  auto deadline = clk.now() + std::chrono::hours(1);
+  send_snapshot(snapshot{{"a", 1}}, 100, table{{"a", deadline}});
+  replicate(101, "b", 2);
+  replicate(102, "c", 3);
+  MESSAGE("standbys forward writes to the primary until taking over");
+  anon_send(standby, atom::local::value,
+            make_internal_command<put_command>("x", 0));
+  run();
+  CHECK_EQUAL(get("x"), data{});
+  anon_send_exit(primary, exit_reason::user_shutdown);
+  run();
+  CHECK(!state().standby);
+  CHECK_EQUAL(core_state().promoted, std::vector<std::string>{"foo"});
+  CHECK(!state().expiry_buckets.empty());
+  MESSAGE("clones that synced with the primary only receive missed commands");
+  self->send(standby, atom::snapshot::value, uint64_t{101});
+  run();
+  self->receive(
+    [&](atom::snapshot, const std::vector<internal_command>& deltas) {
+      REQUIRE_EQUAL(deltas.size(), 1u);
+      CHECK_EQUAL(deltas.front().seq, 102u);
+    },
+    caf::after(std::chrono::seconds(0)) >> [] { FAIL("no deltas received"); });
+  MESSAGE("the promoted standby accepts writes");
+  anon_send(standby, atom::local::value,
+            make_internal_command<put_command>("x", 0));
+  run();
+  CHECK_EQUAL(get("x"), data{0});
+}
+
+CAF_TEST_FIXTURE_SCOPE_END()
+
+namespace {
+
+struct coalescing_fixture : base_fixture {
+  endpoint::clock clk;
+  caf::actor core;
+  caf::actor master;
+  timespan window = std::chrono::milliseconds(100);
+
+  coalescing_fixture() : clk(&sys, false) {
+    core = sys.spawn(dummy_core);
+    master = sys.spawn(master_actor, core, "foo", backend::memory,
+                       backend_options{}, &clk, nullptr);
+    run();
+    state().coalesce_window = window;
+    MESSAGE("attach a clone, since the master only broadcasts to clones");
+    self->send(master, atom::snapshot::value, uint64_t{0});
+    run();
+    self->receive(
+      [](atom::snapshot, const std::vector<internal_command>&) {
+        // nop
+      },
+      caf::after(std::chrono::seconds(0)) >> [] { FAIL("no resync"); });
+  }
+
+  ~coalescing_fixture() {
+    anon_send_exit(master, exit_reason::user_shutdown);
+    anon_send_exit(core, exit_reason::user_shutdown);
+  }
+
+  master_state& state() {
+    return deref<caf::stateful_actor<master_state>>(master).state;
+  }
+
+  std::vector<internal_command>& published() {
+    return deref<dummy_core_actor>(core).state.published;
+  }
+
+  data get(const data& key) {
+    auto res = state().backend->get(key);
+    return res ? std::move(*res) : data{};
+  }
+
+  void write(internal_command cmd) {
+    anon_send(master, atom::local::value, std::move(cmd));
+    run();
+  }
+
+  void write_from_clone(internal_command cmd) {
+    state().from_clone = true;
+    state().command(cmd);
+    state().from_clone = false;
+    run();
+  }
+
+  void close_window() {
+    clk.advance_time(clk.now() + window);
+    run();
+  }
+
+  // Checks that the clones received consecutive sequence numbers.
+  void check_sequence() {
+    for (size_t i = 0; i < published().size(); ++i)
+      CHECK_EQUAL(published()[i].seq, i + 1);
+  }
+};
+
+template <class T>
+const T& content(const internal_command& x) {
+  return caf::get<T>(x.content);
+}
+
+} // namespace
+
+CAF_TEST_FIXTURE_SCOPE(coalescing_master, coalescing_fixture)
+
+CAF_TEST(puts within the window replace each other) {
+  write(make_internal_command<put_command>("a", 1));
+  write(make_internal_command<put_command>("a", 2));
+  write(make_internal_command<put_command>("b", 3));
+  CHECK(published().empty());
+  CHECK_EQUAL(get("a"), data{2});
+  close_window();
+  REQUIRE_EQUAL(published().size(), 2u);
+  check_sequence();
+  CHECK_EQUAL(content<put_command>(published()[0]).key, data{"a"});
+  CHECK_EQUAL(content<put_command>(published()[0]).value, data{2});
+  CHECK_EQUAL(content<put_command>(published()[1]).key, data{"b"});
+  CHECK_EQUAL(content<put_command>(published()[1]).value, data{3});
+  MESSAGE("the next write opens a new window");
+  write(make_internal_command<put_command>("a", 4));
+  CHECK_EQUAL(published().size(), 2u);
+  close_window();
+  REQUIRE_EQUAL(published().size(), 3u);
+  CHECK_EQUAL(content<put_command>(published()[2]).value, data{4});
+}
+
+CAF_TEST(adds merge into a pending add or put) {
+  write(make_internal_command<put_command>("x", count{1}));
+  write(make_internal_command<add_command>("x", count{2}, data::type::count));
+  write(make_internal_command<add_command>("y", count{1}, data::type::count));
+  write(make_internal_command<add_command>("y", count{2}, data::type::count));
+  CHECK(published().empty());
+  close_window();
+  REQUIRE_EQUAL(published().size(), 2u);
+  check_sequence();
+  CHECK_EQUAL(content<put_command>(published()[0]).value, data{count{3}});
+  CHECK_EQUAL(content<add_command>(published()[1]).key, data{"y"});
+  CHECK_EQUAL(content<add_command>(published()[1]).value, data{count{3}});
+  MESSAGE("clones converge to the state of the master");
+  CHECK_EQUAL(get("x"), data{count{3}});
+  CHECK_EQUAL(get("y"), data{count{3}});
+}
+
+CAF_TEST(adds with expiry send the pending command first) {
+  write(make_internal_command<put_command>("z", count{1}));
+  timespan expiry = std::chrono::seconds(10);
+  write(make_internal_command<add_command>("z", count{1}, data::type::count,
+                                           expiry));
+  REQUIRE_EQUAL(published().size(), 1u);
+  CHECK_EQUAL(content<put_command>(published()[0]).value, data{count{1}});
+  close_window();
+  REQUIRE_EQUAL(published().size(), 2u);
+  check_sequence();
+  auto& add = content<add_command>(published()[1]);
+  CHECK_EQUAL(add.value, data{count{1}});
+  REQUIRE(add.expiry);
+  CHECK_EQUAL(*add.expiry, expiry);
+}
+
+CAF_TEST(erase and clear send all pending commands first) {
+  write(make_internal_command<put_command>("a", 1));
+  write(make_internal_command<put_command>("b", 2));
+  write(make_internal_command<erase_command>("a"));
+  REQUIRE_EQUAL(published().size(), 3u);
+  CHECK(caf::holds_alternative<put_command>(published()[0].content));
+  CHECK(caf::holds_alternative<put_command>(published()[1].content));
+  CHECK_EQUAL(content<erase_command>(published()[2]).key, data{"a"});
+  write(make_internal_command<put_command>("c", 3));
+  write(make_internal_command<clear_command>());
+  REQUIRE_EQUAL(published().size(), 5u);
+  CHECK_EQUAL(content<put_command>(published()[3]).key, data{"c"});
+  CHECK(caf::holds_alternative<clear_command>(published()[4].content));
+  check_sequence();
+  MESSAGE("closing the window afterwards sends nothing");
+  close_window();
+  CHECK_EQUAL(published().size(), 5u);
+}
+
+CAF_TEST(puts from clones bypass coalescing) {
+  write(make_internal_command<put_command>("a", 1));
+  write_from_clone(make_internal_command<put_command>("a", 2));
+  REQUIRE_EQUAL(published().size(), 2u);
+  check_sequence();
+  CHECK_EQUAL(content<put_command>(published()[0]).value, data{1});
+  CHECK_EQUAL(content<put_command>(published()[1]).value, data{2});
+  CHECK_EQUAL(get("a"), data{2});
+  close_window();
+  CHECK_EQUAL(published().size(), 2u);
+}
+
+CAF_TEST_FIXTURE_SCOPE_END()
@@ -0,0 +1,42 @@
+#define SUITE packed
+
+#include "broker/packed.hh"
+
+#include "test.hh"
+
+#include "broker/error.hh"
+
+using namespace broker;
+
+TEST(roundtrip) {
+  data x = vector{1, "two", set{3.0, count{4}}, table{{"five", nil}}};
+  auto packed = pack(x);
+  CHECK(is_packed(packed));
+  CHECK(caf::holds_alternative<packed_data>(packed));
+  auto y = unpack(packed);
+  REQUIRE(y);
+  CHECK_EQUAL(*y, x);
+}
+
+TEST(regular strings are not packed) {
+  CHECK(!is_packed(data{"hello world"}));
+  CHECK(!is_packed(data{42}));
+  CHECK_EQUAL(unpack(data{"hello world"}), ec::invalid_data);
+}
+
+TEST(strings that contain packed data are not packed) {
+  auto packed = caf::get<packed_data>(pack(data{42}));
+  data str = std::string{packed.bytes.begin(), packed.bytes.end()};
+  CHECK(!is_packed(str));
+  CHECK_EQUAL(unpack(str), ec::invalid_data);
+}
+
+TEST(malformed packed data results in errors) {
+  auto packed = caf::get<packed_data>(pack(data{"hello world"}));
+  auto truncated = packed;
+  truncated.bytes.pop_back();
+  CHECK_EQUAL(unpack(data{truncated}), ec::invalid_data);
+  auto padded = packed;
+  padded.bytes.push_back('\0');
+  CHECK_EQUAL(unpack(data{padded}), ec::invalid_data);
+}
@@ -0,0 +1,67 @@
+#define SUITE predicate
+
+#include "broker/predicate.hh"
+
+#include "test.hh"
+
+#include "broker/data.hh"
+#include "broker/packed.hh"
+#include "broker/zeek.hh"
+
+using namespace broker;
+
+namespace {
+
+predicate events(std::vector<std::string> names) {
+  predicate result;
+  result.event_names = std::move(names);
+  normalize(result);
+  return result;
+}
+
+data event(std::string name, vector args = {}) {
+  return zeek::Event{std::move(name), std::move(args)}.as_data();
+}
+
+} // namespace <anonymous>
+
+TEST(empty predicates accept everything) {
+  predicate pred;
+  CHECK(pred.empty());
+  CHECK(matches(pred, data{}));
+  CHECK(matches(pred, event("foo")));
+}
+
+TEST(event names select Zeek events) {
+  auto pred = events({"foo", "bar", "foo"});
+  CHECK_EQUAL(pred.event_names, std::vector<std::string>({"bar", "foo"}));
+  CHECK(matches(pred, event("foo")));
+  CHECK(matches(pred, event("bar")));
+  CHECK(!matches(pred, event("baz")));
+  CHECK(!matches(pred, data{"foo"}));
+  CHECK(!matches(pred, data{vector{count{1}}}));
+}
+
+TEST(batches pass if any event passes) {
+  auto pred = events({"foo"});
+  CHECK(matches(pred, zeek::Batch{vector{event("baz"), event("foo")}}
+                        .as_data()));
+  CHECK(!matches(pred, zeek::Batch{vector{event("baz")}}.as_data()));
+}
+
+TEST(field conditions compare nested elements) {
+  predicate pred;
+  pred.fields.emplace_back(field_condition{{2, 1, 0}, data{count{42}}});
+  CHECK(matches(pred, event("foo", {count{42}, "x"})));
+  CHECK(!matches(pred, event("foo", {count{23}, "x"})));
+  CHECK(!matches(pred, event("foo")));
+  CHECK(!matches(pred, data{count{42}}));
+  pred.fields.emplace_back(field_condition{{2, 1, 1}, data{"x"}});
+  CHECK(matches(pred, event("foo", {count{42}, "x"})));
+  CHECK(!matches(pred, event("foo", {count{42}, "y"})));
+}
+
+TEST(packed payloads always pass) {
+  auto pred = events({"foo"});
+  CHECK(matches(pred, pack(event("bar"))));
+}
@@ -22,6 +22,7 @@
 #include "broker/convert.hh"
 #include "broker/core_actor.hh"
 #include "broker/data.hh"
+#include "broker/defaults.hh"
 #include "broker/endpoint.hh"
 #include "broker/filter_type.hh"
 #include "broker/message.hh"
@@ -97,6 +98,10 @@ CAF_TEST(blocking_publishers) {
     pub2.drop_all_on_destruction();
     auto d1 = pub1.worker();
     auto d2 = pub2.worker();
+    CAF_CHECK_EQUAL(pub1.capacity(), defaults::publisher::queue_size);
+    auto pub3 = ep.make_publisher("a/c", 100);
+    pub3.drop_all_on_destruction();
+    CAF_CHECK_EQUAL(pub3.capacity(), 100u);
     run();
     // Data flows from our publishers to core1 to core2 and finally to leaf.
     using buf = std::vector<data_message>;
@@ -187,4 +192,25 @@ CAF_TEST(nonblocking_publishers) {
   anon_send_exit(leaf, exit_reason::user_shutdown);
 }
 
+CAF_TEST(publishers accept messages with individual topics) {
+  auto pub = ep.make_publisher("a");
+  pub.drop_all_on_destruction();
+  pub.publish("b", 1);
+  pub.publish(data_msgs({{"c", 2}, {"d", 3}}));
+  CHECK_EQUAL(pub.buffered(), 3u);
+}
+
+CAF_TEST(try_publish never exceeds the capacity) {
+  auto pub = ep.make_publisher("a", 3);
+  pub.drop_all_on_destruction();
+  CHECK(pub.try_publish(0));
+  CHECK(pub.try_publish(1));
+  std::vector<data> xs{2, 3, 4};
+  CHECK_EQUAL(pub.try_publish(xs), 1u);
+  CHECK_EQUAL(pub.buffered(), 3u);
+  CHECK_EQUAL(pub.free_capacity(), 0u);
+  CHECK(!pub.try_publish(5));
+  CHECK_EQUAL(pub.buffered(), 3u);
+}
+
 CAF_TEST_FIXTURE_SCOPE_END()
@@ -4,12 +4,14 @@
 
 #include "test.hh"
 
+#include <algorithm>
 #include <deque>
 #include <iterator>
 #include <set>
 #include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
 
 using namespace std;
 using namespace broker;
@@ -484,3 +486,73 @@ TEST(general) {
   matches = tree.prefixed_by("");
   CHECK(matches.empty());
 }
+
+TEST(node recycling) {
+  detail::radix_tree<string> t;
+  auto fill = [&] {
+    for (auto i = 0; i < 256; ++i) {
+      string key{"x"};
+      key += static_cast<char>(i);
+      CHECK(t.insert(make_pair(key, key + " value")).second);
+    }
+  };
+  // Grow the root through all node types, shrink it again, and grow it once
+  // more from the recycled nodes.
+  fill();
+  CHECK(t.size() == 256);
+  for (auto i = 0; i < 256; ++i) {
+    string key{"x"};
+    key += static_cast<char>(i);
+    CHECK(t.erase(key) == 1);
+  }
+  CHECK(t.empty());
+  CHECK(t.find("x") == t.end());
+  fill();
+  CHECK(t.size() == 256);
+  CHECK(t.prefixed_by("x").size() == 256);
+  CHECK(t.find("xa")->second == "xa value");
+  MESSAGE("swapped trees keep their nodes");
+  detail::radix_tree<string> u;
+  swap(t, u);
+  CHECK(t.empty());
+  CHECK(u.size() == 256);
+  CHECK(u.find("xb")->second == "xb value");
+  u.clear();
+  CHECK(u.empty());
+  CHECK(u.insert(make_pair("foo", "bar")).second);
+  CHECK(u.find("foo")->second == "bar");
+}
+
+TEST(node16 order) {
+  // Keys with bytes above 0x7F must come after all other keys.
+  test_radix_tree t;
+  std::vector<unsigned char> bytes{0x10, 0xF0, 0x7F, 0x80, 0x01, 0xAA, 0x42,
+                                   0xFF, 0x20};
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    string key{"x"};
+    key += static_cast<char>(bytes[i]);
+    CHECK(t.insert(make_pair(key, static_cast<int>(i))).second);
+  }
+  std::vector<string> keys;
+  for (auto& kvp : t)
+    keys.emplace_back(kvp.first);
+  CHECK_EQUAL(keys.size(), bytes.size());
+  CHECK(std::is_sorted(keys.begin(), keys.end()));
+  string key{"x"};
+  key += static_cast<char>(0xAA);
+  CHECK(t.find(key)->second == 5);
+}
+
+TEST(node48 iteration) {
+  test_radix_tree t;
+  for (auto i = 0; i < 40; ++i) {
+    string key{"y"};
+    key += static_cast<char>('0' + i * 3 % 40);
+    CHECK(t.insert(make_pair(key, i)).second);
+  }
+  std::vector<string> keys;
+  for (auto& kvp : t)
+    keys.emplace_back(kvp.first);
+  CHECK_EQUAL(keys.size(), 40u);
+  CHECK(std::is_sorted(keys.begin(), keys.end()));
+}
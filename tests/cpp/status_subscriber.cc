@@ -79,4 +79,24 @@ CAF_TEST(base_tests) {
   anon_send_exit(ep.core(), caf::exit_reason::user_shutdown);
 }
 
+CAF_TEST(congested_data_subscribers) {
+  auto sub = ep.make_status_subscriber(false);
+  sub.set_rate_calculation(false);
+  auto data_sub = ep.make_subscriber({"a"}, 1);
+  data_sub.set_rate_calculation(false);
+  run();
+  CAF_MESSAGE("fill the queue of the data subscriber");
+  for (int i = 0; i < 100; ++i)
+    caf::anon_send(ep.core(), atom::publish::value, atom::local::value,
+                   make_data_message("a", i));
+  error e1 = ec::peer_unavailable;
+  push(e1);
+  run();
+  CAF_CHECK_GREATER(data_sub.available(), 0u);
+  CAF_MESSAGE("the status subscriber receives its events regardless");
+  CAF_REQUIRE_EQUAL(sub.available(), 1u);
+  CAF_CHECK_EQUAL(sub.get(), e1);
+  anon_send_exit(ep.core(), caf::exit_reason::user_shutdown);
+}
+
 CAF_TEST_FIXTURE_SCOPE_END()
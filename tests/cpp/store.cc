@@ -5,6 +5,8 @@
 #include "test.hh"
 
 #include <chrono>
+#include <future>
+#include <memory>
 #include <thread>
 #include <utility>
 
@@ -78,6 +80,33 @@ TEST(master operations) {
   REQUIRE_EQUAL(ds->get_index_from_value("foo", 2), true);
   MESSAGE("keys");
   REQUIRE_EQUAL(value_of(ds->keys()), data(set{"foo"}));
+  MESSAGE("get_many");
+  ds->put("foobar", 1);
+  ds->put("bar", 2);
+  REQUIRE_EQUAL(value_of(ds->get_many({"foobar", "bar", "baz"})),
+                data(table{{"foobar", 1}, {"bar", 2}}));
+  MESSAGE("scan");
+  REQUIRE_EQUAL(value_of(ds->scan("foo")),
+                data(table{{"foo", set{2, 3}}, {"foobar", 1}}));
+  MESSAGE("staleness");
+  REQUIRE_EQUAL(ds->staleness(), timespan{0});
+}
+
+TEST(atomic operations) {
+  endpoint ep;
+  auto ds = ep.attach_master("atomic", memory);
+  REQUIRE(ds);
+  MESSAGE("compare_and_swap");
+  CHECK_EQUAL(value_of(ds->compare_and_swap("lock", data{}, "a")), data{true});
+  CHECK_EQUAL(value_of(ds->compare_and_swap("lock", data{}, "b")),
+              data{false});
+  CHECK_EQUAL(value_of(ds->get("lock")), data{"a"});
+  CHECK_EQUAL(value_of(ds->compare_and_swap("lock", "a", "b")), data{true});
+  CHECK_EQUAL(value_of(ds->get("lock")), data{"b"});
+  MESSAGE("increment_and_get");
+  CHECK_EQUAL(value_of(ds->increment_and_get("counter", 2u)), data{2u});
+  CHECK_EQUAL(value_of(ds->increment_and_get("counter", 3u)), data{5u});
+  CHECK_EQUAL(value_of(ds->get("counter")), data{5u});
 }
 
 TEST(clone operations - same endpoint) {
@@ -105,6 +134,35 @@ TEST(expiration) {
   CHECK_EQUAL(error_of(m->get("foo")), ec::no_such_key);
 }
 
+TEST(change feeds) {
+  using std::chrono::seconds;
+  using kind = store_change::kind;
+  endpoint ep;
+  auto m = ep.attach_master("feeds", memory);
+  REQUIRE(m);
+  auto all = m->subscribe_changes();
+  auto foos = m->subscribe_changes("foo");
+  m->put("foo1", 1);
+  m->put("bar", 2);
+  m->increment("foo1", 1);
+  m->erase("foo1");
+  m->clear();
+  auto xs = foos.get(4, seconds(5));
+  REQUIRE_EQUAL(xs.size(), 4u);
+  CHECK(xs[0].type == kind::put);
+  CHECK_EQUAL(xs[0].key, data{"foo1"});
+  CHECK_EQUAL(xs[0].value, data{1});
+  CHECK(xs[1].type == kind::put);
+  CHECK_EQUAL(xs[1].value, data{2});
+  CHECK(xs[2].type == kind::erase);
+  CHECK_EQUAL(xs[2].key, data{"foo1"});
+  CHECK(xs[3].type == kind::clear);
+  auto ys = all.get(5, seconds(5));
+  REQUIRE_EQUAL(ys.size(), 5u);
+  CHECK_EQUAL(ys[1].key, data{"bar"});
+  CHECK(foos.poll().empty());
+}
+
 TEST(proxy) {
   endpoint ep;
   auto m = ep.attach_master("puneta", memory);
@@ -130,3 +188,111 @@ TEST(proxy) {
   CAF_REQUIRE_EQUAL(key_resp.id, key_id);
   CAF_REQUIRE_EQUAL(value_of(key_resp.answer), data(set{"foo"}));
 }
+
+TEST(proxy receive_all) {
+  endpoint ep;
+  auto m = ep.attach_master("puneta", memory);
+  REQUIRE(m);
+  auto proxy = store::proxy{*m};
+  std::vector<store::response> xs;
+  CHECK_EQUAL(proxy.receive_all(xs), 0u);
+  m->put("foo", 42);
+  MESSAGE("issue queries and wait until all responses arrived");
+  for (int i = 0; i < 10; ++i)
+    proxy.get(i % 2 == 0 ? "foo" : "bar");
+  auto mbox = proxy.mailbox();
+  while (mbox.size() < 10)
+    std::this_thread::sleep_for(milliseconds(1));
+  MESSAGE("collect all responses at once");
+  REQUIRE_EQUAL(proxy.receive_all(xs), 10u);
+  for (size_t i = 0; i < xs.size(); ++i) {
+    CHECK_EQUAL(xs[i].id, i + 1);
+    if (i % 2 == 0)
+      CHECK_EQUAL(value_of(xs[i].answer), data{42});
+    else
+      CHECK_EQUAL(xs[i].answer, error{ec::no_such_key});
+  }
+  CHECK(mbox.empty());
+  MESSAGE("reuse the buffer");
+  CHECK_EQUAL(proxy.receive_all(xs), 0u);
+  CHECK(xs.empty());
+}
+
+TEST(async queries) {
+  endpoint ep;
+  auto m = ep.attach_master("sarkoon", memory);
+  REQUIRE(m);
+  m->put("foo", 42);
+  m->put("bar", set{1, 2});
+  MESSAGE("futures");
+  auto f1 = m->get_async("foo");
+  auto f2 = m->get_async("baz");
+  auto f3 = m->exists_async("bar");
+  auto f4 = m->get_index_from_value_async("bar", 2);
+  auto f5 = m->keys_async();
+  CHECK_EQUAL(value_of(f1.get()), data{42});
+  CHECK_EQUAL(error_of(f2.get()), error{ec::no_such_key});
+  CHECK_EQUAL(value_of(f3.get()), data{true});
+  CHECK_EQUAL(value_of(f4.get()), data{true});
+  CHECK_EQUAL(value_of(f5.get()), data(set{"bar", "foo"}));
+  MESSAGE("callbacks");
+  constexpr size_t num_requests = 1000;
+  std::promise<size_t> done;
+  auto hits = std::make_shared<size_t>(0);
+  auto remaining = std::make_shared<size_t>(num_requests);
+  for (size_t i = 0; i < num_requests; ++i)
+    m->get_async("foo", [=, &done](expected<data> x) {
+      // All callbacks run in the same helper actor, no need to synchronize.
+      if (x && *x == data{42})
+        ++*hits;
+      if (--*remaining == 0)
+        done.set_value(*hits);
+    });
+  CHECK_EQUAL(done.get_future().get(), num_requests);
+  MESSAGE("uninitialized store");
+  CHECK_EQUAL(error_of(store{}.get_async("foo").get()), ec::unspecified);
+}
+
+TEST(endpoint stats) {
+  endpoint ep;
+  auto m = ep.attach_master("stats", memory);
+  REQUIRE(m);
+  auto pub = ep.make_publisher("foo/bar");
+  MESSAGE("stats contain the core, stores, subscribers and publishers");
+  {
+    auto sub = ep.make_subscriber({"foo"});
+    auto x = ep.stats();
+    auto xs = caf::get_if<table>(&x);
+    REQUIRE(xs != nullptr);
+    auto core = caf::get_if<table>(&(*xs)["core"]);
+    REQUIRE(core != nullptr);
+    CHECK(caf::holds_alternative<count>((*core)["mailbox-size"]));
+    CHECK(caf::holds_alternative<table>((*core)["peers"]));
+    auto stores = caf::get_if<vector>(&(*xs)["data-stores"]);
+    REQUIRE(stores != nullptr);
+    REQUIRE_EQUAL(stores->size(), 1u);
+    auto master = caf::get_if<table>(&stores->front());
+    REQUIRE(master != nullptr);
+    CHECK_EQUAL((*master)["name"], data{"stats"});
+    CHECK_EQUAL((*master)["role"], data{"master"});
+    auto subscribers = caf::get_if<vector>(&(*xs)["subscribers"]);
+    REQUIRE(subscribers != nullptr);
+    REQUIRE_EQUAL(subscribers->size(), 1u);
+    CHECK_EQUAL(caf::get<table>(subscribers->front())["topics"],
+                data{vector{"foo"}});
+    auto publishers = caf::get_if<vector>(&(*xs)["publishers"]);
+    REQUIRE(publishers != nullptr);
+    REQUIRE_EQUAL(publishers->size(), 1u);
+    CHECK_EQUAL(caf::get<table>(publishers->front())["topic"],
+                data{"foo/bar"});
+  }
+  MESSAGE("stats drop destroyed subscribers");
+  // The worker of the subscriber releases its queue asynchronously.
+  auto num_subscribers = [&] {
+    auto x = ep.stats();
+    return caf::get<vector>(caf::get<table>(x)["subscribers"]).size();
+  };
+  for (int i = 0; i < 100 && num_subscribers() > 0; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  CHECK_EQUAL(num_subscribers(), 0u);
+}
@@ -7,6 +7,9 @@
 
 #include "test.hh"
 
+#include <algorithm>
+#include <numeric>
+
 #include <caf/actor.hpp>
 #include <caf/downstream.hpp>
 #include <caf/event_based_actor.hpp>
@@ -15,12 +18,15 @@
 
 #include "broker/atoms.hh"
 #include "broker/configuration.hh"
+#include "broker/consumer_group.hh"
 #include "broker/convert.hh"
 #include "broker/core_actor.hh"
 #include "broker/data.hh"
 #include "broker/endpoint.hh"
 #include "broker/filter_type.hh"
 #include "broker/message.hh"
+#include "broker/predicate.hh"
+#include "broker/timeout.hh"
 #include "broker/topic.hh"
 
 using std::cout;
@@ -55,6 +61,14 @@ void driver(event_based_actor* self, const actor& sink) {
     [](const buf_type& xs) { return xs.empty(); });
 }
 
+// Lets `src` peer with `dst` via the loopback interface. Endpoints never
+// deliver their own messages to local subscribers, so tests with real
+// endpoints need a peer on the other side.
+bool connect(endpoint& src, endpoint& dst) {
+  auto port = dst.listen("127.0.0.1", 0);
+  return port != 0 && src.peer("127.0.0.1", port, timeout::seconds(0));
+}
+
 } // namespace <anonymous>
 
 CAF_TEST_FIXTURE_SCOPE(subscriber_tests, base_fixture)
@@ -89,6 +103,15 @@ CAF_TEST(blocking_subscriber) {
   auto expected = data_msgs({{"b", true}, {"b", false},
                              {"b", true}, {"b", false}});
   CAF_CHECK_EQUAL(sub.poll(), expected);
+  CAF_MESSAGE("drain into a caller-owned buffer");
+  anon_send_exit(d1, exit_reason::user_shutdown);
+  d1 = sys.spawn(driver, core1);
+  run();
+  buf xs;
+  xs.reserve(4);
+  CAF_CHECK_EQUAL(sub.poll(xs), 4u);
+  CAF_CHECK_EQUAL(xs, expected);
+  CAF_CHECK_EQUAL(sub.drain([](data_message&&) {}), 0u);
   // Shutdown.
   CAF_MESSAGE("Shutdown core actors.");
   anon_send_exit(core1, exit_reason::user_shutdown);
@@ -97,6 +120,190 @@ CAF_TEST(blocking_subscriber) {
   anon_send_exit(d1, exit_reason::user_shutdown);
 }
 
+CAF_TEST(subscriber_channels) {
+  // Spawn/get/configure core actors.
+  broker_options options;
+  options.disable_ssl = true;
+  auto core1 = sys.spawn(core_actor, filter_type{"a", "b", "c"}, options, nullptr);
+  auto core2 = ep.core();
+  anon_send(core2, atom::subscribe::value, filter_type{"a", "b", "c"});
+  anon_send(core1, atom::no_events::value);
+  anon_send(core2, atom::no_events::value);
+  run();
+  // Split the messages of a single subscriber into two queues.
+  auto sub = ep.make_subscriber(filter_type{"b"});
+  sub.set_rate_calculation(false);
+  auto ch = sub.add_channel(filter_type{"b"});
+  CAF_MESSAGE("move-assigning a channel detaches the previous one");
+  ch = sub.add_channel(filter_type{"a"});
+  CAF_CHECK_EQUAL(ch.filter(), filter_type{"a"});
+  self->send(core1, atom::peer::value, core2);
+  run();
+  auto d1 = sys.spawn(driver, core1);
+  run();
+  CAF_MESSAGE("the channel receives all messages on topic a");
+  CAF_CHECK_EQUAL(ch.poll(), data_msgs({{"a", 0}, {"a", 1}, {"a", 2},
+                                        {"a", 3}, {"a", 4}, {"a", 5}}));
+  CAF_MESSAGE("the subscriber receives all remaining messages");
+  CAF_CHECK_EQUAL(sub.poll(), data_msgs({{"b", true}, {"b", false},
+                                         {"b", true}, {"b", false}}));
+  // Shutdown.
+  CAF_MESSAGE("Shutdown core actors.");
+  anon_send_exit(core1, exit_reason::user_shutdown);
+  anon_send_exit(core2, exit_reason::user_shutdown);
+  anon_send_exit(sub.worker(), exit_reason::user_shutdown);
+  anon_send_exit(d1, exit_reason::user_shutdown);
+}
+
+CAF_TEST(subscriber_partitions) {
+  // Spawn/get/configure core actors.
+  broker_options options;
+  options.disable_ssl = true;
+  auto core1 = sys.spawn(core_actor, filter_type{"a", "b", "c"}, options, nullptr);
+  auto core2 = ep.core();
+  anon_send(core2, atom::subscribe::value, filter_type{"a", "b", "c"});
+  anon_send(core1, atom::no_events::value);
+  anon_send(core2, atom::no_events::value);
+  run();
+  // Partition all messages by their content.
+  auto sub = ep.make_subscriber(filter_type{"a", "b"});
+  sub.set_rate_calculation(false);
+  auto parts = sub.add_partitions(3, {});
+  CAF_REQUIRE_EQUAL(parts.size(), 3u);
+  self->send(core1, atom::peer::value, core2);
+  run();
+  auto d1 = sys.spawn(driver, core1);
+  run();
+  CAF_MESSAGE("the partitions receive all messages");
+  std::vector<std::vector<data_message>> xss;
+  size_t total = 0;
+  for (auto& part : parts) {
+    xss.emplace_back(part.poll());
+    total += xss.back().size();
+  }
+  CAF_CHECK_EQUAL(total, 10u);
+  CAF_CHECK(sub.poll().empty());
+  CAF_MESSAGE("messages with the same key share a partition");
+  for (auto x : {data{true}, data{false}}) {
+    auto has_key = [&](const std::vector<data_message>& xs) {
+      return std::any_of(xs.begin(), xs.end(), [&](const data_message& y) {
+        return get_data(y) == x;
+      });
+    };
+    CAF_CHECK_EQUAL(std::count_if(xss.begin(), xss.end(), has_key), 1);
+  }
+  // Shutdown.
+  anon_send_exit(core1, exit_reason::user_shutdown);
+  anon_send_exit(core2, exit_reason::user_shutdown);
+  anon_send_exit(sub.worker(), exit_reason::user_shutdown);
+  anon_send_exit(d1, exit_reason::user_shutdown);
+}
+
+CAF_TEST(subscriber_workers) {
+  // Spawn/get/configure core actors.
+  broker_options options;
+  options.disable_ssl = true;
+  auto core1 = sys.spawn(core_actor, filter_type{"a", "b", "c"}, options, nullptr);
+  auto core2 = ep.core();
+  anon_send(core2, atom::subscribe::value, filter_type{"a", "b", "c"});
+  anon_send(core1, atom::no_events::value);
+  anon_send(core2, atom::no_events::value);
+  run();
+  // Spread all messages over three workers.
+  auto sub = ep.make_subscriber(filter_type{"a", "b"});
+  sub.set_rate_calculation(false);
+  auto workers = sub.add_workers(3);
+  CAF_REQUIRE_EQUAL(workers.size(), 3u);
+  self->send(core1, atom::peer::value, core2);
+  run();
+  auto d1 = sys.spawn(driver, core1);
+  run();
+  CAF_MESSAGE("the workers receive all messages in equal shares");
+  std::vector<size_t> sizes;
+  for (auto& worker : workers)
+    sizes.emplace_back(worker.poll().size());
+  CAF_CHECK_EQUAL(std::accumulate(sizes.begin(), sizes.end(), size_t{0}), 10u);
+  auto [lo, hi] = std::minmax_element(sizes.begin(), sizes.end());
+  CAF_CHECK(*hi - *lo <= 1u);
+  CAF_CHECK(sub.poll().empty());
+  // Shutdown.
+  anon_send_exit(core1, exit_reason::user_shutdown);
+  anon_send_exit(core2, exit_reason::user_shutdown);
+  anon_send_exit(sub.worker(), exit_reason::user_shutdown);
+  anon_send_exit(d1, exit_reason::user_shutdown);
+}
+
+CAF_TEST(subscriber_predicates) {
+  // Spawn/get/configure core actors.
+  broker_options options;
+  options.disable_ssl = true;
+  auto core1 = sys.spawn(core_actor, filter_type{"a", "b", "c"}, options, nullptr);
+  auto core2 = ep.core();
+  anon_send(core2, atom::subscribe::value, filter_type{"a", "b", "c"});
+  anon_send(core1, atom::no_events::value);
+  anon_send(core2, atom::no_events::value);
+  run();
+  // Only accept `true` values on topic "b".
+  predicate pred;
+  pred.fields.emplace_back(field_condition{{}, data{true}});
+  auto sub = ep.make_subscriber(filter_type{"b"}, std::move(pred));
+  sub.set_rate_calculation(false);
+  self->send(core1, atom::peer::value, core2);
+  run();
+  auto d1 = sys.spawn(driver, core1);
+  run();
+  CAF_MESSAGE("the core drops messages that fail the predicate");
+  CAF_CHECK_EQUAL(sub.poll(), data_msgs({{"b", true}, {"b", true}}));
+  // Shutdown.
+  anon_send_exit(core1, exit_reason::user_shutdown);
+  anon_send_exit(core2, exit_reason::user_shutdown);
+  anon_send_exit(sub.worker(), exit_reason::user_shutdown);
+  anon_send_exit(d1, exit_reason::user_shutdown);
+}
+
+CAF_TEST(consumer_groups) {
+  // Spawn/get/configure core actors.
+  broker_options options;
+  options.disable_ssl = true;
+  auto core1 = sys.spawn(core_actor, filter_type{"a", "b", "c"}, options, nullptr);
+  auto core2 = ep.core();
+  anon_send(core2, atom::subscribe::value, filter_type{"a", "b", "c"});
+  anon_send(core1, atom::no_events::value);
+  anon_send(core2, atom::no_events::value);
+  run();
+  // Two members of a group share topic "b", a third subscriber sees all.
+  consumer_group group{"workers", group_policy::round_robin};
+  auto m1 = ep.make_subscriber(filter_type{"b"}, group);
+  auto m2 = ep.make_subscriber(filter_type{"b"}, group);
+  auto all = ep.make_subscriber(filter_type{"b"});
+  for (auto sub : {&m1, &m2, &all})
+    sub->set_rate_calculation(false);
+  self->send(core1, atom::peer::value, core2);
+  run();
+  auto d1 = sys.spawn(driver, core1);
+  run();
+  CAF_MESSAGE("the core delivers each message to one member of the group");
+  auto xs = m1.poll();
+  auto ys = m2.poll();
+  CAF_CHECK_EQUAL(xs.size(), 2u);
+  CAF_CHECK_EQUAL(ys.size(), 2u);
+  xs.insert(xs.end(), ys.begin(), ys.end());
+  auto zs = all.poll();
+  CAF_CHECK_EQUAL(zs.size(), 4u);
+  auto less = [](const data_message& x, const data_message& y) {
+    return get_data(x) < get_data(y);
+  };
+  std::sort(xs.begin(), xs.end(), less);
+  std::sort(zs.begin(), zs.end(), less);
+  CAF_CHECK_EQUAL(xs, zs);
+  // Shutdown.
+  anon_send_exit(core1, exit_reason::user_shutdown);
+  anon_send_exit(core2, exit_reason::user_shutdown);
+  for (auto sub : {&m1, &m2, &all})
+    anon_send_exit(sub->worker(), exit_reason::user_shutdown);
+  anon_send_exit(d1, exit_reason::user_shutdown);
+}
+
 CAF_TEST(nonblocking_subscriber) {
   // Spawn/get/configure core actors.
   broker_options options;
@@ -137,3 +344,88 @@ CAF_TEST(nonblocking_subscriber) {
 }
 
 CAF_TEST_FIXTURE_SCOPE_END()
+
+CAF_TEST(batched_publishing) {
+  broker_options options;
+  options.disable_ssl = true;
+  options.ignore_broker_conf = true;
+  configuration cfg{options};
+  cfg.set("broker.publish-batch-size", 4);
+  endpoint ep{std::move(cfg)};
+  endpoint peer{configuration{options}};
+  auto sub = peer.make_subscriber(filter_type{"a"});
+  // Blocking waits for the worker to connect to the core.
+  sub.add_topic("b", true);
+  CAF_REQUIRE(connect(ep, peer));
+  std::vector<data_message> expected;
+  for (int i = 0; i < 10; ++i) {
+    ep.publish("a", i);
+    expected.emplace_back(make_data_message("a", i));
+  }
+  CAF_MESSAGE("the last two messages arrive after the batch delay");
+  CAF_CHECK_EQUAL(sub.get(10, to_duration(10)), expected);
+}
+
+CAF_TEST(bulk_topic_updates) {
+  broker_options options;
+  options.disable_ssl = true;
+  options.ignore_broker_conf = true;
+  endpoint ep{configuration{options}};
+  endpoint peer{configuration{options}};
+  auto sub = peer.make_subscriber(filter_type{"x"});
+  CAF_CHECK(sub.update_topics(filter_type{"a", "b"}, filter_type{"x"}, true));
+  CAF_CHECK(!sub.update_topics(filter_type{"a"}, filter_type{"y"}, true));
+  CAF_REQUIRE(connect(ep, peer));
+  ep.publish("x", 0);
+  ep.publish("a", 1);
+  ep.publish("b", 2);
+  CAF_CHECK_EQUAL(sub.get(2, to_duration(10)), data_msgs({{"a", 1}, {"b", 2}}));
+  CAF_CHECK_EQUAL(sub.available(), 0u);
+}
+
+CAF_TEST(fast_start) {
+  broker_options options;
+  options.disable_ssl = true;
+  options.fast_start = true;
+  configuration cfg{options};
+  CAF_CHECK_EQUAL(get_or(cfg, "scheduler.max-threads", size_t{0}), 2u);
+  endpoint ep{std::move(cfg)};
+  options.fast_start = false;
+  options.ignore_broker_conf = true;
+  endpoint peer{configuration{options}};
+  auto sub = peer.make_subscriber(filter_type{"a"});
+  // Blocking waits for the worker to connect to the core.
+  sub.add_topic("b", true);
+  CAF_REQUIRE(connect(ep, peer));
+  ep.publish("a", 1);
+  CAF_CHECK_EQUAL(sub.get(to_duration(10)), make_data_message("a", 1));
+}
+
+CAF_TEST(shared_actor_system) {
+  broker_options options;
+  options.disable_ssl = true;
+  options.ignore_broker_conf = true;
+  auto sys = make_shared_system(configuration{options});
+  endpoint ep1{configuration{options}, sys};
+  endpoint ep2{configuration{options}, sys};
+  CAF_CHECK_EQUAL(&ep1.system(), &ep2.system());
+  auto sub1 = ep1.make_subscriber(filter_type{"a"});
+  auto sub2 = ep2.make_subscriber(filter_type{"a"});
+  // Blocking waits for the workers to connect to their cores.
+  sub1.add_topic("b", true);
+  sub2.add_topic("b", true);
+  CAF_REQUIRE(connect(ep1, ep2));
+  CAF_MESSAGE("endpoints on a shared system keep separate cores");
+  ep1.publish("a", 1);
+  ep2.publish("a", 2);
+  CAF_CHECK_EQUAL(sub1.get(to_duration(10)), make_data_message("a", 2));
+  CAF_CHECK_EQUAL(sub2.get(to_duration(10)), make_data_message("a", 1));
+  CAF_CHECK_EQUAL(sub1.available(), 0u);
+  CAF_CHECK_EQUAL(sub2.available(), 0u);
+  CAF_MESSAGE("shutting down one endpoint leaves the system running");
+  ep1.shutdown();
+  endpoint ep3{configuration{options}, sys};
+  CAF_REQUIRE(connect(ep3, ep2));
+  ep3.publish("b", 3);
+  CAF_CHECK_EQUAL(sub2.get(to_duration(10)), make_data_message("b", 3));
+}
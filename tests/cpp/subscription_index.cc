@@ -0,0 +1,60 @@
+#define SUITE subscription_index
+
+#include "broker/detail/subscription_index.hh"
+
+#include "test.hh"
+
+using namespace broker;
+
+namespace {
+
+using index_type = detail::subscription_index<int>;
+
+using key_list = index_type::key_list;
+
+struct fixture {
+  index_type idx;
+
+  fixture() {
+    idx.update(1, {"/zeek/events"_t, "/zeek/stores"_t});
+    idx.update(2, {"/zeek"_t});
+    idx.update(3, {"/foo"_t, "/zeek/events/debug"_t});
+  }
+};
+
+} // namespace <anonymous>
+
+FIXTURE_SCOPE(subscription_index_tests, fixture)
+
+TEST(matching) {
+  CHECK_EQUAL(idx.size(), 3u);
+  CHECK_EQUAL(idx.match("/zeek/events/debug/x"_t), key_list({1, 2, 3}));
+  CHECK_EQUAL(idx.match("/zeek/events"_t), key_list({1, 2}));
+  CHECK_EQUAL(idx.match("/zeek/logs"_t), key_list({2}));
+  CHECK_EQUAL(idx.match("/foo/bar"_t), key_list({3}));
+  CHECK_EQUAL(idx.match("/bar"_t), key_list{});
+  CHECK(idx.matches(1, "/zeek/stores/x"_t));
+  CHECK(!idx.matches(3, "/zeek/stores/x"_t));
+}
+
+TEST(updates) {
+  CHECK(idx.matches(1, "/zeek/events"_t));
+  idx.update(1, {"/foo"_t});
+  CHECK(!idx.matches(1, "/zeek/events"_t));
+  CHECK_EQUAL(idx.match("/foo"_t), key_list({1, 3}));
+  idx.erase(3);
+  CHECK_EQUAL(idx.match("/foo"_t), key_list({1}));
+  CHECK_EQUAL(idx.match("/zeek/events/debug"_t), key_list({2}));
+  CHECK(idx.filter(3) == nullptr);
+  CHECK_EQUAL(idx.size(), 2u);
+}
+
+TEST(wildcards) {
+  idx.update(4, {""_t});
+  CHECK_EQUAL(idx.match("/bar"_t), key_list({4}));
+  CHECK_EQUAL(idx.match("/zeek/logs"_t), key_list({2, 4}));
+  idx.erase(4);
+  CHECK_EQUAL(idx.match("/bar"_t), key_list{});
+}
+
+FIXTURE_SCOPE_END()
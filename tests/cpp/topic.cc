@@ -4,6 +4,9 @@
 
 #include "test.hh"
 
+#include <caf/binary_deserializer.hpp>
+#include <caf/binary_serializer.hpp>
+
 using namespace broker;
 
 namespace {
@@ -99,3 +102,35 @@ TEST(prefix) {
   CAF_CHECK( t5.prefix_of(t4));
   CAF_CHECK( t5.prefix_of(t5));
 }
+
+TEST(classification) {
+  CHECK(!"foo/bar"_t.is_internal());
+  CHECK(!"foo/bar"_t.is_control());
+  CHECK(topics::statuses.is_internal());
+  CHECK(topics::statuses.is_control());
+  auto master = "store"_t / topics::master_suffix;
+  CHECK(master.is_internal());
+  CHECK(!master.is_control());
+  CHECK(master.is_master_topic());
+  CHECK(!master.is_clone_topic());
+  auto clone = "store"_t / topics::clone_suffix;
+  CHECK(clone.is_clone_topic());
+  CHECK(!clone.is_master_topic());
+  topic t{"store"};
+  CHECK(!t.is_internal());
+  t /= topics::clone_suffix;
+  CHECK(t.is_clone_topic());
+}
+
+TEST(deserialized topics carry their classification) {
+  caf::binary_serializer::container_type buf;
+  caf::binary_serializer sink{nullptr, buf};
+  auto clone = "store"_t / topics::clone_suffix;
+  REQUIRE(!sink(clone));
+  topic t;
+  caf::binary_deserializer source{nullptr, buf};
+  REQUIRE(!source(t));
+  CHECK_EQUAL(t, clone);
+  CHECK(t.is_clone_topic());
+  CHECK(t.is_internal());
+}
@@ -0,0 +1,64 @@
+#define SUITE topic_summary
+
+#include "broker/topic_summary.hh"
+
+#include "test.hh"
+
+#include <string>
+
+using namespace broker;
+
+namespace {
+
+filter_type sensors(size_t n) {
+  filter_type result;
+  for (size_t i = 0; i < n; ++i)
+    result.emplace_back("zeek/sensor/" + std::to_string(i) + "/conn");
+  return result;
+}
+
+} // namespace <anonymous>
+
+TEST(empty summaries cover nothing) {
+  topic_summary uut;
+  CHECK(uut.empty());
+  CHECK(!uut.covers("foo"));
+  topic_summary uut2{filter_type{}, 10};
+  CHECK(uut2.empty());
+  CHECK(!uut2.covers("foo"));
+}
+
+TEST(summaries cover all topics of their filter) {
+  auto xs = sensors(10000);
+  topic_summary uut{xs, xs.size()};
+  CHECK_LESS(uut.num_bits(), xs.size() * 16);
+  for (auto& x : xs) {
+    CHECK(uut.covers(x));
+    CHECK(uut.covers(x / "tcp"));
+  }
+}
+
+TEST(summaries reject most other topics) {
+  auto xs = sensors(10000);
+  topic_summary uut{xs, xs.size()};
+  size_t false_positives = 0;
+  for (size_t i = 0; i < 10000; ++i)
+    if (uut.covers(topic{"zeek/sensor/" + std::to_string(i) + "/dns"}))
+      ++false_positives;
+  CHECK_LESS(false_positives, 1000u);
+  CHECK(!uut.covers("zeek/sensor"));
+}
+
+TEST(the empty topic covers everything) {
+  topic_summary uut{filter_type{topic{}}, 1};
+  CHECK(uut.covers("foo"));
+  CHECK(uut.covers(""));
+}
+
+TEST(summaries grow with new topics) {
+  topic_summary uut{filter_type{"a/b"}, 10};
+  CHECK(!uut.covers("c/d"));
+  uut.add("c");
+  CHECK(uut.covers("c/d"));
+  CHECK(uut.covers("a/b/c"));
+}
@@ -20,3 +20,84 @@ TEST(event) {
   CHECK_EQUAL(ev2.name(), "test");
   CHECK_EQUAL(ev2.args(), args);
 }
+
+TEST(event_builder) {
+  auto args = vector{1, "s", port(42, port::protocol::tcp)};
+  zeek::EventBuilder builder{"test", 3};
+  builder.add(1).add("s").add(port(42, port::protocol::tcp));
+  auto ev = std::move(builder).build();
+  CHECK(ev.valid());
+  CHECK_EQUAL(ev.type(), zeek::Message::Type::Event);
+  CHECK_EQUAL(ev.name(), "test");
+  CHECK_EQUAL(ev.args(), args);
+  CHECK_EQUAL(ev.as_data(), zeek::Event("test", vector(args)).as_data());
+}
+
+TEST(event_view) {
+  auto args = vector{1, "s"};
+  zeek::Event ev("test", vector(args));
+  zeek::EventView view{ev};
+  REQUIRE(view.valid());
+  CHECK_EQUAL(view.name(), "test");
+  CHECK(view.name_view() == "test");
+  CHECK_EQUAL(view.args(), args);
+  CHECK(!zeek::EventView{data{}}.valid());
+  CHECK(!zeek::EventView{data{vector{zeek::ProtocolVersion}}}.valid());
+  zeek::IdentifierUpdate update{"x", 42};
+  CHECK(!zeek::EventView{update.as_data()}.valid());
+}
+
+TEST(typed_event) {
+  zeek::TypedEvent<count, address, port> conn_state{"conn_state"};
+  address addr;
+  REQUIRE(convert("10.0.0.1", addr));
+  auto ev = conn_state.make(42u, addr, port(80, port::protocol::tcp));
+  CHECK(ev.valid());
+  CHECK_EQUAL(ev.name(), "conn_state");
+  CHECK_EQUAL(ev.args(), (vector{42u, addr, port(80, port::protocol::tcp)}));
+  auto xs = conn_state.unpack(ev.as_data());
+  REQUIRE(xs);
+  CHECK_EQUAL(std::get<0>(*xs), 42u);
+  CHECK_EQUAL(std::get<1>(*xs), addr);
+  CHECK_EQUAL(std::get<2>(*xs), port(80, port::protocol::tcp));
+  // Name, arity, and argument types must match.
+  CHECK(!conn_state.matches(zeek::Event("other", ev.args()).as_data()));
+  CHECK(!conn_state.matches(zeek::Event("conn_state", vector{42u}).as_data()));
+  CHECK(!conn_state.matches(
+    zeek::Event("conn_state", vector{42, addr, port()}).as_data()));
+  CHECK(!conn_state.matches(data{}));
+  // The type `data` accepts any argument.
+  zeek::TypedEvent<std::string, data> any{"any"};
+  auto ys = any.unpack(zeek::Event("any", vector{"x", 1.5}).as_data());
+  REQUIRE(ys);
+  CHECK_EQUAL(std::get<0>(*ys), "x");
+  CHECK_EQUAL(std::get<1>(*ys), data{1.5});
+}
+
+TEST(log_batch) {
+  zeek::LogBatch batch{enum_value{"Conn::LOG"}, enum_value{"Log::WRITER_ASCII"},
+                       "conn", 2};
+  CHECK(batch.valid());
+  CHECK_EQUAL(batch.num_fields(), 2u);
+  CHECK_EQUAL(batch.num_rows(), 0u);
+  batch.add_row(vector{1, "a"});
+  batch.add_row(vector{2, "b"});
+  zeek::LogBatch received{batch.as_data()};
+  REQUIRE(received.valid());
+  CHECK_EQUAL(received.type(), zeek::Message::Type::LogBatch);
+  CHECK_EQUAL(received.stream_id(), enum_value{"Conn::LOG"});
+  CHECK_EQUAL(received.path(), data{"conn"});
+  CHECK_EQUAL(received.num_rows(), 2u);
+  std::vector<data> ids;
+  std::vector<data> names;
+  for (auto row : received) {
+    CHECK_EQUAL(row.size(), 2u);
+    ids.emplace_back(row[0]);
+    names.emplace_back(row[1]);
+  }
+  CHECK_EQUAL(ids, (std::vector<data>{1, 2}));
+  CHECK_EQUAL(names, (std::vector<data>{"a", "b"}));
+  CHECK(!zeek::LogBatch(enum_value{"x"}, enum_value{"y"}, "p",
+                        vector{vector{1, 2}, vector{3}})
+           .valid());
+}
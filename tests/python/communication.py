@@ -5,11 +5,23 @@ from __future__ import unicode_literals
 import unittest
 import multiprocessing
 import sys
+import threading
 import time
 import ipaddress
 
 import broker
 
+def count_progress(f):
+    # Runs f in a separate thread and returns how often the calling thread
+    # got to run Python code until f returned.
+    t = threading.Thread(target=f)
+    n = 0
+    t.start()
+    while t.is_alive():
+        n += 1
+    t.join()
+    return n
+
 class TestCommunication(unittest.TestCase):
     def test_ping(self):
         # --peer-start
@@ -87,6 +99,99 @@ class TestCommunication(unittest.TestCase):
         ep1.shutdown()
         ep2.shutdown()
 
+    def test_poll_into(self):
+        ep1 = broker.Endpoint()
+        ep2 = broker.Endpoint()
+        s1 = ep1.make_subscriber("/test")
+        port = ep1.listen("127.0.0.1", 0)
+        ep2.peer("127.0.0.1", port, 1.0)
+
+        msg1 = ("/test/1", (1, "foo", {"a": ipaddress.IPv4Address('1.2.3.4')}))
+        msg2 = ("/test/2", (1.5, 2.5, 3.5))
+        ep2.publish_batch(msg1, msg2)
+
+        msgs = []
+        n = 0
+        while n < 2:
+            n += s1.poll_into(msgs, 2, 1.0, numeric_vectors=True)
+        self.assertEqual(n, 2)
+        self.assertFalse(s1.available())
+        self.assertEqual(msgs[0], msg1)
+        self.assertEqual(msgs[1][0], "/test/2")
+        self.assertEqual(len(msgs[1][1]), 3)
+        self.assertEqual(memoryview(msgs[1][1]).tolist(), [1.5, 2.5, 3.5])
+        self.assertEqual(s1.poll_into(msgs, 10), 0)
+
+        ep1.shutdown()
+        ep2.shutdown()
+
+    def test_poll_arrow(self):
+        try:
+            import pyarrow
+        except ImportError:
+            self.skipTest("requires pyarrow")
+        ep1 = broker.Endpoint()
+        ep2 = broker.Endpoint()
+        s1 = ep1.make_subscriber("/test")
+        port = ep1.listen("127.0.0.1", 0)
+        ep2.peer("127.0.0.1", port, 1.0)
+
+        ep2.publish_batch(("/test/1", (1, "foo", 0.5)),
+                          ("/test/2", (2, None, 1.5)))
+
+        rows = 0
+        columns = {}
+        while rows < 2:
+            batch = s1.poll_arrow(2 - rows, 1.0, names=["id", "name"])
+            for k, v in batch.to_pydict().items():
+                columns.setdefault(k, []).extend(v)
+            rows += batch.num_rows
+        self.assertEqual(columns, {"id": [1, 2], "name": ["foo", None],
+                                   "f2": [0.5, 1.5]})
+
+        ep2.publish_batch(("/test/3", (1,)), ("/test/4", (1, 2)))
+        while s1.available() < 2:
+            time.sleep(0.1)
+        self.assertRaises(ValueError, s1.poll_arrow)
+
+        ep1.shutdown()
+        ep2.shutdown()
+
+    @unittest.skipIf(sys.version_info < (3, 5), "requires asyncio")
+    def test_async_subscriber(self):
+        import asyncio
+        ep1 = broker.Endpoint()
+        ep2 = broker.Endpoint()
+        s1 = ep1.make_subscriber("/test")
+        port = ep1.listen("127.0.0.1", 0)
+        ep2.peer("127.0.0.1", port, 1.0)
+
+        loop = asyncio.new_event_loop()
+        it = s1.__aiter__()
+        pending = loop.create_task(it.__anext__())
+        ep2.publish_batch(("/test/1", 1), ("/test/2", 2))
+        msg1 = loop.run_until_complete(pending)
+        msg2 = loop.run_until_complete(it.__anext__())
+        self.assertEqual(msg1, ("/test/1", 1))
+        self.assertEqual(msg2, ("/test/2", 2))
+        loop.close()
+
+        ep1.shutdown()
+        ep2.shutdown()
+
+    def test_blocking_calls_release_gil(self):
+        ep = broker.Endpoint()
+        s = ep.make_subscriber("/test")
+        es = ep.make_status_subscriber(True)
+
+        # Both calls time out after waiting for a second without holding the
+        # GIL, i.e., this thread keeps running in the meantime.
+        self.assertGreater(count_progress(lambda: s.get(1.0)), 1000)
+        self.assertGreater(count_progress(lambda: es.get(1.0)), 1000)
+        self.assertGreater(count_progress(lambda: s.get(2, 1.0)), 1000)
+
+        ep.shutdown()
+
     def test_status_subscriber(self):
         # --status-start
         ep1 = broker.Endpoint()
@@ -134,6 +134,25 @@ class TestStore(unittest.TestCase):
         ep1.shutdown()
         ep2.shutdown()
 
+    @unittest.skipIf(sys.version_info < (3, 5), "requires asyncio")
+    def test_async_queries(self):
+        import asyncio
+        ep = broker.Endpoint()
+        m = ep.attach_master("test", broker.Backend.Memory)
+        m.put("a", "A")
+        m.put("b", {1: "X"})
+
+        loop = asyncio.new_event_loop()
+        run = loop.run_until_complete
+        self.assertEqual(run(m.get_async("a", loop)), "A")
+        self.assertEqual(run(m.get_async("X", loop)), None)
+        self.assertEqual(run(m.exists_async("b", loop)), True)
+        self.assertEqual(run(m.get_index_from_value_async("b", 1, loop)), "X")
+        self.assertEqual(run(m.keys_async(loop)), {"a", "b"})
+        loop.close()
+
+        ep.shutdown()
+
     def test_from_clones(self):
         (ep0, ep1, ep2, m, c1, c2) = create_stores()
 